@@ -0,0 +1,647 @@
+/**
+ * @file core_bench.cpp
+ * @brief Google Benchmark suite of the likelihoods, modules and samplers, built without R
+ *
+ * Every benchmark runs on a mixture from synthetic::generate_mixture_data() with n points and K
+ * true clusters, the chain state set to the true allocations. Throughput is reported as
+ * items_per_second (calls, or point updates for the samplers) and bytes_per_second, from an
+ * estimate of the bytes each call reads (see the comment of each benchmark).
+ *
+ * The sampler and module benchmarks also report allocs_per_iteration, the heap allocations
+ * (malloc, and so operator new and Eigen) made inside the timed loop per iteration, counted by
+ * interposing malloc on glibc: a steady-state Gibbs sweep (K no longer reaching new maxima) is
+ * expected to make none.
+ *
+ * n in {1k, 10k, 50k}. The benchmarks that need the n x n distance matrix stop at 10k by default
+ * (dense D and log D take 16 n^2 bytes, 40 GB at 50k); set BNP_BENCH_LARGE=1 to include 50k.
+ * Build and run (see bench/CMakeLists.txt):
+ *
+ *     cmake -S bench -B build-bench -DCMAKE_BUILD_TYPE=Release && cmake --build build-bench -j
+ *     ./build-bench/core_bench --benchmark_filter=Natarajan
+ *
+ * @author Filippo Galli
+ * @date 2025
+ */
+
+#include "synthetic_data.hpp"
+
+#include "../src/likelihoods/Natarajan_likelihood.hpp"
+#include "../src/likelihoods/caches/distance_cache.hpp"
+#include "../src/processes/DP.hpp"
+#include "../src/processes/caches/binary_cache.hpp"
+#include "../src/processes/caches/categorical_cache.hpp"
+#include "../src/processes/caches/continuos_cache.hpp"
+#include "../src/processes/caches/multi_continuos_cache.hpp"
+#include "../src/processes/caches/spatial_cache.hpp"
+#include "../src/processes/module/binary_covariate_module.hpp"
+#include "../src/processes/module/binary_covariate_module_cache.hpp"
+#include "../src/processes/module/categorical_covariate_module.hpp"
+#include "../src/processes/module/categorical_covariate_module_cache.hpp"
+#include "../src/processes/module/continuos_covariate_module.hpp"
+#include "../src/processes/module/continuos_covariate_module_cache.hpp"
+#include "../src/processes/module/multi_continuos_covariate_module_cache.hpp"
+#include "../src/processes/module/spatial_module.hpp"
+#include "../src/processes/module/spatial_module_cache.hpp"
+#include "../src/processes/DPx.hpp"
+#include "../src/samplers/neal.hpp"
+#include "../src/samplers/neal_ZDNAM.hpp"
+#include "../src/samplers/splitmerge_LSS_SDDS.hpp"
+#include "../src/utils/Data.hpp"
+#include "../src/utils/Datax.hpp"
+#include "../src/utils/Params.hpp"
+#include "../src/utils/SweepOrder.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <vector>
+
+// ========== Allocation counting ==========
+
+namespace {
+std::atomic<std::uint64_t> heap_allocations{0}; ///< Calls to the malloc family since start-up
+}
+
+#if defined(__GLIBC__)
+// The bench executable interposes the allocation entry points of glibc, forwarding to the
+// __libc_ implementations; free() and the memory returned are unchanged.
+extern "C" {
+void *__libc_malloc(std::size_t size);
+void *__libc_calloc(std::size_t count, std::size_t size);
+void *__libc_realloc(void *ptr, std::size_t size);
+void *__libc_memalign(std::size_t alignment, std::size_t size);
+
+void *malloc(std::size_t size) {
+    heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void *calloc(std::size_t count, std::size_t size) {
+    heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, std::size_t size) {
+    heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+
+void *aligned_alloc(std::size_t alignment, std::size_t size) {
+    heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **ptr, std::size_t alignment, std::size_t size) {
+    heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    void *p = __libc_memalign(alignment, size);
+    if (!p)
+        return 12; // ENOMEM
+    *ptr = p;
+    return 0;
+}
+}
+#define BNP_BENCH_COUNTS_ALLOCATIONS 1
+#else
+#define BNP_BENCH_COUNTS_ALLOCATIONS 0
+#endif
+
+namespace {
+
+/**
+ * @brief Counts the heap allocations of a timed loop
+ *
+ * Construct it right before the loop and call report() after it: allocs_per_iteration is set to
+ * the allocations in between divided by the iterations (not reported where malloc is not
+ * interposed).
+ */
+class AllocationCounter {
+public:
+    AllocationCounter() : start(heap_allocations.load(std::memory_order_relaxed)) {}
+
+    void report(benchmark::State &state) const {
+        if (!BNP_BENCH_COUNTS_ALLOCATIONS)
+            return;
+        const double count = static_cast<double>(heap_allocations.load(std::memory_order_relaxed) - start);
+        state.counters["allocs_per_iteration"] = benchmark::Counter(count, benchmark::Counter::kAvgIterations);
+    }
+
+private:
+    std::uint64_t start;
+};
+
+// ========== Fixtures ==========
+
+/**
+ * @brief Data set, parameters and true allocations for one (n, K)
+ *
+ * Building D is the slow part, so the last fixture is kept: the arguments of one benchmark
+ * family reuse it and memory holds a single D at a time.
+ */
+struct Fixture {
+    int n, K;
+    bool with_distances;
+    synthetic::MixtureData mixture;
+    std::unique_ptr<Params> params; ///< Referenced by Data, so it must not move
+    Eigen::VectorXi allocations;    ///< True allocations; referenced by some caches
+};
+
+const Fixture &fixture(int n, int K, bool with_distances) {
+    static std::unique_ptr<Fixture> current;
+    if (current && current->n == n && current->K == K && current->with_distances == with_distances)
+        return *current;
+
+    current.reset(); // release the previous D first
+    auto next = std::make_unique<Fixture>();
+    next->n = n;
+    next->K = K;
+    next->with_distances = with_distances;
+    next->mixture = synthetic::generate_mixture_data(n, K);
+    Eigen::MatrixXd D = with_distances ? synthetic::euclidean_distances(next->mixture.points) : Eigen::MatrixXd();
+    next->params = std::make_unique<Params>(0.5, 2, 2, 2, 2, 2, 0, 0, 1.0, 1.0, 1.0, std::move(D));
+    next->params->n = n;
+    next->allocations = next->mixture.clusts;
+    current = std::move(next);
+    return *current;
+}
+
+/** @brief Mean cluster size of the true allocations */
+double mean_cluster_size(const Fixture &f) { return static_cast<double>(f.n) / f.K; }
+
+void distance_sizes(benchmark::internal::Benchmark *b) {
+    const bool large = std::getenv("BNP_BENCH_LARGE") != nullptr;
+    for (int n : {1000, 10000, 50000}) {
+        if (n > 10000 && !large)
+            continue;
+        for (int K : {4, 16, 64})
+            b->Args({n, K});
+    }
+}
+
+void module_sizes(benchmark::internal::Benchmark *b) {
+    for (int n : {1000, 10000, 50000})
+        for (int K : {4, 16, 64})
+            b->Args({n, K});
+}
+
+/** @brief Sweeps run before the timed loop of the Gibbs benchmarks */
+constexpr int warm_up_sweeps = 10;
+
+void warm_up(Sampler &sampler) {
+    for (int i = 0; i < warm_up_sweeps; ++i)
+        sampler.step();
+}
+
+/**
+ * @brief Timed loop of the sampler benchmarks: one step per iteration
+ * @param sampler Sampler to step, already configured
+ * @param data Data of the sampler, for the K counter
+ * @param items_per_step Items reported per step (point updates of a sweep, or 1 for a proposal)
+ * @param warm Whether to run warm_up() out of the loop first (the Gibbs sweeps)
+ *
+ * Reports the heap allocations per iteration, the items and the final number of clusters; the
+ * caller adds the bytes, which depend on the sampler.
+ */
+void run_steps(benchmark::State &state, Sampler &sampler, const Data &data, double items_per_step, bool warm = true) {
+    if (warm)
+        warm_up(sampler);
+    AllocationCounter allocations;
+    for (auto _ : state)
+        sampler.step();
+    allocations.report(state);
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * items_per_step));
+    state.counters["K"] = data.get_K();
+}
+
+void sampler_sizes(benchmark::internal::Benchmark *b) {
+    for (int n : {1000, 10000})
+        for (int K : {4, 16})
+            b->Args({n, K});
+}
+
+// ========== Likelihood ==========
+
+// One cluster: gathers n_k entries of the row of D and of log D (8 + 8 bytes) by index (4 bytes)
+void BM_Natarajan_point_loglikelihood_cond(benchmark::State &state) {
+    const Fixture &f = fixture(state.range(0), state.range(1), true);
+    Data data(*f.params, f.allocations);
+    Natarajan_likelihood likelihood(data, *f.params);
+    int point = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(likelihood.point_loglikelihood_cond(point, point % f.K));
+        point = (point + 7919) % f.n;
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * mean_cluster_size(f) * 20));
+}
+BENCHMARK(BM_Natarajan_point_loglikelihood_cond)->Apply(distance_sizes);
+
+// All clusters at once: one pass over the row of D and log D plus the allocations (20 bytes per point)
+void BM_Natarajan_point_loglikelihood_cond_all(benchmark::State &state) {
+    const Fixture &f = fixture(state.range(0), state.range(1), true);
+    Data data(*f.params, f.allocations);
+    Natarajan_likelihood likelihood(data, *f.params);
+    Eigen::VectorXd out(data.get_K() + 1);
+    int point = 0;
+    for (auto _ : state) {
+        likelihood.point_loglikelihood_cond_all(point, out);
+        benchmark::DoNotOptimize(out.data());
+        point = (point + 7919) % f.n;
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * f.n * 20.0));
+}
+BENCHMARK(BM_Natarajan_point_loglikelihood_cond_all)->Apply(distance_sizes);
+
+// As above, split over state.range(2) threads (see Sampler::set_gibbs_threads())
+void BM_Natarajan_point_loglikelihood_cond_all_parallel(benchmark::State &state) {
+    const Fixture &f = fixture(state.range(0), state.range(1), true);
+    Data data(*f.params, f.allocations);
+    Natarajan_likelihood likelihood(data, *f.params);
+    Eigen::VectorXd out(data.get_K() + 1);
+    const int n_threads = state.range(2);
+    int point = 0;
+    for (auto _ : state) {
+        likelihood.point_loglikelihood_cond_all_parallel(point, out, n_threads);
+        benchmark::DoNotOptimize(out.data());
+        point = (point + 7919) % f.n;
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * f.n * 20.0));
+}
+BENCHMARK(BM_Natarajan_point_loglikelihood_cond_all_parallel)
+    ->ArgsProduct({{1000, 10000}, {16, 64}, {2, 4}})
+    ->UseRealTime();
+
+// Cohesion over the n_k (n_k - 1) / 2 pairs of a cluster, D and log D (16 bytes per pair)
+void BM_Natarajan_cluster_loglikelihood(benchmark::State &state) {
+    const Fixture &f = fixture(state.range(0), state.range(1), true);
+    Data data(*f.params, f.allocations);
+    Natarajan_likelihood likelihood(data, *f.params);
+    int cluster = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(likelihood.cluster_loglikelihood(cluster));
+        cluster = (cluster + 1) % f.K;
+    }
+    const double n_k = mean_cluster_size(f);
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * n_k * (n_k - 1) / 2 * 16));
+}
+BENCHMARK(BM_Natarajan_cluster_loglikelihood)->Apply(distance_sizes);
+
+// ========== Samplers ==========
+
+// One iteration = one sweep; each point update reads its row of D and log D (16 n bytes).
+// Warm-up sweeps out of the loop let K settle and size the buffers, so that the loop measures
+// the steady state (allocations left come from K growing past its previous maximum).
+// Registered for Neal3 and Neal3ZDNAM (transition probabilities sorting the K + 1 candidates).
+template <typename GibbsSampler> void BM_Gibbs_step(benchmark::State &state) {
+    const Fixture &f = fixture(state.range(0), state.range(1), true);
+    Data data(*f.params, f.allocations);
+    Natarajan_likelihood likelihood(data, *f.params);
+    DP process(data, *f.params);
+    GibbsSampler sampler(data, *f.params, likelihood, process, Rng(42));
+    run_steps(state, sampler, data, f.n);
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * 16.0 * f.n * f.n));
+}
+BENCHMARK_TEMPLATE(BM_Gibbs_step, Neal3)->Apply(sampler_sizes)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_Gibbs_step, Neal3ZDNAM)->Apply(sampler_sizes)->Unit(benchmark::kMillisecond);
+
+// One iteration = one split-merge-shuffle proposal; the launch state rescans the two clusters
+// involved (about 2 n / K points, each reading its row of D and log D)
+void BM_SplitMerge_LSS_SDDS_step(benchmark::State &state) {
+    const Fixture &f = fixture(state.range(0), state.range(1), true);
+    Data data(*f.params, f.allocations);
+    Natarajan_likelihood likelihood(data, *f.params);
+    DP process(data, *f.params);
+    SplitMerge_LSS_SDDS sampler(data, *f.params, likelihood, process, true, Rng(42));
+    run_steps(state, sampler, data, 1, false);
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * 2.0 * mean_cluster_size(f) * 16.0 * f.n));
+}
+BENCHMARK(BM_SplitMerge_LSS_SDDS_step)->Apply(sampler_sizes)->Unit(benchmark::kMicrosecond);
+
+// ========== Modules ==========
+
+/** @brief Module / cache combinations, as built by build_chain() in R/mcmc_loop.R */
+enum class ModuleKind {
+    Spatial,
+    SpatialCache,
+    Continuos,
+    ContinuosCache,
+    MultiContinuosCache,
+    Binary,
+    BinaryCache,
+    Categorical,
+    CategoricalCache
+};
+
+/** @brief A module on its Datax, with the cache it reads (if any) registered in the Datax */
+struct ModuleSetup {
+    std::shared_ptr<ClusterInfo> cache;
+    std::unique_ptr<Datax> data;
+    std::unique_ptr<Module> module;
+    double obs_bytes;     ///< Estimated bytes read by add_similarity_obs(i) over all clusters
+    double cluster_bytes; ///< Estimated bytes read by compute_similarity_cls(k)
+};
+
+ModuleSetup make_module(ModuleKind kind, const Fixture &f) {
+    ModuleSetup s;
+    const Eigen::VectorXi &z = f.allocations;
+    const double n_k = mean_cluster_size(f);
+    const double stats = 24.0 * f.K; // a few doubles of statistics per cluster
+
+    switch (kind) {
+    case ModuleKind::Spatial:
+    case ModuleKind::SpatialCache: {
+        SparseAdjacency adjacency = synthetic::lattice_adjacency(f.n);
+        const double edges_per_point = static_cast<double>(adjacency.num_entries()) / f.n;
+        if (kind == ModuleKind::SpatialCache) {
+            auto cache = std::make_shared<SpatialCache>(z, std::move(adjacency));
+            s.data = std::make_unique<Datax>(*f.params, std::vector<std::shared_ptr<ClusterInfo>>{cache}, z);
+            s.module = std::make_unique<SpatialModuleCache>(*s.data, *cache, 1.0);
+            s.cache = cache;
+            s.obs_bytes = edges_per_point * 8 + stats;
+            s.cluster_bytes = 8;
+        } else {
+            s.data = std::make_unique<Datax>(*f.params, std::vector<std::shared_ptr<ClusterInfo>>{}, z);
+            s.module = std::make_unique<SpatialModule>(*s.data, std::move(adjacency), 1.0);
+            s.obs_bytes = edges_per_point * 8;
+            s.cluster_bytes = n_k * (4 + edges_per_point * 8);
+        }
+        break;
+    }
+    case ModuleKind::Continuos:
+    case ModuleKind::ContinuosCache: {
+        const Eigen::VectorXd x = synthetic::continuous_covariate(z);
+        if (kind == ModuleKind::ContinuosCache) {
+            Eigen::VectorXi allocations = z;
+            auto cache = std::make_shared<ContinuosCache>(allocations, x);
+            s.data = std::make_unique<Datax>(*f.params, std::vector<std::shared_ptr<ClusterInfo>>{cache}, z);
+            s.module = std::make_unique<ContinuosCovariatesModuleCache>(*s.data, *cache, false);
+            s.cache = cache;
+            s.obs_bytes = stats;
+            s.cluster_bytes = 24;
+        } else {
+            s.data = std::make_unique<Datax>(*f.params, std::vector<std::shared_ptr<ClusterInfo>>{}, z);
+            s.module = std::make_unique<ContinuosCovariatesModule>(*s.data, x, false);
+            s.obs_bytes = f.n * 12.0;
+            s.cluster_bytes = n_k * 12;
+        }
+        break;
+    }
+    case ModuleKind::MultiContinuosCache: {
+        const Eigen::MatrixXd x = f.mixture.points.leftCols(std::min<int>(4, f.mixture.points.cols()));
+        auto cache = std::make_shared<MultiContinuosCache>(z, x);
+        const Eigen::VectorXd one = Eigen::VectorXd::Ones(1), zero = Eigen::VectorXd::Zero(1);
+        s.data = std::make_unique<Datax>(*f.params, std::vector<std::shared_ptr<ClusterInfo>>{cache}, z);
+        s.module =
+            std::make_unique<MultiContinuosCovariatesModuleCache>(*s.data, *cache, false, zero, one, one, one, one);
+        s.cache = cache;
+        s.obs_bytes = stats * x.cols();
+        s.cluster_bytes = 24.0 * x.cols();
+        break;
+    }
+    case ModuleKind::Binary:
+    case ModuleKind::BinaryCache: {
+        const Eigen::VectorXi x = synthetic::binary_covariate(z);
+        if (kind == ModuleKind::BinaryCache) {
+            auto cache = std::make_shared<BinaryCache>(z, x);
+            s.data = std::make_unique<Datax>(*f.params, std::vector<std::shared_ptr<ClusterInfo>>{cache}, z);
+            s.module = std::make_unique<BinaryCovariatesModuleCache>(*s.data, *cache, 0.1, 0.1);
+            s.cache = cache;
+            s.obs_bytes = 8.0 * f.K;
+            s.cluster_bytes = 8;
+        } else {
+            s.data = std::make_unique<Datax>(*f.params, std::vector<std::shared_ptr<ClusterInfo>>{}, z);
+            s.module = std::make_unique<BinaryCovariatesModule>(*s.data, x, 0.1, 0.1);
+            s.obs_bytes = f.n * 8.0;
+            s.cluster_bytes = n_k * 8;
+        }
+        break;
+    }
+    case ModuleKind::Categorical:
+    case ModuleKind::CategoricalCache: {
+        const int C = 5;
+        const Eigen::VectorXi x = synthetic::categorical_covariate(z, C);
+        const std::vector<double> alphas(C, 1.0);
+        if (kind == ModuleKind::CategoricalCache) {
+            auto cache = std::make_shared<CategoricalCache>(z, x);
+            s.data = std::make_unique<Datax>(*f.params, std::vector<std::shared_ptr<ClusterInfo>>{cache}, z);
+            s.module = std::make_unique<CategoricalCovariatesModuleCache>(*s.data, *cache, alphas);
+            s.cache = cache;
+            s.obs_bytes = 4.0 * (C + 1) * f.K;
+            s.cluster_bytes = 4.0 * (C + 1);
+        } else {
+            s.data = std::make_unique<Datax>(*f.params, std::vector<std::shared_ptr<ClusterInfo>>{}, z);
+            s.module = std::make_unique<CategoricalCovariatesModule>(*s.data, x, alphas);
+            s.obs_bytes = f.n * 8.0;
+            s.cluster_bytes = n_k * 8;
+        }
+        break;
+    }
+    }
+    return s;
+}
+
+// Prior term of one point for every cluster, added into a buffer as in the Gibbs scans
+template <ModuleKind kind> void BM_Module_similarity_obs(benchmark::State &state) {
+    const Fixture &f = fixture(state.range(0), state.range(1), false);
+    ModuleSetup s = make_module(kind, f);
+    Eigen::VectorXd log_prior = Eigen::VectorXd::Zero(s.data->get_K());
+    s.module->add_similarity_obs(0, log_prior);
+    int point = 0;
+    AllocationCounter allocations;
+    for (auto _ : state) {
+        s.module->add_similarity_obs(point, log_prior);
+        benchmark::DoNotOptimize(log_prior.data());
+        point = (point + 7919) % f.n;
+    }
+    allocations.report(state);
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * s.obs_bytes));
+}
+
+// Prior term of one cluster, as in the split-merge acceptance ratios
+template <ModuleKind kind> void BM_Module_similarity_cls(benchmark::State &state) {
+    const Fixture &f = fixture(state.range(0), state.range(1), false);
+    ModuleSetup s = make_module(kind, f);
+    int cluster = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(s.module->compute_similarity_cls(cluster));
+        cluster = (cluster + 1) % f.K;
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * s.cluster_bytes));
+}
+
+// A point moved to the next cluster and back, updating the registered cache (if any)
+template <ModuleKind kind> void BM_Module_set_allocation(benchmark::State &state) {
+    const Fixture &f = fixture(state.range(0), state.range(1), false);
+    ModuleSetup s = make_module(kind, f);
+    int point = 0;
+    for (auto _ : state) {
+        const int cluster = s.data->get_allocations()(point);
+        s.data->set_allocation(point, (cluster + 1) % f.K);
+        s.data->set_allocation(point, cluster);
+        point = (point + 7919) % f.n;
+    }
+    state.SetItemsProcessed(2 * state.iterations());
+}
+
+#define BNP_MODULE_BENCHMARKS(kind)                                                                                    \
+    BENCHMARK_TEMPLATE(BM_Module_similarity_obs, ModuleKind::kind)->Apply(module_sizes);                             \
+    BENCHMARK_TEMPLATE(BM_Module_similarity_cls, ModuleKind::kind)->Apply(module_sizes);                             \
+    BENCHMARK_TEMPLATE(BM_Module_set_allocation, ModuleKind::kind)->Apply(module_sizes)
+
+BNP_MODULE_BENCHMARKS(Spatial);
+BNP_MODULE_BENCHMARKS(SpatialCache);
+BNP_MODULE_BENCHMARKS(Continuos);
+BNP_MODULE_BENCHMARKS(ContinuosCache);
+BNP_MODULE_BENCHMARKS(MultiContinuosCache);
+BNP_MODULE_BENCHMARKS(Binary);
+BNP_MODULE_BENCHMARKS(BinaryCache);
+BNP_MODULE_BENCHMARKS(Categorical);
+BNP_MODULE_BENCHMARKS(CategoricalCache);
+
+// One iteration = one sweep of Neal3 on a DPx with one module, through the Gibbs kernel
+// (likelihood batch, DP prior and module similarities added into the workspace buffer)
+template <ModuleKind kind> void BM_Neal3_DPx_step(benchmark::State &state) {
+    const Fixture &f = fixture(state.range(0), state.range(1), true);
+    ModuleSetup s = make_module(kind, f);
+    const std::vector<std::shared_ptr<Module>> modules{std::shared_ptr<Module>(std::move(s.module))};
+    Natarajan_likelihood likelihood(*s.data, *f.params);
+    DPx process(*s.data, *f.params, modules);
+    Neal3 sampler(*s.data, *f.params, likelihood, process, Rng(42));
+    run_steps(state, sampler, *s.data, f.n);
+}
+BENCHMARK_TEMPLATE(BM_Neal3_DPx_step, ModuleKind::SpatialCache)->Apply(sampler_sizes)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_Neal3_DPx_step, ModuleKind::ContinuosCache)->Apply(sampler_sizes)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_Neal3_DPx_step, ModuleKind::Categorical)->Apply(sampler_sizes)->Unit(benchmark::kMillisecond);
+
+// ========== Sweep orders ==========
+
+// The fixture points are sorted by cluster, so their labels already keep near points together;
+// Scrambled visits them in a fixed random permutation instead, as with data whose labels carry no
+// locality, and the other orders are measured against it. On a build of Google Benchmark with
+// libpfm, --benchmark_perf_counters=CACHE-MISSES adds the cache misses per sweep.
+
+/** @brief Visiting orders of the scan-order benchmarks (third argument) */
+enum class OrderKind { Identity, Scrambled, RandomScan, Locality, ClusterGrouped };
+
+const char *order_name(OrderKind kind) {
+    switch (kind) {
+    case OrderKind::Identity:
+        return "identity";
+    case OrderKind::Scrambled:
+        return "scrambled";
+    case OrderKind::RandomScan:
+        return "random_scan";
+    case OrderKind::Locality:
+        return "locality";
+    case OrderKind::ClusterGrouped:
+        return "cluster_grouped";
+    }
+    return "";
+}
+
+/** @brief Fixed random permutation of the points */
+std::vector<int> scrambled_order(int n) {
+    std::vector<int> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    Rng gen(7);
+    std::shuffle(order.begin(), order.end(), gen);
+    return order;
+}
+
+/** @brief Sets the order of kind on sampler; locality() gives the locality-preserving permutation */
+template <typename Locality> void set_order(Neal3 &sampler, OrderKind kind, int n, Locality locality) {
+    switch (kind) {
+    case OrderKind::Identity:
+        break;
+    case OrderKind::Scrambled:
+        sampler.set_visit_order(scrambled_order(n));
+        break;
+    case OrderKind::RandomScan:
+        sampler.set_visit_order(scrambled_order(n));
+        sampler.set_scan_order(Neal3::ScanOrder::Random);
+        break;
+    case OrderKind::Locality:
+        sampler.set_visit_order(locality());
+        break;
+    case OrderKind::ClusterGrouped:
+        sampler.set_scan_order(Neal3::ScanOrder::ClusterGrouped);
+        break;
+    }
+}
+
+void order_sizes(benchmark::internal::Benchmark *b) {
+    for (int n : {1000, 10000})
+        for (int kind = 0; kind <= static_cast<int>(OrderKind::ClusterGrouped); ++kind)
+            b->Args({n, 16, kind});
+}
+
+// One sweep of BM_Gibbs_step<Neal3> in each order; Locality is the Hilbert order of the FastMap
+// embedding of D (sweep_order::distance_order())
+void BM_Neal3_scan_order(benchmark::State &state) {
+    const Fixture &f = fixture(state.range(0), state.range(1), true);
+    const OrderKind kind = static_cast<OrderKind>(state.range(2));
+    Data data(*f.params, f.allocations);
+    Natarajan_likelihood likelihood(data, *f.params);
+    DP process(data, *f.params);
+    Neal3 sampler(data, *f.params, likelihood, process, Rng(42));
+    set_order(sampler, kind, f.n, [&f] { return sweep_order::distance_order(*f.params); });
+    run_steps(state, sampler, data, f.n);
+    state.SetLabel(order_name(kind));
+}
+BENCHMARK(BM_Neal3_scan_order)->Apply(order_sizes)->Unit(benchmark::kMillisecond);
+
+// One sweep of BM_Neal3_DPx_step with the spatial cache in each order; Locality is the reverse
+// Cuthill-McKee order of the lattice (sweep_order::reverse_cuthill_mckee())
+void BM_Neal3_spatial_scan_order(benchmark::State &state) {
+    const Fixture &f = fixture(state.range(0), state.range(1), true);
+    const OrderKind kind = static_cast<OrderKind>(state.range(2));
+    ModuleSetup s = make_module(ModuleKind::SpatialCache, f);
+    const SparseAdjacency &graph = static_cast<const SpatialCache &>(*s.cache).neighbor_cache;
+    const std::vector<std::shared_ptr<Module>> modules{std::shared_ptr<Module>(std::move(s.module))};
+    Natarajan_likelihood likelihood(*s.data, *f.params);
+    DPx process(*s.data, *f.params, modules);
+    Neal3 sampler(*s.data, *f.params, likelihood, process, Rng(42));
+    set_order(sampler, kind, f.n, [&graph] { return sweep_order::reverse_cuthill_mckee(graph); });
+    run_steps(state, sampler, *s.data, f.n);
+    state.SetLabel(order_name(kind));
+}
+BENCHMARK(BM_Neal3_spatial_scan_order)->Apply(order_sizes)->Unit(benchmark::kMillisecond);
+
+// ========== Lazy compaction ==========
+
+void lazy_compaction_sizes(benchmark::internal::Benchmark *b) {
+    for (int n : {1000, 10000})
+        for (int K : {4, 16})
+            for (int lazy : {0, 1})
+                b->Args({n, K, lazy});
+}
+
+// One sweep of Neal3 on a Datax with a DistanceCache, whose compaction relabels all n points;
+// with lazy = 1 the clusters emptied in the sweep are free slots until its end
+void BM_Neal3_lazy_compaction(benchmark::State &state) {
+    const Fixture &f = fixture(state.range(0), state.range(1), true);
+    const bool lazy = state.range(2) != 0;
+    auto cache = std::make_shared<DistanceCache>(f.allocations, *f.params);
+    Datax data(*f.params, {cache}, f.allocations);
+    Natarajan_likelihood likelihood(data, *f.params, cache.get());
+    DP process(data, *f.params);
+    Neal3 sampler(data, *f.params, likelihood, process, Rng(42));
+    sampler.set_lazy_compaction(lazy);
+    run_steps(state, sampler, data, f.n);
+    state.SetLabel(lazy ? "lazy" : "eager");
+}
+BENCHMARK(BM_Neal3_lazy_compaction)->Apply(lazy_compaction_sizes)->Unit(benchmark::kMillisecond);
+
+} // namespace
+
+BENCHMARK_MAIN();
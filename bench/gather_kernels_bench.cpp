@@ -0,0 +1,126 @@
+/**
+ * @file gather_kernels_bench.cpp
+ * @brief Micro-benchmark of the member-indexed row reductions in gather_kernels.hpp
+ *
+ * Compares gather_kernels::gather_sum2 with the plain loop previously used by the
+ * likelihoods, for cluster sizes 10, 100 and 10k drawn from rows of length n = 50k.
+ * Two regimes are timed: a single cache-resident row, and 64 rows visited round-robin
+ * (51 MB, as when sweeping over points of a large D). Standalone, no R needed:
+ *
+ *     g++ -std=c++17 -O2 -DGATHER_KERNELS_SIMD=1 -I/usr/include/eigen3 bench/gather_kernels_bench.cpp \
+ *         src/utils/cpu_dispatch.cpp -o gather_bench
+ *     ./gather_bench
+ *
+ * The gather path is that of the CPU (cpu_dispatch); run with BNPCLUST_ISA=avx2 to time the AVX2
+ * one, or drop -DGATHER_KERNELS_SIMD=1 (and cpu_dispatch.cpp) for the scalar one.
+ * Also built by bench/CMakeLists.txt as gather_kernels_bench (-DBNP_GATHER_SIMD=ON for the SIMD path).
+ *
+ * @author Filippo Galli
+ * @date 2025
+ */
+
+#include "../src/utils/gather_kernels.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <numeric>
+#include <random>
+#include <vector>
+
+namespace {
+
+// Reference: the loop shape of compute_cohesion/compute_repulsion
+void plain_sum2(const double *a, const double *b, const int *idx, int m, double &sum_a, double &sum_b) {
+    double s_a = 0, s_b = 0;
+    for (int i = 0; i < m; ++i) {
+        s_a += a[idx[i]];
+        s_b += b[idx[i]];
+    }
+    sum_a = s_a;
+    sum_b = s_b;
+}
+
+// Keeps the compiler from discarding a result (same idea as benchmark::DoNotOptimize)
+inline void keep(double value) { asm volatile("" : : "r,m"(value) : "memory"); }
+
+template <typename F> double time_ns_per_call(F &&f, long calls) {
+    const auto start = std::chrono::steady_clock::now();
+    for (long c = 0; c < calls; ++c)
+        f(c);
+    const auto stop = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(stop - start).count() / calls;
+}
+
+} // namespace
+
+int main() {
+    const int n = 50000;
+    const int max_rows = 64;
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<> unif(0.1, 10.0);
+
+    std::vector<double> D(static_cast<size_t>(max_rows) * n), logD(D.size());
+    for (size_t i = 0; i < D.size(); ++i) {
+        D[i] = unif(gen);
+        logD[i] = std::log(D[i]);
+    }
+
+    std::vector<int> all(n);
+    std::iota(all.begin(), all.end(), 0);
+
+#if GATHER_KERNELS_SIMD
+    const char *isa = cpu_dispatch::name(cpu_dispatch::active());
+#else
+    const char *isa = "scalar";
+#endif
+    std::printf("gather_sum2 (%s) vs plain loop, row length %d\n", isa, n);
+    std::printf("%6s %10s %14s %14s %9s %12s\n", "rows", "n_k", "plain ns/call", "kernel ns/call", "speed-up",
+                "max rel err");
+
+    for (int n_rows : {1, max_rows}) {
+        for (int n_k : {10, 100, 10000}) {
+            // Members in insertion order, as stored in Data::cluster_members
+            std::shuffle(all.begin(), all.end(), gen);
+            std::vector<int> members(all.begin(), all.begin() + n_k);
+
+            const long calls = std::max(2000L, 20000000L / n_k);
+            double max_rel_err = 0;
+
+            const double t_plain = time_ns_per_call(
+                [&](long c) {
+                    const size_t row = static_cast<size_t>(c % n_rows) * n;
+                    double s, l;
+                    plain_sum2(D.data() + row, logD.data() + row, members.data(), n_k, s, l);
+                    keep(s);
+                    keep(l);
+                },
+                calls);
+
+            const double t_kernel = time_ns_per_call(
+                [&](long c) {
+                    const size_t row = static_cast<size_t>(c % n_rows) * n;
+                    double s, l;
+                    gather_kernels::gather_sum2(D.data() + row, logD.data() + row, members.data(), n_k, s, l);
+                    keep(s);
+                    keep(l);
+                },
+                calls);
+
+            for (int r = 0; r < n_rows; ++r) {
+                const size_t row = static_cast<size_t>(r) * n;
+                double s0, l0, s1, l1;
+                plain_sum2(D.data() + row, logD.data() + row, members.data(), n_k, s0, l0);
+                gather_kernels::gather_sum2(D.data() + row, logD.data() + row, members.data(), n_k, s1, l1);
+                max_rel_err =
+                    std::max({max_rel_err, std::abs(s1 - s0) / std::abs(s0), std::abs(l1 - l0) / std::abs(l0)});
+            }
+
+            std::printf("%6d %10d %14.1f %14.1f %8.2fx %12.2e\n", n_rows, n_k, t_plain, t_kernel, t_plain / t_kernel,
+                        max_rel_err);
+        }
+    }
+
+    return 0;
+}
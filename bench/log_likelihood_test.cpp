@@ -0,0 +1,66 @@
+/**
+ * @file log_likelihood_test.cpp
+ * @brief Check of the running log-likelihood of ChainRunner across samplers that do and do not track it
+ *
+ * Each iteration steps SplitMerge_SAMS, which does not report the likelihood change of its moves
+ * and so stops the tracking, then SplitMerge_LSS_SDDS on the cluster-local Gamma likelihood, which
+ * does. The tracking must be off after the run, and the value read then (recomputed and
+ * re-seeded) must be finite and equal the full sum of the cluster log-likelihoods. Exits with status 1 on failure; run by ctest (see bench/CMakeLists.txt).
+ *
+ * @author Filippo Galli
+ * @date 2025
+ */
+
+#include "synthetic_data.hpp"
+
+#include "../src/likelihoods/Gamma_likelihood.hpp"
+#include "../src/processes/DP.hpp"
+#include "../src/samplers/splitmerge_LSS_SDDS.hpp"
+#include "../src/samplers/splitmerge_SAMS.hpp"
+#include "../src/utils/ChainRunner.hpp"
+#include "../src/utils/Data.hpp"
+#include "../src/utils/Params.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+int main() {
+    const int n = 200, K = 4, iterations = 20;
+    const synthetic::MixtureData mixture = synthetic::generate_mixture_data(n, K);
+    Params params(0.5, 2, 2, 2, 2, 2, 0, 0, 1.0, 1.0, 1.0, synthetic::euclidean_distances(mixture.points));
+    params.n = n;
+
+    Data data(params, mixture.clusts);
+    Gamma_likelihood likelihood(data, params);
+    DP process(data, params);
+    SplitMerge_SAMS untracking(data, params, likelihood, process, true, Rng(1));
+    SplitMerge_LSS_SDDS tracking(data, params, likelihood, process, true, Rng(2));
+    if (untracking.tracks_log_likelihood() || !tracking.tracks_log_likelihood()) {
+        std::fprintf(stderr, "unexpected tracking of the samplers\n");
+        return 1;
+    }
+
+    ChainRunner runner(data, process, {&untracking, &tracking}, {1, 1});
+    runner.track_log_likelihood(&likelihood);
+    std::vector<int> K_out(ChainRunner::n_saved(0, iterations, 1));
+    runner.run(0, iterations, 1, nullptr, K_out.data(), nullptr);
+
+    // SplitMerge_SAMS stopped the tracking and SplitMerge_LSS_SDDS does not restart it
+    if (data.tracks_log_likelihood()) {
+        std::fprintf(stderr, "running log-likelihood still tracked after SplitMerge_SAMS\n");
+        return 1;
+    }
+    const double running = runner.log_likelihood();
+    double full = 0.0;
+    for (int k = 0; k < data.get_K(); ++k) {
+        if (data.get_cluster_size(k) > 0)
+            full += likelihood.cluster_loglikelihood(k);
+    }
+    if (!std::isfinite(running) || std::abs(running - full) > 1e-6 * (1.0 + std::abs(full))) {
+        std::fprintf(stderr, "running log-likelihood %g, full sum %g\n", running, full);
+        return 1;
+    }
+    std::printf("running log-likelihood %g matches the full sum\n", running);
+    return 0;
+}
@@ -0,0 +1,165 @@
+/**
+ * @file synthetic_data.hpp
+ * @brief Synthetic data sets for the benchmarks, mirroring generate_mixture_data() in R/utils.R
+ *
+ * @author Filippo Galli
+ * @date 2025
+ */
+
+#pragma once
+
+#include "../src/utils/SparseAdjacency.hpp"
+
+#include <Eigen/Dense>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+namespace synthetic {
+
+/** @brief Output of generate_mixture_data() */
+struct MixtureData {
+    Eigen::MatrixXd points;        ///< N x dim points
+    Eigen::VectorXi clusts;        ///< True cluster of each point, 0-based
+    Eigen::MatrixXd clust_centres; ///< K x dim centres
+    Eigen::VectorXd probs;         ///< Cluster weights
+};
+
+/**
+ * @brief Gaussian mixture with centres on the vertices of a simplex
+ *
+ * Same model as generate_mixture_data() in R/utils.R: weights ~ Dirichlet(alpha, ..., alpha),
+ * centre k at radius * e_k, points ~ N(centre, sigma^2 I_dim), ordered by cluster if requested.
+ * Clusters are 0-based here, as everywhere in the C++ code.
+ *
+ * @param N Number of points
+ * @param K Number of clusters
+ * @param alpha Dirichlet concentration of the weights
+ * @param dim Dimension (0: K)
+ * @param radius Distance of the centres from the origin
+ * @param sigma Standard deviation of each coordinate
+ * @param ordered Whether the points are sorted by cluster
+ * @param seed Seed of the generator
+ */
+inline MixtureData generate_mixture_data(int N = 100, int K = 10, double alpha = 10, int dim = 0, double radius = 1,
+                                         double sigma = 0.1, bool ordered = true, uint64_t seed = 42) {
+    if (dim == 0)
+        dim = K;
+    if (N < 1 || K < 1 || K > N || alpha <= 0 || dim < K || radius <= 0 || sigma <= 0) {
+        throw std::invalid_argument("generate_mixture_data: invalid arguments");
+    }
+
+    std::mt19937_64 gen(seed);
+    MixtureData out;
+
+    // Dirichlet weights as normalized gamma draws
+    std::gamma_distribution<double> gamma(alpha, 1.0);
+    out.probs.resize(K);
+    for (int k = 0; k < K; ++k)
+        out.probs(k) = gamma(gen);
+    out.probs /= out.probs.sum();
+
+    std::discrete_distribution<int> cluster(out.probs.data(), out.probs.data() + K);
+    out.clusts.resize(N);
+    for (int i = 0; i < N; ++i)
+        out.clusts(i) = cluster(gen);
+    if (ordered)
+        std::sort(out.clusts.data(), out.clusts.data() + N);
+
+    out.clust_centres = Eigen::MatrixXd::Zero(K, dim);
+    for (int k = 0; k < K; ++k)
+        out.clust_centres(k, k) = radius;
+
+    std::normal_distribution<double> noise(0.0, sigma);
+    out.points.resize(N, dim);
+    for (int i = 0; i < N; ++i)
+        for (int j = 0; j < dim; ++j)
+            out.points(i, j) = out.clust_centres(out.clusts(i), j) + noise(gen);
+    return out;
+}
+
+/**
+ * @brief Euclidean distance matrix of the rows of points (0 on the diagonal, as dist() in R)
+ * @param points N x dim points
+ */
+inline Eigen::MatrixXd euclidean_distances(const Eigen::MatrixXd &points) {
+    const Eigen::VectorXd norms = points.rowwise().squaredNorm();
+    Eigen::MatrixXd D = -2.0 * points * points.transpose();
+    D.colwise() += norms;
+    D.rowwise() += norms.transpose();
+    D = D.cwiseMax(0.0).cwiseSqrt();
+    D.diagonal().setZero();
+    return D;
+}
+
+/**
+ * @brief Continuous covariate centred on the cluster index
+ * @param clusts Cluster of each point
+ * @param sd Standard deviation around the cluster index
+ * @param seed Seed of the generator
+ */
+inline Eigen::VectorXd continuous_covariate(const Eigen::VectorXi &clusts, double sd = 0.5, uint64_t seed = 43) {
+    std::mt19937_64 gen(seed);
+    std::normal_distribution<double> noise(0.0, sd);
+    Eigen::VectorXd x(clusts.size());
+    for (int i = 0; i < clusts.size(); ++i)
+        x(i) = clusts(i) + noise(gen);
+    return x;
+}
+
+/**
+ * @brief Binary covariate with success probability (k + 1) / (K + 1) in cluster k
+ * @param clusts Cluster of each point
+ * @param seed Seed of the generator
+ */
+inline Eigen::VectorXi binary_covariate(const Eigen::VectorXi &clusts, uint64_t seed = 44) {
+    std::mt19937_64 gen(seed);
+    std::uniform_real_distribution<double> unif(0.0, 1.0);
+    const double K = clusts.maxCoeff() + 1;
+    Eigen::VectorXi x(clusts.size());
+    for (int i = 0; i < clusts.size(); ++i)
+        x(i) = unif(gen) < (clusts(i) + 1) / (K + 1) ? 1 : 0;
+    return x;
+}
+
+/**
+ * @brief Categorical covariate in {0, ..., C - 1}, equal to k mod C with probability 0.8
+ * @param clusts Cluster of each point
+ * @param C Number of categories
+ * @param seed Seed of the generator
+ */
+inline Eigen::VectorXi categorical_covariate(const Eigen::VectorXi &clusts, int C = 5, uint64_t seed = 45) {
+    std::mt19937_64 gen(seed);
+    std::uniform_real_distribution<double> unif(0.0, 1.0);
+    std::uniform_int_distribution<int> category(0, C - 1);
+    Eigen::VectorXi x(clusts.size());
+    for (int i = 0; i < clusts.size(); ++i)
+        x(i) = unif(gen) < 0.8 ? clusts(i) % C : category(gen);
+    return x;
+}
+
+/**
+ * @brief Lattice adjacency: the points, in order, fill a square grid with 4-neighbours
+ * @param N Number of points
+ */
+inline SparseAdjacency lattice_adjacency(int N) {
+    const int width = static_cast<int>(std::ceil(std::sqrt(static_cast<double>(N))));
+    std::vector<int> from, to;
+    for (int i = 0; i < N; ++i) {
+        if ((i + 1) % width != 0 && i + 1 < N) {
+            from.push_back(i);
+            to.push_back(i + 1);
+        }
+        if (i + width < N) {
+            from.push_back(i);
+            to.push_back(i + width);
+        }
+    }
+    return SparseAdjacency::from_edges(N, from, to);
+}
+
+} // namespace synthetic
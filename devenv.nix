@@ -20,19 +20,23 @@ in
   env.NIX_ENFORCE_NO_NATIVE = "0";
 
   # ========== OPTIMIZED C++ COMPILATION FLAGS FOR MCMC ==========
-  # CPU architecture-specific optimizations (best performance)
-  env.MARCH_FLAGS = "-march=native -mtune=native";
+  # Portable baseline (x86-64-v2: SSE4.2, POPCNT), so one build runs on every node of a cluster;
+  # the hot kernels still use AVX2 / AVX-512 where the CPU has them (src/utils/cpu_dispatch.hpp).
+  # -march=native is faster only for the code outside those kernels, on the build machine alone.
+  env.MARCH_FLAGS = "-march=x86-64-v2 -mtune=generic";
 
   # Optimization levels for MCMC (computational intensity is high)
   # -O3: aggressive optimizations
   # -ffast-math: allow aggressive floating point optimizations (safe for MCMC)
+  # -fno-finite-math-only: but keep infinities and NaN, which the samplers use for log(0) weights
+  #   and empty sums; under -ffinite-math-only std::isfinite()/std::isnan() fold to constants
   # -funroll-loops: unroll loops for better CPU cache utilization
   # -ftree-vectorize: auto-vectorize loops (SIMD)
   # -flto: link-time optimization
   env.CXX_STD = "CXX17";
-  env.PKG_CXXFLAGS = "-O2 -g -march=native -mtune=native -ffast-math -funroll-loops -ftree-vectorize -flto=auto -fopenmp";
-  env.CXXFLAGS = "-O2 -g -march=native -mtune=native -ffast-math -funroll-loops -ftree-vectorize -flto=auto -fopenmp";
-  env.PKG_CFLAGS = "-O2 -g -march=native -mtune=native -ffast-math -funroll-loops -ftree-vectorize -flto=auto -fopenmp";
+  env.PKG_CXXFLAGS = "-O2 -g -march=x86-64-v2 -mtune=generic -ffast-math -fno-finite-math-only -funroll-loops -ftree-vectorize -flto=auto -fopenmp";
+  env.CXXFLAGS = "-O2 -g -march=x86-64-v2 -mtune=generic -ffast-math -fno-finite-math-only -funroll-loops -ftree-vectorize -flto=auto -fopenmp";
+  env.PKG_CFLAGS = "-O2 -g -march=x86-64-v2 -mtune=generic -ffast-math -fno-finite-math-only -funroll-loops -ftree-vectorize -flto=auto -fopenmp";
 
   # Eigen specific flags
   env.PKG_CXXFLAGS_EIGEN = "-DEIGEN_NO_DEBUG -DEIGEN_DONT_PARALLELIZE";
@@ -11,9 +11,18 @@
  */
 
 #include <RcppEigen.h>
+#include <cstdlib>
+#include <cxxabi.h>
 #include <memory>
+#include <typeinfo>
+#include <vector>
 #include "Rcpp/XPtr.h"
 #include "utils/Params.hpp"
+#include "utils/MappedDistances.hpp"
+#include "utils/PlacedDistances.hpp"
+#include "utils/DistanceBuilder.hpp"
+#include "utils/SparseAdjacency.hpp"
+#include "utils/SweepOrder.hpp"
 #include "utils/Data.hpp"
 #include "utils/Datax.hpp"
 
@@ -21,82 +30,191 @@
 #include "likelihoods/Natarajan_likelihood.hpp"
 #include "likelihoods/Null_likelihood.hpp"
 #include "likelihoods/Gamma_likelihood.hpp"
+#include "likelihoods/Knn_Natarajan_likelihood.hpp"
+#include "likelihoods/Tempered_likelihood.hpp"
+#include "likelihoods/caches/cluster_layout.hpp"
+#include "likelihoods/caches/distance_cache.hpp"
 
 #include "utils/Process.hpp"
 #include "processes/DP.hpp"
 #include "processes/DPx.hpp"
 #include "processes/NGGP.hpp"
 #include "processes/NGGPx.hpp"
+#include "processes/DPxT.hpp"
+#include "processes/NGGPxT.hpp"
 
 #include "processes/module/spatial_module.hpp"
 #include "processes/module/spatial_module_cache.hpp"
 #include "processes/module/continuos_covariate_module.hpp"
 #include "processes/module/continuos_covariate_module_cache.hpp"
+#include "processes/module/multi_continuos_covariate_module_cache.hpp"
 #include "processes/module/binary_covariate_module.hpp"
 #include "processes/module/binary_covariate_module_cache.hpp"
+#include "processes/module/multi_binary_covariate_module_cache.hpp"
 #include "processes/module/categorical_covariate_module.hpp"
+#include "processes/module/categorical_covariate_module_cache.hpp"
 
 #include "utils/ClusterInfo.hpp"
 #include "processes/caches/continuos_cache.hpp"
+#include "processes/caches/multi_continuos_cache.hpp"
 #include "processes/caches/binary_cache.hpp"
+#include "processes/caches/multi_binary_cache.hpp"
+#include "processes/caches/categorical_cache.hpp"
 #include "processes/caches/spatial_cache.hpp"
 
 #include "samplers/U_sampler/U_sampler.hpp"
 #include "samplers/U_sampler/RWMH.hpp"
 #include "samplers/U_sampler/MALA.hpp"
+#include "samplers/U_sampler/Slice.hpp"
 
 #include "utils/Sampler.hpp"
 #include "samplers/neal.hpp"
+#include "samplers/nealT.hpp"
 #include "samplers/neal_ZDNAM.hpp"
 #include "samplers/splitmerge.hpp"
 #include "samplers/splitmerge_SAMS.hpp"
 #include "samplers/splitmerge_LSS.hpp"
 #include "samplers/splitmerge_LSS_SDDS.hpp"
+#include "samplers/parallel_gibbs.hpp"
+#include "samplers/parallel_splitmerge.hpp"
+#include "samplers/multiple_try_splitmerge.hpp"
+#include "samplers/subcluster_splitmerge.hpp"
+#include "samplers/move_scheduler.hpp"
+
+#include "utils/ChainRunner.hpp"
+#include "utils/ReplicaExchange.hpp"
+#include "utils/ConvergenceMonitor.hpp"
+#include "utils/TraceFile.hpp"
+#include "utils/AsyncTraceWriter.hpp"
+#include "utils/CoClustering.hpp"
+#include "utils/MemoryReport.hpp"
+#include "utils/HyperparameterGrid.hpp"
+#include "utils/PartitionEstimator.hpp"
+#include "utils/CoarseToFine.hpp"
+#include "utils/InitialPartition.hpp"
+#include "utils/ShardedClustering.hpp"
+#include "utils/PredictiveAllocator.hpp"
+#include "utils/Rng.hpp"
+#include "utils/cpu_dispatch.hpp"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// ALTREP (R >= 3.5.0) backs the zero-copy allocation view, see data_get_allocations_view()
+#if R_VERSION >= R_Version(3, 5, 0)
+#include <R_ext/Altrep.h>
+#define BNP_ALTREP 1
+#else
+#define BNP_ALTREP 0
+#endif
+
+// ========== Tagged handles ==========
+// The external pointers to Data, Datax, the ClusterInfo caches and the trace sinks carry the name of their concrete
+// class in the tag slot, as an interned symbol: get_data_ptr() and get_cluster_info_ptr() dispatch
+// with one pointer comparison per candidate type and cast from the concrete type, with no
+// exception and no assumption on the layout of the class hierarchy.
+
+template <typename T> const char *handle_name();
+template <> const char *handle_name<Data>() { return "Data"; }
+template <> const char *handle_name<Datax>() { return "Datax"; }
+template <> const char *handle_name<ContinuosCache>() { return "ContinuosCache"; }
+template <> const char *handle_name<MultiContinuosCache>() { return "MultiContinuosCache"; }
+template <> const char *handle_name<BinaryCache>() { return "BinaryCache"; }
+template <> const char *handle_name<MultiBinaryCache>() { return "MultiBinaryCache"; }
+template <> const char *handle_name<CategoricalCache>() { return "CategoricalCache"; }
+template <> const char *handle_name<SpatialCache>() { return "SpatialCache"; }
+template <> const char *handle_name<DistanceCache>() { return "DistanceCache"; }
+template <> const char *handle_name<ClusterLayout>() { return "ClusterLayout"; }
+template <> const char *handle_name<TraceWriter>() { return "TraceWriter"; }
+template <> const char *handle_name<AsyncTraceWriter::Channel>() { return "AsyncTraceChannel"; }
+
+// Tag of the handles of T (symbols are never collected, so it is looked up once)
+template <typename T> SEXP handle_tag() {
+    static const SEXP tag = Rf_install(handle_name<T>());
+    return tag;
+}
+
+// Owning external pointer to object, tagged with its type
+template <typename T> Rcpp::XPtr<T> make_handle(T *object) { return Rcpp::XPtr<T>(object, true, handle_tag<T>()); }
+
+// Object of a handle as a B, if the handle is tagged with one of the types T, Ts...; nullptr otherwise
+template <typename B, typename T, typename... Ts> B *handle_cast(SEXP sexp) {
+    if (TYPEOF(sexp) != EXTPTRSXP || !R_ExternalPtrAddr(sexp))
+        return nullptr;
+    if (R_ExternalPtrTag(sexp) == handle_tag<T>())
+        return static_cast<T *>(R_ExternalPtrAddr(sexp));
+    if constexpr (sizeof...(Ts) > 0)
+        return handle_cast<B, Ts...>(sexp);
+    else
+        return nullptr;
+}
 
-// Helper functions to handle inheritance with XPtrs
 Data *get_data_ptr(SEXP sexp) {
-    // Try Data
-    try {
-        Rcpp::XPtr<Data> ptr(sexp);
-        return ptr.get();
-    } catch (...) {
-    }
+    if (Data *data = handle_cast<Data, Datax, Data>(sexp))
+        return data;
+    Rcpp::stop("Expected external pointer to Data or Datax");
+}
 
-    // Try Data_wClusterInfo
-    try {
-        Rcpp::XPtr<Datax> ptr(sexp);
-        return ptr.get();
-    } catch (...) {
-    }
+ClusterInfo *get_cluster_info_ptr(SEXP sexp) {
+    if (ClusterInfo *cluster_info = handle_cast<ClusterInfo, SpatialCache, ContinuosCache, MultiContinuosCache,
+                                                BinaryCache, MultiBinaryCache, CategoricalCache, DistanceCache,
+                                                ClusterLayout>(sexp))
+        return cluster_info;
+    Rcpp::stop("Expected external pointer to a ClusterInfo cache");
+}
 
-    Rcpp::stop("Expected external pointer to Data or Data_wClusterInfo");
-    return nullptr;
+TraceSink *get_trace_sink_ptr(SEXP sexp) {
+    if (TraceSink *sink = handle_cast<TraceSink, TraceWriter, AsyncTraceWriter::Channel>(sexp))
+        return sink;
+    Rcpp::stop("Expected external pointer to a TraceWriter or an AsyncTraceWriter channel");
 }
 
-ClusterInfo *get_cluster_info_ptr(SEXP sexp) {
-    // Try ClusterInfo
-    try {
-        Rcpp::XPtr<ClusterInfo> ptr(sexp);
-        return ptr.get();
-    } catch (...) {
-    }
+// Returns a fresh stream split from the master generator, or a randomly seeded one if rng is NULL
+Rng make_rng(SEXP rng_sexp) {
+    if (Rf_isNull(rng_sexp))
+        return Rng();
+    Rcpp::XPtr<Rng> master(rng_sexp);
+    return master->split();
+}
 
-    // Try Covariate_cache
-    try {
-        Rcpp::XPtr<ContinuosCache> ptr(sexp);
-        return ptr.get();
-    } catch (...) {
+// Neighbour lists of n points from a dense 0/1 matrix, a CsparseMatrix (e.g. a dgCMatrix from the
+// Matrix package) or a list / data.frame with integer columns from and to (1-based, one row per
+// undirected edge). Only the dense input costs O(n^2).
+SparseAdjacency as_adjacency(SEXP W, int n) {
+    if (Rf_isS4(W)) {
+        Rcpp::S4 sparse(W);
+        if (!sparse.is("CsparseMatrix"))
+            Rcpp::stop("Sparse adjacency must be a CsparseMatrix (e.g. dgCMatrix)");
+        if (sparse.is("symmetricMatrix"))
+            Rcpp::stop("Symmetric sparse adjacency stores one triangle: convert it with as(W, \"generalMatrix\")");
+        Rcpp::IntegerVector dim = sparse.slot("Dim");
+        if (dim[0] != n || dim[1] != n)
+            Rcpp::stop("Adjacency matrix must be n x n");
+        Rcpp::IntegerVector col_ptr = sparse.slot("p");
+        Rcpp::IntegerVector row_idx = sparse.slot("i");
+        if (!sparse.hasSlot("x"))
+            return SparseAdjacency::from_csc(n, col_ptr.begin(), row_idx.begin());
+        Rcpp::NumericVector values = Rcpp::as<Rcpp::NumericVector>(sparse.slot("x"));
+        return SparseAdjacency::from_csc(n, col_ptr.begin(), row_idx.begin(), values.begin());
     }
 
-    // Try BinaryContinuosCache
-    try {
-        Rcpp::XPtr<BinaryCache> ptr(sexp);
-        return ptr.get();
-    } catch (...) {
+    if (Rf_isNewList(W)) {
+        Rcpp::List edges(W);
+        if (!edges.containsElementNamed("from") || !edges.containsElementNamed("to"))
+            Rcpp::stop("Edge list must have elements from and to");
+        Rcpp::IntegerVector from = edges["from"];
+        Rcpp::IntegerVector to = edges["to"];
+        std::vector<int> from0(from.begin(), from.end()), to0(to.begin(), to.end());
+        for (size_t e = 0; e < from0.size(); ++e) {
+            --from0[e];
+            if (e < to0.size())
+                --to0[e];
+        }
+        return SparseAdjacency::from_edges(n, from0, to0);
     }
 
-    Rcpp::stop("Expected external pointer to ClusterInfo or Covariate_cache");
-    return nullptr;
+    return SparseAdjacency::from_dense(Rcpp::as<Eigen::MatrixXi>(W));
 }
 
 // [[Rcpp::depends(RcppEigen)]]
@@ -110,23 +228,52 @@ Rcpp::XPtr<Params> create_Params(double delta1, double alpha, double beta, doubl
 
 // [[Rcpp::export]]
 Rcpp::XPtr<Data> create_Data(Rcpp::XPtr<Params> params, Eigen::VectorXi initial_allocations) {
-    return Rcpp::XPtr<Data>(new Data(*params, initial_allocations), true);
+    return make_handle(new Data(*params, initial_allocations));
 }
 
 // [[Rcpp::export]]
 Rcpp::XPtr<ContinuosCache> create_Continuos_cache(Eigen::VectorXi &initial_allocations,
                                                   Eigen::VectorXd continuos_covariates) {
-    return Rcpp::XPtr<ContinuosCache>(new ContinuosCache(initial_allocations, continuos_covariates), true);
+    return make_handle(new ContinuosCache(initial_allocations, continuos_covariates));
+}
+
+// [[Rcpp::export]]
+Rcpp::XPtr<MultiContinuosCache> create_MultiContinuos_cache(Eigen::VectorXi &initial_allocations,
+                                                            Eigen::MatrixXd continuos_covariates) {
+    return make_handle(new MultiContinuosCache(initial_allocations, continuos_covariates));
 }
 
 // [[Rcpp::export]]
 Rcpp::XPtr<BinaryCache> create_Binary_cache(Eigen::VectorXi &initial_allocations, Eigen::VectorXi binary_covariates) {
-    return Rcpp::XPtr<BinaryCache>(new BinaryCache(initial_allocations, binary_covariates), true);
+    return make_handle(new BinaryCache(initial_allocations, binary_covariates));
+}
+
+// [[Rcpp::export]]
+Rcpp::XPtr<MultiBinaryCache> create_MultiBinary_cache(Eigen::VectorXi &initial_allocations,
+                                                      Eigen::MatrixXi binary_covariates) {
+    return make_handle(new MultiBinaryCache(initial_allocations, binary_covariates));
+}
+
+// [[Rcpp::export]]
+Rcpp::XPtr<CategoricalCache> create_Categorical_cache(Eigen::VectorXi &initial_allocations,
+                                                      Eigen::VectorXi categorical_covariates) {
+    return make_handle(new CategoricalCache(initial_allocations, categorical_covariates));
 }
 
 // [[Rcpp::export]]
-Rcpp::XPtr<SpatialCache> create_Spatial_cache(Eigen::VectorXi &initial_allocations, Eigen::MatrixXi W) {
-    return Rcpp::XPtr<SpatialCache>(new SpatialCache(initial_allocations, W), true);
+Rcpp::XPtr<SpatialCache> create_Spatial_cache(Eigen::VectorXi &initial_allocations, SEXP W) {
+    SparseAdjacency adjacency = as_adjacency(W, initial_allocations.size());
+    return make_handle(new SpatialCache(initial_allocations, std::move(adjacency)));
+}
+
+// [[Rcpp::export]]
+Rcpp::XPtr<DistanceCache> create_Distance_cache(Eigen::VectorXi &initial_allocations, Rcpp::XPtr<Params> params) {
+    return make_handle(new DistanceCache(initial_allocations, *params));
+}
+
+// [[Rcpp::export]]
+Rcpp::XPtr<ClusterLayout> create_Cluster_layout(Eigen::VectorXi &initial_allocations, Rcpp::XPtr<Params> params) {
+    return make_handle(new ClusterLayout(initial_allocations, *params));
 }
 
 // [[Rcpp::export]]
@@ -142,14 +289,28 @@ Rcpp::XPtr<Datax> create_Datax(Rcpp::XPtr<Params> params, Rcpp::List modules_lis
         // Wrap in non-owning shared_ptr (R's XPtr manages lifetime)
         modules.push_back(std::shared_ptr<ClusterInfo>(raw_ptr, [](ClusterInfo *) {}));
     }
-    return Rcpp::XPtr<Datax>(new Datax(*params, std::move(modules), initial_allocations), true);
+    return make_handle(new Datax(*params, std::move(modules), initial_allocations));
 }
 
 // Factory functions for likelihoods
 // [[Rcpp::export]]
-Rcpp::XPtr<Natarajan_likelihood> create_Natarajan_likelihood(SEXP data_sexp, Rcpp::XPtr<Params> params) {
+Rcpp::XPtr<Natarajan_likelihood> create_Natarajan_likelihood(SEXP data_sexp, Rcpp::XPtr<Params> params,
+                                                             SEXP distance_cache = R_NilValue,
+                                                             SEXP cluster_layout = R_NilValue) {
+    Data *data = get_data_ptr(data_sexp);
+    const DistanceCache *cache =
+        Rf_isNull(distance_cache) ? nullptr : Rcpp::XPtr<DistanceCache>(distance_cache).get();
+    const ClusterLayout *layout =
+        Rf_isNull(cluster_layout) ? nullptr : Rcpp::XPtr<ClusterLayout>(cluster_layout).get();
+    return Rcpp::XPtr<Natarajan_likelihood>(new Natarajan_likelihood(*data, *params, cache, layout), true);
+}
+
+// [[Rcpp::export]]
+Rcpp::XPtr<Knn_Natarajan_likelihood> create_Knn_Natarajan_likelihood(SEXP data_sexp, Rcpp::XPtr<Params> params,
+                                                                     int k, int far_samples = 8) {
     Data *data = get_data_ptr(data_sexp);
-    return Rcpp::XPtr<Natarajan_likelihood>(new Natarajan_likelihood(*data, *params), true);
+    return Rcpp::XPtr<Knn_Natarajan_likelihood>(new Knn_Natarajan_likelihood(*data, *params, k, far_samples),
+                                                true);
 }
 
 // [[Rcpp::export]]
@@ -159,24 +320,56 @@ Rcpp::XPtr<Null_likelihood> create_Null_likelihood(SEXP data_sexp, Rcpp::XPtr<Pa
 }
 
 // [[Rcpp::export]]
-Rcpp::XPtr<Gamma_likelihood> create_Gamma_likelihood(SEXP data_sexp, Rcpp::XPtr<Params> params) {
+Rcpp::XPtr<Gamma_likelihood> create_Gamma_likelihood(SEXP data_sexp, Rcpp::XPtr<Params> params,
+                                                     SEXP distance_cache = R_NilValue,
+                                                     SEXP cluster_layout = R_NilValue) {
+    Data *data = get_data_ptr(data_sexp);
+    const DistanceCache *cache =
+        Rf_isNull(distance_cache) ? nullptr : Rcpp::XPtr<DistanceCache>(distance_cache).get();
+    const ClusterLayout *layout =
+        Rf_isNull(cluster_layout) ? nullptr : Rcpp::XPtr<ClusterLayout>(cluster_layout).get();
+    return Rcpp::XPtr<Gamma_likelihood>(new Gamma_likelihood(*data, *params, cache, layout), true);
+}
+
+/**
+ * @brief Likelihood raised to the power beta, for run_tempered_chains()
+ * @param likelihood Untempered likelihood on the same data, kept alive by the caller
+ * @param beta Inverse temperature in (0, 1]
+ */
+// [[Rcpp::export]]
+Rcpp::XPtr<Tempered_likelihood> create_Tempered_likelihood(SEXP data_sexp, Rcpp::XPtr<Params> params,
+                                                           Rcpp::XPtr<Likelihood> likelihood, double beta = 1.0) {
     Data *data = get_data_ptr(data_sexp);
-    return Rcpp::XPtr<Gamma_likelihood>(new Gamma_likelihood(*data, *params), true);
+    return Rcpp::XPtr<Tempered_likelihood>(new Tempered_likelihood(*data, *params, *likelihood, beta), true);
+}
+
+// Factory function for the random number generator
+// [[Rcpp::export]]
+Rcpp::XPtr<Rng> create_Rng(double seed) {
+    return Rcpp::XPtr<Rng>(new Rng(static_cast<std::uint64_t>(seed)), true);
 }
 
 // Factory functions for U samplers
 // [[Rcpp::export]]
 Rcpp::XPtr<RWMH> create_RWMH(Rcpp::XPtr<Params> params, SEXP data_sexp, bool use_V, double proposal_sd,
-                             bool tuning_enabled) {
+                             bool tuning_enabled, SEXP rng = R_NilValue) {
     Data *data = get_data_ptr(data_sexp);
-    return Rcpp::XPtr<RWMH>(new RWMH(*params, *data, use_V, proposal_sd, tuning_enabled), true);
+    return Rcpp::XPtr<RWMH>(new RWMH(*params, *data, use_V, proposal_sd, tuning_enabled, make_rng(rng)), true);
 }
 
 // [[Rcpp::export]]
 Rcpp::XPtr<MALA> create_MALA(Rcpp::XPtr<Params> params, SEXP data_sexp, bool use_V, double proposal_sd,
-                             bool tuning_enabled) {
+                             bool tuning_enabled, SEXP rng = R_NilValue) {
+    Data *data = get_data_ptr(data_sexp);
+    return Rcpp::XPtr<MALA>(new MALA(*params, *data, use_V, proposal_sd, tuning_enabled, make_rng(rng)), true);
+}
+
+// Slice sampler on V = log(U): no acceptance rate to tune, width only sets the cost of an update
+// [[Rcpp::export]]
+Rcpp::XPtr<Slice> create_Slice(Rcpp::XPtr<Params> params, SEXP data_sexp, double width = 1.0, int max_steps = 32,
+                               bool adapt = true, SEXP rng = R_NilValue) {
     Data *data = get_data_ptr(data_sexp);
-    return Rcpp::XPtr<MALA>(new MALA(*params, *data, use_V, proposal_sd, tuning_enabled), true);
+    return Rcpp::XPtr<Slice>(new Slice(*params, *data, width, max_steps, adapt, make_rng(rng)), true);
 }
 
 // Factory functions for processes
@@ -193,10 +386,9 @@ Rcpp::XPtr<NGGP> create_NGGP(SEXP data_sexp, Rcpp::XPtr<Params> params, Rcpp::XP
 }
 
 // [[Rcpp::export]]
-Rcpp::XPtr<std::shared_ptr<Module>> create_SpatialModule(SEXP data_sexp, Eigen::MatrixXi W,
-                                                         double spatial_coefficient) {
+Rcpp::XPtr<std::shared_ptr<Module>> create_SpatialModule(SEXP data_sexp, SEXP W, double spatial_coefficient) {
     Data *data = get_data_ptr(data_sexp);
-    auto ptr = std::make_shared<SpatialModule>(*data, W, spatial_coefficient);
+    auto ptr = std::make_shared<SpatialModule>(*data, as_adjacency(W, data->get_n()), spatial_coefficient);
     return Rcpp::XPtr<std::shared_ptr<Module>>(new std::shared_ptr<Module>(ptr), true);
 }
 
@@ -227,6 +419,20 @@ Rcpp::XPtr<std::shared_ptr<Module>> create_ContinuosCovariatesModuleCache(SEXP d
     return Rcpp::XPtr<std::shared_ptr<Module>>(new std::shared_ptr<Module>(ptr), true);
 }
 
+// Hyperparameters: one value shared by all covariates or one value per covariate
+// [[Rcpp::export]]
+Rcpp::XPtr<std::shared_ptr<Module>> create_MultiContinuosCovariatesModuleCache(
+    SEXP data_sexp, Rcpp::XPtr<MultiContinuosCache> cache, bool fixed_v,
+    Rcpp::NumericVector m = Rcpp::NumericVector::create(0.0), Rcpp::NumericVector B = Rcpp::NumericVector::create(1.0),
+    Rcpp::NumericVector v = Rcpp::NumericVector::create(1.0), Rcpp::NumericVector nu = Rcpp::NumericVector::create(1.0),
+    Rcpp::NumericVector S0 = Rcpp::NumericVector::create(1.0)) {
+    Data *data = get_data_ptr(data_sexp);
+    auto ptr = std::make_shared<MultiContinuosCovariatesModuleCache>(
+        *data, *cache, fixed_v, Rcpp::as<Eigen::VectorXd>(m), Rcpp::as<Eigen::VectorXd>(B),
+        Rcpp::as<Eigen::VectorXd>(v), Rcpp::as<Eigen::VectorXd>(nu), Rcpp::as<Eigen::VectorXd>(S0));
+    return Rcpp::XPtr<std::shared_ptr<Module>>(new std::shared_ptr<Module>(ptr), true);
+}
+
 // [[Rcpp::export]]
 Rcpp::XPtr<std::shared_ptr<Module>> create_BinaryCovariatesModule(SEXP data_sexp, Eigen::VectorXi covariates,
                                                                   double prior_a = 1.0, double prior_b = 1.0) {
@@ -244,6 +450,18 @@ Rcpp::XPtr<std::shared_ptr<Module>> create_BinaryCovariatesModuleCache(SEXP data
     return Rcpp::XPtr<std::shared_ptr<Module>>(new std::shared_ptr<Module>(ptr), true);
 }
 
+// Hyperparameters: one value shared by all covariates or one value per covariate
+// [[Rcpp::export]]
+Rcpp::XPtr<std::shared_ptr<Module>> create_MultiBinaryCovariatesModuleCache(
+    SEXP data_sexp, Rcpp::XPtr<MultiBinaryCache> cache,
+    Rcpp::NumericVector beta_prior_alpha = Rcpp::NumericVector::create(1.0),
+    Rcpp::NumericVector beta_prior_beta = Rcpp::NumericVector::create(1.0)) {
+    Data *data = get_data_ptr(data_sexp);
+    auto ptr = std::make_shared<MultiBinaryCovariatesModuleCache>(
+        *data, *cache, Rcpp::as<Eigen::VectorXd>(beta_prior_alpha), Rcpp::as<Eigen::VectorXd>(beta_prior_beta));
+    return Rcpp::XPtr<std::shared_ptr<Module>>(new std::shared_ptr<Module>(ptr), true);
+}
+
 Rcpp::XPtr<std::shared_ptr<Module>> create_CategoricalCovariatesModule(SEXP data_sexp,
                                                                        Eigen::VectorXi categorical_covariate,
                                                                        std::vector<double> prior_alpha) {
@@ -253,10 +471,16 @@ Rcpp::XPtr<std::shared_ptr<Module>> create_CategoricalCovariatesModule(SEXP data
 }
 
 // [[Rcpp::export]]
-Rcpp::XPtr<DPx> create_DPx(SEXP data_sexp, Rcpp::XPtr<Params> params, Rcpp::List modules_list) {
-
+Rcpp::XPtr<std::shared_ptr<Module>> create_CategoricalCovariatesModuleCache(SEXP data_sexp,
+                                                                            Rcpp::XPtr<CategoricalCache> cache,
+                                                                            std::vector<double> prior_alpha) {
     Data *data = get_data_ptr(data_sexp);
+    auto ptr = std::make_shared<CategoricalCovariatesModuleCache>(*data, *cache, prior_alpha);
+    return Rcpp::XPtr<std::shared_ptr<Module>>(new std::shared_ptr<Module>(ptr), true);
+}
 
+// Modules of an R list of module pointers
+std::vector<std::shared_ptr<Module>> modules_from_list(Rcpp::List modules_list) {
     std::vector<std::shared_ptr<Module>> modules;
     modules.reserve(modules_list.size());
 
@@ -265,72 +489,277 @@ Rcpp::XPtr<DPx> create_DPx(SEXP data_sexp, Rcpp::XPtr<Params> params, Rcpp::List
         Rcpp::XPtr<std::shared_ptr<Module>> mod_ptr_wrapper(modules_list[i]);
         modules.push_back(*mod_ptr_wrapper); // Copy the shared_ptr, incrementing ref count
     }
+    return modules;
+}
+
+// Module combinations compiled into DPxT and NGGPxT, whose module calls are not virtual;
+// nullptr for any other list, which falls back to DPx or NGGPx
+template <typename Base, template <typename...> class ProcessT, typename... Args>
+Base *make_static_module_process(const std::vector<std::shared_ptr<Module>> &modules, Args &...args) {
+    using Spatial = SpatialModuleCache;
+    using Continuos = ContinuosCovariatesModuleCache;
+    using Binary = BinaryCovariatesModuleCache;
+    using Categorical = CategoricalCovariatesModuleCache;
+
+    if (ModulePack<Spatial>::matches(modules))
+        return new ProcessT<Spatial>(args..., modules);
+    if (ModulePack<Continuos>::matches(modules))
+        return new ProcessT<Continuos>(args..., modules);
+    if (ModulePack<Spatial, Continuos>::matches(modules))
+        return new ProcessT<Spatial, Continuos>(args..., modules);
+    if (ModulePack<Spatial, Binary>::matches(modules))
+        return new ProcessT<Spatial, Binary>(args..., modules);
+    if (ModulePack<Spatial, Categorical>::matches(modules))
+        return new ProcessT<Spatial, Categorical>(args..., modules);
+    if (ModulePack<Spatial, Continuos, Binary, Categorical>::matches(modules))
+        return new ProcessT<Spatial, Continuos, Binary, Categorical>(args..., modules);
+    return nullptr;
+}
 
-    return Rcpp::XPtr<DPx>(new DPx(*data, *params, modules), true);
+// [[Rcpp::export]]
+Rcpp::XPtr<DPx> create_DPx(SEXP data_sexp, Rcpp::XPtr<Params> params, Rcpp::List modules_list,
+                           bool static_modules = true) {
+
+    Data *data = get_data_ptr(data_sexp);
+    const std::vector<std::shared_ptr<Module>> modules = modules_from_list(modules_list);
+
+    DPx *process = static_modules ? make_static_module_process<DPx, DPxT>(modules, *data, *params) : nullptr;
+    if (process == nullptr)
+        process = new DPx(*data, *params, modules);
+    return Rcpp::XPtr<DPx>(process, true);
 }
 
 // [[Rcpp::export]]
 Rcpp::XPtr<NGGPx> create_NGGPx(SEXP data_sexp, Rcpp::XPtr<Params> params, Rcpp::XPtr<U_sampler> u_sampler,
-                               Rcpp::List modules_list) {
+                               Rcpp::List modules_list, bool static_modules = true) {
     Data *data = get_data_ptr(data_sexp);
+    const std::vector<std::shared_ptr<Module>> modules = modules_from_list(modules_list);
+
+    NGGPx *process = static_modules
+                         ? make_static_module_process<NGGPx, NGGPxT>(modules, *data, *params, *u_sampler)
+                         : nullptr;
+    if (process == nullptr)
+        process = new NGGPx(*data, *params, *u_sampler, modules);
+    return Rcpp::XPtr<NGGPx>(process, true);
+}
 
-    std::vector<std::shared_ptr<Module>> modules;
-    modules.reserve(modules_list.size());
+// Factory functions for samplers
+// Neal3T for a likelihood of type L and the first of the process types P, Ps... that matches
+template <typename L, typename P, typename... Ps>
+Neal3 *make_static_neal3(Data &data, Params &params, const L &likelihood, Process &process, const Rng &rng) {
+    if (typeid(process) == typeid(P))
+        return new Neal3T<L, P>(data, params, likelihood, static_cast<P &>(process), rng);
+    if constexpr (sizeof...(Ps) > 0)
+        return make_static_neal3<L, Ps...>(data, params, likelihood, process, rng);
+    else
+        return nullptr;
+}
 
-    for (int i = 0; i < modules_list.size(); ++i) {
-        // Cast the SEXP to an XPtr<shared_ptr<Module>>
-        Rcpp::XPtr<std::shared_ptr<Module>> mod_ptr_wrapper(modules_list[i]);
-        modules.push_back(*mod_ptr_wrapper); // Copy the shared_ptr, incrementing ref count
-    }
+// Likelihood and process types compiled into Neal3T, whose kernel calls are not virtual;
+// nullptr for any other pair, which falls back to Neal3
+template <typename L>
+Neal3 *make_static_neal3(Data &data, Params &params, const L &likelihood, Process &process, const Rng &rng) {
+    return make_static_neal3<L, DP, NGGP, DPxT<SpatialModuleCache>, NGGPxT<SpatialModuleCache>>(
+        data, params, likelihood, process, rng);
+}
 
-    return Rcpp::XPtr<NGGPx>(new NGGPx(*data, *params, *u_sampler, modules), true);
+Neal3 *make_static_neal3(Data &data, Params &params, const Likelihood &likelihood, Process &process,
+                         const Rng &rng) {
+    if (typeid(likelihood) == typeid(Natarajan_likelihood))
+        return make_static_neal3(data, params, static_cast<const Natarajan_likelihood &>(likelihood), process, rng);
+    if (typeid(likelihood) == typeid(Gamma_likelihood))
+        return make_static_neal3(data, params, static_cast<const Gamma_likelihood &>(likelihood), process, rng);
+    if (typeid(likelihood) == typeid(Knn_Natarajan_likelihood))
+        return make_static_neal3(data, params, static_cast<const Knn_Natarajan_likelihood &>(likelihood), process,
+                                 rng);
+    return nullptr;
 }
 
-// Factory functions for samplers
 // [[Rcpp::export]]
 Rcpp::XPtr<Neal3> create_Neal3(SEXP data_sexp, Rcpp::XPtr<Params> params, Rcpp::XPtr<Likelihood> likelihood,
-                               Rcpp::XPtr<Process> process) {
+                               Rcpp::XPtr<Process> process, SEXP rng = R_NilValue, bool static_dispatch = true) {
     Data *data = get_data_ptr(data_sexp);
-    return Rcpp::XPtr<Neal3>(new Neal3(*data, *params, *likelihood, *process), true);
+    const Rng gen = make_rng(rng);
+
+    Neal3 *sampler = static_dispatch ? make_static_neal3(*data, *params, *likelihood, *process, gen) : nullptr;
+    if (sampler == nullptr)
+        sampler = new Neal3(*data, *params, *likelihood, *process, gen);
+    return Rcpp::XPtr<Neal3>(sampler, true);
 }
 
 // [[Rcpp::export]]
 Rcpp::XPtr<Neal3ZDNAM> create_Neal3ZDNAM(SEXP data_sexp, Rcpp::XPtr<Params> params, Rcpp::XPtr<Likelihood> likelihood,
-                                         Rcpp::XPtr<Process> process) {
+                                         Rcpp::XPtr<Process> process, SEXP rng = R_NilValue) {
     Data *data = get_data_ptr(data_sexp);
-    return Rcpp::XPtr<Neal3ZDNAM>(new Neal3ZDNAM(*data, *params, *likelihood, *process), true);
+    return Rcpp::XPtr<Neal3ZDNAM>(new Neal3ZDNAM(*data, *params, *likelihood, *process, make_rng(rng)), true);
 }
 
 // [[Rcpp::export]]
 Rcpp::XPtr<SplitMerge> create_SplitMerge(SEXP data_sexp, Rcpp::XPtr<Params> params, Rcpp::XPtr<Likelihood> likelihood,
-                                         Rcpp::XPtr<Process> process, bool shuffle) {
+                                         Rcpp::XPtr<Process> process, bool shuffle, SEXP rng = R_NilValue) {
     Data *data = get_data_ptr(data_sexp);
-    return Rcpp::XPtr<SplitMerge>(new SplitMerge(*data, *params, *likelihood, *process, shuffle), true);
+    return Rcpp::XPtr<SplitMerge>(new SplitMerge(*data, *params, *likelihood, *process, shuffle, make_rng(rng)),
+                                  true);
 }
 
 // [[Rcpp::export]]
 Rcpp::XPtr<SplitMerge_SAMS> create_SplitMerge_SAMS(SEXP data_sexp, Rcpp::XPtr<Params> params,
                                                    Rcpp::XPtr<Likelihood> likelihood, Rcpp::XPtr<Process> process,
-                                                   bool shuffle) {
+                                                   bool shuffle, SEXP rng = R_NilValue) {
     Data *data = get_data_ptr(data_sexp);
-    return Rcpp::XPtr<SplitMerge_SAMS>(new SplitMerge_SAMS(*data, *params, *likelihood, *process, shuffle), true);
+    return Rcpp::XPtr<SplitMerge_SAMS>(
+        new SplitMerge_SAMS(*data, *params, *likelihood, *process, shuffle, make_rng(rng)), true);
 }
 
 // [[Rcpp::export]]
 Rcpp::XPtr<SplitMerge_LSS> create_SplitMerge_LSS(SEXP data_sexp, Rcpp::XPtr<Params> params,
                                                  Rcpp::XPtr<Likelihood> likelihood, Rcpp::XPtr<Process> process,
-                                                 bool shuffle) {
+                                                 bool shuffle, SEXP rng = R_NilValue) {
     Data *data = get_data_ptr(data_sexp);
-    return Rcpp::XPtr<SplitMerge_LSS>(new SplitMerge_LSS(*data, *params, *likelihood, *process, shuffle), true);
+    return Rcpp::XPtr<SplitMerge_LSS>(
+        new SplitMerge_LSS(*data, *params, *likelihood, *process, shuffle, make_rng(rng)), true);
 }
 
 // [[Rcpp::export]]
 Rcpp::XPtr<SplitMerge_LSS_SDDS> create_SplitMerge_LSS_SDDS(SEXP data_sexp, Rcpp::XPtr<Params> params,
                                                            Rcpp::XPtr<Likelihood> likelihood,
-                                                           Rcpp::XPtr<Process> process, bool shuffle) {
+                                                           Rcpp::XPtr<Process> process, bool shuffle,
+                                                           SEXP rng = R_NilValue) {
+    Data *data = get_data_ptr(data_sexp);
+    return Rcpp::XPtr<SplitMerge_LSS_SDDS>(
+        new SplitMerge_LSS_SDDS(*data, *params, *likelihood, *process, shuffle, make_rng(rng)), true);
+}
+
+/**
+ * @brief Reads the worker stacks of the parallel samplers
+ * @param replicas List of list(data, likelihood, process)
+ */
+std::vector<SamplerReplica> as_replicas(Rcpp::List replicas) {
+    std::vector<SamplerReplica> stacks;
+    stacks.reserve(replicas.size());
+    for (int i = 0; i < replicas.size(); ++i) {
+        Rcpp::List replica(replicas[i]);
+        SEXP replica_data = replica["data"], replica_likelihood = replica["likelihood"],
+             replica_process = replica["process"];
+        stacks.push_back({get_data_ptr(replica_data), Rcpp::XPtr<Likelihood>(replica_likelihood).get(),
+                          Rcpp::XPtr<Process>(replica_process).get()});
+    }
+    return stacks;
+}
+
+/**
+ * @brief Approximate parallel Gibbs sampler, one OpenMP thread per replica (see ParallelGibbs)
+ * @param replicas List of list(data, likelihood, process), one per worker, built on the same params
+ * @param rounds Rounds per sweep
+ * @param coloring Form the rounds from a greedy coloring of graph
+ * @param check_every Check one update every check_every against its exact conditional (0: off)
+ * @param graph Spatial graph: a SpatialCache, or W as accepted by create_SpatialModule() (NULL: none)
+ */
+// [[Rcpp::export]]
+Rcpp::XPtr<ParallelGibbs> create_ParallelGibbs(SEXP data_sexp, Rcpp::XPtr<Params> params,
+                                               Rcpp::XPtr<Likelihood> likelihood, Rcpp::XPtr<Process> process,
+                                               Rcpp::List replicas, int rounds = 4, bool coloring = false,
+                                               int check_every = 0, SEXP graph = R_NilValue,
+                                               SEXP rng = R_NilValue) {
+    Data *data = get_data_ptr(data_sexp);
+
+    std::vector<SamplerReplica> stacks = as_replicas(replicas);
+
+    ParallelGibbs::Options options;
+    options.rounds = rounds;
+    options.coloring = coloring;
+    options.check_every = check_every;
+
+    SparseAdjacency adjacency;
+    if (TYPEOF(graph) == EXTPTRSXP) {
+        adjacency = Rcpp::XPtr<SpatialCache>(graph)->neighbor_cache;
+    } else if (!Rf_isNull(graph)) {
+        adjacency = as_adjacency(graph, data->get_n());
+    }
+
+    return Rcpp::XPtr<ParallelGibbs>(new ParallelGibbs(*data, *params, *likelihood, *process, stacks, options,
+                                                       std::move(adjacency), make_rng(rng)),
+                                     true);
+}
+
+/**
+ * @brief Batched split-merge proposals on disjoint cluster pairs (see ParallelSplitMerge)
+ * @param replicas List of list(data, likelihood, process), one per worker, built on the same params;
+ * used only with a cluster-local likelihood (Gamma, Null), otherwise the batches run sequentially
+ * @param pairs_per_worker Anchor pairs drawn per step and per worker
+ */
+// [[Rcpp::export]]
+Rcpp::XPtr<ParallelSplitMerge> create_ParallelSplitMerge(SEXP data_sexp, Rcpp::XPtr<Params> params,
+                                                         Rcpp::XPtr<Likelihood> likelihood,
+                                                         Rcpp::XPtr<Process> process, Rcpp::List replicas,
+                                                         int pairs_per_worker = 1, SEXP rng = R_NilValue) {
+    Data *data = get_data_ptr(data_sexp);
+    return Rcpp::XPtr<ParallelSplitMerge>(new ParallelSplitMerge(*data, *params, *likelihood, *process,
+                                                                 as_replicas(replicas), pairs_per_worker,
+                                                                 make_rng(rng)),
+                                          true);
+}
+
+/**
+ * @brief Multiple-try split-merge proposals, the candidates drawn on the replicas (see MultipleTrySplitMerge)
+ * @param replicas List of list(data, likelihood, process), one per worker, built on the same params
+ * (may be empty: the candidates are then drawn on the master stack)
+ * @param tries Candidate splits per proposal
+ */
+// [[Rcpp::export]]
+Rcpp::XPtr<MultipleTrySplitMerge> create_MultipleTrySplitMerge(SEXP data_sexp, Rcpp::XPtr<Params> params,
+                                                               Rcpp::XPtr<Likelihood> likelihood,
+                                                               Rcpp::XPtr<Process> process, Rcpp::List replicas,
+                                                               int tries = 4, SEXP rng = R_NilValue) {
+    Data *data = get_data_ptr(data_sexp);
+    return Rcpp::XPtr<MultipleTrySplitMerge>(new MultipleTrySplitMerge(*data, *params, *likelihood, *process,
+                                                                       as_replicas(replicas), tries,
+                                                                       make_rng(rng)),
+                                             true);
+}
+
+/**
+ * @brief Split-merge moves along persistent sub-clusters (see SubClusterSplitMerge)
+ * @param n_threads OpenMP threads of the sub-cluster sweep
+ * @param sub_sweeps Sub-cluster sweeps per step
+ * @param proposals Split-merge proposals per step
+ */
+// [[Rcpp::export]]
+Rcpp::XPtr<SubClusterSplitMerge> create_SubClusterSplitMerge(SEXP data_sexp, Rcpp::XPtr<Params> params,
+                                                             Rcpp::XPtr<Likelihood> likelihood,
+                                                             Rcpp::XPtr<Process> process, int n_threads = 1,
+                                                             int sub_sweeps = 1, int proposals = 1,
+                                                             SEXP rng = R_NilValue) {
+    Data *data = get_data_ptr(data_sexp);
+    return Rcpp::XPtr<SubClusterSplitMerge>(new SubClusterSplitMerge(*data, *params, *likelihood, *process,
+                                                                     n_threads, sub_sweeps, proposals,
+                                                                     make_rng(rng)),
+                                            true);
+}
+
+/**
+ * @brief Random scan over samplers with selection probabilities tuned during burn-in (see MoveScheduler)
+ * @param samplers List of external pointers to Sampler objects on the same data; kept alive by the caller
+ * @param weights Initial selection weights, one per sampler
+ * @param adapt_steps Steps during which the probabilities adapt (usually the burn-in)
+ * @param min_prob Floor of each selection probability
+ */
+// [[Rcpp::export]]
+Rcpp::XPtr<MoveScheduler> create_MoveScheduler(SEXP data_sexp, Rcpp::XPtr<Params> params,
+                                               Rcpp::XPtr<Likelihood> likelihood, Rcpp::XPtr<Process> process,
+                                               Rcpp::List samplers, Rcpp::NumericVector weights, int adapt_steps,
+                                               double min_prob = 0.05, SEXP rng = R_NilValue) {
     Data *data = get_data_ptr(data_sexp);
-    return Rcpp::XPtr<SplitMerge_LSS_SDDS>(new SplitMerge_LSS_SDDS(*data, *params, *likelihood, *process, shuffle),
-                                           true);
+    std::vector<Sampler *> moves;
+    moves.reserve(samplers.size());
+    for (int s = 0; s < samplers.size(); ++s) {
+        SEXP sampler = samplers[s];
+        moves.push_back(Rcpp::XPtr<Sampler>(sampler).get());
+    }
+    return Rcpp::XPtr<MoveScheduler>(new MoveScheduler(*data, *params, *likelihood, *process, std::move(moves),
+                                                       Rcpp::as<std::vector<double>>(weights), adapt_steps,
+                                                       min_prob, make_rng(rng)),
+                                     true);
 }
 
 // Wrapper functions for methods
@@ -340,12 +769,333 @@ void process_update_params(Rcpp::XPtr<Process> process) { process->update_params
 // [[Rcpp::export]]
 void sampler_step(Rcpp::XPtr<Sampler> sampler) { sampler->step(); }
 
+/**
+ * @brief Allocates the points with allocation -1 by one Gibbs draw each (warm start after
+ * params_append_points(), see Sampler::allocate_unallocated_points())
+ * @return Number of points allocated
+ */
+// [[Rcpp::export]]
+int sampler_allocate_unallocated_points(Rcpp::XPtr<Sampler> sampler) { return sampler->allocate_unallocated_points(); }
+
+/**
+ * @brief Splits the candidate scoring of the sampler's Gibbs updates over OpenMP threads
+ * @param n_threads Threads per point update (1: serial)
+ * @param min_work Updates with n + 32 K below this stay serial (see Sampler::set_gibbs_threads())
+ */
+// [[Rcpp::export]]
+void sampler_set_gibbs_threads(Rcpp::XPtr<Sampler> sampler, int n_threads, double min_work = 65536) {
+    sampler->set_gibbs_threads(n_threads, static_cast<long>(min_work));
+}
+
+/**
+ * @brief Sets how a Neal3 sampler orders the points within a sweep
+ * @param scan_order "fixed" (the visiting order), "random" (a new permutation of it each sweep)
+ * or "cluster" (grouped by cluster at the start of each sweep; burn-in only, see Neal3::ScanOrder)
+ * @param visit_order Permutation of 1:n visited by "fixed" (NULL: keep the current one), e.g.
+ * from sweep_order_spatial() or sweep_order_distances()
+ */
+// [[Rcpp::export]]
+void neal3_set_scan_order(Rcpp::XPtr<Neal3> sampler, std::string scan_order = "fixed",
+                          SEXP visit_order = R_NilValue) {
+    if (!Rf_isNull(visit_order)) {
+        Rcpp::IntegerVector order(visit_order);
+        std::vector<int> order0(order.begin(), order.end());
+        for (int &i : order0)
+            --i;
+        sampler->set_visit_order(std::move(order0));
+    }
+    sampler->set_scan_order(Neal3::parse_scan_order(scan_order));
+}
+
+/**
+ * @brief Keeps the clusters emptied during a Neal3 sweep as free slots, compacted at its end
+ * @param lazy TRUE to reuse the slot of an emptied cluster for the next new cluster
+ * (Neal3::set_lazy_compaction(); same chain in distribution, clusters numbered differently)
+ */
+// [[Rcpp::export]]
+void neal3_set_lazy_compaction(Rcpp::XPtr<Neal3> sampler, bool lazy = true) { sampler->set_lazy_compaction(lazy); }
+
+/**
+ * @brief Makes each Neal3 sweep visit a random active set, favouring the uncertain points
+ * (Neal3::set_active_set(); the chain is valid once the visit probabilities are frozen)
+ * @param min_visit Smallest probability that a sweep visits a point
+ * @param settled Allocation probability at which a point is visited min_visit of the sweeps
+ * @param adapt_sweeps Sweeps during which the visit probabilities adapt, at least 1: the Neal3
+ * sweeps of the burn-in (BI over the Neal3 period)
+ * @param decay Weight of the latest visit in the running uncertainty of a point
+ * @param enable FALSE to visit every point again
+ */
+// [[Rcpp::export]]
+void neal3_set_active_set(Rcpp::XPtr<Neal3> sampler, double min_visit = 0.05, double settled = 0.99,
+                          int adapt_sweeps = 100, double decay = 0.2, bool enable = true) {
+    if (!enable) {
+        sampler->clear_active_set();
+        return;
+    }
+    Neal3::ActiveSet settings;
+    settings.min_visit = min_visit;
+    settings.settled = settled;
+    settings.adapt_sweeps = adapt_sweeps;
+    settings.decay = decay;
+    sampler->set_active_set(settings);
+}
+
+/**
+ * @brief Bounds the intermediate restricted Gibbs scans of the SplitMerge split and shuffle
+ * proposals (SplitMerge::set_launch_scans())
+ * @param min_scans Scans always run
+ * @param max_scans Scans at most
+ * @param tolerance Fraction of the launch state changing cluster in a scan at which it stops; the
+ * realized scans are in the launch_scan counter of sampler_get_profile()
+ */
+// [[Rcpp::export]]
+void splitmerge_set_launch_scans(Rcpp::XPtr<SplitMerge> sampler, int min_scans = 1, int max_scans = 10,
+                                 double tolerance = 0.02) {
+    SplitMerge::LaunchScans settings;
+    settings.min_scans = min_scans;
+    settings.max_scans = max_scans;
+    settings.tolerance = tolerance;
+    sampler->set_launch_scans(settings);
+}
+
+/**
+ * @brief Active set of a Neal3
+ * @return List with sizes (points visited by each sweep since neal3_set_active_set()),
+ * visit_probabilities (current probability of visiting each point) and frozen (whether the
+ * adaptation is over)
+ */
+// [[Rcpp::export]]
+Rcpp::List neal3_active_set_report(Rcpp::XPtr<Neal3> sampler) {
+    const std::vector<int> &sizes = sampler->get_active_sizes();
+    const std::vector<double> q = sampler->visit_probabilities();
+    return Rcpp::List::create(
+        Rcpp::Named("sizes") = Rcpp::IntegerVector(sizes.begin(), sizes.end()),
+        Rcpp::Named("visit_probabilities") = Rcpp::NumericVector(q.begin(), q.end()),
+        Rcpp::Named("frozen") = sampler->has_active_set() &&
+                                static_cast<int>(sizes.size()) >= sampler->get_active_set().adapt_sweeps);
+}
+
+/**
+ * @brief Reverse Cuthill-McKee order of a spatial graph, neighbours visited close together
+ * @param graph A SpatialCache, or W as accepted by create_SpatialModule()
+ * @param n Number of points (needed for W only)
+ * @return Permutation of 1:n
+ */
+// [[Rcpp::export]]
+Rcpp::IntegerVector sweep_order_spatial(SEXP graph, int n = 0) {
+    std::vector<int> order;
+    if (TYPEOF(graph) == EXTPTRSXP)
+        order = sweep_order::reverse_cuthill_mckee(Rcpp::XPtr<SpatialCache>(graph)->neighbor_cache);
+    else if (n > 0)
+        order = sweep_order::reverse_cuthill_mckee(as_adjacency(graph, n));
+    else
+        Rcpp::stop("sweep_order_spatial: n is needed with an adjacency W");
+    for (int &i : order)
+        ++i;
+    return Rcpp::wrap(order);
+}
+
+/**
+ * @brief Order of the points along a Hilbert curve through a 2-d FastMap embedding of D
+ * @return Permutation of 1:n, points near in D visited close together
+ */
+// [[Rcpp::export]]
+Rcpp::IntegerVector sweep_order_distances(Rcpp::XPtr<Params> params) {
+    std::vector<int> order = sweep_order::distance_order(*params);
+    for (int &i : order)
+        ++i;
+    return Rcpp::wrap(order);
+}
+
+/**
+ * @brief Approximation diagnostics of a ParallelGibbs sampler, cumulated since the last reset
+ * @return Named list with the raw counts and their means per update / check
+ */
+// [[Rcpp::export]]
+Rcpp::List parallel_gibbs_diagnostics(Rcpp::XPtr<ParallelGibbs> sampler) {
+    const ParallelGibbs::Diagnostics &d = sampler->get_diagnostics();
+    const double updates = std::max(1L, d.updates);
+    return Rcpp::List::create(
+        Rcpp::Named("workers") = sampler->num_workers(), Rcpp::Named("colors") = sampler->num_colors(),
+        Rcpp::Named("sweeps") = d.sweeps, Rcpp::Named("rounds") = d.rounds, Rcpp::Named("updates") = d.updates,
+        Rcpp::Named("moves") = d.moves, Rcpp::Named("mean_unseen_moves") = d.unseen_moves / updates,
+        Rcpp::Named("births") = d.births, Rcpp::Named("concurrent_births") = d.concurrent_births,
+        Rcpp::Named("edge_conflicts") = d.edge_conflicts, Rcpp::Named("checked") = d.checked,
+        Rcpp::Named("mean_tv") = d.checked > 0 ? d.tv_sum / d.checked : NA_REAL,
+        Rcpp::Named("max_tv") = d.checked > 0 ? d.tv_max : NA_REAL);
+}
+
+// [[Rcpp::export]]
+void parallel_gibbs_reset_diagnostics(Rcpp::XPtr<ParallelGibbs> sampler) { sampler->reset_diagnostics(); }
+
+/**
+ * @brief Acceptance diagnostics of a ParallelSplitMerge sampler, cumulated since the last reset
+ */
+// [[Rcpp::export]]
+Rcpp::List parallel_splitmerge_diagnostics(Rcpp::XPtr<ParallelSplitMerge> sampler) {
+    const ParallelSplitMerge::Diagnostics &d = sampler->get_diagnostics();
+    return Rcpp::List::create(
+        Rcpp::Named("workers") = sampler->num_workers(), Rcpp::Named("concurrent") = sampler->is_concurrent(),
+        Rcpp::Named("batches") = d.batches, Rcpp::Named("drawn") = d.drawn,
+        Rcpp::Named("overlapping") = d.overlapping, Rcpp::Named("splits") = d.splits,
+        Rcpp::Named("merges") = d.merges,
+        Rcpp::Named("split_acceptance") = d.splits > 0 ? static_cast<double>(d.accepted_splits) / d.splits : NA_REAL,
+        Rcpp::Named("merge_acceptance") = d.merges > 0 ? static_cast<double>(d.accepted_merges) / d.merges : NA_REAL);
+}
+
+// [[Rcpp::export]]
+void parallel_splitmerge_reset_diagnostics(Rcpp::XPtr<ParallelSplitMerge> sampler) { sampler->reset_diagnostics(); }
+
+/**
+ * @brief Acceptance diagnostics of a MultipleTrySplitMerge sampler, cumulated since the last reset
+ */
+// [[Rcpp::export]]
+Rcpp::List multiple_try_splitmerge_diagnostics(Rcpp::XPtr<MultipleTrySplitMerge> sampler) {
+    const MultipleTrySplitMerge::Diagnostics &d = sampler->get_diagnostics();
+    return Rcpp::List::create(
+        Rcpp::Named("tries") = sampler->get_tries(), Rcpp::Named("stacks") = sampler->num_stacks(),
+        Rcpp::Named("concurrent") = sampler->is_concurrent(), Rcpp::Named("splits") = d.splits,
+        Rcpp::Named("merges") = d.merges, Rcpp::Named("candidates") = d.candidates,
+        Rcpp::Named("split_acceptance") = d.splits > 0 ? static_cast<double>(d.accepted_splits) / d.splits : NA_REAL,
+        Rcpp::Named("merge_acceptance") = d.merges > 0 ? static_cast<double>(d.accepted_merges) / d.merges : NA_REAL);
+}
+
+// [[Rcpp::export]]
+void multiple_try_splitmerge_reset_diagnostics(Rcpp::XPtr<MultipleTrySplitMerge> sampler) {
+    sampler->reset_diagnostics();
+}
+
+/**
+ * @brief Mix chosen by a MoveScheduler and the statistics behind it
+ * @return List with `frozen` and a data frame with one row per sampler: initial and current
+ *         selection probability, runs, runs that changed the partition, points moved per run,
+ *         seconds per run and points moved per second
+ */
+// [[Rcpp::export]]
+Rcpp::List move_scheduler_report(Rcpp::XPtr<MoveScheduler> scheduler) {
+    const std::vector<MoveScheduler::MoveStats> &stats = scheduler->get_stats();
+    const int S = static_cast<int>(stats.size());
+    Rcpp::NumericVector initial(S), weight(S), runs(S), changed(S), moved(S), seconds(S), rate(S);
+    for (int s = 0; s < S; ++s) {
+        const MoveScheduler::MoveStats &m = stats[s];
+        initial[s] = m.initial_weight;
+        weight[s] = m.weight;
+        runs[s] = static_cast<double>(m.runs);
+        changed[s] = static_cast<double>(m.changed_runs);
+        moved[s] = m.runs > 0 ? m.moved / m.runs : NA_REAL;
+        seconds[s] = m.runs > 0 ? m.seconds / m.runs : NA_REAL;
+        rate[s] = m.seconds > 0 ? m.moved / m.seconds : NA_REAL;
+    }
+    return Rcpp::List::create(
+        Rcpp::Named("frozen") = scheduler->is_frozen(),
+        Rcpp::Named("moves") = Rcpp::DataFrame::create(
+            Rcpp::Named("initial_weight") = initial, Rcpp::Named("weight") = weight, Rcpp::Named("runs") = runs,
+            Rcpp::Named("changed_runs") = changed, Rcpp::Named("moved_per_run") = moved,
+            Rcpp::Named("seconds_per_run") = seconds, Rcpp::Named("moved_per_second") = rate));
+}
+
 // [[Rcpp::export]]
 Eigen::VectorXi data_get_allocations(SEXP data_sexp) {
     Data *data = get_data_ptr(data_sexp);
     return data->get_allocations();
 }
 
+#if BNP_ALTREP
+// ========== Allocation view ==========
+// Read-only ALTREP integer vector over the allocations of a Data object: data1 is the Data handle
+// (which keeps the object alive), data2 is NULL while the view is live. A request for a writable
+// pointer materializes a copy in data2 and detaches the view from then on; duplicates are plain
+// copies. The callbacks run inside R's C code, so they report errors with Rf_error(), not exceptions.
+
+namespace allocation_view {
+
+R_altrep_class_t view_class;
+bool registered = false;
+
+const Eigen::VectorXi &allocations(SEXP x) {
+    const Data *data = handle_cast<Data, Datax, Data>(R_altrep_data1(x));
+    if (!data)
+        Rf_error("allocation view: the Data object is no longer available");
+    return data->get_allocations();
+}
+
+SEXP copy(SEXP x) {
+    const Eigen::VectorXi &a = allocations(x);
+    SEXP out = PROTECT(Rf_allocVector(INTSXP, a.size()));
+    std::copy(a.data(), a.data() + a.size(), INTEGER(out));
+    UNPROTECT(1);
+    return out;
+}
+
+R_xlen_t length(SEXP x) {
+    const SEXP detached = R_altrep_data2(x);
+    return detached == R_NilValue ? allocations(x).size() : XLENGTH(detached);
+}
+
+void *dataptr(SEXP x, Rboolean writeable) {
+    SEXP detached = R_altrep_data2(x);
+    if (detached == R_NilValue) {
+        if (!writeable)
+            return const_cast<int *>(allocations(x).data());
+        detached = copy(x);
+        R_set_altrep_data2(x, detached);
+    }
+    return INTEGER(detached);
+}
+
+const void *dataptr_or_null(SEXP x) { return dataptr(x, FALSE); }
+
+int elt(SEXP x, R_xlen_t i) { return static_cast<const int *>(dataptr(x, FALSE))[i]; }
+
+SEXP duplicate(SEXP x, Rboolean) {
+    const SEXP detached = R_altrep_data2(x);
+    return detached == R_NilValue ? copy(x) : Rf_duplicate(detached);
+}
+
+Rboolean inspect(SEXP x, int, int, int, void (*)(SEXP, int, int, int)) {
+    Rprintf(" allocation view (%s)\n", R_altrep_data2(x) == R_NilValue ? "live" : "detached");
+    return TRUE;
+}
+
+void ensure_registered() {
+    if (registered)
+        return;
+    view_class = R_make_altinteger_class("allocation_view", "BNPClust", nullptr);
+    R_set_altrep_Length_method(view_class, length);
+    R_set_altrep_Duplicate_method(view_class, duplicate);
+    R_set_altrep_Inspect_method(view_class, inspect);
+    R_set_altvec_Dataptr_method(view_class, dataptr);
+    R_set_altvec_Dataptr_or_null_method(view_class, dataptr_or_null);
+    R_set_altinteger_Elt_method(view_class, elt);
+    registered = true;
+}
+
+} // namespace allocation_view
+#endif
+
+/**
+ * @brief Allocations of a Data object as a read-only view, without copying them.
+ *
+ * The view reads the current allocations of the object on every access, so it follows the chain
+ * while the sampler runs: keep the allocations of an iteration with a copy (e.g. x + 0L).
+ * Modifying the view, or a name it was assigned to, copies it first. The view keeps the Data
+ * object alive. Without ALTREP (R < 3.5.0) it is a copy, as data_get_allocations().
+ *
+ * @param data_sexp Data or Datax object.
+ * @return Integer vector of the 0-based allocations.
+ */
+// [[Rcpp::export]]
+SEXP data_get_allocations_view(SEXP data_sexp) {
+    Data *data = get_data_ptr(data_sexp);
+#if BNP_ALTREP
+    (void)data;
+    allocation_view::ensure_registered();
+    return R_new_altrep(allocation_view::view_class, data_sexp, R_NilValue);
+#else
+    return Rcpp::wrap(data->get_allocations());
+#endif
+}
+
 // [[Rcpp::export]]
 int data_get_K(SEXP data_sexp) {
     Data *data = get_data_ptr(data_sexp);
@@ -358,9 +1108,36 @@ double u_sampler_get_U(Rcpp::XPtr<U_sampler> u_sampler) { return u_sampler->get_
 // [[Rcpp::export]]
 double u_sampler_get_acceptance_rate(Rcpp::XPtr<U_sampler> u_sampler) { return u_sampler->get_acceptance_rate(); }
 
+/**
+ * @brief Efficiency of a U sampler over the updates since construction or the last reset
+ * @param u_sampler External pointer to the U_sampler
+ * @return List with `ess` (batch-means effective sample size of the U trace), `seconds` (time spent
+ *         updating U), `ess_per_second`, `acceptance_rate` and, for the slice sampler, `width` and
+ *         `evaluations_per_update`
+ */
+// [[Rcpp::export]]
+Rcpp::List u_sampler_diagnostics(Rcpp::XPtr<U_sampler> u_sampler) {
+    Rcpp::List out = Rcpp::List::create(Rcpp::Named("ess") = u_sampler->get_ess(),
+                                        Rcpp::Named("seconds") = u_sampler->get_update_seconds(),
+                                        Rcpp::Named("ess_per_second") = u_sampler->get_ess_per_second(),
+                                        Rcpp::Named("acceptance_rate") = u_sampler->get_acceptance_rate());
+    if (const Slice *slice = dynamic_cast<const Slice *>(u_sampler.get())) {
+        out["width"] = slice->get_width();
+        out["evaluations_per_update"] = slice->get_evaluations_per_update();
+    }
+    return out;
+}
+
+// Clears the ESS trace and timer of a U sampler, e.g. after the burn-in
+// [[Rcpp::export]]
+void u_sampler_reset_diagnostics(Rcpp::XPtr<U_sampler> u_sampler) { u_sampler->reset_diagnostics(); }
+
 // [[Rcpp::export]]
 int params_get_BI(Rcpp::XPtr<Params> params) { return params->BI; }
 
+// [[Rcpp::export]]
+int params_get_n(Rcpp::XPtr<Params> params) { return params->n; }
+
 // [[Rcpp::export]]
 int params_get_NI(Rcpp::XPtr<Params> params) { return params->NI; }
 
@@ -373,14 +1150,251 @@ double params_get_sigma(Rcpp::XPtr<Params> params) { return params->sigma; }
 // [[Rcpp::export]]
 double params_get_tau(Rcpp::XPtr<Params> params) { return params->tau; }
 
+/**
+ * @brief Sets the number of burn-in iterations of a Params object (e.g. a short re-burn-in after
+ * params_append_points()).
+ *
+ * @param params Params object.
+ * @param BI Burn-in iterations.
+ */
 // [[Rcpp::export]]
-void cluster_info_set_allocation(Rcpp::XPtr<ClusterInfo> cluster_info, int index, int cluster, int old_cluster) {
-    cluster_info->set_allocation(index, cluster, old_cluster);
-}
+void params_set_BI(Rcpp::XPtr<Params> params, int BI) { params->BI = BI; }
 
+/**
+ * @brief Appends points to the distance matrix of a Params object.
+ *
+ * The current distances (and log D, if computed) are copied rather than recomputed. Every Data,
+ * cache, likelihood, process and sampler built on params must be rebuilt afterwards.
+ * See Params::append_points().
+ *
+ * @param params Params object with in-memory dense distances.
+ * @param D_new m x (n + m) distances of the new points to the current ones, then to each other.
+ */
 // [[Rcpp::export]]
-void cluster_info_recompute(Rcpp::XPtr<ClusterInfo> cluster_info, int K, Eigen::VectorXi allocations) {
-    cluster_info->recompute(K, allocations);
+void params_append_points(Rcpp::XPtr<Params> params, Eigen::MatrixXd D_new) { params->append_points(D_new); }
+
+/**
+ * @brief Switches the distance storage of a Params object to single precision.
+ *
+ * Call it right after create_Params(), before building any Data, cache or likelihood on it.
+ * See Params::use_single_precision().
+ *
+ * @param params Params object.
+ */
+// [[Rcpp::export]]
+void params_use_single_precision(Rcpp::XPtr<Params> params) { params->use_single_precision(); }
+
+/**
+ * @brief Switches the distance storage of a Params object to the packed upper triangle.
+ *
+ * Call it right after create_Params(), before building any Data, cache or likelihood on it.
+ * See Params::use_packed_storage().
+ *
+ * @param params Params object.
+ */
+// [[Rcpp::export]]
+void params_use_packed_storage(Rcpp::XPtr<Params> params) { params->use_packed_storage(); }
+
+/**
+ * @brief Writes a distance matrix and its logarithm to a file that Params objects can map.
+ *
+ * @param D Distance matrix.
+ * @param path Output path (overwritten).
+ */
+// [[Rcpp::export]]
+void write_distance_file(Eigen::MatrixXd D, std::string path) { MappedDistances::write(path, D); }
+
+/**
+ * @brief Makes a Params object read D and log D from a file written by write_distance_file().
+ *
+ * The file is mapped read-only: nothing is copied or recomputed, and concurrent jobs mapping the
+ * same file share it through the page cache. Create the Params with an empty D (matrix(0, 0, 0))
+ * and call this before building any Data, cache or likelihood on it. See Params::map_distances().
+ *
+ * @param params Params object.
+ * @param path Distance file.
+ */
+// [[Rcpp::export]]
+void params_map_distances(Rcpp::XPtr<Params> params, std::string path) { params->map_distances(path); }
+
+/**
+ * @brief Copies the distances of a Params object into huge pages placed on the NUMA nodes.
+ *
+ * Call it before building any Data, cache or likelihood on params. With placement = "replicate"
+ * each node holds a copy: build the stack of chain c on params_replica(params, c - 1) and
+ * run_chains() / run_monitored_chains() pin it to the cores of the node of its copy. What was
+ * obtained is reported by distance_placement(). See Params::place_distances().
+ *
+ * @param params Params object with dense distances (in memory or mapped).
+ * @param huge_pages "none", "transparent" (madvise) or "explicit" (hugetlbfs pool, else transparent).
+ * @param placement "first_touch", "interleave" or "replicate".
+ */
+// [[Rcpp::export]]
+void params_place_distances(Rcpp::XPtr<Params> params, std::string huge_pages = "transparent",
+                            std::string placement = "interleave") {
+    PlacedDistances::Options options;
+    if (huge_pages == "none")
+        options.huge_pages = PlacedDistances::HugePages::NONE;
+    else if (huge_pages == "transparent")
+        options.huge_pages = PlacedDistances::HugePages::TRANSPARENT;
+    else if (huge_pages == "explicit")
+        options.huge_pages = PlacedDistances::HugePages::EXPLICIT;
+    else
+        Rcpp::stop("huge_pages must be \"none\", \"transparent\" or \"explicit\"");
+    if (placement == "first_touch")
+        options.placement = PlacedDistances::Placement::FIRST_TOUCH;
+    else if (placement == "interleave")
+        options.placement = PlacedDistances::Placement::INTERLEAVE;
+    else if (placement == "replicate")
+        options.placement = PlacedDistances::Placement::REPLICATE;
+    else
+        Rcpp::stop("placement must be \"first_touch\", \"interleave\" or \"replicate\"");
+    params->place_distances(options);
+}
+
+/**
+ * @brief Creates a Params object reading one copy of the placed distances of another.
+ *
+ * The copies are shared, not duplicated. See Params::replica().
+ *
+ * @param params Params object after params_place_distances().
+ * @param replica Copy to read, modulo the number of copies (0-based).
+ * @return External pointer to the new Params.
+ */
+// [[Rcpp::export]]
+Rcpp::XPtr<Params> params_replica(Rcpp::XPtr<Params> params, int replica) {
+    return Rcpp::XPtr<Params>(new Params(params->replica(replica)), true);
+}
+
+/**
+ * @brief Moves the in-memory distances of a Params into a store shared by its copies.
+ *
+ * The jobs of run_hyperparameter_grid(), which copy params with their own hyperparameters, then share D,
+ * and log D when the hyperparameters use it, instead of each holding its own. See
+ * Params::share_distances(). Call it before building anything on params.
+ *
+ * @param params Params object.
+ */
+// [[Rcpp::export]]
+void params_share_distances(Rcpp::XPtr<Params> params) { params->share_distances(); }
+
+/**
+ * @brief Creates a Params object on the distances among some of the points of another.
+ *
+ * Same hyperparameters, with a dense copy of the block of the distances (whatever their storage),
+ * for the local chain of a shard (see shard_points()). See Params::subset().
+ *
+ * @param params Params object.
+ * @param indices Points of the block (1-based), in the order of the new points.
+ * @return External pointer to the new Params.
+ */
+// [[Rcpp::export]]
+Rcpp::XPtr<Params> params_subset(Rcpp::XPtr<Params> params, Rcpp::IntegerVector indices) {
+    std::vector<int> points(indices.begin(), indices.end());
+    for (int &i : points)
+        i -= 1;
+    return Rcpp::XPtr<Params>(new Params(params->subset(points)), true);
+}
+
+/**
+ * @brief Creates a builder of the distances between histograms on shared breaks.
+ *
+ * The divergences are those of compute_hist_distances(). See DistanceBuilder.
+ *
+ * @param counts Counts, one histogram per row (n x B).
+ * @param breaks Shared breaks (B + 1 values).
+ * @param type "Wasserstein", "CM", "Jeff", "chi2", "euclidean" or "Histogram-Divergence".
+ */
+// [[Rcpp::export]]
+Rcpp::XPtr<DistanceBuilder> create_hist_distance_builder(Eigen::MatrixXd counts, Eigen::VectorXd breaks,
+                                                         std::string type = "Wasserstein") {
+    return Rcpp::XPtr<DistanceBuilder>(
+        new DistanceBuilder(DistanceBuilder::from_histograms(counts, breaks, DistanceBuilder::parse_divergence(type))),
+        true);
+}
+
+/**
+ * @brief Creates a builder of the distances between densities evaluated on a grid each.
+ *
+ * The divergences are those of compute_kde_distances(). See DistanceBuilder.
+ *
+ * @param x Grid points, one density per row (n x G, e.g. the x of density() objects).
+ * @param y Density values at the grid points (n x G).
+ * @param type "Histogram-Divergence", "Jeff", "chi2", "euclidean", "CM" or "Wasserstein".
+ */
+// [[Rcpp::export]]
+Rcpp::XPtr<DistanceBuilder> create_kde_distance_builder(Eigen::MatrixXd x, Eigen::MatrixXd y,
+                                                        std::string type = "Histogram-Divergence") {
+    return Rcpp::XPtr<DistanceBuilder>(
+        new DistanceBuilder(DistanceBuilder::from_densities(x, y, DistanceBuilder::parse_divergence(type))), true);
+}
+
+/**
+ * @brief Computes the dense distance matrix of a builder.
+ *
+ * @param builder Distance builder.
+ * @param n_threads OpenMP threads (0: all available).
+ */
+// [[Rcpp::export]]
+Eigen::MatrixXd distance_builder_matrix(Rcpp::XPtr<DistanceBuilder> builder, int n_threads = 0) {
+    return builder->dense(n_threads);
+}
+
+/**
+ * @brief Computes the dense distance matrix among some of the distributions of a builder.
+ *
+ * Only the distances of the block are computed, e.g. those of a shard (see shard_points()).
+ *
+ * @param builder Distance builder.
+ * @param indices Distributions of the block (1-based), in the order of the rows.
+ * @param n_threads OpenMP threads (0: all available).
+ */
+// [[Rcpp::export]]
+Eigen::MatrixXd distance_builder_block(Rcpp::XPtr<DistanceBuilder> builder, Rcpp::IntegerVector indices,
+                                       int n_threads = 0) {
+    std::vector<int> points(indices.begin(), indices.end());
+    for (int &i : points)
+        i -= 1;
+    return builder->block(points, n_threads);
+}
+
+/**
+ * @brief Computes the distances of a builder straight into a file for params_map_distances().
+ *
+ * The file is filled in place: the matrix is never held in memory.
+ *
+ * @param builder Distance builder.
+ * @param path Output path (overwritten).
+ * @param n_threads OpenMP threads (0: all available).
+ */
+// [[Rcpp::export]]
+void distance_builder_write_file(Rcpp::XPtr<DistanceBuilder> builder, std::string path, int n_threads = 0) {
+    builder->write_file(path, n_threads);
+}
+
+/**
+ * @brief Computes the distances of a builder straight into the packed storage of a Params object.
+ *
+ * Same storage as params_use_packed_storage(), without a dense D. Create the Params with an empty
+ * D (matrix(0, 0, 0)) and call this before building any Data, cache or likelihood on it.
+ *
+ * @param params Params object.
+ * @param builder Distance builder.
+ * @param n_threads OpenMP threads (0: all available).
+ */
+// [[Rcpp::export]]
+void params_use_built_distances(Rcpp::XPtr<Params> params, Rcpp::XPtr<DistanceBuilder> builder, int n_threads = 0) {
+    params->use_packed_storage(builder->packed(n_threads));
+}
+
+// [[Rcpp::export]]
+void cluster_info_set_allocation(Rcpp::XPtr<ClusterInfo> cluster_info, int index, int cluster, int old_cluster) {
+    cluster_info->set_allocation(index, cluster, old_cluster);
+}
+
+// [[Rcpp::export]]
+void cluster_info_recompute(Rcpp::XPtr<ClusterInfo> cluster_info, int K, Eigen::VectorXi allocations) {
+    cluster_info->recompute(K, allocations);
 }
 
 // [[Rcpp::export]]
@@ -399,3 +1413,1509 @@ void lss_sdds_accepted_moves(Rcpp::XPtr<SplitMerge_LSS_SDDS> sampler) {
     Rcpp::Rcout << "Ratio accepted merges: " << sampler->get_accepted_merge() * 100 << " %" << std::endl;
     Rcpp::Rcout << "Ratio accepted shuffles: " << sampler->get_accepted_shuffle() * 100 << " %" << std::endl;
 }
+
+// ========== Profiling ==========
+
+/**
+ * @brief Call counts and cumulative time of the profiled hot-path components
+ *
+ * Totals over all threads since the start or the last sampler_reset_profile(); times are
+ * inclusive of nested profiled calls. Only the components of the compiled PROFILING level are
+ * recorded (see utils/Profiling.hpp): build with e.g. Sys.setenv(PKG_CPPFLAGS = "-DPROFILING=2")
+ * before sourceCpp(). Call it while no chain is running.
+ *
+ * @return Data frame with `component`, `level`, `calls`, `seconds` and `ns_per_call`
+ */
+// [[Rcpp::export]]
+Rcpp::DataFrame sampler_get_profile() {
+    if (PROFILING < 1)
+        Rcpp::warning("Built with PROFILING = 0: no component is profiled");
+
+    const std::vector<profiling::Total> totals = profiling::Registry::shared().snapshot();
+    const int size = static_cast<int>(totals.size());
+    Rcpp::CharacterVector component(size);
+    Rcpp::IntegerVector level(size);
+    Rcpp::NumericVector calls(size), seconds(size), ns_per_call(size);
+    for (int c = 0; c < size; ++c) {
+        component[c] = totals[c].name;
+        level[c] = profiling::counter_levels[c];
+        calls[c] = static_cast<double>(totals[c].calls);
+        seconds[c] = totals[c].seconds;
+        ns_per_call[c] = totals[c].calls > 0 ? 1e9 * totals[c].seconds / totals[c].calls : NA_REAL;
+    }
+    return Rcpp::DataFrame::create(Rcpp::Named("component") = component, Rcpp::Named("level") = level,
+                                   Rcpp::Named("calls") = calls, Rcpp::Named("seconds") = seconds,
+                                   Rcpp::Named("ns_per_call") = ns_per_call,
+                                   Rcpp::Named("stringsAsFactors") = false);
+}
+
+// [[Rcpp::export]]
+void sampler_reset_profile() { profiling::Registry::shared().reset(); }
+
+// [[Rcpp::export]]
+int profiling_level() { return PROFILING; }
+
+/**
+ * @brief Instruction set levels of the dispatched kernels (see utils/cpu_dispatch.hpp)
+ *
+ * The distance gathers, the log-sum-exp of the Gibbs weights and the continuous covariate
+ * predictives run the kernels of the best level of the CPU, chosen when the library is loaded,
+ * whatever -march the package was built with. Set BNPCLUST_ISA (e.g. "avx2") before loading it
+ * to cap the level.
+ *
+ * @return List with `active` (level of the kernels in use), `detected` (best level of this CPU)
+ *         and `available` (all levels this CPU and build can run, lowest first)
+ */
+// [[Rcpp::export]]
+Rcpp::List cpu_dispatch_info() {
+    const std::vector<cpu_dispatch::Isa> levels = cpu_dispatch::available();
+    Rcpp::CharacterVector available(levels.size());
+    for (size_t l = 0; l < levels.size(); ++l)
+        available[l] = cpu_dispatch::name(levels[l]);
+    return Rcpp::List::create(Rcpp::Named("active") = cpu_dispatch::name(cpu_dispatch::active()),
+                              Rcpp::Named("detected") = cpu_dispatch::name(cpu_dispatch::detected()),
+                              Rcpp::Named("available") = available);
+}
+
+/**
+ * @brief Switches the dispatched kernels to another level, e.g. to compare levels on one machine
+ *
+ * Call it while no chain is running.
+ *
+ * @param isa "generic", "sse4.2", "avx2" or "avx512", at most the detected level
+ * @return Name of the level now active
+ */
+// [[Rcpp::export]]
+std::string cpu_dispatch_select(std::string isa) {
+    cpu_dispatch::select(cpu_dispatch::parse(isa));
+    return cpu_dispatch::name(cpu_dispatch::active());
+}
+
+/**
+ * @brief Storage of the distances of a Params object, with the backing and placement obtained
+ *
+ * Available at every profiling level. huge_page_bytes is read from the kernel at the call, so
+ * it also shows transparent huge pages collapsed or split since params_place_distances().
+ *
+ * @param params Params object.
+ * @return List with `storage` ("memory", "shared", "mapped", "placed", "single_precision" or "packed");
+ *         for placed distances also `huge_pages` and `placement` obtained, `nodes` (node of each
+ *         copy, NA if unbound, 0-based), `node` (of the copy read by params), `bytes` (per copy)
+ *         and `huge_page_bytes` (all copies)
+ */
+// [[Rcpp::export]]
+Rcpp::List distance_placement(Rcpp::XPtr<Params> params) {
+    const PlacedDistances *placed = params->get_D_placed();
+    if (!placed) {
+        std::string storage = "memory";
+        if (params->single_precision())
+            storage = "single_precision";
+        else if (params->get_D_packed())
+            storage = "packed";
+        else if (params->shared_distances())
+            storage = "shared";
+        else if (params->get_D_data() != params->D.data())
+            storage = "mapped";
+        return Rcpp::List::create(Rcpp::Named("storage") = storage);
+    }
+
+    static const char *huge_pages_names[] = {"none", "transparent", "explicit"};
+    static const char *placement_names[] = {"first_touch", "interleave", "replicate"};
+    const PlacedDistances::Report report = placed->report();
+    Rcpp::IntegerVector nodes(report.nodes.size());
+    for (size_t r = 0; r < report.nodes.size(); ++r)
+        nodes[r] = report.nodes[r] < 0 ? NA_INTEGER : report.nodes[r];
+    const int node = params->distance_node();
+    return Rcpp::List::create(Rcpp::Named("storage") = "placed",
+                              Rcpp::Named("huge_pages") = huge_pages_names[static_cast<int>(report.huge_pages)],
+                              Rcpp::Named("placement") = placement_names[static_cast<int>(report.placement)],
+                              Rcpp::Named("nodes") = nodes, Rcpp::Named("node") = node < 0 ? NA_INTEGER : node,
+                              Rcpp::Named("bytes") = static_cast<double>(report.bytes),
+                              Rcpp::Named("huge_page_bytes") = static_cast<double>(report.huge_page_bytes));
+}
+
+// ========== Native Chain Driver ==========
+
+/**
+ * @brief Builds a ChainRunner from the R-side handles of one chain
+ * @param data_sexp External pointer to the Data (or Datax) object
+ * @param process External pointer to the Process
+ * @param samplers_list List of external pointers to Sampler objects
+ * @param schedule Period of each sampler
+ * @param u_sampler_sexp External pointer to the U_sampler, or R_NilValue
+ * @return Runner operating on the given stack
+ */
+ChainRunner make_chain_runner(SEXP data_sexp, Rcpp::XPtr<Process> process, Rcpp::List samplers_list,
+                              Rcpp::IntegerVector schedule, SEXP u_sampler_sexp) {
+    if (samplers_list.size() != schedule.size())
+        Rcpp::stop("samplers and schedule must have the same length");
+
+    std::vector<Sampler *> samplers;
+    std::vector<int> periods;
+    samplers.reserve(samplers_list.size());
+    periods.reserve(samplers_list.size());
+    for (int s = 0; s < samplers_list.size(); ++s) {
+        if (schedule[s] < 1)
+            Rcpp::stop("schedule entries must be positive integers");
+        samplers.push_back(Rcpp::XPtr<Sampler>(samplers_list[s]).get());
+        periods.push_back(schedule[s]);
+    }
+
+    U_sampler *u_ptr = Rf_isNull(u_sampler_sexp) ? nullptr : Rcpp::XPtr<U_sampler>(u_sampler_sexp).get();
+
+    return ChainRunner(*get_data_ptr(data_sexp), *process, std::move(samplers), std::move(periods), u_ptr);
+}
+
+/**
+ * @brief Runs a full MCMC chain natively, without crossing the R/C++ boundary per iteration.
+ *
+ * At every iteration the process parameters are updated first, then each sampler in
+ * `samplers_list` is stepped if the iteration index (1-based) is a multiple of its entry in
+ * `schedule`. Every `thin`-th iteration the allocations, K and (optionally) U are written into
+ * preallocated traces.
+ *
+ * @param data_sexp External pointer to the Data (or Datax) object shared by the stack.
+ * @param process External pointer to the Process.
+ * @param samplers_list List of external pointers to Sampler objects, stepped in order.
+ * @param schedule Period of each sampler (1 = every iteration, 25 = every 25th iteration, ...).
+ * @param BI Number of burn-in iterations.
+ * @param NI Number of iterations after burn-in.
+ * @param thin Thinning interval of the stored traces.
+ * @param u_sampler Optional external pointer to the U_sampler whose U is traced.
+ * @param verbose If true, prints progress 20 times during the run.
+ * @param trace Optional external pointer to a TraceWriter (see create_TraceWriter()), or to a channel
+ *        of an AsyncTraceWriter (async_trace_channel()), receiving the thinned post-burn-in samples.
+ *        The allocations are then not kept in memory.
+ * @param likelihood Optional external pointer to the untempered Likelihood of the samplers. Its value
+ *        is kept up to date from the moves of the samplers (see ChainRunner::track_log_likelihood()),
+ *        traced as `log_posterior` and written to the trace.
+ * @param co_clustering Optional external pointer to a CoClustering accumulator (see
+ *        create_CoClustering()) receiving the thinned post-burn-in samples.
+ * @param checkpoint_file Optional path of a binary checkpoint of the chain state (see ChainRunner).
+ * @param checkpoint_every Iterations between checkpoints written to checkpoint_file (0: none).
+ * @param resume If true, the state is first loaded from checkpoint_file, which must have been written
+ *        by a stack built the same way with the same BI and thin, and the run continues from the
+ *        iteration it was written at. Only the remaining samples are returned.
+ * @param drift_check_every Iterations between full recomputations of the tracked log-likelihood,
+ *        checking its drift (0: none).
+ * @return List with `allocations` (n x n_saved integer matrix, one column per saved iteration,
+ *         NULL with a trace), `K`, `U`, `log_posterior` (NA without a likelihood), `BI`, `NI`,
+ *         `thin`, `first_iteration` (iterations run before this call, 0 unless resumed),
+ *         `elapsed_time` (seconds) and `max_drift` (largest gap found by the drift checks).
+ */
+// [[Rcpp::export]]
+Rcpp::List run_chain(SEXP data_sexp, Rcpp::XPtr<Process> process, Rcpp::List samplers_list,
+                     Rcpp::IntegerVector schedule, int BI, int NI, int thin = 1, SEXP u_sampler = R_NilValue,
+                     bool verbose = true, SEXP trace = R_NilValue, SEXP likelihood = R_NilValue,
+                     SEXP co_clustering = R_NilValue, SEXP checkpoint_file = R_NilValue, int checkpoint_every = 0,
+                     bool resume = false, int drift_check_every = 0) {
+
+    if (thin < 1)
+        Rcpp::stop("thin must be a positive integer");
+    if (BI < 0 || NI < 0)
+        Rcpp::stop("BI and NI must be non-negative");
+    if (checkpoint_every < 0)
+        Rcpp::stop("checkpoint_every must be non-negative");
+    if ((resume || checkpoint_every > 0) && Rf_isNull(checkpoint_file))
+        Rcpp::stop("checkpoint_every and resume need a checkpoint_file");
+    if (drift_check_every < 0)
+        Rcpp::stop("drift_check_every must be non-negative");
+
+    ChainRunner runner = make_chain_runner(data_sexp, process, samplers_list, schedule, u_sampler);
+    const Data *data = get_data_ptr(data_sexp);
+    const bool streamed = !Rf_isNull(trace);
+    if (streamed)
+        runner.set_trace(get_trace_sink_ptr(trace),
+                         Rf_isNull(likelihood) ? nullptr : Rcpp::XPtr<Likelihood>(likelihood).get());
+    if (!Rf_isNull(co_clustering))
+        runner.set_co_clustering(Rcpp::XPtr<CoClustering>(co_clustering).get());
+
+    int first_iteration = 0;
+    if (!Rf_isNull(checkpoint_file)) {
+        const std::string path = Rcpp::as<std::string>(checkpoint_file);
+        if (resume) {
+            first_iteration = runner.load_checkpoint(path, BI, thin);
+            if (first_iteration > BI + NI)
+                Rcpp::stop("the checkpoint was written at iteration " + std::to_string(first_iteration) +
+                           ", after the end of the run");
+        }
+        runner.set_checkpoint(path, checkpoint_every);
+    }
+    if (!Rf_isNull(likelihood))
+        runner.track_log_likelihood(Rcpp::XPtr<Likelihood>(likelihood).get(), drift_check_every);
+
+    // Preallocated traces, filled column by column (allocations only without a trace file)
+    const int n_saved = ChainRunner::n_saved(BI, NI, thin, first_iteration);
+    Rcpp::IntegerMatrix allocations_out(streamed ? 0 : data->get_n(), streamed ? 0 : n_saved);
+    Rcpp::IntegerVector K_out(n_saved);
+    Rcpp::NumericVector U_out(n_saved, NA_REAL);
+    Rcpp::NumericVector log_posterior_out(n_saved, NA_REAL);
+
+    if (verbose) {
+        Rcpp::Rcout << "Starting MCMC with " << NI << " iterations after " << BI << " burn-in..." << std::endl;
+        if (first_iteration > 0)
+            Rcpp::Rcout << "Resuming from the checkpoint at iteration " << first_iteration << std::endl;
+    }
+
+    // Progress and user interrupts, checked 20 times during the run
+    auto on_progress = [&](int i, int total_iters) {
+        Rcpp::checkUserInterrupt();
+        if (verbose) {
+            Rcpp::Rcout << "Iteration " << i << "/" << total_iters << ": Clusters: " << data->get_K() << std::endl;
+        }
+    };
+
+    const double elapsed_time = runner.run(BI, NI, thin, streamed ? nullptr : allocations_out.begin(), K_out.begin(),
+                                           U_out.begin(), on_progress, first_iteration,
+                                           Rf_isNull(likelihood) ? nullptr : log_posterior_out.begin());
+
+    if (verbose) {
+        Rcpp::Rcout << "MCMC completed." << std::endl;
+        Rcpp::Rcout << "Total time (secs): " << elapsed_time << std::endl;
+    }
+
+    return Rcpp::List::create(Rcpp::Named("allocations") = streamed ? R_NilValue : SEXP(allocations_out),
+                              Rcpp::Named("K") = K_out, Rcpp::Named("U") = U_out,
+                              Rcpp::Named("log_posterior") = log_posterior_out, Rcpp::Named("BI") = BI,
+                              Rcpp::Named("NI") = NI, Rcpp::Named("thin") = thin,
+                              Rcpp::Named("first_iteration") = first_iteration,
+                              Rcpp::Named("elapsed_time") = elapsed_time,
+                              Rcpp::Named("max_drift") = runner.get_max_drift());
+}
+
+/**
+ * @brief Runs several independent MCMC chains in parallel on OpenMP threads.
+ *
+ * Each element of `chains` describes one fully built stack as a list with entries `data`,
+ * `process`, `samplers` and optionally `u_sampler`, `trace` (a TraceWriter, one file per chain, or a
+ * channel of an AsyncTraceWriter, one per chain, so that one background thread writes all of them),
+ * `likelihood` (untempered, whose value is tracked as in run_chain() and written to the trace) and `co_clustering` (a CoClustering; several
+ * chains may share one created with shared = TRUE to pool their samples). All stacks should be created from the
+ * same Params object: the distance matrix and its logarithm (see Params::get_log_D_data()) are then
+ * held once and shared read-only by every chain. With distances replicated on the NUMA nodes
+ * (params_place_distances()), stacks built on params_replica() read the copy of a node, and
+ * their chains run on the cores of that node. Every sampler owns its own random number
+ * generator, so chains draw from independent streams.
+ *
+ * No R API call is made inside the parallel region: traces are preallocated on the main thread
+ * and each chain writes only into its own buffers.
+ *
+ * @param chains List of chain descriptions (see above).
+ * @param schedule Period of each sampler, shared by all chains.
+ * @param BI Number of burn-in iterations.
+ * @param NI Number of iterations after burn-in.
+ * @param thin Thinning interval of the stored traces.
+ * @param n_threads Number of threads (0 = OpenMP default).
+ * @param drift_check_every Iterations between full recomputations of the tracked log-likelihoods (0: none).
+ * @return List with one element per chain, each shaped like the output of run_chain().
+ */
+// [[Rcpp::export]]
+Rcpp::List run_chains(Rcpp::List chains, Rcpp::IntegerVector schedule, int BI, int NI, int thin = 1,
+                      int n_threads = 0, int drift_check_every = 0) {
+
+    if (thin < 1)
+        Rcpp::stop("thin must be a positive integer");
+    if (BI < 0 || NI < 0)
+        Rcpp::stop("BI and NI must be non-negative");
+    if (drift_check_every < 0)
+        Rcpp::stop("drift_check_every must be non-negative");
+
+    const int n_chains = chains.size();
+    const int n_saved = ChainRunner::n_saved(BI, NI, thin);
+
+    std::vector<ChainRunner> runners;
+    runners.reserve(n_chains);
+
+    std::vector<Rcpp::IntegerMatrix> allocations_out;
+    std::vector<Rcpp::IntegerVector> K_out;
+    std::vector<Rcpp::NumericVector> U_out;
+    std::vector<Rcpp::NumericVector> log_posterior_out;
+    std::vector<int *> allocations_ptr(n_chains);
+    std::vector<char> streamed(n_chains, 0);
+    std::vector<int *> K_ptr(n_chains);
+    std::vector<double *> U_ptr(n_chains), log_posterior_ptr(n_chains);
+
+    for (int c = 0; c < n_chains; ++c) {
+        Rcpp::List chain = chains[c];
+        SEXP u_sampler = chain.containsElementNamed("u_sampler") ? SEXP(chain["u_sampler"]) : R_NilValue;
+        runners.push_back(make_chain_runner(chain["data"], Rcpp::XPtr<Process>(SEXP(chain["process"])),
+                                            chain["samplers"], schedule, u_sampler));
+
+        const bool has_likelihood = chain.containsElementNamed("likelihood") && !Rf_isNull(chain["likelihood"]);
+        const Likelihood *likelihood = has_likelihood ? Rcpp::XPtr<Likelihood>(SEXP(chain["likelihood"])).get() : nullptr;
+        streamed[c] = chain.containsElementNamed("trace") && !Rf_isNull(chain["trace"]);
+        if (streamed[c])
+            runners.back().set_trace(get_trace_sink_ptr(chain["trace"]), likelihood);
+        if (likelihood)
+            runners.back().track_log_likelihood(likelihood, drift_check_every);
+
+        if (chain.containsElementNamed("co_clustering") && !Rf_isNull(chain["co_clustering"])) {
+            CoClustering *accumulator = Rcpp::XPtr<CoClustering>(SEXP(chain["co_clustering"])).get();
+            for (int other = 0; other < c && !accumulator->is_shared(); ++other) {
+                Rcpp::List previous = chains[other];
+                if (previous.containsElementNamed("co_clustering") &&
+                    Rcpp::XPtr<CoClustering>(SEXP(previous["co_clustering"])).get() == accumulator)
+                    Rcpp::stop("A co-clustering accumulator used by several chains must be created with shared = TRUE");
+            }
+            runners.back().set_co_clustering(accumulator);
+        }
+
+        const int n = get_data_ptr(chain["data"])->get_n();
+        allocations_out.emplace_back(streamed[c] ? 0 : n, streamed[c] ? 0 : n_saved);
+        K_out.emplace_back(n_saved);
+        U_out.emplace_back(n_saved, NA_REAL);
+        log_posterior_out.emplace_back(n_saved, NA_REAL);
+        allocations_ptr[c] = streamed[c] ? nullptr : allocations_out.back().begin();
+        K_ptr[c] = K_out.back().begin();
+        U_ptr[c] = U_out.back().begin();
+        log_posterior_ptr[c] = likelihood ? log_posterior_out.back().begin() : nullptr;
+    }
+
+    std::vector<double> elapsed_time(n_chains, 0.0);
+    std::vector<std::string> errors(n_chains);
+
+#ifdef _OPENMP
+    if (n_threads <= 0)
+        n_threads = omp_get_max_threads();
+#pragma omp parallel for schedule(dynamic, 1) num_threads(n_threads)
+#endif
+    for (int c = 0; c < n_chains; ++c) {
+        // Exceptions must not escape the parallel region
+        try {
+            // Next to the copy of the distances the chain reads (see params_place_distances())
+            const NodeAffinity pin(runners[c].get_data().get_params().distance_node());
+            elapsed_time[c] = runners[c].run(BI, NI, thin, allocations_ptr[c], K_ptr[c], U_ptr[c], {}, 0,
+                                             log_posterior_ptr[c]);
+        } catch (const std::exception &e) {
+            errors[c] = e.what();
+        }
+    }
+
+    Rcpp::List results(n_chains);
+    for (int c = 0; c < n_chains; ++c) {
+        if (!errors[c].empty())
+            Rcpp::stop("Chain " + std::to_string(c + 1) + " failed: " + errors[c]);
+
+        results[c] = Rcpp::List::create(Rcpp::Named("allocations") =
+                                            streamed[c] ? R_NilValue : SEXP(allocations_out[c]),
+                                        Rcpp::Named("K") = K_out[c], Rcpp::Named("U") = U_out[c],
+                                        Rcpp::Named("log_posterior") = log_posterior_out[c],
+                                        Rcpp::Named("BI") = BI, Rcpp::Named("NI") = NI, Rcpp::Named("thin") = thin,
+                                        Rcpp::Named("elapsed_time") = elapsed_time[c],
+                                        Rcpp::Named("max_drift") = runners[c].get_max_drift());
+    }
+
+    return results;
+}
+
+/**
+ * @brief Runs independent chains in parallel, ending the burn-in and the run on convergence (see ConvergenceMonitor).
+ *
+ * Each element of `chains` describes one stack as for run_chains(); its `likelihood`, if given, is
+ * monitored through the log-posterior of the samples. Traces and co-clustering accumulators of the
+ * chains are ignored: the samples are returned. Every `check_every` iterations the split-R-hat
+ * across the chains and the batch-means effective sample size of K, U and the log-posterior are
+ * computed: the burn-in ends once they meet `rhat_max` and `min_ess` on its second half, and the
+ * run once they reach `target_ess` after the burn-in.
+ *
+ * @param chains List of chain descriptions.
+ * @param schedule Period of each sampler, shared by all chains.
+ * @param BI Largest number of burn-in iterations.
+ * @param NI Largest number of iterations after burn-in.
+ * @param thin Thinning interval of the stored traces.
+ * @param check_every Iterations between checks.
+ * @param rhat_max Largest split-R-hat ending the burn-in.
+ * @param min_ess Smallest effective sample size (over all the chains) ending the burn-in.
+ * @param target_ess Effective sample size after the burn-in ending the run (0: run all NI iterations).
+ * @param min_burn_in Iterations before the burn-in can end.
+ * @param n_threads Number of threads (0 = OpenMP default).
+ * @param verbose If true, prints the progress at the checks (about 20 times).
+ * @return List with `chains`, one element per chain shaped like the output of run_chain() (with
+ *         `log_posterior` next to `K` and `U`, and `BI` and `NI` the iterations actually run), and
+ *         `convergence`: `burn_in`, `iterations`, `burn_in_converged`, `target_reached` and a data
+ *         frame `diagnostics` with the split-R-hat and effective sample size of each monitored
+ *         quantity after the burn-in and at its last check.
+ */
+// [[Rcpp::export]]
+Rcpp::List run_monitored_chains(Rcpp::List chains, Rcpp::IntegerVector schedule, int BI, int NI, int thin = 1,
+                                int check_every = 100, double rhat_max = 1.05, double min_ess = 100,
+                                double target_ess = 0, int min_burn_in = 0, int n_threads = 0, bool verbose = true) {
+
+    if (thin < 1)
+        Rcpp::stop("thin must be a positive integer");
+    if (BI < 0 || NI < 0)
+        Rcpp::stop("BI and NI must be non-negative");
+
+    const int n_chains = chains.size();
+    std::vector<ConvergenceMonitor::Chain> monitored;
+    monitored.reserve(n_chains);
+    for (int c = 0; c < n_chains; ++c) {
+        Rcpp::List chain = chains[c];
+        SEXP u_sampler = chain.containsElementNamed("u_sampler") ? SEXP(chain["u_sampler"]) : R_NilValue;
+        const bool has_likelihood = chain.containsElementNamed("likelihood") && !Rf_isNull(chain["likelihood"]);
+        monitored.push_back({make_chain_runner(chain["data"], Rcpp::XPtr<Process>(SEXP(chain["process"])),
+                                               chain["samplers"], schedule, u_sampler),
+                             has_likelihood ? Rcpp::XPtr<Likelihood>(SEXP(chain["likelihood"])).get() : nullptr});
+    }
+
+    ConvergenceMonitor::Options options;
+    options.check_every = check_every;
+    options.rhat_max = rhat_max;
+    options.min_ess = min_ess;
+    options.target_ess = target_ess;
+    options.min_burn_in = min_burn_in;
+    ConvergenceMonitor monitor(std::move(monitored), options);
+
+    // Buffers for the longest run, cut to the iterations run afterwards
+    const int n = get_data_ptr(Rcpp::List(chains[0])["data"])->get_n();
+    const int max_saved = ChainRunner::n_saved(BI, NI, thin);
+    std::vector<std::vector<int>> allocations_buffer(n_chains, std::vector<int>(static_cast<size_t>(n) * max_saved));
+    std::vector<std::vector<int>> K_buffer(n_chains, std::vector<int>(max_saved));
+    std::vector<std::vector<double>> U_buffer(n_chains, std::vector<double>(max_saved, NA_REAL));
+    std::vector<std::vector<double>> log_posterior_buffer(n_chains, std::vector<double>(max_saved));
+    std::vector<int *> allocations_ptr(n_chains), K_ptr(n_chains);
+    std::vector<double *> U_ptr(n_chains), log_posterior_ptr(n_chains);
+    for (int c = 0; c < n_chains; ++c) {
+        allocations_ptr[c] = allocations_buffer[c].data();
+        K_ptr[c] = K_buffer[c].data();
+        U_ptr[c] = U_buffer[c].data();
+        log_posterior_ptr[c] = log_posterior_buffer[c].data();
+    }
+
+    if (verbose)
+        Rcpp::Rcout << "Starting " << n_chains << " monitored chains with at most " << NI
+                    << " iterations after at most " << BI << " burn-in..." << std::endl;
+
+    // Called after each check, on the calling thread
+    const int progress_every = std::max(1, (BI + NI) / 20);
+    int last_report = 0;
+    auto on_progress = [&](int i, int total_iters) {
+        Rcpp::checkUserInterrupt();
+        if (verbose && (i / progress_every != last_report / progress_every || i == total_iters)) {
+            Rcpp::Rcout << "Iteration " << i << "/" << total_iters << std::endl;
+            last_report = i;
+        }
+    };
+
+    const double elapsed_time = monitor.run(BI, NI, thin, allocations_ptr, K_ptr, U_ptr, log_posterior_ptr,
+                                            n_threads, on_progress);
+    const ConvergenceMonitor::Report &report = monitor.get_report();
+    const int n_saved = (report.burn_in + report.iterations) / thin;
+
+    if (verbose)
+        Rcpp::Rcout << "Burn-in " << (report.burn_in_converged ? "converged after " : "ended at ") << report.burn_in
+                    << " iterations; " << report.iterations << " iterations after it"
+                    << (report.target_reached ? " (target ESS reached)" : "") << ", " << elapsed_time << " secs."
+                    << std::endl;
+
+    Rcpp::List results(n_chains);
+    for (int c = 0; c < n_chains; ++c) {
+        Rcpp::IntegerMatrix allocations_out(n, n_saved);
+        std::copy(allocations_buffer[c].begin(), allocations_buffer[c].begin() + static_cast<size_t>(n) * n_saved,
+                  allocations_out.begin());
+        results[c] = Rcpp::List::create(
+            Rcpp::Named("allocations") = allocations_out,
+            Rcpp::Named("K") = Rcpp::IntegerVector(K_buffer[c].begin(), K_buffer[c].begin() + n_saved),
+            Rcpp::Named("U") = Rcpp::NumericVector(U_buffer[c].begin(), U_buffer[c].begin() + n_saved),
+            Rcpp::Named("log_posterior") =
+                Rcpp::NumericVector(log_posterior_buffer[c].begin(), log_posterior_buffer[c].begin() + n_saved),
+            Rcpp::Named("BI") = report.burn_in, Rcpp::Named("NI") = report.iterations, Rcpp::Named("thin") = thin,
+            Rcpp::Named("elapsed_time") = elapsed_time);
+    }
+
+    const char *names[ConvergenceMonitor::n_quantities] = {"K", "U", "log_posterior"};
+    int rows = 0;
+    for (int q = 0; q < ConvergenceMonitor::n_quantities; ++q)
+        rows += report.monitored[q];
+    Rcpp::CharacterVector quantity(rows);
+    Rcpp::NumericVector rhat(rows), ess(rows), burn_in_rhat(rows), burn_in_ess(rows);
+    for (int q = 0, r = 0; q < ConvergenceMonitor::n_quantities; ++q) {
+        if (!report.monitored[q])
+            continue;
+        quantity[r] = names[q];
+        rhat[r] = report.rhat[q];
+        ess[r] = report.ess[q];
+        burn_in_rhat[r] = report.burn_in_rhat[q];
+        burn_in_ess[r] = report.burn_in_ess[q];
+        r++;
+    }
+
+    return Rcpp::List::create(
+        Rcpp::Named("chains") = results,
+        Rcpp::Named("convergence") = Rcpp::List::create(
+            Rcpp::Named("burn_in") = report.burn_in, Rcpp::Named("iterations") = report.iterations,
+            Rcpp::Named("burn_in_converged") = report.burn_in_converged,
+            Rcpp::Named("target_reached") = report.target_reached,
+            Rcpp::Named("diagnostics") = Rcpp::DataFrame::create(
+                Rcpp::Named("quantity") = quantity, Rcpp::Named("rhat") = rhat, Rcpp::Named("ess") = ess,
+                Rcpp::Named("burn_in_rhat") = burn_in_rhat, Rcpp::Named("burn_in_ess") = burn_in_ess,
+                Rcpp::Named("stringsAsFactors") = false)));
+}
+
+/**
+ * @brief Runs tempered chains in parallel, swapping their temperatures (see ReplicaExchange).
+ *
+ * Each element of `chains` describes one stack as for run_chains(), whose samplers were built on
+ * a Tempered_likelihood given as `likelihood` (see create_Tempered_likelihood()). Traces and
+ * co-clustering accumulators of the chains are ignored: the samples of the posterior are returned.
+ *
+ * @param chains List of chain descriptions, one per temperature.
+ * @param betas Inverse temperatures, starting at 1 and decreasing.
+ * @param schedule Period of each sampler, shared by all chains.
+ * @param BI Number of burn-in iterations.
+ * @param NI Number of iterations after burn-in.
+ * @param thin Thinning interval of the stored traces.
+ * @param swap_every Iterations between swap attempts.
+ * @param n_threads Number of threads (0 = OpenMP default).
+ * @param verbose If true, prints progress 20 times during the run.
+ * @param rng Random number generator of the swaps.
+ * @return List shaped like the output of run_chain() for the beta = 1 samples, plus `cold_chain`
+ *         (1-based chain each sample was taken from) and `swaps`, a data frame with one row per
+ *         pair of adjacent temperatures.
+ */
+// [[Rcpp::export]]
+Rcpp::List run_tempered_chains(Rcpp::List chains, Rcpp::NumericVector betas, Rcpp::IntegerVector schedule, int BI,
+                               int NI, int thin = 1, int swap_every = 10, int n_threads = 0, bool verbose = true,
+                               SEXP rng = R_NilValue) {
+
+    if (thin < 1)
+        Rcpp::stop("thin must be a positive integer");
+    if (BI < 0 || NI < 0)
+        Rcpp::stop("BI and NI must be non-negative");
+
+    std::vector<ReplicaExchange::Chain> tempered;
+    tempered.reserve(chains.size());
+    for (int c = 0; c < chains.size(); ++c) {
+        Rcpp::List chain = chains[c];
+        SEXP u_sampler = chain.containsElementNamed("u_sampler") ? SEXP(chain["u_sampler"]) : R_NilValue;
+        SEXP likelihood = chain["likelihood"];
+        tempered.push_back({make_chain_runner(chain["data"], Rcpp::XPtr<Process>(SEXP(chain["process"])),
+                                              chain["samplers"], schedule, u_sampler),
+                            Rcpp::XPtr<Tempered_likelihood>(likelihood).get()});
+    }
+
+    ReplicaExchange exchange(std::move(tempered), Rcpp::as<std::vector<double>>(betas), swap_every,
+                             make_rng(rng));
+
+    const int n = get_data_ptr(Rcpp::List(chains[0])["data"])->get_n();
+    const int n_saved = ChainRunner::n_saved(BI, NI, thin);
+    Rcpp::IntegerMatrix allocations_out(n, n_saved);
+    Rcpp::IntegerVector K_out(n_saved), cold_out(n_saved);
+    Rcpp::NumericVector U_out(n_saved, NA_REAL);
+
+    if (verbose)
+        Rcpp::Rcout << "Starting " << exchange.size() << " tempered chains with " << NI << " iterations after " << BI
+                    << " burn-in..." << std::endl;
+
+    // Called between rounds, on the calling thread
+    auto on_progress = [&](int i, int total_iters) {
+        Rcpp::checkUserInterrupt();
+        if (verbose)
+            Rcpp::Rcout << "Iteration " << i << "/" << total_iters << std::endl;
+    };
+
+    const double elapsed_time = exchange.run(BI, NI, thin, allocations_out.begin(), K_out.begin(), U_out.begin(),
+                                             cold_out.begin(), n_threads, on_progress);
+    for (int s = 0; s < n_saved; ++s)
+        cold_out[s] += 1;
+
+    const std::vector<double> &beta = exchange.get_betas();
+    const std::vector<ReplicaExchange::PairStats> &stats = exchange.get_pair_stats();
+    const int pairs = static_cast<int>(stats.size());
+    Rcpp::NumericVector beta_cold(pairs), beta_hot(pairs), attempted(pairs), accepted(pairs), rate(pairs);
+    for (int t = 0; t < pairs; ++t) {
+        beta_cold[t] = beta[t];
+        beta_hot[t] = beta[t + 1];
+        attempted[t] = static_cast<double>(stats[t].attempted);
+        accepted[t] = static_cast<double>(stats[t].accepted);
+        rate[t] = stats[t].attempted > 0 ? accepted[t] / attempted[t] : NA_REAL;
+    }
+
+    if (verbose)
+        Rcpp::Rcout << "Tempered MCMC completed in " << elapsed_time << " secs." << std::endl;
+
+    return Rcpp::List::create(
+        Rcpp::Named("allocations") = allocations_out, Rcpp::Named("K") = K_out, Rcpp::Named("U") = U_out,
+        Rcpp::Named("cold_chain") = cold_out, Rcpp::Named("BI") = BI, Rcpp::Named("NI") = NI,
+        Rcpp::Named("thin") = thin, Rcpp::Named("elapsed_time") = elapsed_time,
+        Rcpp::Named("swaps") = Rcpp::DataFrame::create(Rcpp::Named("beta_cold") = beta_cold,
+                                                       Rcpp::Named("beta_hot") = beta_hot,
+                                                       Rcpp::Named("attempted") = attempted,
+                                                       Rcpp::Named("accepted") = accepted,
+                                                       Rcpp::Named("acceptance") = rate));
+}
+
+// ========== Trace Files ==========
+
+/**
+ * @brief Creates a trace file receiving the samples of run_chain() / run_chains()
+ * @param path Output path (overwritten)
+ * @param n Number of points
+ * @param keyframe_interval Samples between full keyframes (bounds the work to read a slice)
+ * @param compression_level Deflate level 1-9, or 0 for none (needs a build with -DTRACE_FILE_ZLIB=1)
+ * @return External pointer to the writer; the file is completed by trace_writer_close() or when
+ *         the pointer is garbage collected
+ */
+// [[Rcpp::export]]
+Rcpp::XPtr<TraceWriter> create_TraceWriter(std::string path, int n, int keyframe_interval = 256,
+                                           int compression_level = 0) {
+    return make_handle(new TraceWriter(path, n, keyframe_interval, compression_level));
+}
+
+// [[Rcpp::export]]
+void trace_writer_close(Rcpp::XPtr<TraceWriter> trace) { trace->close(); }
+
+/**
+ * @brief Starts a background thread writing the samples of several chains to their trace files
+ *
+ * See AsyncTraceWriter: each chain streams to its channel (async_trace_channel()), which copies
+ * the sample into a bounded ring and returns; the thread encodes and writes the samples of all
+ * the channels, so sampling and output overlap.
+ *
+ * @param writers List of TraceWriter external pointers (create_TraceWriter()), one per channel.
+ * @param capacity Samples each ring holds (n ints each).
+ * @param backpressure "block" (a chain waits for a free slot, the trace is complete) or "drop"
+ *        (a sample arriving at a full ring is discarded and counted, the chain never waits).
+ * @return External pointer to the writer; it keeps the TraceWriters alive. Close it with
+ *         async_trace_writer_close() after the run, which also closes the trace files.
+ */
+// [[Rcpp::export]]
+Rcpp::XPtr<AsyncTraceWriter> create_AsyncTraceWriter(Rcpp::List writers, int capacity = 64,
+                                                     std::string backpressure = "block") {
+    AsyncTraceWriter::Backpressure policy;
+    if (backpressure == "block")
+        policy = AsyncTraceWriter::Backpressure::Block;
+    else if (backpressure == "drop")
+        policy = AsyncTraceWriter::Backpressure::Drop;
+    else
+        Rcpp::stop("backpressure must be \"block\" or \"drop\"");
+    std::vector<TraceWriter *> targets;
+    for (int c = 0; c < writers.size(); ++c)
+        targets.push_back(Rcpp::XPtr<TraceWriter>(SEXP(writers[c])).get());
+    return Rcpp::XPtr<AsyncTraceWriter>(new AsyncTraceWriter(targets, capacity, policy), true, R_NilValue, writers);
+}
+
+/**
+ * @brief Channel of one chain of an AsyncTraceWriter, to pass as the trace of run_chain() or of a
+ * chain of run_chains()
+ * @param writer External pointer to the AsyncTraceWriter.
+ * @param chain Index of the channel (1-based, that of its TraceWriter in the list).
+ * @return External pointer to the channel; it keeps the writer alive.
+ */
+// [[Rcpp::export]]
+SEXP async_trace_channel(Rcpp::XPtr<AsyncTraceWriter> writer, int chain) {
+    if (chain < 1 || chain > writer->size())
+        Rcpp::stop("chain must be between 1 and the number of trace files");
+    return Rcpp::XPtr<AsyncTraceWriter::Channel>(&writer->channel(chain - 1), false,
+                                                 handle_tag<AsyncTraceWriter::Channel>(), writer);
+}
+
+/**
+ * @brief Writes the queued samples, stops the background thread and closes the trace files
+ * @param writer External pointer to the AsyncTraceWriter.
+ */
+// [[Rcpp::export]]
+void async_trace_writer_close(Rcpp::XPtr<AsyncTraceWriter> writer) { writer->close(); }
+
+/**
+ * @brief Counters of the channels of an AsyncTraceWriter
+ * @param writer External pointer to the AsyncTraceWriter.
+ * @return Data frame with one row per channel: `queued` (samples handed over by the chain),
+ *         `written`, `dropped` (full ring, "drop" policy) and `stalls` (writes that waited for a
+ *         slot, "block" policy).
+ */
+// [[Rcpp::export]]
+Rcpp::DataFrame async_trace_writer_stats(Rcpp::XPtr<AsyncTraceWriter> writer) {
+    const int channels = writer->size();
+    Rcpp::NumericVector queued(channels), written(channels), dropped(channels), stalls(channels);
+    for (int c = 0; c < channels; ++c) {
+        const AsyncTraceWriter::Channel &channel = writer->channel(c);
+        queued[c] = static_cast<double>(channel.get_queued());
+        written[c] = static_cast<double>(channel.get_written());
+        dropped[c] = static_cast<double>(channel.get_dropped());
+        stalls[c] = static_cast<double>(channel.get_stalls());
+    }
+    return Rcpp::DataFrame::create(Rcpp::Named("queued") = queued, Rcpp::Named("written") = written,
+                                   Rcpp::Named("dropped") = dropped, Rcpp::Named("stalls") = stalls);
+}
+
+// [[Rcpp::export]]
+Rcpp::XPtr<TraceReader> create_TraceReader(std::string path) {
+    return Rcpp::XPtr<TraceReader>(new TraceReader(path), true);
+}
+
+/**
+ * @brief Header information and scalar traces of a trace file
+ * @return List with `n`, `samples`, `keyframe_interval`, `compression_level`, `K`, `U` and
+ *         `loglik` (one entry per sample)
+ */
+// [[Rcpp::export]]
+Rcpp::List trace_reader_info(Rcpp::XPtr<TraceReader> reader) {
+    const auto &K = reader->get_K();
+    const auto &U = reader->get_U();
+    const auto &loglik = reader->get_log_likelihood();
+    return Rcpp::List::create(Rcpp::Named("n") = reader->size(),
+                              Rcpp::Named("samples") = static_cast<double>(reader->get_samples()),
+                              Rcpp::Named("keyframe_interval") = reader->get_keyframe_interval(),
+                              Rcpp::Named("compression_level") = reader->get_compression_level(),
+                              Rcpp::Named("K") = Rcpp::IntegerVector(K.begin(), K.end()),
+                              Rcpp::Named("U") = Rcpp::NumericVector(U.begin(), U.end()),
+                              Rcpp::Named("loglik") = Rcpp::NumericVector(loglik.begin(), loglik.end()));
+}
+
+/**
+ * @brief Reads consecutive samples of a trace file
+ * @param reader External pointer to a TraceReader
+ * @param first Index of the first sample (1-based)
+ * @param count Number of samples (-1: up to the last one)
+ * @return n x count integer matrix, one column per sample
+ */
+// [[Rcpp::export]]
+Rcpp::IntegerMatrix trace_reader_allocations(Rcpp::XPtr<TraceReader> reader, double first = 1, double count = -1) {
+    const int64_t samples = reader->get_samples();
+    const int64_t first0 = static_cast<int64_t>(first) - 1;
+    const int64_t length = count < 0 ? samples - first0 : static_cast<int64_t>(count);
+    if (first0 < 0 || length < 0 || first0 + length > samples)
+        Rcpp::stop("Requested samples outside the " + std::to_string(samples) + " samples of the trace");
+
+    Rcpp::IntegerMatrix out(reader->size(), static_cast<int>(length));
+    reader->read_allocations(first0, length, out.begin());
+    return out;
+}
+
+// ========== Co-Clustering ==========
+
+/**
+ * @brief Creates an online posterior similarity matrix accumulator
+ * @param n Number of points
+ * @param layout "packed" (upper triangle, default), "dense" (full n x n) or "sparse" (pairs seen only)
+ * @param shared If TRUE, several chains of run_chains() may feed it concurrently
+ * @return External pointer to the accumulator, to pass to run_chain() / run_chains()
+ */
+// [[Rcpp::export]]
+Rcpp::XPtr<CoClustering> create_CoClustering(int n, std::string layout = "packed", bool shared = false) {
+    CoClustering::Layout storage;
+    if (layout == "packed")
+        storage = CoClustering::Layout::Packed;
+    else if (layout == "dense")
+        storage = CoClustering::Layout::Dense;
+    else if (layout == "sparse")
+        storage = CoClustering::Layout::Sparse;
+    else
+        Rcpp::stop("layout must be one of \"packed\", \"dense\" or \"sparse\"");
+    return Rcpp::XPtr<CoClustering>(new CoClustering(n, storage, shared), true);
+}
+
+// [[Rcpp::export]]
+double co_clustering_samples(Rcpp::XPtr<CoClustering> accumulator) {
+    return static_cast<double>(accumulator->get_samples());
+}
+
+/**
+ * @brief Posterior similarity matrix accumulated so far
+ * @return n x n matrix with the fraction of samples in which each pair shares a cluster
+ */
+// [[Rcpp::export]]
+Rcpp::NumericMatrix co_clustering_matrix(Rcpp::XPtr<CoClustering> accumulator) {
+    Rcpp::NumericMatrix out(accumulator->size(), accumulator->size());
+    accumulator->to_dense(out.begin());
+    return out;
+}
+
+/**
+ * @brief Non-zero posterior similarities as triplets, without forming the n x n matrix
+ * @return List with `i`, `j` (1-based, i < j) and `x` (similarity) of every pair seen in a cluster
+ */
+// [[Rcpp::export]]
+Rcpp::List co_clustering_pairs(Rcpp::XPtr<CoClustering> accumulator) {
+    std::vector<int> rows, cols;
+    std::vector<double> values;
+    const double scale = accumulator->get_samples() > 0 ? 1.0 / accumulator->get_samples() : 0.0;
+    accumulator->for_each_pair([&](int i, int j, uint32_t c) {
+        rows.push_back(i + 1);
+        cols.push_back(j + 1);
+        values.push_back(c * scale);
+    });
+    return Rcpp::List::create(Rcpp::Named("i") = Rcpp::IntegerVector(rows.begin(), rows.end()),
+                              Rcpp::Named("j") = Rcpp::IntegerVector(cols.begin(), cols.end()),
+                              Rcpp::Named("x") = Rcpp::NumericVector(values.begin(), values.end()));
+}
+
+// ========== Initial Partition ==========
+
+/**
+ * @brief Starting allocations by CLARA-style k-medoids on the distances of params
+ *
+ * Native search on any distance storage (see InitialPartition): restarts on independent samples
+ * run in parallel and the partition with the smallest sum of distances to the medoids is kept.
+ *
+ * @param params Params object (after any storage switch, e.g. params_map_distances()).
+ * @param K Number of clusters (0: expected number under a DP prior with the total mass of params;
+ *        pass it explicitly for an NGGP, which expects more clusters).
+ * @param restarts Number of independent samples.
+ * @param sample_size Points per sample (0: 40 + 20 K).
+ * @param max_iterations Maximum k-medoids iterations per sample.
+ * @param n_threads Number of threads (0 = OpenMP default).
+ * @param rng Optional external pointer to the master Rng; one stream is split off per restart.
+ * @return List with `allocations` (0-based, ready for create_Data(), create_Datax() and the
+ *         caches), `medoids` (1-based), `cost` and `K`.
+ */
+// [[Rcpp::export]]
+Rcpp::List initial_partition(Rcpp::XPtr<Params> params, int K = 0, int restarts = 5, int sample_size = 0,
+                             int max_iterations = 20, int n_threads = 0, SEXP rng = R_NilValue) {
+    InitialPartition::Options options;
+    options.K = K;
+    options.restarts = restarts;
+    options.sample_size = sample_size;
+    options.max_iterations = max_iterations;
+    options.n_threads = n_threads;
+    Rng master = make_rng(rng);
+    const InitialPartition::Result result = InitialPartition::k_medoids(*params, options, master);
+
+    Rcpp::IntegerVector medoids(result.medoids.begin(), result.medoids.end());
+    for (int k = 0; k < medoids.size(); ++k)
+        medoids[k] += 1;
+    return Rcpp::List::create(Rcpp::Named("allocations") = Rcpp::IntegerVector(result.labels.begin(), result.labels.end()),
+                              Rcpp::Named("medoids") = medoids, Rcpp::Named("cost") = result.cost,
+                              Rcpp::Named("K") = static_cast<int>(result.medoids.size()));
+}
+
+/**
+ * @brief Starting partition from a short chain on a weighted coreset of the points
+ *
+ * See CoarseToFine: m representatives seeded by D^2 sampling stand for the points closest to
+ * them, as groups of copies in proportion to their weights; a chain of the chosen process and
+ * likelihood on the copies (M points) is lifted back to all n points.
+ *
+ * @param params Params object of the full chain.
+ * @param process "DP" or "NGGP".
+ * @param likelihood "Natarajan" or "Gamma".
+ * @param representatives Coreset size m (0: min(n, 500)).
+ * @param budget Points of the coarse chain (0: min(n, 4 m)).
+ * @param iterations Iterations of the coarse chain.
+ * @param start_clusters K of the k-medoids start of the coarse chain (0: the initial_partition() default).
+ * @param rng Optional external pointer to the master Rng.
+ * @return List with `allocations` (0-based, ready for create_Data(), create_Datax() and the caches),
+ *         `K`, `representatives` (1-based), `weights`, `copies`, `representative_labels` (0-based),
+ *         `coreset_time` and `chain_time` (seconds).
+ */
+// [[Rcpp::export]]
+Rcpp::List coarse_to_fine_start(Rcpp::XPtr<Params> params, std::string process = "NGGP",
+                                std::string likelihood = "Natarajan", int representatives = 0, int budget = 0,
+                                int iterations = 200, int start_clusters = 0, SEXP rng = R_NilValue) {
+    CoarseToFine::Options options;
+    options.process = process;
+    options.likelihood = likelihood;
+    options.representatives = representatives;
+    options.budget = budget;
+    options.iterations = iterations;
+    options.start_clusters = start_clusters;
+    Rng master = make_rng(rng);
+    const CoarseToFine::Result result = CoarseToFine::run(*params, options, master);
+
+    const CoarseToFine::Coreset &coreset = result.coreset;
+    Rcpp::IntegerVector points(coreset.representatives.begin(), coreset.representatives.end());
+    for (int r = 0; r < points.size(); ++r)
+        points[r] += 1;
+    return Rcpp::List::create(
+        Rcpp::Named("allocations") = Rcpp::IntegerVector(result.allocations.data(),
+                                                         result.allocations.data() + result.allocations.size()),
+        Rcpp::Named("K") = result.K, Rcpp::Named("representatives") = points,
+        Rcpp::Named("weights") = Rcpp::IntegerVector(coreset.weights.begin(), coreset.weights.end()),
+        Rcpp::Named("copies") = Rcpp::IntegerVector(coreset.copies.begin(), coreset.copies.end()),
+        Rcpp::Named("representative_labels") =
+            Rcpp::IntegerVector(result.coarse_allocations.data(),
+                                result.coarse_allocations.data() + result.coarse_allocations.size()),
+        Rcpp::Named("coreset_time") = result.coreset_time, Rcpp::Named("chain_time") = result.chain_time);
+}
+
+// ========== Point Estimate ==========
+
+/**
+ * @brief Point estimate of the clustering minimizing the posterior expected VI or Binder loss
+ *
+ * Native SALSO-style search (see PartitionEstimator): restarts run in parallel and every move is
+ * scored incrementally, so no R-side loss evaluation is involved.
+ *
+ * @param samples The post-burn-in draws, as an integer matrix with one column per draw (e.g. the
+ *        allocations of run_chain() or trace_reader_allocations()) or an external pointer to a
+ *        TraceReader (all its samples are used); or, for the Binder loss only, an n x n numeric
+ *        posterior similarity matrix (e.g. from co_clustering_matrix()).
+ * @param loss "VI" (default) or "binder".
+ * @param restarts Number of restarts.
+ * @param max_sweeps Maximum number of sweeps per restart.
+ * @param max_clusters Maximum number of clusters (0: twice the largest K of the draws for VI, n for Binder).
+ * @param binder_a Binder cost of clustering together a pair that should be apart (separating costs 1).
+ * @param n_threads Number of threads (0 = OpenMP default).
+ * @param rng Optional external pointer to the master Rng; one stream is split off per restart.
+ * @return List with `labels` (1-based), `loss`, `K`, `sweeps` and `restart` of the best partition.
+ */
+// [[Rcpp::export]]
+Rcpp::List point_estimate(SEXP samples, std::string loss = "VI", int restarts = 16, int max_sweeps = 100,
+                          int max_clusters = 0, double binder_a = 1.0, int n_threads = 0, SEXP rng = R_NilValue) {
+    PartitionEstimator::Loss loss_type;
+    if (loss == "VI")
+        loss_type = PartitionEstimator::Loss::VI;
+    else if (loss == "binder")
+        loss_type = PartitionEstimator::Loss::Binder;
+    else
+        Rcpp::stop("loss must be \"VI\" or \"binder\"");
+
+    std::unique_ptr<PartitionEstimator> estimator;
+    if (TYPEOF(samples) == EXTPTRSXP) {
+        Rcpp::XPtr<TraceReader> reader(samples);
+        std::vector<int> draws(static_cast<size_t>(reader->size()) * reader->get_samples());
+        reader->read_allocations(0, reader->get_samples(), draws.data());
+        estimator.reset(new PartitionEstimator(reader->size(), draws.data(), static_cast<int>(reader->get_samples())));
+    } else if (TYPEOF(samples) == REALSXP) {
+        Rcpp::NumericMatrix similarity(samples);
+        if (similarity.nrow() != similarity.ncol())
+            Rcpp::stop("A numeric input must be the square posterior similarity matrix");
+        estimator.reset(new PartitionEstimator(similarity.nrow(), std::vector<double>(similarity.begin(), similarity.end())));
+    } else {
+        Rcpp::IntegerMatrix draws(samples);
+        estimator.reset(new PartitionEstimator(draws.nrow(), draws.begin(), draws.ncol()));
+    }
+
+    PartitionEstimator::Options options;
+    options.restarts = restarts;
+    options.max_sweeps = max_sweeps;
+    options.max_clusters = max_clusters;
+    options.binder_a = binder_a;
+    options.n_threads = n_threads;
+    Rng master = make_rng(rng);
+    const PartitionEstimator::Result result = estimator->minimize(loss_type, options, master);
+
+    Rcpp::IntegerVector labels(result.labels.begin(), result.labels.end());
+    for (int i = 0; i < labels.size(); ++i)
+        labels[i] += 1;
+    return Rcpp::List::create(Rcpp::Named("labels") = labels, Rcpp::Named("loss") = result.loss,
+                              Rcpp::Named("K") = *std::max_element(result.labels.begin(), result.labels.end()) + 1,
+                              Rcpp::Named("sweeps") = result.sweeps, Rcpp::Named("restart") = result.restart + 1);
+}
+
+// ========== Divide and Conquer ==========
+
+/**
+ * @brief Splits the points into shards for a divide-and-conquer round
+ *
+ * See ShardedClustering::assign_shards(): random shards without labels; with the global labels of
+ * a previous round, every cluster is kept in one shard as far as the shard sizes allow.
+ *
+ * @param n Number of points.
+ * @param n_shards Number of shards.
+ * @param labels Global cluster of each point (0-based, e.g. `labels` of merge_shard_clusters()),
+ *        or integer(0) for random shards.
+ * @param rng Optional external pointer to the master Rng; one stream is split off.
+ * @return List of integer vectors, the points of each shard (1-based, increasing).
+ */
+// [[Rcpp::export]]
+Rcpp::List shard_points(int n, int n_shards, Rcpp::IntegerVector labels = Rcpp::IntegerVector(),
+                        SEXP rng = R_NilValue) {
+    Rng gen = make_rng(rng);
+    const std::vector<std::vector<int>> shards =
+        ShardedClustering::assign_shards(n, n_shards, std::vector<int>(labels.begin(), labels.end()), gen);
+
+    Rcpp::List result(shards.size());
+    for (size_t s = 0; s < shards.size(); ++s) {
+        Rcpp::IntegerVector points(shards[s].begin(), shards[s].end());
+        for (int q = 0; q < points.size(); ++q)
+            points[q] += 1;
+        result[s] = points;
+    }
+    return result;
+}
+
+/**
+ * @brief Merges the local clusters of the shards into a global partition
+ *
+ * Every local cluster is summarized by its size, up to `representatives` members and their mean
+ * pairwise distance; clusters of different shards are then merged by average linkage on the
+ * representatives while it is at most `threshold` times their mean spread (see ShardedClustering).
+ * Only the distances among representatives are read.
+ *
+ * @param shards Points of each shard (1-based), as from shard_points().
+ * @param allocations Local allocations of each shard (0-based, one per point of the shard), e.g. the
+ *        last draw of its chain.
+ * @param params Params object on the full data (or NULL with a builder).
+ * @param builder Distance builder on the full data (or NULL with params).
+ * @param representatives Largest number of representatives per local cluster.
+ * @param threshold Largest ratio of linkage to mean spread of a merge; two parts of one cluster have
+ *        a ratio about 1, so it should be above 1.
+ * @param n_threads Number of threads (0 = OpenMP default).
+ * @param rng Optional external pointer to the master Rng; one stream is split off.
+ * @return List with `labels` (0-based global allocations, ready for create_Data() or shard_points()),
+ *         `K` and `clusters`, a data frame of the local clusters (shard, label, size, spread, group).
+ */
+// [[Rcpp::export]]
+Rcpp::List merge_shard_clusters(Rcpp::List shards, Rcpp::List allocations, SEXP params = R_NilValue,
+                                SEXP builder = R_NilValue, int representatives = 16, double threshold = 1.5,
+                                int n_threads = 0, SEXP rng = R_NilValue) {
+    if (shards.size() != allocations.size())
+        Rcpp::stop("shards and allocations must have one entry per shard");
+
+    ShardedClustering::DistanceFn distance;
+    int n = 0;
+    if (!Rf_isNull(params)) {
+        Rcpp::XPtr<Params> p(params);
+        distance = [p](int i, int j) { return p->distance(i, j); };
+        n = p->n;
+    } else if (!Rf_isNull(builder)) {
+        Rcpp::XPtr<DistanceBuilder> b(builder);
+        distance = [b](int i, int j) { return b->distance(i, j); };
+        n = b->size();
+    } else {
+        Rcpp::stop("Either params or builder must be given");
+    }
+
+    std::vector<std::vector<int>> points(shards.size()), local(shards.size());
+    for (int s = 0; s < shards.size(); ++s) {
+        Rcpp::IntegerVector idx = shards[s];
+        Rcpp::IntegerVector labels = allocations[s];
+        if (idx.size() != labels.size())
+            Rcpp::stop("shard " + std::to_string(s + 1) + " has " + std::to_string(idx.size()) + " points and " +
+                       std::to_string(labels.size()) + " allocations");
+        for (int q = 0; q < idx.size(); ++q) {
+            if (idx[q] < 1 || idx[q] > n)
+                Rcpp::stop("shard indices must be between 1 and n");
+            points[s].push_back(idx[q] - 1);
+        }
+        local[s].assign(labels.begin(), labels.end());
+    }
+
+    Rng gen = make_rng(rng);
+    std::vector<ShardedClustering::Summary> summaries;
+    for (size_t s = 0; s < points.size(); ++s) {
+        std::vector<ShardedClustering::Summary> shard_summaries =
+            ShardedClustering::summarize(static_cast<int>(s), points[s], local[s], distance, representatives, gen);
+        summaries.insert(summaries.end(), shard_summaries.begin(), shard_summaries.end());
+    }
+    const std::vector<int> groups = ShardedClustering::merge(summaries, distance, threshold, n_threads);
+    const std::vector<int> labels = ShardedClustering::global_labels(n, points, local, summaries, groups);
+
+    const size_t M = summaries.size();
+    Rcpp::IntegerVector shard(M), label(M), size(M), group(groups.begin(), groups.end());
+    Rcpp::NumericVector spread(M);
+    for (size_t m = 0; m < M; ++m) {
+        shard[m] = summaries[m].shard + 1;
+        label[m] = summaries[m].label;
+        size[m] = summaries[m].size;
+        spread[m] = summaries[m].has_spread ? summaries[m].spread : NA_REAL;
+    }
+    return Rcpp::List::create(
+        Rcpp::Named("labels") = Rcpp::IntegerVector(labels.begin(), labels.end()),
+        Rcpp::Named("K") = groups.empty() ? 0 : *std::max_element(groups.begin(), groups.end()) + 1,
+        Rcpp::Named("clusters") = Rcpp::DataFrame::create(Rcpp::Named("shard") = shard, Rcpp::Named("label") = label,
+                                                          Rcpp::Named("size") = size, Rcpp::Named("spread") = spread,
+                                                          Rcpp::Named("group") = group));
+}
+
+// ========== Memory ==========
+
+namespace memory_report {
+
+/** @brief Readable class name of a component */
+template <typename T> std::string type_name(const T &object) {
+    const char *mangled = typeid(object).name();
+    int status = 0;
+    char *demangled = abi::__cxa_demangle(mangled, nullptr, nullptr, &status);
+    std::string name = status == 0 && demangled ? demangled : mangled;
+    std::free(demangled);
+    return name;
+}
+
+/** @brief Adds the components of one chain description to the report */
+void add_chain(MemoryReport &report, Rcpp::List chain) {
+    const auto has = [&](const char *name) { return chain.containsElementNamed(name) && !Rf_isNull(chain[name]); };
+
+    if (has("data")) {
+        const Data *data = get_data_ptr(chain["data"]);
+        report.add(data, "data", type_name(*data), data->memory_bytes());
+        if (const Datax *datax = dynamic_cast<const Datax *>(data)) {
+            for (const std::shared_ptr<ClusterInfo> &cache : datax->get_cluster_info())
+                report.add(cache.get(), "cache", type_name(*cache), cache->memory_bytes());
+        }
+    }
+    if (has("likelihood")) {
+        const Likelihood *likelihood = Rcpp::XPtr<Likelihood>(SEXP(chain["likelihood"])).get();
+        report.add(likelihood, "likelihood", type_name(*likelihood), likelihood->memory_bytes());
+    }
+    if (has("process")) {
+        const Process *process = Rcpp::XPtr<Process>(SEXP(chain["process"])).get();
+        report.add(process, "process", type_name(*process), process->memory_bytes());
+        const std::vector<std::shared_ptr<Module>> *modules = nullptr;
+        if (const DPx *dpx = dynamic_cast<const DPx *>(process))
+            modules = &dpx->get_modules();
+        else if (const NGGPx *nggpx = dynamic_cast<const NGGPx *>(process))
+            modules = &nggpx->get_modules();
+        if (modules) {
+            for (const std::shared_ptr<Module> &module : *modules)
+                report.add(module.get(), "module", type_name(*module), module->memory_bytes());
+        }
+    }
+    if (has("samplers")) {
+        Rcpp::List samplers = chain["samplers"];
+        for (int s = 0; s < samplers.size(); ++s) {
+            const Sampler *sampler = Rcpp::XPtr<Sampler>(SEXP(samplers[s])).get();
+            report.add(sampler, "sampler", type_name(*sampler), sampler->memory_bytes());
+        }
+    }
+    if (has("co_clustering")) {
+        const CoClustering *accumulator = Rcpp::XPtr<CoClustering>(SEXP(chain["co_clustering"])).get();
+        report.add(accumulator, "co_clustering", "CoClustering", accumulator->memory_bytes());
+    }
+}
+
+/** @brief Data frame of a report, with its total as an attribute */
+Rcpp::List to_list(const MemoryReport &report) {
+    const std::vector<MemoryReport::Entry> &entries = report.entries();
+    Rcpp::CharacterVector component(entries.size()), type(entries.size());
+    Rcpp::NumericVector bytes(entries.size());
+    for (size_t e = 0; e < entries.size(); ++e) {
+        component[e] = entries[e].component;
+        type[e] = entries[e].type;
+        bytes[e] = static_cast<double>(entries[e].bytes);
+    }
+    return Rcpp::List::create(
+        Rcpp::Named("components") = Rcpp::DataFrame::create(Rcpp::Named("component") = component,
+                                                            Rcpp::Named("type") = type, Rcpp::Named("bytes") = bytes,
+                                                            Rcpp::Named("stringsAsFactors") = false),
+        Rcpp::Named("total") = static_cast<double>(report.total()));
+}
+
+} // namespace memory_report
+
+/**
+ * @brief Heap bytes held by the components of one or more chains
+ *
+ * Walks the chain descriptions as returned by build_chain() (entries `data`, `likelihood`,
+ * `process`, `samplers` and optionally `co_clustering`): the Data and its caches, the likelihood,
+ * the process and its modules, every sampler (with the anchor tables of the SDDS split-merge) and
+ * the co-clustering accumulator, then the distance stores of params. An object shared by several
+ * chains or listed twice is counted once. The R objects of the chains (the distance matrix passed
+ * from R, the traces returned) are not included: see memory_report() on the R side.
+ *
+ * @param chains One chain description, or a list of them.
+ * @param params Optional external pointer to the Params the chains were built on.
+ * @return List with `components`, a data frame (component, type, bytes), and `total`, in bytes.
+ */
+// [[Rcpp::export]]
+Rcpp::List bnp_memory_report(Rcpp::List chains, SEXP params = R_NilValue) {
+    MemoryReport report;
+    if (chains.containsElementNamed("data")) {
+        memory_report::add_chain(report, chains);
+    } else {
+        for (int c = 0; c < chains.size(); ++c)
+            memory_report::add_chain(report, Rcpp::List(chains[c]));
+    }
+    if (!Rf_isNull(params))
+        Rcpp::XPtr<Params>(params)->report_memory(report);
+    return memory_report::to_list(report);
+}
+
+/**
+ * @brief Predicted heap bytes of a run, before building anything
+ *
+ * See MemoryReport::estimate(). Entries of config (all optional): `chains`, `storage`
+ * ("dense", "single", "packed", "mapped" or "placed"), `replicas`, `log_distances`, `from_r`,
+ * `distance_cache`, `cluster_layout`, `knn`, `spatial_edges` (-1: no spatial cache),
+ * `continuos_covariates`, `binary_covariates`, `categorical_covariates`, `categories`,
+ * `multi_covariates`, `saved_samples` and `co_clustering` ("none", "dense", "packed"
+ * or "sparse"); the defaults are those of a single chain of build_chain() on a dense D from R.
+ * The entry `startup` is the transient peak of the conversion of D into the chosen storage.
+ *
+ * @param n Number of points.
+ * @param K Expected number of clusters (0: sqrt(n)).
+ * @param config Named list of the configuration.
+ * @return List with `components`, a data frame (component, type, bytes), and `total`, in bytes.
+ */
+// [[Rcpp::export]]
+Rcpp::List bnp_memory_estimate(int n, int K = 0, Rcpp::List config = Rcpp::List()) {
+    MemoryReport::Config options;
+    options.n = n;
+    options.K = K;
+    const auto get = [&](const char *name, auto &field) {
+        if (config.containsElementNamed(name))
+            field = Rcpp::as<std::decay_t<decltype(field)>>(config[name]);
+    };
+    get("chains", options.chains);
+    get("storage", options.storage);
+    get("replicas", options.replicas);
+    get("log_distances", options.log_distances);
+    get("from_r", options.from_r);
+    get("distance_cache", options.distance_cache);
+    get("cluster_layout", options.cluster_layout);
+    get("knn", options.knn);
+    get("spatial_edges", options.spatial_edges);
+    get("continuos_covariates", options.continuos_covariates);
+    get("binary_covariates", options.binary_covariates);
+    get("categorical_covariates", options.categorical_covariates);
+    get("categories", options.categories);
+    get("multi_covariates", options.multi_covariates);
+    get("saved_samples", options.saved_samples);
+    get("co_clustering", options.co_clustering);
+    return memory_report::to_list(MemoryReport::estimate(options));
+}
+
+// ========== Hyperparameter Grid ==========
+
+/**
+ * @brief Runs one chain per hyperparameter configuration, all on the distances of params
+ *
+ * See HyperparameterGrid: the distances and the split-merge anchor tables are built once and
+ * shared read-only by every job (a dense D of params is moved to a shared store, see
+ * params_share_distances()), while each job builds its own Data, likelihood, process and
+ * samplers on the thread that runs it and keeps only a summary. The jobs are taken one at a time
+ * by the threads, so jobs of unequal length balance over them.
+ *
+ * @param params External pointer to the Params of the distances; its scalars are the defaults of
+ *        the jobs.
+ * @param jobs Data frame (or list of equal-length vectors) with one row per job and any of the
+ *        columns delta1, alpha, beta, delta2, gamma, zeta, a, sigma, tau, BI, NI and thin; a
+ *        missing column takes the value of params (thin: 1).
+ * @param process "DP" or "NGGP".
+ * @param likelihood "Natarajan" or "Gamma".
+ * @param periods Periods of SplitMerge_LSS_SDDS and Neal3, as the schedule of run_chain().
+ * @param initial_allocations Starting partition of every job (0-based), or integer(0).
+ * @param n_threads Number of threads (0 = OpenMP default).
+ * @param rng Optional external pointer to the master Rng; one stream is split off per job.
+ * @return List with `summary`, a data frame with one row per job (samples, mean_K, sd_K, mean_U,
+ *         mean_log_posterior, max_log_posterior, elapsed_time, error: "" unless the job failed), `K_counts` (per job,
+ *         samples with 0, 1, 2, ... clusters) and `allocations` (per job, the last partition, 0-based).
+ */
+// [[Rcpp::export]]
+Rcpp::List run_hyperparameter_grid(Rcpp::XPtr<Params> params, Rcpp::List jobs, std::string process = "NGGP",
+                                   std::string likelihood = "Natarajan",
+                                   Rcpp::IntegerVector periods = Rcpp::IntegerVector::create(1, 25),
+                                   Rcpp::IntegerVector initial_allocations = Rcpp::IntegerVector(),
+                                   int n_threads = 0, SEXP rng = R_NilValue) {
+    int n_jobs = -1;
+    for (int c = 0; c < jobs.size(); ++c) {
+        const int length = Rcpp::as<Rcpp::NumericVector>(jobs[c]).size();
+        if (n_jobs >= 0 && length != n_jobs)
+            Rcpp::stop("run_hyperparameter_grid: the columns of jobs must have the same length");
+        n_jobs = length;
+    }
+    n_jobs = std::max(n_jobs, 0);
+
+    Rng gen = make_rng(rng);
+    std::vector<HyperparameterGrid::Job> configurations(n_jobs);
+    for (int j = 0; j < n_jobs; ++j)
+        configurations[j] = HyperparameterGrid::Job::from(*params, gen());
+    const auto column = [&](const char *name, auto member) {
+        if (!jobs.containsElementNamed(name))
+            return;
+        Rcpp::NumericVector values = Rcpp::as<Rcpp::NumericVector>(jobs[name]);
+        for (int j = 0; j < n_jobs; ++j)
+            configurations[j].*member = values[j];
+    };
+    using Job = HyperparameterGrid::Job;
+    column("delta1", &Job::delta1);
+    column("alpha", &Job::alpha);
+    column("beta", &Job::beta);
+    column("delta2", &Job::delta2);
+    column("gamma", &Job::gamma);
+    column("zeta", &Job::zeta);
+    column("a", &Job::a);
+    column("sigma", &Job::sigma);
+    column("tau", &Job::tau);
+    column("BI", &Job::BI);
+    column("NI", &Job::NI);
+    column("thin", &Job::thin);
+
+    HyperparameterGrid::Options options;
+    options.process = process;
+    options.likelihood = likelihood;
+    options.periods.assign(periods.begin(), periods.end());
+    options.initial_allocations = Rcpp::as<Eigen::VectorXi>(initial_allocations);
+    const HyperparameterGrid grid(*params, options);
+    const std::vector<HyperparameterGrid::Summary> summaries = grid.run(configurations, n_threads);
+
+    Rcpp::IntegerVector samples(n_jobs);
+    Rcpp::NumericVector mean_K(n_jobs), sd_K(n_jobs), mean_U(n_jobs), mean_log_posterior(n_jobs),
+        max_log_posterior(n_jobs), elapsed_time(n_jobs);
+    Rcpp::CharacterVector error(n_jobs);
+    Rcpp::List K_counts(n_jobs), allocations(n_jobs);
+    for (int j = 0; j < n_jobs; ++j) {
+        const HyperparameterGrid::Summary &summary = summaries[j];
+        const bool failed = !summary.error.empty();
+        samples[j] = summary.samples;
+        mean_K[j] = failed ? NA_REAL : summary.mean_K;
+        sd_K[j] = failed ? NA_REAL : summary.sd_K;
+        mean_U[j] = failed || process == "DP" ? NA_REAL : summary.mean_U;
+        mean_log_posterior[j] = failed ? NA_REAL : summary.mean_log_posterior;
+        max_log_posterior[j] = failed ? NA_REAL : summary.max_log_posterior;
+        elapsed_time[j] = summary.elapsed_time;
+        error[j] = summary.error;
+        K_counts[j] = Rcpp::IntegerVector(summary.K_counts.begin(), summary.K_counts.end());
+        allocations[j] = Rcpp::IntegerVector(summary.allocations.data(),
+                                             summary.allocations.data() + summary.allocations.size());
+    }
+    return Rcpp::List::create(
+        Rcpp::Named("summary") = Rcpp::DataFrame::create(
+            Rcpp::Named("samples") = samples, Rcpp::Named("mean_K") = mean_K, Rcpp::Named("sd_K") = sd_K,
+            Rcpp::Named("mean_U") = mean_U, Rcpp::Named("mean_log_posterior") = mean_log_posterior,
+            Rcpp::Named("max_log_posterior") = max_log_posterior, Rcpp::Named("elapsed_time") = elapsed_time,
+            Rcpp::Named("error") = error, Rcpp::Named("stringsAsFactors") = false),
+        Rcpp::Named("K_counts") = K_counts, Rcpp::Named("allocations") = allocations);
+}
+
+// ========== Predictive Allocation ==========
+
+/**
+ * @brief Allocator of new observations to the clusters of a fitted chain, see PredictiveAllocator
+ *
+ * Freeze samples with predictive_allocator_add_samples(), then compute the distances of the new
+ * points to predictive_allocator_landmarks() and call predictive_allocate().
+ *
+ * @param params External pointer to the Params of the chain (hyperparameters).
+ * @param reference Partition the probabilities refer to (0-based), e.g. point_estimate()$labels - 1;
+ *        integer(0): the first sample added.
+ * @param process "DP" or "NGGP".
+ * @param likelihood "Natarajan" or "Gamma".
+ * @param representatives Landmarks per cluster; the distance sums of larger clusters are estimated
+ *        from them (0: every member, exact).
+ * @param modules List of the module caches of the process (ContinuosCovariatesModuleCache,
+ *        BinaryCovariatesModuleCache or SpatialModuleCache), built on the Data of the samples.
+ * @param rng Optional external pointer to the master Rng; draws the landmarks.
+ * @return External pointer to the allocator.
+ */
+// [[Rcpp::export]]
+Rcpp::XPtr<PredictiveAllocator> create_PredictiveAllocator(Rcpp::XPtr<Params> params,
+                                                           Rcpp::IntegerVector reference = Rcpp::IntegerVector(),
+                                                           std::string process = "NGGP",
+                                                           std::string likelihood = "Natarajan",
+                                                           int representatives = 8, Rcpp::List modules = Rcpp::List(),
+                                                           SEXP rng = R_NilValue) {
+    PredictiveAllocator::Options options;
+    options.process = process;
+    options.likelihood = likelihood;
+    options.representatives = representatives;
+    auto *allocator =
+        new PredictiveAllocator(*params, options, Rcpp::as<Eigen::VectorXi>(reference), make_rng(rng));
+    Rcpp::XPtr<PredictiveAllocator> handle(allocator, true);
+    for (int m = 0; m < modules.size(); ++m)
+        allocator->add_module(*Rcpp::XPtr<std::shared_ptr<Module>>(Rcpp::as<SEXP>(modules[m])));
+    return handle;
+}
+
+/**
+ * @brief Freezes posterior samples into a PredictiveAllocator
+ *
+ * Each sample is set on data (which updates its caches, read by the modules) and frozen; data gets
+ * its partition back at the end.
+ *
+ * @param allocator External pointer to the allocator.
+ * @param data External pointer to the Data of the chain (with the caches of the modules).
+ * @param samples Integer matrix with one column per sample (0-based allocations, as from
+ *        run_chain()), an external pointer to a TraceReader (all its samples, and their U), or
+ *        NULL for the current partition of data.
+ * @param U U of each sample for the NGGP (NULL: the U of the TraceReader, or of u_sampler).
+ * @param u_sampler Optional external pointer to the U sampler, for the current partition.
+ * @return Number of samples frozen so far.
+ */
+// [[Rcpp::export]]
+int predictive_allocator_add_samples(Rcpp::XPtr<PredictiveAllocator> allocator, SEXP data, SEXP samples = R_NilValue,
+                                     SEXP U = R_NilValue, SEXP u_sampler = R_NilValue) {
+    Data *d = get_data_ptr(data);
+    const int n = d->get_n();
+    std::vector<double> u;
+    if (!Rf_isNull(U)) {
+        Rcpp::NumericVector values(U);
+        u.assign(values.begin(), values.end());
+    }
+
+    if (Rf_isNull(samples)) {
+        if (u.empty() && !Rf_isNull(u_sampler))
+            u.push_back(Rcpp::XPtr<U_sampler>(u_sampler)->get_U());
+        allocator->add_sample(*d, u.empty() ? std::numeric_limits<double>::quiet_NaN() : u[0]);
+        return allocator->samples();
+    }
+
+    std::vector<int> draws;
+    int S = 0;
+    if (TYPEOF(samples) == EXTPTRSXP) {
+        Rcpp::XPtr<TraceReader> reader(samples);
+        if (reader->size() != n)
+            Rcpp::stop("predictive_allocator_add_samples: the trace has another number of points");
+        S = static_cast<int>(reader->get_samples());
+        draws.resize(static_cast<std::size_t>(n) * S);
+        reader->read_allocations(0, S, draws.data());
+        if (u.empty())
+            u = reader->get_U();
+    } else {
+        Rcpp::IntegerMatrix matrix(samples);
+        if (matrix.nrow() != n)
+            Rcpp::stop("predictive_allocator_add_samples: samples need one row per point");
+        S = matrix.ncol();
+        draws.assign(matrix.begin(), matrix.end());
+    }
+    if (!u.empty() && static_cast<int>(u.size()) != S)
+        Rcpp::stop("predictive_allocator_add_samples: U needs one value per sample");
+
+    const Eigen::VectorXi saved = d->get_allocations();
+    try {
+        for (int s = 0; s < S; ++s) {
+            d->set_allocations(Eigen::Map<const Eigen::VectorXi>(draws.data() + static_cast<std::size_t>(s) * n, n));
+            allocator->add_sample(*d, u.empty() ? std::numeric_limits<double>::quiet_NaN() : u[s]);
+        }
+    } catch (...) {
+        d->set_allocations(saved);
+        throw;
+    }
+    d->set_allocations(saved);
+    return allocator->samples();
+}
+
+/**
+ * @brief Training points whose distances predictive_allocate() needs
+ * @param allocator External pointer to the allocator.
+ * @return 1-based indices, in the column order of the distances.
+ */
+// [[Rcpp::export]]
+Rcpp::IntegerVector predictive_allocator_landmarks(Rcpp::XPtr<PredictiveAllocator> allocator) {
+    const std::vector<int> &landmarks = allocator->landmarks();
+    Rcpp::IntegerVector out(landmarks.begin(), landmarks.end());
+    for (int i = 0; i < out.size(); ++i)
+        out[i] += 1;
+    return out;
+}
+
+/**
+ * @brief Allocation probabilities of new points
+ *
+ * @param allocator External pointer to the allocator, with its samples.
+ * @param distances Matrix with one row per new point: its distances to
+ *        predictive_allocator_landmarks(), in that order.
+ * @param continuos Matrix of the continuous covariates, one column per continuous module (NULL: none).
+ * @param binary Integer matrix of the binary covariates (0/1), one column per binary module (NULL: none).
+ * @param neighbors List with, for each new point, the 1-based training points adjacent to it
+ *        (spatial modules; NULL: none).
+ * @param n_threads Number of threads (0 = OpenMP default).
+ * @return List with `probabilities` (points x (K + 1) matrix: the K clusters of the reference, then
+ *         a new cluster) and `labels` (most probable column, 0-based; K: a new cluster).
+ */
+// [[Rcpp::export]]
+Rcpp::List predictive_allocate(Rcpp::XPtr<PredictiveAllocator> allocator, Rcpp::NumericMatrix distances,
+                               SEXP continuos = R_NilValue, SEXP binary = R_NilValue, SEXP neighbors = R_NilValue,
+                               int n_threads = 0) {
+    PredictiveAllocator::Points points;
+    points.distances = Rcpp::as<Eigen::MatrixXd>(distances);
+    if (!Rf_isNull(continuos))
+        points.continuos = Rcpp::as<Eigen::MatrixXd>(continuos);
+    if (!Rf_isNull(binary))
+        points.binary = Rcpp::as<Eigen::MatrixXi>(binary);
+    if (!Rf_isNull(neighbors)) {
+        Rcpp::List rows(neighbors);
+        points.neighbors.resize(rows.size());
+        for (int i = 0; i < rows.size(); ++i) {
+            Rcpp::IntegerVector row = Rcpp::as<Rcpp::IntegerVector>(rows[i]);
+            for (int j = 0; j < row.size(); ++j)
+                points.neighbors[i].push_back(row[j] - 1);
+        }
+    }
+    const PredictiveAllocator::Result result = allocator->allocate(points, n_threads);
+    return Rcpp::List::create(
+        Rcpp::Named("probabilities") = Rcpp::wrap(result.probabilities),
+        Rcpp::Named("labels") = Rcpp::IntegerVector(result.labels.data(), result.labels.data() + result.labels.size()));
+}
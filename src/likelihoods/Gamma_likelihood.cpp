@@ -7,12 +7,33 @@
 #include <cmath>
 
 double Gamma_likelihood::cluster_loglikelihood(int cluster_index) const {
+    PROFILE_SCOPE(ClusterLoglikelihood);
+    if (cache) {
+        const int n_k = data.get_cluster_size(cluster_index);
+        if (n_k <= 1) {
+            return 0;
+        }
+
+        const DistanceCache::ClusterStats &stats = cache->get_cluster_stats_ref(cluster_index);
+        const int pairs = n_k * (n_k - 1) / 2;
+
+        double coh = 0;
+        coh += stats.log_sum * (params.delta1 - 1);
+        coh -= lgamma_delta1 * pairs;
+        coh += log_beta_alpha;
+        coh += lgamma(pairs * params.delta1 + params.alpha);
+        coh -= log(params.beta + stats.sum) * (pairs * params.delta1 + params.alpha);
+
+        return coh;
+    }
+
     auto cls_ass_k = data.get_cluster_assignments_ref(cluster_index);
     return cluster_loglikelihood(cluster_index, cls_ass_k);
 }
 
 double Gamma_likelihood::cluster_loglikelihood(int cluster_index,
                                                const Eigen::Ref<const Eigen::VectorXi> &cls_ass_k) const {
+    PROFILE_SCOPE(ClusterLoglikelihood);
     const int n_k = cls_ass_k.size();
 
     if (n_k == 0) {
@@ -21,10 +42,6 @@ double Gamma_likelihood::cluster_loglikelihood(int cluster_index,
 
     const int K = data.get_K();
 
-    // Get raw pointer to distance matrices for fastest access
-    const double *__restrict__ D_data = params.D.data();
-    const double *__restrict__ logD_data = log_D_data.data();
-
     /* -------------------- Cohesion part -------------------------- */
     if (n_k == 1) {
         return 0;
@@ -33,31 +50,59 @@ double Gamma_likelihood::cluster_loglikelihood(int cluster_index,
     const int pairs = n_k * (n_k - 1) / 2;
     double log_prod = 0;
     double sum = 0;
+    pair_sum2(log_D_data, cls_ass_k.data(), n_k, sum, log_prod);
+
+    double coh = 0;
+    coh += log_prod * (params.delta1 - 1);
+    coh -= lgamma_delta1 * pairs;
+    coh += log_beta_alpha;
+    coh += lgamma(pairs * params.delta1 + params.alpha);
+    coh -= log(params.beta + sum) * (pairs * params.delta1 + params.alpha);
 
-    // Direct pointer access for cohesion
-    for (int i = 0; i < n_k; ++i) {
-        const int idx_i = cls_ass_k(i);
-        const double *D_row = D_data + idx_i * D_cols;
-        const double *logD_row = logD_data + idx_i * D_cols;
+    return coh;
+}
 
-        for (int j = i + 1; j < n_k; ++j) {
-            const int idx_j = cls_ass_k(j);
-            sum += D_row[idx_j];
-            log_prod += logD_row[idx_j];
-        }
+Likelihood::PairLoglikelihood Gamma_likelihood::pair_loglikelihood(int ci, int cj) const {
+    PROFILE_SCOPE(ClusterLoglikelihood);
+    auto cls_ass_i = data.get_cluster_assignments_ref(ci);
+    auto cls_ass_j = data.get_cluster_assignments_ref(cj);
+    const int n_i = cls_ass_i.size();
+    const int n_j = cls_ass_j.size();
+
+    double sum_i = 0, log_sum_i = 0, sum_j = 0, log_sum_j = 0;
+    double sum_ij = 0, log_sum_ij = 0;
+    if (cache) {
+        sum_i = cache->get_cluster_stats_ref(ci).sum;
+        log_sum_i = cache->get_cluster_stats_ref(ci).log_sum;
+        sum_j = cache->get_cluster_stats_ref(cj).sum;
+        log_sum_j = cache->get_cluster_stats_ref(cj).log_sum;
+        sum_ij = cache->get_between_sum(ci, cj);
+        log_sum_ij = cache->get_between_log_sum(ci, cj);
+    } else {
+        pair_sum2(log_D_data, cls_ass_i.data(), n_i, sum_i, log_sum_i);
+        pair_sum2(log_D_data, cls_ass_j.data(), n_j, sum_j, log_sum_j);
+        cross_sum2(log_D_data, cls_ass_i.data(), n_i, cls_ass_j.data(), n_j, sum_ij, log_sum_ij);
     }
 
+    return {cluster_cohesion(n_i, sum_i, log_sum_i), cluster_cohesion(n_j, sum_j, log_sum_j),
+            cluster_cohesion(n_i + n_j, sum_i + sum_j + sum_ij, log_sum_i + log_sum_j + log_sum_ij)};
+}
+
+double Gamma_likelihood::cluster_cohesion(int n_k, double sum, double log_sum) const {
+    if (n_k <= 1)
+        return 0;
+    const double pairs = 0.5 * n_k * (n_k - 1);
     double coh = 0;
-    coh += log_prod * (params.delta1 - 1);
+    coh += log_sum * (params.delta1 - 1);
     coh -= lgamma_delta1 * pairs;
     coh += log_beta_alpha;
     coh += lgamma(pairs * params.delta1 + params.alpha);
     coh -= log(params.beta + sum) * (pairs * params.delta1 + params.alpha);
-
     return coh;
 }
 
 double Gamma_likelihood::point_loglikelihood_cond(int point_index, int cluster_index) const {
+    PROFILE_SCOPE(PointLoglikelihoodCond);
     auto cls_ass_k = data.get_cluster_assignments_ref(cluster_index);
     const int n_k = cls_ass_k.size();
 
@@ -66,22 +111,72 @@ double Gamma_likelihood::point_loglikelihood_cond(int point_index, int cluster_i
     return coeh;
 }
 
+void Gamma_likelihood::point_loglikelihood_cond_all(int point_index, Eigen::Ref<Eigen::VectorXd> out) const {
+    PROFILE_SCOPE(PointLoglikelihoodCondAll);
+    if (layout) {
+        layout->point_cluster_sums(point_index, point_sum_buf, point_log_sum_buf);
+    } else {
+        accumulate_point_sums(point_index, log_D_data);
+    }
+    score_candidates(out, 1);
+}
+
+void Gamma_likelihood::point_loglikelihood_cond_all_parallel(int point_index, Eigen::Ref<Eigen::VectorXd> out,
+                                                             int n_threads) const {
+    PROFILE_SCOPE(PointLoglikelihoodCondAll);
+    if (layout) {
+        layout->point_cluster_sums(point_index, point_sum_buf, point_log_sum_buf);
+    } else {
+        accumulate_point_sums(point_index, log_D_data, n_threads);
+    }
+    score_candidates(out, n_threads);
+}
+
+void Gamma_likelihood::score_candidates(Eigen::Ref<Eigen::VectorXd> out, int n_threads) const {
+    const int K = data.get_K();
+
+    auto score = [&](int k) {
+        const int n_k = data.get_cluster_size(k);
+        if (n_k == 0) {
+            out(k) = 0.0;
+            return;
+        }
+
+        double loglik = 0;
+        loglik += (-n_k) * lgamma_delta1;
+        loglik += (params.delta1 - 1) * point_log_sum_buf[k];
+        loglik += lgamma_alpha_mh_cache[n_k];
+        loglik += log_beta_alpha;
+        loglik -= (params.alpha + params.delta1 * n_k) * log(params.beta + point_sum_buf[k]);
+        out(k) = loglik;
+    };
+
+#ifdef _OPENMP
+    if (n_threads > 1) {
+#pragma omp parallel for schedule(static) num_threads(n_threads)
+        for (int k = 0; k < K; ++k)
+            score(k);
+    } else
+#endif
+    {
+        (void)n_threads;
+        for (int k = 0; k < K; ++k)
+            score(k);
+    }
+
+    // New cluster: empty, no cohesion term
+    out(K) = 0.0;
+}
+
 double Gamma_likelihood::compute_cohesion(int point_index, int cluster_index,
                                           const Eigen::Ref<const Eigen::VectorXi> &cls_ass_k, int n_k) const {
     if (n_k == 0) {
         return 0.0;
     }
 
-    const double *__restrict__ D_row = params.D.data() + point_index * D_cols;
-    const double *__restrict__ logD_row = log_D_data.data() + point_index * D_cols;
-
     double sum_i = 0;
     double log_prod_i = 0;
-
-    for (const auto &idx : cls_ass_k) {
-        sum_i += D_row[idx];
-        log_prod_i += logD_row[idx];
-    }
+    row_sum2(point_index, log_D_data, cls_ass_k.data(), n_k, sum_i, log_prod_i);
 
     const double alpha_mh = params.alpha + params.delta1 * n_k;
     const double beta_mh = params.beta + sum_i;
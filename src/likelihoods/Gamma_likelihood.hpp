@@ -6,6 +6,8 @@
 #pragma once
 
 #include "../utils/Likelihood.hpp"
+#include "caches/cluster_layout.hpp"
+#include "caches/distance_cache.hpp"
 #include <vector>
 
 /**
@@ -23,10 +25,12 @@ private:
   // Precomputed values for efficiency
   const double lgamma_delta1; ///< Precomputed lgamma(delta1) for cohesion
   const double log_beta_alpha; ///< Precomputed log(beta) * alpha - lgamma(alpha)
-  std::vector<double> lgamma_alpha_mh_cache; ///< Cache for lgamma(alpha_mh) values
+  CountTable lgamma_alpha_mh_cache; ///< lgamma(alpha + delta1 m), shared through CountTables
 
-  std::vector<double> log_D_data;   ///< Precomputed log distance matrix (flattened)
-  const int D_cols; ///< Number of columns in distance matrix
+  const double *log_D_data;   ///< Log distance matrix (flattened), shared through Params::get_log_D_data() (nullptr unless dense storage and delta1 != 1)
+
+  const DistanceCache *cache; ///< Optional pairwise sums cache (nullptr: sums recomputed on each call)
+  const ClusterLayout *layout; ///< Optional cluster-contiguous layout of D (nullptr: gathers by allocation)
 
   /**
    * @brief Computes the cohesion component of the log-likelihood
@@ -40,37 +44,46 @@ private:
                           const Eigen::Ref<const Eigen::VectorXi> &cls_ass_k,
                           int n_k) const;
 
+  /**
+   * @brief Cohesion term of a cluster from the sums over its pairs
+   * @param n_k Number of points in the cluster (0 for fewer than two)
+   * @param sum Sum of D over the pairs of members
+   * @param log_sum Sum of log D over the pairs of members
+   */
+  double cluster_cohesion(int n_k, double sum, double log_sum) const;
+
+  /**
+   * @brief Fills the conditional log-likelihoods of every candidate from the point's sums
+   * @param out Output vector of size K + 1 (last entry: new cluster)
+   * @param n_threads OpenMP threads over the candidates (1: serial)
+   */
+  void score_candidates(Eigen::Ref<Eigen::VectorXd> out, int n_threads) const;
+
 public:
   /**
    * @brief Constructs a Likelihood object with precomputation
    * @param data Reference to Data object with distances and allocations
    * @param param Reference to model parameters
+   * @param cache Optional DistanceCache registered with the same Datax; when set,
+   * cluster_loglikelihood(cluster_index) reads the cached cohesion sums in O(1)
+   * @param layout Optional ClusterLayout registered with the same Datax; when set,
+   * point_loglikelihood_cond_all() reads the point's sums from contiguous segments
    *
    * The constructor precomputes several values for computational efficiency:
    * - Log-gamma values for delta parameters
    * - Logarithmic combinations of hyperparameters
-   * - Logarithm of the entire distance matrix
+   * - Logarithm of the entire distance matrix (shared through Params, or read from the
+   *   single-precision or packed storage selected on Params); not requested at all with
+   *   delta1 = 1, where the log-distance terms vanish and the kernels read D alone
    */
-  Gamma_likelihood(const Data &data, const Params &param)
+  Gamma_likelihood(const Data &data, const Params &param, const DistanceCache *cache = nullptr,
+                   const ClusterLayout *layout = nullptr)
       : Likelihood(data, param), lgamma_delta1(lgamma(params.delta1)),
         log_beta_alpha(log(params.beta) * params.alpha - lgamma(params.alpha)),
-        D_cols(params.D.cols()) {
-    // Precompute log distances manually
-    const int n = params.D.rows() * params.D.cols();
-    log_D_data.resize(n);
-
-    // Log distance precomputation
-    const double *D_ptr = params.D.data();
-    for (int i = 0; i < n; ++i) {
-      log_D_data[i] = std::log(D_ptr[i]);
-    }
-
-    // Cache lgamma values for efficiency
-    lgamma_alpha_mh_cache.resize(data.get_n() + 1, 0.0);
-
-    for (int val = 0; val <= data.get_n(); ++val) {
-      lgamma_alpha_mh_cache[val] = lgamma(params.alpha + params.delta1 * val);
-    }
+        log_D_data(params.dense_storage() && params.delta1 != 1.0 ? params.get_log_D_data() : nullptr), cache(cache),
+        layout(layout) {
+    // Shared lgamma tables indexed by cluster size
+    lgamma_alpha_mh_cache = CountTables::shared().lgamma(params.alpha, params.delta1, data.get_n() + 1);
 
   }
 
@@ -81,6 +94,7 @@ public:
    *
    * This method computes both the within-cluster cohesion and the
    * between-cluster repulsion contributions for the specified cluster.
+   * With a DistanceCache the pairwise sums are read from the cache.
    */
   double cluster_loglikelihood(int cluster_index) const override final;
 
@@ -109,4 +123,49 @@ public:
    * repulsion from points in other clusters.
    */
   double point_loglikelihood_cond(int point_index, int cluster_index) const override final __attribute__((hot));
+
+  /**
+   * @brief Computes the conditional log-likelihood of a point for all clusters
+   * @param point_index Index of the point to evaluate
+   * @param out Output vector of size K + 1 (last entry: new cluster)
+   *
+   * The distance and log-distance sums of the point to every cluster are
+   * accumulated in one O(n) pass, then the cohesion term of each candidate is
+   * evaluated in O(1).
+   */
+  void point_loglikelihood_cond_all(int point_index, Eigen::Ref<Eigen::VectorXd> out) const override final __attribute__((hot));
+
+  /**
+   * @brief point_loglikelihood_cond_all() with the row pass and the candidates split over threads
+   * @param point_index Index of the point to evaluate
+   * @param out Output vector of size K + 1 (last entry: new cluster)
+   * @param n_threads Number of OpenMP threads
+   * @see Natarajan_likelihood::point_loglikelihood_cond_all_parallel()
+   */
+  void point_loglikelihood_cond_all_parallel(int point_index, Eigen::Ref<Eigen::VectorXd> out,
+                                             int n_threads) const override final;
+
+  /**
+   * @brief Log-likelihoods of two clusters and of their union
+   * @param ci First cluster
+   * @param cj Second cluster
+   *
+   * The union's pair sums are the within sums of ci and cj plus their cross
+   * sums, so only the n_ci n_cj cross pairs are read beyond the two clusters
+   * (nothing with a DistanceCache).
+   */
+  PairLoglikelihood pair_loglikelihood(int ci, int cj) const override final;
+
+  /**
+   * @brief Cohesion of a point with an arbitrary set of points, in O(|members|)
+   * @param point_index Index of the point (not among the members)
+   * @param members Indices of the points of the set
+   */
+  double point_loglikelihood_members(int point_index,
+                                     const Eigen::Ref<const Eigen::VectorXi> &members) const override final {
+    return compute_cohesion(point_index, -1, members, members.size());
+  }
+
+  /** @brief Cohesion only: a cluster's log-likelihood reads its own members */
+  bool cluster_local() const override final { return true; }
 };
\ No newline at end of file
@@ -0,0 +1,391 @@
+/**
+ * @file Knn_Natarajan_likelihood.cpp
+ * @brief Implementation of the kNN-truncated Natarajan likelihood
+ */
+
+#include "Knn_Natarajan_likelihood.hpp"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+Knn_Natarajan_likelihood::Knn_Natarajan_likelihood(const Data &data, const Params &param, int k, int far_samples)
+    : Likelihood(data, param), lgamma_delta1(lgamma(params.delta1)),
+      log_beta_alpha(log(params.beta) * params.alpha - lgamma(params.alpha)), lgamma_delta2(lgamma(params.delta2)),
+      log_gamma_zeta(log(params.gamma) * params.zeta - lgamma(params.zeta)),
+      k(std::max(0, std::min(k, params.n - 1))), far_samples(std::max(1, far_samples)),
+      log_D_dense(params.dense_storage() ? params.get_log_D_data() : nullptr) {
+    // Shared lgamma tables indexed by cluster size
+    lgamma_alpha_mh_cache = CountTables::shared().lgamma(params.alpha, params.delta1, data.get_n() + 1);
+    lgamma_zeta_mt_cache = CountTables::shared().lgamma(params.zeta, params.delta2, data.get_n() + 1);
+
+    in_set.assign(params.n, 0);
+    build_graph();
+}
+
+void Knn_Natarajan_likelihood::build_graph() {
+    const int n = params.n;
+    const size_t cells = static_cast<size_t>(n) * k;
+    nbr_index.resize(cells);
+    nbr_D.resize(cells);
+    nbr_log_D.resize(cells);
+    far_D.assign(n, 0.0);
+    far_log_D.assign(n, 0.0);
+
+    // Rows are read from the dense matrices when available, through the accessor otherwise
+    const double *D_dense = params.dense_storage() ? params.get_D_data() : nullptr;
+
+#pragma omp parallel
+    {
+        std::vector<double> row(n), log_row(n);
+        std::vector<int> order(n > 0 ? n - 1 : 0);
+
+#pragma omp for schedule(dynamic, 64)
+        for (int i = 0; i < n; ++i) {
+            const size_t offset = static_cast<size_t>(i) * n;
+            for (int j = 0; j < n; ++j) {
+                row[j] = D_dense ? D_dense[offset + j] : params.distance(i, j);
+                log_row[j] = log_D_dense ? log_D_dense[offset + j] : std::log(row[j]);
+            }
+
+            // Every other point, nearest k first (ties broken by index, for reproducibility)
+            std::iota(order.begin(), order.begin() + i, 0);
+            std::iota(order.begin() + i, order.end(), i + 1);
+            auto closer = [&](int a, int b) { return row[a] < row[b] || (row[a] == row[b] && a < b); };
+            if (k < n - 1) {
+                std::nth_element(order.begin(), order.begin() + k, order.end(), closer);
+            }
+            std::sort(order.begin(), order.begin() + k);
+
+            const size_t base = static_cast<size_t>(i) * k;
+            for (int a = 0; a < k; ++a) {
+                const int j = order[a];
+                nbr_index[base + a] = j;
+                nbr_D[base + a] = row[j];
+                nbr_log_D[base + a] = log_row[j];
+            }
+
+            double sum = 0, log_sum = 0;
+            for (int a = k; a < n - 1; ++a) {
+                sum += row[order[a]];
+                log_sum += log_row[order[a]];
+            }
+            const int n_far = n - 1 - k;
+            if (n_far > 0) {
+                far_D[i] = sum / n_far;
+                far_log_D[i] = log_sum / n_far;
+            }
+        }
+    }
+}
+
+// ========== Building blocks ==========
+
+void Knn_Natarajan_likelihood::read_pair(int i, int j, double &d, double &log_d) const {
+    if (D_data) {
+        const size_t pos = static_cast<size_t>(i) * params.n + j;
+        d = D_data[pos];
+        log_d = log_D_dense[pos];
+    } else if (D_pairs) {
+        const DistancePair &cell = D_pairs[static_cast<size_t>(i) * params.n + j];
+        d = cell.d;
+        log_d = cell.log_d;
+    } else {
+        d = D_packed->distance(i, j);
+        log_d = D_packed->log_distance(i, j);
+    }
+}
+
+void Knn_Natarajan_likelihood::far_means(int point_index, const Eigen::Ref<const Eigen::VectorXi> &members,
+                                         double &mu, double &lambda) const {
+    const int m = members.size();
+    const int *nbr_begin = nbr_index.data() + static_cast<size_t>(point_index) * k;
+    const int *nbr_end = nbr_begin + k;
+
+    // Evenly spaced positions: every member when the set is small enough
+    const int reads = std::min(m, far_samples);
+    double sum = 0, log_sum = 0;
+    int used = 0;
+    for (int q = 0; q < reads; ++q) {
+        const int j = members(static_cast<int>(static_cast<long long>(q) * m / reads));
+        if (j == point_index || std::binary_search(nbr_begin, nbr_end, j))
+            continue;
+        double d, log_d;
+        read_pair(point_index, j, d, log_d);
+        sum += d;
+        log_sum += log_d;
+        ++used;
+    }
+
+    if (used == 0) {
+        mu = far_D[point_index];
+        lambda = far_log_D[point_index];
+        return;
+    }
+    mu = sum / used;
+    lambda = log_sum / used;
+}
+
+void Knn_Natarajan_likelihood::approximate_point_sums(int point_index) const {
+    const int K = data.get_K();
+
+    point_sum_buf.assign(K, 0.0);
+    point_log_sum_buf.assign(K, 0.0);
+    nbr_count_buf.assign(K, 0);
+
+    const int *__restrict__ alloc = data.get_allocations().data();
+    const size_t base = static_cast<size_t>(point_index) * k;
+    const int *__restrict__ nbr = nbr_index.data() + base;
+    const double *__restrict__ d = nbr_D.data() + base;
+    const double *__restrict__ log_d = nbr_log_D.data() + base;
+
+    for (int a = 0; a < k; ++a) {
+        const int c = alloc[nbr[a]];
+        if (c < 0)
+            continue;
+        point_sum_buf[c] += d[a];
+        point_log_sum_buf[c] += log_d[a];
+        ++nbr_count_buf[c];
+    }
+
+    // The members of each cluster outside N(i) contribute their estimated mean
+    for (int t = 0; t < K; ++t) {
+        const int n_far = data.get_cluster_size(t) - nbr_count_buf[t];
+        if (n_far <= 0)
+            continue;
+        double mu, lambda;
+        far_means(point_index, data.get_cluster_assignments_ref(t), mu, lambda);
+        point_sum_buf[t] += n_far * mu;
+        point_log_sum_buf[t] += n_far * lambda;
+    }
+}
+
+double Knn_Natarajan_likelihood::cohesion_term(int n_t, double sum, double log_sum) const {
+    double coh = 0;
+    coh += (-n_t) * lgamma_delta1;
+    coh += (params.delta1 - 1) * log_sum;
+    coh += lgamma_alpha_mh_cache[n_t];
+    coh += log_beta_alpha;
+    coh -= (params.alpha + params.delta1 * n_t) * log(params.beta + sum);
+    return coh;
+}
+
+double Knn_Natarajan_likelihood::repulsion_term(int n_t, double sum, double log_sum) const {
+    double rep = 0;
+    rep -= n_t * lgamma_delta2;
+    rep += (params.delta2 - 1) * log_sum;
+    rep += lgamma_zeta_mt_cache[n_t];
+    rep += log_gamma_zeta;
+    rep -= (params.zeta + params.delta2 * n_t) * log(params.gamma + sum);
+    return rep;
+}
+
+// ========== Likelihood interface ==========
+
+double Knn_Natarajan_likelihood::cluster_loglikelihood(int cluster_index) const {
+    PROFILE_SCOPE(ClusterLoglikelihood);
+    auto cls_ass_k = data.get_cluster_assignments_ref(cluster_index);
+    return cluster_loglikelihood(cluster_index, cls_ass_k);
+}
+
+double Knn_Natarajan_likelihood::cluster_loglikelihood(int cluster_index,
+                                                       const Eigen::Ref<const Eigen::VectorXi> &cls_ass_k) const {
+    PROFILE_SCOPE(ClusterLoglikelihood);
+    return members_loglikelihood(cluster_index, cls_ass_k, -1);
+}
+
+Likelihood::PairLoglikelihood Knn_Natarajan_likelihood::pair_loglikelihood(int ci, int cj) const {
+    PROFILE_SCOPE(ClusterLoglikelihood);
+    auto members_ci = data.get_cluster_assignments_ref(ci);
+    auto members_cj = data.get_cluster_assignments_ref(cj);
+    Eigen::VectorXi merged(members_ci.size() + members_cj.size());
+    merged << members_ci, members_cj;
+    return {members_loglikelihood(ci, members_ci, -1), members_loglikelihood(cj, members_cj, -1),
+            members_loglikelihood(ci, merged, cj)};
+}
+
+double Knn_Natarajan_likelihood::members_loglikelihood(int cluster_index,
+                                                       const Eigen::Ref<const Eigen::VectorXi> &cls_ass_k,
+                                                       int absorbed) const {
+    const int n_k = cls_ass_k.size();
+
+    if (n_k == 0) {
+        return 0;
+    }
+
+    const int K = data.get_K();
+    const int *__restrict__ alloc = data.get_allocations().data();
+
+    // Per target cluster: approximate cross sums accumulated over the members
+    nbr_sum_buf.assign(K, 0.0);
+    nbr_log_sum_buf.assign(K, 0.0);
+
+    for (int a = 0; a < n_k; ++a)
+        in_set[cls_ass_k(a)] = 1;
+
+    double within_sum = 0, within_log_sum = 0;
+    for (int a = 0; a < n_k; ++a) {
+        const int i = cls_ass_k(a);
+        nbr_count_buf.assign(K, 0);
+        int within_count = 0;
+
+        const size_t base = static_cast<size_t>(i) * k;
+        for (int b = 0; b < k; ++b) {
+            const int j = nbr_index[base + b];
+            if (in_set[j]) {
+                within_sum += nbr_D[base + b];
+                within_log_sum += nbr_log_D[base + b];
+                ++within_count;
+                continue;
+            }
+            const int t = alloc[j];
+            if (t < 0 || t == cluster_index || t == absorbed)
+                continue;
+            nbr_sum_buf[t] += nbr_D[base + b];
+            nbr_log_sum_buf[t] += nbr_log_D[base + b];
+            ++nbr_count_buf[t];
+        }
+
+        double mu, lambda;
+        const int within_far = n_k - 1 - within_count;
+        if (within_far > 0) {
+            far_means(i, cls_ass_k, mu, lambda);
+            within_sum += within_far * mu;
+            within_log_sum += within_far * lambda;
+        }
+        for (int t = 0; t < K; ++t) {
+            if (t == cluster_index || t == absorbed)
+                continue;
+            const int n_far = data.get_cluster_size(t) - nbr_count_buf[t];
+            if (n_far <= 0)
+                continue;
+            far_means(i, data.get_cluster_assignments_ref(t), mu, lambda);
+            nbr_sum_buf[t] += n_far * mu;
+            nbr_log_sum_buf[t] += n_far * lambda;
+        }
+    }
+
+    for (int a = 0; a < n_k; ++a)
+        in_set[cls_ass_k(a)] = 0;
+
+    double rep = 0;
+
+    /* -------------------- Repulsion part -------------------------- */
+    for (int t = 0; t < K; ++t) {
+        if (t == cluster_index || t == absorbed)
+            continue;
+
+        const int n_t = data.get_cluster_size(t);
+        if (n_t == 0)
+            continue;
+
+        const double sum = nbr_sum_buf[t];
+        const double log_prod = nbr_log_sum_buf[t];
+
+        const int n_pairs = n_k * n_t;
+        rep += log_prod * (params.delta2 - 1);
+        rep -= lgamma_delta2 * n_pairs;
+        rep += log_gamma_zeta;
+        rep += lgamma(n_pairs * params.delta2 + params.zeta);
+        rep -= log(params.gamma + sum) * (n_pairs * params.delta2 + params.zeta);
+    }
+
+    /* -------------------- Cohesion part -------------------------- */
+    if (n_k == 1) {
+        return rep;
+    }
+
+    // Every unordered pair is seen from both members: halve the per-member estimates
+    const int pairs = n_k * (n_k - 1) / 2;
+    const double sum = 0.5 * within_sum;
+    const double log_prod = 0.5 * within_log_sum;
+
+    double coh = 0;
+    coh += log_prod * (params.delta1 - 1);
+    coh -= lgamma_delta1 * pairs;
+    coh += log_beta_alpha;
+    coh += lgamma(pairs * params.delta1 + params.alpha);
+    coh -= log(params.beta + sum) * (pairs * params.delta1 + params.alpha);
+
+    return rep + coh;
+}
+
+double Knn_Natarajan_likelihood::point_loglikelihood_cond(int point_index, int cluster_index) const {
+    PROFILE_SCOPE(PointLoglikelihoodCond);
+    const int K = data.get_K();
+    approximate_point_sums(point_index);
+
+    double loglik = 0;
+    const int n_k = cluster_index < K ? data.get_cluster_size(cluster_index) : 0;
+    if (n_k > 0) {
+        loglik += cohesion_term(n_k, point_sum_buf[cluster_index], point_log_sum_buf[cluster_index]);
+    }
+
+    // Same convention as Natarajan_likelihood: no repulsion with fewer than two clusters
+    if (K <= 1) {
+        return loglik;
+    }
+    for (int t = 0; t < K; ++t) {
+        const int n_t = data.get_cluster_size(t);
+        if (t == cluster_index || n_t == 0)
+            continue;
+        loglik += repulsion_term(n_t, point_sum_buf[t], point_log_sum_buf[t]);
+    }
+    return loglik;
+}
+
+double Knn_Natarajan_likelihood::point_loglikelihood_odds(int point_index, int ci, int cj) const {
+    PROFILE_SCOPE(PointLoglikelihoodCond);
+    if (ci == cj)
+        return 0;
+    approximate_point_sums(point_index);
+
+    const int K = data.get_K();
+    const int n_i = data.get_cluster_size(ci);
+    const int n_j = data.get_cluster_size(cj);
+    double odds = 0;
+    if (n_i > 0)
+        odds += cohesion_term(n_i, point_sum_buf[ci], point_log_sum_buf[ci]);
+    if (n_j > 0)
+        odds -= cohesion_term(n_j, point_sum_buf[cj], point_log_sum_buf[cj]);
+
+    // Same convention as point_loglikelihood_cond(): no repulsion with fewer than two clusters
+    if (K > 1) {
+        if (n_j > 0)
+            odds += repulsion_term(n_j, point_sum_buf[cj], point_log_sum_buf[cj]);
+        if (n_i > 0)
+            odds -= repulsion_term(n_i, point_sum_buf[ci], point_log_sum_buf[ci]);
+    }
+    return odds;
+}
+
+void Knn_Natarajan_likelihood::point_loglikelihood_cond_all(int point_index, Eigen::Ref<Eigen::VectorXd> out) const {
+    PROFILE_SCOPE(PointLoglikelihoodCondAll);
+    const int K = data.get_K();
+    const bool with_repulsion = K > 1;
+
+    approximate_point_sums(point_index);
+
+    double total_rep = 0;
+    for (int t = 0; t < K; ++t) {
+        const int n_t = data.get_cluster_size(t);
+        if (n_t == 0) {
+            out(t) = 0;
+            continue;
+        }
+
+        out(t) = cohesion_term(n_t, point_sum_buf[t], point_log_sum_buf[t]);
+        if (!with_repulsion)
+            continue;
+
+        // Candidate t is repelled by every cluster except itself
+        const double rep = repulsion_term(n_t, point_sum_buf[t], point_log_sum_buf[t]);
+        out(t) -= rep;
+        total_rep += rep;
+    }
+
+    if (with_repulsion)
+        out.head(K).array() += total_rep;
+
+    // New cluster: no cohesion, repulsion from every existing cluster
+    out(K) = total_rep;
+}
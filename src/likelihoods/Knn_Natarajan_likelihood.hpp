@@ -0,0 +1,192 @@
+/**
+ * @file Knn_Natarajan_likelihood.hpp
+ * @brief Approximate Natarajan likelihood with exact k-nearest-neighbour pairs and summarized far pairs
+ */
+
+#pragma once
+
+#include "../utils/Likelihood.hpp"
+#include <vector>
+
+/**
+ * @class Knn_Natarajan_likelihood
+ * @brief Natarajan_likelihood with exact near pairs and summarized far pairs
+ *
+ * A kNN graph is built once at construction: for each point i its k nearest points N(i), with
+ * D and log D to them. The sums of D(i, .) and log D(i, .) over the members of a cluster t, which
+ * are the only data-dependent inputs of the cohesion and repulsion terms, are approximated by
+ *
+ *     S_t(i) = sum_{j in N(i) and t} D(i, j)     + (n_t - |N(i) and t|) mu_t(i)
+ *     L_t(i) = sum_{j in N(i) and t} log D(i, j) + (n_t - |N(i) and t|) lambda_t(i)
+ *
+ * where mu_t(i) and lambda_t(i) are the mean D and log D from i to the members of t outside N(i),
+ * estimated on at most far_samples members taken at evenly spaced positions of the member list
+ * (so deterministically for a given state, and exactly for clusters that small). If none of them
+ * qualifies, the mean of i to all its non-neighbours, precomputed with the graph, is used.
+ *
+ * A point update therefore costs O(k + K far_samples) instead of O(n), and the log-likelihood of
+ * a cluster with n_k members O(n_k (k + K far_samples)) instead of O(n_k n). Pair sums over a
+ * cluster use the same estimate from the side of each member (halved for the within pairs).
+ *
+ * With k = n - 1 there are no far pairs and the values agree with Natarajan_likelihood up to
+ * rounding, which is the reference for A/B comparisons. Construction reads the whole of D once,
+ * O(n^2) split over the OpenMP threads; memory is 20 n k bytes.
+ */
+class Knn_Natarajan_likelihood : public Likelihood {
+private:
+    // Precomputed values for efficiency (same as Natarajan_likelihood)
+    const double lgamma_delta1;                 ///< Precomputed lgamma(delta1) for cohesion
+    const double log_beta_alpha;                ///< Precomputed log(beta) * alpha - lgamma(alpha)
+    const double lgamma_delta2;                 ///< Precomputed lgamma(delta2) for repulsion
+    const double log_gamma_zeta;                ///< Precomputed log(gamma) * zeta - lgamma(zeta)
+    CountTable lgamma_zeta_mt_cache;            ///< lgamma(zeta + delta2 m), shared through CountTables
+    CountTable lgamma_alpha_mh_cache;           ///< lgamma(alpha + delta1 m), shared through CountTables
+
+    // ========== kNN graph ==========
+    int k;                         ///< Number of neighbours per point
+    int far_samples;               ///< Members read per cluster to estimate the far means
+    std::vector<int> nbr_index;    ///< Neighbours of point i at [i * k, (i + 1) * k), ascending
+    std::vector<double> nbr_D;     ///< D to each neighbour
+    std::vector<double> nbr_log_D; ///< log D to each neighbour
+    std::vector<double> far_D;     ///< Mean D of each point to all its non-neighbours (fallback far mean)
+    std::vector<double> far_log_D; ///< Mean log D of each point to all its non-neighbours
+    const double *log_D_dense;     ///< Dense log D when available (nullptr: read through the storage mode)
+
+    // ========== Scratch (per cluster) ==========
+    mutable std::vector<double> nbr_sum_buf;     ///< Per-cluster sums of D over neighbours
+    mutable std::vector<double> nbr_log_sum_buf; ///< Per-cluster sums of log D over neighbours
+    mutable std::vector<int> nbr_count_buf;      ///< Per-cluster neighbour counts
+    mutable std::vector<char> in_set;            ///< Membership flags of the set passed to cluster_loglikelihood()
+
+    /**
+     * @brief Builds the kNN graph and the far means from D
+     */
+    void build_graph();
+
+    /**
+     * @brief Reads D(i, j) and log D(i, j) from whichever storage Params uses
+     */
+    void read_pair(int i, int j, double &d, double &log_d) const;
+
+    /**
+     * @brief Estimates the mean D and log D from a point to the members of a set outside N(i)
+     * @param point_index Index of the point (skipped if in the set)
+     * @param members Members of the set
+     * @param mu Output: mean D
+     * @param lambda Output: mean log D
+     */
+    void far_means(int point_index, const Eigen::Ref<const Eigen::VectorXi> &members, double &mu,
+                   double &lambda) const;
+
+    /**
+     * @brief Approximate log-likelihood of a set of points labelled cluster_index
+     * @param cluster_index Label of the set
+     * @param cls_ass_k Members of the set
+     * @param absorbed Cluster whose members are all in the set, left out of the repulsion (-1 for none)
+     */
+    double members_loglikelihood(int cluster_index, const Eigen::Ref<const Eigen::VectorXi> &cls_ass_k,
+                                 int absorbed) const __attribute__((hot));
+
+    /**
+     * @brief Approximate sums S_t(i) and L_t(i) of a point for every cluster
+     * @param point_index Index of the point
+     *
+     * Fills point_sum_buf and point_log_sum_buf with one entry per cluster in O(k + K far_samples).
+     */
+    void approximate_point_sums(int point_index) const;
+
+    /**
+     * @brief Cohesion of a point with a cluster from its sums
+     * @param n_t Cluster size
+     * @param sum Sum of D from the point to the cluster
+     * @param log_sum Sum of log D from the point to the cluster
+     */
+    double cohesion_term(int n_t, double sum, double log_sum) const;
+
+    /**
+     * @brief Repulsion of a point from a cluster from its sums
+     * @param n_t Cluster size
+     * @param sum Sum of D from the point to the cluster
+     * @param log_sum Sum of log D from the point to the cluster
+     */
+    double repulsion_term(int n_t, double sum, double log_sum) const;
+
+public:
+    /**
+     * @brief Constructs the likelihood and builds the kNN graph
+     * @param data Reference to Data object with distances and allocations
+     * @param param Reference to model parameters
+     * @param k Number of nearest neighbours kept exactly per point (clamped to n - 1)
+     * @param far_samples Members read per cluster to estimate the far means (default: 8)
+     */
+    Knn_Natarajan_likelihood(const Data &data, const Params &param, int k, int far_samples = 8);
+
+    /**
+     * @brief Approximate log-likelihood for a cluster
+     * @param cluster_index Index of the cluster to evaluate
+     * @return Total log-likelihood (cohesion + repulsion)
+     */
+    double cluster_loglikelihood(int cluster_index) const override final;
+
+    /**
+     * @brief Approximate log-likelihood for a cluster with given assignments
+     * @param cluster_index Index of the cluster to evaluate
+     * @param cls_ass_k Vector of point indices in the cluster
+     * @return Total log-likelihood (cohesion + repulsion)
+     *
+     * As in Natarajan_likelihood, the other clusters are read from the current allocations.
+     */
+    double cluster_loglikelihood(int cluster_index,
+                                 const Eigen::Ref<const Eigen::VectorXi> &cls_ass_k) const override final
+        __attribute__((hot));
+
+    /**
+     * @brief Approximate log-likelihoods of two clusters and of their union
+     * @param ci First cluster
+     * @param cj Second cluster
+     *
+     * The union is evaluated as a set labelled ci with cj left out of its repulsion, so it needs
+     * no change of the allocations.
+     */
+    PairLoglikelihood pair_loglikelihood(int ci, int cj) const override final;
+
+    /**
+     * @brief Approximate conditional log-likelihood of a point given a cluster
+     * @param point_index Index of the point to evaluate
+     * @param cluster_index Index of the target cluster
+     * @return Conditional log-likelihood, O(k + K far_samples)
+     */
+    double point_loglikelihood_cond(int point_index, int cluster_index) const override final __attribute__((hot));
+
+    /**
+     * @brief Approximate log-odds of a point joining cluster ci rather than cj
+     * @param point_index Index of the point (unallocated)
+     * @param ci First cluster
+     * @param cj Second cluster
+     * @return As the difference of two point_loglikelihood_cond(), from one pass of the sums and
+     * the terms of ci and cj only (the repulsion from the other clusters cancels)
+     */
+    double point_loglikelihood_odds(int point_index, int ci, int cj) const override final;
+
+    /**
+     * @brief Approximate conditional log-likelihood of a point for all clusters
+     * @param point_index Index of the point to evaluate
+     * @param out Output vector of size K + 1 (last entry: new cluster), O(k + K far_samples)
+     */
+    void point_loglikelihood_cond_all(int point_index, Eigen::Ref<Eigen::VectorXd> out) const override final
+        __attribute__((hot));
+
+    /** @brief Number of neighbours per point */
+    int get_k() const { return k; }
+
+    /**
+     * @brief Heap bytes of the neighbour lists, their distances, the far means and the scratch
+     * @see MemoryReport
+     */
+    std::size_t memory_bytes() const override {
+        return Likelihood::memory_bytes() + MemoryReport::bytes(nbr_index) + MemoryReport::bytes(nbr_D) +
+               MemoryReport::bytes(nbr_log_D) + MemoryReport::bytes(far_D) + MemoryReport::bytes(far_log_D) +
+               MemoryReport::bytes(nbr_sum_buf) + MemoryReport::bytes(nbr_log_sum_buf) +
+               MemoryReport::bytes(nbr_count_buf) + MemoryReport::bytes(in_set);
+    }
+};
@@ -7,13 +7,67 @@
 #include <cmath>
 
 double Natarajan_likelihood::cluster_loglikelihood(int cluster_index) const {
+  PROFILE_SCOPE(ClusterLoglikelihood);
+  if (cache) {
+    return cluster_loglikelihood_cached(cluster_index,
+                                        data.get_cluster_size(cluster_index));
+  }
   auto cls_ass_k = data.get_cluster_assignments_ref(cluster_index);
   return cluster_loglikelihood(cluster_index, cls_ass_k);
 }
 
+double Natarajan_likelihood::cluster_loglikelihood_cached(int cluster_index,
+                                                          int n_k) const {
+  if (n_k == 0) {
+    return 0;
+  }
+
+  double rep = 0;
+  const int K = data.get_K();
+
+  /* -------------------- Repulsion part -------------------------- */
+  for (int t = 0; t < K; ++t) {
+    if (t == cluster_index)
+      continue;
+
+    const int n_t = data.get_cluster_size(t);
+    if (n_t == 0)
+      continue;
+
+    const double log_prod = cache->get_between_log_sum(cluster_index, t);
+    const double sum = cache->get_between_sum(cluster_index, t);
+
+    const int n_pairs = n_k * n_t;
+    rep += log_prod * (params.delta2 - 1);
+    rep -= lgamma_delta2 * n_pairs;
+    rep += log_gamma_zeta;
+    rep += lgamma(n_pairs * params.delta2 + params.zeta);
+    rep -= log(params.gamma + sum) * (n_pairs * params.delta2 + params.zeta);
+  }
+
+  /* -------------------- Cohesion part -------------------------- */
+  if (n_k == 1) {
+    return rep;
+  }
+
+  const DistanceCache::ClusterStats &stats =
+      cache->get_cluster_stats_ref(cluster_index);
+  const int pairs = n_k * (n_k - 1) / 2;
+
+  double coh = 0;
+  coh += stats.log_sum * (params.delta1 - 1);
+  coh -= lgamma_delta1 * pairs;
+  coh += log_beta_alpha;
+  coh += lgamma(pairs * params.delta1 + params.alpha);
+  coh -= log(params.beta + stats.sum) * (pairs * params.delta1 + params.alpha);
+
+  return rep + coh;
+}
+
 double Natarajan_likelihood::cluster_loglikelihood(
     int cluster_index,
     const Eigen::Ref<const Eigen::VectorXi> &cls_ass_k) const {
+  PROFILE_SCOPE(ClusterLoglikelihood);
   const int n_k = cls_ass_k.size();
 
   if (n_k == 0) {
@@ -23,10 +77,6 @@ double Natarajan_likelihood::cluster_loglikelihood(
   double rep = 0;
   const int K = data.get_K();
 
-  // Get raw pointer to distance matrices for fastest access
-  const double *__restrict__ D_data = params.D.data();
-  const double *__restrict__ logD_data = log_D_data.data();
-
   /* -------------------- Repulsion part -------------------------- */
   for (int t = 0; t < K; ++t) {
     if (t == cluster_index)
@@ -40,16 +90,8 @@ double Natarajan_likelihood::cluster_loglikelihood(
 
     double log_prod = 0;
     double sum = 0;
-
-    for (const auto & idx_i : cls_ass_k) {
-      const double *D_row = D_data + idx_i * D_cols;
-      const double *logD_row = logD_data + idx_i * D_cols;
-
-      for (const auto & idx_j : cls_ass_t) {
-        sum += D_row[idx_j];
-        log_prod += logD_row[idx_j];
-      }
-    }
+    cross_sum2(log_D_data, cls_ass_k.data(), n_k, cls_ass_t.data(), n_t, sum,
+               log_prod);
 
     const int n_pairs = n_k * n_t;
     rep += log_prod * (params.delta2 - 1);
@@ -67,32 +109,121 @@ double Natarajan_likelihood::cluster_loglikelihood(
   const int pairs = n_k * (n_k - 1) / 2;
   double log_prod = 0;
   double sum = 0;
+  pair_sum2(log_D_data, cls_ass_k.data(), n_k, sum, log_prod);
+
+  double coh = 0;
+  coh += log_prod * (params.delta1 - 1);
+  coh -= lgamma_delta1 * pairs;
+  coh += log_beta_alpha;
+  coh += lgamma(pairs * params.delta1 + params.alpha);
+  coh -= log(params.beta + sum) * (pairs * params.delta1 + params.alpha);
+
+  return rep + coh;
+}
+
+Likelihood::PairLoglikelihood
+Natarajan_likelihood::pair_loglikelihood(int ci, int cj) const {
+  PROFILE_SCOPE(ClusterLoglikelihood);
+  auto cls_ass_i = data.get_cluster_assignments_ref(ci);
+  auto cls_ass_j = data.get_cluster_assignments_ref(cj);
+  const int n_i = cls_ass_i.size();
+  const int n_j = cls_ass_j.size();
+  const int K = data.get_K();
+
+  /* -------------------- Sums of the two clusters -------------------------- */
+  double sum_i = 0, log_sum_i = 0, sum_j = 0, log_sum_j = 0;
+  double sum_ij = 0, log_sum_ij = 0;
+  if (cache) {
+    sum_i = cache->get_cluster_stats_ref(ci).sum;
+    log_sum_i = cache->get_cluster_stats_ref(ci).log_sum;
+    sum_j = cache->get_cluster_stats_ref(cj).sum;
+    log_sum_j = cache->get_cluster_stats_ref(cj).log_sum;
+    sum_ij = cache->get_between_sum(ci, cj);
+    log_sum_ij = cache->get_between_log_sum(ci, cj);
+  } else {
+    pair_sum2(log_D_data, cls_ass_i.data(), n_i, sum_i, log_sum_i);
+    pair_sum2(log_D_data, cls_ass_j.data(), n_j, sum_j, log_sum_j);
+    cross_sum2(log_D_data, cls_ass_i.data(), n_i, cls_ass_j.data(), n_j, sum_ij,
+               log_sum_ij);
+  }
+
+  PairLoglikelihood out{0, 0, 0};
 
-  // Direct pointer access for cohesion
-  for (int i = 0; i < n_k; ++i) {
-    const int idx_i = cls_ass_k(i);
-    const double *D_row = D_data + idx_i * D_cols;
-    const double *logD_row = logD_data + idx_i * D_cols;
+  /* -------------------- Repulsion from the other clusters -------------------------- */
+  // The cross sums of the union with cluster t are those of ci plus those of cj
+  for (int t = 0; t < K; ++t) {
+    if (t == ci || t == cj)
+      continue;
+    const int n_t = data.get_cluster_size(t);
+    if (n_t == 0)
+      continue;
 
-    for (int j = i + 1; j < n_k; ++j) {
-      const int idx_j = cls_ass_k(j);
-      sum += D_row[idx_j];
-      log_prod += logD_row[idx_j];
+    double sum_it = 0, log_sum_it = 0, sum_jt = 0, log_sum_jt = 0;
+    if (cache) {
+      sum_it = cache->get_between_sum(ci, t);
+      log_sum_it = cache->get_between_log_sum(ci, t);
+      sum_jt = cache->get_between_sum(cj, t);
+      log_sum_jt = cache->get_between_log_sum(cj, t);
+    } else {
+      auto cls_ass_t = data.get_cluster_assignments_ref(t);
+      cross_sum2(log_D_data, cls_ass_i.data(), n_i, cls_ass_t.data(), n_t,
+                 sum_it, log_sum_it);
+      cross_sum2(log_D_data, cls_ass_j.data(), n_j, cls_ass_t.data(), n_t,
+                 sum_jt, log_sum_jt);
     }
+
+    if (n_i > 0)
+      out.ci += cluster_repulsion(static_cast<double>(n_i) * n_t, sum_it, log_sum_it);
+    if (n_j > 0)
+      out.cj += cluster_repulsion(static_cast<double>(n_j) * n_t, sum_jt, log_sum_jt);
+    if (n_i + n_j > 0)
+      out.merged += cluster_repulsion(static_cast<double>(n_i + n_j) * n_t,
+                                      sum_it + sum_jt, log_sum_it + log_sum_jt);
   }
 
+  // ci and cj repel each other in the split state only
+  if (n_i > 0 && n_j > 0) {
+    const double rep_ij = cluster_repulsion(static_cast<double>(n_i) * n_j, sum_ij, log_sum_ij);
+    out.ci += rep_ij;
+    out.cj += rep_ij;
+  }
+
+  /* -------------------- Cohesion part -------------------------- */
+  out.ci += cluster_cohesion(n_i, sum_i, log_sum_i);
+  out.cj += cluster_cohesion(n_j, sum_j, log_sum_j);
+  out.merged += cluster_cohesion(n_i + n_j, sum_i + sum_j + sum_ij,
+                                 log_sum_i + log_sum_j + log_sum_ij);
+  return out;
+}
+
+double Natarajan_likelihood::cluster_cohesion(int n_k, double sum,
+                                              double log_sum) const {
+  if (n_k <= 1)
+    return 0;
+  const double pairs = 0.5 * n_k * (n_k - 1);
   double coh = 0;
-  coh += log_prod * (params.delta1 - 1);
+  coh += log_sum * (params.delta1 - 1);
   coh -= lgamma_delta1 * pairs;
   coh += log_beta_alpha;
   coh += lgamma(pairs * params.delta1 + params.alpha);
   coh -= log(params.beta + sum) * (pairs * params.delta1 + params.alpha);
+  return coh;
+}
 
-  return rep + coh;
+double Natarajan_likelihood::cluster_repulsion(double n_pairs, double sum,
+                                               double log_sum) const {
+  double rep = 0;
+  rep += log_sum * (params.delta2 - 1);
+  rep -= lgamma_delta2 * n_pairs;
+  rep += log_gamma_zeta;
+  rep += lgamma(n_pairs * params.delta2 + params.zeta);
+  rep -= log(params.gamma + sum) * (n_pairs * params.delta2 + params.zeta);
+  return rep;
 }
 
 double Natarajan_likelihood::point_loglikelihood_cond(int point_index,
                                             int cluster_index) const {
+  PROFILE_SCOPE(PointLoglikelihoodCond);
   auto cls_ass_k = data.get_cluster_assignments_ref(cluster_index);
   const int n_k = cls_ass_k.size();
 
@@ -102,6 +233,112 @@ double Natarajan_likelihood::point_loglikelihood_cond(int point_index,
   return coeh + rep;
 }
 
+double Natarajan_likelihood::point_loglikelihood_odds(int point_index, int ci,
+                                                      int cj) const {
+  PROFILE_SCOPE(PointLoglikelihoodCond);
+  if (ci == cj)
+    return 0;
+
+  auto cls_ass_i = data.get_cluster_assignments_ref(ci);
+  auto cls_ass_j = data.get_cluster_assignments_ref(cj);
+  double odds = compute_cohesion(point_index, ci, cls_ass_i, cls_ass_i.size()) -
+                compute_cohesion(point_index, cj, cls_ass_j, cls_ass_j.size());
+
+  // Same convention as compute_repulsion(): no repulsion with fewer than two clusters
+  if (data.get_K() > 1) {
+    odds += compute_repulsion_cluster(point_index, cls_ass_j);
+    odds -= compute_repulsion_cluster(point_index, cls_ass_i);
+  }
+  return odds;
+}
+
+void Natarajan_likelihood::point_loglikelihood_cond_all(
+    int point_index, Eigen::Ref<Eigen::VectorXd> out) const {
+  PROFILE_SCOPE(PointLoglikelihoodCondAll);
+  if (layout) {
+    layout->point_cluster_sums(point_index, point_sum_buf, point_log_sum_buf);
+  } else {
+    accumulate_point_sums(point_index, log_D_data);
+  }
+  score_candidates(out, 1);
+}
+
+void Natarajan_likelihood::point_loglikelihood_cond_all_parallel(
+    int point_index, Eigen::Ref<Eigen::VectorXd> out, int n_threads) const {
+  PROFILE_SCOPE(PointLoglikelihoodCondAll);
+  if (layout) {
+    layout->point_cluster_sums(point_index, point_sum_buf, point_log_sum_buf);
+  } else {
+    accumulate_point_sums(point_index, log_D_data, n_threads);
+  }
+  score_candidates(out, n_threads);
+}
+
+void Natarajan_likelihood::score_candidates(Eigen::Ref<Eigen::VectorXd> out,
+                                            int n_threads) const {
+  const int K = data.get_K();
+  // Same convention as compute_repulsion(): no repulsion with fewer than two clusters
+  const bool with_repulsion = K > 1;
+  candidate_rep_buf.assign(K, 0.0);
+
+  auto score = [&](int t) {
+    const int n_t = data.get_cluster_size(t);
+    if (n_t == 0) {
+      out(t) = 0;
+      return;
+    }
+
+    const double sum_i = point_sum_buf[t];
+    const double log_prod_i = point_log_sum_buf[t];
+
+    double coh = 0;
+    coh += (-n_t) * lgamma_delta1;
+    coh += (params.delta1 - 1) * log_prod_i;
+    coh += lgamma_alpha_mh_cache[n_t];
+    coh += log_beta_alpha;
+    coh -= (params.alpha + params.delta1 * n_t) * log(params.beta + sum_i);
+    out(t) = coh;
+
+    if (!with_repulsion)
+      return;
+
+    double rep = 0;
+    rep -= n_t * lgamma_delta2;
+    rep += (params.delta2 - 1) * log_prod_i;
+    rep += lgamma_zeta_mt_cache[n_t];
+    rep += log_gamma_zeta;
+    rep -= (params.zeta + params.delta2 * n_t) * log(params.gamma + sum_i);
+
+    // Candidate t is repelled by every cluster except itself
+    out(t) -= rep;
+    candidate_rep_buf[t] = rep;
+  };
+
+#ifdef _OPENMP
+  if (n_threads > 1) {
+#pragma omp parallel for schedule(static) num_threads(n_threads)
+    for (int t = 0; t < K; ++t)
+      score(t);
+  } else
+#endif
+  {
+    (void)n_threads;
+    for (int t = 0; t < K; ++t)
+      score(t);
+  }
+
+  // Summed in cluster order whatever the number of threads
+  double total_rep = 0;
+  for (int t = 0; t < K; ++t)
+    total_rep += candidate_rep_buf[t];
+
+  if (with_repulsion)
+    out.head(K).array() += total_rep;
+
+  // New cluster: no cohesion, repulsion from every existing cluster
+  out(K) = total_rep;
+}
+
 double
 Natarajan_likelihood::compute_cohesion(int point_index, int cluster_index,
                              const Eigen::Ref<const Eigen::VectorXi> &cls_ass_k,
@@ -110,17 +347,9 @@ Natarajan_likelihood::compute_cohesion(int point_index, int cluster_index,
     return 0.0;
   }
 
-  const double *__restrict__ D_row = params.D.data() + point_index * D_cols;
-  const double *__restrict__ logD_row =
-      log_D_data.data() + point_index * D_cols;
-
   double sum_i = 0;
   double log_prod_i = 0;
-
-  for (const auto & idx : cls_ass_k) {
-    sum_i += D_row[idx];
-    log_prod_i += logD_row[idx];
-  }
+  row_sum2(point_index, log_D_data, cls_ass_k.data(), n_k, sum_i, log_prod_i);
 
   const double alpha_mh = params.alpha + params.delta1 * n_k;
   const double beta_mh = params.beta + sum_i;
@@ -146,9 +375,6 @@ double Natarajan_likelihood::compute_repulsion(
 
   double loglik = 0;
 
-  const double *__restrict__ D_row = params.D.data() + point_index * D_cols;
-  const double *__restrict__ logD_row = log_D_data.data() + point_index * D_cols;
-
   for (int t = 0; t < num_cluster; ++t) {
     if (t == cluster_index)
       continue;
@@ -161,11 +387,8 @@ double Natarajan_likelihood::compute_repulsion(
 
     double sum_i = 0;
     double log_point_prod = 0;
-
-    for (const auto & idx : cls_ass_t) {
-      sum_i += D_row[idx];
-      log_point_prod += logD_row[idx];
-    }
+    row_sum2(point_index, log_D_data, cls_ass_t.data(), n_t, sum_i,
+             log_point_prod);
 
     const double zeta_mt = params.zeta + params.delta2 * n_t;
     const double gamma_mt = params.gamma + sum_i;
@@ -178,4 +401,24 @@ double Natarajan_likelihood::compute_repulsion(
   }
 
   return loglik;
-}
\ No newline at end of file
+}
+
+double Natarajan_likelihood::compute_repulsion_cluster(
+    int point_index, const Eigen::Ref<const Eigen::VectorXi> &cls_ass_t) const {
+  const int n_t = cls_ass_t.size();
+  if (n_t == 0)
+    return 0;
+
+  double sum_i = 0;
+  double log_point_prod = 0;
+  row_sum2(point_index, log_D_data, cls_ass_t.data(), n_t, sum_i,
+           log_point_prod);
+
+  double loglik = 0;
+  loglik -= n_t * lgamma_delta2;
+  loglik += (params.delta2 - 1) * log_point_prod;
+  loglik += lgamma_zeta_mt_cache[n_t];
+  loglik += log_gamma_zeta;
+  loglik -= (params.zeta + params.delta2 * n_t) * log(params.gamma + sum_i);
+  return loglik;
+}
@@ -6,6 +6,8 @@
 #pragma once
 
 #include "../utils/Likelihood.hpp"
+#include "caches/cluster_layout.hpp"
+#include "caches/distance_cache.hpp"
 #include <vector>
 
 /**
@@ -27,11 +29,15 @@ private:
   const double log_beta_alpha; ///< Precomputed log(beta) * alpha - lgamma(alpha)
   const double lgamma_delta2; ///< Precomputed lgamma(delta2) for repulsion
   const double log_gamma_zeta; ///< Precomputed log(gamma) * zeta - lgamma(zeta)
-  std::vector<double> lgamma_zeta_mt_cache; ///< Cache for lgamma(zeta_mt) values
-  std::vector<double> lgamma_alpha_mh_cache; ///< Cache for lgamma(alpha_mh) values
+  CountTable lgamma_zeta_mt_cache; ///< lgamma(zeta + delta2 m), shared through CountTables
+  CountTable lgamma_alpha_mh_cache; ///< lgamma(alpha + delta1 m), shared through CountTables
 
-  std::vector<double> log_D_data;   ///< Precomputed log distance matrix (flattened)
-  const int D_cols; ///< Number of columns in distance matrix
+  const double *log_D_data;   ///< Log distance matrix (flattened), shared through Params::get_log_D_data() (nullptr unless dense storage and Params::uses_log_distances())
+
+  const DistanceCache *cache; ///< Optional pairwise sums cache (nullptr: sums recomputed on each call)
+  const ClusterLayout *layout; ///< Optional cluster-contiguous layout of D (nullptr: gathers by allocation)
+
+  mutable std::vector<double> candidate_rep_buf; ///< Repulsion term of each candidate, see score_candidates()
 
   /**
    * @brief Computes the cohesion component of the log-likelihood
@@ -57,41 +63,78 @@ private:
                            const Eigen::Ref<const Eigen::VectorXi> &cls_ass_k,
                            int n_k) const;
 
+  /**
+   * @brief Repulsion of a point from one cluster
+   * @param point_index Index of the point being evaluated
+   * @param cls_ass_t Vector of point indices in the cluster
+   * @return Term of cluster t in compute_repulsion() (0 for an empty cluster)
+   */
+  double compute_repulsion_cluster(int point_index,
+                                   const Eigen::Ref<const Eigen::VectorXi> &cls_ass_t) const;
+
+  /**
+   * @brief Cohesion term of a cluster from the sums over its pairs
+   * @param n_k Number of points in the cluster (0 for fewer than two)
+   * @param sum Sum of D over the pairs of members
+   * @param log_sum Sum of log D over the pairs of members
+   */
+  double cluster_cohesion(int n_k, double sum, double log_sum) const;
+
+  /**
+   * @brief Repulsion term between two clusters from the sums over their cross pairs
+   * @param n_pairs Number of cross pairs (n_k n_t)
+   * @param sum Sum of D over the cross pairs
+   * @param log_sum Sum of log D over the cross pairs
+   */
+  double cluster_repulsion(double n_pairs, double sum, double log_sum) const;
+
+  /**
+   * @brief Log-likelihood of a cluster from its pairwise sums
+   * @param cluster_index Index of the cluster to evaluate
+   * @param n_k Number of points in the cluster
+   * @return Total log-likelihood (cohesion + repulsion), read from the cache in O(K)
+   */
+  double cluster_loglikelihood_cached(int cluster_index, int n_k) const;
+
+  /**
+   * @brief Fills the conditional log-likelihoods of every candidate from the point's sums
+   * @param out Output vector of size K + 1 (last entry: new cluster)
+   * @param n_threads OpenMP threads over the candidates (1: serial)
+   *
+   * Reads point_sum_buf and point_log_sum_buf. The total repulsion is summed in cluster order
+   * after the candidates are scored, so the output does not depend on n_threads.
+   */
+  void score_candidates(Eigen::Ref<Eigen::VectorXd> out, int n_threads) const;
+
 public:
   /**
    * @brief Constructs a Likelihood object with precomputation
    * @param data Reference to Data object with distances and allocations
    * @param param Reference to model parameters
+   * @param cache Optional DistanceCache registered with the same Datax; when set,
+   * cluster_loglikelihood(cluster_index) reads the cached pairwise sums in O(K)
+   * @param layout Optional ClusterLayout registered with the same Datax; when set,
+   * point_loglikelihood_cond_all() reads the point's sums from contiguous segments
    *
    * The constructor precomputes several values for computational efficiency:
    * - Log-gamma values for delta parameters
    * - Logarithmic combinations of hyperparameters
-   * - Logarithm of the entire distance matrix
+   * - Logarithm of the entire distance matrix (shared through Params, or read from the
+   *   single-precision or packed storage selected on Params); not requested at all with
+   *   delta1 = delta2 = 1 (Params::uses_log_distances()), where the log-distance terms vanish and the kernels read D alone
    */
-  Natarajan_likelihood(const Data &data, const Params &param)
+  Natarajan_likelihood(const Data &data, const Params &param, const DistanceCache *cache = nullptr,
+                       const ClusterLayout *layout = nullptr)
       : Likelihood(data, param), lgamma_delta1(lgamma(params.delta1)),
         log_beta_alpha(log(params.beta) * params.alpha - lgamma(params.alpha)),
         lgamma_delta2(lgamma(params.delta2)),
         log_gamma_zeta(log(params.gamma) * params.zeta - lgamma(params.zeta)),
-        D_cols(params.D.cols()) {
-    // Precompute log distances manually
-    const int n = params.D.rows() * params.D.cols();
-    log_D_data.resize(n);
-
-    // Log distance precomputation
-    const double *D_ptr = params.D.data();
-    for (int i = 0; i < n; ++i) {
-      log_D_data[i] = std::log(D_ptr[i]);
-    }
-
-    // Cache lgamma values for efficiency
-    lgamma_alpha_mh_cache.resize(data.get_n() + 1, 0.0);
-    lgamma_zeta_mt_cache.resize(data.get_n() + 1, 0.0);
-
-    for (int val = 0; val <= data.get_n(); ++val) {
-      lgamma_alpha_mh_cache[val] = lgamma(params.alpha + params.delta1 * val);
-      lgamma_zeta_mt_cache[val] = lgamma(params.zeta + params.delta2 * val);
-    }
+        log_D_data(params.dense_storage() && params.uses_log_distances() ? params.get_log_D_data() : nullptr),
+        cache(cache),
+        layout(layout) {
+    // Shared lgamma tables indexed by cluster size
+    lgamma_alpha_mh_cache = CountTables::shared().lgamma(params.alpha, params.delta1, data.get_n() + 1);
+    lgamma_zeta_mt_cache = CountTables::shared().lgamma(params.zeta, params.delta2, data.get_n() + 1);
 
   }
 
@@ -102,6 +145,7 @@ public:
    *
    * This method computes both the within-cluster cohesion and the
    * between-cluster repulsion contributions for the specified cluster.
+   * With a DistanceCache the pairwise sums are read from the cache.
    */
   double cluster_loglikelihood(int cluster_index) const override final;
 
@@ -119,6 +163,18 @@ public:
       int cluster_index,
       const Eigen::Ref<const Eigen::VectorXi> &cls_ass_k) const override final __attribute__((hot));
 
+  /**
+   * @brief Log-likelihoods of two clusters and of their union, in one evaluation
+   * @param ci First cluster
+   * @param cj Second cluster
+   *
+   * The within sums of ci and cj, their cross sums and the cross sums of each
+   * with every other cluster are computed once (read from the DistanceCache
+   * when set); the union's sums are the sums of the parts, so it costs no
+   * pass of its own.
+   */
+  PairLoglikelihood pair_loglikelihood(int ci, int cj) const override final;
+
   /**
    * @brief Computes the conditional log-likelihood of a point given a cluster
    * @param point_index Index of the point to evaluate
@@ -130,4 +186,63 @@ public:
    * repulsion from points in other clusters.
    */
   double point_loglikelihood_cond(int point_index, int cluster_index) const override final __attribute__((hot));
+
+  /**
+   * @brief Log-odds of a point joining cluster ci rather than cj, in O(n_ci + n_cj)
+   * @param point_index Index of the point (unallocated)
+   * @param ci First cluster
+   * @param cj Second cluster
+   *
+   * The repulsion from the clusters other than ci and cj appears in both
+   * conditionals and cancels: what is left is the cohesion with each cluster
+   * and the repulsion from the other one of the two.
+   */
+  double point_loglikelihood_odds(int point_index, int ci, int cj) const override final;
+
+  /**
+   * @brief Computes the conditional log-likelihood of a point for all clusters
+   * @param point_index Index of the point to evaluate
+   * @param out Output vector of size K + 1 (last entry: new cluster)
+   *
+   * The distance and log-distance sums of the point to every cluster are
+   * accumulated in one O(n) pass. The repulsion from all clusters is then
+   * computed once, and each candidate k gets its cohesion term plus the total
+   * repulsion minus the term of cluster k, so the whole vector costs O(n + K)
+   * instead of O(n K).
+   */
+  void point_loglikelihood_cond_all(int point_index, Eigen::Ref<Eigen::VectorXd> out) const override final __attribute__((hot));
+
+  /**
+   * @brief point_loglikelihood_cond_all() with the row pass and the candidates split over threads
+   * @param point_index Index of the point to evaluate
+   * @param out Output vector of size K + 1 (last entry: new cluster)
+   * @param n_threads Number of OpenMP threads
+   *
+   * The per-cluster sums come from per-thread partial buffers reduced in thread order (see
+   * Likelihood::accumulate_point_sums()); with a ClusterLayout they are read serially from the
+   * segments and only the candidates are split.
+   */
+  void point_loglikelihood_cond_all_parallel(int point_index, Eigen::Ref<Eigen::VectorXd> out,
+                                             int n_threads) const override final;
+
+  /**
+   * @brief Cohesion of a point with an arbitrary set of points, in O(|members|)
+   * @param point_index Index of the point (not among the members)
+   * @param members Indices of the points of the set
+   *
+   * Only the cohesion term: the repulsion from the other clusters is the same for every set
+   * inside one cluster, and the repulsion between the sets of a cluster is left out.
+   */
+  double point_loglikelihood_members(int point_index,
+                                     const Eigen::Ref<const Eigen::VectorXi> &members) const override final {
+    return compute_cohesion(point_index, -1, members, members.size());
+  }
+
+  /**
+   * @brief Heap bytes of the candidate scratch, plus the Likelihood buffers
+   * @see MemoryReport
+   */
+  std::size_t memory_bytes() const override {
+    return Likelihood::memory_bytes() + MemoryReport::bytes(candidate_rep_buf);
+  }
 };
\ No newline at end of file
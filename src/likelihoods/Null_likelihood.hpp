@@ -49,4 +49,19 @@ public:
     double point_loglikelihood_cond(int point_index, int cluster_index) const override final __attribute__((hot)) {
         return 0.0;
     };
+
+    void point_loglikelihood_cond_all(int point_index, Eigen::Ref<Eigen::VectorXd> out) const override final {
+        out.head(data.get_K() + 1).setZero();
+    };
+
+    double point_loglikelihood_members(int point_index,
+                                       const Eigen::Ref<const Eigen::VectorXi> &members) const override final {
+        return 0.0;
+    }
+
+    PairLoglikelihood pair_loglikelihood(int ci, int cj) const override final { return {0.0, 0.0, 0.0}; }
+
+    bool cluster_local() const override final { return true; }
+
+    bool exact_conditionals() const override final { return true; }
 };
\ No newline at end of file
@@ -0,0 +1,103 @@
+/**
+ * @file Tempered_likelihood.hpp
+ * @brief Likelihood raised to a power beta in (0, 1], for tempered chains
+ *
+ * @author Filippo Galli
+ * @date 2025
+ */
+
+#pragma once
+
+#include "../utils/Likelihood.hpp"
+
+/**
+ * @class Tempered_likelihood
+ * @brief Wraps a likelihood and multiplies every log-likelihood it returns by beta
+ *
+ * A sampler built on the wrapper targets p(z) L(z)^beta: beta = 1 is the posterior, smaller
+ * values flatten the likelihood so that the chain crosses between modes more easily. The
+ * wrapper holds no state of its own besides beta, which ReplicaExchange changes between
+ * iterations to exchange temperatures between chains.
+ *
+ * @note The base likelihood must be built on the same Data; it is not owned
+ */
+class Tempered_likelihood : public Likelihood {
+private:
+    const Likelihood &base; ///< Untempered likelihood
+    double beta;            ///< Inverse temperature
+
+public:
+    /**
+     * @brief Constructor
+     * @param data Data of the chain, as for the base likelihood
+     * @param param Parameters
+     * @param base_ Untempered likelihood on the same Data
+     * @param beta_ Inverse temperature in (0, 1]
+     * @throws std::invalid_argument if beta_ is not in (0, 1]
+     */
+    Tempered_likelihood(const Data &data, const Params &param, const Likelihood &base_, double beta_ = 1.0)
+        : Likelihood(data, param), base(base_), beta(1.0) {
+        set_beta(beta_);
+    }
+
+    /**
+     * @brief Sets the inverse temperature
+     * @throws std::invalid_argument if beta_ is not in (0, 1]
+     */
+    void set_beta(double beta_) {
+        if (!(beta_ > 0 && beta_ <= 1)) {
+            throw std::invalid_argument("Tempered_likelihood: beta must be in (0, 1]");
+        }
+        beta = beta_;
+    }
+
+    /** @brief Inverse temperature */
+    double get_beta() const { return beta; }
+
+    /** @brief Untempered likelihood */
+    const Likelihood &get_base() const { return base; }
+
+    double cluster_loglikelihood(int cluster_index) const override final {
+        return beta * base.cluster_loglikelihood(cluster_index);
+    }
+
+    double cluster_loglikelihood(int cluster_index,
+                                 const Eigen::Ref<const Eigen::VectorXi> &cls_ass_k) const override final {
+        return beta * base.cluster_loglikelihood(cluster_index, cls_ass_k);
+    }
+
+    double point_loglikelihood_cond(int point_index, int cluster_index) const override final {
+        return beta * base.point_loglikelihood_cond(point_index, cluster_index);
+    }
+
+    PairLoglikelihood pair_loglikelihood(int ci, int cj) const override final {
+        const PairLoglikelihood pair = base.pair_loglikelihood(ci, cj);
+        return {beta * pair.ci, beta * pair.cj, beta * pair.merged};
+    }
+
+    double point_loglikelihood_odds(int point_index, int ci, int cj) const override final {
+        return beta * base.point_loglikelihood_odds(point_index, ci, cj);
+    }
+
+    void point_loglikelihood_cond_all(int point_index, Eigen::Ref<Eigen::VectorXd> out) const override final {
+        base.point_loglikelihood_cond_all(point_index, out);
+        out.head(data.get_K() + 1) *= beta;
+    }
+
+    void point_loglikelihood_cond_all_parallel(int point_index, Eigen::Ref<Eigen::VectorXd> out,
+                                               int n_threads) const override final {
+        base.point_loglikelihood_cond_all_parallel(point_index, out, n_threads);
+        out.head(data.get_K() + 1) *= beta;
+    }
+
+    double point_loglikelihood_members(int point_index,
+                                       const Eigen::Ref<const Eigen::VectorXi> &members) const override final {
+        return beta * base.point_loglikelihood_members(point_index, members);
+    }
+
+    bool cluster_local() const override final { return base.cluster_local(); }
+
+    bool exact_conditionals() const override final { return base.exact_conditionals(); }
+
+    double inverse_temperature() const override final { return beta; }
+};
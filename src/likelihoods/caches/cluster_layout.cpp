@@ -0,0 +1,284 @@
+/**
+ * @file cluster_layout.cpp
+ * @brief Implementation of `ClusterLayout`.
+ */
+
+#include "cluster_layout.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+ClusterLayout::ClusterLayout(const Eigen::VectorXi &allocations_ref, const Params &params)
+    : D_data(params.dense_storage() ? params.get_D_data() : nullptr),
+      log_D_data(params.dense_storage() && params.uses_log_distances() ? params.get_log_D_data() : nullptr),
+      n(params.n) {
+
+    if (!params.dense_storage()) {
+        throw std::invalid_argument("ClusterLayout needs the dense double precision distances");
+    }
+
+    // Same convention as Data: no allocations means all points in one cluster
+    if (allocations_ref.size() == 0) {
+        labels.assign(n, 0);
+    } else {
+        labels.assign(allocations_ref.data(), allocations_ref.data() + n);
+    }
+    num_clusters = std::max(0, *std::max_element(labels.begin(), labels.end()) + 1);
+
+    D_perm.resize(n, n);
+    if (log_D_data)
+        log_D_perm.resize(n, n);
+    snap_labels.assign(n, -1);
+    position.resize(n);
+    perm.resize(n);
+    missing_slot.assign(n, -1);
+    joined_slot.assign(n, -1);
+
+    rebuild();
+}
+
+// ========== Bookkeeping ==========
+
+void ClusterLayout::ensure_clusters(int K) const {
+    if (K <= static_cast<int>(seg_begin.size())) {
+        return;
+    }
+    seg_begin.resize(K, 0);
+    seg_end.resize(K, 0);
+    missing.resize(K);
+    joined.resize(K);
+}
+
+void ClusterLayout::list_add(std::vector<std::vector<int>> &lists, std::vector<int> &slot, int cluster,
+                             int point) const {
+    slot[point] = static_cast<int>(lists[cluster].size());
+    lists[cluster].push_back(point);
+    ++n_corrections;
+}
+
+void ClusterLayout::list_remove(std::vector<std::vector<int>> &lists, std::vector<int> &slot, int cluster,
+                                int point) const {
+    std::vector<int> &list = lists[cluster];
+    const int s = slot[point];
+    const int last = list.back();
+    list[s] = last;
+    slot[last] = s;
+    list.pop_back();
+    slot[point] = -1;
+    --n_corrections;
+}
+
+void ClusterLayout::orphan_segment(int cluster) const {
+    for (int pos = seg_begin[cluster]; pos < seg_end[cluster]; ++pos) {
+        const int p = perm[pos];
+        snap_labels[p] = -1;
+        if (missing_slot[p] >= 0) {
+            list_remove(missing, missing_slot, cluster, p);
+        } else if (labels[p] == cluster) {
+            // Still a member, now outside any segment
+            list_add(joined, joined_slot, cluster, p);
+        }
+    }
+    seg_begin[cluster] = seg_end[cluster] = 0;
+}
+
+void ClusterLayout::rebuild() const {
+    ensure_clusters(num_clusters);
+
+    // Counting sort by cluster, unallocated points at the end
+    std::vector<int> count(num_clusters + 1, 0);
+    for (int i = 0; i < n; ++i) {
+        ++count[labels[i] >= 0 ? labels[i] : num_clusters];
+    }
+    int offset = 0;
+    for (int k = 0; k < num_clusters; ++k) {
+        seg_begin[k] = offset;
+        offset += count[k];
+        seg_end[k] = offset;
+        count[k] = seg_begin[k];
+    }
+    count[num_clusters] = offset;
+
+    for (int i = 0; i < n; ++i) {
+        const int c = labels[i] >= 0 ? labels[i] : num_clusters;
+        position[i] = count[c]++;
+        perm[position[i]] = i;
+        snap_labels[i] = labels[i];
+    }
+    for (size_t k = num_clusters; k < seg_begin.size(); ++k) {
+        seg_begin[k] = seg_end[k] = 0;
+    }
+
+    for (auto &list : missing)
+        list.clear();
+    for (auto &list : joined)
+        list.clear();
+    std::fill(missing_slot.begin(), missing_slot.end(), -1);
+    std::fill(joined_slot.begin(), joined_slot.end(), -1);
+    n_corrections = 0;
+
+    // D is symmetric: column perm[b] read at rows perm[a] is column b of the permuted matrix
+    for (int b = 0; b < n; ++b) {
+        const size_t src = static_cast<size_t>(perm[b]) * n;
+        const double *__restrict__ D_col = D_data + src;
+        double *__restrict__ Dp_col = D_perm.data() + static_cast<size_t>(b) * n;
+        for (int a = 0; a < n; ++a)
+            Dp_col[a] = D_col[perm[a]];
+        if (!log_D_data)
+            continue;
+
+        const double *__restrict__ logD_col = log_D_data + src;
+        double *__restrict__ logDp_col = log_D_perm.data() + static_cast<size_t>(b) * n;
+        for (int a = 0; a < n; ++a)
+            logDp_col[a] = logD_col[perm[a]];
+        logDp_col[b] = 0.0;
+    }
+}
+
+// ========== Queries ==========
+
+template <bool WithLog>
+void ClusterLayout::segment_sums(const double *row_D, const double *row_logD, int k, double &sum,
+                                 double &log_sum) const {
+    double s = 0.0, ls = 0.0;
+    for (int pos = seg_begin[k]; pos < seg_end[k]; ++pos) {
+        s += row_D[pos];
+        if constexpr (WithLog)
+            ls += row_logD[pos];
+    }
+    for (int p : missing[k]) {
+        s -= row_D[position[p]];
+        if constexpr (WithLog)
+            ls -= row_logD[position[p]];
+    }
+    for (int p : joined[k]) {
+        s += row_D[position[p]];
+        if constexpr (WithLog)
+            ls += row_logD[position[p]];
+    }
+    sum = s;
+    log_sum = ls;
+}
+
+void ClusterLayout::point_cluster_sums(int point_index, std::vector<double> &sum,
+                                       std::vector<double> &log_sum) const {
+    if (n_corrections > n / 8) {
+        rebuild();
+    }
+
+    sum.resize(num_clusters);
+    log_sum.resize(num_clusters);
+
+    const size_t row = static_cast<size_t>(position[point_index]) * n;
+    const double *row_D = D_perm.data() + row;
+    if (log_D_data) {
+        const double *row_logD = log_D_perm.data() + row;
+        for (int k = 0; k < num_clusters; ++k)
+            segment_sums<true>(row_D, row_logD, k, sum[k], log_sum[k]);
+    } else {
+        for (int k = 0; k < num_clusters; ++k)
+            segment_sums<false>(row_D, nullptr, k, sum[k], log_sum[k]);
+    }
+}
+
+void ClusterLayout::point_cluster_sum(int point_index, int cluster, double &sum, double &log_sum) const {
+    if (n_corrections > n / 8) {
+        rebuild();
+    }
+
+    const size_t row = static_cast<size_t>(position[point_index]) * n;
+    if (log_D_data)
+        segment_sums<true>(D_perm.data() + row, log_D_perm.data() + row, cluster, sum, log_sum);
+    else
+        segment_sums<false>(D_perm.data() + row, nullptr, cluster, sum, log_sum);
+}
+
+// ========== ClusterInfo interface ==========
+
+void ClusterLayout::set_allocation(int index, int cluster, int old_cluster) {
+    if (cluster == old_cluster) {
+        return;
+    }
+    ensure_clusters(std::max(num_clusters, cluster + 1));
+
+    if (old_cluster >= 0) {
+        if (snap_labels[index] == old_cluster) {
+            list_add(missing, missing_slot, old_cluster, index);
+        } else {
+            list_remove(joined, joined_slot, old_cluster, index);
+        }
+    }
+    if (cluster >= 0) {
+        if (snap_labels[index] == cluster) {
+            list_remove(missing, missing_slot, cluster, index);
+        } else {
+            list_add(joined, joined_slot, cluster, index);
+        }
+        num_clusters = std::max(num_clusters, cluster + 1);
+    }
+
+    labels[index] = cluster;
+}
+
+void ClusterLayout::recompute(const int K, const Eigen::VectorXi &allocations_in) {
+    for (int i = 0; i < n; ++i) {
+        if (labels[i] != allocations_in(i)) {
+            set_allocation(i, allocations_in(i), labels[i]);
+        }
+    }
+
+    // Clusters past K are empty now: drop their segments
+    for (int k = K; k < num_clusters; ++k) {
+        orphan_segment(k);
+    }
+    num_clusters = K;
+}
+
+void ClusterLayout::move_cluster_info(int from_cluster, int to_cluster) {
+    // The target cluster is empty: its segment no longer belongs to anyone
+    orphan_segment(to_cluster);
+
+    for (int i = 0; i < n; ++i) {
+        if (labels[i] == from_cluster)
+            labels[i] = to_cluster;
+        if (snap_labels[i] == from_cluster)
+            snap_labels[i] = to_cluster;
+    }
+
+    // The slots index into the lists, which move unchanged
+    seg_begin[to_cluster] = seg_begin[from_cluster];
+    seg_end[to_cluster] = seg_end[from_cluster];
+    missing[to_cluster].swap(missing[from_cluster]);
+    joined[to_cluster].swap(joined[from_cluster]);
+
+    seg_begin[from_cluster] = seg_end[from_cluster] = 0;
+    missing[from_cluster].clear();
+    joined[from_cluster].clear();
+}
+
+void ClusterLayout::remove_info(int cluster) {
+    orphan_segment(cluster);
+    n_corrections -= static_cast<int>(joined[cluster].size());
+    for (int p : joined[cluster])
+        joined_slot[p] = -1;
+    joined[cluster].clear();
+
+    // Removing a cluster in the middle shifts the following ones down by one
+    const int last = num_clusters - 1;
+    if (cluster < last) {
+        for (int i = 0; i < n; ++i) {
+            if (labels[i] > cluster)
+                --labels[i];
+            if (snap_labels[i] > cluster)
+                --snap_labels[i];
+        }
+        for (int k = cluster; k < last; ++k) {
+            seg_begin[k] = seg_begin[k + 1];
+            seg_end[k] = seg_end[k + 1];
+            missing[k].swap(missing[k + 1]);
+            joined[k].swap(joined[k + 1]);
+        }
+        seg_begin[last] = seg_end[last] = 0;
+    }
+
+    num_clusters = last;
+}
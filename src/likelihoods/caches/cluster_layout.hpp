@@ -0,0 +1,161 @@
+#pragma once
+
+/**
+ * @file cluster_layout.hpp
+ * @brief Cluster-contiguous permuted copy of the distance matrices.
+ */
+
+#include "../../utils/ClusterInfo.hpp"
+#include "../../utils/Params.hpp"
+#include <Eigen/Dense>
+#include <vector>
+
+/**
+ * @class ClusterLayout
+ * @brief Keeps D and log D permuted so that the members of each cluster are contiguous.
+ * @details At each re-permutation the points are sorted by cluster and D, log D are copied in
+ * that order, so the sums of a point's distances to the members of cluster k become contiguous
+ * (vectorizable) row-segment reads instead of scattered gathers.
+ *
+ * Between re-permutations the clusters drift away from their segments. Every point that left the
+ * segment of its cluster ("missing") or joined a cluster outside its segment ("joined") is kept in
+ * a per-cluster correction list, and the segment sums are patched with those entries. Once the
+ * corrections exceed n / 8 points the layout is rebuilt, lazily, at the next query: an O(n^2) copy
+ * amortized over the moves that caused it (about one Gibbs sweep).
+ *
+ * The diagonal of the permuted log D is stored as 0 instead of -inf, so that patching a segment
+ * that contains the query point itself stays finite.
+ *
+ * Memory: two extra n x n double matrices, one if the likelihoods have no log-distance term
+ * (Params::uses_log_distances(): log D is then neither copied nor read). Not available with Params::use_single_precision() or
+ * Params::use_packed_storage(), whose point is to avoid n x n double copies.
+ */
+
+class ClusterLayout : public ClusterInfo {
+private:
+    const double *D_data;     ///< Original distance matrix (flattened), see Params::get_D_data()
+    const double *log_D_data; ///< Original log distance matrix (flattened), shared through Params::get_log_D_data() (nullptr: unused)
+    const int n;              ///< Number of points
+
+    mutable Eigen::MatrixXd D_perm;     ///< D with rows and columns permuted by cluster
+    mutable Eigen::MatrixXd log_D_perm; ///< log D with rows and columns permuted by cluster (0 on the diagonal; empty without log_D_data)
+
+    std::vector<int> labels;              ///< Current cluster of each point (-1 unallocated)
+    mutable std::vector<int> snap_labels; ///< Cluster whose segment holds each point (-1: no segment)
+    mutable std::vector<int> position;    ///< Permuted position of each point
+    mutable std::vector<int> perm;        ///< Point stored at each permuted position
+
+    mutable std::vector<int> seg_begin; ///< First position of each cluster's segment
+    mutable std::vector<int> seg_end;   ///< One past the last position of each cluster's segment
+
+    mutable std::vector<std::vector<int>> missing; ///< Per cluster: points in its segment now elsewhere
+    mutable std::vector<std::vector<int>> joined;  ///< Per cluster: members outside its segment
+    mutable std::vector<int> missing_slot;         ///< Index of each point in its missing list (-1 if none)
+    mutable std::vector<int> joined_slot;          ///< Index of each point in its joined list (-1 if none)
+    mutable int n_corrections = 0;                 ///< Total size of the correction lists
+
+    int num_clusters = 0; ///< Number of clusters tracked
+
+    /**
+     * @brief Makes room for clusters with index < K
+     * @param K Required number of clusters
+     */
+    void ensure_clusters(int K) const;
+
+    /** @brief Appends a point to a correction list */
+    void list_add(std::vector<std::vector<int>> &lists, std::vector<int> &slot, int cluster, int point) const;
+
+    /** @brief Removes a point from a correction list in O(1) (swap with last) */
+    void list_remove(std::vector<std::vector<int>> &lists, std::vector<int> &slot, int cluster, int point) const;
+
+    /**
+     * @brief Marks the points of a segment that are no longer part of any cluster segment
+     * @param cluster Cluster whose segment is dropped
+     */
+    void orphan_segment(int cluster) const;
+
+    /**
+     * @brief Sums the permuted row of a point over cluster k, including corrections
+     * @param row_D Permuted row of D for the point
+     * @param row_logD Permuted row of log D for the point (unread unless WithLog)
+     * @param k Cluster index
+     * @param sum Output: sum of D
+     * @param log_sum Output: sum of log D (0 unless WithLog)
+     * @tparam WithLog false when the likelihoods have no log-distance term
+     */
+    template <bool WithLog>
+    void segment_sums(const double *row_D, const double *row_logD, int k, double &sum, double &log_sum) const;
+
+public:
+    /**
+     * @brief Builds the layout from the initial allocations
+     * @param allocations_ref Initial allocations (empty: all points in one cluster)
+     * @param params Model parameters holding D
+     * @throws std::invalid_argument unless params stores D and log D as dense double matrices
+     */
+    ClusterLayout(const Eigen::VectorXi &allocations_ref, const Params &params);
+
+    /**
+     * @brief Re-permutes D and log D by the current clusters and clears the corrections
+     */
+    void rebuild() const;
+
+    /**
+     * @brief Sums the distances of a point to the members of every cluster
+     * @param point_index Index of the point
+     * @param sum Output: per-cluster sums of D (resized to the number of clusters)
+     * @param log_sum Output: per-cluster sums of log D (resized to the number of clusters)
+     *
+     * Same result as a pass over the point's row dispatched on the allocations
+     * (Likelihood::accumulate_point_sums()), with contiguous reads.
+     */
+    void point_cluster_sums(int point_index, std::vector<double> &sum, std::vector<double> &log_sum) const;
+
+    /**
+     * @brief Sums the distances of a point to the members of one cluster
+     * @param point_index Index of the point
+     * @param cluster Cluster index
+     * @param sum Output: sum of D
+     * @param log_sum Output: sum of log D
+     */
+    void point_cluster_sum(int point_index, int cluster, double &sum, double &log_sum) const;
+
+    /**
+     * @brief Assigns a point to a cluster
+     * @param index Index of the point to reassign
+     * @param cluster Target cluster index (K for new cluster, -1 for unallocated)
+     * @param old_cluster Previous cluster index of the point
+     */
+    void set_allocation(int index, int cluster, int old_cluster) override;
+
+    /**
+     * @brief Recomputes all cluster information from current allocations
+     * @param K Current number of clusters
+     * @param allocations_in Current allocations vector
+     */
+    void recompute(const int K, const Eigen::VectorXi &allocations_in) override;
+
+    /**
+     * @brief Moves cluster information from one cluster to another
+     * @param from_cluster Index of the source cluster
+     * @param to_cluster Index of the target cluster
+     */
+    void move_cluster_info(int from_cluster, int to_cluster) override;
+
+    /**
+     * @brief Removes information related to a specific cluster
+     * @param cluster Index of the cluster to remove
+     */
+    void remove_info(int cluster) override;
+
+    /**
+     * @brief Heap bytes of the permuted copies of D and log D and the segment bookkeeping
+     * @see MemoryReport
+     */
+    std::size_t memory_bytes() const override {
+        return MemoryReport::bytes(D_perm) + MemoryReport::bytes(log_D_perm) + MemoryReport::bytes(labels) +
+               MemoryReport::bytes(snap_labels) + MemoryReport::bytes(position) + MemoryReport::bytes(perm) +
+               MemoryReport::bytes(seg_begin) + MemoryReport::bytes(seg_end) + MemoryReport::bytes(missing) +
+               MemoryReport::bytes(joined) + MemoryReport::bytes(missing_slot) + MemoryReport::bytes(joined_slot);
+    }
+};
@@ -0,0 +1,285 @@
+/**
+ * @file distance_cache.cpp
+ * @brief Implementation of `DistanceCache`.
+ */
+
+#include "distance_cache.hpp"
+#include <algorithm>
+
+DistanceCache::DistanceCache(const Eigen::VectorXi &allocations_ref, const Params &params)
+    : D_data(params.dense_storage() ? params.get_D_data() : nullptr),
+      log_D_data(params.dense_storage() && params.uses_log_distances() ? params.get_log_D_data() : nullptr),
+      D_pairs(params.get_D_pairs()),
+      D_packed(params.get_D_packed()), n(params.n) {
+
+    if (D_packed) {
+        packed_row_buf.resize(n);
+        packed_log_row_buf.resize(n);
+    }
+
+    // Same convention as Data: no allocations means all points in one cluster
+    const Eigen::VectorXi allocations =
+        allocations_ref.size() == 0 ? Eigen::VectorXi::Zero(n) : Eigen::VectorXi(allocations_ref);
+    const int K = allocations.maxCoeff() + 1;
+    rebuild(K > 0 ? K : 0, allocations);
+}
+
+void DistanceCache::ensure_capacity(int K) {
+    if (K > static_cast<int>(cluster_stats.size())) {
+        cluster_stats.resize(K);
+    }
+
+    const int capacity = between_sum.rows();
+    if (K <= capacity) {
+        return;
+    }
+
+    // Grow geometrically so that opening clusters one at a time stays amortized O(K)
+    const int new_capacity = std::max({K, 2 * capacity, 4});
+    Eigen::MatrixXd new_sum = Eigen::MatrixXd::Zero(new_capacity, new_capacity);
+    Eigen::MatrixXd new_log_sum = Eigen::MatrixXd::Zero(new_capacity, new_capacity);
+    new_sum.topLeftCorner(capacity, capacity) = between_sum;
+    new_log_sum.topLeftCorner(capacity, capacity) = between_log_sum;
+    between_sum.swap(new_sum);
+    between_log_sum.swap(new_log_sum);
+
+    row_sum_buf.resize(new_capacity);
+    row_log_sum_buf.resize(new_capacity);
+}
+
+void DistanceCache::move_point(int index, int from, int to) {
+    if (from == to) {
+        return;
+    }
+
+    ensure_capacity(std::max(num_clusters, to + 1));
+    const int C = static_cast<int>(cluster_stats.size());
+
+    // Distance and log-distance sums of the point to every cluster (point itself excluded)
+    std::fill(row_sum_buf.begin(), row_sum_buf.begin() + C, 0.0);
+    std::fill(row_log_sum_buf.begin(), row_log_sum_buf.begin() + C, 0.0);
+
+    const size_t row = static_cast<size_t>(index) * n;
+    const int *__restrict__ lab = labels.data();
+    double *__restrict__ s = row_sum_buf.data();
+    double *__restrict__ ls = row_log_sum_buf.data();
+
+    if (D_pairs) {
+        const DistancePair *__restrict__ pair_row = D_pairs + row;
+        for (int j = 0; j < n; ++j) {
+            const int c = lab[j];
+            if (c < 0 || j == index)
+                continue;
+            s[c] += pair_row[j].d;
+            ls[c] += pair_row[j].log_d;
+        }
+    } else {
+        if (D_packed)
+            D_packed->materialize_row(index, packed_row_buf.data(), packed_log_row_buf.data());
+        const double *__restrict__ D_row = D_packed ? packed_row_buf.data() : D_data + row;
+        const double *__restrict__ logD_row = D_packed ? packed_log_row_buf.data() : log_D_data ? log_D_data + row : nullptr;
+        if (logD_row) {
+            for (int j = 0; j < n; ++j) {
+                const int c = lab[j];
+                if (c < 0 || j == index)
+                    continue;
+                s[c] += D_row[j];
+                ls[c] += logD_row[j];
+            }
+        } else {
+            // No log-distance term (Params::uses_log_distances()): the log sums stay 0
+            for (int j = 0; j < n; ++j) {
+                const int c = lab[j];
+                if (c < 0 || j == index)
+                    continue;
+                s[c] += D_row[j];
+            }
+        }
+    }
+
+    // Remove the pairs formed with the members of every cluster
+    if (from >= 0) {
+        cluster_stats[from].sum -= s[from];
+        cluster_stats[from].log_sum -= ls[from];
+        for (int t = 0; t < C; ++t) {
+            if (t == from)
+                continue;
+            between_sum(from, t) -= s[t];
+            between_sum(t, from) -= s[t];
+            between_log_sum(from, t) -= ls[t];
+            between_log_sum(t, from) -= ls[t];
+        }
+    }
+
+    // Add the pairs formed in the new cluster
+    if (to >= 0) {
+        cluster_stats[to].sum += s[to];
+        cluster_stats[to].log_sum += ls[to];
+        for (int t = 0; t < C; ++t) {
+            if (t == to)
+                continue;
+            between_sum(to, t) += s[t];
+            between_sum(t, to) += s[t];
+            between_log_sum(to, t) += ls[t];
+            between_log_sum(t, to) += ls[t];
+        }
+        num_clusters = std::max(num_clusters, to + 1);
+    }
+
+    labels[index] = to;
+}
+
+void DistanceCache::rebuild(int K, const Eigen::VectorXi &allocations) {
+    labels.assign(allocations.data(), allocations.data() + n);
+    num_clusters = K;
+
+    ensure_capacity(K);
+    std::fill(cluster_stats.begin(), cluster_stats.end(), ClusterStats());
+    between_sum.setZero();
+    between_log_sum.setZero();
+
+    for (int i = 0; i < n; ++i) {
+        const int ci = labels[i];
+        if (ci < 0)
+            continue;
+
+        // Entry j of the strict upper part of row i is at [j - i - 1] in the packed storage
+        const size_t row = static_cast<size_t>(i) * n;
+        const double *packed_D = D_packed && i + 1 < n ? D_packed->upper_row_D(i) : nullptr;
+        const double *packed_log_D = D_packed && i + 1 < n ? D_packed->upper_row_log_D(i) : nullptr;
+
+        for (int j = i + 1; j < n; ++j) {
+            const int cj = labels[j];
+            if (cj < 0)
+                continue;
+
+            double d, log_d;
+            if (D_pairs) {
+                d = D_pairs[row + j].d;
+                log_d = D_pairs[row + j].log_d;
+            } else if (D_packed) {
+                d = packed_D[j - i - 1];
+                log_d = packed_log_D[j - i - 1];
+            } else {
+                d = D_data[row + j];
+                log_d = log_D_data ? log_D_data[row + j] : 0.0;
+            }
+            if (ci == cj) {
+                cluster_stats[ci].sum += d;
+                cluster_stats[ci].log_sum += log_d;
+            } else {
+                between_sum(ci, cj) += d;
+                between_sum(cj, ci) += d;
+                between_log_sum(ci, cj) += log_d;
+                between_log_sum(cj, ci) += log_d;
+            }
+        }
+    }
+}
+
+void DistanceCache::set_allocation(int index, int cluster, int old_cluster) { move_point(index, old_cluster, cluster); }
+
+void DistanceCache::recompute(int K, const Eigen::VectorXi &allocations_in) {
+    int changed = 0;
+    for (int i = 0; i < n; ++i) {
+        changed += (labels[i] != allocations_in(i));
+    }
+
+    // Replaying moves costs O(n) each, a rebuild O(n^2 / 2)
+    if (changed > n / 4) {
+        rebuild(K, allocations_in);
+        return;
+    }
+
+    for (int i = 0; i < n && changed > 0; ++i) {
+        if (labels[i] != allocations_in(i)) {
+            move_point(i, labels[i], allocations_in(i));
+            --changed;
+        }
+    }
+
+    // Clusters past K are empty now: drop their (rounding) residue
+    for (int k = K; k < num_clusters; ++k) {
+        cluster_stats[k] = ClusterStats();
+        between_sum.row(k).setZero();
+        between_sum.col(k).setZero();
+        between_log_sum.row(k).setZero();
+        between_log_sum.col(k).setZero();
+    }
+    num_clusters = K;
+}
+
+void DistanceCache::move_cluster_info(int from_cluster, int to_cluster) {
+    for (int &label : labels) {
+        if (label == from_cluster)
+            label = to_cluster;
+    }
+
+    cluster_stats[to_cluster] = cluster_stats[from_cluster];
+
+    const int C = static_cast<int>(cluster_stats.size());
+    for (int t = 0; t < C; ++t) {
+        if (t == from_cluster || t == to_cluster)
+            continue;
+        between_sum(to_cluster, t) = between_sum(t, to_cluster) = between_sum(from_cluster, t);
+        between_log_sum(to_cluster, t) = between_log_sum(t, to_cluster) = between_log_sum(from_cluster, t);
+    }
+    between_sum(to_cluster, to_cluster) = 0.0;
+    between_log_sum(to_cluster, to_cluster) = 0.0;
+}
+
+void DistanceCache::remove_info(int cluster) {
+    const int last = num_clusters - 1;
+
+    // Removing a cluster in the middle shifts the following ones down by one
+    if (cluster < last) {
+        for (int &label : labels) {
+            if (label > cluster)
+                --label;
+        }
+        for (int k = cluster; k < last; ++k) {
+            cluster_stats[k] = cluster_stats[k + 1];
+        }
+
+        const int tail = last - cluster;
+        between_sum.block(cluster, 0, tail, num_clusters) = between_sum.block(cluster + 1, 0, tail, num_clusters).eval();
+        between_sum.block(0, cluster, num_clusters, tail) = between_sum.block(0, cluster + 1, num_clusters, tail).eval();
+        between_log_sum.block(cluster, 0, tail, num_clusters) =
+            between_log_sum.block(cluster + 1, 0, tail, num_clusters).eval();
+        between_log_sum.block(0, cluster, num_clusters, tail) =
+            between_log_sum.block(0, cluster + 1, num_clusters, tail).eval();
+    }
+
+    cluster_stats[last] = ClusterStats();
+    between_sum.row(last).setZero();
+    between_sum.col(last).setZero();
+    between_log_sum.row(last).setZero();
+    between_log_sum.col(last).setZero();
+    num_clusters = last;
+}
+
+void DistanceCache::merge_clusters(int from_cluster, int to_cluster, const std::vector<int> &moved) {
+    for (const int index : moved) {
+        labels[index] = to_cluster;
+    }
+
+    // The pairs of the merged cluster: those of each part plus the cross pairs
+    ClusterStats &to_stats = cluster_stats[to_cluster];
+    to_stats.sum += cluster_stats[from_cluster].sum + between_sum(from_cluster, to_cluster);
+    to_stats.log_sum += cluster_stats[from_cluster].log_sum + between_log_sum(from_cluster, to_cluster);
+    cluster_stats[from_cluster] = ClusterStats();
+
+    const int C = static_cast<int>(cluster_stats.size());
+    for (int t = 0; t < C; ++t) {
+        if (t == from_cluster || t == to_cluster)
+            continue;
+        between_sum(to_cluster, t) += between_sum(from_cluster, t);
+        between_sum(t, to_cluster) = between_sum(to_cluster, t);
+        between_log_sum(to_cluster, t) += between_log_sum(from_cluster, t);
+        between_log_sum(t, to_cluster) = between_log_sum(to_cluster, t);
+    }
+    between_sum.row(from_cluster).setZero();
+    between_sum.col(from_cluster).setZero();
+    between_log_sum.row(from_cluster).setZero();
+    between_log_sum.col(from_cluster).setZero();
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+/**
+ * @file distance_cache.hpp
+ * @brief Cache of pairwise distance sufficient statistics for the distance likelihoods.
+ */
+
+#include "../../utils/ClusterInfo.hpp"
+#include "../../utils/Params.hpp"
+#include <Eigen/Dense>
+#include <vector>
+
+/**
+ * @class DistanceCache
+ * @brief Cache of within- and between-cluster sums of D and log D.
+ * @details For every cluster k the cache stores the sum of D and log D over the unordered pairs of
+ * its members, and for every pair of clusters (k, t) the sum over the n_k * n_t cross pairs. These are
+ * the only data-dependent quantities of Natarajan_likelihood and Gamma_likelihood, so with the cache
+ * cluster_loglikelihood(k) costs O(K) instead of O(n_k * n).
+ *
+ * Each set_allocation() costs one O(n) pass over the row of the moved point. recompute() applies
+ * the difference between the cached and the requested allocations point by point, so restoring
+ * the state before a rejected proposal costs O(n) per moved point. A full O(n^2) rebuild is done
+ * only when most points changed.
+ *
+ * Memory is O(K_max^2) for the between-cluster sums, where K_max is the largest number of clusters seen.
+ * The sums are accumulated in double whatever the storage mode of Params.
+ */
+
+class DistanceCache : public ClusterInfo {
+public:
+    /**
+     * @struct ClusterStats
+     * @brief Within-cluster sums over unordered pairs of members.
+     */
+    struct ClusterStats {
+        double sum = 0.0;     ///< Sum of D over the pairs of members
+        double log_sum = 0.0; ///< Sum of log D over the pairs of members
+    };
+
+private:
+    const double *D_data;        ///< Distance matrix (flattened), shared with Params
+    const double *log_D_data;    ///< Log distance matrix (flattened), shared through Params::get_log_D_data() (nullptr: log sums of 0, see Params::uses_log_distances())
+    const DistancePair *D_pairs; ///< Single-precision D / log D (nullptr: double storage), shared with Params
+    const PackedDistances *D_packed; ///< Packed D / log D (nullptr: dense storage), shared with Params
+    const int n;              ///< Number of points
+
+    int num_clusters = 0;                   ///< Number of clusters tracked
+    std::vector<int> labels;                ///< Cluster of each point as seen by the cache (-1 unallocated)
+    std::vector<ClusterStats> cluster_stats; ///< Within-cluster sums, indexed by cluster
+    Eigen::MatrixXd between_sum;            ///< Between-cluster sums of D (symmetric, capacity x capacity)
+    Eigen::MatrixXd between_log_sum;        ///< Between-cluster sums of log D (symmetric, capacity x capacity)
+
+    std::vector<double> row_sum_buf;     ///< Per-cluster sums of D(point, .), scratch for move_point()
+    std::vector<double> row_log_sum_buf; ///< Per-cluster sums of log D(point, .), scratch for move_point()
+    std::vector<double> packed_row_buf;     ///< Row of D materialized from D_packed, scratch for move_point()
+    std::vector<double> packed_log_row_buf; ///< Row of log D materialized from D_packed, scratch for move_point()
+
+    /**
+     * @brief Makes room for clusters with index < K, zero-initialising the new entries
+     * @param K Required number of clusters
+     */
+    void ensure_capacity(int K);
+
+    /**
+     * @brief Moves a point between two clusters updating all sums
+     * @param index Index of the point
+     * @param from Cluster the point leaves (-1 if unallocated)
+     * @param to Cluster the point joins (-1 to unallocate)
+     */
+    void move_point(int index, int from, int to);
+
+    /**
+     * @brief Rebuilds all sums from scratch in O(n^2)
+     * @param K Number of clusters
+     * @param allocations Allocations to rebuild from
+     */
+    void rebuild(int K, const Eigen::VectorXi &allocations);
+
+public:
+    DistanceCache(const Eigen::VectorXi &allocations_ref, const Params &params);
+
+    /**
+     * @brief Assigns a point to a cluster
+     * @param index Index of the point to reassign
+     * @param cluster Target cluster index (K for new cluster, -1 for unallocated)
+     * @param old_cluster Previous cluster index of the point
+     */
+    void set_allocation(int index, int cluster, int old_cluster) override;
+
+    /**
+     * @brief Merges from_cluster into to_cluster from the cluster sums, in O(K + moved points)
+     * instead of one O(n) row pass per moved point
+     */
+    void merge_clusters(int from_cluster, int to_cluster, const std::vector<int> &moved) override;
+
+    /**
+     * @brief Get within-cluster statistics for a specific cluster
+     * @param cluster Index of the cluster
+     * @return Const reference to ClusterStats struct
+     */
+    inline const ClusterStats &get_cluster_stats_ref(int cluster) const { return cluster_stats[cluster]; }
+
+    /**
+     * @brief Sum of D over the cross pairs of two clusters
+     * @param k Index of the first cluster
+     * @param t Index of the second cluster (t != k)
+     * @return Between-cluster distance sum
+     */
+    inline double get_between_sum(int k, int t) const { return between_sum(k, t); }
+
+    /**
+     * @brief Sum of log D over the cross pairs of two clusters
+     * @param k Index of the first cluster
+     * @param t Index of the second cluster (t != k)
+     * @return Between-cluster log-distance sum
+     */
+    inline double get_between_log_sum(int k, int t) const { return between_log_sum(k, t); }
+
+    /**
+     * @brief Recomputes all cluster information from current allocations
+     * @param K Current number of clusters
+     * @param allocations_in Current allocations vector
+     */
+    void recompute(const int K, const Eigen::VectorXi &allocations_in) override;
+
+    /**
+     * @brief Moves cluster information from one cluster to another
+     * @param from_cluster Index of the source cluster
+     * @param to_cluster Index of the target cluster
+     */
+    void move_cluster_info(int from_cluster, int to_cluster) override;
+
+    /**
+     * @brief Removes information related to a specific cluster
+     * @param cluster Index of the cluster to remove
+     */
+    void remove_info(int cluster) override;
+
+    /**
+     * @brief Heap bytes of the within- and between-cluster sums and the scratch rows
+     * @see MemoryReport
+     */
+    std::size_t memory_bytes() const override {
+        return MemoryReport::bytes(labels) + MemoryReport::bytes(cluster_stats) + MemoryReport::bytes(between_sum) +
+               MemoryReport::bytes(between_log_sum) + MemoryReport::bytes(row_sum_buf) +
+               MemoryReport::bytes(row_log_sum_buf) + MemoryReport::bytes(packed_row_buf) +
+               MemoryReport::bytes(packed_log_row_buf);
+    }
+};
@@ -24,9 +24,10 @@ double DP::gibbs_prior_existing_cluster(int cls_idx, int obs_idx) const {
    * @return The log prior probability of assigning the data point to its
    * current cluster.
    */
+  PROFILE_SCOPE(GibbsPriorExistingCluster);
 
   const int cluster_size = data.get_cluster_size(cls_idx);
-  return (cluster_size > 0) ? log(cluster_size) : std::numeric_limits<double>::lowest();
+  return (cluster_size > 0) ? log_size[cluster_size] : std::numeric_limits<double>::lowest();
 }
 
 Eigen::VectorXd DP::gibbs_prior_existing_clusters(int obs_idx) const {
@@ -37,13 +38,19 @@ Eigen::VectorXd DP::gibbs_prior_existing_clusters(int obs_idx) const {
    * implementation).
    * @return A vector of log prior probabilities for all existing clusters.
    */
-
   Eigen::VectorXd log_priors(data.get_K());
+  DP::gibbs_prior_existing_clusters(obs_idx, log_priors);
+  return log_priors;
+}
+
+void DP::gibbs_prior_existing_clusters(int obs_idx,
+                                       Eigen::Ref<Eigen::VectorXd> out) const {
+  PROFILE_SCOPE(GibbsPriorExistingClusters);
+
   for (int k = 0; k < data.get_K(); ++k) {
       int cluster_size = data.get_cluster_size(k);
-      log_priors(k) = (cluster_size > 0) ? log(cluster_size) : std::numeric_limits<double>::lowest();
+      out(k) = (cluster_size > 0) ? log_size[cluster_size] : std::numeric_limits<double>::lowest();
   }
-  return log_priors;
 }
 
 double DP::gibbs_prior_new_cluster() const {
@@ -53,6 +60,7 @@ double DP::gibbs_prior_new_cluster() const {
    * @return The log prior probability of assigning the data point to a new
    * cluster.
    */
+  PROFILE_SCOPE(GibbsPriorNewCluster);
   return log_a;
 }
 
@@ -64,11 +72,12 @@ double DP::prior_ratio_split(int ci, int cj) const {
    * @param cj The second cluster index involved in the split.
    * @return The log prior ratio for the split operation.
    */
+  PROFILE_SCOPE(PriorRatioSplit);
 
   const int n_ci = data.get_cluster_size(ci);
   const int n_cj = data.get_cluster_size(cj);
 
-  return log_a - lgamma(n_ci + n_cj) + lgamma(n_ci) + lgamma(n_cj);
+  return log_a - lgamma_size[n_ci + n_cj] + lgamma_size[n_ci] + lgamma_size[n_cj];
 }
 
 double DP::prior_ratio_merge(int size_old_ci, int size_old_cj) const {
@@ -79,13 +88,14 @@ double DP::prior_ratio_merge(int size_old_ci, int size_old_cj) const {
    * @param size_old_cj The size of the second cluster before the merge.
    * @return The log prior ratio for the merge operation.
    */
+  PROFILE_SCOPE(PriorRatioMerge);
 
   const int size_merge = size_old_ci + size_old_cj;
 
   double log_acceptance_ratio = -log_a;
-  log_acceptance_ratio += lgamma(size_merge);
-  log_acceptance_ratio -= lgamma(size_old_ci);
-  log_acceptance_ratio -= lgamma(size_old_cj);
+  log_acceptance_ratio += lgamma_size[size_merge];
+  log_acceptance_ratio -= lgamma_size[size_old_ci];
+  log_acceptance_ratio -= lgamma_size[size_old_cj];
 
   return log_acceptance_ratio;
 }
@@ -101,15 +111,30 @@ double DP::prior_ratio_shuffle(int size_old_ci, int size_old_cj, int ci,
    * @param cj The second cluster index involved in the shuffle.
    * @return The log prior ratio for the shuffle operation.
    */
+  PROFILE_SCOPE(PriorRatioShuffle);
 
   const int n_ci = data.get_cluster_size(ci);
   const int n_cj = data.get_cluster_size(cj);
 
   double log_acceptance_ratio = 0.0;
-  log_acceptance_ratio += lgamma(n_ci);
-  log_acceptance_ratio += lgamma(n_cj);
-  log_acceptance_ratio -= lgamma(size_old_ci);
-  log_acceptance_ratio -= lgamma(size_old_cj);
+  log_acceptance_ratio += lgamma_size[n_ci];
+  log_acceptance_ratio += lgamma_size[n_cj];
+  log_acceptance_ratio -= lgamma_size[size_old_ci];
+  log_acceptance_ratio -= lgamma_size[size_old_cj];
 
   return log_acceptance_ratio;
 }
+
+double DP::log_prior() const {
+  int K = 0, n = 0;
+  double log_prior = 0.0;
+  for (int k = 0; k < data.get_K(); ++k) {
+    const int cluster_size = data.get_cluster_size(k);
+    if (cluster_size == 0)
+      continue; // Free slot of lazy compaction
+    log_prior += lgamma_size[cluster_size];
+    ++K;
+    n += cluster_size;
+  }
+  return log_prior + K * log_a + std::lgamma(params.a) - std::lgamma(params.a + n);
+}
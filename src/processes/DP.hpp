@@ -24,7 +24,7 @@ public:
    * @param d Reference to the data object.
    * @param p Reference to the parameters object.
    */
-  DP(Data &d, Params &p) : Process(d, p) {};
+  DP(Data &d, Params &p) : Process(d, p) { refresh_tables(0.0); };
 
   /**
    * @name Gibbs Sampling Methods
@@ -51,6 +51,15 @@ public:
   [[nodiscard]] Eigen::VectorXd
   gibbs_prior_existing_clusters(int obs_idx) const override;
 
+  /**
+   * @brief Writes the log prior probabilities of assigning a data point to
+   * all existing clusters into out (K entries), without allocating.
+   * @param obs_idx The index of the observation.
+   * @param out Output buffer, overwritten.
+   */
+  void gibbs_prior_existing_clusters(int obs_idx,
+                                     Eigen::Ref<Eigen::VectorXd> out) const override;
+
   /**
    * @brief Computes the log prior probability of assigning a data point to a
    * new cluster.
@@ -99,11 +108,19 @@ public:
 
   /** @} */
 
+  /**
+   * @brief Log EPPF of the current partition under the Dirichlet Process.
+   * @return K log(a) + sum_k lgamma(n_k) + lgamma(a) - lgamma(a + n).
+   */
+  [[nodiscard]] double log_prior() const override;
+
+  [[nodiscard]] bool has_log_prior() const override { return true; }
+
   /**
    * @brief Updates the parameters of the Dirichlet Process.
    *
-   * This is a null implementation as the Dirichlet Process has no parameters to
-   * update.
+   * The Dirichlet Process has no parameters to sample; this only refreshes
+   * log(a) and the shared size tables in case the parameters changed.
    */
-  void update_params() override { return; };
+  void update_params() override { refresh_tables(0.0); };
 };
\ No newline at end of file
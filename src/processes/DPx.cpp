@@ -25,18 +25,25 @@ Eigen::VectorXd DPx::gibbs_prior_existing_clusters(int obs_idx) const {
      * @return A vector of log prior probabilities for assigning the data point to
      * each existing cluster.
      */
+    Eigen::VectorXd log_prior(data.get_K());
+    DPx::gibbs_prior_existing_clusters(obs_idx, log_prior);
+    return log_prior;
+}
+
+void DPx::gibbs_prior_existing_clusters(int obs_idx, Eigen::Ref<Eigen::VectorXd> out) const {
+    PROFILE_SCOPE(GibbsPriorExistingClusters);
 
     // Get DP gibbs prior for existing clusters
-    Eigen::VectorXd log_prior = DP::gibbs_prior_existing_clusters(obs_idx);
+    DP::gibbs_prior_existing_clusters(obs_idx, out);
 
     // Add covariate module contributions
     for (auto &mod : modules) {
-        log_prior += mod->compute_similarity_obs(obs_idx);
+        mod->add_similarity_obs(obs_idx, out);
     }
-    return log_prior;
 }
 
 double DPx::gibbs_prior_existing_cluster(int cls_idx, int obs_idx) const {
+    PROFILE_SCOPE(GibbsPriorExistingCluster);
     double prior = DP::gibbs_prior_existing_cluster(cls_idx, obs_idx);
     // Add covariate module contribution
     for (auto &mod : modules) {
@@ -49,6 +56,7 @@ double DPx::gibbs_prior_existing_cluster(int cls_idx, int obs_idx) const {
 double DPx::gibbs_prior_new_cluster() const { return DP::gibbs_prior_new_cluster(); }
 
 double DPx::gibbs_prior_new_cluster_obs(int obs_idx) const {
+    PROFILE_SCOPE(GibbsPriorNewCluster);
     double log_prior = DP::gibbs_prior_new_cluster();
 
     // add covariate module contributions
@@ -68,13 +76,14 @@ double DPx::prior_ratio_split(int ci, int cj) const {
      * @param cj The second cluster index involved in the split.
      * @return The log prior ratio for the split operation.
      */
+    PROFILE_SCOPE(PriorRatioSplit);
 
     double log_acceptance_ratio = DP::prior_ratio_split(ci, cj);
 
-    for (auto &mod : modules) {
-        log_acceptance_ratio += mod->compute_similarity_cls(ci, false);
-        log_acceptance_ratio += mod->compute_similarity_cls(cj, false);
-        log_acceptance_ratio -= mod->compute_similarity_cls(ci, true);
+    for (std::size_t m = 0; m < modules.size(); ++m) {
+        log_acceptance_ratio += modules[m]->compute_similarity_cls(ci, false);
+        log_acceptance_ratio += modules[m]->compute_similarity_cls(cj, false);
+        log_acceptance_ratio -= old_similarity(m, ci);
     }
 
     return log_acceptance_ratio;
@@ -90,20 +99,21 @@ double DPx::prior_ratio_merge(int size_old_ci, int size_old_cj) const {
      * @param size_old_cj The size of the second cluster before the merge.
      * @return The log prior ratio for the merge operation.
      */
+    PROFILE_SCOPE(PriorRatioMerge);
 
     // DP prior part
     double log_acceptance_ratio = DP::prior_ratio_merge(size_old_ci, size_old_cj);
     // Spatial part
-    const int old_ci = old_allocations[idx_i];
-    const int old_cj = old_allocations[idx_j];
+    const int old_ci = this->old_ci();
+    const int old_cj = this->old_cj();
     for (auto &mod : modules) {
         log_acceptance_ratio += mod->compute_similarity_cls(old_ci, false);
         log_acceptance_ratio += mod->compute_similarity_cls(old_cj, false);
     }
 
     const int new_ci = data.get_allocations()[idx_i];
-    for (auto &mod : modules) {
-        log_acceptance_ratio -= mod->compute_similarity_cls(new_ci, true);
+    for (std::size_t m = 0; m < modules.size(); ++m) {
+        log_acceptance_ratio -= old_similarity(m, new_ci);
     }
     return log_acceptance_ratio;
 }
@@ -121,16 +131,28 @@ double DPx::prior_ratio_shuffle(int size_old_ci, int size_old_cj, int ci, int cj
      * @param cj The second cluster index involved in the shuffle.
      * @return The log prior ratio for the shuffle operation.
      */
+    PROFILE_SCOPE(PriorRatioShuffle);
 
     // DP prior part
     double log_acceptance_ratio = DP::prior_ratio_shuffle(size_old_ci, size_old_cj, ci, cj);
 
-    for (auto &mod : modules) {
-        log_acceptance_ratio += mod->compute_similarity_cls(old_allocations[idx_i], false);
-        log_acceptance_ratio += mod->compute_similarity_cls(old_allocations[idx_j], false);
-        log_acceptance_ratio -= mod->compute_similarity_cls(data.get_allocations()[idx_i], true);
-        log_acceptance_ratio -= mod->compute_similarity_cls(data.get_allocations()[idx_j], true);
+    for (std::size_t m = 0; m < modules.size(); ++m) {
+        log_acceptance_ratio += modules[m]->compute_similarity_cls(old_ci(), false);
+        log_acceptance_ratio += modules[m]->compute_similarity_cls(old_cj(), false);
+        log_acceptance_ratio -= old_similarity(m, data.get_allocations()[idx_i]);
+        log_acceptance_ratio -= old_similarity(m, data.get_allocations()[idx_j]);
     }
 
     return log_acceptance_ratio;
 }
+
+double DPx::log_prior() const {
+    double log_prior = DP::log_prior();
+    for (int k = 0; k < data.get_K(); ++k) {
+        if (data.get_cluster_size(k) == 0)
+            continue; // Free slot of lazy compaction
+        for (const auto &mod : modules)
+            log_prior += mod->compute_similarity_cls(k, false);
+    }
+    return log_prior;
+}
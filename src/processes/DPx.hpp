@@ -29,6 +29,36 @@ class DPx : public DP {
 protected:
     std::vector<std::shared_ptr<Module>> modules;
 
+    /** @brief Similarities of the pair before the proposal, valid when old_state_snapshot is set */
+    SimilaritySnapshot snapshot;
+
+    /**
+     * @brief Stores the clusters of the pair and their similarities, so the prior ratios need no
+     * copy of the old allocations and cluster members
+     * @return True if any module is attached
+     */
+    bool snapshot_old_state() override {
+        if (modules.empty())
+            return false;
+        snapshot.take(modules, data.get_allocations()[idx_i], data.get_allocations()[idx_j]);
+        return true;
+    }
+
+    /** @brief Cluster of the first observation of the pair before the proposal */
+    [[nodiscard]] int old_ci() const { return old_state_snapshot ? snapshot.old_ci() : old_allocations[idx_i]; }
+
+    /** @brief Cluster of the second observation of the pair before the proposal */
+    [[nodiscard]] int old_cj() const { return old_state_snapshot ? snapshot.old_cj() : old_allocations[idx_j]; }
+
+    /**
+     * @brief Similarity of a cluster of the pair before the proposal, for module m
+     * @details A lookup in the snapshot if the proposal took one, otherwise
+     * compute_similarity_cls(c, true) on the copies of the old state.
+     */
+    [[nodiscard]] double old_similarity(std::size_t m, int c) const {
+        return old_state_snapshot ? snapshot.old_similarity(m, c) : modules[m]->compute_similarity_cls(c, true);
+    }
+
 public:
     /**
      * @brief Constructor for the Dirichlet Process with modules.
@@ -45,6 +75,23 @@ public:
         }
     }
 
+    /**
+     * @brief The modules compare the clusters with their state before the proposal
+     * @return True if any module is attached
+     */
+    [[nodiscard]] bool uses_old_state() const override { return !modules.empty(); }
+
+    /**
+     * @brief Gets the modules
+     * @return The modules whose similarities enter the prior
+     */
+    const std::vector<std::shared_ptr<Module>> &get_modules() const { return modules; }
+
+    /**
+     * @brief Heap bytes of the old state and of the module list (the modules report their own)
+     */
+    std::size_t memory_bytes() const override { return Process::memory_bytes() + MemoryReport::bytes(modules); }
+
     /**
      * @name Gibbs Sampling Methods
      * @{
@@ -72,6 +119,14 @@ public:
      */
     [[nodiscard]] Eigen::VectorXd gibbs_prior_existing_clusters(int obs_idx) const override;
 
+    /**
+     * @brief Writes the log prior probabilities of every existing cluster into out (K entries):
+     * the DP prior, then each module's similarities added in place (Module::add_similarity_obs()).
+     * @param obs_idx The index of the observation to assign.
+     * @param out Output buffer, overwritten.
+     */
+    void gibbs_prior_existing_clusters(int obs_idx, Eigen::Ref<Eigen::VectorXd> out) const override;
+
     /**
      * @brief Computes the log prior probability of assigning a data point to a
      * new cluster.
@@ -137,11 +192,17 @@ public:
 
     /** @} */
 
+    /**
+     * @brief Log prior of the current partition: that of DP plus the similarity of every
+     * non-empty cluster in every module, the terms the Gibbs priors and prior ratios are built from.
+     */
+    [[nodiscard]] double log_prior() const override;
+
     /**
      * @brief Updates the module-based parameters.
      *
-     * This is a null implementation as DPx has no parameters to update beyond
-     * those handled by the base Process class.
+     * DPx has no parameters to sample; this only refreshes log(a) and the
+     * shared size tables in case the parameters changed.
      */
-    void update_params() override { return; };
+    void update_params() override { refresh_tables(0.0); };
 };
\ No newline at end of file
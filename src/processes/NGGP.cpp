@@ -26,9 +26,10 @@ double NGGP::gibbs_prior_existing_cluster(int cls_idx, int obs_idx) const {
    * @return The log prior probability of assigning the data point to the
    * existing cluster.
    */
+  PROFILE_SCOPE(GibbsPriorExistingCluster);
 
   int cluster_size = data.get_cluster_size(cls_idx);
-  return (cluster_size - params.sigma > 0) ? log(cluster_size - params.sigma) : std::numeric_limits<double>::lowest();
+  return (cluster_size - params.sigma > 0) ? log_size[cluster_size] : std::numeric_limits<double>::lowest();
 }
 
 Eigen::VectorXd NGGP::gibbs_prior_existing_clusters(int obs_idx) const {
@@ -42,18 +43,22 @@ Eigen::VectorXd NGGP::gibbs_prior_existing_clusters(int obs_idx) const {
    * @return A vector of log prior probabilities for assigning the data point to
    * each existing cluster.
    */
+  Eigen::VectorXd priors(data.get_K());
+  NGGP::gibbs_prior_existing_clusters(obs_idx, priors);
+  return priors;
+}
 
-  Eigen::VectorXd priors = Eigen::VectorXd::Zero(data.get_K());
+void NGGP::gibbs_prior_existing_clusters(int obs_idx,
+                                         Eigen::Ref<Eigen::VectorXd> out) const {
+  PROFILE_SCOPE(GibbsPriorExistingClusters);
 
   // Compute prior for each existing cluster
   for (int k = 0; k < data.get_K(); ++k) {
     const int cluster_size = data.get_cluster_size(k);
-    double prior = cluster_size  - params.sigma > 0 ? log(cluster_size - params.sigma)
+    double prior = cluster_size  - params.sigma > 0 ? log_size[cluster_size]
                                     : std::numeric_limits<double>::lowest();
-    priors(k) = prior;
+    out(k) = prior;
   }
-
-  return priors;
 }
 
 double NGGP::gibbs_prior_new_cluster() const {
@@ -66,6 +71,7 @@ double NGGP::gibbs_prior_new_cluster() const {
    * @return The log prior probability of assigning the data point to a new
    * cluster.
    */
+  PROFILE_SCOPE(GibbsPriorNewCluster);
   return log_a + params.sigma * log(params.tau + U_sampler_method.get_U());
 }
 
@@ -80,6 +86,7 @@ double NGGP::prior_ratio_split(int ci, int cj) const {
    * @param cj The second cluster index involved in the split.
    * @return The log prior ratio for the split operation.
    */
+  PROFILE_SCOPE(PriorRatioSplit);
 
   const int n_ci = data.get_cluster_size(ci);
   const int n_cj = data.get_cluster_size(cj);
@@ -87,9 +94,9 @@ double NGGP::prior_ratio_split(int ci, int cj) const {
   double log_acceptance_ratio = 0.0;
   log_acceptance_ratio += log_a;
   log_acceptance_ratio += params.sigma * log(params.tau + U_sampler_method.get_U());
-  log_acceptance_ratio -= n_ci + n_cj - params.sigma > 0 ? lgamma(n_ci + n_cj - params.sigma) : 0;
-  log_acceptance_ratio += n_ci - params.sigma > 0 ? lgamma(n_ci - params.sigma) : 0;
-  log_acceptance_ratio += n_cj - params.sigma > 0 ? lgamma(n_cj - params.sigma) : 0;
+  log_acceptance_ratio -= n_ci + n_cj - params.sigma > 0 ? lgamma_size[n_ci + n_cj] : 0;
+  log_acceptance_ratio += n_ci - params.sigma > 0 ? lgamma_size[n_ci] : 0;
+  log_acceptance_ratio += n_cj - params.sigma > 0 ? lgamma_size[n_cj] : 0;
 
   return log_acceptance_ratio;
 }
@@ -105,14 +112,15 @@ double NGGP::prior_ratio_merge(int size_old_ci, int size_old_cj) const {
    * @param size_old_cj The size of the second cluster before the merge.
    * @return The log prior ratio for the merge operation.
    */
+  PROFILE_SCOPE(PriorRatioMerge);
 
   const int size_merge = size_old_ci + size_old_cj;
 
   double log_acceptance_ratio = -log_a;
   log_acceptance_ratio -= params.sigma * log(params.tau + U_sampler_method.get_U());
-  log_acceptance_ratio += size_merge - params.sigma > 0 ? lgamma(size_merge - params.sigma) : 0;
-  log_acceptance_ratio -= size_old_ci - params.sigma > 0 ? lgamma(size_old_ci - params.sigma) : 0;
-  log_acceptance_ratio -= size_old_cj - params.sigma > 0 ? lgamma(size_old_cj - params.sigma) : 0;
+  log_acceptance_ratio += size_merge - params.sigma > 0 ? lgamma_size[size_merge] : 0;
+  log_acceptance_ratio -= size_old_ci - params.sigma > 0 ? lgamma_size[size_old_ci] : 0;
+  log_acceptance_ratio -= size_old_cj - params.sigma > 0 ? lgamma_size[size_old_cj] : 0;
 
   return log_acceptance_ratio;
 }
@@ -131,15 +139,35 @@ double NGGP::prior_ratio_shuffle(int size_old_ci, int size_old_cj, int ci,
    * @param cj The second cluster index involved in the shuffle.
    * @return The log prior ratio for the shuffle operation.
    */
+  PROFILE_SCOPE(PriorRatioShuffle);
 
   const int n_ci = data.get_cluster_size(ci);
   const int n_cj = data.get_cluster_size(cj);
 
   double log_acceptance_ratio = 0.0;
-  log_acceptance_ratio += n_ci - params.sigma > 0 ? lgamma(n_ci - params.sigma) : 0;
-  log_acceptance_ratio += n_cj - params.sigma > 0 ? lgamma(n_cj - params.sigma) : 0;
-  log_acceptance_ratio -= size_old_ci - params.sigma > 0 ? lgamma(size_old_ci - params.sigma) : 0;
-  log_acceptance_ratio -= size_old_cj - params.sigma > 0 ? lgamma(size_old_cj - params.sigma) : 0;
+  log_acceptance_ratio += n_ci - params.sigma > 0 ? lgamma_size[n_ci] : 0;
+  log_acceptance_ratio += n_cj - params.sigma > 0 ? lgamma_size[n_cj] : 0;
+  log_acceptance_ratio -= size_old_ci - params.sigma > 0 ? lgamma_size[size_old_ci] : 0;
+  log_acceptance_ratio -= size_old_cj - params.sigma > 0 ? lgamma_size[size_old_cj] : 0;
 
   return log_acceptance_ratio;
-}
\ No newline at end of file
+}
+
+double NGGP::log_prior() const {
+  int K = 0, n = 0;
+  double log_prior = 0.0;
+  for (int k = 0; k < data.get_K(); ++k) {
+    const int cluster_size = data.get_cluster_size(k);
+    if (cluster_size == 0)
+      continue; // Free slot of lazy compaction
+    log_prior += lgamma_size[cluster_size] - lgamma_size[1];
+    ++K;
+    n += cluster_size;
+  }
+
+  const double U = U_sampler_method.get_U();
+  const double log_tau_U = std::log(params.tau + U);
+  log_prior += K * log_a + (n - 1) * std::log(U) - std::lgamma(n) - (n - params.sigma * K) * log_tau_U;
+  log_prior -= params.a / params.sigma * (std::pow(params.tau + U, params.sigma) - std::pow(params.tau, params.sigma));
+  return log_prior;
+}
@@ -38,19 +38,6 @@ protected:
   U_sampler &U_sampler_method;
   /** @} */
 
-  /**
-   * @name Random Number Generation
-   * @{
-   */
-
-  /** @brief Random device for seeding. */
-  std::random_device rd;
-
-  /** @brief Mersenne Twister random number generator. */
-  mutable std::mt19937 gen;
-
-  /** @} */
-
 public:
   /**
    * @brief Constructor for the Normalized Generalized Gamma Process.
@@ -62,7 +49,9 @@ public:
    * updating the latent variable U via MCMC.
    */
   NGGP(Data &d, Params &p, U_sampler &mh)
-      : Process(d, p), gen(rd()), U_sampler_method(mh) {};
+      : Process(d, p), U_sampler_method(mh) {
+    refresh_tables(params.sigma);
+  };
 
   /**
    * @name Gibbs Sampling Methods
@@ -96,6 +85,15 @@ public:
   [[nodiscard]] Eigen::VectorXd
   gibbs_prior_existing_clusters(int obs_idx) const override;
 
+  /**
+   * @brief Writes the log prior probabilities of assigning a data point to
+   * all existing clusters into out (K entries), without allocating.
+   * @param obs_idx The index of the observation.
+   * @param out Output buffer, overwritten.
+   */
+  void gibbs_prior_existing_clusters(int obs_idx,
+                                     Eigen::Ref<Eigen::VectorXd> out) const override;
+
   /**
    * @brief Computes the log prior probability of assigning a data point to a
    * new cluster.
@@ -156,6 +154,17 @@ public:
 
   /** @} */
 
+  /**
+   * @brief Joint log density of the current partition and of U under the NGGP.
+   *
+   * log p(z, U) = (n - 1) log(U) - lgamma(n) - (a / sigma) ((tau + U)^sigma - tau^sigma)
+   *   + sum_k [log(a) + lgamma(n_k - sigma) - lgamma(1 - sigma) + (sigma - n_k) log(tau + U)],
+   * whose U terms are the conditional density the U samplers target.
+   */
+  [[nodiscard]] double log_prior() const override;
+
+  [[nodiscard]] bool has_log_prior() const override { return true; }
+
   /**
    * @name Parameter Update Methods
    * @{
@@ -166,11 +175,15 @@ public:
    *
    * This method delegates the update to the U_sampler instance, which uses
    * an MCMC algorithm (RWMH or MALA) to sample U from its conditional
-   * distribution given the current partition.
+   * distribution given the current partition. The shared size tables are
+   * rebuilt if sigma changed.
    *
-   * @see U_sampler::update_U(), RWMH::update_U(), MALA::update_U()
+   * @see U_sampler::update(), RWMH::update_U(), MALA::update_U(), Slice::update_U()
    */
-  void update_params() override { U_sampler_method.update_U(); };
+  void update_params() override {
+    U_sampler_method.update();
+    refresh_tables(params.sigma);
+  };
 
   /** @} */
 };
\ No newline at end of file
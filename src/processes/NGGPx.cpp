@@ -13,6 +13,7 @@
 #include "./NGGPx.hpp"
 
 double NGGPx::gibbs_prior_existing_cluster(int cls_idx, int obs_idx) const {
+    PROFILE_SCOPE(GibbsPriorExistingCluster);
 
     // NGGP gibbs prior for existing cluster
     double log_prior = NGGP::gibbs_prior_existing_cluster(cls_idx, obs_idx);
@@ -26,20 +27,27 @@ double NGGPx::gibbs_prior_existing_cluster(int cls_idx, int obs_idx) const {
 }
 
 Eigen::VectorXd NGGPx::gibbs_prior_existing_clusters(int obs_idx) const {
+    Eigen::VectorXd log_prior(data.get_K());
+    NGGPx::gibbs_prior_existing_clusters(obs_idx, log_prior);
+    return log_prior;
+}
+
+void NGGPx::gibbs_prior_existing_clusters(int obs_idx, Eigen::Ref<Eigen::VectorXd> out) const {
+    PROFILE_SCOPE(GibbsPriorExistingClusters);
 
     // Get NGGP gibbs prior for existing clusters
-    Eigen::VectorXd log_prior = NGGP::gibbs_prior_existing_clusters(obs_idx);
+    NGGP::gibbs_prior_existing_clusters(obs_idx, out);
 
     // Add module-based similarity contributions
     for (auto &mod : modules) {
-        log_prior += mod->compute_similarity_obs(obs_idx);
+        mod->add_similarity_obs(obs_idx, out);
     }
-    return log_prior;
 }
 
 double NGGPx::gibbs_prior_new_cluster() const { return NGGP::gibbs_prior_new_cluster(); }
 
 double NGGPx::gibbs_prior_new_cluster_obs(int obs_idx) const {
+    PROFILE_SCOPE(GibbsPriorNewCluster);
     double log_prior = NGGP::gibbs_prior_new_cluster();
 
     // add module-based similarity contributions
@@ -50,25 +58,27 @@ double NGGPx::gibbs_prior_new_cluster_obs(int obs_idx) const {
 }
 
 double NGGPx::prior_ratio_split(int ci, int cj) const {
+    PROFILE_SCOPE(PriorRatioSplit);
     // NGGP prior ratio for split
     double log_prior_ratio = NGGP::prior_ratio_split(ci, cj);
 
     // Module-based similarity ratio: sim(new ci) + sim(new cj) - sim(old merged ci)
-    for (auto &mod : modules) {
-        log_prior_ratio += mod->compute_similarity_cls(ci, false);
-        log_prior_ratio += mod->compute_similarity_cls(cj, false);
-        log_prior_ratio -= mod->compute_similarity_cls(ci, true);
+    for (std::size_t m = 0; m < modules.size(); ++m) {
+        log_prior_ratio += modules[m]->compute_similarity_cls(ci, false);
+        log_prior_ratio += modules[m]->compute_similarity_cls(cj, false);
+        log_prior_ratio -= old_similarity(m, ci);
     }
     return log_prior_ratio;
 }
 
 double NGGPx::prior_ratio_merge(int size_old_ci, int size_old_cj) const {
+    PROFILE_SCOPE(PriorRatioMerge);
     // NGGP prior ratio for merge
     double log_prior_ratio = NGGP::prior_ratio_merge(size_old_ci, size_old_cj);
 
     // Add module-based similarity contributions
-    const int old_ci = old_allocations[idx_i];
-    const int old_cj = old_allocations[idx_j];
+    const int old_ci = this->old_ci();
+    const int old_cj = this->old_cj();
 
     for (auto &mod : modules) {
         log_prior_ratio += mod->compute_similarity_cls(old_ci, false);
@@ -76,20 +86,21 @@ double NGGPx::prior_ratio_merge(int size_old_ci, int size_old_cj) const {
     }
 
     const int new_ci = NGGP::data.get_allocations()[idx_i];
-    for (auto &mod : modules) {
-        log_prior_ratio -= mod->compute_similarity_cls(new_ci, true);
+    for (std::size_t m = 0; m < modules.size(); ++m) {
+        log_prior_ratio -= old_similarity(m, new_ci);
     }
 
     return log_prior_ratio;
 }
 
 double NGGPx::prior_ratio_shuffle(int size_old_ci, int size_old_cj, int ci, int cj) const {
+    PROFILE_SCOPE(PriorRatioShuffle);
     // NGGP prior ratio for shuffle
     double log_prior_ratio = NGGP::prior_ratio_shuffle(size_old_ci, size_old_cj, ci, cj);
 
     // Add module-based similarity contributions
-    const int old_ci = old_allocations[idx_i];
-    const int old_cj = old_allocations[idx_j];
+    const int old_ci = this->old_ci();
+    const int old_cj = this->old_cj();
 
     for (auto &mod : modules) {
         log_prior_ratio += mod->compute_similarity_cls(old_ci, false);
@@ -98,10 +109,21 @@ double NGGPx::prior_ratio_shuffle(int size_old_ci, int size_old_cj, int ci, int
 
     const int new_ci = NGGP::data.get_allocations()[idx_i];
     const int new_cj = NGGP::data.get_allocations()[idx_j];
-    for (auto &mod : modules) {
-        log_prior_ratio -= mod->compute_similarity_cls(new_ci, true);
-        log_prior_ratio -= mod->compute_similarity_cls(new_cj, true);
+    for (std::size_t m = 0; m < modules.size(); ++m) {
+        log_prior_ratio -= old_similarity(m, new_ci);
+        log_prior_ratio -= old_similarity(m, new_cj);
     }
 
     return log_prior_ratio;
 }
+
+double NGGPx::log_prior() const {
+    double log_prior = NGGP::log_prior();
+    for (int k = 0; k < data.get_K(); ++k) {
+        if (data.get_cluster_size(k) == 0)
+            continue; // Free slot of lazy compaction
+        for (const auto &mod : modules)
+            log_prior += mod->compute_similarity_cls(k, false);
+    }
+    return log_prior;
+}
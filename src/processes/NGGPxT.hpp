@@ -0,0 +1,143 @@
+/**
+ * @file NGGPxT.hpp
+ * @brief Normalized Generalized Gamma Process with a list of module types fixed at compile time
+ *
+ * @author Filippo Galli
+ * @date 2025
+ */
+
+#pragma once
+
+#include "../utils/ModulePack.hpp"
+#include "NGGPx.hpp"
+
+/**
+ * @class NGGPxT
+ * @brief NGGPx whose modules have concrete types fixed at compile time
+ *
+ * Same prior as NGGPx with the same modules, but the module contributions are summed by folding over
+ * a ModulePack instead of looping over std::vector<shared_ptr<Module>>: every similarity call is a
+ * direct call to the concrete module, with no virtual dispatch. The terms are added in the same
+ * order as in NGGPx, so the two give bit-identical priors and ratios.
+ *
+ * The class is final, so the calls of the samplers through an NGGPxT pointer can also be devirtualized.
+ * NGGPx stays the fallback for any other combination of modules.
+ *
+ * @tparam Mods Concrete module types, in the order of the modules
+ * @see NGGPx, ModulePack
+ */
+template <typename... Mods> class NGGPxT final : public NGGPx {
+
+private:
+    ModulePack<Mods...> static_modules; ///< The modules, with their concrete types
+
+    /** @brief Old similarity of cluster c for the m-th module, see NGGPx::old_similarity() */
+    template <typename M> double old_similarity(const StaticModule<M> &mod, std::size_t m, int c) const {
+        return old_state_snapshot ? snapshot.old_similarity(m, c) : mod.cls(c, true);
+    }
+
+public:
+    /**
+     * @brief Constructor
+     * @param d Reference to the data object
+     * @param p Reference to the parameters object
+     * @param U_sam Sampler of the latent variable U
+     * @param mods Modules, of exactly the types Mods in order
+     * @throws std::invalid_argument if the modules do not have the types Mods
+     */
+    NGGPxT(Data &d, Params &p, U_sampler &U_sam, const std::vector<std::shared_ptr<Module>> &mods)
+        : NGGPx(d, p, U_sam, mods), static_modules(mods) {}
+
+    /**
+     * @name Gibbs Sampling Methods
+     * @{
+     */
+
+    /** @brief See NGGPx::gibbs_prior_existing_cluster() */
+    [[nodiscard]] double gibbs_prior_existing_cluster(int cls_idx, int obs_idx = 0) const override {
+        PROFILE_SCOPE(GibbsPriorExistingCluster);
+        double prior = NGGP::gibbs_prior_existing_cluster(cls_idx, obs_idx);
+        static_modules.for_each([&](auto mod) { prior += mod.obs(obs_idx, cls_idx); });
+        return prior;
+    }
+
+    /** @brief See NGGPx::gibbs_prior_existing_clusters() */
+    [[nodiscard]] Eigen::VectorXd gibbs_prior_existing_clusters(int obs_idx) const override {
+        Eigen::VectorXd log_prior(data.get_K());
+        gibbs_prior_existing_clusters(obs_idx, log_prior);
+        return log_prior;
+    }
+
+    /** @brief See NGGPx::gibbs_prior_existing_clusters(int, Eigen::Ref<Eigen::VectorXd>) */
+    void gibbs_prior_existing_clusters(int obs_idx, Eigen::Ref<Eigen::VectorXd> out) const override {
+        PROFILE_SCOPE(GibbsPriorExistingClusters);
+        NGGP::gibbs_prior_existing_clusters(obs_idx, out);
+        static_modules.for_each([&](auto mod) { mod.add_obs(obs_idx, out); });
+    }
+
+    /** @brief See NGGPx::gibbs_prior_new_cluster_obs() */
+    [[nodiscard]] double gibbs_prior_new_cluster_obs(int obs_idx) const override {
+        PROFILE_SCOPE(GibbsPriorNewCluster);
+        double log_prior = NGGP::gibbs_prior_new_cluster();
+        static_modules.for_each([&](auto mod) { log_prior += mod.obs(obs_idx, -1); });
+        return log_prior;
+    }
+
+    /** @} */
+
+    /**
+     * @name Split-Merge Algorithm Methods
+     * @{
+     */
+
+    /** @brief See NGGPx::prior_ratio_split() */
+    [[nodiscard]] double prior_ratio_split(int ci, int cj) const override {
+        PROFILE_SCOPE(PriorRatioSplit);
+        double log_prior_ratio = NGGP::prior_ratio_split(ci, cj);
+        std::size_t m = 0;
+        static_modules.for_each([&](auto mod) {
+            log_prior_ratio += mod.cls(ci, false);
+            log_prior_ratio += mod.cls(cj, false);
+            log_prior_ratio -= old_similarity(mod, m++, ci);
+        });
+        return log_prior_ratio;
+    }
+
+    /** @brief See NGGPx::prior_ratio_merge() */
+    [[nodiscard]] double prior_ratio_merge(int size_old_ci, int size_old_cj) const override {
+        PROFILE_SCOPE(PriorRatioMerge);
+        double log_prior_ratio = NGGP::prior_ratio_merge(size_old_ci, size_old_cj);
+        const int old_ci = this->old_ci();
+        const int old_cj = this->old_cj();
+        static_modules.for_each([&](auto mod) {
+            log_prior_ratio += mod.cls(old_ci, false);
+            log_prior_ratio += mod.cls(old_cj, false);
+        });
+        const int new_ci = NGGP::data.get_allocations()[idx_i];
+        std::size_t m = 0;
+        static_modules.for_each([&](auto mod) { log_prior_ratio -= old_similarity(mod, m++, new_ci); });
+        return log_prior_ratio;
+    }
+
+    /** @brief See NGGPx::prior_ratio_shuffle() */
+    [[nodiscard]] double prior_ratio_shuffle(int size_old_ci, int size_old_cj, int ci, int cj) const override {
+        PROFILE_SCOPE(PriorRatioShuffle);
+        double log_prior_ratio = NGGP::prior_ratio_shuffle(size_old_ci, size_old_cj, ci, cj);
+        const int old_ci = this->old_ci();
+        const int old_cj = this->old_cj();
+        static_modules.for_each([&](auto mod) {
+            log_prior_ratio += mod.cls(old_ci, false);
+            log_prior_ratio += mod.cls(old_cj, false);
+        });
+        const int new_ci = NGGP::data.get_allocations()[idx_i];
+        const int new_cj = NGGP::data.get_allocations()[idx_j];
+        std::size_t m = 0;
+        static_modules.for_each([&](auto mod) {
+            log_prior_ratio -= old_similarity(mod, m, new_ci);
+            log_prior_ratio -= old_similarity(mod, m++, new_cj);
+        });
+        return log_prior_ratio;
+    }
+
+    /** @} */
+};
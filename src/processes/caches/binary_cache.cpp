@@ -44,4 +44,12 @@ void BinaryCache::set_allocation(int index, int cluster, int old_cluster) {
         stats.n++;
         stats.binary_sum += binary_covariates(index);
     }
-}
\ No newline at end of file
+}
+
+void BinaryCache::merge_clusters(int from_cluster, int to_cluster, const std::vector<int> &) {
+    ClusterStats &from_stats = cluster_stats[from_cluster];
+    ClusterStats &to_stats = cluster_stats[to_cluster];
+    to_stats.n += from_stats.n;
+    to_stats.binary_sum += from_stats.binary_sum;
+    from_stats = ClusterStats();
+}
@@ -51,6 +51,9 @@ public:
      */
     void set_allocation(int index, int cluster, int old_cluster) override;
 
+    /** @brief Adds the statistics of from_cluster to to_cluster in O(1) */
+    void merge_clusters(int from_cluster, int to_cluster, const std::vector<int> &moved) override;
+
     /**
      * @brief Get cluster statistics for a specific cluster
      * @param cluster Index of the cluster
@@ -92,4 +95,12 @@ public:
             cluster_stats.erase(cluster_stats.begin() + cluster);
         }
     }
+
+    /**
+     * @brief Heap bytes of the cluster statistics and the copy of the covariate
+     * @see MemoryReport
+     */
+    std::size_t memory_bytes() const override {
+        return MemoryReport::bytes(cluster_stats) + MemoryReport::bytes(binary_covariates);
+    }
 };
\ No newline at end of file
@@ -0,0 +1,55 @@
+/**
+ * @file categorical_cache.cpp
+ * @brief Implementation of `CategoricalCache`.
+ */
+
+#include "categorical_cache.hpp"
+
+void CategoricalCache::recompute(const int K, const Eigen::VectorXi &allocations_in) {
+    // Clear existing stats
+    cluster_stats.clear();
+
+    // Resize to number of clusters
+    cluster_stats.resize(K);
+
+    // Compute stats
+    for (int i = 0; i < allocations_in.size(); ++i) {
+        int cluster = allocations_in(i);
+        if (cluster < 0)
+            continue;
+
+        update_stats(cluster_stats[cluster], i, +1);
+    }
+}
+
+void CategoricalCache::set_allocation(int index, int cluster, int old_cluster) {
+
+    // Remove from old cluster
+    if (old_cluster != -1) {
+        update_stats(cluster_stats[old_cluster], index, -1);
+    }
+
+    // Add to new cluster
+    if (cluster != -1) {
+
+        if (cluster >= static_cast<int>(cluster_stats.size())) {
+            cluster_stats.resize(cluster + 1);
+        }
+
+        update_stats(cluster_stats[cluster], index, +1);
+    }
+}
+
+void CategoricalCache::merge_clusters(int from_cluster, int to_cluster, const std::vector<int> &) {
+    ClusterStats &from_stats = cluster_stats[from_cluster];
+    ClusterStats &to_stats = cluster_stats[to_cluster];
+    if (to_stats.category_counts.empty())
+        to_stats.category_counts.assign(num_categories, 0);
+    if (!from_stats.category_counts.empty()) {
+        for (int c = 0; c < num_categories; ++c)
+            to_stats.category_counts[c] += from_stats.category_counts[c];
+    }
+    to_stats.n += from_stats.n;
+    from_stats.n = 0;
+    std::fill(from_stats.category_counts.begin(), from_stats.category_counts.end(), 0);
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+/**
+ * @file categorical_cache.hpp
+ * @brief Cache for spatial model with categorical covariates.
+ */
+
+#include "../../utils/ClusterInfo.hpp"
+#include <algorithm>
+#include <vector>
+
+/**
+ * @class CategoricalCache
+ * @brief Cache for spatial model with categorical covariates.
+ * @details This class maintains, for every cluster, the number of members and the number of members in each
+ * category, so that the categorical covariate module reads them in O(1) instead of scanning the members.
+ * Categories are the integers 0, ..., C - 1; negative values are treated as missing and not counted.
+ */
+
+class CategoricalCache : public ClusterInfo {
+public:
+    /**
+     * @struct ClusterStats
+     * @brief Structure to hold statistics for each cluster.
+     * @details Contains the count of observations in the cluster and the count of each category among them.
+     */
+    struct ClusterStats {
+        std::vector<int> category_counts;
+        int n = 0;
+    };
+
+private:
+    std::vector<ClusterStats> cluster_stats;
+    const Eigen::VectorXi &allocations;
+
+    /**
+     * @brief Adds (sign = +1) or removes (sign = -1) a point from the statistics of a cluster
+     * @param stats Statistics of the cluster
+     * @param index Index of the point
+     * @param sign +1 or -1
+     */
+    inline void update_stats(ClusterStats &stats, int index, int sign) {
+        if (stats.category_counts.empty())
+            stats.category_counts.assign(num_categories, 0);
+        stats.n += sign;
+        const int category = categorical_covariates(index);
+        if (category >= 0)
+            stats.category_counts[category] += sign;
+    }
+
+public:
+    const Eigen::VectorXi categorical_covariates;
+    const int num_categories; ///< Number of categories C (largest covariate value + 1)
+
+    CategoricalCache(const Eigen::VectorXi &allocations_ref, const Eigen::VectorXi &categorical_covariates)
+        : allocations(allocations_ref), categorical_covariates(categorical_covariates),
+          num_categories(categorical_covariates.size() > 0 ? std::max(0, categorical_covariates.maxCoeff() + 1) : 0) {
+
+        const int K = allocations.maxCoeff() + 1;
+        recompute(K > 0 ? K : 0, allocations);
+    }
+
+    /**
+     * @brief Assigns a point to a cluster
+     * @param index Index of the point to reassign
+     * @param cluster Target cluster index (K for new cluster, -1 for unallocated)
+     * @param old_cluster Previous cluster index of the point
+     */
+    void set_allocation(int index, int cluster, int old_cluster) override;
+
+    /** @brief Adds the category counts of from_cluster to to_cluster in O(C) */
+    void merge_clusters(int from_cluster, int to_cluster, const std::vector<int> &moved) override;
+
+    /**
+     * @brief Get cluster statistics reference for a specific cluster
+     * @param cluster Index of the cluster
+     * @return Const reference to ClusterStats struct
+     */
+    inline const ClusterStats &get_cluster_stats_ref(int cluster) const { return cluster_stats[cluster]; }
+
+    /**
+     * @brief Number of members of a cluster in a category
+     * @param cluster Index of the cluster
+     * @param category Category, 0 <= category < num_categories
+     */
+    inline int get_category_count(int cluster, int category) const {
+        const ClusterStats &stats = cluster_stats[cluster];
+        return stats.category_counts.empty() ? 0 : stats.category_counts[category];
+    }
+
+    /**
+     * @brief Recomputes all cluster information from current allocations
+     * @param K Current number of clusters
+     * @param allocations_in Current allocations vector
+     */
+    void recompute(const int K, const Eigen::VectorXi &allocations_in) override;
+
+    /**
+     * @brief Moves cluster information from one cluster to another
+     * @param from_cluster Index of the source cluster
+     * @param to_cluster Index of the target cluster
+     */
+    inline void move_cluster_info(int from_cluster, int to_cluster) override {
+        cluster_stats[to_cluster] = std::move(cluster_stats[from_cluster]);
+    };
+
+    /**
+     * @brief Removes information related to a specific cluster
+     * @param cluster Index of the cluster to remove
+     */
+    void remove_info(int cluster) override {
+        if (cluster == static_cast<int>(cluster_stats.size()) - 1) {
+            cluster_stats.pop_back();
+        } else {
+            cluster_stats.erase(cluster_stats.begin() + cluster);
+        }
+    }
+
+    /**
+     * @brief Heap bytes of the category counts of the clusters and the copy of the covariate
+     * @see MemoryReport
+     */
+    std::size_t memory_bytes() const override {
+        std::size_t bytes = MemoryReport::bytes(cluster_stats) + MemoryReport::bytes(categorical_covariates);
+        for (const ClusterStats &stats : cluster_stats)
+            bytes += MemoryReport::bytes(stats.category_counts);
+        return bytes;
+    }
+};
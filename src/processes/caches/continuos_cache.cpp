@@ -60,4 +60,13 @@ void ContinuosCache::remove_info(int cluster) {
     } else {
         cluster_stats.erase(cluster_stats.begin() + cluster);
     }
-}
\ No newline at end of file
+}
+
+void ContinuosCache::merge_clusters(int from_cluster, int to_cluster, const std::vector<int> &) {
+    ClusterStats &from_stats = cluster_stats[from_cluster];
+    ClusterStats &to_stats = cluster_stats[to_cluster];
+    to_stats.n += from_stats.n;
+    to_stats.sum += from_stats.sum;
+    to_stats.sumsq += from_stats.sumsq;
+    from_stats = ClusterStats();
+}
@@ -0,0 +1,77 @@
+/**
+ * @file multi_binary_cache.cpp
+ * @brief Implementation of `MultiBinaryCache`.
+ */
+
+#include "multi_binary_cache.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+std::vector<uint64_t> MultiBinaryCache::pack(const Eigen::MatrixXi &binary_covariates, int words) {
+    std::vector<uint64_t> packed(static_cast<size_t>(binary_covariates.rows()) * words, 0);
+    for (Eigen::Index j = 0; j < binary_covariates.cols(); ++j) {
+        for (Eigen::Index i = 0; i < binary_covariates.rows(); ++i) {
+            const int value = binary_covariates(i, j);
+            if (value != 0 && value != 1) {
+                throw std::invalid_argument("MultiBinaryCache: covariates must be 0 or 1");
+            }
+            packed[static_cast<size_t>(i) * words + j / 64] |= static_cast<uint64_t>(value) << (j % 64);
+        }
+    }
+    return packed;
+}
+
+void MultiBinaryCache::set_allocation(int index, int cluster, int old_cluster) {
+
+    // Remove point from old cluster stats
+    if (old_cluster != -1) {
+        update_stats(index, old_cluster, -1);
+    }
+
+    // Add point to new cluster stats
+    if (cluster != -1) {
+        ensure_cluster(cluster);
+        update_stats(index, cluster, +1);
+    }
+}
+
+void MultiBinaryCache::recompute(const int K, const Eigen::VectorXi &allocations) {
+    // Reset the stats of K clusters
+    counts.assign(K, 0);
+    successes.assign(static_cast<size_t>(K) * d, 0);
+
+    // Recompute stats from scratch
+    for (int i = 0; i < allocations.size(); ++i) {
+        const int cluster = allocations(i);
+        if (cluster < 0)
+            continue; // Skip unallocated points
+
+        ensure_cluster(cluster);
+        update_stats(i, cluster, +1);
+    }
+}
+
+void MultiBinaryCache::move_cluster_info(int from_cluster, int to_cluster) {
+    ensure_cluster(to_cluster);
+    counts[to_cluster] = counts[from_cluster];
+    std::copy_n(successes.begin() + static_cast<size_t>(from_cluster) * d, d,
+                successes.begin() + static_cast<size_t>(to_cluster) * d);
+}
+
+void MultiBinaryCache::remove_info(int cluster) {
+    // Remove the count and the d successes of the cluster, shifting the following clusters down
+    counts.erase(counts.begin() + cluster);
+    const auto first = static_cast<size_t>(cluster) * d;
+    successes.erase(successes.begin() + first, successes.begin() + first + d);
+}
+
+void MultiBinaryCache::merge_clusters(int from_cluster, int to_cluster, const std::vector<int> &) {
+    counts[to_cluster] += counts[from_cluster];
+    counts[from_cluster] = 0;
+    int *from = successes.data() + static_cast<size_t>(from_cluster) * d;
+    int *to = successes.data() + static_cast<size_t>(to_cluster) * d;
+    for (int j = 0; j < d; ++j) {
+        to[j] += from[j];
+        from[j] = 0;
+    }
+}
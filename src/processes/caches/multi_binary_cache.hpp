@@ -0,0 +1,141 @@
+#pragma once
+
+/**
+ * @file multi_binary_cache.hpp
+ * @brief Cache for spatial model with several binary covariates, stored as bitsets.
+ */
+
+#include "../../utils/ClusterInfo.hpp"
+#include <cstdint>
+#include <vector>
+
+/**
+ * @class MultiBinaryCache
+ * @brief Cache for spatial model with d binary covariates.
+ * @details Same statistics as BinaryCache (count and number of successes) for all d covariates at
+ * once, so that d covariates cost one ClusterInfo callback per move instead of d. The covariates of
+ * each observation are packed into words = ceil(d / 64) 64-bit words (bit j of the row is covariate
+ * j), i.e. d / 8 bytes per observation instead of the 4 d of d VectorXi. The successes are kept as
+ * a flat array in which cluster k occupies the d contiguous entries [k d, (k + 1) d). A move visits
+ * the words of the point and, within each word, only its set bits (count trailing zeros), so it
+ * costs O(words + ones) rather than O(d).
+ */
+
+class MultiBinaryCache : public ClusterInfo {
+private:
+    std::vector<int> counts;    ///< Number of members of each cluster
+    std::vector<int> successes; ///< Per cluster and covariate: number of members with a 1
+
+    /**
+     * @brief Grows the statistics to hold cluster index cluster
+     * @param cluster Index of the cluster
+     */
+    inline void ensure_cluster(int cluster) {
+        if (cluster >= static_cast<int>(counts.size())) {
+            counts.resize(cluster + 1, 0);
+            successes.resize(static_cast<size_t>(cluster + 1) * d, 0);
+        }
+    }
+
+    /**
+     * @brief Adds (sign = +1) or removes (sign = -1) a point from the statistics of a cluster
+     * @param index Index of the point
+     * @param cluster Index of the cluster
+     * @param sign +1 or -1
+     */
+    inline void update_stats(int index, int cluster, int sign) {
+        const uint64_t *row = get_bits(index);
+        int *s = successes.data() + static_cast<size_t>(cluster) * d;
+        counts[cluster] += sign;
+        for (int w = 0; w < words; ++w) {
+            for (uint64_t bits = row[w]; bits; bits &= bits - 1)
+                s[64 * w + __builtin_ctzll(bits)] += sign;
+        }
+    }
+
+    /**
+     * @brief Packs an n x d matrix of 0/1 values into rows of 64-bit words
+     * @throws std::invalid_argument if a value is neither 0 nor 1
+     */
+    static std::vector<uint64_t> pack(const Eigen::MatrixXi &binary_covariates, int words);
+
+public:
+    const int d;     ///< Number of covariates
+    const int words; ///< 64-bit words per observation
+    const std::vector<uint64_t> bits; ///< Covariates, one row of words per observation (unused high bits are 0)
+
+    /**
+     * @brief Builds the statistics of the initial allocations
+     * @param initial_allocations Initial allocations
+     * @param binary_covariates n x d matrix of 0/1 covariates
+     * @throws std::invalid_argument if a covariate is neither 0 nor 1
+     */
+    MultiBinaryCache(const Eigen::VectorXi &initial_allocations, const Eigen::MatrixXi &binary_covariates)
+        : d(binary_covariates.cols()), words((binary_covariates.cols() + 63) / 64),
+          bits(pack(binary_covariates, words)) {
+        const int K = initial_allocations.maxCoeff() + 1;
+        recompute(K > 0 ? K : 0, initial_allocations);
+    }
+
+    /**
+     * @brief Covariates of an observation
+     * @param index Index of the observation
+     * @return Pointer to its words
+     */
+    inline const uint64_t *get_bits(int index) const { return bits.data() + static_cast<size_t>(index) * words; }
+
+    /**
+     * @brief Covariate j of an observation
+     * @param index Index of the observation
+     * @param j Index of the covariate
+     * @return 0 or 1
+     */
+    inline int get_covariate(int index, int j) const { return (get_bits(index)[j / 64] >> (j % 64)) & 1; }
+
+    /** @brief Number of members of a cluster */
+    inline int get_count(int cluster) const { return counts[cluster]; }
+
+    /** @brief Successes of the d covariates over the members of a cluster */
+    inline const int *get_successes(int cluster) const {
+        return successes.data() + static_cast<size_t>(cluster) * d;
+    }
+
+    /**
+     * @brief Assigns a point to a cluster
+     * @param index Index of the point to reassign
+     * @param cluster Target cluster index (K for new cluster, -1 for unallocated)
+     * @param old_cluster Previous cluster index of the point
+     */
+    void set_allocation(int index, int cluster, int old_cluster) override;
+
+    /** @brief Adds the statistics of from_cluster to to_cluster in O(d) */
+    void merge_clusters(int from_cluster, int to_cluster, const std::vector<int> &moved) override;
+
+    /**
+     * @brief Recomputes all cluster information from current allocations
+     * @param K Current number of clusters
+     * @param allocations Current allocations vector
+     */
+    void recompute(const int K, const Eigen::VectorXi &allocations) override;
+
+    /**
+     * @brief Moves cluster information from one cluster to another
+     * @param from_cluster Index of the source cluster
+     * @param to_cluster Index of the target cluster
+     */
+    void move_cluster_info(int from_cluster, int to_cluster) override;
+
+    /**
+     * @brief Removes information related to a specific cluster
+     * @param cluster Index of the cluster to remove
+     */
+    void remove_info(int cluster) override;
+
+    /**
+     * @brief Heap bytes of the cluster statistics and the packed covariates
+     * @see MemoryReport
+     */
+    std::size_t memory_bytes() const override {
+        return MemoryReport::bytes(counts) + MemoryReport::bytes(successes) + MemoryReport::bytes(bits);
+    }
+};
@@ -0,0 +1,70 @@
+/**
+ * @file multi_continuos_cache.cpp
+ * @brief Implementation of `MultiContinuosCache`.
+ */
+
+#include "multi_continuos_cache.hpp"
+#include <algorithm>
+
+void MultiContinuosCache::set_allocation(int index, int cluster, int old_cluster) {
+
+    // Remove point from old cluster stats
+    if (old_cluster != -1) {
+        update_stats(index, old_cluster, -1);
+    }
+
+    // Add point to new cluster stats
+    if (cluster != -1) {
+        ensure_cluster(cluster);
+        update_stats(index, cluster, +1);
+    }
+}
+
+void MultiContinuosCache::recompute(const int K, const Eigen::VectorXi &allocations) {
+    // Reset the stats of K clusters
+    counts.assign(K, 0);
+    sums.assign(static_cast<size_t>(K) * d, 0.0);
+    sumsqs.assign(static_cast<size_t>(K) * d, 0.0);
+
+    // Recompute stats from scratch
+    for (int i = 0; i < allocations.size(); ++i) {
+        const int cluster = allocations(i);
+        if (cluster < 0)
+            continue; // Skip unallocated points
+
+        ensure_cluster(cluster);
+        update_stats(i, cluster, +1);
+    }
+}
+
+void MultiContinuosCache::move_cluster_info(int from_cluster, int to_cluster) {
+    ensure_cluster(to_cluster);
+    counts[to_cluster] = counts[from_cluster];
+    std::copy_n(sums.begin() + static_cast<size_t>(from_cluster) * d, d,
+                sums.begin() + static_cast<size_t>(to_cluster) * d);
+    std::copy_n(sumsqs.begin() + static_cast<size_t>(from_cluster) * d, d,
+                sumsqs.begin() + static_cast<size_t>(to_cluster) * d);
+}
+
+void MultiContinuosCache::remove_info(int cluster) {
+    // Remove the count and the d stats of the cluster, shifting the following clusters down
+    counts.erase(counts.begin() + cluster);
+    const auto first = static_cast<size_t>(cluster) * d;
+    sums.erase(sums.begin() + first, sums.begin() + first + d);
+    sumsqs.erase(sumsqs.begin() + first, sumsqs.begin() + first + d);
+}
+
+void MultiContinuosCache::merge_clusters(int from_cluster, int to_cluster, const std::vector<int> &) {
+    counts[to_cluster] += counts[from_cluster];
+    counts[from_cluster] = 0;
+    double *from_sums = sums.data() + static_cast<size_t>(from_cluster) * d;
+    double *from_sumsqs = sumsqs.data() + static_cast<size_t>(from_cluster) * d;
+    double *to_sums = sums.data() + static_cast<size_t>(to_cluster) * d;
+    double *to_sumsqs = sumsqs.data() + static_cast<size_t>(to_cluster) * d;
+    for (int j = 0; j < d; ++j) {
+        to_sums[j] += from_sums[j];
+        to_sumsqs[j] += from_sumsqs[j];
+        from_sums[j] = 0.0;
+        from_sumsqs[j] = 0.0;
+    }
+}
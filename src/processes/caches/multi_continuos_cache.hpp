@@ -0,0 +1,128 @@
+#pragma once
+
+/**
+ * @file multi_continuos_cache.hpp
+ * @brief Cache for spatial model with several continuous covariates.
+ */
+
+#include "../../utils/ClusterInfo.hpp"
+#include <vector>
+
+/**
+ * @class MultiContinuosCache
+ * @brief Cache for spatial model with d continuous covariates.
+ * @details Same statistics as ContinuosCache (count, sum and sum of squares) for all d covariates at
+ * once, so that d covariates cost one ClusterInfo callback per move instead of d. The statistics are
+ * kept as structure of arrays: one array of counts and two flat arrays of sums and sums of squares
+ * in which cluster k occupies the d contiguous entries [k d, (k + 1) d).
+ */
+
+class MultiContinuosCache : public ClusterInfo {
+private:
+    std::vector<int> counts;    ///< Number of members of each cluster
+    std::vector<double> sums;   ///< Per cluster and covariate: sum of the values
+    std::vector<double> sumsqs; ///< Per cluster and covariate: sum of the squared values
+
+    /**
+     * @brief Grows the statistics to hold cluster index cluster
+     * @param cluster Index of the cluster
+     */
+    inline void ensure_cluster(int cluster) {
+        if (cluster >= static_cast<int>(counts.size())) {
+            counts.resize(cluster + 1, 0);
+            sums.resize(static_cast<size_t>(cluster + 1) * d, 0.0);
+            sumsqs.resize(static_cast<size_t>(cluster + 1) * d, 0.0);
+        }
+    }
+
+    /**
+     * @brief Adds (sign = +1) or removes (sign = -1) a point from the statistics of a cluster
+     * @param index Index of the point
+     * @param cluster Index of the cluster
+     * @param sign +1 or -1
+     */
+    inline void update_stats(int index, int cluster, int sign) {
+        const double *x = get_covariates(index);
+        double *s = sums.data() + static_cast<size_t>(cluster) * d;
+        double *q = sumsqs.data() + static_cast<size_t>(cluster) * d;
+        counts[cluster] += sign;
+        for (int j = 0; j < d; ++j) {
+            s[j] += sign * x[j];
+            q[j] += sign * x[j] * x[j];
+        }
+    }
+
+public:
+    const int d; ///< Number of covariates
+    const Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
+        continuos_covariates; ///< Covariates, one row of d values per observation
+
+    /**
+     * @brief Builds the statistics of the initial allocations
+     * @param initial_allocations Initial allocations
+     * @param continuos_covariates n x d matrix of covariates
+     */
+    MultiContinuosCache(const Eigen::VectorXi &initial_allocations, const Eigen::MatrixXd &continuos_covariates)
+        : d(continuos_covariates.cols()), continuos_covariates(continuos_covariates) {
+        const int K = initial_allocations.maxCoeff() + 1;
+        recompute(K > 0 ? K : 0, initial_allocations);
+    }
+
+    /**
+     * @brief Covariates of an observation
+     * @param index Index of the observation
+     * @return Pointer to its d values
+     */
+    inline const double *get_covariates(int index) const {
+        return continuos_covariates.data() + static_cast<size_t>(index) * d;
+    }
+
+    /** @brief Number of members of a cluster */
+    inline int get_count(int cluster) const { return counts[cluster]; }
+
+    /** @brief Sums of the d covariates over the members of a cluster */
+    inline const double *get_sums(int cluster) const { return sums.data() + static_cast<size_t>(cluster) * d; }
+
+    /** @brief Sums of the squared d covariates over the members of a cluster */
+    inline const double *get_sumsqs(int cluster) const { return sumsqs.data() + static_cast<size_t>(cluster) * d; }
+
+    /**
+     * @brief Assigns a point to a cluster
+     * @param index Index of the point to reassign
+     * @param cluster Target cluster index (K for new cluster, -1 for unallocated)
+     * @param old_cluster Previous cluster index of the point
+     */
+    void set_allocation(int index, int cluster, int old_cluster) override;
+
+    /** @brief Adds the statistics of from_cluster to to_cluster in O(d) */
+    void merge_clusters(int from_cluster, int to_cluster, const std::vector<int> &moved) override;
+
+    /**
+     * @brief Recomputes all cluster information from current allocations
+     * @param K Current number of clusters
+     * @param allocations Current allocations vector
+     */
+    void recompute(const int K, const Eigen::VectorXi &allocations) override;
+
+    /**
+     * @brief Moves cluster information from one cluster to another
+     * @param from_cluster Index of the source cluster
+     * @param to_cluster Index of the target cluster
+     */
+    void move_cluster_info(int from_cluster, int to_cluster) override;
+
+    /**
+     * @brief Removes information related to a specific cluster
+     * @param cluster Index of the cluster to remove
+     */
+    void remove_info(int cluster) override;
+
+    /**
+     * @brief Heap bytes of the cluster statistics and the copy of the covariates
+     * @see MemoryReport
+     */
+    std::size_t memory_bytes() const override {
+        return MemoryReport::bytes(counts) + MemoryReport::bytes(sums) + MemoryReport::bytes(sumsqs) +
+               MemoryReport::bytes(continuos_covariates);
+    }
+};
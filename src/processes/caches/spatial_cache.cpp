@@ -5,20 +5,24 @@
 
 #include "spatial_cache.hpp"
 
-void SpatialCache::neighbor_cache_compute() {
-    const int N = W.rows();
-    neighbor_cache.resize(N);
-
-    // For each observation, store indices of its neighbors (where W(i,j) == 1)
-    for (int obs_idx = 0; obs_idx < N; ++obs_idx) {
-        Eigen::RowVectorXi row = W.row(obs_idx);
-        neighbor_cache[obs_idx].reserve(row.sum());
-
-        for (int j = 0; j < row.size(); ++j) {
-            if (row(j) == 1) {
-                neighbor_cache[obs_idx].push_back(j);
-            }
-        }
+void SpatialCache::add_count(int point, int cluster, int delta) {
+    NeighborCount *entry = find_count(point, cluster);
+    if (!entry) {
+        neighbor_counts[count_offsets[point] + count_used[point]++] = {cluster, delta};
+    } else if ((entry->count += delta) == 0) {
+        erase_count(point, entry);
+    }
+}
+
+void SpatialCache::relabel_count(int point, int from_cluster, int to_cluster) {
+    NeighborCount *from = find_count(point, from_cluster);
+    if (!from)
+        return;
+    if (NeighborCount *to = find_count(point, to_cluster)) {
+        to->count += from->count;
+        erase_count(point, from);
+    } else {
+        from->cluster = to_cluster;
     }
 }
 
@@ -27,11 +31,19 @@ void SpatialCache::recompute(int K, const Eigen::VectorXi &allocations) {
     cluster_stats.resize(K);
 
     const int N = allocations.size();
+    count_used.assign(N, 0);
+    for (int i = 0; i < N; ++i) {
+        for (const int neighbor_idx : neighbor_cache[i]) {
+            if (allocations(neighbor_idx) != -1)
+                add_count(i, allocations(neighbor_idx), 1);
+        }
+    }
+
     for (int i = 0; i < N; ++i) {
         int cls_idx = allocations(i);
         if (cls_idx != -1) {
             // Sum spatial covariates from neighbors
-            const std::vector<int> &row = neighbor_cache[i];
+            const SparseAdjacency::Row row = neighbor_cache[i];
             for (size_t j = 0; j < row.size(); ++j) {
                 cluster_stats[cls_idx].spatial_sum +=
                     (allocations(row[j]) == cls_idx
@@ -44,10 +56,18 @@ void SpatialCache::recompute(int K, const Eigen::VectorXi &allocations) {
 
 void SpatialCache::set_allocation(int index, int cluster, int old_cluster) {
 
+    // The point leaves old_cluster and joins cluster in the counts of the points next to it
+    for (const int point : affected_points(index)) {
+        if (old_cluster != -1)
+            add_count(point, old_cluster, -1);
+        if (cluster != -1)
+            add_count(point, cluster, 1);
+    }
+
     // Remove from old cluster
     if (old_cluster != -1) {
         ClusterStats &stats = cluster_stats[old_cluster];
-        for (const auto &neighbor_idx : neighbor_cache[index]) {
+        for (const int neighbor_idx : neighbor_cache[index]) {
             stats.spatial_sum -= (allocations_ptr->operator()(neighbor_idx) == old_cluster ? 2 : 0);
         }
     }
@@ -60,8 +80,43 @@ void SpatialCache::set_allocation(int index, int cluster, int old_cluster) {
         }
 
         ClusterStats &stats = cluster_stats[cluster];
-        for (const auto &neighbor_idx : neighbor_cache[index]) {
+        for (const int neighbor_idx : neighbor_cache[index]) {
             stats.spatial_sum += (allocations_ptr->operator()(neighbor_idx) == cluster ? 2 : 0);
         }
     }
-}
\ No newline at end of file
+}
+
+void SpatialCache::merge_clusters(int from_cluster, int to_cluster, const std::vector<int> &moved) {
+    // With the allocations already merged, the walk counts the ordered neighbour pairs inside
+    // from_cluster (its sum) plus each cross pair once, so the merged sum is
+    // sum(to) + sum(from) + 2 (walk - sum(from))
+    int walk = 0;
+    for (const int index : moved) {
+        for (const int neighbor_idx : neighbor_cache[index]) {
+            walk += (allocations_ptr->operator()(neighbor_idx) == to_cluster ? 1 : 0);
+        }
+    }
+    cluster_stats[to_cluster].spatial_sum += 2 * walk - cluster_stats[from_cluster].spatial_sum;
+    cluster_stats[from_cluster] = ClusterStats();
+
+    // Each point next to a moved one has its count of from_cluster folded into to_cluster on the
+    // first visit; later visits find no entry of from_cluster
+    for (const int index : moved) {
+        for (const int point : affected_points(index))
+            relabel_count(point, from_cluster, to_cluster);
+    }
+}
+
+void SpatialCache::move_cluster_info(int from_cluster, int to_cluster) {
+    cluster_stats[to_cluster] = std::move(cluster_stats[from_cluster]);
+    for (int point = 0; point < static_cast<int>(count_used.size()); ++point)
+        relabel_count(point, from_cluster, to_cluster);
+}
+
+void SpatialCache::relabel_cluster(int from_cluster, int to_cluster, const std::vector<int> &members) {
+    cluster_stats[to_cluster] = std::move(cluster_stats[from_cluster]);
+    for (const int index : members) {
+        for (const int point : affected_points(index))
+            relabel_count(point, from_cluster, to_cluster);
+    }
+}
@@ -6,6 +6,7 @@
  */
 
 #include "../../utils/ClusterInfo.hpp"
+#include "../../utils/SparseAdjacency.hpp"
 #include <Eigen/Dense>
 #include <vector>
 
@@ -28,29 +29,101 @@ public:
         int spatial_sum = 0;
     };
 
-    std::vector<std::vector<int>> neighbor_cache;
+    /**
+     * @struct NeighborCount
+     * @brief Number of neighbours of a point allocated to one cluster
+     */
+    struct NeighborCount {
+        int cluster; ///< Cluster index
+        int count;   ///< Neighbours of the point in the cluster, always positive
+    };
+
+    /**
+     * @struct NeighborCounts
+     * @brief Read-only view of the clusters among the neighbours of one point
+     */
+    struct NeighborCounts {
+        const NeighborCount *first; ///< First entry
+        const NeighborCount *last;  ///< One past the last entry
+
+        const NeighborCount *begin() const { return first; }
+        const NeighborCount *end() const { return last; }
+        size_t size() const { return static_cast<size_t>(last - first); }
+    };
+
+    const SparseAdjacency neighbor_cache; ///< Neighbours of each observation (CSR), O(edges) memory
 
 private:
     std::vector<ClusterStats> cluster_stats;
     Eigen::VectorXi* allocations_ptr;
 
     /**
-     * @brief Precomputes and stores neighbor indices for all observations.
-     *
-     * This method initializes neighbor_cache by extracting non-zero entries
-     * from each row of the adjacency matrix W. Called once during construction
-     * to enable O(neighbors) instead of O(N) lookup time.
+     * @brief Points that have each point as a neighbour, for a graph that is not symmetric
+     * (empty otherwise: the neighbours are the same lists)
      */
-    void neighbor_cache_compute();
+    SparseAdjacency reverse_neighbors;
+    bool symmetric; ///< Whether neighbor_cache is symmetric
 
-public:
-    const Eigen::MatrixXi W;
+    // ========== Neighbour cluster counts ==========
+    // Point i owns the slots [count_offsets[i], count_offsets[i] + count_used[i]) of
+    // neighbor_counts: one entry per cluster with at least one neighbour of i, in no particular
+    // order. There are at most degree(i) such clusters, so the table takes O(edges) memory.
+
+    std::vector<int> count_offsets;            ///< First slot of each point, n + 1 entries
+    std::vector<int> count_used;               ///< Slots in use for each point
+    std::vector<NeighborCount> neighbor_counts; ///< (cluster, count) entries of all points
 
-    SpatialCache(const Eigen::VectorXi &allocations_ref, const Eigen::MatrixXi &W)
-        : W(W) {
+    /** @brief Points whose neighbour lists contain index, i.e. whose counts a move of index changes */
+    SparseAdjacency::Row affected_points(int index) const {
+        return symmetric ? neighbor_cache[index] : reverse_neighbors[index];
+    }
+
+    /** @brief Entry of cluster in the counts of point, or nullptr */
+    NeighborCount *find_count(int point, int cluster) {
+        NeighborCount *entry = neighbor_counts.data() + count_offsets[point];
+        NeighborCount *const last = entry + count_used[point];
+        for (; entry != last; ++entry) {
+            if (entry->cluster == cluster)
+                return entry;
+        }
+        return nullptr;
+    }
+
+    /** @brief Adds delta to the count of cluster among the neighbours of point */
+    void add_count(int point, int cluster, int delta);
+
+    /** @brief Removes an entry from the counts of point, moving the last one into its slot */
+    void erase_count(int point, NeighborCount *entry) {
+        *entry = neighbor_counts[count_offsets[point] + --count_used[point]];
+    }
+
+    /** @brief Moves the count of from_cluster into to_cluster in the counts of point */
+    void relabel_count(int point, int from_cluster, int to_cluster);
+
+public:
+    /**
+     * @brief Constructs the cache from the neighbour lists of the adjacency graph
+     * @param allocations_ref Initial allocations
+     * @param adjacency Neighbours of each observation (see SparseAdjacency for the builders)
+     * @throws std::invalid_argument if the graph and the allocations differ in size
+     */
+    SpatialCache(const Eigen::VectorXi &allocations_ref, SparseAdjacency adjacency)
+        : neighbor_cache(std::move(adjacency)) {
 
+        if (neighbor_cache.size() != allocations_ref.size()) {
+            throw std::invalid_argument("SpatialCache: adjacency graph and allocations differ in size");
+        }
+        symmetric = neighbor_cache.is_symmetric();
+        if (!symmetric)
+            reverse_neighbors = neighbor_cache.transposed();
+
+        const int n = neighbor_cache.size();
+        count_offsets.resize(n + 1);
+        count_offsets[0] = 0;
+        for (int i = 0; i < n; ++i)
+            count_offsets[i + 1] = count_offsets[i] + neighbor_cache.degree(i);
+        neighbor_counts.resize(count_offsets[n]);
         const int K = allocations_ref.maxCoeff() + 1;
-        neighbor_cache_compute();
         recompute(K > 0 ? K : 0, allocations_ref);
     }
 
@@ -63,10 +136,42 @@ public:
      */
     void set_allocation(int index, int cluster, int old_cluster) override;
 
+    /**
+     * @brief Merges from_cluster into to_cluster with one pass over the neighbours of the moved
+     * points (the moved points and the members of to_cluster read as one cluster)
+     */
+    void merge_clusters(int from_cluster, int to_cluster, const std::vector<int> &moved) override;
+
     void set_allocation_ptr(const Eigen::VectorXi *new_allocations) {
         allocations_ptr = const_cast<Eigen::VectorXi *>(new_allocations);
     }
 
+    /**
+     * @brief Number of neighbours of a point allocated to a cluster
+     * @param index Index of the point
+     * @param cluster Cluster index (-1 and clusters without neighbours of the point give 0)
+     * @details A scan of the clusters among the neighbours of the point, at most its degree and
+     * in practice a few entries, instead of a walk over its neighbour list.
+     */
+    int neighbors_in_cluster(int index, int cluster) const {
+        const NeighborCount *entry = neighbor_counts.data() + count_offsets[index];
+        const NeighborCount *const last = entry + count_used[index];
+        for (; entry != last; ++entry) {
+            if (entry->cluster == cluster)
+                return entry->count;
+        }
+        return 0;
+    }
+
+    /**
+     * @brief Clusters among the neighbours of a point, with their counts
+     * @param index Index of the point
+     */
+    NeighborCounts neighbor_clusters(int index) const {
+        const NeighborCount *first = neighbor_counts.data() + count_offsets[index];
+        return NeighborCounts{first, first + count_used[index]};
+    }
+
     /**
      * @brief Get cluster statistics for a specific cluster
      * @param cluster Index of the cluster
@@ -91,15 +196,22 @@ public:
     /**
      * @brief Moves cluster information from one cluster to another
      * @param from_cluster Index of the source cluster
-     * @param to_cluster Index of the target cluster
+     * @param to_cluster Index of the target cluster, empty
+     * @details Without the members of the cluster the neighbour counts of every point are
+     * relabelled, O(edges); Datax calls relabel_cluster() instead.
      */
-    inline void move_cluster_info(int from_cluster, int to_cluster) override {
-        cluster_stats[to_cluster] = std::move(cluster_stats[from_cluster]);
-    };
+    void move_cluster_info(int from_cluster, int to_cluster) override;
+
+    /**
+     * @brief Moves cluster information from one cluster to another, relabelling only the counts
+     * of the points next to its members
+     * @see ClusterInfo::relabel_cluster()
+     */
+    void relabel_cluster(int from_cluster, int to_cluster, const std::vector<int> &members) override;
 
     /**
      * @brief Removes information related to a specific cluster
-     * @param cluster Index of the cluster to remove
+     * @param cluster Index of the cluster to remove, empty (so absent from the neighbour counts)
      */
     void remove_info(int cluster) override {
         if (cluster == static_cast<int>(cluster_stats.size()) - 1) {
@@ -108,4 +220,14 @@ public:
             cluster_stats.erase(cluster_stats.begin() + cluster);
         }
     }
+
+    /**
+     * @brief Heap bytes of the two neighbour lists, the neighbour counts and the cluster statistics
+     * @see MemoryReport
+     */
+    std::size_t memory_bytes() const override {
+        return neighbor_cache.memory_bytes() + reverse_neighbors.memory_bytes() + MemoryReport::bytes(cluster_stats) +
+               MemoryReport::bytes(count_offsets) + MemoryReport::bytes(count_used) +
+               MemoryReport::bytes(neighbor_counts);
+    }
 };
\ No newline at end of file
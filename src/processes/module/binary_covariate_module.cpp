@@ -6,16 +6,11 @@
 #include "binary_covariate_module.hpp"
 
 double BinaryCovariatesModule::compute_similarity_cls(int cls_idx, bool old_allo) const {
+    PROFILE_SCOPE(ModuleSimilarityCls);
     // Retrieve cluster members based on allocation type
-    Eigen::VectorXi cluster_members;
-    if (old_allo && old_cluster_members_provider) {
-        auto it = old_cluster_members_provider->find(cls_idx);
-        if (it != old_cluster_members_provider->end()) {
-            cluster_members = Eigen::Map<const Eigen::VectorXi>(it->second.data(), it->second.size());
-        }
-    } else {
-        cluster_members = data.get_cluster_assignments(cls_idx);
-    }
+    const Eigen::Map<const Eigen::VectorXi> cluster_members =
+        (old_allo && old_cluster_members_provider) ? cluster_members_view(*old_cluster_members_provider, cls_idx)
+                                                   : data.get_cluster_assignments(cls_idx);
 
     // If the cluster is empty, return 0 similarity
     if (cluster_members.size() == 0) {
@@ -33,17 +28,14 @@ double BinaryCovariatesModule::compute_similarity_cls(int cls_idx, bool old_allo
     }
 
     // Compute log marginal likelihood using Beta-Binomial model
-    double alpha = beta_prior_alpha;
-    double beta = beta_prior_beta;
-
-    double log_marginal_likelihood = lgamma(counts + alpha) +
-                                     lgamma(num_covariates - counts + beta) -
-                                     lgamma(num_covariates + alpha + beta) - log_beta_prior;
+    double log_marginal_likelihood = lgamma_alpha_count[counts] + lgamma_beta_count[num_covariates - counts] -
+                                     lgamma_alpha_beta_size[num_covariates] - log_beta_prior;
 
     return log_marginal_likelihood;
 }
 
 double BinaryCovariatesModule::compute_similarity_obs(int obs_idx, int cls_idx) const {
+    PROFILE_SCOPE(ModuleSimilarityObs);
     
     int num_covariates = 0;
     int counts = 0;
@@ -62,20 +54,22 @@ double BinaryCovariatesModule::compute_similarity_obs(int obs_idx, int cls_idx)
         }
     }
 
-    const double denominator = num_covariates + beta_prior_alpha + beta_prior_beta;
-    const double numerator = (beta_prior_alpha + counts)*binary_covariate_data(obs_idx) + 
-                             (beta_prior_beta + num_covariates - counts)*(1 - binary_covariate_data(obs_idx));
-    return std::log(numerator / denominator);
+    // log( (alpha + counts) / (n + alpha + beta) ) for a 1, log( (beta + n - counts) / (n + alpha + beta) ) for a 0
+    const double log_numerator =
+        binary_covariate_data(obs_idx) == 1 ? log_alpha_count[counts] : log_beta_count[num_covariates - counts];
+    return log_numerator - log_alpha_beta_size[num_covariates];
 }
 
-Eigen::VectorXd BinaryCovariatesModule::compute_similarity_obs(int obs_idx) const{
+void BinaryCovariatesModule::add_similarity_obs(int obs_idx, Eigen::Ref<Eigen::VectorXd> out) const {
+    PROFILE_SCOPE(ModuleSimilarityObs);
     const int K = data.get_K();
     const Eigen::VectorXi &allocations = data.get_allocations();
     
-    // Pre-allocate temporary storage for cluster statistics
-    // You could make these member variables (mutable) to avoid re-allocating memory every step
-    std::vector<int> cluster_counts(K, 0);
-    std::vector<int> cluster_sizes(K, 0);
+    // Temporary storage for cluster statistics, in member buffers reused across calls
+    std::vector<int> &cluster_counts = cluster_counts_buf;
+    std::vector<int> &cluster_sizes = cluster_sizes_buf;
+    cluster_counts.assign(K, 0);
+    cluster_sizes.assign(K, 0);
 
     // Single pass over allocations to compute stats for ALL clusters
     for (int i = 0; i < allocations.size(); ++i) {
@@ -91,10 +85,7 @@ Eigen::VectorXd BinaryCovariatesModule::compute_similarity_obs(int obs_idx) cons
         }
     }
 
-    Eigen::VectorXd similarities(K);
     bool is_success = (binary_covariate_data(obs_idx) == 1);
-    double alpha = beta_prior_alpha;
-    double beta = beta_prior_beta;
 
     // Compute similarities using gathered stats
     for (int k = 0; k < K; ++k) {
@@ -102,16 +93,14 @@ Eigen::VectorXd BinaryCovariatesModule::compute_similarity_obs(int obs_idx) cons
         // Usually implementation details might vary, but log(0) for empty cluster logic:
         // Use prior predictive for empty cluster logic if it's considered "active"
         
-        double num;
-        if (is_success) {
-            num = alpha + cluster_counts[k];
-        } else {
-            num = beta + cluster_sizes[k] - cluster_counts[k];
-        }
-        
-        double den = cluster_sizes[k] + alpha + beta;
-        similarities(k) = std::log(num) - std::log(den);
+        const double log_num =
+            is_success ? log_alpha_count[cluster_counts[k]] : log_beta_count[cluster_sizes[k] - cluster_counts[k]];
+        out(k) += log_num - log_alpha_beta_size[cluster_sizes[k]];
     }
-    
+}
+
+Eigen::VectorXd BinaryCovariatesModule::compute_similarity_obs(int obs_idx) const {
+    Eigen::VectorXd similarities = Eigen::VectorXd::Zero(data.get_K());
+    BinaryCovariatesModule::add_similarity_obs(obs_idx, similarities);
     return similarities;
 }
@@ -5,8 +5,10 @@
  * @brief Covariate-related computations for clustering processes.
  */
 
+#include "../../utils/CountTables.hpp"
 #include "../../utils/Data.hpp"
 #include "../../utils/Module.hpp"
+#include <vector>
 
 /**
  * @class BinaryCovariatesModule
@@ -43,6 +45,20 @@ protected:
     const double log_beta_prior =
         std::lgamma(beta_prior_alpha) + std::lgamma(beta_prior_beta) -
         std::lgamma(beta_prior_alpha + beta_prior_beta); /**< Log Beta function for prior parameters */
+
+    CountTable lgamma_alpha_count;     /**< lgamma(alpha + m), shared through CountTables */
+    CountTable lgamma_beta_count;      /**< lgamma(beta + m), shared through CountTables */
+    CountTable lgamma_alpha_beta_size; /**< lgamma(alpha + beta + m), shared through CountTables */
+    CountTable log_alpha_count;        /**< log(alpha + m), shared through CountTables */
+    CountTable log_beta_count;         /**< log(beta + m), shared through CountTables */
+    CountTable log_alpha_beta_size;    /**< log(alpha + beta + m), shared through CountTables */
+    /** @} */
+
+    /** @name Scratch buffers of add_similarity_obs() (not reentrant)
+     * @{
+     */
+    mutable std::vector<int> cluster_counts_buf; ///< Successes per cluster
+    mutable std::vector<int> cluster_sizes_buf;  ///< Sizes per cluster
     /** @} */
 
 public:
@@ -57,9 +73,17 @@ public:
      */
     BinaryCovariatesModule(const Data &data_, const Eigen::VectorXi binary_covariate, double beta_prior_alpha_,
                            double beta_prior_beta_, const Eigen::VectorXi *old_alloc_provider = nullptr,
-                           const std::unordered_map<int, std::vector<int>> *old_cluster_members_provider_ = nullptr)
+                           const ClusterMembers *old_cluster_members_provider_ = nullptr)
         : beta_prior_alpha(beta_prior_alpha_), beta_prior_beta(beta_prior_beta_), data(data_),
-          binary_covariate_data(binary_covariate), Module(old_alloc_provider, old_cluster_members_provider_) {}
+          binary_covariate_data(binary_covariate), Module(old_alloc_provider, old_cluster_members_provider_) {
+        const int size = data.get_n() + 1;
+        lgamma_alpha_count = CountTables::shared().lgamma(beta_prior_alpha, 1.0, size);
+        lgamma_beta_count = CountTables::shared().lgamma(beta_prior_beta, 1.0, size);
+        lgamma_alpha_beta_size = CountTables::shared().lgamma(beta_prior_alpha + beta_prior_beta, 1.0, size);
+        log_alpha_count = CountTables::shared().log(beta_prior_alpha, 1.0, size);
+        log_beta_count = CountTables::shared().log(beta_prior_beta, 1.0, size);
+        log_alpha_beta_size = CountTables::shared().log(beta_prior_alpha + beta_prior_beta, 1.0, size);
+    }
 
     /**
      * @name Similarity Computation Methods
@@ -105,5 +129,20 @@ public:
      */
     Eigen::VectorXd compute_similarity_obs(int obs_idx) const override __attribute__((hot));
 
+    /**
+     * @brief Adds the similarity contributions of obs_idx for every existing cluster to out
+     * @see Module::add_similarity_obs()
+     */
+    void add_similarity_obs(int obs_idx, Eigen::Ref<Eigen::VectorXd> out) const override __attribute__((hot));
+
+    /**
+     * @brief Heap bytes of the copy of the covariate and the scratch
+     * @see MemoryReport
+     */
+    std::size_t memory_bytes() const override {
+        return MemoryReport::bytes(binary_covariate_data) + MemoryReport::bytes(cluster_counts_buf) +
+               MemoryReport::bytes(cluster_sizes_buf);
+    }
+
     /** @} */
 };
\ No newline at end of file
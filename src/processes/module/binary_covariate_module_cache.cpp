@@ -6,17 +6,14 @@
 #include "binary_covariate_module_cache.hpp"
 
 double BinaryCovariatesModuleCache::compute_similarity_cls(int cls_idx, bool old_allo) const {
+    PROFILE_SCOPE(ModuleSimilarityCls);
 
     int counts = 0;
     int num_covariates = 0;
 
     // Retrieve cluster members based on allocation type
-    Eigen::VectorXi cluster_members;
     if (old_allo && old_cluster_members_provider) {
-        auto it = old_cluster_members_provider->find(cls_idx);
-        if (it != old_cluster_members_provider->end()) {
-            cluster_members = Eigen::Map<const Eigen::VectorXi>(it->second.data(), it->second.size());
-        }
+        const auto cluster_members = cluster_members_view(*old_cluster_members_provider, cls_idx);
         // Initialize counts for binary covariates
         num_covariates = cluster_members.size();
 
@@ -36,16 +33,14 @@ double BinaryCovariatesModuleCache::compute_similarity_cls(int cls_idx, bool old
     }
 
     // Compute log marginal likelihood using Beta-Binomial model
-    double alpha = beta_prior_alpha;
-    double beta = beta_prior_beta;
-
-    double log_marginal_likelihood = lgamma(counts + alpha) + lgamma(num_covariates - counts + beta) -
-                                     lgamma(num_covariates + alpha + beta) - log_beta_prior;
+    double log_marginal_likelihood = lgamma_alpha_count[counts] + lgamma_beta_count[num_covariates - counts] -
+                                     lgamma_alpha_beta_size[num_covariates] - log_beta_prior;
 
     return log_marginal_likelihood;
 }
 
 double BinaryCovariatesModuleCache::compute_similarity_obs(int obs_idx, int cls_idx) const {
+    PROFILE_SCOPE(ModuleSimilarityObs);
 
     int num_covariates = 0;
     int counts = 0;
@@ -65,20 +60,22 @@ double BinaryCovariatesModuleCache::compute_similarity_obs(int obs_idx, int cls_
         }
     }
 
-    const double denominator = num_covariates + beta_prior_alpha + beta_prior_beta;
-    const double numerator = (beta_prior_alpha + counts) * cache.binary_covariates(obs_idx) +
-                             (beta_prior_beta + num_covariates - counts) * (1 - cache.binary_covariates(obs_idx));
-    return std::log(numerator / denominator);
+    // log( (alpha + counts) / (n + alpha + beta) ) for a 1, log( (beta + n - counts) / (n + alpha + beta) ) for a 0
+    const double log_numerator =
+        cache.binary_covariates(obs_idx) == 1 ? log_alpha_count[counts] : log_beta_count[num_covariates - counts];
+    return log_numerator - log_alpha_beta_size[num_covariates];
 }
 
-Eigen::VectorXd BinaryCovariatesModuleCache::compute_similarity_obs(int obs_idx) const {
+void BinaryCovariatesModuleCache::add_similarity_obs(int obs_idx, Eigen::Ref<Eigen::VectorXd> out) const {
+    PROFILE_SCOPE(ModuleSimilarityObs);
     const int K = data.get_K();
     const Eigen::VectorXi &allocations = data.get_allocations();
 
-    // Pre-allocate temporary storage for cluster statistics
-    // You could make these member variables (mutable) to avoid re-allocating memory every step
-    std::vector<int> cluster_counts(K, 0);
-    std::vector<int> cluster_sizes(K, 0);
+    // Temporary storage for cluster statistics, in member buffers reused across calls
+    std::vector<int> &cluster_counts = cluster_counts_buf;
+    std::vector<int> &cluster_sizes = cluster_sizes_buf;
+    cluster_counts.assign(K, 0);
+    cluster_sizes.assign(K, 0);
 
     for (int k = 0; k < K; ++k) {
         cluster_counts[k] = cache.get_cluster_stats_ref(k).binary_sum;
@@ -92,10 +89,7 @@ Eigen::VectorXd BinaryCovariatesModuleCache::compute_similarity_obs(int obs_idx)
         cluster_counts[current_cluster] -= cache.binary_covariates(obs_idx);
     }
 
-    Eigen::VectorXd similarities(K);
     bool is_success = (cache.binary_covariates(obs_idx) == 1);
-    double alpha = beta_prior_alpha;
-    double beta = beta_prior_beta;
 
     // Compute similarities using gathered stats
     for (int k = 0; k < K; ++k) {
@@ -103,16 +97,14 @@ Eigen::VectorXd BinaryCovariatesModuleCache::compute_similarity_obs(int obs_idx)
         // Usually implementation details might vary, but log(0) for empty cluster logic:
         // Use prior predictive for empty cluster logic if it's considered "active"
 
-        double num;
-        if (is_success) {
-            num = alpha + cluster_counts[k];
-        } else {
-            num = beta + cluster_sizes[k] - cluster_counts[k];
-        }
-
-        double den = cluster_sizes[k] + alpha + beta;
-        similarities(k) = std::log(num) - std::log(den);
+        const double log_num =
+            is_success ? log_alpha_count[cluster_counts[k]] : log_beta_count[cluster_sizes[k] - cluster_counts[k]];
+        out(k) += log_num - log_alpha_beta_size[cluster_sizes[k]];
     }
+}
 
+Eigen::VectorXd BinaryCovariatesModuleCache::compute_similarity_obs(int obs_idx) const {
+    Eigen::VectorXd similarities = Eigen::VectorXd::Zero(data.get_K());
+    BinaryCovariatesModuleCache::add_similarity_obs(obs_idx, similarities);
     return similarities;
 }
@@ -5,9 +5,11 @@
  * @brief Covariate-related computations for clustering processes with cache.
  */
 
+#include "../../utils/CountTables.hpp"
 #include "../../utils/Data.hpp"
 #include "../../utils/Module.hpp"
 #include "../caches/binary_cache.hpp"
+#include <vector>
 
 /**
  * @class BinaryCovariatesModuleCache
@@ -43,6 +45,20 @@ protected:
     const double log_beta_prior =
         std::lgamma(beta_prior_alpha) + std::lgamma(beta_prior_beta) -
         std::lgamma(beta_prior_alpha + beta_prior_beta); /**< Log Beta function for prior parameters */
+
+    CountTable lgamma_alpha_count;     /**< lgamma(alpha + m), shared through CountTables */
+    CountTable lgamma_beta_count;      /**< lgamma(beta + m), shared through CountTables */
+    CountTable lgamma_alpha_beta_size; /**< lgamma(alpha + beta + m), shared through CountTables */
+    CountTable log_alpha_count;        /**< log(alpha + m), shared through CountTables */
+    CountTable log_beta_count;         /**< log(beta + m), shared through CountTables */
+    CountTable log_alpha_beta_size;    /**< log(alpha + beta + m), shared through CountTables */
+    /** @} */
+
+    /** @name Scratch buffers of add_similarity_obs() (not reentrant)
+     * @{
+     */
+    mutable std::vector<int> cluster_counts_buf; ///< Successes per cluster
+    mutable std::vector<int> cluster_sizes_buf;  ///< Sizes per cluster
     /** @} */
 
 public:
@@ -57,9 +73,17 @@ public:
      */
     BinaryCovariatesModuleCache(const Data &data_, const BinaryCache &cache_, double beta_prior_alpha_,
                            double beta_prior_beta_, const Eigen::VectorXi *old_alloc_provider = nullptr,
-                           const std::unordered_map<int, std::vector<int>> *old_cluster_members_provider_ = nullptr)
+                           const ClusterMembers *old_cluster_members_provider_ = nullptr)
         : beta_prior_alpha(beta_prior_alpha_), beta_prior_beta(beta_prior_beta_), data(data_), cache(cache_),
-           Module(old_alloc_provider, old_cluster_members_provider_) {}
+           Module(old_alloc_provider, old_cluster_members_provider_) {
+        const int size = data.get_n() + 1;
+        lgamma_alpha_count = CountTables::shared().lgamma(beta_prior_alpha, 1.0, size);
+        lgamma_beta_count = CountTables::shared().lgamma(beta_prior_beta, 1.0, size);
+        lgamma_alpha_beta_size = CountTables::shared().lgamma(beta_prior_alpha + beta_prior_beta, 1.0, size);
+        log_alpha_count = CountTables::shared().log(beta_prior_alpha, 1.0, size);
+        log_beta_count = CountTables::shared().log(beta_prior_beta, 1.0, size);
+        log_alpha_beta_size = CountTables::shared().log(beta_prior_alpha + beta_prior_beta, 1.0, size);
+    }
 
     /**
      * @name Similarity Computation Methods
@@ -105,5 +129,41 @@ public:
      */
     Eigen::VectorXd compute_similarity_obs(int obs_idx) const override __attribute__((hot));
 
+    /**
+     * @brief Adds the similarity contributions of obs_idx for every existing cluster to out
+     * @see Module::add_similarity_obs()
+     */
+    void add_similarity_obs(int obs_idx, Eigen::Ref<Eigen::VectorXd> out) const override __attribute__((hot));
+
+    /**
+     * @brief Heap bytes of the scratch
+     * @see MemoryReport
+     */
+    std::size_t memory_bytes() const override {
+        return MemoryReport::bytes(cluster_counts_buf) + MemoryReport::bytes(cluster_sizes_buf);
+    }
+
+    /** @} */
+
+    /**
+     * @name Prediction
+     * @{
+     */
+
+    /** @brief Cache of the covariate counts read by the module */
+    const BinaryCache &get_cache() const { return cache; }
+
+    /**
+     * @brief Log predictive probability of a covariate value for a cluster with the given counts
+     * (empty counts: a new cluster), as compute_similarity_obs() for a point outside the data
+     * @param stats Counts of the cluster, at most the number of points of the data
+     * @param value Covariate value of the new observation, 0 or 1
+     */
+    double log_predictive(const BinaryCache::ClusterStats &stats, int value) const {
+        const double log_numerator =
+            value == 1 ? log_alpha_count[stats.binary_sum] : log_beta_count[stats.n - stats.binary_sum];
+        return log_numerator - log_alpha_beta_size[stats.n];
+    }
+
     /** @} */
 };
\ No newline at end of file
@@ -6,16 +6,11 @@
 #include "categorical_covariate_module.hpp"
 
 double CategoricalCovariatesModule::compute_similarity_cls(int cls_idx, bool old_allo) const {
+    PROFILE_SCOPE(ModuleSimilarityCls);
     // 1. Retrieve cluster members
-    Eigen::VectorXi cluster_members;
-    if (old_allo && old_cluster_members_provider) {
-        auto it = old_cluster_members_provider->find(cls_idx);
-        if (it != old_cluster_members_provider->end()) {
-            cluster_members = Eigen::Map<const Eigen::VectorXi>(it->second.data(), it->second.size());
-        }
-    } else {
-        cluster_members = data.get_cluster_assignments(cls_idx);
-    }
+    const Eigen::Map<const Eigen::VectorXi> cluster_members =
+        (old_allo && old_cluster_members_provider) ? cluster_members_view(*old_cluster_members_provider, cls_idx)
+                                                   : data.get_cluster_assignments(cls_idx);
 
     if (cluster_members.size() == 0)
         return 0.0;
@@ -34,16 +29,17 @@ double CategoricalCovariatesModule::compute_similarity_cls(int cls_idx, bool old
     // log g(x) = [lgamma(alpha_0) - lgamma(alpha_0 + n_j)] + sum(lgamma(alpha_i + n_ji)) - sum(lgamma(alpha_i))
     double sum_lgamma_data = 0.0;
     for (int i = 0; i < num_categories; ++i) {
-        sum_lgamma_data += std::lgamma(prior_alpha[i] + n_ji[i]);
+        sum_lgamma_data += lgamma_alpha_count[i][n_ji[i]];
     }
 
     double log_marginal_likelihood =
-        lgamma_alpha_0 - std::lgamma(alpha_0 + cluster_members.size()) + sum_lgamma_data - prod_lgamma_prior;
+        lgamma_alpha_0 - lgamma_alpha_0_size[cluster_members.size()] + sum_lgamma_data - prod_lgamma_prior;
 
     return log_marginal_likelihood;
 }
 
 double CategoricalCovariatesModule::compute_similarity_obs(int obs_idx, int cls_idx) const {
+    PROFILE_SCOPE(ModuleSimilarityObs);
     int n_j = 0;                                 // Total count in cluster
     int n_jl = 0;                                // Count of category 'l' in cluster
     int l = categorical_covariate_data(obs_idx); // The category of the current observation
@@ -59,16 +55,19 @@ double CategoricalCovariatesModule::compute_similarity_obs(int obs_idx, int cls_
     }
 
     // Using: log( (alpha_l + n_jl) / (alpha_0 + n_j) )
-    return std::log(prior_alpha[l] + n_jl) - std::log(alpha_0 + n_j);
+    return log_alpha_count[l][n_jl] - log_alpha_0_size[n_j];
 }
 
-Eigen::VectorXd CategoricalCovariatesModule::compute_similarity_obs(int obs_idx) const {
+void CategoricalCovariatesModule::add_similarity_obs(int obs_idx, Eigen::Ref<Eigen::VectorXd> out) const {
+    PROFILE_SCOPE(ModuleSimilarityObs);
     const int K = data.get_K();                                  // Number of clusters
     const Eigen::VectorXi &allocations = data.get_allocations(); // Current cluster assignments
     int l = categorical_covariate_data(obs_idx);                 // The category of the current observation
 
-    std::vector<int> cluster_sizes(K, 0);
-    std::vector<int> cluster_counts_l(K, 0); // Only need counts for category 'l'
+    std::vector<int> &cluster_sizes = cluster_sizes_buf;
+    std::vector<int> &cluster_counts_l = cluster_counts_buf; // Only need counts for category 'l'
+    cluster_sizes.assign(K, 0);
+    cluster_counts_l.assign(K, 0);
 
     // Pass over data to get stats for category 'l' across all clusters
     for (int i = 0; i < allocations.size(); ++i) {
@@ -84,10 +83,13 @@ Eigen::VectorXd CategoricalCovariatesModule::compute_similarity_obs(int obs_idx)
         }
     }
 
-    Eigen::VectorXd similarities(K);
     for (int k = 0; k < K; ++k) {
-        similarities(k) = std::log(prior_alpha[l] + cluster_counts_l[k]) - std::log(alpha_0 + cluster_sizes[k]);
+        out(k) += log_alpha_count[l][cluster_counts_l[k]] - log_alpha_0_size[cluster_sizes[k]];
     }
+}
 
+Eigen::VectorXd CategoricalCovariatesModule::compute_similarity_obs(int obs_idx) const {
+    Eigen::VectorXd similarities = Eigen::VectorXd::Zero(data.get_K());
+    CategoricalCovariatesModule::add_similarity_obs(obs_idx, similarities);
     return similarities;
 }
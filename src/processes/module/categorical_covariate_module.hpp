@@ -5,8 +5,11 @@
  * @brief Covariate-related computations for clustering processes.
  */
 
+#include "../../utils/CountTables.hpp"
 #include "../../utils/Data.hpp"
 #include "../../utils/Module.hpp"
+#include <numeric>
+#include <vector>
 
 /**
  * @class CategoricalCovariatesModule
@@ -44,6 +47,18 @@ protected:
 
     double prod_lgamma_prior = 0; /**< Sum of log Gamma of prior alphas  */
 
+    std::vector<CountTable> lgamma_alpha_count; /**< Per category: lgamma(alpha_i + m), shared through CountTables */
+    std::vector<CountTable> log_alpha_count;    /**< Per category: log(alpha_i + m), shared through CountTables */
+    CountTable lgamma_alpha_0_size;             /**< lgamma(alpha_0 + m), shared through CountTables */
+    CountTable log_alpha_0_size;                /**< log(alpha_0 + m), shared through CountTables */
+
+    /** @} */
+
+    /** @name Scratch buffers of add_similarity_obs() (not reentrant)
+     * @{
+     */
+    mutable std::vector<int> cluster_sizes_buf;  ///< Sizes per cluster
+    mutable std::vector<int> cluster_counts_buf; ///< Counts of the observation's category per cluster
     /** @} */
 
 public:
@@ -58,12 +73,18 @@ public:
     CategoricalCovariatesModule(
         const Data &data_, const Eigen::VectorXi categorical_covariate, std::vector<double> prior_alpha_,
         const Eigen::VectorXi *old_alloc_provider = nullptr,
-        const std::unordered_map<int, std::vector<int>> *old_cluster_members_provider_ = nullptr)
+        const ClusterMembers *old_cluster_members_provider_ = nullptr)
         : prior_alpha(prior_alpha_), data(data_), categorical_covariate_data(categorical_covariate),
           Module(old_alloc_provider, old_cluster_members_provider_) {
 
-        for (const double &alpha : prior_alpha)
+        const int size = data.get_n() + 1;
+        for (const double &alpha : prior_alpha) {
             prod_lgamma_prior += std::lgamma(alpha);
+            lgamma_alpha_count.push_back(CountTables::shared().lgamma(alpha, 1.0, size));
+            log_alpha_count.push_back(CountTables::shared().log(alpha, 1.0, size));
+        }
+        lgamma_alpha_0_size = CountTables::shared().lgamma(alpha_0, 1.0, size);
+        log_alpha_0_size = CountTables::shared().log(alpha_0, 1.0, size);
     }
     /**
      * @name Similarity Computation Methods
@@ -108,5 +129,21 @@ public:
      */
     Eigen::VectorXd compute_similarity_obs(int obs_idx) const override __attribute__((hot));
 
+    /**
+     * @brief Adds the similarity contributions of obs_idx for every existing cluster to out
+     * @see Module::add_similarity_obs()
+     */
+    void add_similarity_obs(int obs_idx, Eigen::Ref<Eigen::VectorXd> out) const override __attribute__((hot));
+
+    /**
+     * @brief Heap bytes of the copy of the covariate, the priors and the scratch
+     * @see MemoryReport
+     */
+    std::size_t memory_bytes() const override {
+        return MemoryReport::bytes(prior_alpha) + MemoryReport::bytes(categorical_covariate_data) +
+               MemoryReport::bytes(lgamma_alpha_count) + MemoryReport::bytes(log_alpha_count) +
+               MemoryReport::bytes(cluster_sizes_buf) + MemoryReport::bytes(cluster_counts_buf);
+    }
+
     /** @} */
 };
\ No newline at end of file
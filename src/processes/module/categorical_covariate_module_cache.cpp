@@ -0,0 +1,90 @@
+/**
+ * @file categorical_covariate_module_cache.cpp
+ * @brief Implementation of `CategoricalCovariatesModuleCache`.
+ */
+
+#include "categorical_covariate_module_cache.hpp"
+
+double CategoricalCovariatesModuleCache::compute_similarity_cls(int cls_idx, bool old_allo) const {
+    PROFILE_SCOPE(ModuleSimilarityCls);
+    const int num_categories = prior_alpha.size();
+    double sum_lgamma_data = 0.0;
+    int n_j = 0;
+
+    if (old_allo && old_cluster_members_provider) {
+        // The cache follows the current allocations: count the old members directly
+        const auto cluster_members = cluster_members_view(*old_cluster_members_provider, cls_idx);
+        n_j = cluster_members.size();
+        if (n_j == 0)
+            return 0.0;
+
+        std::vector<int> n_ji(num_categories, 0);
+        for (int i = 0; i < n_j; ++i) {
+            const int val = cache.categorical_covariates(cluster_members(i));
+            if (val >= 0 && val < num_categories)
+                n_ji[val]++;
+        }
+        for (int i = 0; i < num_categories; ++i)
+            sum_lgamma_data += lgamma_alpha_count[i][n_ji[i]];
+    } else {
+        const CategoricalCache::ClusterStats &stats = cache.get_cluster_stats_ref(cls_idx);
+        n_j = stats.n;
+        if (n_j == 0)
+            return 0.0;
+
+        const int cached_categories = std::min(num_categories, cache.num_categories);
+        for (int i = 0; i < cached_categories; ++i)
+            sum_lgamma_data += lgamma_alpha_count[i][stats.category_counts[i]];
+        for (int i = cached_categories; i < num_categories; ++i)
+            sum_lgamma_data += lgamma_alpha_count[i][0];
+    }
+
+    // log g(x) = [lgamma(alpha_0) - lgamma(alpha_0 + n_j)] + sum(lgamma(alpha_i + n_ji)) - sum(lgamma(alpha_i))
+    return lgamma_alpha_0 - lgamma_alpha_0_size[n_j] + sum_lgamma_data - prod_lgamma_prior;
+}
+
+double CategoricalCovariatesModuleCache::compute_similarity_obs(int obs_idx, int cls_idx) const {
+    PROFILE_SCOPE(ModuleSimilarityObs);
+    int n_j = 0;                                         // Total count in cluster
+    int n_jl = 0;                                        // Count of category 'l' in cluster
+    const int l = cache.categorical_covariates(obs_idx); // The category of the current observation
+
+    if (cls_idx >= 0) {
+        n_j = cache.get_cluster_stats_ref(cls_idx).n;
+        n_jl = cache.get_category_count(cls_idx, l);
+
+        // Exclude the observation itself if it currently belongs to the cluster
+        if (data.get_allocations()(obs_idx) == cls_idx) {
+            n_j--;
+            n_jl--;
+        }
+    }
+
+    // Using: log( (alpha_l + n_jl) / (alpha_0 + n_j) )
+    return log_alpha_count[l][n_jl] - log_alpha_0_size[n_j];
+}
+
+void CategoricalCovariatesModuleCache::add_similarity_obs(int obs_idx, Eigen::Ref<Eigen::VectorXd> out) const {
+    PROFILE_SCOPE(ModuleSimilarityObs);
+    const int K = data.get_K();
+    const int l = cache.categorical_covariates(obs_idx);
+    const int current_cluster = data.get_allocations()(obs_idx);
+
+    for (int k = 0; k < K; ++k) {
+        int n_j = cache.get_cluster_stats_ref(k).n;
+        int n_jl = cache.get_category_count(k, l);
+
+        // Adjust for current assignment of obs_idx
+        if (k == current_cluster) {
+            n_j--;
+            n_jl--;
+        }
+        out(k) += log_alpha_count[l][n_jl] - log_alpha_0_size[n_j];
+    }
+}
+
+Eigen::VectorXd CategoricalCovariatesModuleCache::compute_similarity_obs(int obs_idx) const {
+    Eigen::VectorXd similarities = Eigen::VectorXd::Zero(data.get_K());
+    CategoricalCovariatesModuleCache::add_similarity_obs(obs_idx, similarities);
+    return similarities;
+}
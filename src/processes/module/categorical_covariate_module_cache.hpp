@@ -0,0 +1,138 @@
+#pragma once
+
+/**
+ * @file categorical_covariate_module_cache.hpp
+ * @brief Categorical covariate computations for clustering processes with cache.
+ */
+
+#include "../../utils/CountTables.hpp"
+#include "../../utils/Data.hpp"
+#include "../../utils/Module.hpp"
+#include "../caches/categorical_cache.hpp"
+#include <cmath>
+#include <numeric>
+#include <vector>
+
+/**
+ * @class CategoricalCovariatesModuleCache
+ * @brief Module for categorical covariate-related computations within clustering processes.
+ *
+ * Same Dirichlet-Multinomial model as CategoricalCovariatesModule, with the per-cluster category counts read
+ * from a CategoricalCache registered with the same Datax: scoring a point costs O(K) for all clusters and
+ * scoring a cluster O(C), instead of a pass over the members or the allocations.
+ */
+
+class CategoricalCovariatesModuleCache : public Module {
+protected:
+    /**
+     * @name Module References
+     * @{
+     */
+
+    const std::vector<double> prior_alpha; /**< Prior alpha parameters for Dirichlet-Multinomial model */
+
+    /** @brief Reference to data object with cluster assignments */
+    const Data &data;
+    const CategoricalCache &cache;
+
+    /** @} */
+
+    /**
+     * @name Precomputed Values
+     * @{
+     */
+
+    const double alpha_0 = std::accumulate(prior_alpha.begin(), prior_alpha.end(), 0.0); /**< Sum of prior alphas */
+    const double lgamma_alpha_0 = std::lgamma(alpha_0); /**< Log Gamma of sum of prior alphas */
+
+    double prod_lgamma_prior = 0; /**< Sum of log Gamma of prior alphas  */
+
+    std::vector<CountTable> lgamma_alpha_count; /**< Per category: lgamma(alpha_i + m), shared through CountTables */
+    std::vector<CountTable> log_alpha_count;    /**< Per category: log(alpha_i + m), shared through CountTables */
+    CountTable lgamma_alpha_0_size;             /**< lgamma(alpha_0 + m), shared through CountTables */
+    CountTable log_alpha_0_size;                /**< log(alpha_0 + m), shared through CountTables */
+
+    /** @} */
+
+public:
+    /**
+     * @brief Constructor for CategoricalCovariatesModuleCache
+     * @param data_ Reference to data object with cluster assignments
+     * @param cache_ Reference to CategoricalCache for precomputed counts
+     * @param prior_alpha_ Prior alpha parameters for Dirichlet-Multinomial model (one per category)
+     * @param old_alloc_provider Optional pointer to previous allocation provider
+     * @param old_cluster_members_provider_ Optional pointer to previous cluster members provider
+     */
+    CategoricalCovariatesModuleCache(const Data &data_, const CategoricalCache &cache_, std::vector<double> prior_alpha_,
+                                     const Eigen::VectorXi *old_alloc_provider = nullptr,
+                                     const ClusterMembers *old_cluster_members_provider_ = nullptr)
+        : Module(old_alloc_provider, old_cluster_members_provider_), prior_alpha(prior_alpha_),
+          data(data_), cache(cache_) {
+
+        const int size = data.get_n() + 1;
+        for (const double &alpha : prior_alpha) {
+            prod_lgamma_prior += std::lgamma(alpha);
+            lgamma_alpha_count.push_back(CountTables::shared().lgamma(alpha, 1.0, size));
+            log_alpha_count.push_back(CountTables::shared().log(alpha, 1.0, size));
+        }
+        lgamma_alpha_0_size = CountTables::shared().lgamma(alpha_0, 1.0, size);
+        log_alpha_0_size = CountTables::shared().log(alpha_0, 1.0, size);
+    }
+
+    /**
+     * @name Similarity Computation Methods
+     * @{
+     */
+
+    /**
+     * @brief Compute covariate similarity contribution for a cluster
+     *
+     * Computes the log marginal likelihood of the covariates within a cluster
+     * under the Dirichlet-Multinomial conjugate model, from the cached counts in O(C).
+     *
+     * @param cls_idx Index of the cluster (0 to K-1)
+     * @param old_allo If true, counts the members under the old allocations (not cached);
+     *                 if false, uses the cached counts of the current allocations (default: false)
+     * @return Log marginal likelihood contribution (similarity score)
+     */
+    double compute_similarity_cls(int cls_idx, bool old_allo = false) const override __attribute__((hot));
+
+    /**
+     * @brief Compute covariate similarity for a single observation in a cluster
+     *
+     * Computes the predictive contribution when adding observation obs_idx to
+     * cluster cls_idx, excluding obs_idx itself from the cluster counts. O(1).
+     *
+     * @param obs_idx Index of the observation
+     * @param cls_idx Index of the cluster (-1 for a new cluster)
+     * @return Log predictive density contribution
+     */
+    double compute_similarity_obs(int obs_idx, int cls_idx) const override __attribute__((hot));
+
+    /**
+     * @brief Compute covariate similarity contributions for all existing clusters
+     *
+     * Computes the predictive contributions for adding observation obs_idx
+     * to each existing cluster, from the cached counts in O(K).
+     *
+     * @param obs_idx Index of the observation
+     * @return Vector of log predictive density contributions for each cluster
+     */
+    Eigen::VectorXd compute_similarity_obs(int obs_idx) const override __attribute__((hot));
+
+    /**
+     * @brief Adds the similarity contributions of obs_idx for every existing cluster to out
+     * @see Module::add_similarity_obs()
+     */
+    void add_similarity_obs(int obs_idx, Eigen::Ref<Eigen::VectorXd> out) const override __attribute__((hot));
+
+    /**
+     * @brief Heap bytes of the priors
+     * @see MemoryReport
+     */
+    std::size_t memory_bytes() const override {
+        return MemoryReport::bytes(prior_alpha) + MemoryReport::bytes(lgamma_alpha_count) + MemoryReport::bytes(log_alpha_count);
+    }
+
+    /** @} */
+};
@@ -21,6 +21,7 @@ ContinuosCovariatesModule::compute_cluster_statistics(const Eigen::Ref<const Eig
 }
 
 double ContinuosCovariatesModule::compute_similarity_cls(int cls_idx, bool old_allo) const {
+    PROFILE_SCOPE(ModuleSimilarityCls);
     ClusterStats stats;
 
     if (old_allo) {
@@ -28,7 +29,7 @@ double ContinuosCovariatesModule::compute_similarity_cls(int cls_idx, bool old_a
         stats = compute_cluster_statistics(Eigen::Map<const Eigen::VectorXi>(old_cls_allo.data(), old_cls_allo.size()));
 
     } else {
-        const Eigen::VectorXi &obs = data.get_cluster_assignments_ref(cls_idx);
+        const auto obs = data.get_cluster_assignments_ref(cls_idx);
         stats = compute_cluster_statistics(obs);
     }
 
@@ -36,6 +37,7 @@ double ContinuosCovariatesModule::compute_similarity_cls(int cls_idx, bool old_a
 }
 
 double ContinuosCovariatesModule::compute_similarity_obs(int obs_idx, int cls_idx) const {
+    PROFILE_SCOPE(ModuleSimilarityObs);
 
     ClusterStats base_stats;
 
@@ -48,12 +50,14 @@ double ContinuosCovariatesModule::compute_similarity_obs(int obs_idx, int cls_id
     return compute_log_predictive_likelihood(base_stats, covariate_val);
 }
 
-Eigen::VectorXd ContinuosCovariatesModule::compute_similarity_obs(int obs_idx) const {
+void ContinuosCovariatesModule::add_similarity_obs(int obs_idx, Eigen::Ref<Eigen::VectorXd> out) const {
+    PROFILE_SCOPE(ModuleSimilarityObs);
     const Eigen::VectorXi &allocations = data.get_allocations();
     const int num_clusters = data.get_K();
 
     // Compute all cluster statistics once
-    std::vector<ClusterStats> all_stats(num_clusters);
+    std::vector<ClusterStats> &all_stats = cluster_stats_buf;
+    all_stats.assign(num_clusters, ClusterStats());
     for (int i = 0; i < allocations.size(); ++i) {
         int k = allocations(i);
         if (k < 0)
@@ -64,15 +68,17 @@ Eigen::VectorXd ContinuosCovariatesModule::compute_similarity_obs(int obs_idx) c
         all_stats[k].sumsq += val * val;
     }
 
-    // Compute log similarities for each cluster
-    Eigen::VectorXd log_similarities(num_clusters);
     const double obs_age = continuos_covariate_data(obs_idx);
     for (int k = 0; k < num_clusters; ++k) {
         ClusterStats &stats = all_stats[k];
 
-        log_similarities(k) = compute_log_predictive_likelihood(stats, obs_age);
+        out(k) += compute_log_predictive_likelihood(stats, obs_age);
     }
+}
 
+Eigen::VectorXd ContinuosCovariatesModule::compute_similarity_obs(int obs_idx) const {
+    Eigen::VectorXd log_similarities = Eigen::VectorXd::Zero(data.get_K());
+    ContinuosCovariatesModule::add_similarity_obs(obs_idx, log_similarities);
     return log_similarities;
 }
 
@@ -100,12 +106,7 @@ double ContinuosCovariatesModule::compute_log_marginal_likelihood_NNIG(const Clu
     const double one_plus_nB = 1.0 + n_dbl * B;
     const double S_n = S0 + 0.5 * ss + 0.5 * (n_dbl / one_plus_nB) * dev * dev;
 
-    double lgamma_nu_n_temp;
-    if (stats.n <= lgamma_nu_n.size() - 1) {
-        lgamma_nu_n_temp = lgamma_nu_n[stats.n];
-    } else {
-        lgamma_nu_n_temp = std::lgamma(nu + 0.5 * n_dbl);
-    }
+    const double lgamma_nu_n_temp = lgamma_nu_n[stats.n];
 
     // log g(S) = log Γ(ν + n/2) - log Γ(ν) - n/2 log(2π)
     //            - 1/2 log(1+nB) + ν log(S₀) - (ν + n/2) log(S_n)
@@ -133,12 +134,7 @@ double ContinuosCovariatesModule::compute_log_marginal_likelihood_NN(const Clust
     const double dev = xbar - m;
 
     // Log of posterior variance: log(τ_j) = log(B) + log(v) - log(v + n_j B)
-    double log_v_plus_nB_temp;
-    if (stats.n <= log_v_plus_nB.size() - 1) {
-        log_v_plus_nB_temp = log_v_plus_nB[stats.n];
-    } else {
-        log_v_plus_nB_temp = std::log(v + n_dbl * B);
-    }
+    const double log_v_plus_nB_temp = log_v_plus_nB[stats.n];
 
     const double log_tau_j = log_B + log_v - log_v_plus_nB_temp;
 
@@ -197,12 +193,7 @@ double ContinuosCovariatesModule::compute_predictive_NNIG(const ClusterStats &st
     double nu_n = nu + 0.5 * n_dbl;
 
     // Log of Gamma ratio: lgamma(nu_n + 0.5) - lgamma(nu_n)
-    double lgamma_diff;
-    if (stats.n + 1 < lgamma_nu_n.size()) {
-        lgamma_diff = lgamma_nu_n[stats.n + 1] - lgamma_nu_n[stats.n];
-    } else {
-        lgamma_diff = std::lgamma(nu_n + 0.5) - std::lgamma(nu_n);
-    }
+    const double lgamma_diff = lgamma_nu_n[stats.n + 1] - lgamma_nu_n[stats.n];
 
     return lgamma_diff - 0.5 * std::log(2.0 * M_PI) -
            0.5 * std::log(one_plus_next_nB / one_plus_nB)  // Scale inflation term
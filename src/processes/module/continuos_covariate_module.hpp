@@ -5,6 +5,7 @@
 
 #pragma once
 
+#include "../../utils/CountTables.hpp"
 #include "../../utils/Data.hpp"
 #include "../../utils/Module.hpp"
 #include "Eigen/Dense"
@@ -212,11 +213,13 @@ protected:
     const double lgamma_nu; ///< log Gamma(ν) for NNIG model (v ~ IG(ν, S₀))
     const double nu_logS0;  ///< ν log(S₀) for NNIG model (v ~ IG(ν, S₀))
 
-    std::vector<double> log_v_plus_nB; ///< Cache for log(v_plus_nB) for NN
-    std::vector<double> lgamma_nu_n;   ///< Cache for lgamma(nu_n) for NNIG
+    CountTable log_v_plus_nB; ///< log(v + n B) by cluster size for NN, shared through CountTables
+    CountTable lgamma_nu_n;   ///< lgamma(nu + n / 2) by cluster size for NNIG, shared through CountTables
 
     /** @} */
 
+    mutable std::vector<ClusterStats> cluster_stats_buf; ///< Per-cluster statistics, scratch of add_similarity_obs()
+
 public:
     /**
      * @brief Constructor for ContinuosCovariatesModule
@@ -235,22 +238,16 @@ public:
     ContinuosCovariatesModule(const Data &data_, const Eigen::VectorXd covariates_data_, bool fixed_v_, double m_ = 0,
                               double B_ = 1.0, double v_ = 1.0, double nu_ = 1.0, double S0_ = 1.0,
                               const Eigen::VectorXi *old_alloc_provider = nullptr,
-                              const std::unordered_map<int, std::vector<int>> *old_cluster_members_provider_ = nullptr)
+                              const ClusterMembers *old_cluster_members_provider_ = nullptr)
         : continuos_covariate_data(covariates_data_), fixed_v(fixed_v_), m(m_), B(B_), v(v_), nu(nu_), S0(S0_),
           data(data_), Module(old_alloc_provider, old_cluster_members_provider_), Bv(B * v), log_B(std::log(B)),
           log_v(std::log(v)), const_term(-0.5 * std::log(2.0 * M_PI)), lgamma_nu(std::lgamma(nu)),
           nu_logS0(nu * std::log(S0)) {
-        // Precompute caches for efficiency if needed
+        // Shared tables of the terms indexed by cluster size
         if (fixed_v) {
-            log_v_plus_nB.reserve(data_.get_n() + 1);
-            for (int n = 0; n <= data_.get_n(); ++n) {
-                log_v_plus_nB.push_back(std::log(v + n * B));
-            }
+            log_v_plus_nB = CountTables::shared().log(v, B, data_.get_n() + 1);
         } else {
-            lgamma_nu_n.reserve(data_.get_n() + 1);
-            for (int n = 0; n <= data_.get_n(); ++n) {
-                lgamma_nu_n.push_back(std::lgamma(nu + 0.5 * static_cast<double>(n)));
-            }
+            lgamma_nu_n = CountTables::shared().lgamma(nu, 0.5, data_.get_n() + 1);
         }
     }
 
@@ -307,5 +304,19 @@ public:
      */
     Eigen::VectorXd compute_similarity_obs(int obs_idx) const override __attribute__((hot));
 
+    /**
+     * @brief Adds the similarity contributions of obs_idx for every existing cluster to out
+     * @see Module::add_similarity_obs()
+     */
+    void add_similarity_obs(int obs_idx, Eigen::Ref<Eigen::VectorXd> out) const override __attribute__((hot));
+
+    /**
+     * @brief Heap bytes of the copy of the covariate and the scratch
+     * @see MemoryReport
+     */
+    std::size_t memory_bytes() const override {
+        return MemoryReport::bytes(continuos_covariate_data) + MemoryReport::bytes(cluster_stats_buf);
+    }
+
     /** @} */
 };
\ No newline at end of file
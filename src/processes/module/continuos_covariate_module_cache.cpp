@@ -4,6 +4,8 @@
  */
 
 #include "continuos_covariate_module_cache.hpp"
+#include "../../utils/cpu_dispatch.hpp"
+#include <algorithm>
 
 ContinuosCache::ClusterStats
 ContinuosCovariatesModuleCache::compute_cluster_statistics(const Eigen::Ref<const Eigen::VectorXi> obs) const {
@@ -21,6 +23,7 @@ ContinuosCovariatesModuleCache::compute_cluster_statistics(const Eigen::Ref<cons
 }
 
 double ContinuosCovariatesModuleCache::compute_similarity_cls(int cls_idx, bool old_allo) const {
+    PROFILE_SCOPE(ModuleSimilarityCls);
 
     if (old_allo) {
         ContinuosCache::ClusterStats stats;
@@ -29,13 +32,13 @@ double ContinuosCovariatesModuleCache::compute_similarity_cls(int cls_idx, bool
         return compute_log_marginal_likelihood(stats);
 
     } else {
-        const Eigen::VectorXi &obs = data.get_cluster_assignments_ref(cls_idx);
         const auto &stats = continuos_cache.get_cluster_stats_ref(cls_idx);
         return compute_log_marginal_likelihood(stats);
     }
 }
 
 double ContinuosCovariatesModuleCache::compute_similarity_obs(int obs_idx, int cls_idx) const {
+    PROFILE_SCOPE(ModuleSimilarityObs);
 
     ContinuosCache::ClusterStats base_stats;
 
@@ -48,18 +51,41 @@ double ContinuosCovariatesModuleCache::compute_similarity_obs(int obs_idx, int c
     return compute_log_predictive_likelihood(base_stats, covariate_val);
 }
 
-Eigen::VectorXd ContinuosCovariatesModuleCache::compute_similarity_obs(int obs_idx) const {
+void ContinuosCovariatesModuleCache::add_similarity_obs(int obs_idx, Eigen::Ref<Eigen::VectorXd> out) const {
+    PROFILE_SCOPE(ModuleSimilarityObs);
 
     const int num_clusters = data.get_K();
-    // Compute log similarities for each cluster
-    Eigen::VectorXd log_similarities(num_clusters);
     const double covariate_val = continuos_cache.continuos_covariates(obs_idx);
 
-    for (int k = 0; k < num_clusters; ++k) {
-        const ContinuosCache::ClusterStats &stats_ref = continuos_cache.get_cluster_stats_ref(k);
-        log_similarities(k) = compute_log_predictive_likelihood(stats_ref, covariate_val);
+    // The statistics of a chunk of clusters are copied into arrays for the dispatched kernel
+    // (cpu_dispatch), which evaluates the predictive of all of them in one vector loop
+    constexpr int chunk = 64;
+    double n[chunk], sum[chunk], sumsq[chunk];
+    const cpu_dispatch::Kernels &kernels = cpu_dispatch::kernels();
+    for (int first = 0; first < num_clusters; first += chunk) {
+        const int size = std::min(chunk, num_clusters - first);
+        for (int c = 0; c < size; ++c) {
+            const ContinuosCache::ClusterStats &stats_ref = continuos_cache.get_cluster_stats_ref(first + c);
+            n[c] = static_cast<double>(stats_ref.n);
+            sum[c] = stats_ref.sum;
+            sumsq[c] = stats_ref.sumsq;
+        }
+        double *chunk_out = out.data() + first;
+        if (fixed_v) {
+            kernels.nn_log_predictive(n, sum, size, covariate_val, m, B, v, chunk_out);
+        } else {
+            kernels.nnig_log_predictive(n, sum, sumsq, size, covariate_val, m, B, nu, S0, chunk_out);
+            for (int c = 0; c < size; ++c) {
+                const int n_c = continuos_cache.get_cluster_stats_ref(first + c).n;
+                chunk_out[c] += lgamma_nu_n[n_c + 1] - lgamma_nu_n[n_c];
+            }
+        }
     }
+}
 
+Eigen::VectorXd ContinuosCovariatesModuleCache::compute_similarity_obs(int obs_idx) const {
+    Eigen::VectorXd log_similarities = Eigen::VectorXd::Zero(data.get_K());
+    ContinuosCovariatesModuleCache::add_similarity_obs(obs_idx, log_similarities);
     return log_similarities;
 }
 
@@ -87,12 +113,7 @@ double ContinuosCovariatesModuleCache::compute_log_marginal_likelihood_NNIG(cons
     const double one_plus_nB = 1.0 + n_dbl * B;
     const double S_n = S0 + 0.5 * ss + 0.5 * (n_dbl / one_plus_nB) * dev * dev;
 
-    double lgamma_nu_n_temp;
-    if (stats.n <= lgamma_nu_n.size() - 1) {
-        lgamma_nu_n_temp = lgamma_nu_n[stats.n];
-    } else {
-        lgamma_nu_n_temp = std::lgamma(nu + 0.5 * n_dbl);
-    }
+    const double lgamma_nu_n_temp = lgamma_nu_n[stats.n];
 
     // log g(S) = log Γ(ν + n/2) - log Γ(ν) - n/2 log(2π)
     //            - 1/2 log(1+nB) + ν log(S₀) - (ν + n/2) log(S_n)
@@ -120,12 +141,7 @@ double ContinuosCovariatesModuleCache::compute_log_marginal_likelihood_NN(const
     const double dev = xbar - m;
 
     // Log of posterior variance: log(τ_j) = log(B) + log(v) - log(v + n_j B)
-    double log_v_plus_nB_temp;
-    if (stats.n <= log_v_plus_nB.size() - 1) {
-        log_v_plus_nB_temp = log_v_plus_nB[stats.n];
-    } else {
-        log_v_plus_nB_temp = std::log(v + n_dbl * B);
-    }
+    const double log_v_plus_nB_temp = log_v_plus_nB[stats.n];
 
     const double log_tau_j = log_B + log_v - log_v_plus_nB_temp;
 
@@ -184,12 +200,7 @@ double ContinuosCovariatesModuleCache::compute_predictive_NNIG(const ContinuosCa
     double nu_n = nu + 0.5 * n_dbl;
 
     // Log of Gamma ratio: lgamma(nu_n + 0.5) - lgamma(nu_n)
-    double lgamma_diff;
-    if (stats.n + 1 < lgamma_nu_n.size()) {
-        lgamma_diff = lgamma_nu_n[stats.n + 1] - lgamma_nu_n[stats.n];
-    } else {
-        lgamma_diff = std::lgamma(nu_n + 0.5) - std::lgamma(nu_n);
-    }
+    const double lgamma_diff = lgamma_nu_n[stats.n + 1] - lgamma_nu_n[stats.n];
 
     return lgamma_diff - 0.5 * std::log(2.0 * M_PI) -
            0.5 * std::log(one_plus_next_nB / one_plus_nB)  // Scale inflation term
@@ -5,6 +5,7 @@
 
 #pragma once
 
+#include "../../utils/CountTables.hpp"
 #include "../../utils/Data.hpp"
 #include "../caches/continuos_cache.hpp"
 #include "../../utils/Module.hpp"
@@ -203,8 +204,8 @@ protected:
     const double lgamma_nu; ///< log Gamma(ν) for NNIG model (v ~ IG(ν, S₀))
     const double nu_logS0;  ///< ν log(S₀) for NNIG model (v ~ IG(ν, S₀))
 
-    std::vector<double> log_v_plus_nB; ///< Cache for log(v_plus_nB) for NN
-    std::vector<double> lgamma_nu_n;   ///< Cache for lgamma(nu_n) for NNIG
+    CountTable log_v_plus_nB; ///< log(v + n B) by cluster size for NN, shared through CountTables
+    CountTable lgamma_nu_n;   ///< lgamma(nu + n / 2) by cluster size for NNIG, shared through CountTables
 
     /** @} */
 
@@ -226,24 +227,18 @@ public:
     ContinuosCovariatesModuleCache(const Data &data_, const ContinuosCache &continuos_cache_, bool fixed_v_,
                                    double m_ = 0, double B_ = 1.0, double v_ = 1.0, double nu_ = 1.0, double S0_ = 1.0,
                                    const Eigen::VectorXi *old_alloc_provider = {},
-                                   const std::unordered_map<int, std::vector<int>> *old_cluster_members_provider_ = {})
+                                   const ClusterMembers *old_cluster_members_provider_ = {})
         : data(data_), continuos_cache(continuos_cache_), fixed_v(fixed_v_), m(m_), B(B_), v(v_), nu(nu_), S0(S0_),
           Module(old_alloc_provider, old_cluster_members_provider_),
           // Initialize constants here in the list
           Bv(B * v), log_B(std::log(B)), log_v(std::log(v)), const_term(-0.5 * std::log(2.0 * M_PI)),
           lgamma_nu(std::lgamma(nu)), nu_logS0(nu * std::log(S0)) {
 
-        // Precompute caches for efficiency if needed
+        // Shared tables of the terms indexed by cluster size
         if (fixed_v) {
-            log_v_plus_nB.reserve(data_.get_n() + 1);
-            for (int n = 0; n <= data_.get_n(); ++n) {
-                log_v_plus_nB.push_back(std::log(v + n * B));
-            }
+            log_v_plus_nB = CountTables::shared().log(v, B, data_.get_n() + 1);
         } else {
-            lgamma_nu_n.reserve(data_.get_n() + 1);
-            for (int n = 0; n <= data_.get_n(); ++n) {
-                lgamma_nu_n.push_back(std::lgamma(nu + 0.5 * static_cast<double>(n)));
-            }
+            lgamma_nu_n = CountTables::shared().lgamma(nu, 0.5, data_.get_n() + 1);
         }
     }
 
@@ -300,5 +295,39 @@ public:
      */
     Eigen::VectorXd compute_similarity_obs(int obs_idx) const;
 
+    /**
+     * @brief Adds the similarity contributions of obs_idx for every existing cluster to out
+     * @see Module::add_similarity_obs()
+     */
+    void add_similarity_obs(int obs_idx, Eigen::Ref<Eigen::VectorXd> out) const override;
+
+    /**
+     * @brief Heap bytes of the module: none, the statistics are in the ContinuosCache
+     * @see MemoryReport
+     */
+    std::size_t memory_bytes() const override {
+        return 0;
+    }
+
+    /** @} */
+
+    /**
+     * @name Prediction
+     * @{
+     */
+
+    /** @brief Cache of the covariate statistics read by the module */
+    const ContinuosCache &get_cache() const { return continuos_cache; }
+
+    /**
+     * @brief Log predictive density of a covariate value for a cluster with the given statistics
+     * (empty statistics: a new cluster), as compute_similarity_obs() for a point outside the data
+     * @param stats Statistics of the cluster, e.g. a copy of get_cache().get_cluster_stats(k)
+     * @param covariate_val Covariate value of the new observation
+     */
+    double log_predictive(const ContinuosCache::ClusterStats &stats, double covariate_val) const {
+        return compute_log_predictive_likelihood(stats, covariate_val);
+    }
+
     /** @} */
 };
\ No newline at end of file
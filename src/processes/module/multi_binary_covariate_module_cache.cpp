@@ -0,0 +1,135 @@
+/**
+ * @file multi_binary_covariate_module_cache.cpp
+ * @brief Implementation of `MultiBinaryCovariatesModuleCache`.
+ */
+
+#include "multi_binary_covariate_module_cache.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+std::vector<double> MultiBinaryCovariatesModuleCache::per_covariate(const Eigen::VectorXd &values, int d) {
+    if (values.size() != 1 && values.size() != d)
+        throw std::invalid_argument("MultiBinaryCovariatesModuleCache: hyperparameters need 1 or " +
+                                    std::to_string(d) + " values, got " + std::to_string(values.size()));
+    if (!(values.array() > 0.0).all())
+        throw std::invalid_argument("MultiBinaryCovariatesModuleCache: hyperparameters must be positive");
+    if (values.size() == 1)
+        return std::vector<double>(d, values(0));
+    return std::vector<double>(values.data(), values.data() + d);
+}
+
+void MultiBinaryCovariatesModuleCache::build_tables(int n) {
+    const int columns = shared_prior ? 1 : d;
+    const size_t cells = static_cast<size_t>(n + 1) * columns;
+    log_alpha_count.resize(cells);
+    log_beta_count.resize(cells);
+    lgamma_alpha_count.resize(cells);
+    lgamma_beta_count.resize(cells);
+    log_alpha_beta_size.assign(n + 1, 0.0);
+    lgamma_alpha_beta_size.assign(n + 1, 0.0);
+
+    for (int c = 0; c <= n; ++c) {
+        for (int j = 0; j < columns; ++j) {
+            const size_t cell = static_cast<size_t>(c) * columns + j;
+            log_alpha_count[cell] = std::log(prior_a[j] + c);
+            log_beta_count[cell] = std::log(prior_b[j] + c);
+            lgamma_alpha_count[cell] = std::lgamma(prior_a[j] + c);
+            lgamma_beta_count[cell] = std::lgamma(prior_b[j] + c);
+        }
+    }
+    for (int m = 0; m <= n; ++m) {
+        for (int j = 0; j < d; ++j) {
+            log_alpha_beta_size[m] += std::log(prior_a[j] + prior_b[j] + m);
+            lgamma_alpha_beta_size[m] += std::lgamma(prior_a[j] + prior_b[j] + m);
+        }
+    }
+    log_beta_prior = 0.0;
+    for (int j = 0; j < d; ++j)
+        log_beta_prior += std::lgamma(prior_a[j]) + std::lgamma(prior_b[j]) - std::lgamma(prior_a[j] + prior_b[j]);
+}
+
+const int *MultiBinaryCovariatesModuleCache::unpack(int obs_idx) const {
+    const uint64_t *row = cache.get_bits(obs_idx);
+    int *x = point_buf.data();
+    for (int j = 0; j < d; ++j)
+        x[j] = static_cast<int>((row[j / 64] >> (j % 64)) & 1);
+    return x;
+}
+
+double MultiBinaryCovariatesModuleCache::log_marginal(int count, const int *successes) const {
+    // If the cluster is empty, return 0 similarity
+    if (count == 0)
+        return 0.0;
+
+    const size_t cs = count_stride, js = covariate_stride;
+    double total = 0.0;
+    for (int j = 0; j < d; ++j)
+        total += lgamma_alpha_count[successes[j] * cs + j * js] +
+                 lgamma_beta_count[(count - successes[j]) * cs + j * js];
+    return total - lgamma_alpha_beta_size[count] - log_beta_prior;
+}
+
+double MultiBinaryCovariatesModuleCache::compute_similarity_cls(int cls_idx, bool old_allo) const {
+    PROFILE_SCOPE(ModuleSimilarityCls);
+
+    if (old_allo && old_cluster_members_provider) {
+        // The cache follows the current allocations: count the old members directly
+        const auto members = cluster_members_view(*old_cluster_members_provider, cls_idx);
+        int *s = successes_buf.data();
+        std::fill(successes_buf.begin(), successes_buf.end(), 0);
+        for (int i = 0; i < members.size(); ++i) {
+            const uint64_t *row = cache.get_bits(members(i));
+            for (int w = 0; w < cache.words; ++w) {
+                for (uint64_t bits = row[w]; bits; bits &= bits - 1)
+                    ++s[64 * w + __builtin_ctzll(bits)];
+            }
+        }
+        return log_marginal(members.size(), s);
+    }
+
+    return log_marginal(cache.get_count(cls_idx), cache.get_successes(cls_idx));
+}
+
+double MultiBinaryCovariatesModuleCache::compute_similarity_obs(int obs_idx, int cls_idx) const {
+    PROFILE_SCOPE(ModuleSimilarityObs);
+    const int *x = unpack(obs_idx);
+
+    // Handle new cluster case
+    if (cls_idx < 0 || cls_idx >= data.get_K())
+        return log_predictive(x, 0, zeros.data());
+
+    const int *s = cache.get_successes(cls_idx);
+    if (data.get_allocations()(obs_idx) != cls_idx)
+        return log_predictive(x, cache.get_count(cls_idx), s);
+
+    // Leave obs_idx out of its own cluster
+    for (int j = 0; j < d; ++j)
+        successes_buf[j] = s[j] - x[j];
+    return log_predictive(x, cache.get_count(cls_idx) - 1, successes_buf.data());
+}
+
+void MultiBinaryCovariatesModuleCache::add_similarity_obs(int obs_idx, Eigen::Ref<Eigen::VectorXd> out) const {
+    PROFILE_SCOPE(ModuleSimilarityObs);
+    const int num_clusters = data.get_K();
+    const int current_cluster = data.get_allocations()(obs_idx);
+    const int *x = unpack(obs_idx);
+
+    for (int k = 0; k < num_clusters; ++k) {
+        if (k != current_cluster) {
+            out(k) += log_predictive(x, cache.get_count(k), cache.get_successes(k));
+            continue;
+        }
+        // Leave obs_idx out of its own cluster
+        const int *s = cache.get_successes(k);
+        for (int j = 0; j < d; ++j)
+            successes_buf[j] = s[j] - x[j];
+        out(k) += log_predictive(x, cache.get_count(k) - 1, successes_buf.data());
+    }
+}
+
+Eigen::VectorXd MultiBinaryCovariatesModuleCache::compute_similarity_obs(int obs_idx) const {
+    Eigen::VectorXd log_similarities = Eigen::VectorXd::Zero(data.get_K());
+    MultiBinaryCovariatesModuleCache::add_similarity_obs(obs_idx, log_similarities);
+    return log_similarities;
+}
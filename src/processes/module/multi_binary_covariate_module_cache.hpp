@@ -0,0 +1,220 @@
+/**
+ * @file multi_binary_covariate_module_cache.hpp
+ * @brief Covariate-related computations for several binary covariates at once.
+ */
+
+#pragma once
+
+#include "../../utils/Data.hpp"
+#include "../../utils/Module.hpp"
+#include "../caches/multi_binary_cache.hpp"
+#include <cmath>
+#include <vector>
+
+/**
+ * @class MultiBinaryCovariatesModuleCache
+ * @brief Module for d binary covariates with independent Beta-Bernoulli models.
+ *
+ * Same Beta-Binomial model as BinaryCovariatesModuleCache, applied to each covariate with its own
+ * prior: the covariates are independent given the cluster, so every score is the sum over the d
+ * covariates of the corresponding scalar score, and equals the sum of d stacked
+ * BinaryCovariatesModuleCache up to rounding.
+ *
+ * The statistics come from one MultiBinaryCache. log(alpha_j + c), log(beta_j + c) and their lgamma
+ * are tabulated for every count c of successes or failures, and the sums over the covariates of
+ * log(alpha_j + beta_j + m) and lgamma(alpha_j + beta_j + m) for every cluster size m. A point is
+ * unpacked once per call, then scored against every cluster in a single pass over the contiguous
+ * successes of the clusters, with a branch-free inner loop over the covariates that selects the
+ * success or failure term. With one prior shared by all the covariates the tables hold one column
+ * (n + 1 values each) instead of d.
+ */
+class MultiBinaryCovariatesModuleCache : public Module {
+protected:
+    /**
+     * @name Module References
+     * @{
+     */
+    /** @brief Reference to data object with cluster assignments */
+    const Data &data;
+
+    const MultiBinaryCache &cache; ///< Reference to covariate cache for precomputed stats
+
+    /** @} */
+
+    /**
+     * @name Data used
+     * @{
+     */
+    const int d;                          ///< Number of covariates
+    const std::vector<double> prior_a;    ///< Prior alpha of each covariate (successes)
+    const std::vector<double> prior_b;    ///< Prior beta of each covariate (failures)
+    const bool shared_prior;              ///< Whether all the covariates have the same prior
+    const size_t count_stride;            ///< Stride of the count in the tables (1 if shared_prior, else d)
+    const size_t covariate_stride;        ///< Stride of the covariate in the tables (0 if shared_prior, else 1)
+
+    /** @} */
+
+    /**
+     * @name Precomputed values
+     * @{
+     */
+
+    // Per count c and covariate j, at [c * count_stride + j * covariate_stride]
+    std::vector<double> log_alpha_count;    ///< log(alpha_j + c)
+    std::vector<double> log_beta_count;     ///< log(beta_j + c)
+    std::vector<double> lgamma_alpha_count; ///< lgamma(alpha_j + c)
+    std::vector<double> lgamma_beta_count;  ///< lgamma(beta_j + c)
+
+    // Per cluster size m, summed over the covariates
+    std::vector<double> log_alpha_beta_size;    ///< sum_j log(alpha_j + beta_j + m)
+    std::vector<double> lgamma_alpha_beta_size; ///< sum_j lgamma(alpha_j + beta_j + m)
+
+    double log_beta_prior = 0.0; ///< sum_j log B(alpha_j, beta_j)
+
+    std::vector<int> zeros; ///< Successes of an empty cluster (d zeros)
+
+    /** @} */
+
+    /** @name Scratch buffers (not reentrant)
+     * @{
+     */
+    mutable std::vector<int> point_buf;     ///< Unpacked covariates of the scored point
+    mutable std::vector<int> successes_buf; ///< Successes of a cluster without the point, or of old members
+    /** @} */
+
+    /**
+     * @name Helper Methods
+     * @{
+     */
+
+    /**
+     * @brief Broadcasts a hyperparameter of length 1 to the d covariates
+     * @param values Hyperparameter, of length 1 or d
+     * @param d Number of covariates
+     * @throws std::invalid_argument if the length is neither 1 nor d, or a value is not positive
+     */
+    static std::vector<double> per_covariate(const Eigen::VectorXd &values, int d);
+
+    /**
+     * @brief Fills the tables indexed by count and cluster size
+     * @param n Number of observations
+     */
+    void build_tables(int n);
+
+    /**
+     * @brief Unpacks the covariates of a point into point_buf
+     * @param obs_idx Index of the observation
+     * @return point_buf, d values 0 or 1
+     */
+    const int *unpack(int obs_idx) const;
+
+    /**
+     * @brief Log predictive probability of a point given the statistics of a cluster, summed over covariates
+     * @param x Covariates of the point (d values 0 or 1)
+     * @param count Cluster size, 0 <= count <= n
+     * @param successes Successes of the covariates over the cluster (d values)
+     */
+    inline double log_predictive(const int *__restrict__ x, int count, const int *__restrict__ successes) const
+        __attribute__((hot, always_inline)) {
+        const double *__restrict__ log_a = log_alpha_count.data();
+        const double *__restrict__ log_b = log_beta_count.data();
+        const size_t cs = count_stride, js = covariate_stride;
+        double total = 0.0;
+
+#pragma omp simd reduction(+ : total)
+        for (int j = 0; j < d; ++j) {
+            // (alpha_j + s_j) / (alpha_j + beta_j + m) for a 1, (beta_j + m - s_j) / (alpha_j + beta_j + m) for a 0
+            const double success = log_a[successes[j] * cs + j * js];
+            const double failure = log_b[(count - successes[j]) * cs + j * js];
+            total += x[j] ? success : failure;
+        }
+        return total - log_alpha_beta_size[count];
+    }
+
+    /**
+     * @brief Log marginal likelihood of a cluster from its statistics, summed over covariates
+     * @param count Cluster size
+     * @param successes Successes of the covariates over the cluster (d values)
+     */
+    double log_marginal(int count, const int *successes) const __attribute__((hot));
+
+    /** @} */
+
+public:
+    /**
+     * @brief Constructor for MultiBinaryCovariatesModuleCache
+     *
+     * Each hyperparameter is either one value shared by all covariates or one value per covariate.
+     *
+     * @param data_ Reference to Data object with cluster assignments
+     * @param cache_ Reference to MultiBinaryCache for precomputed stats
+     * @param prior_a_ Prior alpha parameters of the Beta-Binomial models (successes)
+     * @param prior_b_ Prior beta parameters of the Beta-Binomial models (failures)
+     * @param old_alloc_provider function to access old allocations
+     * @param old_cluster_members_provider_ function to access old cluster members
+     * @throws std::invalid_argument if a hyperparameter has neither 1 nor d values, or is not positive
+     */
+    MultiBinaryCovariatesModuleCache(const Data &data_, const MultiBinaryCache &cache_, const Eigen::VectorXd &prior_a_,
+                                     const Eigen::VectorXd &prior_b_, const Eigen::VectorXi *old_alloc_provider = {},
+                                     const ClusterMembers *old_cluster_members_provider_ = {})
+        : Module(old_alloc_provider, old_cluster_members_provider_), data(data_), cache(cache_), d(cache_.d),
+          prior_a(per_covariate(prior_a_, d)), prior_b(per_covariate(prior_b_, d)),
+          shared_prior(prior_a_.size() == 1 && prior_b_.size() == 1), count_stride(shared_prior ? 1 : d),
+          covariate_stride(shared_prior ? 0 : 1), zeros(d, 0), point_buf(d), successes_buf(d) {
+        build_tables(data.get_n());
+    }
+
+    /**
+     * @name Similarity Computation Methods
+     * @{
+     */
+
+    /**
+     * @brief Compute covariate similarity contribution for a cluster
+     *
+     * Sum over the covariates of the log marginal likelihood of BinaryCovariatesModuleCache, O(d).
+     *
+     * @param cls_idx Index of the cluster (0 to K-1)
+     * @param old_allo If true, uses the old cluster members (statistics recomputed, O(n_k words + ones));
+     *                 if false, uses the cached statistics (default: false)
+     * @return Log marginal likelihood contribution (similarity score)
+     */
+    double compute_similarity_cls(int cls_idx, bool old_allo = false) const override;
+
+    /**
+     * @brief Compute covariate similarity for a single observation in a cluster
+     *
+     * @param obs_idx Index of the observation (left out of its own cluster)
+     * @param cls_idx Index of the cluster (-1 or K for a new cluster)
+     * @return Log predictive probability, summed over the covariates, O(d)
+     */
+    double compute_similarity_obs(int obs_idx, int cls_idx) const override __attribute__((hot));
+
+    /**
+     * @brief Compute covariate similarity contributions for all existing clusters
+     *
+     * @param obs_idx Index of the observation
+     * @return Log predictive probabilities for each cluster, O(K d)
+     */
+    Eigen::VectorXd compute_similarity_obs(int obs_idx) const override __attribute__((hot));
+
+    /**
+     * @brief Adds the similarity contributions of obs_idx for every existing cluster to out
+     * @see Module::add_similarity_obs()
+     */
+    void add_similarity_obs(int obs_idx, Eigen::Ref<Eigen::VectorXd> out) const override __attribute__((hot));
+
+    /**
+     * @brief Heap bytes of the priors and the tables by count and cluster size
+     * @see MemoryReport
+     */
+    std::size_t memory_bytes() const override {
+        return MemoryReport::bytes(prior_a) + MemoryReport::bytes(prior_b) + MemoryReport::bytes(log_alpha_count) +
+               MemoryReport::bytes(log_beta_count) + MemoryReport::bytes(lgamma_alpha_count) +
+               MemoryReport::bytes(lgamma_beta_count) + MemoryReport::bytes(log_alpha_beta_size) +
+               MemoryReport::bytes(lgamma_alpha_beta_size) + MemoryReport::bytes(zeros) +
+               MemoryReport::bytes(point_buf) + MemoryReport::bytes(successes_buf);
+    }
+
+    /** @} */
+};
@@ -0,0 +1,136 @@
+/**
+ * @file multi_continuos_covariate_module_cache.cpp
+ * @brief Implementation of `MultiContinuosCovariatesModuleCache`.
+ */
+
+#include "multi_continuos_covariate_module_cache.hpp"
+#include <stdexcept>
+#include <string>
+
+std::vector<double> MultiContinuosCovariatesModuleCache::per_covariate(const Eigen::VectorXd &values, int d) {
+    if (values.size() == 1)
+        return std::vector<double>(d, values(0));
+    if (values.size() != d)
+        throw std::invalid_argument("MultiContinuosCovariatesModuleCache: hyperparameters need 1 or " +
+                                    std::to_string(d) + " values, got " + std::to_string(values.size()));
+    return std::vector<double>(values.data(), values.data() + d);
+}
+
+void MultiContinuosCovariatesModuleCache::build_tables(int n) {
+    const size_t cells = static_cast<size_t>(n + 1) * d;
+    const double log_2pi = std::log(2.0 * M_PI);
+    inv_one_plus_nB.resize(cells);
+    inv_size.resize(cells);
+    pred_const.resize(cells);
+    pred_scale.resize(cells);
+    marg_const.resize(cells);
+    marg_scale.resize(cells);
+    if (!fixed_v)
+        pred_power.resize(cells);
+
+    for (int size = 0; size <= n; ++size) {
+        const double n_dbl = static_cast<double>(size);
+        for (int j = 0; j < d; ++j) {
+            const size_t cell = static_cast<size_t>(size) * d + j;
+            const double one_plus_nB = 1.0 + n_dbl * B[j];
+            const double one_plus_next_nB = one_plus_nB + B[j];
+            inv_one_plus_nB[cell] = 1.0 / one_plus_nB;
+            inv_size[cell] = size > 0 ? 1.0 / n_dbl : 0.0;
+
+            if (fixed_v) {
+                // Predictive N(mu_n, v (1 + (n + 1) B) / (1 + nB))
+                const double sigma2_pred = v[j] * one_plus_next_nB / one_plus_nB;
+                pred_const[cell] = -0.5 * std::log(2.0 * M_PI * sigma2_pred);
+                pred_scale[cell] = 1.0 / sigma2_pred;
+
+                // Marginal: -n/2 log(2 pi) - n/2 log(v) - 1/2 log(B) + 1/2 log(tau), tau = Bv / (v + nB)
+                const double v_plus_nB = v[j] + n_dbl * B[j];
+                marg_const[cell] = -0.5 * n_dbl * log_2pi - 0.5 * (n_dbl - 1.0) * std::log(v[j]) -
+                                   0.5 * std::log(v_plus_nB);
+                marg_scale[cell] = 1.0 / v_plus_nB;
+            } else {
+                // Predictive Student-t: lgamma(nu_n + 1/2) - lgamma(nu_n) - 1/2 log(2 pi) - scale inflation
+                const double nu_n = nu[j] + 0.5 * n_dbl;
+                pred_const[cell] = std::lgamma(nu_n + 0.5) - std::lgamma(nu_n) - 0.5 * log_2pi -
+                                   0.5 * std::log(one_plus_next_nB / one_plus_nB);
+                pred_scale[cell] = one_plus_nB / one_plus_next_nB;
+                pred_power[cell] = nu_n + 0.5;
+
+                // Marginal: lgamma(nu_n) - lgamma(nu) - n/2 log(2 pi) - 1/2 log(1 + nB) + nu log(S0)
+                marg_const[cell] = std::lgamma(nu_n) - std::lgamma(nu[j]) - 0.5 * n_dbl * log_2pi -
+                                   0.5 * std::log(one_plus_nB) + nu[j] * std::log(S0[j]);
+                marg_scale[cell] = n_dbl / one_plus_nB;
+            }
+        }
+    }
+}
+
+double MultiContinuosCovariatesModuleCache::log_marginal(int count, const double *sum, const double *sumsq) const {
+    const size_t row = static_cast<size_t>(count) * d;
+    const double *c = marg_const.data() + row;
+    const double *scale = marg_scale.data() + row;
+    const double inv_n = inv_size[row];
+    const double n_dbl = static_cast<double>(count);
+    double total = 0.0;
+
+    for (int j = 0; j < d; ++j) {
+        const double xbar = sum[j] * inv_n;
+        const double ss = sumsq[j] - n_dbl * xbar * xbar; // Centered sum of squares
+        const double dev = xbar - m[j];
+        if (fixed_v) {
+            // - SS / (2v) - n (xbar - m)^2 / (2 (v + nB))
+            total += c[j] - 0.5 * (ss / v[j] + n_dbl * dev * dev * scale[j]);
+        } else {
+            // - (nu + n/2) log(S0 + SS/2 + n/(2(1+nB)) (xbar - m)^2)
+            const double S_n = S0[j] + 0.5 * ss + 0.5 * scale[j] * dev * dev;
+            total += c[j] - (nu[j] + 0.5 * n_dbl) * std::log(S_n);
+        }
+    }
+    return total;
+}
+
+double MultiContinuosCovariatesModuleCache::compute_similarity_cls(int cls_idx, bool old_allo) const {
+    PROFILE_SCOPE(ModuleSimilarityCls);
+
+    if (old_allo && old_cluster_members_provider) {
+        // The cache follows the current allocations: sum the old members directly
+        const auto members = cluster_members_view(*old_cluster_members_provider, cls_idx);
+        std::vector<double> sum(d, 0.0), sumsq(d, 0.0);
+        for (int i = 0; i < members.size(); ++i) {
+            const double *x = cache.get_covariates(members(i));
+            for (int j = 0; j < d; ++j) {
+                sum[j] += x[j];
+                sumsq[j] += x[j] * x[j];
+            }
+        }
+        return log_marginal(members.size(), sum.data(), sumsq.data());
+    }
+
+    return log_marginal(cache.get_count(cls_idx), cache.get_sums(cls_idx), cache.get_sumsqs(cls_idx));
+}
+
+double MultiContinuosCovariatesModuleCache::compute_similarity_obs(int obs_idx, int cls_idx) const {
+    PROFILE_SCOPE(ModuleSimilarityObs);
+    const double *x = cache.get_covariates(obs_idx);
+
+    // Handle new cluster case
+    if (cls_idx > -1 && cls_idx < data.get_K())
+        return log_predictive(x, cache.get_count(cls_idx), cache.get_sums(cls_idx), cache.get_sumsqs(cls_idx));
+    return log_predictive(x, 0, zeros.data(), zeros.data());
+}
+
+void MultiContinuosCovariatesModuleCache::add_similarity_obs(int obs_idx, Eigen::Ref<Eigen::VectorXd> out) const {
+    PROFILE_SCOPE(ModuleSimilarityObs);
+    const int num_clusters = data.get_K();
+    const double *x = cache.get_covariates(obs_idx);
+
+    for (int k = 0; k < num_clusters; ++k) {
+        out(k) += log_predictive(x, cache.get_count(k), cache.get_sums(k), cache.get_sumsqs(k));
+    }
+}
+
+Eigen::VectorXd MultiContinuosCovariatesModuleCache::compute_similarity_obs(int obs_idx) const {
+    Eigen::VectorXd log_similarities = Eigen::VectorXd::Zero(data.get_K());
+    MultiContinuosCovariatesModuleCache::add_similarity_obs(obs_idx, log_similarities);
+    return log_similarities;
+}
@@ -0,0 +1,229 @@
+/**
+ * @file multi_continuos_covariate_module_cache.hpp
+ * @brief Covariate-related computations for several continuous covariates at once.
+ */
+
+#pragma once
+
+#include "../../utils/Data.hpp"
+#include "../../utils/Module.hpp"
+#include "../caches/multi_continuos_cache.hpp"
+#include <cmath>
+#include <vector>
+
+/**
+ * @class MultiContinuosCovariatesModuleCache
+ * @brief Module for d continuous covariates with independent conjugate priors.
+ *
+ * Same Normal-Normal (fixed_v) or Normal-Normal-InverseGamma model as ContinuosCovariatesModuleCache,
+ * applied to each covariate with its own hyperparameters: the covariates are independent given the
+ * cluster (diagonal prior and observation covariance), so every score is the sum over the d covariates
+ * of the corresponding scalar score, and equals the sum of d stacked ContinuosCovariatesModuleCache up
+ * to rounding.
+ *
+ * The statistics come from one MultiContinuosCache. All the terms that depend only on the cluster size
+ * and the covariate are tabulated once as flat (n + 1) x d tables, row m holding the d values for a
+ * cluster of m members, so scoring a point against all clusters is a single pass over the contiguous
+ * per-cluster statistics with a branch-free inner loop over the covariates that the compiler vectorizes.
+ */
+class MultiContinuosCovariatesModuleCache : public Module {
+protected:
+    /**
+     * @name Module References
+     * @{
+     */
+    /** @brief Reference to data object with cluster assignments */
+    const Data &data;
+
+    const MultiContinuosCache &cache; ///< Reference to covariate cache for precomputed stats
+
+    /** @} */
+
+    /**
+     * @name Data used
+     * @{
+     */
+    const int d;                 ///< Number of covariates
+    const bool fixed_v;          ///< Whether observation variances are fixed (NN) or random (NNIG)
+    const std::vector<double> m;  ///< Prior mean of each covariate
+    const std::vector<double> B;  ///< Prior variance of each covariate
+    const std::vector<double> v;  ///< Observation variance of each covariate
+    const std::vector<double> nu; ///< Prior shape parameter of each variance (NNIG)
+    const std::vector<double> S0; ///< Prior scale parameter of each variance (NNIG)
+
+    /** @} */
+
+    /**
+     * @name Precomputed values
+     * @{
+     */
+
+    // Per cluster size and covariate, at [m * d + j]
+    std::vector<double> inv_one_plus_nB; ///< 1 / (1 + m B)
+    std::vector<double> inv_size;        ///< 1 / m (0 for m = 0)
+    std::vector<double> pred_const;      ///< Predictive terms that do not depend on the point or the sums
+    std::vector<double> pred_scale;      ///< NN: 1 / predictive variance; NNIG: (1 + m B) / (1 + (m + 1) B)
+    std::vector<double> pred_power;      ///< NNIG: nu + (m + 1) / 2
+    std::vector<double> marg_const;      ///< Marginal terms that do not depend on the sums
+    std::vector<double> marg_scale;      ///< NN: 1 / (v + m B); NNIG: m / (1 + m B)
+
+    std::vector<double> zeros; ///< Statistics of an empty cluster (d zeros)
+
+    /** @} */
+
+    /**
+     * @name Helper Methods
+     * @{
+     */
+
+    /**
+     * @brief Broadcasts a hyperparameter of length 1 to the d covariates
+     * @param values Hyperparameter, of length 1 or d
+     * @param d Number of covariates
+     * @throws std::invalid_argument if the length is neither 1 nor d
+     */
+    static std::vector<double> per_covariate(const Eigen::VectorXd &values, int d);
+
+    /**
+     * @brief Fills the tables indexed by cluster size
+     * @param n Number of observations
+     */
+    void build_tables(int n);
+
+    /**
+     * @brief Log predictive density of a point given the statistics of a cluster, summed over covariates
+     * @param x Covariates of the point (d values)
+     * @param count Cluster size, 0 <= count <= n
+     * @param sum Sums of the covariates over the cluster (d values)
+     * @param sumsq Sums of the squared covariates over the cluster (d values)
+     */
+    inline double log_predictive(const double *__restrict__ x, int count, const double *__restrict__ sum,
+                                 const double *__restrict__ sumsq) const __attribute__((hot, always_inline)) {
+        const size_t row = static_cast<size_t>(count) * d;
+        const double *__restrict__ inv_1pnB = inv_one_plus_nB.data() + row;
+        const double *__restrict__ c = pred_const.data() + row;
+        const double *__restrict__ scale = pred_scale.data() + row;
+        const double *__restrict__ mean = m.data();
+        const double *__restrict__ var = B.data();
+        const double n_dbl = static_cast<double>(count);
+        double total = 0.0;
+
+        if (fixed_v) {
+#pragma omp simd reduction(+ : total)
+            for (int j = 0; j < d; ++j) {
+                // x_new | cluster ~ N((m + B sum) / (1 + nB), v (1 + (n + 1) B) / (1 + nB))
+                const double diff = x[j] - (mean[j] + var[j] * sum[j]) * inv_1pnB[j];
+                total += c[j] - 0.5 * diff * diff * scale[j];
+            }
+        } else {
+            const double *__restrict__ inv_n = inv_size.data() + row;
+            const double *__restrict__ power = pred_power.data() + row;
+            const double *__restrict__ scale0 = S0.data();
+#pragma omp simd reduction(+ : total)
+            for (int j = 0; j < d; ++j) {
+                // Posterior scale S_n = S0 + SS / 2 + n / (2 (1 + nB)) (xbar - m)^2 (S0 for an empty cluster)
+                const double xbar = sum[j] * inv_n[j];
+                const double dev = xbar - mean[j];
+                const double S_n =
+                    scale0[j] + 0.5 * (sumsq[j] - n_dbl * xbar * xbar) + 0.5 * n_dbl * inv_1pnB[j] * dev * dev;
+                // Student-t kernel of the update S_n -> S_n + delta_S brought by x_new
+                const double diff = x[j] - (mean[j] + var[j] * sum[j]) * inv_1pnB[j];
+                const double delta_S = 0.5 * diff * diff * scale[j];
+                total += c[j] - 0.5 * std::log(S_n) - power[j] * std::log(1.0 + delta_S / S_n);
+            }
+        }
+        return total;
+    }
+
+    /**
+     * @brief Log marginal likelihood of a cluster from its statistics, summed over covariates
+     * @param count Cluster size
+     * @param sum Sums of the covariates over the cluster (d values)
+     * @param sumsq Sums of the squared covariates over the cluster (d values)
+     */
+    double log_marginal(int count, const double *sum, const double *sumsq) const __attribute__((hot));
+
+    /** @} */
+
+public:
+    /**
+     * @brief Constructor for MultiContinuosCovariatesModuleCache
+     *
+     * Each hyperparameter is either one value shared by all covariates or one value per covariate.
+     *
+     * @param data_ Reference to Data object with cluster assignments
+     * @param cache_ Reference to MultiContinuosCache for precomputed stats
+     * @param fixed_v_ Whether observation variances are fixed (NN) or random (NNIG)
+     * @param m_ Prior means
+     * @param B_ Prior variances
+     * @param v_ Observation variances
+     * @param nu_ Prior shape parameters of the variances (NNIG)
+     * @param S0_ Prior scale parameters of the variances (NNIG)
+     * @param old_alloc_provider function to access old allocations
+     * @param old_cluster_members_provider_ function to access old cluster members
+     * @throws std::invalid_argument if a hyperparameter has neither 1 nor d values
+     */
+    MultiContinuosCovariatesModuleCache(const Data &data_, const MultiContinuosCache &cache_, bool fixed_v_,
+                                        const Eigen::VectorXd &m_, const Eigen::VectorXd &B_,
+                                        const Eigen::VectorXd &v_, const Eigen::VectorXd &nu_,
+                                        const Eigen::VectorXd &S0_, const Eigen::VectorXi *old_alloc_provider = {},
+                                        const ClusterMembers *old_cluster_members_provider_ = {})
+        : Module(old_alloc_provider, old_cluster_members_provider_), data(data_), cache(cache_), d(cache_.d),
+          fixed_v(fixed_v_), m(per_covariate(m_, d)), B(per_covariate(B_, d)), v(per_covariate(v_, d)),
+          nu(per_covariate(nu_, d)), S0(per_covariate(S0_, d)), zeros(d, 0.0) {
+        build_tables(data.get_n());
+    }
+
+    /**
+     * @name Similarity Computation Methods
+     * @{
+     */
+
+    /**
+     * @brief Compute covariate similarity contribution for a cluster
+     *
+     * Sum over the covariates of the log marginal likelihood of ContinuosCovariatesModuleCache, O(d).
+     *
+     * @param cls_idx Index of the cluster (0 to K-1)
+     * @param old_allo If true, uses the old cluster members (statistics recomputed, O(n_k d));
+     *                 if false, uses the cached statistics (default: false)
+     * @return Log marginal likelihood contribution (similarity score)
+     */
+    double compute_similarity_cls(int cls_idx, bool old_allo = false) const override;
+
+    /**
+     * @brief Compute covariate similarity for a single observation in a cluster
+     *
+     * @param obs_idx Index of the observation
+     * @param cls_idx Index of the cluster (-1 or K for a new cluster)
+     * @return Log predictive density, summed over the covariates, O(d)
+     */
+    double compute_similarity_obs(int obs_idx, int cls_idx) const override __attribute__((hot));
+
+    /**
+     * @brief Compute covariate similarity contributions for all existing clusters
+     *
+     * @param obs_idx Index of the observation
+     * @return Log predictive densities for each cluster, O(K d)
+     */
+    Eigen::VectorXd compute_similarity_obs(int obs_idx) const override __attribute__((hot));
+
+    /**
+     * @brief Adds the similarity contributions of obs_idx for every existing cluster to out
+     * @see Module::add_similarity_obs()
+     */
+    void add_similarity_obs(int obs_idx, Eigen::Ref<Eigen::VectorXd> out) const override __attribute__((hot));
+
+    /**
+     * @brief Heap bytes of the priors and the tables by cluster size
+     * @see MemoryReport
+     */
+    std::size_t memory_bytes() const override {
+        return MemoryReport::bytes(m) + MemoryReport::bytes(B) + MemoryReport::bytes(v) + MemoryReport::bytes(nu) +
+               MemoryReport::bytes(S0) + MemoryReport::bytes(inv_one_plus_nB) + MemoryReport::bytes(inv_size) +
+               MemoryReport::bytes(pred_const) + MemoryReport::bytes(pred_scale) + MemoryReport::bytes(pred_power) +
+               MemoryReport::bytes(marg_const) + MemoryReport::bytes(marg_scale) + MemoryReport::bytes(zeros);
+    }
+
+    /** @} */
+};
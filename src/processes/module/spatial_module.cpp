@@ -6,8 +6,9 @@
 #include "spatial_module.hpp"
 
 double SpatialModule::compute_similarity_obs(int obs_idx, int cls_idx) const {
+    PROFILE_SCOPE(ModuleSimilarityObs);
     int neighbors = 0;
-    const std::vector<int> &row = neighbor_cache[obs_idx];
+    const SparseAdjacency::Row row = neighbor_cache[obs_idx];
 
     // Iterate through cached neighbors and count those in the specified cluster
     for (size_t i = 0; i < row.size(); ++i) {
@@ -20,32 +21,16 @@ double SpatialModule::compute_similarity_obs(int obs_idx, int cls_idx) const {
     return spatial_weight * neighbors;
 }
 
-void SpatialModule::neighbor_cache_compute() {
-    const int N = data_module.get_n();
-    neighbor_cache.resize(N);
-
-    // For each observation, store indices of its neighbors (where W(i,j) == 1)
-    for (int obs_idx = 0; obs_idx < N; ++obs_idx) {
-        Eigen::RowVectorXi row = W.row(obs_idx);
-        neighbor_cache[obs_idx].reserve(row.sum());
-
-        for (int j = 0; j < row.size(); ++j) {
-            if (row(j) == 1) {
-                neighbor_cache[obs_idx].push_back(j);
-            }
-        }
-    }
-}
-
 double SpatialModule::compute_similarity_cls(int cls_idx, bool old_allo) const {
+    PROFILE_SCOPE(ModuleSimilarityCls);
 
-    const Eigen::VectorXi & cls_idx_allocations =
-        (old_allo && old_cluster_members_provider) ? Eigen::Map<const Eigen::VectorXi>(old_cluster_members_provider->at(cls_idx).data(), old_cluster_members_provider->at(cls_idx).size()) : data_module.get_cluster_assignments(cls_idx);
+    const Eigen::Map<const Eigen::VectorXi> cls_idx_allocations =
+        (old_allo && old_cluster_members_provider) ? cluster_members_view(*old_cluster_members_provider, cls_idx) : data_module.get_cluster_assignments(cls_idx);
 
     double total_neighbors = 0;
     for(auto && i : cls_idx_allocations){
         // Use cached neighbor indices instead of iterating over full adjacency matrix
-        const std::vector<int> &row = neighbor_cache[i];
+        const SparseAdjacency::Row row = neighbor_cache[i];
 
         // Count neighbors in each cluster
         for (size_t j = 0; j < row.size(); ++j) {
@@ -61,11 +46,13 @@ double SpatialModule::compute_similarity_cls(int cls_idx, bool old_allo) const {
     return spatial_weight * total_neighbors / 2; // Each edge counted twice
 }
 
-Eigen::VectorXd SpatialModule::compute_similarity_obs(int obs_idx) const {
-    Eigen::VectorXd cluster_adjacency = Eigen::VectorXd::Zero(data_module.get_K());
+void SpatialModule::add_similarity_obs(int obs_idx, Eigen::Ref<Eigen::VectorXd> out) const {
+    PROFILE_SCOPE(ModuleSimilarityObs);
+    std::vector<double> &cluster_adjacency = cluster_adjacency_buf;
+    cluster_adjacency.assign(data_module.get_K(), 0.0);
 
     // Use cached neighbor indices instead of iterating over full adjacency matrix
-    const std::vector<int> &row = neighbor_cache[obs_idx];
+    const SparseAdjacency::Row row = neighbor_cache[obs_idx];
 
     // Count neighbors in each cluster
     for (size_t i = 0; i < row.size(); ++i) {
@@ -73,9 +60,17 @@ Eigen::VectorXd SpatialModule::compute_similarity_obs(int obs_idx) const {
         int cluster_i = data_module.get_cluster_assignment(neighbor_idx);
 
         if (cluster_i != -1) {
-            cluster_adjacency(cluster_i) += spatial_weight;
+            cluster_adjacency[cluster_i] += spatial_weight;
         }
     }
 
+    for (int k = 0; k < data_module.get_K(); ++k) {
+        out(k) += cluster_adjacency[k];
+    }
+}
+
+Eigen::VectorXd SpatialModule::compute_similarity_obs(int obs_idx) const {
+    Eigen::VectorXd cluster_adjacency = Eigen::VectorXd::Zero(data_module.get_K());
+    SpatialModule::add_similarity_obs(obs_idx, cluster_adjacency);
     return cluster_adjacency;
-}
\ No newline at end of file
+}
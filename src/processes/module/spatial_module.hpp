@@ -7,6 +7,8 @@
 
 #include "../../utils/Data.hpp"
 #include "../../utils/Module.hpp"
+#include "../../utils/SparseAdjacency.hpp"
+#include <vector>
 
 /**
  * @class SpatialModule
@@ -14,56 +16,49 @@
  * information.
  *
  * This class offers utility functions to compute neighbor counts based on an
- * adjacency matrix W, facilitating the incorporation of spatial dependencies
+ * adjacency graph W, facilitating the incorporation of spatial dependencies
  * in clustering algorithms. The neighbor relationships are cached at
  * construction time for efficient repeated access.
  */
 class SpatialModule : public Module {
 protected:
     /**
-     * @brief Cache storing neighbor indices for each observation.
+     * @brief Neighbor indices of each observation.
      *
-     * neighbor_cache[i] contains a vector of indices j where W(i,j) == 1.
-     * This avoids repeatedly scanning the full adjacency matrix during MCMC
-     * sampling.
+     * neighbor_cache[i] lists the indices j adjacent to i, stored as offsets into one flat
+     * array. This avoids repeatedly scanning a full adjacency matrix during MCMC sampling and
+     * keeps memory O(edges).
      */
-    std::vector<std::vector<int>> neighbor_cache;
-
-    /**
-     * @brief Precomputes and stores neighbor indices for all observations.
-     *
-     * This method initializes neighbor_cache by extracting non-zero entries
-     * from each row of the adjacency matrix W. Called once during construction
-     * to enable O(neighbors) instead of O(N) lookup time.
-     */
-    void neighbor_cache_compute();
+    const SparseAdjacency neighbor_cache;
 
     const Data &data_module;           ///< Reference to data object with cluster assignments
-    const Eigen::MatrixXi W;           ///< Reference to adjacency matrix W from covariates
     const double spatial_weight = 1.0; ///< Weighting factor for spatial similarity
 
+    mutable std::vector<double> cluster_adjacency_buf; ///< Neighbors per cluster, scratch of add_similarity_obs()
+
 public:
     /**
      * @brief Constructs a SpatialModule with parameter and data references.
      *
-     * Initializes the neighbor cache by calling neighbor_cache_compute().
-     *
      * @param data_ Reference to the Data object with cluster assignments.
-     * @param W_ Reference to the adjacency matrix W.
-     * matrix.
+     * @param adjacency Neighbor lists of the adjacency graph (see SparseAdjacency for the
+     * builders from dense, sparse or edge-list input).
      * @param spatial_coeff Weighting factor for spatial similarity.
      * @param old_alloc_provider function to access old allocations for
      * split-merge.
      * @param old_cluster_members_provider_ function to access old cluster members for
      * split-merge.
+     * @throws std::invalid_argument if the graph and the data differ in size
      */
-    SpatialModule(const Data &data_, const Eigen::MatrixXi W_, double spatial_coeff,
+    SpatialModule(const Data &data_, SparseAdjacency adjacency, double spatial_coeff,
                   const Eigen::VectorXi *old_alloc_provider = nullptr,
-                  const std::unordered_map<int, std::vector<int>> *old_cluster_members_provider_ = nullptr)
-        : W(W_), data_module(data_), spatial_weight(spatial_coeff),
-          Module(old_alloc_provider, old_cluster_members_provider_) {
+                  const ClusterMembers *old_cluster_members_provider_ = nullptr)
+        : Module(old_alloc_provider, old_cluster_members_provider_), neighbor_cache(std::move(adjacency)),
+          data_module(data_), spatial_weight(spatial_coeff) {
 
-        neighbor_cache_compute();
+        if (neighbor_cache.size() != data_module.get_n()) {
+            throw std::invalid_argument("SpatialModule: adjacency graph and data differ in size");
+        }
     }
 
     /**
@@ -82,6 +77,20 @@ public:
      */
     Eigen::VectorXd compute_similarity_obs(int obs_idx) const override;
 
+    /**
+     * @brief Adds the similarity contributions of obs_idx for every existing cluster to out
+     * @see Module::add_similarity_obs()
+     */
+    void add_similarity_obs(int obs_idx, Eigen::Ref<Eigen::VectorXd> out) const override;
+
+    /**
+     * @brief Heap bytes of the neighbour lists and the scratch
+     * @see MemoryReport
+     */
+    std::size_t memory_bytes() const override {
+        return neighbor_cache.memory_bytes() + MemoryReport::bytes(cluster_adjacency_buf);
+    }
+
     /**
      * @brief Counts internal edges within a cluster.
      *
@@ -6,21 +6,12 @@
 #include "spatial_module_cache.hpp"
 
 double SpatialModuleCache::compute_similarity_obs(int obs_idx, int cls_idx) const {
-    int neighbors = 0;
-    const std::vector<int> &row = cache.neighbor_cache[obs_idx];
-    const int *allocations = data_module.get_allocations().data();
-
-    for (size_t i = 0; i < row.size(); ++i) {
-        const int cluster_i = allocations[row[i]];
-        if (cluster_i == cls_idx && cluster_i != -1) {
-            ++neighbors;
-        }
-    }
-
-    return spatial_weight * neighbors;
+    PROFILE_SCOPE(ModuleSimilarityObs);
+    return spatial_weight * cache.neighbors_in_cluster(obs_idx, cls_idx);
 }
 
 double SpatialModuleCache::compute_similarity_cls(int cls_idx, bool old_allo) const {
+    PROFILE_SCOPE(ModuleSimilarityCls);
 
     if (old_allo && old_cluster_members_provider) {
         const auto &members = old_cluster_members_provider->at(cls_idx);
@@ -28,7 +19,7 @@ double SpatialModuleCache::compute_similarity_cls(int cls_idx, bool old_allo) co
 
         double total_neighbors = 0;
         for (size_t i = 0; i < members.size(); ++i) {
-            const std::vector<int> &row = cache.neighbor_cache[members[i]];
+            const SparseAdjacency::Row row = cache.neighbor_cache[members[i]];
 
             for (size_t j = 0; j < row.size(); ++j) {
                 if (allocations[row[j]] == cls_idx && allocations[row[j]] != -1) {
@@ -42,17 +33,16 @@ double SpatialModuleCache::compute_similarity_cls(int cls_idx, bool old_allo) co
     return cache.get_cluster_stats_ref(cls_idx).spatial_sum * spatial_weight / 2; // Each edge counted twice
 }
 
-Eigen::VectorXd SpatialModuleCache::compute_similarity_obs(int obs_idx) const {
-    Eigen::VectorXd cluster_adjacency = Eigen::VectorXd::Zero(data_module.get_K());
-    const std::vector<int> &row = cache.neighbor_cache[obs_idx];
-    const int *allocations = data_module.get_allocations().data();
-
-    for (size_t i = 0; i < row.size(); ++i) {
-        const int cluster_i = allocations[row[i]];
-        if (cluster_i != -1) {
-            cluster_adjacency(cluster_i) += spatial_weight;
-        }
+void SpatialModuleCache::add_similarity_obs(int obs_idx, Eigen::Ref<Eigen::VectorXd> out) const {
+    PROFILE_SCOPE(ModuleSimilarityObs);
+    // Only the clusters among the neighbours contribute
+    for (const SpatialCache::NeighborCount &entry : cache.neighbor_clusters(obs_idx)) {
+        out(entry.cluster) += spatial_weight * entry.count;
     }
+}
 
+Eigen::VectorXd SpatialModuleCache::compute_similarity_obs(int obs_idx) const {
+    Eigen::VectorXd cluster_adjacency = Eigen::VectorXd::Zero(data_module.get_K());
+    SpatialModuleCache::add_similarity_obs(obs_idx, cluster_adjacency);
     return cluster_adjacency;
-}
\ No newline at end of file
+}
@@ -8,6 +8,7 @@
 #include "../../utils/Data.hpp"
 #include "../../utils/Module.hpp"
 #include "../caches/spatial_cache.hpp"
+#include <vector>
 
 /**
  * @class SpatialModuleCache (WIP)
@@ -31,7 +32,7 @@ public:
     /**
      * @brief Constructs a SpatialModuleCache with parameter and data references.
      *
-     * Initializes the neighbor cache by calling neighbor_cache_compute().
+     * The neighbor lists are the ones held by the cache.
      *
      * @param data_ Reference to the Data object with cluster assignments.
      * @param spatial_cache_ Precomputed spatial cache.
@@ -43,7 +44,7 @@ public:
      */
     SpatialModuleCache(const Data &data_, SpatialCache &spatial_cache_, double spatial_coeff,
                        const Eigen::VectorXi *old_alloc_provider = nullptr,
-                       const std::unordered_map<int, std::vector<int>> *old_cluster_members_provider_ = nullptr)
+                       const ClusterMembers *old_cluster_members_provider_ = nullptr)
         : data_module(data_), cache(spatial_cache_), spatial_weight(spatial_coeff),
           Module(old_alloc_provider, old_cluster_members_provider_) {
         cache.set_allocation_ptr(&data_module.get_allocations());
@@ -65,6 +66,23 @@ public:
      */
     Eigen::VectorXd compute_similarity_obs(int obs_idx) const override;
 
+    /**
+     * @brief Adds the similarity contributions of obs_idx for every existing cluster to out
+     *
+     * Reads the neighbour counts of the cache (SpatialCache::neighbor_clusters()), so only the
+     * clusters among the neighbours of obs_idx are touched.
+     * @see Module::add_similarity_obs()
+     */
+    void add_similarity_obs(int obs_idx, Eigen::Ref<Eigen::VectorXd> out) const override;
+
+    /**
+     * @brief Heap bytes of the module: none, the neighbour counts are in the SpatialCache
+     * @see MemoryReport
+     */
+    std::size_t memory_bytes() const override {
+        return 0;
+    }
+
     /**
      * @brief Counts internal edges within a cluster.
      *
@@ -83,8 +101,8 @@ public:
     /**
      * @brief Counts neighbors of an observation within a specific cluster.
      *
-     * Uses the cached neighbor list to efficiently count how many neighbors
-     * of observation obs_idx belong to cluster cls_idx.
+     * A lookup in the neighbour counts of the cache (SpatialCache::neighbors_in_cluster()),
+     * with no walk over the neighbour list of obs_idx.
      *
      * @param obs_idx The index of the observation (0 to N-1).
      * @param cls_idx The index of the cluster to consider for neighbor counting.
@@ -92,5 +110,8 @@ public:
      * cluster.
      */
     double compute_similarity_obs(int obs_idx, int cls_idx) const override;
+
+    /** @brief Weight of each neighbour in the cluster, the similarity of a new point */
+    double get_spatial_weight() const { return spatial_weight; }
     /** @} */
 };
@@ -178,4 +178,20 @@ void MALA::Robbins_Monro_tuning() {
   // Periodic logging of epsilon value for monitoring
   // if (total_iterations % 1000 == 0)
   //   Rcpp::Rcout << "[DEBUG] - Updated epsilon: " << epsilon << std::endl;
-}
\ No newline at end of file
+}
+
+void MALA::write_checkpoint(CheckpointWriter &out) const {
+  U_sampler::write_checkpoint(out);
+  out.begin("MALA");
+  out.write(epsilon);
+  out.write(old_epsilon);
+  out.write(accept);
+}
+
+void MALA::read_checkpoint(CheckpointReader &in) {
+  U_sampler::read_checkpoint(in);
+  in.expect("MALA");
+  in.read(epsilon);
+  in.read(old_epsilon);
+  in.read(accept);
+}
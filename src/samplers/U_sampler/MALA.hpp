@@ -135,10 +135,12 @@ public:
    * @param eps Initial step size for Langevin dynamics (default: 1.0)
    * @param tuning If true, enable Robbins-Monro adaptive tuning (default:
    * false)
+   * @param rng Random number generator stream (default: non-deterministically
+   * seeded)
    */
   MALA(Params &p, Data &d, bool use_V = false, double eps = 1,
-       bool tuning = false)
-      : U_sampler(p, d), epsilon(eps), old_epsilon(epsilon),
+       bool tuning = false, Rng rng = Rng())
+      : U_sampler(p, d, rng), epsilon(eps), old_epsilon(epsilon),
         tuning_enabled(tuning) {};
 
   /**
@@ -152,4 +154,10 @@ public:
    * @note Overrides the pure virtual function from U_sampler base class
    */
   void update_U() override;
+
+  /** @brief Writes the base state and the tuned step size. */
+  void write_checkpoint(CheckpointWriter &out) const override;
+
+  /** @brief Restores the state written by write_checkpoint(). */
+  void read_checkpoint(CheckpointReader &in) override;
 };
\ No newline at end of file
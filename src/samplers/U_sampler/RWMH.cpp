@@ -101,4 +101,18 @@ void RWMH::Robbins_Monro_tuning() {
   // if(total_iterations % 1000 == 0)
   //     Rcpp::Rcout << "[DEBUG] - Updated proposal sd: " << proposal_sd <<
   //     std::endl;
-}
\ No newline at end of file
+}
+
+void RWMH::write_checkpoint(CheckpointWriter &out) const {
+  U_sampler::write_checkpoint(out);
+  out.begin("RWMH");
+  out.write(proposal_sd);
+  out.write(accept);
+}
+
+void RWMH::read_checkpoint(CheckpointReader &in) {
+  U_sampler::read_checkpoint(in);
+  in.expect("RWMH");
+  in.read(proposal_sd);
+  in.read(accept);
+}
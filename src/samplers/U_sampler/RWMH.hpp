@@ -134,14 +134,16 @@ public:
    * distribution (default: 1.0).
    * @param tuning If true, enable Robbins-Monro adaptive tuning of proposal_sd
    * (default: false).
+   * @param rng Random number generator stream (default: non-deterministically
+   * seeded).
    *
    * @note When use_V = false, proposals are truncated to ensure U > 0.
    * @note When tuning = true, proposal_sd will be automatically adjusted during
    * sampling.
    */
   RWMH(Params &p, Data &d, bool use_V = false, double prop_sd = 1,
-       bool tuning = false)
-      : U_sampler(p, d), use_V(use_V), proposal_sd(prop_sd),
+       bool tuning = false, Rng rng = Rng())
+      : U_sampler(p, d, rng), use_V(use_V), proposal_sd(prop_sd),
         tuning_enabled(tuning) {};
 
   /**
@@ -158,4 +160,10 @@ public:
    * @see sampling_U(), sampling_V(), Robbins_Monro_tuning()
    */
   void update_U() override;
+
+  /** @brief Writes the base state and the tuned proposal standard deviation. */
+  void write_checkpoint(CheckpointWriter &out) const override;
+
+  /** @brief Restores the state written by write_checkpoint(). */
+  void read_checkpoint(CheckpointReader &in) override;
 };
\ No newline at end of file
@@ -0,0 +1,96 @@
+/**
+ * @file Slice.cpp
+ * @brief Implementation of the slice sampler for U.
+ */
+
+#include "Slice.hpp"
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+Slice::Slice(Params &p, Data &d, double width_, int max_steps_, bool adapt_,
+             Rng rng)
+    : U_sampler(p, d, rng), width(width_), max_steps(max_steps_),
+      adapt(adapt_) {
+  if (!(width > 0) || max_steps < 1) {
+    throw std::invalid_argument(
+        "Slice: width must be positive and max_steps at least 1");
+  }
+}
+
+double Slice::log_density(double v) {
+  evaluations++;
+  const double f = log_conditional_density_V(v);
+  // Range comparisons rather than std::isfinite(), which -ffast-math folds to true: NaN fails both
+  if (f >= std::numeric_limits<double>::lowest() && f <= std::numeric_limits<double>::max())
+    return f;
+  return -std::numeric_limits<double>::infinity();
+}
+
+void Slice::update_U() {
+
+  total_iterations++;
+
+  const double V_current = std::log(U);
+
+  // Level of the slice: log y = log f(V) + log(Uniform(0, 1))
+  const double log_level = log_density(V_current) + std::log(gen.uniform_pos());
+
+  // Stepping out, with the steps split at random between the two ends
+  double left = V_current - width * gen.uniform();
+  double right = left + width;
+  int steps_left = static_cast<int>(max_steps * gen.uniform());
+  int steps_right = max_steps - 1 - steps_left;
+  while (steps_left > 0 && log_density(left) > log_level) {
+    left -= width;
+    steps_left--;
+  }
+  while (steps_right > 0 && log_density(right) > log_level) {
+    right += width;
+    steps_right--;
+  }
+
+  // Shrinkage towards the current value, which is in the slice
+  double V_new = V_current;
+  while (true) {
+    const double V_proposed = left + gen.uniform() * (right - left);
+    if (log_density(V_proposed) > log_level) {
+      V_new = V_proposed;
+      break;
+    }
+    if (V_proposed < V_current)
+      left = V_proposed;
+    else
+      right = V_proposed;
+    // The interval collapsed on the current value (a level at the mode)
+    if (right - left <= 1e-12 * (1.0 + std::abs(V_current)))
+      break;
+  }
+
+  if (V_new != V_current) {
+    U = std::exp(V_new);
+    accepted_U++;
+  }
+
+  if (adapt) {
+    total_jump += std::abs(V_new - V_current);
+    if (total_jump > 0)
+      width = 2.0 * total_jump / total_iterations;
+  }
+}
+
+void Slice::write_checkpoint(CheckpointWriter &out) const {
+  U_sampler::write_checkpoint(out);
+  out.begin("Slice");
+  out.write(width);
+  out.write(total_jump);
+  out.write(evaluations);
+}
+
+void Slice::read_checkpoint(CheckpointReader &in) {
+  U_sampler::read_checkpoint(in);
+  in.expect("Slice");
+  in.read(width);
+  in.read(total_jump);
+  in.read(evaluations);
+}
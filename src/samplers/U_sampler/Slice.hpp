@@ -0,0 +1,106 @@
+/**
+ * @file Slice.hpp
+ * @brief Adaptive slice sampler for the latent variable U.
+ */
+
+#pragma once
+
+#include "U_sampler.hpp"
+
+/**
+ * @class Slice
+ * @brief Univariate slice sampler on V = log(U), with stepping out and
+ * shrinkage.
+ *
+ * Each update draws a level y under the conditional density of V at the
+ * current value, places an interval of width w at random around it, steps it
+ * out by w until both ends are below the level (at most max_steps steps in
+ * total), and then samples uniformly from the interval, shrinking it towards
+ * the current value after each draw outside the slice (Neal, 2003, Figures 3
+ * and 5). The update always moves to a point of the slice and leaves the
+ * conditional of V invariant for any w, so unlike RWMH and MALA there is no
+ * acceptance rate to tune: a poor w only costs more density evaluations.
+ *
+ * With adaptation on, w is set after each update to twice the mean absolute
+ * jump of V so far. The jumps of a slice sampler are on the scale of the slice
+ * whatever w is, so w follows the width of the conditional as it sharpens with
+ * n; the changes shrink as 1/t (diminishing adaptation).
+ *
+ * get_acceptance_rate() is the fraction of updates that moved U (1 up to
+ * ties); compare samplers with get_ess_per_second() instead.
+ *
+ * @note Reference: "Slice sampling" by R. M. Neal, Annals of Statistics, 2003.
+ *
+ * @see U_sampler, RWMH, MALA
+ */
+class Slice : public U_sampler {
+
+private:
+  /** @brief Width of the initial interval and of each stepping-out step. */
+  double width = 1.0;
+
+  /** @brief Largest number of stepping-out steps per update. */
+  int max_steps = 32;
+
+  /** @brief Flag to adapt width to the mean jump. */
+  bool adapt = true;
+
+  /** @brief Sum of the absolute jumps of V, for the adaptation. */
+  double total_jump = 0.0;
+
+  /** @brief Evaluations of the conditional density, over all updates. */
+  long evaluations = 0;
+
+  /**
+   * @brief Log conditional density of V, with non-finite values (overflow of
+   * exp(v) far in the tails) read as outside the slice.
+   *
+   * @param v Value of V = log(U).
+   * @return log_conditional_density_V(v), or -infinity.
+   */
+  double log_density(double v);
+
+public:
+  /**
+   * @brief Constructor for the slice sampler.
+   *
+   * @param p Reference to the parameters object containing NGGP parameters.
+   * @param d Reference to the data object containing observations and cluster
+   * assignments.
+   * @param width_ Initial width of the interval on V = log(U) (default: 1.0).
+   * @param max_steps_ Largest number of stepping-out steps per update
+   * (default: 32).
+   * @param adapt_ If true, adapt the width to the mean jump (default: true).
+   * @param rng Random number generator stream (default: non-deterministically
+   * seeded).
+   * @throws std::invalid_argument if width_ is not positive or max_steps_ < 1.
+   */
+  Slice(Params &p, Data &d, double width_ = 1.0, int max_steps_ = 32,
+        bool adapt_ = true, Rng rng = Rng());
+
+  /**
+   * @brief Updates U with one slice sampling step on V = log(U).
+   *
+   * @details
+   * 1. Increments the iteration counter
+   * 2. Draws the level log y = log f(V) - Exp(1)
+   * 3. Steps out an interval of width w around V, then samples it with
+   *    shrinkage until a point of the slice is found
+   * 4. Optionally adapts w
+   */
+  void update_U() override;
+
+  /** @brief Current width of the interval. */
+  double get_width() const { return width; }
+
+  /** @brief Mean number of density evaluations per update, the cost of an update. */
+  double get_evaluations_per_update() const {
+    return total_iterations == 0 ? 0.0 : static_cast<double>(evaluations) / total_iterations;
+  }
+
+  /** @brief Writes the base state, the width and the adaptation sums. */
+  void write_checkpoint(CheckpointWriter &out) const override;
+
+  /** @brief Restores the state written by write_checkpoint(). */
+  void read_checkpoint(CheckpointReader &in) override;
+};
@@ -28,4 +28,24 @@ double U_sampler::log_conditional_density_V(double v) const {
   const double u = std::exp(v); // Transform back to U scale
   // Apply change of variables: log f_V(v) = log f_U(u) + log|dU/dV| = log(f_U(u)) + v
   return log_conditional_density_U(u) + v;
-}
\ No newline at end of file
+}
+
+void U_sampler::write_checkpoint(CheckpointWriter &out) const {
+  out.begin("U_sampler");
+  out.write(U);
+  out.write(total_iterations);
+  out.write(accepted_U);
+  out.write(update_seconds);
+  out.write(gen);
+  U_ess.write_checkpoint(out);
+}
+
+void U_sampler::read_checkpoint(CheckpointReader &in) {
+  in.expect("U_sampler");
+  in.read(U);
+  in.read(total_iterations);
+  in.read(accepted_U);
+  in.read(update_seconds);
+  in.read(gen);
+  U_ess.read_checkpoint(in);
+}
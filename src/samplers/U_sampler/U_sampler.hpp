@@ -5,8 +5,13 @@
 
 #pragma once
 
+#include "../../utils/Checkpoint.hpp"
 #include "../../utils/Data.hpp"
+#include "../../utils/OnlineESS.hpp"
 #include "../../utils/Params.hpp"
+#include "../../utils/Rng.hpp"
+#include <chrono>
+#include <limits>
 #include <random>
 
 /**
@@ -41,11 +46,14 @@ protected:
   /** @brief Counter of accepted U*/
   int accepted_U = 0;
 
-  /** @brief Random device for seeding. */
-  std::random_device rd;
+  /** @brief Random number generator stream owned by this sampler. */
+  mutable Rng gen;
 
-  /** @brief Mersenne Twister random number generator. */
-  mutable std::mt19937 gen;
+  /** @brief Effective sample size of the U trace, fed by update(). */
+  OnlineESS U_ess;
+
+  /** @brief Wall-clock time spent in update_U() by update(), in seconds. */
+  double update_seconds = 0.0;
 
   /**
    * @name Cached Constants
@@ -150,8 +158,10 @@ public:
    * sigma, tau).
    * @param d Reference to the data object containing observations and cluster
    * assignments.
+   * @param rng Random number generator stream (default: non-deterministically
+   * seeded).
    */
-  U_sampler(Params &p, Data &d) : params(p), data(d) {};
+  U_sampler(Params &p, Data &d, Rng rng = Rng()) : params(p), data(d), gen(rng) {};
 
   /**
    * @brief Pure virtual method to update the latent variable U.
@@ -162,6 +172,20 @@ public:
    */
   virtual void update_U() = 0;
 
+  /**
+   * @brief Updates U and records the new value and the time taken.
+   *
+   * Called by the processes once per iteration. It runs update_U() and feeds
+   * the U trace and the elapsed time to the diagnostics, so that samplers can
+   * be compared by get_ess_per_second() rather than by acceptance rate.
+   */
+  void update() {
+    const auto start = std::chrono::steady_clock::now();
+    update_U();
+    update_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    U_ess.add(U);
+  }
+
   /**
    * @brief Getter for the current value of U.
    *
@@ -179,6 +203,51 @@ public:
     return static_cast<double>(accepted_U) / static_cast<double>(total_iterations);
   }
 
+  /**
+   * @brief Effective sample size of the U values drawn by update().
+   * @return Batch-means estimate (see OnlineESS), NaN for very short traces.
+   */
+  double get_ess() const { return U_ess.ess(); }
+
+  /** @brief Time spent in update_U() by update(), in seconds. */
+  double get_update_seconds() const { return update_seconds; }
+
+  /**
+   * @brief Effective samples of U per second spent updating U.
+   * @return get_ess() / get_update_seconds(), NaN before any timed update.
+   */
+  double get_ess_per_second() const {
+    return update_seconds > 0.0 ? get_ess() / update_seconds : std::numeric_limits<double>::quiet_NaN();
+  }
+
+  /**
+   * @brief Clears the ESS trace and the timer (e.g. at the end of the burn-in).
+   *
+   * The acceptance counters are kept: the tuning of RWMH and MALA reads them.
+   */
+  void reset_diagnostics() {
+    U_ess.reset();
+    update_seconds = 0.0;
+  }
+
+  /**
+   * @brief Writes U, the counters and the random stream to a checkpoint.
+   *
+   * Derived classes with adapted quantities override both methods, calling
+   * the base first.
+   *
+   * @param out Checkpoint being written.
+   */
+  virtual void write_checkpoint(CheckpointWriter &out) const;
+
+  /**
+   * @brief Restores the state written by write_checkpoint().
+   *
+   * @param in Checkpoint being read.
+   * @throws std::runtime_error if the checkpoint was written by another sampler type.
+   */
+  virtual void read_checkpoint(CheckpointReader &in);
+
   /**
   @brief Virtual destructor for the U_sampler class.
   */
@@ -0,0 +1,145 @@
+/**
+ * @file anchor_tables.cpp
+ * @brief Implementation of AnchorTables
+ *
+ * @author Filippo Galli
+ * @date 2025
+ */
+
+#include "anchor_tables.hpp"
+#include <numeric>
+#include <stdexcept>
+
+AnchorTables::AnchorTables(const Params &params, int candidates) : params(params), n(params.n) {
+    if (n < 2) {
+        throw std::invalid_argument("AnchorTables needs at least two points");
+    }
+    M = std::max(1, std::min(candidates, n - 1));
+
+    const size_t cells = static_cast<size_t>(n) * M;
+    for (Weighting *tables : {&dissimilar, &similar}) {
+        tables->top.resize(cells);
+        tables->alias_prob.resize(cells);
+        tables->alias.resize(cells);
+        tables->top_mass.assign(n, 0.0);
+        tables->rest_mass.assign(n, 0.0);
+        tables->rest_bound.assign(n, 0.0);
+    }
+    log_max.assign(n, 0.0);
+
+#pragma omp parallel
+    {
+        std::vector<double> log_row(n), w(n), scratch(M);
+        std::vector<int> order(n - 1);
+
+#pragma omp for schedule(dynamic, 64)
+        for (int i = 0; i < n; ++i) {
+            // Same expression as weight(), so that the rejection step reproduces these values exactly
+            double max_distance = 0.0;
+            for (int j = 0; j < n; ++j) {
+                max_distance = std::max(max_distance, params.distance(i, j));
+                log_row[j] = log_distance(i, j);
+            }
+            log_max[i] = std::log(std::max(max_distance, distance_floor));
+
+            for (int j = 0; j < n; ++j)
+                w[j] = std::max(0.0, log_row[j]);
+            build_row(dissimilar, i, w, order, scratch);
+
+            for (int j = 0; j < n; ++j)
+                w[j] = log_max[i] - log_row[j];
+            build_row(similar, i, w, order, scratch);
+        }
+    }
+}
+
+void AnchorTables::build_row(Weighting &tables, int i, const std::vector<double> &w, std::vector<int> &order,
+                             std::vector<double> &scratch) const {
+    // Every other point, largest weight first (ties broken by index, for reproducibility)
+    std::iota(order.begin(), order.begin() + i, 0);
+    std::iota(order.begin() + i, order.end(), i + 1);
+    auto heavier = [&](int a, int b) { return w[a] > w[b] || (w[a] == w[b] && a < b); };
+    if (M < n - 1) {
+        std::nth_element(order.begin(), order.begin() + M, order.end(), heavier);
+    }
+
+    double bound = w[order[0]];
+    for (int a = 1; a < M; ++a)
+        bound = std::min(bound, w[order[a]]);
+    double rest = 0.0;
+    for (int a = M; a < n - 1; ++a)
+        rest += w[order[a]];
+
+    std::sort(order.begin(), order.begin() + M);
+    const size_t base = static_cast<size_t>(i) * M;
+    double top = 0.0;
+    for (int a = 0; a < M; ++a) {
+        tables.top[base + a] = order[a];
+        top += w[order[a]];
+    }
+    tables.top_mass[i] = top;
+    tables.rest_mass[i] = rest;
+    tables.rest_bound[i] = bound;
+    if (top <= 0.0) {
+        return;
+    }
+
+    // Vose's alias method over the kept slots
+    double *prob = tables.alias_prob.data() + base;
+    int *alias = tables.alias.data() + base;
+    std::vector<int> small, large;
+    small.reserve(M);
+    large.reserve(M);
+    for (int a = 0; a < M; ++a) {
+        scratch[a] = w[order[a]] * M / top;
+        (scratch[a] < 1.0 ? small : large).push_back(a);
+        alias[a] = a;
+    }
+    while (!small.empty() && !large.empty()) {
+        const int s = small.back(), l = large.back();
+        small.pop_back();
+        prob[s] = scratch[s];
+        alias[s] = l;
+        scratch[l] -= 1.0 - scratch[s];
+        if (scratch[l] < 1.0) {
+            large.pop_back();
+            small.push_back(l);
+        }
+    }
+    // What is left has probability one up to rounding
+    for (int a : small)
+        prob[a] = 1.0;
+    for (int a : large)
+        prob[a] = 1.0;
+}
+
+int AnchorTables::sample_residual_scan(int i, bool similarity, Rng &gen) const {
+    const Weighting &tables = similarity ? similar : dissimilar;
+    const int *kept = tables.top.data() + static_cast<size_t>(i) * M;
+
+    // The sum is accumulated in another order than rest_mass: the last positive candidate takes
+    // whatever rounding leaves over
+    double u = gen.uniform() * tables.rest_mass[i];
+    int last = -1;
+    for (int j = 0; j < n; ++j) {
+        if (j == i || std::binary_search(kept, kept + M, j))
+            continue;
+        const double w = weight(i, j, similarity);
+        if (w <= 0.0)
+            continue;
+        last = j;
+        u -= w;
+        if (u < 0.0)
+            return j;
+    }
+    return last;
+}
+
+std::size_t AnchorTables::memory_bytes() const {
+    std::size_t bytes = MemoryReport::bytes(log_max);
+    for (const Weighting *tables : {&dissimilar, &similar})
+        bytes += MemoryReport::bytes(tables->top) + MemoryReport::bytes(tables->alias_prob) +
+                 MemoryReport::bytes(tables->alias) + MemoryReport::bytes(tables->top_mass) +
+                 MemoryReport::bytes(tables->rest_mass) + MemoryReport::bytes(tables->rest_bound);
+    return bytes;
+}
@@ -0,0 +1,152 @@
+/**
+ * @file anchor_tables.hpp
+ * @brief Precomputed per-point tables for distance-weighted anchor sampling
+ *
+ * @author Filippo Galli
+ * @date 2025
+ */
+
+#pragma once
+
+#include "../utils/Params.hpp"
+#include "../utils/Rng.hpp"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+/**
+ * @class AnchorTables
+ * @brief Samples a second anchor j given the first anchor i with distance-based weights
+ *
+ * Two weightings of the candidates j != i are supported, the ones used by SplitMerge_LSS_SDDS:
+ * - dissimilarity: w(i, j) = max(0, log D(i, j))
+ * - similarity:    w(i, j) = log max_l D(i, l) - log D(i, j)
+ *
+ * For every point and weighting the M candidates with the largest weight are kept, sorted by
+ * index, with a Walker alias table over them. The other candidates (the residual) all have a
+ * weight no larger than the smallest kept one, w_min, so they are drawn by rejection: a uniform
+ * candidate outside the kept ones is accepted with probability w(i, j) / w_min. An attempt
+ * succeeds with probability (residual mass) / (w_min (n - 1 - M)), which is small when the
+ * residual weights sit far below the kept ones; after rejection_tries failed attempts the
+ * candidate is drawn by an exact O(n) scan of the residual. The draw is exact either way. A draw
+ * from the kept part costs O(1), instead of the O(n) row pass, n logarithms and allocation of a
+ * full categorical draw, and the kept part holds the bulk of the mass when the weights are
+ * concentrated.
+ *
+ * Distances are floored at distance_floor before the logarithm, so duplicate points (zero
+ * off-diagonal distances) get a large but finite similarity weight. If all the weights of a row
+ * are zero the candidate is drawn uniformly.
+ *
+ * Construction reads D once, O(n^2) split over the OpenMP threads; memory is 32 n M bytes.
+ */
+class AnchorTables {
+private:
+    /** @brief Tables of one weighting */
+    struct Weighting {
+        std::vector<int> top;           ///< Kept candidates of point i at [i * M, (i + 1) * M), ascending
+        std::vector<double> alias_prob; ///< Alias acceptance threshold of each kept slot
+        std::vector<int> alias;         ///< Alias slot of each kept slot
+        std::vector<double> top_mass;   ///< Total weight of the kept candidates
+        std::vector<double> rest_mass;  ///< Total weight of the residual candidates
+        std::vector<double> rest_bound; ///< Upper bound of the residual weights (smallest kept weight)
+    };
+
+    const Params &params; ///< Parameters holding D
+    int n;                ///< Number of points
+    int M;                ///< Kept candidates per point
+    Weighting dissimilar; ///< Tables for the dissimilarity weights
+    Weighting similar;    ///< Tables for the similarity weights
+    std::vector<double> log_max; ///< log of the largest distance from each point
+
+    static constexpr double distance_floor = 1e-12; ///< Smallest distance entering a logarithm
+    static constexpr int rejection_tries = 16;       ///< Rejection attempts before the residual scan
+
+    /**
+     * @brief Fills the kept candidates, the alias table and the masses of one row
+     * @param tables Tables of the weighting
+     * @param i Row index
+     * @param w Weights of row i (w[i] is ignored)
+     * @param order Scratch buffer of n - 1 entries
+     * @param scratch Scratch buffer of M entries
+     */
+    void build_row(Weighting &tables, int i, const std::vector<double> &w, std::vector<int> &order,
+                   std::vector<double> &scratch) const;
+
+    /**
+     * @brief Weight of candidate j for anchor i
+     * @param i First anchor
+     * @param j Candidate, j != i
+     * @param similarity Weighting to use
+     */
+    double weight(int i, int j, bool similarity) const {
+        const double log_d = log_distance(i, j);
+        return similarity ? log_max[i] - log_d : std::max(0.0, log_d);
+    }
+
+    /** @brief log D(i, j), with D floored at distance_floor */
+    double log_distance(int i, int j) const { return std::log(std::max(params.distance(i, j), distance_floor)); }
+
+    /**
+     * @brief Draws a residual candidate of anchor i by a linear scan of its weights
+     * @param i First anchor
+     * @param similarity Weighting to use
+     * @param gen Random number generator
+     */
+    int sample_residual_scan(int i, bool similarity, Rng &gen) const;
+
+public:
+    /**
+     * @brief Builds the tables from the distances held by params
+     * @param params Model parameters (any storage mode)
+     * @param candidates Candidates kept per point (clamped to n - 1, default: 32)
+     * @throws std::invalid_argument if there are fewer than two points
+     */
+    explicit AnchorTables(const Params &params, int candidates = 32);
+
+    /**
+     * @brief Draws the second anchor
+     * @param i First anchor
+     * @param similarity If true use the similarity weights, otherwise the dissimilarity weights
+     * @param gen Random number generator
+     * @return Index j != i drawn with probability w(i, j) / sum_l w(i, l)
+     */
+    int sample(int i, bool similarity, Rng &gen) const {
+        const Weighting &tables = similarity ? similar : dissimilar;
+        const double top = tables.top_mass[i];
+        const double rest = tables.rest_mass[i];
+
+        if (top <= 0.0) {
+            // All weights are zero: uniform over the other points
+            const int j = gen.uniform_int(n - 1);
+            return j < i ? j : j + 1;
+        }
+
+        const size_t base = static_cast<size_t>(i) * M;
+        if (rest <= 0.0 || gen.uniform() * (top + rest) < top) {
+            const size_t slot = base + gen.uniform_int(M);
+            return tables.top[gen.uniform() < tables.alias_prob[slot] ? slot : base + tables.alias[slot]];
+        }
+
+        // Residual: uniform candidate outside the kept ones, accepted with probability w / bound
+        const int *kept = tables.top.data() + base;
+        const double bound = tables.rest_bound[i];
+        for (int attempt = 0; attempt < rejection_tries; ++attempt) {
+            int j;
+            do {
+                j = gen.uniform_int(n);
+            } while (j == i || std::binary_search(kept, kept + M, j));
+            if (gen.uniform() * bound < weight(i, j, similarity))
+                return j;
+        }
+        return sample_residual_scan(i, similarity, gen);
+    }
+
+    /** @brief Kept candidates per point */
+    int get_candidates() const { return M; }
+
+    /**
+     * @brief Heap bytes of the tables of both weightings
+     * @see MemoryReport
+     */
+    std::size_t memory_bytes() const;
+};
@@ -0,0 +1,139 @@
+/**
+ * @file move_scheduler.cpp
+ * @brief Implementation of MoveScheduler
+ *
+ * @author Filippo Galli
+ * @date 2025
+ */
+
+#include "move_scheduler.hpp"
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+
+MoveScheduler::MoveScheduler(Data &d, Params &p, Likelihood &l, Process &pr, std::vector<Sampler *> samplers,
+                             std::vector<double> weights, int adapt_steps, double min_prob, Rng rng)
+    : Sampler(d, p, l, pr, rng), moves(std::move(samplers)), adapt_steps(adapt_steps), min_prob(min_prob) {
+    const int S = static_cast<int>(moves.size());
+    if (S == 0 || weights.size() != moves.size()) {
+        throw std::invalid_argument("MoveScheduler: need one weight per sampler, and at least one sampler");
+    }
+    if (std::find(moves.begin(), moves.end(), nullptr) != moves.end()) {
+        throw std::invalid_argument("MoveScheduler: null sampler");
+    }
+    if (adapt_steps < 0 || min_prob < 0 || min_prob * S >= 1) {
+        throw std::invalid_argument("MoveScheduler: adapt_steps must be non-negative and min_prob in [0, 1 / S)");
+    }
+
+    double total = 0;
+    for (const double w : weights) {
+        if (!(w >= 0)) {
+            throw std::invalid_argument("MoveScheduler: weights must be non-negative");
+        }
+        total += w;
+    }
+    if (total <= 0) {
+        throw std::invalid_argument("MoveScheduler: weights must not be all zero");
+    }
+
+    // The floor applies from the start, so that every sampler gets its first min_runs runs
+    stats.resize(S);
+    probabilities.resize(S);
+    for (int s = 0; s < S; ++s) {
+        stats[s].initial_weight = weights[s] / total;
+        probabilities[s] = stats[s].weight = min_prob + (1.0 - min_prob * S) * stats[s].initial_weight;
+    }
+
+    representative.resize(d.get_n());
+    representative_after.resize(d.get_n());
+}
+
+// ========== Change measure ==========
+
+void MoveScheduler::cluster_representatives(std::vector<int> &out) {
+    const int n = data.get_n();
+    const Eigen::VectorXi &allocations = data.get_allocations();
+    cluster_min.assign(data.get_K(), n);
+    for (int i = 0; i < n; ++i) {
+        const int k = allocations(i);
+        if (k >= 0)
+            cluster_min[k] = std::min(cluster_min[k], i);
+    }
+    for (int i = 0; i < n; ++i)
+        out[i] = allocations(i) >= 0 ? cluster_min[allocations(i)] : -1;
+}
+
+int MoveScheduler::count_moved() {
+    cluster_representatives(representative_after);
+    int moved = 0;
+    for (size_t i = 0; i < representative.size(); ++i)
+        moved += representative_after[i] != representative[i];
+    return moved;
+}
+
+// ========== Adaptation ==========
+
+void MoveScheduler::adapt() {
+    double total_rate = 0;
+    for (const MoveStats &s : stats) {
+        if (s.runs < min_runs)
+            return; // Too few measurements: keep the current probabilities
+        total_rate += s.moved / std::max(s.seconds, 1e-9);
+    }
+
+    const double free_mass = 1.0 - min_prob * static_cast<double>(stats.size());
+    for (MoveStats &s : stats) {
+        const double rate = s.moved / std::max(s.seconds, 1e-9);
+        // With no move seen yet, fall back on a uniform share of the free mass
+        s.weight = min_prob + free_mass * (total_rate > 0 ? rate / total_rate : 1.0 / stats.size());
+    }
+    for (size_t s = 0; s < stats.size(); ++s)
+        probabilities[s] = stats[s].weight;
+}
+
+void MoveScheduler::step() {
+    const int s = gen.categorical(probabilities.data(), static_cast<int>(probabilities.size()));
+
+    cluster_representatives(representative);
+    const auto start = std::chrono::steady_clock::now();
+    moves[s]->step();
+    if (!moves[s]->tracks_log_likelihood())
+        data.stop_log_likelihood_tracking();
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    const int moved = count_moved();
+
+    MoveStats &move = stats[s];
+    move.runs++;
+    move.changed_runs += moved > 0;
+    move.moved += moved;
+    move.seconds += seconds;
+
+    steps++;
+    if (steps <= adapt_steps)
+        adapt();
+}
+
+void MoveScheduler::write_checkpoint(CheckpointWriter &out) const {
+    Sampler::write_checkpoint(out);
+    out.begin("MoveScheduler");
+    out.write(stats);
+    out.write(probabilities);
+    out.write(steps);
+    for (const Sampler *move : moves)
+        move->write_checkpoint(out);
+}
+
+void MoveScheduler::read_checkpoint(CheckpointReader &in) {
+    Sampler::read_checkpoint(in);
+    in.expect("MoveScheduler");
+    const std::size_t S = moves.size();
+    in.read(stats);
+    in.read(probabilities);
+    if (stats.size() != S || probabilities.size() != S) {
+        in.fail("written for " + std::to_string(stats.size()) + " samplers, scheduler has " + std::to_string(S));
+    }
+    in.read(steps);
+    for (Sampler *move : moves)
+        move->read_checkpoint(in);
+}
@@ -0,0 +1,124 @@
+/**
+ * @file move_scheduler.hpp
+ * @brief Random scan over a set of samplers, with selection probabilities adapted to their cost
+ *
+ * @author Filippo Galli
+ * @date 2025
+ */
+
+#pragma once
+
+#include "../utils/Sampler.hpp"
+#include <vector>
+
+/**
+ * @class MoveScheduler
+ * @brief Steps one sampler of a weighted set per step, tuning the weights during burn-in
+ *
+ * Each step draws one of the samplers (Neal3, Neal3_ZDNAM, any split-merge variant, ...) with the
+ * current selection probabilities and steps it, measuring its wall-clock time and how many points
+ * it moved. A point counts as moved if the smallest index of its cluster changed, which does not
+ * depend on the labels (so relabeling by compaction is not a change) and is zero exactly when the
+ * partition is unchanged.
+ *
+ * For the first adapt_steps steps the probabilities follow the moved points per second of each
+ * sampler, p_s = min_prob + (1 - S min_prob) r_s / sum_t r_t, once every sampler has been run
+ * min_runs times (the floored initial weights are used until then). The floor keeps every
+ * sampler in the mix: the kernels complement each other (a Gibbs sweep for single points,
+ * split-merge moves for whole clusters), and none should be starved on a noisy estimate.
+ * After adapt_steps steps the probabilities are frozen, so the chain is a fixed random-scan
+ * mixture of invariant kernels from then on: set adapt_steps to the burn-in.
+ *
+ * The samplers are not owned and should share the Data of the scheduler.
+ *
+ * @see ChainRunner
+ */
+class MoveScheduler : public Sampler {
+public:
+    /** @brief Statistics of one sampler, since construction */
+    struct MoveStats {
+        double initial_weight = 0; ///< Selection probability given at construction (normalized)
+        double weight = 0;         ///< Current selection probability
+        long runs = 0;             ///< Steps of the sampler
+        long changed_runs = 0;     ///< Steps that changed the partition
+        double moved = 0;          ///< Points moved
+        double seconds = 0;        ///< Wall-clock time of its steps
+    };
+
+    /** @brief Runs of every sampler before the probabilities start adapting */
+    static constexpr int min_runs = 5;
+
+private:
+    std::vector<Sampler *> moves;   ///< Samplers, not owned
+    std::vector<MoveStats> stats;   ///< Statistics of each sampler
+    std::vector<double> probabilities; ///< Current selection probabilities (the weights of stats)
+    int adapt_steps;                ///< Steps during which the probabilities adapt
+    double min_prob;                ///< Floor of each selection probability
+    long steps = 0;                 ///< Steps run
+
+    std::vector<int> representative; ///< Smallest index of the cluster of each point before the step
+    std::vector<int> representative_after; ///< Same, after the step
+    std::vector<int> cluster_min;    ///< Smallest index of each cluster (scratch)
+
+    /** @brief Writes the smallest index of the cluster of each point into out */
+    void cluster_representatives(std::vector<int> &out);
+
+    /** @brief Number of points whose representative changed during the step */
+    int count_moved();
+
+    /** @brief Recomputes the selection probabilities from the measured rates */
+    void adapt();
+
+public:
+    /**
+     * @brief Constructor
+     *
+     * @param d Data shared by the samplers
+     * @param p Parameters
+     * @param l Likelihood
+     * @param pr Process
+     * @param samplers Samplers to choose from; not owned
+     * @param weights Initial selection weights, one per sampler (normalized and floored at min_prob)
+     * @param adapt_steps Steps during which the probabilities adapt (0: fixed weights)
+     * @param min_prob Floor of each selection probability, below 1 / samplers.size()
+     * @param rng Random number generator stream (default: non-deterministically seeded)
+     * @throws std::invalid_argument if there is no sampler, the sizes differ, a weight is negative or
+     * they are all zero, adapt_steps < 0, or min_prob is not in [0, 1 / samplers.size())
+     */
+    MoveScheduler(Data &d, Params &p, Likelihood &l, Process &pr, std::vector<Sampler *> samplers,
+                  std::vector<double> weights, int adapt_steps, double min_prob = 0.05, Rng rng = Rng());
+
+    /** @brief Steps one sampler, drawn with the current selection probabilities */
+    void step() override;
+
+    /**
+     * @brief The running log-likelihood stays up to date: the step of a sampler that does not
+     * report its changes stops the tracking
+     */
+    bool tracks_log_likelihood() const override { return true; }
+
+    /**
+     * @brief Writes the random stream, the statistics and probabilities, then every sampler in turn
+     * @note The measured times are restored too, so a resumed scheduler adapts from the same rates
+     */
+    void write_checkpoint(CheckpointWriter &out) const override;
+
+    /** @brief Restores the state written by write_checkpoint() */
+    void read_checkpoint(CheckpointReader &in) override;
+
+    /**
+     * @brief Heap bytes of the move statistics and the representatives (the moves report their own)
+     * @see MemoryReport
+     */
+    std::size_t memory_bytes() const override {
+        return Sampler::memory_bytes() + MemoryReport::bytes(moves) + MemoryReport::bytes(stats) +
+               MemoryReport::bytes(probabilities) + MemoryReport::bytes(representative) +
+               MemoryReport::bytes(representative_after) + MemoryReport::bytes(cluster_min);
+    }
+
+    /** @brief Whether the selection probabilities are frozen */
+    bool is_frozen() const { return steps >= adapt_steps; }
+
+    /** @brief Statistics of each sampler, in construction order */
+    const std::vector<MoveStats> &get_stats() const { return stats; }
+};
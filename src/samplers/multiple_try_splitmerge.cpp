@@ -0,0 +1,251 @@
+/**
+ * @file multiple_try_splitmerge.cpp
+ * @brief Implementation of MultipleTrySplitMerge
+ *
+ * @author Filippo Galli
+ * @date 2025
+ */
+
+#include "multiple_try_splitmerge.hpp"
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+/** @brief log(sum(exp(x))), -infinity for an empty or all -infinity x */
+double log_sum_exp(const std::vector<double> &x) {
+    double max_x = -std::numeric_limits<double>::infinity();
+    for (const double v : x)
+        max_x = std::max(max_x, v);
+    if (max_x == -std::numeric_limits<double>::infinity())
+        return max_x;
+
+    double total = 0.0;
+    for (const double v : x)
+        total += std::exp(v - max_x);
+    return max_x + std::log(total);
+}
+
+} // namespace
+
+MultipleTrySplitMerge::MultipleTrySplitMerge(Data &d, Params &p, Likelihood &l, Process &pr,
+                                             const std::vector<SamplerReplica> &replicas, int tries, Rng rng)
+    : Sampler(d, p, l, pr, rng), anchors(std::make_shared<const AnchorTables>(p)), concurrent(!replicas.empty()),
+      tries(tries) {
+    if (tries < 1) {
+        throw std::invalid_argument("MultipleTrySplitMerge: tries must be positive");
+    }
+
+    if (!concurrent) {
+        stacks.push_back(std::make_unique<SplitMerge_LSS_SDDS>(d, p, l, pr, false, anchors, gen.split()));
+        stack_data.push_back(&d);
+        stack_process.push_back(&pr);
+    }
+    for (const SamplerReplica &replica : replicas) {
+        if (!replica.data || !replica.likelihood || !replica.process || replica.data->get_n() != d.get_n()) {
+            throw std::invalid_argument("MultipleTrySplitMerge: every replica needs a data set of n points");
+        }
+        stacks.push_back(std::make_unique<SplitMerge_LSS_SDDS>(*replica.data, p, *replica.likelihood,
+                                                               *replica.process, false, anchors, gen.split()));
+        stack_data.push_back(replica.data);
+        stack_process.push_back(replica.process);
+    }
+
+    log_ratios.resize(tries);
+    sides.resize(tries);
+}
+
+void MultipleTrySplitMerge::run_stacks(const std::function<void(int)> &task) {
+    const int T = active_stacks();
+    if (!concurrent) {
+        task(0);
+        return;
+    }
+
+    const Eigen::VectorXi &state = data.get_allocations();
+    std::vector<std::exception_ptr> errors(T);
+
+#pragma omp parallel for schedule(static, 1) num_threads(T)
+    for (int t = 0; t < T; ++t) {
+        try {
+            Data &replica = *stack_data[t];
+            if (replica.in_transaction() || replica.get_allocations() != state)
+                replica.set_allocations(state);
+            task(t);
+        } catch (...) {
+            errors[t] = std::current_exception();
+        }
+    }
+
+    for (const std::exception_ptr &error : errors) {
+        if (error)
+            std::rethrow_exception(error);
+    }
+}
+
+void MultipleTrySplitMerge::open_cluster(Data &d, const std::vector<int> &group) {
+    d.set_allocation(group[0], d.get_K());
+    const int cluster = d.get_cluster_assignment(group[0]);
+    for (std::size_t q = 1; q < group.size(); ++q)
+        d.set_allocation(group[q], cluster);
+}
+
+void MultipleTrySplitMerge::apply(const std::function<void(Data &)> &update) {
+    if (!concurrent) {
+        update(data);
+        return;
+    }
+
+    // The replicas that drew the candidates hold the master partition; the others are reset by
+    // run_stacks() before they are used
+    const int T = active_stacks();
+    std::vector<std::exception_ptr> errors(T + 1);
+
+#pragma omp parallel for schedule(static, 1) num_threads(T + 1)
+    for (int t = 0; t <= T; ++t) {
+        try {
+            update(t == 0 ? data : *stack_data[t - 1]);
+        } catch (...) {
+            errors[t] = std::current_exception();
+        }
+    }
+
+    for (const std::exception_ptr &error : errors) {
+        if (error)
+            std::rethrow_exception(error);
+    }
+}
+
+void MultipleTrySplitMerge::split_step(bool similarity, int i, int j) {
+    const auto members = data.get_cluster_assignments_ref(data.get_cluster_assignment(i));
+    points.assign(members.data(), members.data() + members.size());
+    const int T = active_stacks();
+
+    run_stacks([&](int t) {
+        SplitMerge_LSS_SDDS &sampler = *stacks[t];
+        const Eigen::VectorXi &local = stack_data[t]->get_allocations();
+        for (int m = t; m < tries; m += T) {
+            log_ratios[m] = sampler.draw_split(similarity, i, j);
+            sides[m].resize(points.size());
+            for (std::size_t q = 0; q < points.size(); ++q)
+                sides[m][q] = local(points[q]) != local(i);
+            stack_process[t]->restore_state();
+        }
+    });
+
+    diagnostics.splits++;
+    diagnostics.candidates += tries;
+    const double log_ratio = log_sum_exp(log_ratios) - std::log(static_cast<double>(tries));
+    if (std::log(gen.uniform_pos()) > log_ratio) // move not accepted
+        return;
+
+    const int k = gen.categorical_log(log_ratios.data(), tries);
+    moved.clear();
+    for (std::size_t q = 0; q < points.size(); ++q) {
+        if (sides[k][q])
+            moved.push_back(points[q]);
+    }
+    apply([&](Data &d) { open_cluster(d, moved); });
+    diagnostics.accepted_splits++;
+}
+
+void MultipleTrySplitMerge::merge_step(bool similarity, int i, int j) {
+    const int ci = data.get_cluster_assignment(i);
+    const int cj = data.get_cluster_assignment(j);
+    const auto members = data.get_cluster_assignments_ref(cj);
+    points.assign(members.data(), members.data() + members.size());
+    const int T = active_stacks();
+
+    run_stacks([&](int t) {
+        SplitMerge_LSS_SDDS &sampler = *stacks[t];
+        Data &d = *stack_data[t];
+
+        // Draw 0: the split from the merged state to the current one
+        if (t == 0)
+            log_ratios[0] = -sampler.merge_log_ratio(similarity, i, j);
+        const int first = t == 0 ? T : t;
+        if (first >= tries)
+            return;
+
+        // Auxiliary splits of the merged state. In lazy compaction mode cj becomes the last free
+        // slot, taken again by the cluster each split opens and by the one reopened at the end, so
+        // that the stack keeps its labels
+        const bool lazy = d.get_lazy_compaction();
+        d.set_lazy_compaction(true);
+        d.merge_clusters(cj, ci);
+        for (int m = first; m < tries; m += T) {
+            log_ratios[m] = sampler.draw_split(similarity, i, j);
+            stack_process[t]->restore_state();
+        }
+        open_cluster(d, points);
+        d.set_lazy_compaction(lazy);
+    });
+
+    diagnostics.merges++;
+    diagnostics.candidates += tries - 1;
+    const double log_ratio = std::log(static_cast<double>(tries)) - log_sum_exp(log_ratios);
+    if (std::log(gen.uniform_pos()) > log_ratio) // move not accepted
+        return;
+
+    apply([&](Data &d) { d.merge_clusters(d.get_cluster_assignment(j), d.get_cluster_assignment(i)); });
+    diagnostics.accepted_merges++;
+}
+
+void MultipleTrySplitMerge::step() {
+    // Same draws as SplitMerge_LSS_SDDS::step()
+    const bool similarity = gen.uniform_int(2);
+    const int i = gen.uniform_int(data.get_n());
+    const int j = anchors->sample(i, similarity, gen);
+
+    if (data.get_cluster_assignment(i) == data.get_cluster_assignment(j))
+        split_step(similarity, i, j);
+    else
+        merge_step(similarity, i, j);
+}
+
+void MultipleTrySplitMerge::write_checkpoint(CheckpointWriter &out) const {
+    Sampler::write_checkpoint(out);
+    out.begin("MultipleTrySplitMerge");
+    out.write(static_cast<int32_t>(num_stacks()));
+    out.write(static_cast<int32_t>(tries));
+    out.write(diagnostics);
+
+    for (int t = 0; t < num_stacks(); ++t) {
+        stacks[t]->write_checkpoint(out);
+        if (concurrent)
+            stack_data[t]->set_allocations(data.get_allocations());
+    }
+}
+
+void MultipleTrySplitMerge::read_checkpoint(CheckpointReader &in) {
+    Sampler::read_checkpoint(in);
+    in.expect("MultipleTrySplitMerge");
+    int32_t T, M;
+    in.read(T);
+    in.read(M);
+    if (T != num_stacks() || M != tries) {
+        in.fail("written with " + std::to_string(T) + " stacks and " + std::to_string(M) +
+                " tries, sampler has " + std::to_string(num_stacks()) + " and " + std::to_string(tries));
+    }
+    in.read(diagnostics);
+
+    for (int t = 0; t < num_stacks(); ++t) {
+        stacks[t]->read_checkpoint(in);
+        if (concurrent)
+            stack_data[t]->set_allocations(data.get_allocations());
+    }
+}
+
+std::size_t MultipleTrySplitMerge::memory_bytes() const {
+    std::size_t bytes = Sampler::memory_bytes() + (anchors ? anchors->memory_bytes() : 0) +
+                        MemoryReport::bytes(stacks) + MemoryReport::bytes(stack_data) +
+                        MemoryReport::bytes(stack_process) + MemoryReport::bytes(points) +
+                        MemoryReport::bytes(log_ratios) + MemoryReport::bytes(sides) + MemoryReport::bytes(moved);
+    for (const auto &stack : stacks)
+        bytes += sizeof(SplitMerge_LSS_SDDS) + stack->buffer_bytes();
+    return bytes;
+}
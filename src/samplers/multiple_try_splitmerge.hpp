@@ -0,0 +1,150 @@
+/**
+ * @file multiple_try_splitmerge.hpp
+ * @brief Multiple-try split-merge proposals, the candidates drawn on several threads
+ *
+ * @author Filippo Galli
+ * @date 2025
+ */
+
+#pragma once
+
+#include "../utils/Sampler.hpp"
+#include "replica.hpp"
+#include "splitmerge_LSS_SDDS.hpp"
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <vector>
+
+/**
+ * @class MultipleTrySplitMerge
+ * @brief SplitMerge_LSS_SDDS moves with M candidate splits per anchor pair, selected by multiple-try Metropolis
+ *
+ * A step draws the move mode and the anchor pair as SplitMerge_LSS_SDDS::step() does. When the
+ * anchors share a cluster (state x), M splits y_1, ..., y_M are drawn independently, each with the
+ * launch state and restricted Gibbs scan of SplitMerge_LSS_SDDS, and r_m is the log acceptance
+ * ratio SplitMerge_LSS_SDDS computes for y_m. Candidate k is selected with probability proportional
+ * to exp(r_k) and accepted with probability min(1, (1/M) sum_m exp(r_m)).
+ *
+ * The reverse of a split is the deterministic merge of the anchors' clusters, so when the anchors
+ * are in different clusters (state y) the merged state x is known: M - 1 auxiliary splits of x are
+ * drawn, and the merge is accepted with probability min(1, M / (exp(r_y) + sum_m exp(r*_m))), with
+ * r_y = -(log acceptance ratio of the merge) the ratio of the split from x to y. This is the
+ * multiple-try Metropolis kernel with a deterministic reverse move; it leaves the posterior
+ * invariant and reduces to SplitMerge_LSS_SDDS (without shuffle) for M = 1.
+ *
+ * The M draws all start from the current state and do not interact, so they run concurrently:
+ * candidate m on stack m mod T, each SplitMerge_LSS_SDDS on its own replica stack and OpenMP thread,
+ * for any likelihood. The selected move is then applied to the master Data and to the replicas.
+ * Without replicas the candidates are drawn one after the other on the master stack.
+ *
+ * @see SplitMerge_LSS_SDDS, ParallelSplitMerge
+ */
+class MultipleTrySplitMerge : public Sampler {
+public:
+    /** @brief Cumulated acceptance diagnostics */
+    struct Diagnostics {
+        long splits = 0;          ///< Split proposals
+        long merges = 0;          ///< Merge proposals
+        long accepted_splits = 0; ///< Accepted split proposals
+        long accepted_merges = 0; ///< Accepted merge proposals
+        long candidates = 0;      ///< Splits drawn (candidates and auxiliary draws)
+    };
+
+private:
+    std::shared_ptr<const AnchorTables> anchors;              ///< Shared by all the proposal samplers
+    std::vector<std::unique_ptr<SplitMerge_LSS_SDDS>> stacks; ///< Proposal sampler of each stack
+    std::vector<Data *> stack_data;                           ///< Data of each stack
+    std::vector<Process *> stack_process;                     ///< Process of each stack
+    bool concurrent;                                          ///< Whether the stacks are replicas
+    int tries;                                                ///< Candidates per proposal (M)
+
+    std::vector<int> points;              ///< Points of the split cluster, or of the second merged cluster
+    std::vector<double> log_ratios;       ///< Log acceptance ratio of each draw of the current step
+    std::vector<std::vector<char>> sides; ///< Points of each candidate split that leave the first anchor
+    std::vector<int> moved;               ///< Points of the selected split that open the new cluster
+    Diagnostics diagnostics;
+
+    /**
+     * @brief Runs a task once per stack, concurrently when the stacks are replicas
+     * @param task Called with the stack index t; handles the draws m = t, t + T, ...
+     * @details The replicas are first reset to the master allocations if they differ.
+     */
+    void run_stacks(const std::function<void(int)> &task);
+
+    /** @brief M candidate splits of the cluster of i and j, one of which is kept */
+    void split_step(bool similarity, int i, int j);
+
+    /** @brief Merge of the clusters of i and j, against M - 1 auxiliary splits of the merged state */
+    void merge_step(bool similarity, int i, int j);
+
+    /**
+     * @brief Moves a group of points, all in one cluster, to a new cluster
+     * @param d Data to update
+     * @param group Points to move (not empty)
+     * @details On a Data in lazy compaction mode the new cluster takes the last freed slot.
+     */
+    static void open_cluster(Data &d, const std::vector<int> &group);
+
+    /** @brief Stacks that draw the candidates: all of them, at most one per candidate */
+    int active_stacks() const { return std::min(num_stacks(), tries); }
+
+    /** @brief Applies an accepted move to the master Data and to the replicas in use (concurrently) */
+    void apply(const std::function<void(Data &)> &update);
+
+public:
+    /**
+     * @brief Constructor
+     *
+     * @param d Master Data
+     * @param p Parameters shared by the master stack and the replicas
+     * @param l Master likelihood
+     * @param pr Master process
+     * @param replicas One stack per worker (may be empty: the candidates are then drawn on the master stack)
+     * @param tries Candidates per proposal (M)
+     * @param rng Random number generator stream; the anchors and the decisions are drawn from it,
+     * and one stream is split off per proposal sampler
+     * @throws std::invalid_argument if tries < 1 or a replica has a different number of points
+     *
+     * @details The anchor tables are built once, in O(n^2), and shared by all the proposal samplers.
+     */
+    MultipleTrySplitMerge(Data &d, Params &p, Likelihood &l, Process &pr, const std::vector<SamplerReplica> &replicas,
+                          int tries = 4, Rng rng = Rng());
+
+    /** @brief One multiple-try split or merge proposal */
+    void step() override;
+
+    /**
+     * @brief Writes the random streams of the decisions and of every proposal sampler, and the diagnostics
+     *
+     * @details The replicas are reset to the master allocations, as in ParallelSplitMerge::write_checkpoint().
+     */
+    void write_checkpoint(CheckpointWriter &out) const override;
+
+    /**
+     * @brief Restores the state written by write_checkpoint()
+     * @note The master Data must be restored first (ChainRunner::load_checkpoint() does)
+     */
+    void read_checkpoint(CheckpointReader &in) override;
+
+    /**
+     * @brief Heap bytes of the anchor tables, the proposal samplers and the candidate splits (the stacks report their own)
+     * @see MemoryReport
+     */
+    std::size_t memory_bytes() const override;
+
+    /** @brief Whether the candidates are drawn on the replicas (false: on the master stack) */
+    bool is_concurrent() const { return concurrent; }
+
+    /** @brief Number of stacks the candidates are spread over */
+    int num_stacks() const { return static_cast<int>(stacks.size()); }
+
+    /** @brief Candidates per proposal */
+    int get_tries() const { return tries; }
+
+    /** @brief Diagnostics since construction or the last reset_diagnostics() */
+    const Diagnostics &get_diagnostics() const { return diagnostics; }
+
+    /** @brief Clears the diagnostics */
+    void reset_diagnostics() { diagnostics = Diagnostics(); }
+};
@@ -12,35 +12,89 @@
  */
 
 #include "neal.hpp"
+#include "../utils/SweepOrder.hpp"
+#include <algorithm>
+#include <cstdint>
 #include <numeric>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+Neal3::ScanOrder Neal3::parse_scan_order(const std::string &name) {
+    if (name == "fixed")
+        return ScanOrder::Fixed;
+    if (name == "random")
+        return ScanOrder::Random;
+    if (name == "cluster")
+        return ScanOrder::ClusterGrouped;
+    throw std::invalid_argument("Neal3: unknown scan order \"" + name + "\" (fixed, random or cluster)");
+}
 
-using namespace Rcpp;
-
-// In neal.cpp, could be a private helper in Neal3 or a free function
-int Neal3::sample_from_log_probs(int num_clusters) {
-    // 1. Log-Sum-Exp trick for numerical stability
-    double max_loglik = *std::max_element(log_likelihoods.begin(), log_likelihoods.begin() + num_clusters);
+void Neal3::set_visit_order(std::vector<int> order) {
+    sweep_order::check_permutation(order, n_data, "Neal3");
+    visit_order = std::move(order);
+    indices = visit_order;
+}
 
-    // Reuse pre-allocated weights vector
-    weights.resize(num_clusters);
-    double sum_weights = 0.0;
-    for (int i = 0; i < num_clusters; ++i) {
-        weights[i] = exp(log_likelihoods[i] - max_loglik);
-        sum_weights += weights[i];
+void Neal3::set_active_set(ActiveSet settings) {
+    if (!(settings.min_visit > 0.0 && settings.min_visit <= 1.0) || !(settings.decay > 0.0 && settings.decay <= 1.0)) {
+        throw std::invalid_argument("Neal3: min_visit and decay of the active set must be in (0, 1]");
+    }
+    if (!(settings.settled > 0.0 && settings.settled < 1.0)) {
+        throw std::invalid_argument("Neal3: settled of the active set must be in (0, 1)");
+    }
+    if (settings.adapt_sweeps < 1) {
+        throw std::invalid_argument("Neal3: adapt_sweeps of the active set must be positive");
     }
+    active_settings = settings;
+    active_set_enabled = true;
+    uncertainty.assign(n_data, 1.0);
+    active.reserve(n_data);
+    active_sizes.clear();
+    sweeps = 0;
+}
 
-    // 2. Roulette wheel selection
-    std::uniform_real_distribution<double> unif(0.0, sum_weights);
-    double u = unif(gen);
+std::vector<double> Neal3::visit_probabilities() const {
+    std::vector<double> q(n_data, 1.0);
+    if (active_set_enabled) {
+        const double scale = 1.0 / (1.0 - active_settings.settled);
+        for (int i = 0; i < n_data; ++i)
+            q[i] = std::min(1.0, std::max(active_settings.min_visit, uncertainty[i] * scale));
+    }
+    return q;
+}
 
-    for (int i = 0; i < num_clusters; ++i) {
-        u -= weights[i];
-        if (u < 0.0) {
-            return i;
-        }
+const std::vector<int> &Neal3::prepare_sweep() {
+    switch (scan_order) {
+    case ScanOrder::Fixed:
+        break;
+    case ScanOrder::Random:
+        std::copy(visit_order.begin(), visit_order.end(), indices.begin());
+        std::shuffle(indices.begin(), indices.end(), gen);
+        break;
+    case ScanOrder::ClusterGrouped: {
+        auto next = indices.begin();
+        for (const std::vector<int> &members : data.get_cluster_map())
+            next = std::copy(members.begin(), members.end(), next);
+        break;
+    }
+    }
+    if (lazy_compaction)
+        data.set_lazy_compaction(true);
+    if (!active_set_enabled)
+        return indices;
+
+    // Independent inclusions, kept in the order of the scan
+    ++sweeps;
+    const double scale = 1.0 / (1.0 - active_settings.settled);
+    active.clear();
+    for (const int i : indices) {
+        const double q = std::min(1.0, std::max(active_settings.min_visit, uncertainty[i] * scale));
+        if (q >= 1.0 || gen.uniform_pos() <= q)
+            active.push_back(i);
     }
-    // Fallback for floating point inaccuracies
-    return num_clusters - 1;
+    active_sizes.push_back(static_cast<int>(active.size()));
+    return active;
 }
 
 void Neal3::step_1_observation(int index) {
@@ -52,29 +106,19 @@ void Neal3::step_1_observation(int index) {
      */
 
     // Set unallocated the index
+    const int old_cluster = data.get_cluster_assignment(index);
+    const bool singleton = data.get_cluster_size(old_cluster) == 1;
     data.set_allocation(index, -1);
 
-    const int K = data.get_K();
-    const int num_clusters = K + 1;
-
-    // Resize vector only if needed (capacity already reserved in constructor)
-    log_likelihoods.resize(num_clusters);
-
-    // Compute combined log(likelihood * prior) for existing clusters
-    // This combines likelihood computation with prior multiplication in one pass
-    for (int k = 0; k < K; ++k) {
-        const double log_prior = process.gibbs_prior_existing_cluster(k, index);
-        log_likelihoods[k] = likelihood.point_loglikelihood_cond(index, k) + log_prior;
-    }
-
-    // Compute for new cluster
-    log_likelihoods[K] = likelihood.point_loglikelihood_cond(index, K) + process.gibbs_prior_new_cluster_obs(index);
+    // Log(likelihood * prior) of the K existing clusters and of a new cluster
+    const int num_clusters = compute_gibbs_log_weights(index);
 
     // Sample a cluster based on the probabilities
-    int sampled_cluster = sample_from_log_probs(num_clusters);
+    int sampled_cluster = sample_gibbs_move(index, num_clusters, singleton ? num_clusters - 1 : old_cluster);
 
     // Set the allocation for the data point
     data.set_allocation(index, sampled_cluster);
+    record_visit(index, num_clusters);
 }
 
 void Neal3::step() {
@@ -83,7 +127,39 @@ void Neal3::step() {
      * dataset.
      */
 
-    for (const int idx : indices) {
+    for (const int idx : prepare_sweep()) {
         step_1_observation(idx);
     }
+    finish_sweep();
+}
+
+void Neal3::write_checkpoint(CheckpointWriter &out) const {
+    Sampler::write_checkpoint(out);
+    out.begin("Neal3ActiveSet");
+    out.write(static_cast<int8_t>(active_set_enabled));
+    if (!active_set_enabled)
+        return;
+    out.write(uncertainty);
+    out.write(active_sizes);
+    out.write(sweeps);
+}
+
+void Neal3::read_checkpoint(CheckpointReader &in) {
+    Sampler::read_checkpoint(in);
+    in.expect("Neal3ActiveSet");
+    int8_t saved_active_set;
+    in.read(saved_active_set);
+    if ((saved_active_set != 0) != active_set_enabled) {
+        in.fail(saved_active_set ? "checkpoint has an active set, sampler has none"
+                                 : "checkpoint has no active set, sampler has one");
+    }
+    if (!active_set_enabled)
+        return;
+    in.read(uncertainty);
+    if (static_cast<int>(uncertainty.size()) != n_data) {
+        in.fail("active set written for " + std::to_string(uncertainty.size()) + " points, sampler has " +
+                std::to_string(n_data));
+    }
+    in.read(active_sizes);
+    in.read(sweeps);
 }
@@ -14,6 +14,7 @@
 #pragma once
 
 #include "../utils/Sampler.hpp"
+#include <string>
 #include <vector>
 
 /**
@@ -34,6 +35,12 @@
  * The algorithm is particularly effective for models where the likelihood can
  * be computed in closed form after integrating out cluster-specific parameters.
  *
+ * The points are visited in a fixed order (by default 0, ..., n - 1, or any permutation given to
+ * set_visit_order(), e.g. one from SweepOrder.hpp that keeps neighbours close), in a fresh
+ * random permutation of it each sweep, or grouped by cluster (see ScanOrder). With an active set
+ * (set_active_set()) each sweep visits only a random subset of them, favouring the points whose
+ * allocation is still uncertain.
+ *
  * @note
  * reference Neal, R. M. (2000). "Markov Chain Sampling Methods for Dirichlet
  * Process Mixture Models"
@@ -41,12 +48,36 @@
  * @see Sampler, Process, Likelihood
  */
 class Neal3 : public Sampler {
-private:
-    // ========== Random Number Generation ==========
+public:
+    /**
+     * @brief How the points are ordered within a sweep
+     *
+     * Fixed and Random leave the posterior invariant (a fixed sequence of Gibbs updates, and a
+     * mixture of such sequences drawn independently of the state). ClusterGrouped visits the
+     * members of cluster 0, then of cluster 1, ..., as they stand at the start of the sweep, so
+     * consecutive updates read the same cluster statistics; since the order depends on the
+     * state, invariance is not guaranteed and it is meant for burn-in.
+     */
+    enum class ScanOrder { Fixed, Random, ClusterGrouped };
+
+    /**
+     * @brief Parses a scan order name
+     * @param name "fixed", "random" or "cluster"
+     * @throws std::invalid_argument for any other name
+     */
+    static ScanOrder parse_scan_order(const std::string &name);
 
-    /** @brief Mersenne Twister random number generator for sampling operations */
-    mutable std::mt19937 gen;
+    /**
+     * @brief Settings of the active-set sweeps, see set_active_set()
+     */
+    struct ActiveSet {
+        double min_visit = 0.05; ///< Smallest probability that a sweep visits a point
+        double settled = 0.99;   ///< Allocation probability at which a point gets min_visit
+        double decay = 0.2;      ///< Weight of the latest visit in the running uncertainty
+        int adapt_sweeps = 100;  ///< Sweeps during which the visit probabilities adapt (at least 1)
+    };
 
+private:
     // ========== Core Algorithm Methods ==========
 
     /**
@@ -61,27 +92,50 @@ private:
      * 4. Update cluster assignments and clean up empty clusters
      *
      * The probabilities combine prior information from the Process with
-     * likelihood information computed by integrating out cluster parameters.
+     * likelihood information computed by integrating out cluster parameters,
+     * both evaluated for all candidates at once by the Sampler Gibbs kernel.
      */
     void step_1_observation(int index);
 
+protected:
+    // Pre-allocated buffers to avoid repeated allocations
+    std::vector<int> indices;  ///< Points in the order of the current sweep
+    int n_data;
+
+    std::vector<int> visit_order;            ///< Base order of the points (Fixed, and shuffled by Random)
+    ScanOrder scan_order = ScanOrder::Fixed; ///< Ordering of each sweep
+    bool lazy_compaction = false;            ///< Keep emptied clusters as free slots during a sweep
+
+    bool active_set_enabled = false;   ///< Whether the sweeps visit an active set only
+    ActiveSet active_settings;         ///< Settings of the active set
+    std::vector<double> uncertainty;   ///< Running mean of 1 - max allocation probability of each point
+    std::vector<int> active;           ///< Points of the current sweep (active set only)
+    std::vector<int> active_sizes;     ///< Size of the active set of each sweep
+    int sweeps = 0;                    ///< Sweeps run with the active set
+
     /**
-     * @brief Sample an index from log-probabilities using the log-sum-exp trick
-     *
-     * @param num_clusters Number of clusters (including new cluster)
-     * @return Index sampled according to the probabilities
-     *
-     * @details This method performs sampling from a discrete distribution
-     * defined by log-probabilities. It uses the log-sum-exp trick for numerical
-     * stability and implements roulette wheel selection.
+     * @brief Fills indices for the next sweep, according to scan_order, and opens lazy compaction
+     * @return Points to visit, in order: indices, or its active subset
      */
-    int sample_from_log_probs(int num_clusters);
+    const std::vector<int> &prepare_sweep();
 
-    // Pre-allocated buffers to avoid repeated allocations
-    std::vector<int> indices;
-    std::vector<double> log_likelihoods;
-    std::vector<double> weights;
-    int n_data;
+    /**
+     * @brief Records the allocation probabilities of a visit, while the active set adapts
+     * @param index Point just updated
+     * @param m Number of candidates; the Gibbs weights hold their normalized probabilities
+     */
+    void record_visit(int index, int m) {
+        if (!active_set_enabled || sweeps > active_settings.adapt_sweeps)
+            return;
+        const double u = 1.0 - gibbs_log_weights.head(m).maxCoeff();
+        uncertainty[index] += active_settings.decay * (u - uncertainty[index]);
+    }
+
+    /** @brief Compacts the clusters emptied during the sweep (lazy compaction only) */
+    void finish_sweep() {
+        if (lazy_compaction)
+            data.set_lazy_compaction(false);
+    }
 
 public:
     // ========== Constructor ==========
@@ -93,20 +147,95 @@ public:
      * @param p Reference to Params object with hyperparameters
      * @param l Reference to Likelihood object for probability computations
      * @param pr Reference to Process object (DP, NGGP, etc.) defining the prior
+     * @param rng Random number generator stream (default: non-deterministically seeded)
      *
      * @details Initializes the Gibbs sampler with all required components.
-     * The random number generator is seeded from the inherited random device.
-     * Pre-allocates vectors to maximum possible size to avoid resizing during sampling.
+     * The random number generator stream and the log-weight buffer are stored in the Sampler base.
      */
-    Neal3(Data &d, Params &p, Likelihood &l, Process &pr) : Sampler(d, p, l, pr), gen(rd()), n_data(d.get_n()) {
-        // Pre-allocate to max size (all points in separate clusters + 1 new cluster)
-        log_likelihoods.reserve(n_data + 1);
-        weights.reserve(n_data + 1);
-
+    Neal3(Data &d, Params &p, const Likelihood &l, Process &pr, Rng rng = Rng()) : Sampler(d, p, l, pr, rng), n_data(d.get_n()) {
         indices.resize(n_data);
         std::iota(indices.begin(), indices.end(), 0);
+        visit_order = indices;
+    }
+
+    // ========== Sweep Order ==========
+
+    /** @brief Sets how the points are ordered within a sweep (default: Fixed) */
+    void set_scan_order(ScanOrder order) {
+        scan_order = order;
+        indices = visit_order;
+    }
+
+    /** @brief How the points are ordered within a sweep */
+    ScanOrder get_scan_order() const { return scan_order; }
+
+    /**
+     * @brief Sets the base visiting order of the points
+     * @param order Permutation of 0, ..., n - 1 (see SweepOrder.hpp for locality-preserving ones)
+     * @throws std::invalid_argument if order is not a permutation of the points
+     */
+    void set_visit_order(std::vector<int> order);
+
+    /** @brief Base visiting order of the points */
+    const std::vector<int> &get_visit_order() const { return visit_order; }
+
+    /**
+     * @brief Keeps the clusters emptied during a sweep as free slots (default: false)
+     * @param lazy True for Data::set_lazy_compaction() during each sweep
+     *
+     * A point leaving a singleton and opening a new cluster then lands back in the same slot,
+     * instead of moving the last cluster into the hole and appending a new one; the relabelling
+     * and the statistics moves of every ClusterInfo are saved. The clusters are compacted at the
+     * end of the sweep, so the other moves, the traces and the checkpoints never see a free slot.
+     * The chain is the same in distribution, but not draw for draw, since clusters are numbered
+     * differently.
+     */
+    void set_lazy_compaction(bool lazy) { lazy_compaction = lazy; }
+
+    /** @brief Whether the clusters emptied during a sweep are kept as free slots */
+    bool get_lazy_compaction() const { return lazy_compaction; }
+
+    /**
+     * @brief Visits only a random active set of the points in each sweep
+     * @param settings Visit probabilities and their adaptation
+     * @throws std::invalid_argument if min_visit or decay is not in (0, 1], settled is not in
+     * (0, 1) or adapt_sweeps is not positive (the visit probabilities would never leave 1)
+     *
+     * Each visit records 1 - the largest allocation probability of the point in a running mean u_i
+     * (weight decay for the latest visit), starting from 1. A sweep visits point i with probability
+     * q_i = min(1, max(min_visit, u_i / (1 - settled))), independently of the others and of the
+     * state, in the order of the scan: a point whose cluster is nearly certain is visited about
+     * min_visit of the sweeps, one with an uncertain allocation every sweep, so the Gibbs updates
+     * go where the partition still moves.
+     *
+     * The u_i adapt during the first adapt_sweeps sweeps, then are frozen: the q_i no longer depend
+     * on the chain, and each sweep is a random subset, drawn independently of the state, of Gibbs
+     * updates that each leave the posterior invariant, with every point updated with probability
+     * at least min_visit. So the chain is valid after adaptation, with no correction: set
+     * adapt_sweeps to the sweeps of the burn-in. Resets the running means.
+     */
+    void set_active_set(ActiveSet settings);
+
+    /** @brief Visits every point in each sweep again (the default) */
+    void clear_active_set() {
+        active_set_enabled = false;
+        std::vector<int>().swap(active);
     }
 
+    /** @brief Whether the sweeps visit an active set only */
+    bool has_active_set() const { return active_set_enabled; }
+
+    /** @brief Settings of the active set */
+    const ActiveSet &get_active_set() const { return active_settings; }
+
+    /** @brief Size of the active set of each sweep since set_active_set() */
+    const std::vector<int> &get_active_sizes() const { return active_sizes; }
+
+    /**
+     * @brief Current probability that a sweep visits each point (all 1 without an active set)
+     */
+    std::vector<double> visit_probabilities() const;
+
     // ========== MCMC Interface ==========
 
     /**
@@ -124,4 +253,29 @@ public:
      * @see step_1_observation()
      */
     void step() override;
+
+    /**
+     * @brief Every Gibbs move reports its likelihood change (see Sampler::sample_gibbs_move()),
+     * if the likelihood has exact conditionals
+     */
+    bool tracks_log_likelihood() const override { return likelihood.exact_conditionals(); }
+
+    /** @brief Writes whether there is an active set and its running uncertainties, after the base */
+    void write_checkpoint(CheckpointWriter &out) const override;
+
+    /**
+     * @brief Restores the state written by write_checkpoint()
+     * @throws std::runtime_error if the checkpoint has no active set and the sampler has one, or
+     * the reverse, or it was written for another number of points
+     */
+    void read_checkpoint(CheckpointReader &in) override;
+
+    /**
+     * @brief Heap bytes of the sweep orders and the active set, plus the Sampler buffers
+     * @see MemoryReport
+     */
+    std::size_t memory_bytes() const override {
+        return Sampler::memory_bytes() + MemoryReport::bytes(indices) + MemoryReport::bytes(visit_order) +
+               MemoryReport::bytes(uncertainty) + MemoryReport::bytes(active) + MemoryReport::bytes(active_sizes);
+    }
 };
\ No newline at end of file
@@ -0,0 +1,92 @@
+/**
+ * @file nealT.hpp
+ * @brief Neal's Algorithm 3 for a likelihood and a process type fixed at compile time
+ *
+ * @author Filippo Galli
+ * @date 2025
+ */
+
+#pragma once
+
+#include "neal.hpp"
+#include <stdexcept>
+#include <type_traits>
+#include <typeinfo>
+
+/**
+ * @class Neal3T
+ * @brief Neal3 whose likelihood and process have concrete types fixed at compile time
+ *
+ * The Gibbs kernel of Sampler reaches the likelihood and the process through base references,
+ * with one virtual call per term of every point update. Neal3T makes the same calls qualified
+ * with the concrete types, so they bind statically and can be inlined into the sweep when the
+ * definitions are visible (header-defined members, or LTO for the others). The operations are
+ * the same as Neal3's, in the same order, and the chain is bit-identical.
+ *
+ * @tparam L Concrete likelihood type (the dynamic type of the likelihood passed in, exactly)
+ * @tparam P Concrete process type (the dynamic type of the process passed in, exactly)
+ *
+ * @see Neal3, Sampler::compute_gibbs_log_weights()
+ */
+template <typename L, typename P> class Neal3T final : public Neal3 {
+    static_assert(std::is_base_of<Likelihood, L>::value && !std::is_same<Likelihood, L>::value,
+                  "Neal3T: L must be a concrete likelihood");
+    static_assert(std::is_base_of<Process, P>::value && !std::is_same<Process, P>::value,
+                  "Neal3T: P must be a concrete process");
+
+private:
+    const L &static_likelihood; ///< The likelihood, with its concrete type
+    const P &static_process;    ///< The process, with its concrete type
+
+    /** @brief Sampler::compute_gibbs_log_weights() with the full conditional of a new cluster */
+    int compute_static_gibbs_log_weights(int index) {
+        const int K = data.get_K();
+        const int m = K + 1;
+
+        if (gibbs_threads > 1 && gibbs_work(K) >= gibbs_min_work)
+            static_likelihood.L::point_loglikelihood_cond_all_parallel(index, gibbs_log_weights.head(m),
+                                                                      gibbs_threads);
+        else
+            static_likelihood.L::point_loglikelihood_cond_all(index, gibbs_log_weights.head(m));
+
+        Workspace::Frame frame(workspace);
+        Eigen::Map<Eigen::VectorXd> log_prior = workspace.vector(K);
+        static_process.P::gibbs_prior_existing_clusters(index, log_prior);
+        gibbs_log_weights.head(K) += log_prior;
+        mask_free_clusters();
+        gibbs_log_weights(K) += static_process.P::gibbs_prior_new_cluster_obs(index);
+        return m;
+    }
+
+public:
+    /**
+     * @brief Constructor
+     *
+     * @param d Reference to Data object containing observations
+     * @param p Reference to Params object with hyperparameters
+     * @param l Likelihood, of dynamic type exactly L
+     * @param pr Process, of dynamic type exactly P
+     * @param rng Random number generator stream (default: non-deterministically seeded)
+     * @throws std::invalid_argument if l or pr has another dynamic type (a derived type would
+     * have its overrides skipped)
+     */
+    Neal3T(Data &d, Params &p, const L &l, P &pr, Rng rng = Rng())
+        : Neal3(d, p, l, pr, rng), static_likelihood(l), static_process(pr) {
+        if (typeid(l) != typeid(L) || typeid(pr) != typeid(P)) {
+            throw std::invalid_argument("Neal3T: likelihood or process is not of the compiled type");
+        }
+    }
+
+    /** @brief One sweep of Neal's Algorithm 3, as Neal3::step() */
+    void step() override {
+        for (const int idx : prepare_sweep()) {
+            const int old_cluster = data.get_cluster_assignment(idx);
+            const bool singleton = data.get_cluster_size(old_cluster) == 1;
+            data.set_allocation(idx, -1);
+            const int num_clusters = compute_static_gibbs_log_weights(idx);
+            data.set_allocation(idx, sample_gibbs_move(idx, num_clusters, singleton ? num_clusters - 1 : old_cluster));
+            record_visit(idx, num_clusters);
+        }
+        finish_sweep();
+    }
+};
@@ -13,17 +13,18 @@
 #include <algorithm>
 #include <numeric>
 
-std::vector<double>
-Neal3ZDNAM::compute_zdnam_probabilities(const std::vector<double> &log_probs,
-                                        int current_k) {
+void Neal3ZDNAM::compute_zdnam_probabilities(const double *log_probs, int m,
+                                             int current_k, double *p) {
   // Initialize result vector with number of possible states
-  int m = log_probs.size();
-  std::vector<double> p(m, 0.0);
+  std::fill(p, p + m, 0.0);
+
+  // π and σ live in the sampler workspace, released on return
+  Workspace::Frame frame(workspace);
 
   // Step 1: Convert log probabilities to normalized probabilities (π)
   // Use log-sum-exp trick for numerical stability
-  double max_loglik = *std::max_element(log_probs.begin(), log_probs.end());
-  std::vector<double> pi(m);
+  double max_loglik = *std::max_element(log_probs, log_probs + m);
+  double *pi = workspace.take<double>(m);
   double sum_pi = 0.0;
   for (int i = 0; i < m; ++i) {
     pi[i] = exp(log_probs[i] - max_loglik);
@@ -37,15 +38,16 @@ Neal3ZDNAM::compute_zdnam_probabilities(const std::vector<double> &log_probs,
   // Edge case: current state has zero probability
   // Cannot construct ZDNAM, fall back to standard Gibbs
   if (current_k >= 0 && pi[current_k] <= 0.0) {
-    return pi;
+    std::copy(pi, pi + m, p);
+    return;
   }
 
   // Step 2: Create ordering σ by non-increasing probability
   // This is the focal value ordering used in Algorithm 5
-  std::vector<int> sigma(m);
-  std::iota(sigma.begin(), sigma.end(), 0);
-  std::sort(sigma.begin(), sigma.end(),
-            [&pi](int a, int b) { return pi[a] > pi[b]; });
+  int *sigma = workspace.take<int>(m);
+  std::iota(sigma, sigma + m, 0);
+  std::sort(sigma, sigma + m,
+            [pi](int a, int b) { return pi[a] > pi[b]; });
 
   // Step 3: Handle special case where most probable state has π ≥ 1/2
   // Use simpler downward nesting construction
@@ -63,7 +65,7 @@ Neal3ZDNAM::compute_zdnam_probabilities(const std::vector<double> &log_probs,
       // Current state is not most probable: always move to most probable
       p[sigma[0]] = 1.0;
     }
-    return p;
+    return;
   }
 
   // Step 4: Main ZDNAM algorithm (Algorithm 5 from Neal 2019)
@@ -107,11 +109,11 @@ Neal3ZDNAM::compute_zdnam_probabilities(const std::vector<double> &log_probs,
               for (int k = i + 2; k < m; ++k) {
                 p[sigma[k]] = f * B * pi[sigma[k]] / q;
               }
-              return p;
+              return;
             }
           }
 
-          return p;
+          return;
         }
       }
 
@@ -144,51 +146,36 @@ Neal3ZDNAM::compute_zdnam_probabilities(const std::vector<double> &log_probs,
       p[current_k] = f;
     }
   }
-
-  return p;
 }
 
-int Neal3ZDNAM::sample_from_log_probs_zdnam(
-    const std::vector<double> &log_probs, int current_k) {
-  std::vector<double> probs;
+int Neal3ZDNAM::sample_from_log_probs_zdnam(const double *log_probs, int m,
+                                            int current_k) {
+  Workspace::Frame frame(workspace);
+  double *probs = workspace.take<double>(m);
 
   // Decide which probabilities to use based on current state
-  if (current_k >= 0 && current_k < log_probs.size()) {
+  if (current_k >= 0 && current_k < m) {
     // Valid current state: use ZDNAM transition probabilities
     // This will avoid self-transition when possible
-    probs = compute_zdnam_probabilities(log_probs, current_k);
+    compute_zdnam_probabilities(log_probs, m, current_k, probs);
   } else {
     // No valid current state (e.g., first allocation)
     // Use standard normalized probabilities from target distribution
-    double max_loglik = *std::max_element(log_probs.begin(), log_probs.end());
-    probs.resize(log_probs.size());
+    double max_loglik = *std::max_element(log_probs, log_probs + m);
     double sum_probs = 0.0;
 
     // Log-sum-exp normalization
-    for (size_t i = 0; i < log_probs.size(); ++i) {
+    for (int i = 0; i < m; ++i) {
       probs[i] = exp(log_probs[i] - max_loglik);
       sum_probs += probs[i];
     }
-    for (size_t i = 0; i < log_probs.size(); ++i) {
+    for (int i = 0; i < m; ++i) {
       probs[i] /= sum_probs;
     }
   }
 
   // Sample from discrete distribution using inverse CDF (roulette wheel)
-  std::uniform_real_distribution<double> unif(0.0, 1.0);
-  double u = unif(gen);
-  double cumsum = 0.0;
-
-  for (size_t i = 0; i < probs.size(); ++i) {
-    cumsum += probs[i];
-    if (u < cumsum) {
-      return i;
-    }
-  }
-
-  // Numerical safety: if we get here due to floating point errors,
-  // return the last state
-  return probs.size() - 1;
+  return gen.categorical(probs, m, 1.0);
 }
 
 void Neal3ZDNAM::step_1_observation(int index) {
@@ -200,26 +187,14 @@ void Neal3ZDNAM::step_1_observation(int index) {
   data.set_allocation(index, -1);
 
   // Step 3: Compute log probabilities for all possible assignments
-  // Vector size = K existing clusters + 1 potential new cluster
-  std::vector<double> log_likelihoods(data.get_K() + 1, 0.0);
-
-  // Compute for existing clusters
-  for (int k = 0; k < data.get_K(); ++k) {
-    // Likelihood: P(x_i | allocated to cluster k, other assignments)
-    log_likelihoods[k] = likelihood.point_loglikelihood_cond(index, k);
-    // Prior: P(c_i = k | other assignments) from DP/NGGP
-    log_likelihoods[k] += process.gibbs_prior_existing_cluster(k, index);
-  }
-
-  // Compute for potential new cluster
-  log_likelihoods[data.get_K()] =
-      likelihood.point_loglikelihood_cond(index, data.get_K());
-  log_likelihoods[data.get_K()] += process.gibbs_prior_new_cluster_obs(index);
+  // K existing clusters + 1 potential new cluster, likelihood and prior
+  // (DP/NGGP and modules) evaluated in batch by the Sampler Gibbs kernel
+  const int num_clusters = compute_gibbs_log_weights(index);
 
   // Step 4: Sample new assignment using ZDNAM
   // Pass current_cluster to enable zero self-transition
-  int sampled_cluster =
-      sample_from_log_probs_zdnam(log_likelihoods, current_cluster);
+  int sampled_cluster = sample_from_log_probs_zdnam(
+      gibbs_log_weights.data(), num_clusters, current_cluster);
 
   // Step 5: Assign observation to sampled cluster
   // This automatically handles cluster creation/deletion
@@ -227,15 +202,18 @@ void Neal3ZDNAM::step_1_observation(int index) {
 }
 
 void Neal3ZDNAM::step() {
-  // Step 1: Create vector of all observation indices [0, 1, ..., n-1]
-  std::vector<int> indices(data.get_n());
-  std::iota(indices.begin(), indices.end(), 0);
+  // Step 1: Create vector of all observation indices [0, 1, ..., n-1], in
+  // the workspace (the point updates take their buffers above it)
+  Workspace::Frame frame(workspace);
+  const int n = data.get_n();
+  int *indices = workspace.take<int>(n);
+  std::iota(indices, indices + n, 0);
 
   // Step 2: Randomly shuffle to avoid systematic bias in update order
-  std::shuffle(indices.begin(), indices.end(), gen);
+  std::shuffle(indices, indices + n, gen);
 
   // Step 3: Update each observation in random order using ZDNAM
-  for (int j = 0; j < indices.size(); ++j) {
+  for (int j = 0; j < n; ++j) {
     step_1_observation(indices[j]);
   }
 
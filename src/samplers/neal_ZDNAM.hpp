@@ -59,11 +59,6 @@
  */
 class Neal3ZDNAM : public Sampler {
 private:
-  // ========== Random Number Generation ==========
-
-  /** @brief Mersenne Twister random number generator for sampling operations */
-  mutable std::mt19937 gen;
-
   // ========== Core Algorithm Methods ==========
 
   /**
@@ -108,11 +103,12 @@ private:
   /**
    * @brief Compute ZDNAM transition probabilities from current state
    *
-   * @param log_probs Vector of unnormalized log probabilities (target
-   * distribution π)
+   * @param log_probs Unnormalized log probabilities (target distribution π),
+   * m entries
+   * @param m Number of states
    * @param current_k Current state/cluster index (-1 if no current state)
-   * @return Vector of transition probabilities P(·|current_k) with
-   * P(current_k|current_k) = 0
+   * @param p Output, m entries: the transition probabilities P(·|current_k)
+   * with P(current_k|current_k) = 0
    *
    * @details Implements Algorithm 5 from Neal (2019). The algorithm constructs
    * transition probabilities that:
@@ -143,17 +139,17 @@ private:
    *
    * @see sample_from_log_probs_zdnam()
    */
-  std::vector<double>
-  compute_zdnam_probabilities(const std::vector<double> &log_probs,
-                              int current_k);
+  void compute_zdnam_probabilities(const double *log_probs, int m,
+                                   int current_k, double *p);
 
   /**
    * @brief Sample from log probabilities using ZDNAM to avoid self-transitions
    *
-   * @param log_probs Vector of unnormalized log probabilities (target
-   * distribution)
+   * @param log_probs Unnormalized log probabilities (target distribution),
+   * m entries
+   * @param m Number of states
    * @param current_k Current state/cluster index (-1 for no current state)
-   * @return Sampled index from 0 to log_probs.size()-1
+   * @return Sampled index from 0 to m-1
    *
    * @details High-level ZDNAM sampling procedure:
    * 1. If current_k is valid: compute ZDNAM transition probabilities
@@ -171,7 +167,7 @@ private:
    *
    * @see compute_zdnam_probabilities()
    */
-  int sample_from_log_probs_zdnam(const std::vector<double> &log_probs,
+  int sample_from_log_probs_zdnam(const double *log_probs, int m,
                                   int current_k);
 
 public:
@@ -187,6 +183,7 @@ public:
    * probabilities
    * @param pr Reference to Process object (DP, NGGP, etc.) defining the prior
    * distribution
+   * @param rng Random number generator stream (default: non-deterministically seeded)
    *
    * @details Initializes the ZDNAM-enhanced Gibbs sampler with all required
    * components. The random number generator is seeded from the inherited random
@@ -196,8 +193,8 @@ public:
    * @note The ZDNAM modification is automatically applied during sampling; no
    * additional configuration is needed.
    */
-  Neal3ZDNAM(Data &d, Params &p, Likelihood &l, Process &pr)
-      : Sampler(d, p, l, pr), gen(rd()) {};
+  Neal3ZDNAM(Data &d, Params &p, Likelihood &l, Process &pr, Rng rng = Rng())
+      : Sampler(d, p, l, pr, rng) {};
 
   // ========== MCMC Interface ==========
 
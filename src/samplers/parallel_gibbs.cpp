@@ -0,0 +1,415 @@
+/**
+ * @file parallel_gibbs.cpp
+ * @brief Implementation of ParallelGibbs
+ *
+ * @author Filippo Galli
+ * @date 2025
+ */
+
+#include "parallel_gibbs.hpp"
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+// ========== Worker ==========
+
+void ParallelGibbs::Worker::update(int index, std::vector<double> *probs) {
+    // Clusters emptied during the round are only removed at the merge, so K may exceed n
+    if (gibbs_log_weights.size() < data.get_K() + 2)
+        gibbs_log_weights.resize(2 * (data.get_K() + 2));
+
+    data.set_allocation(index, -1);
+    const int m = compute_gibbs_log_weights(index);
+    const int sampled_cluster = sample_gibbs_log_weights(m);
+    if (probs)
+        probs->assign(gibbs_log_weights.data(), gibbs_log_weights.data() + m);
+    data.set_allocation(index, sampled_cluster);
+}
+
+void ParallelGibbs::Worker::conditional(int index, std::vector<double> &probs) {
+    if (gibbs_log_weights.size() < data.get_K() + 2)
+        gibbs_log_weights.resize(2 * (data.get_K() + 2));
+
+    const int cluster = data.get_allocations()(index);
+    data.set_allocation(index, -1);
+    const int m = compute_gibbs_log_weights(index);
+    normalize_log_weights(gibbs_log_weights.head(m));
+    probs.assign(gibbs_log_weights.data(), gibbs_log_weights.data() + m);
+    data.set_allocation(index, cluster);
+}
+
+// ========== ParallelGibbs ==========
+
+ParallelGibbs::ParallelGibbs(Data &d, Params &p, Likelihood &l, Process &pr, const std::vector<Replica> &replicas,
+                             const Options &options, SparseAdjacency graph_, Rng rng)
+    : Sampler(d, p, l, pr, rng), options(options), graph(std::move(graph_)), has_graph(graph.size() > 0),
+      n(d.get_n()) {
+    if (replicas.empty()) {
+        throw std::invalid_argument("ParallelGibbs needs at least one replica");
+    }
+    if (options.rounds < 1 || options.check_every < 0) {
+        throw std::invalid_argument("ParallelGibbs: rounds must be positive and check_every non-negative");
+    }
+    if (has_graph && graph.size() != n) {
+        throw std::invalid_argument("ParallelGibbs: graph and data differ in size");
+    }
+    if (options.coloring && !has_graph) {
+        throw std::invalid_argument("ParallelGibbs: coloring needs a graph");
+    }
+
+    for (const Replica &replica : replicas) {
+        if (!replica.data || !replica.likelihood || !replica.process || replica.data->get_n() != n) {
+            throw std::invalid_argument("ParallelGibbs: every replica needs a data set of n points");
+        }
+        workers.push_back(std::make_unique<Worker>(replica, p, gen.split()));
+    }
+    checks.resize(workers.size());
+
+    order.resize(n);
+    std::iota(order.begin(), order.end(), 0);
+    owner.assign(n, -1);
+    moved.assign(n, 0);
+
+    if (options.coloring)
+        build_colors();
+}
+
+void ParallelGibbs::build_colors() {
+    // Welsh-Powell: highest degree first, each point takes the smallest color free among its neighbours
+    std::vector<int> by_degree(n);
+    std::iota(by_degree.begin(), by_degree.end(), 0);
+    std::stable_sort(by_degree.begin(), by_degree.end(),
+                     [this](int a, int b) { return graph.degree(a) > graph.degree(b); });
+
+    std::vector<int> color(n, -1);
+    std::vector<int> seen; // seen[c] == i + 1 if color c is taken by a neighbour of i
+    int num_colors = 0;
+    for (const int i : by_degree) {
+        for (const int j : graph[i]) {
+            if (color[j] >= 0)
+                seen[color[j]] = i + 1;
+        }
+        int c = 0;
+        while (c < num_colors && seen[c] == i + 1)
+            ++c;
+        if (c == num_colors) {
+            ++num_colors;
+            seen.push_back(0);
+        }
+        color[i] = c;
+    }
+
+    color_classes.assign(num_colors, {});
+    for (int i = 0; i < n; ++i)
+        color_classes[color[i]].push_back(i);
+}
+
+void ParallelGibbs::plan_sweep() {
+    round_bounds.assign(1, 0);
+
+    if (!options.coloring) {
+        std::shuffle(order.begin(), order.end(), gen);
+        for (int r = 1; r <= options.rounds; ++r)
+            round_bounds.push_back(static_cast<int>(static_cast<long>(n) * r / options.rounds));
+        return;
+    }
+
+    // Colors in turn, each shuffled and cut into rounds in proportion to its size
+    int position = 0;
+    for (std::vector<int> &points : color_classes) {
+        std::shuffle(points.begin(), points.end(), gen);
+        std::copy(points.begin(), points.end(), order.begin() + position);
+        const int size = static_cast<int>(points.size());
+        const int rounds = std::max<int>(1, (static_cast<long>(size) * options.rounds + n - 1) / n);
+        for (int r = 1; r <= rounds; ++r)
+            round_bounds.push_back(position + static_cast<int>(static_cast<long>(size) * r / rounds));
+        position += size;
+    }
+}
+
+void ParallelGibbs::sync_replicas() {
+    const int T = num_workers();
+    std::vector<std::exception_ptr> errors(T);
+
+#pragma omp parallel for schedule(static, 1) num_threads(T)
+    for (int t = 0; t < T; ++t) {
+        try {
+            Data &replica = workers[t]->get_data();
+            if (replica.in_transaction() || replica.get_allocations() != state)
+                replica.set_allocations(state);
+        } catch (...) {
+            errors[t] = std::current_exception();
+        }
+    }
+
+    for (const std::exception_ptr &error : errors) {
+        if (error)
+            std::rethrow_exception(error);
+    }
+}
+
+void ParallelGibbs::run_round(int begin, int end) {
+    const int T = num_workers();
+    const int m = end - begin;
+    const int K_snapshot = static_cast<int>(sizes.size());
+    auto chunk_begin = [&](int t) { return begin + static_cast<int>(static_cast<long>(m) * t / T); };
+
+    for (int t = 0; t < T; ++t) {
+        for (int p = chunk_begin(t); p < chunk_begin(t + 1); ++p)
+            owner[order[p]] = t;
+    }
+
+    // ---------- Concurrent updates on the replicas ----------
+    std::vector<std::exception_ptr> errors(T);
+
+#pragma omp parallel for schedule(static, 1) num_threads(T)
+    for (int t = 0; t < T; ++t) {
+        try {
+            Worker &worker = *workers[t];
+            worker.get_data().begin_transaction();
+            checks[t].clear();
+            for (int p = chunk_begin(t); p < chunk_begin(t + 1); ++p) {
+                const int i = order[p];
+                if (options.check_every > 0 && (p - begin) % options.check_every == 0) {
+                    checks[t].push_back({p, {}});
+                    worker.update(i, &checks[t].back().probs);
+                } else {
+                    worker.update(i, nullptr);
+                }
+            }
+        } catch (...) {
+            errors[t] = std::current_exception();
+        }
+    }
+
+    for (const std::exception_ptr &error : errors) {
+        if (error)
+            std::rethrow_exception(error);
+    }
+
+    // ---------- Merge ----------
+    snapshot = state;
+    // Snapshot clusters keep their labels; each worker's new clusters get the next global labels
+    std::vector<std::vector<int>> new_labels(T);
+    std::vector<long> moves(T, 0), births(T, 0);
+    for (int t = 0; t < T; ++t) {
+        const Data &replica = workers[t]->get_data();
+        const Eigen::VectorXi &local = replica.get_allocations();
+        new_labels[t].assign(std::max(0, replica.get_K() - K_snapshot), -1);
+
+        for (int p = chunk_begin(t); p < chunk_begin(t + 1); ++p) {
+            const int i = order[p];
+            int label = local(i);
+            if (label >= K_snapshot) {
+                int &global = new_labels[t][label - K_snapshot];
+                if (global < 0) {
+                    global = static_cast<int>(sizes.size());
+                    sizes.push_back(0);
+                    ++births[t];
+                }
+                label = global;
+            }
+            if (label != state(i)) {
+                if (state(i) >= 0)
+                    --sizes[state(i)];
+                ++sizes[label];
+                state(i) = label;
+                moved[i] = 1;
+                ++moves[t];
+            }
+        }
+    }
+
+    // ---------- Diagnostics ----------
+    const long total_moves = std::accumulate(moves.begin(), moves.end(), 0L);
+    int birth_workers = 0;
+    for (int t = 0; t < T; ++t) {
+        const long updates = chunk_begin(t + 1) - chunk_begin(t);
+        diagnostics.unseen_moves += static_cast<double>(updates) * (total_moves - moves[t]);
+        diagnostics.births += births[t];
+        birth_workers += births[t] > 0;
+    }
+    if (birth_workers > 1)
+        diagnostics.concurrent_births += std::accumulate(births.begin(), births.end(), 0L);
+    diagnostics.rounds++;
+    diagnostics.updates += m;
+    diagnostics.moves += total_moves;
+
+    if (has_graph) {
+        long conflicts = 0;
+        for (int p = begin; p < end; ++p) {
+            const int i = order[p];
+            if (!moved[i])
+                continue;
+            for (const int j : graph[i]) {
+                if (moved[j] && owner[j] >= 0 && owner[j] != owner[i])
+                    ++conflicts;
+            }
+        }
+        diagnostics.edge_conflicts += conflicts / 2; // every edge was seen from both ends
+    }
+
+    // ---------- Compaction ----------
+    std::vector<int> relabel(sizes.size());
+    int K = 0;
+    for (size_t k = 0; k < sizes.size(); ++k)
+        relabel[k] = sizes[k] > 0 ? K++ : -1;
+    if (K < static_cast<int>(sizes.size())) {
+        for (int i = 0; i < n; ++i) {
+            if (state(i) >= 0)
+                state(i) = relabel[state(i)];
+        }
+        std::vector<int> compacted(K);
+        for (size_t k = 0; k < sizes.size(); ++k) {
+            if (relabel[k] >= 0)
+                compacted[relabel[k]] = sizes[k];
+        }
+        sizes.swap(compacted);
+    }
+
+    for (int p = begin; p < end; ++p) {
+        owner[order[p]] = -1;
+        moved[order[p]] = 0;
+    }
+
+    sync_replicas();
+
+    if (options.check_every > 0) {
+        for (int t = 0; t < T; ++t)
+            run_checks(t, chunk_begin(t + 1), K_snapshot, new_labels[t], relabel);
+    }
+}
+
+void ParallelGibbs::run_checks(int t, int chunk_end, int K_snapshot, const std::vector<int> &new_labels,
+                               const std::vector<int> &relabel) {
+    if (checks[t].empty())
+        return;
+
+    Worker &reference = *workers[0];
+    Data &ref = reference.get_data();
+    ref.begin_transaction();
+
+    // Current label on the reference of each snapshot cluster (-1: removed and not reopened yet)
+    std::vector<int> restored(relabel.begin(), relabel.begin() + K_snapshot);
+    std::vector<double> stale;
+
+    int reverted = chunk_end;
+    for (auto check = checks[t].rbegin(); check != checks[t].rend(); ++check) {
+        // Points updated after this one go back to their snapshot clusters
+        for (; reverted > check->position + 1; --reverted) {
+            const int i = order[reverted - 1];
+            const int s = snapshot(i);
+            if (s >= 0 && restored[s] < 0)
+                restored[s] = ref.get_K(); // reopened as a new cluster
+            ref.set_allocation(i, s >= 0 ? restored[s] : -1);
+        }
+
+        reference.conditional(order[check->position], exact);
+        const int K = static_cast<int>(exact.size()) - 1;
+
+        // Stale probabilities over the reference labels; mass on clusters gone since is unmatched
+        stale.assign(K + 1, 0.0);
+        double unmatched = 0.0;
+        const int last = static_cast<int>(check->probs.size()) - 1;
+        for (int l = 0; l < last; ++l) {
+            int label = -1;
+            if (l < K_snapshot) {
+                label = restored[l];
+            } else if (new_labels[l - K_snapshot] >= 0) {
+                label = relabel[new_labels[l - K_snapshot]];
+            }
+            if (label >= 0 && label < K)
+                stale[label] += check->probs[l];
+            else
+                unmatched += check->probs[l];
+        }
+        stale[K] += check->probs[last];
+
+        double tv = unmatched;
+        for (int k = 0; k <= K; ++k)
+            tv += std::abs(exact[k] - stale[k]);
+        tv *= 0.5;
+
+        diagnostics.checked++;
+        diagnostics.tv_sum += tv;
+        diagnostics.tv_max = std::max(diagnostics.tv_max, tv);
+    }
+
+    ref.rollback();
+}
+
+void ParallelGibbs::step() {
+    state = data.get_allocations();
+    sizes.assign(data.get_K(), 0);
+    for (int i = 0; i < n; ++i) {
+        if (state(i) >= 0)
+            ++sizes[state(i)];
+    }
+    sync_replicas();
+
+    plan_sweep();
+    for (size_t r = 0; r + 1 < round_bounds.size(); ++r) {
+        if (round_bounds[r] < round_bounds[r + 1])
+            run_round(round_bounds[r], round_bounds[r + 1]);
+    }
+
+    data.set_allocations(state);
+    diagnostics.sweeps++;
+}
+
+void ParallelGibbs::write_checkpoint(CheckpointWriter &out) const {
+    Sampler::write_checkpoint(out);
+    out.begin("ParallelGibbs");
+    out.write(static_cast<int32_t>(num_workers()));
+    out.write(order);
+    out.write(static_cast<int32_t>(color_classes.size()));
+    for (const std::vector<int> &points : color_classes)
+        out.write(points);
+    out.write(diagnostics);
+
+    for (const std::unique_ptr<Worker> &worker : workers) {
+        worker->write_checkpoint(out);
+        worker->get_data().set_allocations(data.get_allocations());
+    }
+}
+
+void ParallelGibbs::read_checkpoint(CheckpointReader &in) {
+    Sampler::read_checkpoint(in);
+    in.expect("ParallelGibbs");
+    int32_t T, colors;
+    in.read(T);
+    if (T != num_workers()) {
+        in.fail("written with " + std::to_string(T) + " workers, sampler has " + std::to_string(num_workers()));
+    }
+    in.read(order);
+    in.read(colors);
+    if (static_cast<int>(order.size()) != n || colors != num_colors()) {
+        in.fail("visiting order does not match the sampler");
+    }
+    for (std::vector<int> &points : color_classes)
+        in.read(points);
+    in.read(diagnostics);
+
+    for (const std::unique_ptr<Worker> &worker : workers) {
+        worker->read_checkpoint(in);
+        worker->get_data().set_allocations(data.get_allocations());
+    }
+}
+
+std::size_t ParallelGibbs::memory_bytes() const {
+    std::size_t bytes = Sampler::memory_bytes() + MemoryReport::bytes(workers) + graph.memory_bytes() +
+                        MemoryReport::bytes(order) + MemoryReport::bytes(round_bounds) +
+                        MemoryReport::bytes(color_classes) + MemoryReport::bytes(state) +
+                        MemoryReport::bytes(snapshot) + MemoryReport::bytes(sizes) + MemoryReport::bytes(owner) +
+                        MemoryReport::bytes(moved) + MemoryReport::bytes(checks) + MemoryReport::bytes(exact);
+    for (const auto &worker : workers)
+        bytes += sizeof(Worker) + worker->memory_bytes();
+    for (const std::vector<Check> &worker_checks : checks)
+        for (const Check &check : worker_checks)
+            bytes += MemoryReport::bytes(check.probs);
+    return bytes;
+}
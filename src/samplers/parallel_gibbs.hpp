@@ -0,0 +1,226 @@
+/**
+ * @file parallel_gibbs.hpp
+ * @brief Approximate parallel Gibbs sweep over blocks of points
+ *
+ * @author Filippo Galli
+ * @date 2025
+ */
+
+#pragma once
+
+#include "../utils/Sampler.hpp"
+#include "../utils/SparseAdjacency.hpp"
+#include "replica.hpp"
+#include <memory>
+#include <vector>
+
+/**
+ * @class ParallelGibbs
+ * @brief Neal's Algorithm 3 sweep with blocks of points updated concurrently on stale states
+ *
+ * A sweep visits every point once, in rounds. The points of a round are split into one
+ * contiguous chunk per worker, and the workers update their chunks at the same time, each with
+ * the usual sequential Gibbs kernel on its own replica of the Data / Likelihood / Process stack.
+ * A worker sees its own moves but not the moves made by the others during the round: the state
+ * it conditions on is the snapshot taken at the start of the round, plus its own updates
+ * (approximate distributed Gibbs, as in Newman et al. 2009 for LDA).
+ *
+ * At the barrier closing a round the moves are merged into the global state: points keep the
+ * labels of the clusters of the snapshot, clusters opened by the workers get new global labels
+ * (in worker order, then in update order), clusters left empty are removed, and every replica is
+ * reset to the merged state. During a round the replicas run inside a Data transaction, so that
+ * the snapshot labels stay valid until the merge. The master Data is updated once, at the end
+ * of the sweep.
+ *
+ * Blocks are formed either at random (each sweep shuffles the points and cuts them into
+ * `rounds` rounds) or by graph coloring: with the spatial graph, the points of a round share a
+ * color, no two neighbours are ever updated concurrently, and the spatial module terms are exact.
+ *
+ * The approximation is measured by get_diagnostics(): the moves each update did not see, the
+ * clusters opened concurrently by several workers, the graph edges whose endpoints moved in the
+ * same round on different workers, and (optionally) the total variation distance between the
+ * stale conditional a point was sampled from and its conditional in a sequential sweep that
+ * runs the other workers' moves of the round first (see run_checks()).
+ * The chain is exact with one worker; with more, its error grows with the moves per round.
+ *
+ * Replicas must be built on the same Params as the master stack and, for the NGGP, on the same
+ * U_sampler, so that they read the same process parameters. Every replica costs one Data and
+ * one Likelihood: D and log D are shared through Params, the caches registered on a Datax are
+ * recomputed at every merge (so avoid the O(n^2) DistanceCache and ClusterLayout on replicas).
+ *
+ * @see Neal3
+ */
+class ParallelGibbs : public Sampler {
+public:
+    /** @brief One worker's Data / Likelihood / Process stack (not owned) */
+    using Replica = SamplerReplica;
+
+    /** @brief Blocking options */
+    struct Options {
+        int rounds = 4;        ///< Rounds per sweep (with coloring: per sweep over all colors, at least one per color)
+        bool coloring = false; ///< Form the rounds from a greedy coloring of the graph
+        int check_every = 0;   ///< Check one update every check_every against its exact conditional (0: off)
+    };
+
+    /** @brief Cumulated approximation diagnostics */
+    struct Diagnostics {
+        long sweeps = 0;            ///< Sweeps run
+        long rounds = 0;            ///< Rounds run
+        long updates = 0;           ///< Point updates
+        long moves = 0;             ///< Updates that changed the cluster of the point
+        double unseen_moves = 0.0;  ///< Sum over updates of the moves made meanwhile by the other workers
+        long births = 0;            ///< Clusters opened
+        long concurrent_births = 0; ///< Clusters opened in rounds where several workers opened clusters
+        long edge_conflicts = 0;    ///< Graph edges whose endpoints both moved, on different workers, in one round
+        long checked = 0;           ///< Updates checked against their exact conditional
+        double tv_sum = 0.0;        ///< Sum of the total variation distances of the checked updates
+        double tv_max = 0.0;        ///< Largest total variation distance of the checked updates
+    };
+
+private:
+    /** @brief Gibbs kernel on one replica */
+    class Worker : public Sampler {
+    public:
+        Worker(const Replica &replica, const Params &p, Rng rng)
+            : Sampler(*replica.data, p, *replica.likelihood, *replica.process, rng) {}
+
+        /**
+         * @brief Resamples the cluster of one point (as Neal3)
+         * @param index Index of the point
+         * @param probs If not null, receives the probabilities it was sampled from (K + 1 entries)
+         */
+        void update(int index, std::vector<double> *probs);
+
+        /**
+         * @brief Full conditional of a point on the current state, leaving the state unchanged
+         * @param index Index of the point
+         * @param probs Output probabilities, K + 1 entries (last: new cluster)
+         * @note Must be called inside a transaction (so that removing the point compacts nothing)
+         */
+        void conditional(int index, std::vector<double> &probs);
+
+        Data &get_data() { return data; }
+
+        void step() override {}
+    };
+
+    /** @brief A checked update: the stale conditional of a point, over the worker's labels */
+    struct Check {
+        int position; ///< Position of the point in order
+        std::vector<double> probs;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    Options options;
+    SparseAdjacency graph;        ///< Spatial graph (no points: none)
+    bool has_graph;               ///< Whether a graph was given
+    int n;                        ///< Number of points
+
+    std::vector<int> order;          ///< Points in visiting order for the current sweep
+    std::vector<int> round_bounds;   ///< Round r covers order[round_bounds[r], round_bounds[r + 1])
+    std::vector<std::vector<int>> color_classes; ///< Points of each color (coloring only)
+
+    Eigen::VectorXi state;              ///< Global (merged) allocations
+    Eigen::VectorXi snapshot;           ///< state at the start of the current round
+    std::vector<int> sizes;             ///< Cluster sizes of state
+    std::vector<int> owner;             ///< Worker updating each point in the current round (-1: none)
+    std::vector<char> moved;            ///< Whether each point moved in the current round
+    std::vector<std::vector<Check>> checks; ///< Checked updates of each worker in the current round
+    std::vector<double> exact;          ///< Scratch conditional of the checks
+
+    Diagnostics diagnostics;
+
+    /** @brief Greedy coloring of the graph, in decreasing degree order */
+    void build_colors();
+
+    /** @brief Fills order and round_bounds for a new sweep */
+    void plan_sweep();
+
+    /** @brief Resets every replica to state (in parallel), skipping those already there */
+    void sync_replicas();
+
+    /**
+     * @brief Updates the points of one round on all workers, then merges their moves into state
+     * @param begin First position in order
+     * @param end One past the last position
+     */
+    void run_round(int begin, int end);
+
+    /**
+     * @brief Compares the checked updates of one worker with their exact conditionals
+     *
+     * The exact state of an update is the merged state with the points the worker updated after
+     * it moved back to their snapshot clusters: the state of a sequential sweep running the other
+     * workers' moves of the round first. Checks are visited from the last one, so that each point
+     * is moved back once. Runs on the first replica, inside a transaction rolled back at the end.
+     *
+     * @param t Worker
+     * @param chunk_end One past the last position of the worker's chunk
+     * @param K_snapshot Number of clusters of the snapshot
+     * @param new_labels Global label (before compaction) of each cluster opened by the worker
+     * @param relabel Merged label of each global label before compaction (-1: removed)
+     */
+    void run_checks(int t, int chunk_end, int K_snapshot, const std::vector<int> &new_labels,
+                    const std::vector<int> &relabel);
+
+public:
+    /**
+     * @brief Constructor
+     *
+     * @param d Master Data, updated at the end of every sweep
+     * @param p Parameters shared by the master stack and the replicas
+     * @param l Master likelihood (unused by the sweep, kept for the Sampler interface)
+     * @param pr Master process
+     * @param replicas One stack per worker; workers run on OpenMP threads, one each
+     * @param options Blocking options
+     * @param graph_ Spatial graph for the coloring and the edge diagnostics (empty: none), e.g.
+     * SpatialCache::neighbor_cache
+     * @param rng Random number generator stream; one stream is split off per worker
+     * @throws std::invalid_argument if there are no replicas, a replica has a different number of
+     * points, rounds < 1, check_every < 0, or coloring is requested without a graph of n points
+     */
+    ParallelGibbs(Data &d, Params &p, Likelihood &l, Process &pr, const std::vector<Replica> &replicas,
+                  const Options &options, SparseAdjacency graph_ = SparseAdjacency(), Rng rng = Rng());
+
+    /**
+     * @brief One sweep over all points
+     *
+     * @details The replicas are first reset to the master allocations (which other samplers may
+     * have changed), then the rounds run in turn and the merged state is written back to the
+     * master Data.
+     */
+    void step() override;
+
+    /**
+     * @brief Writes the random streams, the visiting order and the diagnostics
+     *
+     * @details The replicas are reset to the master allocations, so that the chain that wrote the
+     * checkpoint and a chain resumed from it (see read_checkpoint()) continue from the same member
+     * order on every replica.
+     */
+    void write_checkpoint(CheckpointWriter &out) const override;
+
+    /**
+     * @brief Restores the state written by write_checkpoint()
+     * @note The master Data must be restored first (ChainRunner::load_checkpoint() does)
+     */
+    void read_checkpoint(CheckpointReader &in) override;
+
+    /**
+     * @brief Heap bytes of the workers, the graph, the rounds and the checks (the replicas report their own)
+     * @see MemoryReport
+     */
+    std::size_t memory_bytes() const override;
+
+    /** @brief Number of workers */
+    int num_workers() const { return static_cast<int>(workers.size()); }
+
+    /** @brief Number of colors of the graph coloring (0 without coloring) */
+    int num_colors() const { return static_cast<int>(color_classes.size()); }
+
+    /** @brief Diagnostics since construction or the last reset_diagnostics() */
+    const Diagnostics &get_diagnostics() const { return diagnostics; }
+
+    /** @brief Clears the diagnostics */
+    void reset_diagnostics() { diagnostics = Diagnostics(); }
+};
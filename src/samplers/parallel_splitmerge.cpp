@@ -0,0 +1,183 @@
+/**
+ * @file parallel_splitmerge.cpp
+ * @brief Implementation of ParallelSplitMerge
+ *
+ * @author Filippo Galli
+ * @date 2025
+ */
+
+#include "parallel_splitmerge.hpp"
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+#include <string>
+
+ParallelSplitMerge::ParallelSplitMerge(Data &d, Params &p, Likelihood &l, Process &pr,
+                                       const std::vector<SamplerReplica> &replicas, int pairs_per_worker, Rng rng)
+    : Sampler(d, p, l, pr, rng), anchors(std::make_shared<const AnchorTables>(p)),
+      concurrent(l.cluster_local() && !replicas.empty()) {
+    if (pairs_per_worker < 1) {
+        throw std::invalid_argument("ParallelSplitMerge: pairs_per_worker must be positive");
+    }
+
+    serial = std::make_unique<SplitMerge_LSS_SDDS>(d, p, l, pr, false, anchors, gen.split());
+    for (const SamplerReplica &replica : replicas) {
+        if (!replica.data || !replica.likelihood || !replica.process || replica.data->get_n() != d.get_n()) {
+            throw std::invalid_argument("ParallelSplitMerge: every replica needs a data set of n points");
+        }
+        workers.push_back(std::make_unique<SplitMerge_LSS_SDDS>(*replica.data, p, *replica.likelihood,
+                                                                *replica.process, false, anchors, gen.split()));
+        replica_data.push_back(replica.data);
+    }
+
+    pairs_per_batch = std::max<int>(1, static_cast<int>(workers.size())) * pairs_per_worker;
+}
+
+void ParallelSplitMerge::draw_batch() {
+    batch.clear();
+    taken.assign(data.get_K(), 0);
+
+    for (int b = 0; b < pairs_per_batch; ++b) {
+        // Same draws as SplitMerge_LSS_SDDS::step()
+        const bool similarity = gen.uniform_int(2);
+        const int i = gen.uniform_int(data.get_n());
+        const int j = anchors->sample(i, similarity, gen);
+        diagnostics.drawn++;
+
+        const int ci = data.get_cluster_assignment(i);
+        const int cj = data.get_cluster_assignment(j);
+        if (taken[ci] || taken[cj]) {
+            diagnostics.overlapping++;
+            continue;
+        }
+        taken[ci] = taken[cj] = 1;
+
+        Pair pair{similarity, i, j, ci == cj, false, {}};
+        if (concurrent) {
+            for (const int c : {ci, cj}) {
+                const auto members = data.get_cluster_assignments_ref(c);
+                pair.points.insert(pair.points.end(), members.data(), members.data() + members.size());
+                if (ci == cj)
+                    break;
+            }
+        }
+        batch.push_back(std::move(pair));
+    }
+}
+
+void ParallelSplitMerge::run_concurrent() {
+    const int T = num_workers();
+    const int B = static_cast<int>(batch.size());
+    const Eigen::VectorXi &state = data.get_allocations();
+    std::vector<std::exception_ptr> errors(T);
+
+#pragma omp parallel for schedule(static, 1) num_threads(T)
+    for (int t = 0; t < T; ++t) {
+        try {
+            Data &replica = *replica_data[t];
+            if (replica.in_transaction() || replica.get_allocations() != state)
+                replica.set_allocations(state);
+            for (int b = t; b < B; b += T)
+                batch[b].accepted = workers[t]->propose(batch[b].similarity, batch[b].i, batch[b].j);
+        } catch (...) {
+            errors[t] = std::current_exception();
+        }
+    }
+
+    for (const std::exception_ptr &error : errors) {
+        if (error)
+            std::rethrow_exception(error);
+    }
+
+    // Accepted moves in draw order; compaction is deferred to the end of the batch
+    data.begin_transaction();
+    for (int b = 0; b < B; ++b) {
+        if (batch[b].accepted)
+            apply(batch[b], *replica_data[b % T]);
+    }
+    data.commit();
+    diagnostics.concurrent += B;
+}
+
+void ParallelSplitMerge::apply(const Pair &pair, const Data &replica) {
+    const Eigen::VectorXi &local = replica.get_allocations();
+    const int label_i = local(pair.i);
+    const int target_i = data.get_cluster_assignment(pair.i);
+    int target_other = -1; // Opened at the first point of the other group (splits only)
+
+    for (const int q : pair.points) {
+        int target = target_i;
+        if (local(q) != label_i) {
+            if (target_other < 0)
+                target_other = data.get_K();
+            target = target_other;
+        }
+        if (data.get_cluster_assignment(q) != target)
+            data.set_allocation(q, target);
+    }
+}
+
+void ParallelSplitMerge::step() {
+    draw_batch();
+
+    if (concurrent) {
+        run_concurrent();
+    } else {
+        for (Pair &pair : batch)
+            pair.accepted = serial->propose(pair.similarity, pair.i, pair.j);
+    }
+
+    for (const Pair &pair : batch) {
+        if (pair.split) {
+            diagnostics.splits++;
+            diagnostics.accepted_splits += pair.accepted;
+        } else {
+            diagnostics.merges++;
+            diagnostics.accepted_merges += pair.accepted;
+        }
+    }
+    diagnostics.batches++;
+}
+
+void ParallelSplitMerge::write_checkpoint(CheckpointWriter &out) const {
+    Sampler::write_checkpoint(out);
+    out.begin("ParallelSplitMerge");
+    out.write(static_cast<int32_t>(num_workers()));
+    out.write(diagnostics);
+    serial->write_checkpoint(out);
+
+    for (int t = 0; t < num_workers(); ++t) {
+        workers[t]->write_checkpoint(out);
+        replica_data[t]->set_allocations(data.get_allocations());
+    }
+}
+
+void ParallelSplitMerge::read_checkpoint(CheckpointReader &in) {
+    Sampler::read_checkpoint(in);
+    in.expect("ParallelSplitMerge");
+    int32_t T;
+    in.read(T);
+    if (T != num_workers()) {
+        in.fail("written with " + std::to_string(T) + " workers, sampler has " + std::to_string(num_workers()));
+    }
+    in.read(diagnostics);
+    serial->read_checkpoint(in);
+
+    for (int t = 0; t < num_workers(); ++t) {
+        workers[t]->read_checkpoint(in);
+        replica_data[t]->set_allocations(data.get_allocations());
+    }
+}
+
+std::size_t ParallelSplitMerge::memory_bytes() const {
+    std::size_t bytes = Sampler::memory_bytes() + (anchors ? anchors->memory_bytes() : 0) +
+                        MemoryReport::bytes(workers) + MemoryReport::bytes(replica_data) +
+                        MemoryReport::bytes(batch) + MemoryReport::bytes(taken);
+    if (serial)
+        bytes += sizeof(SplitMerge_LSS_SDDS) + serial->buffer_bytes();
+    for (const auto &worker : workers)
+        bytes += sizeof(SplitMerge_LSS_SDDS) + worker->buffer_bytes();
+    for (const Pair &pair : batch)
+        bytes += MemoryReport::bytes(pair.points);
+    return bytes;
+}
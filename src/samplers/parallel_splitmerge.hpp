@@ -0,0 +1,144 @@
+/**
+ * @file parallel_splitmerge.hpp
+ * @brief Batches of split-merge proposals on disjoint cluster pairs, evaluated concurrently
+ *
+ * @author Filippo Galli
+ * @date 2025
+ */
+
+#pragma once
+
+#include "../utils/Sampler.hpp"
+#include "replica.hpp"
+#include "splitmerge_LSS_SDDS.hpp"
+#include <memory>
+#include <vector>
+
+/**
+ * @class ParallelSplitMerge
+ * @brief SplitMerge_LSS_SDDS proposals drawn in batches on disjoint clusters and run on several threads
+ *
+ * A step draws a batch of anchor pairs as SplitMerge_LSS_SDDS::step() does (move mode, first
+ * anchor uniform, second anchor from the anchor tables), none of which depends on the state. A
+ * pair is kept if the clusters of its anchors are not among the clusters of the pairs kept before
+ * it, so the kept pairs involve disjoint sets of points. These sets are left unchanged by the
+ * moves themselves (a split or a merge only regroups the points of its clusters), so running the
+ * kept proposals one after the other in draw order is a valid composition of Metropolis-Hastings
+ * kernels: the batch leaves the posterior invariant, exactly.
+ *
+ * When the likelihood is cluster-local (Likelihood::cluster_local(): Gamma_likelihood,
+ * Null_likelihood) and the process prior ratios only read the sizes of the clusters involved (DP,
+ * NGGP given U, the per-cluster modules of NGGPx), the proposal on a pair does not depend on the
+ * outcome of the others, and the proposals run concurrently: pair b on worker b mod T, each worker
+ * a SplitMerge_LSS_SDDS on its own replica stack, on one OpenMP thread. The accepted moves are
+ * then applied to the master Data in draw order. With a likelihood with repulsion (Natarajan) the
+ * proposals depend on the other clusters, and the batch runs sequentially on the master stack.
+ *
+ * Shuffle moves are not batched (they pick clusters uniformly, which depends on K); alternate with
+ * SplitMerge_LSS_SDDS for them.
+ *
+ * @see SplitMerge_LSS_SDDS, ParallelGibbs
+ */
+class ParallelSplitMerge : public Sampler {
+public:
+    /** @brief Cumulated acceptance diagnostics */
+    struct Diagnostics {
+        long batches = 0;          ///< Steps run
+        long drawn = 0;            ///< Anchor pairs drawn
+        long overlapping = 0;      ///< Pairs dropped because their clusters were taken by an earlier pair
+        long splits = 0;           ///< Split proposals
+        long merges = 0;           ///< Merge proposals
+        long accepted_splits = 0;  ///< Accepted split proposals
+        long accepted_merges = 0;  ///< Accepted merge proposals
+        long concurrent = 0;       ///< Proposals run on the replicas
+    };
+
+private:
+    /** @brief A kept anchor pair of the current batch */
+    struct Pair {
+        bool similarity;         ///< Move mode, see SplitMerge_LSS_SDDS::propose()
+        int i;                   ///< First anchor
+        int j;                   ///< Second anchor
+        bool split;              ///< Whether the anchors shared a cluster
+        bool accepted;           ///< Outcome of the proposal
+        std::vector<int> points; ///< Points of the clusters of the anchors (concurrent mode only)
+    };
+
+    std::shared_ptr<const AnchorTables> anchors;                 ///< Shared by all the proposal samplers
+    std::unique_ptr<SplitMerge_LSS_SDDS> serial;                 ///< Proposals on the master stack
+    std::vector<std::unique_ptr<SplitMerge_LSS_SDDS>> workers;   ///< Proposals on the replicas
+    std::vector<Data *> replica_data;                            ///< Data of each replica
+    bool concurrent;                                             ///< Whether the replicas are used
+    int pairs_per_batch;                                         ///< Anchor pairs drawn per step
+
+    std::vector<Pair> batch;    ///< Kept pairs of the current step
+    std::vector<char> taken;    ///< Whether each cluster belongs to a kept pair
+    Diagnostics diagnostics;
+
+    /** @brief Draws the anchor pairs of a step and keeps those on untaken clusters */
+    void draw_batch();
+
+    /** @brief Runs the kept proposals on the replicas, then applies the accepted ones to the master Data */
+    void run_concurrent();
+
+    /**
+     * @brief Regroups the points of an accepted pair on the master Data as on its replica
+     * @param pair Accepted pair
+     * @param replica Data of the worker that ran it
+     * @note Called inside a transaction on the master Data, so that labels stay valid
+     */
+    void apply(const Pair &pair, const Data &replica);
+
+public:
+    /**
+     * @brief Constructor
+     *
+     * @param d Master Data
+     * @param p Parameters shared by the master stack and the replicas
+     * @param l Master likelihood; the replicas are used only if it is cluster_local()
+     * @param pr Master process
+     * @param replicas One stack per worker (may be empty: every batch then runs on the master stack)
+     * @param pairs_per_worker Anchor pairs drawn per step and per worker (at least one in total)
+     * @param rng Random number generator stream; the anchors are drawn from it, and one stream is
+     * split off per proposal sampler
+     * @throws std::invalid_argument if pairs_per_worker < 1 or a replica has a different number of points
+     *
+     * @details The anchor tables are built once, in O(n^2), and shared by all the proposal samplers.
+     */
+    ParallelSplitMerge(Data &d, Params &p, Likelihood &l, Process &pr, const std::vector<SamplerReplica> &replicas,
+                       int pairs_per_worker = 1, Rng rng = Rng());
+
+    /** @brief One batch of split-merge proposals */
+    void step() override;
+
+    /**
+     * @brief Writes the random streams of the anchors and of every proposal sampler, and the diagnostics
+     *
+     * @details The replicas are reset to the master allocations, as in ParallelGibbs::write_checkpoint().
+     */
+    void write_checkpoint(CheckpointWriter &out) const override;
+
+    /**
+     * @brief Restores the state written by write_checkpoint()
+     * @note The master Data must be restored first (ChainRunner::load_checkpoint() does)
+     */
+    void read_checkpoint(CheckpointReader &in) override;
+
+    /**
+     * @brief Heap bytes of the anchor tables, the proposal samplers and the batch (the replicas report their own)
+     * @see MemoryReport
+     */
+    std::size_t memory_bytes() const override;
+
+    /** @brief Whether the proposals run on the replicas (false: sequentially on the master stack) */
+    bool is_concurrent() const { return concurrent; }
+
+    /** @brief Number of replica workers */
+    int num_workers() const { return static_cast<int>(workers.size()); }
+
+    /** @brief Diagnostics since construction or the last reset_diagnostics() */
+    const Diagnostics &get_diagnostics() const { return diagnostics; }
+
+    /** @brief Clears the diagnostics */
+    void reset_diagnostics() { diagnostics = Diagnostics(); }
+};
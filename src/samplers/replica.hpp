@@ -0,0 +1,28 @@
+/**
+ * @file replica.hpp
+ * @brief Data / Likelihood / Process stack run by one worker of the parallel samplers
+ *
+ * @author Filippo Galli
+ * @date 2025
+ */
+
+#pragma once
+
+#include "../utils/Data.hpp"
+#include "../utils/Likelihood.hpp"
+#include "../utils/Process.hpp"
+
+/**
+ * @brief One worker's Data / Likelihood / Process stack (not owned)
+ *
+ * The stack is a copy of the master one built on the same Params (and, for the NGGP, the same
+ * U_sampler), so that it reads the same distances and process parameters. The parallel samplers
+ * reset its allocations to the master ones before each parallel phase.
+ *
+ * @see ParallelGibbs, ParallelSplitMerge
+ */
+struct SamplerReplica {
+    Data *data;
+    const Likelihood *likelihood;
+    Process *process;
+};
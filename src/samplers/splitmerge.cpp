@@ -12,6 +12,8 @@
  */
 
 #include "splitmerge.hpp"
+#include "../utils/Profiling.hpp"
+#include <stdexcept>
 
 void SplitMerge::choose_indeces() {
   /**
@@ -21,11 +23,9 @@ void SplitMerge::choose_indeces() {
    * operation.
    */
 
-  std::uniform_int_distribution<> dis(0, data.get_n() - 1);
-
-  idx_i = dis(gen);
+  idx_i = gen.uniform_int(data.get_n());
   do {
-    idx_j = dis(gen);
+    idx_j = gen.uniform_int(data.get_n());
   } while (idx_j == idx_i); // Ensure i and j are distinct
 
   // Get the clusters of the chosen indices
@@ -45,8 +45,9 @@ void SplitMerge::choose_indeces() {
 
   launch_state.resize(launch_state_size);
   S.resize(launch_state_size);
-  original_allocations =
-      data.get_allocations(); // Store original allocations in case of rejection
+  // Cluster sizes before the proposal, for the merge prior ratio
+  size_old_ci = size_ci;
+  size_old_cj = size_cj;
 
   // Properly collect all points from clusters ci and cj
   int s_idx = 0;
@@ -73,81 +74,127 @@ void SplitMerge::choose_indeces() {
 #endif
 }
 
-void SplitMerge::restricted_gibbs(int iterations, bool only_probabilities) {
+int SplitMerge::restricted_gibbs_scan(bool final) {
   /**
-   * @brief Perform restricted Gibbs sampling on the points in S to propose new
-   * allocations for iter iterations.
-   * @param iterations Number of Gibbs sampling iterations to perform.
-   * @param only_probabilities If true, only compute the probabilities without
-   * changing allocations (used in merge move).
+   * @brief Perform one restricted Gibbs scan of the points in S.
+   * @param final If true, accumulate the log probability of the scan.
+   * @return Number of points that changed cluster.
    */
 
-  for (int i = 0; i < iterations; ++i) {
-    for (int idx = 0; idx < S.size(); ++idx) {
-      int point_idx = S(idx);
-      int current_cluster = data.get_cluster_assignment(point_idx);
+  int changed = 0;
+  for (int idx = 0; idx < S.size(); ++idx) {
+    int point_idx = S(idx);
+    int current_cluster = data.get_cluster_assignment(point_idx);
+
+    // Remove point from its current cluster
+    data.set_allocation(point_idx, -1); // Temporarily unassign the point
+
+    // Compute probabilities for each cluster (ci and cj)
+    Eigen::Vector2d log_probs;
+
+    log_probs(0) = restricted_gibbs_log_odds(point_idx, ci, cj);
+    log_probs(1) = 0;
+
+    // Normalize to get probabilities
+    double max_log_prob = log_probs.maxCoeff();
+    Eigen::Vector2d probs = (log_probs.array() - max_log_prob).exp();
+    probs /= probs.sum();
 
-      // Remove point from its current cluster
-      data.set_allocation(point_idx, -1); // Temporarily unassign the point
+    // Sample new cluster based on computed probabilities
+    int new_cluster_idx = gen.categorical(probs.data(), 2, 1.0);
+    int new_cluster = (new_cluster_idx == 0) ? ci : cj;
 
-      // Compute probabilities for each cluster (ci and cj)
-      Eigen::Vector2d log_probs;
+    // Assign point to the new cluster
+    data.set_allocation(point_idx, new_cluster);
+    changed += new_cluster != current_cluster;
 
-      log_probs(0) = likelihood.point_loglikelihood_cond(point_idx, ci);
-      log_probs(1) = likelihood.point_loglikelihood_cond(point_idx, cj);
+    // if final scan, accumulate the log probability of the move
+    if (final)
+      log_split_gibbs_prob += log(probs(new_cluster_idx));
+  }
+  return changed;
+}
 
-      log_probs(0) += process.gibbs_prior_existing_cluster(ci, point_idx);
-      log_probs(1) += process.gibbs_prior_existing_cluster(cj, point_idx);
+void SplitMerge::restricted_gibbs_probabilities() {
+  /**
+   * @brief Compute the probability of the current allocations of the points in
+   * S under one restricted Gibbs scan, without changing them (used in merge
+   * move).
+   */
 
-      // Normalize to get probabilities
-      double max_log_prob = log_probs.maxCoeff();
-      Eigen::Vector2d probs = (log_probs.array() - max_log_prob).exp();
-      probs /= probs.sum();
+  for (int idx = 0; idx < S.size(); ++idx) {
+    int point_idx = S(idx);
+    int current_cluster = data.get_cluster_assignment(point_idx);
 
-      if (!only_probabilities) {
-        // Sample new cluster based on computed probabilities
-        std::discrete_distribution<int> dist(probs.data(),
-                                             probs.data() + probs.size());
-        int new_cluster_idx = dist(gen);
-        int new_cluster = (new_cluster_idx == 0) ? ci : cj;
+    // Remove point from its current cluster
+    data.set_allocation(point_idx, -1); // Temporarily unassign the point
 
-        // Assign point to the new cluster
-        data.set_allocation(point_idx, new_cluster);
+    Eigen::Vector2d log_probs;
+    log_probs(0) = restricted_gibbs_log_odds(point_idx, ci, cj);
+    log_probs(1) = 0;
 
-        // if last iteration, accumulate the log probability of the move
-        if (i == iterations - 1)
-          log_split_gibbs_prob += log(probs(new_cluster_idx));
+    double max_log_prob = log_probs.maxCoeff();
+    Eigen::Vector2d probs = (log_probs.array() - max_log_prob).exp();
+    probs /= probs.sum();
 
-      } else {
-        // Just restore the previous allocation
-        data.set_allocation(point_idx, current_cluster);
+    // Just restore the previous allocation
+    data.set_allocation(point_idx, current_cluster);
 
-        // accumulate the log probability of the move usually for the merge move
-        log_merge_gibbs_prob += log(probs((current_cluster == ci) ? 0 : 1));
-      }
+    // accumulate the log probability of the move usually for the merge move
+    log_merge_gibbs_prob += log(probs((current_cluster == ci) ? 0 : 1));
+  }
+}
+
+void SplitMerge::restricted_gibbs_proposal() {
+  /**
+   * @brief Move the launch state with intermediate scans until it settles, then
+   * sample the proposal with a final scan whose probability is recorded.
+   */
+
+  PROFILE_SCOPE(SplitMergeProposal);
+
+  // The stopping rule reads the intermediate scans only: the final scan starts
+  // from a launch state whatever its number of scans, as in a fixed schedule
+  const double settled = launch_scans.tolerance * S.size();
+  for (int scan = 0; scan < launch_scans.max_scans; ++scan) {
+    int changed;
+    {
+      PROFILE_SCOPE(LaunchScan);
+      changed = restricted_gibbs_scan(false);
     }
+    if (scan + 1 >= launch_scans.min_scans && changed <= settled)
+      break;
   }
+
+  restricted_gibbs_scan(true);
 }
 
-double SplitMerge::compute_acceptance_ratio_merge(double likelihood_old_ci,
-                                                  double likelihood_old_cj) {
+void SplitMerge::set_launch_scans(LaunchScans settings) {
+  if (settings.min_scans < 0 || settings.max_scans < settings.min_scans) {
+    throw std::invalid_argument("SplitMerge: launch scans need 0 <= min_scans <= max_scans");
+  }
+  if (!(settings.tolerance >= 0.0 && settings.tolerance <= 1.0)) {
+    throw std::invalid_argument("SplitMerge: the launch scan tolerance must be in [0, 1]");
+  }
+  launch_scans = settings;
+}
+
+double SplitMerge::compute_acceptance_ratio_merge(
+    const Likelihood::PairLoglikelihood &pair) {
   /**
    * @brief Compute the log acceptance ratio for a merge move.
-   * @param likelihood_old_ci The log likelihood of cluster ci before the merge.
-   * @param likelihood_old_cj The log likelihood of cluster cj before the merge.
+   * @param pair Log likelihoods of ci, cj and their union before the merge.
    * @return The log acceptance ratio for the merge move.
    */
 
   // Prior ratio
-  int size_old_ci = (original_allocations.array() == ci).count();
-  int size_old_cj = (original_allocations.array() == cj).count();
   double log_prior_ratio = process.prior_ratio_merge(size_old_ci, size_old_cj);
 
   // Likelihood ratio
   double log_likelihood_ratio = 0;
-  log_likelihood_ratio += likelihood.cluster_loglikelihood(ci);
-  log_likelihood_ratio -= likelihood_old_ci;
-  log_likelihood_ratio -= likelihood_old_cj;
+  log_likelihood_ratio += pair.merged;
+  log_likelihood_ratio -= pair.ci;
+  log_likelihood_ratio -= pair.cj;
 
   // Proposal ratio (already computed in merge_move before calling this
   // function)
@@ -170,25 +217,21 @@ void SplitMerge::merge_move() {
   // Reset log probabilities
   log_merge_gibbs_prob = 0;
 
-  double likelihood_old_ci = likelihood.cluster_loglikelihood(ci);
-  double likelihood_old_cj = likelihood.cluster_loglikelihood(cj);
+  // Both clusters and their union in one evaluation, so the merged state
+  // needs no likelihood pass of its own
+  const Likelihood::PairLoglikelihood pair = likelihood.pair_loglikelihood(ci, cj);
 
   // CRITICAL: Compute the proposal probability BEFORE actually merging
   // This is the probability of generating the current split state from the
   // launch state
-  restricted_gibbs(1, true); // Compute probability of current allocation
+  restricted_gibbs_probabilities(); // Compute probability of current allocation
 
-  data.set_allocation( idx_j, ci); // Temporarily assign j to ci for likelihood computation
-
-  // Propose new allocations by merging clusters ci and cj
-  for (int idx = 0; idx < launch_state.size(); ++idx) {
-    if (launch_state(idx) == cj) {
-      data.set_allocation(S(idx), ci); // Merge cj into ci
-    }
-  }
+  // Propose new allocations by merging clusters ci and cj (j included) in one
+  // batch, so that the caches combine the two clusters at once
+  data.merge_clusters(cj, ci);
 
   // Compute acceptance ratio
-  double acceptance_ratio = compute_acceptance_ratio_merge(likelihood_old_ci, likelihood_old_cj);
+  double acceptance_ratio = compute_acceptance_ratio_merge(pair);
 
   // Rcpp::Rcout << "[DEBUG - Merge] acceptance_ratio: " << acceptance_ratio
   //             << std::endl;
@@ -196,9 +239,11 @@ void SplitMerge::merge_move() {
   // Accept or reject the move
   std::uniform_real_distribution<> dis(0.0, 1.0);
   if (log(dis(gen)) > acceptance_ratio) // move not accepted
-    data.set_allocations(original_allocations);
-  else
+    process.restore_state();
+  else {
+    process.commit_state();
     accepted_merge++;
+  }
 }
 
 void SplitMerge::split_move() {
@@ -208,9 +253,6 @@ void SplitMerge::split_move() {
    * the move.
    */
 
-  double likelihood_old_cluster = likelihood.cluster_loglikelihood(
-      ci); // likelihood of the merged cluster old configuration
-
   log_split_gibbs_prob = 0; // reset the log probability of the split move
 
   data.set_allocation(idx_j, data.get_K()); // Create a new cluster for point j
@@ -225,11 +267,10 @@ void SplitMerge::split_move() {
   }
 
   // Perform restricted Gibbs sampling to refine the allocations
-  restricted_gibbs(5);
+  restricted_gibbs_proposal();
 
   // Compute acceptance ratio
-  double acceptance_ratio =
-      compute_acceptance_ratio_split(likelihood_old_cluster);
+  double acceptance_ratio = compute_acceptance_ratio_split();
 
   // Rcpp::Rcout << "[DEBUG - Split] acceptance_ratio: " << acceptance_ratio
   //             << std::endl;
@@ -237,17 +278,16 @@ void SplitMerge::split_move() {
   // Accept or reject the move
   std::uniform_real_distribution<> dis2(0.0, 1.0);
   if (log(dis2(gen)) > acceptance_ratio) // move not accepted
-    data.set_allocations(original_allocations);
-  else
+    process.restore_state();
+  else {
+    process.commit_state();
     accepted_split++;
+  }
 }
 
-double
-SplitMerge::compute_acceptance_ratio_split(double likelihood_old_cluster) {
+double SplitMerge::compute_acceptance_ratio_split() {
   /**
    * @brief Compute the log acceptance ratio for a split move.
-   * @param likelihood_old_cluster The log likelihood of the original cluster
-   * before the split.
    * @return The log acceptance ratio for the split move.
    */
 
@@ -256,9 +296,11 @@ SplitMerge::compute_acceptance_ratio_split(double likelihood_old_cluster) {
 
   // Likelihood ratio
   double log_likelihood_ratio = 0;
-  log_likelihood_ratio += likelihood.cluster_loglikelihood(ci);
-  log_likelihood_ratio += likelihood.cluster_loglikelihood(cj);
-  log_likelihood_ratio -= likelihood_old_cluster;
+  // The union of ci and cj is the original cluster
+  const Likelihood::PairLoglikelihood pair = likelihood.pair_loglikelihood(ci, cj);
+  log_likelihood_ratio += pair.ci;
+  log_likelihood_ratio += pair.cj;
+  log_likelihood_ratio -= pair.merged;
 
   // Rcpp::Rcout << "\t[DEBUG - Split] log_prior_ratio: " << log_prior_ratio
   //             << ", log_likelihood_ratio: " << log_likelihood_ratio
@@ -280,6 +322,7 @@ void SplitMerge::shuffle() {
   log_merge_gibbs_prob = 0;
 
   if (data.get_K() < 2) {
+    process.commit_state(); // Nothing moved: close the transaction
     return; // No point in shuffling if there's only one cluster
   }
 
@@ -290,7 +333,7 @@ void SplitMerge::shuffle() {
   int old_cj_size = data.get_cluster_size(cj);
 
   // Use restricted gibbs to refine the allocations
-  restricted_gibbs(5);
+  restricted_gibbs_proposal();
 
   // Compute acceptance ratio
   double log_acceptance_ratio = compute_acceptance_ratio_shuffle(likelihood_old_ci, likelihood_old_cj, old_ci_size, old_cj_size);
@@ -298,9 +341,11 @@ void SplitMerge::shuffle() {
   // Accept or reject the move
   std::uniform_real_distribution<> acceptance_ratio_dis(0.0, 1.0);
   if (log(acceptance_ratio_dis(gen)) > log_acceptance_ratio) // move not accepted
-    data.set_allocations(original_allocations);
-  else
+    process.restore_state();
+  else {
+    process.commit_state();
     accepted_shuffle++;
+  }
 }
 
 double SplitMerge::compute_acceptance_ratio_shuffle(double likelihood_old_ci,
@@ -324,7 +369,7 @@ double SplitMerge::compute_acceptance_ratio_shuffle(double likelihood_old_ci,
 
   // Proposal ratio
   log_acceptance_ratio -= log_split_gibbs_prob;
-  restricted_gibbs(1, true); // only compute probabilities
+  restricted_gibbs_probabilities(); // only compute probabilities
   log_acceptance_ratio += log_merge_gibbs_prob;
 
   return log_acceptance_ratio;
@@ -356,9 +401,6 @@ void SplitMerge::choose_clusters_shuffle() {
   std::uniform_int_distribution<> dis_idx_j(0, data.get_cluster_size(cj) - 1);
   idx_j = data.get_cluster_assignments(cj)[dis_idx_j(gen)];
 
-  // Store original allocations in case of rejection
-  original_allocations = data.get_allocations();
-
   // Pre-allocate launch_state and S
   const int size_ci = data.get_cluster_size(ci);
   const int size_cj = data.get_cluster_size(cj);
@@ -389,9 +431,7 @@ void SplitMerge::step() {
    */
 
   choose_indeces();
-  process.set_old_allocations(data.get_allocations()); // Update old allocations in the process
-  process.set_idx_i(idx_i);
-  process.set_idx_j(idx_j);
+  process.save_state(idx_i, idx_j); // Open the proposal transaction
 
   if (ci == cj) {
     split_move();
@@ -401,10 +441,23 @@ void SplitMerge::step() {
 
   if (shuffle_bool) {
     choose_clusters_shuffle();
-    process.set_old_allocations(
-        data.get_allocations()); // Update old allocations in the process
-    process.set_idx_i(idx_i);
-    process.set_idx_j(idx_j);
+    process.save_state(idx_i, idx_j); // Open the proposal transaction
     shuffle();
   }
-}
\ No newline at end of file
+}
+
+void SplitMerge::write_checkpoint(CheckpointWriter &out) const {
+  Sampler::write_checkpoint(out);
+  out.begin("SplitMerge");
+  out.write(accepted_split);
+  out.write(accepted_merge);
+  out.write(accepted_shuffle);
+}
+
+void SplitMerge::read_checkpoint(CheckpointReader &in) {
+  Sampler::read_checkpoint(in);
+  in.expect("SplitMerge");
+  in.read(accepted_split);
+  in.read(accepted_merge);
+  in.read(accepted_shuffle);
+}
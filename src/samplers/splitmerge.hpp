@@ -42,12 +42,17 @@
  * @see Sampler, SplitMerge_SAMS
  */
 class SplitMerge : public Sampler {
-private:
-  // ========== Random Number Generation ==========
-
-  /** @brief Mersenne Twister random number generator for sampling operations */
-  mutable std::mt19937 gen;
+public:
+  /**
+   * @brief Intermediate restricted Gibbs scans of the launch state, see set_launch_scans()
+   */
+  struct LaunchScans {
+    int min_scans = 1;       ///< Scans always run
+    int max_scans = 10;      ///< Scans at most
+    double tolerance = 0.02; ///< Fraction of changed points at which the launch state is settled
+  };
 
+private:
   // ========== Move Selection Variables ==========
 
   /** @brief Index of first randomly chosen observation */
@@ -75,8 +80,14 @@ private:
   /** @brief Indices of observations in clusters ci and cj */
   Eigen::VectorXi S;
 
-  /** @brief Original cluster assignments before move proposal */
-  Eigen::VectorXi original_allocations;
+  /** @brief Size of cluster ci before the move proposal */
+  int size_old_ci = 0;
+
+  /** @brief Size of cluster cj before the move proposal */
+  int size_old_cj = 0;
+
+  /** @brief Intermediate scans of the split and shuffle proposals */
+  LaunchScans launch_scans;
 
   // ========== Proposal Probabilities ==========
 
@@ -114,17 +125,30 @@ private:
   // ========== Proposal Generation ==========
 
   /**
-   * @brief Generate proposal state via restricted Gibbs sampling
+   * @brief One restricted Gibbs scan of the points in S between ci and cj
    *
-   * @param iterations Number of restricted Gibbs iterations to perform
-   * @param only_probabilities If true, only compute proposal probabilities
-   * without updating state
+   * @param final If true, accumulate the log probability of the sampled allocations in
+   * log_split_gibbs_prob (the scan whose probability enters the acceptance ratio)
+   * @return Number of points of S whose cluster changed
+   */
+  int restricted_gibbs_scan(bool final);
+
+  /**
+   * @brief Log probability of the current allocation of S under one restricted Gibbs scan,
+   * accumulated in log_merge_gibbs_prob; the allocations are left unchanged
+   */
+  void restricted_gibbs_probabilities();
+
+  /**
+   * @brief Generate proposal state via restricted Gibbs sampling
    *
-   * @details Performs restricted Gibbs sampling on observations in the selected
-   * clusters to generate a proposal state. Also computes the probability of
-   * generating this state for use in the acceptance ratio.
+   * @details Intermediate scans move the launch state until the fraction of S that changed in
+   * the last one is at most launch_scans.tolerance (between min_scans and max_scans of them),
+   * then one final scan samples the proposal and records its probability. The number of
+   * intermediate scans depends on the launch state only, never on the final scan, so the
+   * acceptance ratio of the final scan stays exact (Jain and Neal, 2004).
    */
-  void restricted_gibbs(int iterations, bool only_probabilities = false);
+  void restricted_gibbs_proposal();
 
   // ========== Split Move Implementation ==========
 
@@ -140,13 +164,12 @@ private:
   /**
    * @brief Compute acceptance ratio for split move
    *
-   * @param likelihood_old_cluster Likelihood of the original single cluster
    * @return Log acceptance ratio for the split proposal
    *
    * @details Computes the Metropolis-Hastings acceptance probability by
    * combining prior ratios, likelihood ratios, and proposal probabilities.
    */
-  double compute_acceptance_ratio_split(double likelihood_old_cluster);
+  double compute_acceptance_ratio_split();
 
   // ========== Merge Move Implementation ==========
 
@@ -161,12 +184,11 @@ private:
   /**
    * @brief Compute acceptance ratio for merge move
    *
-   * @param likelihood_old_ci Likelihood of first original cluster
-   * @param likelihood_old_cj Likelihood of second original cluster
+   * @param pair Likelihoods of the two original clusters and of their union
    * @return Log acceptance ratio for the merge proposal
    */
-  double compute_acceptance_ratio_merge(double likelihood_old_ci,
-                                        double likelihood_old_cj);
+  double
+  compute_acceptance_ratio_merge(const Likelihood::PairLoglikelihood &pair);
 
   // ========== Shuffle Move Implementation ==========
 
@@ -202,13 +224,14 @@ public:
    * @param l Reference to Likelihood object for probability computations
    * @param pr Reference to Process object defining the prior
    * @param shuffle Flag to enable shuffle moves in addition to split-merge
+   * @param rng Random number generator stream (default: non-deterministically seeded)
    *
    * @details Initializes the split-merge sampler with the option to include
    * shuffle moves. When shuffle is enabled, the algorithm can propose
    * redistributions between existing clusters in addition to split-merge moves.
    */
-  SplitMerge(Data &d, Params &p, Likelihood &l, Process &pr, bool shuffle)
-      : Sampler(d, p, l, pr), shuffle_bool(shuffle), gen(rd()) {};
+  SplitMerge(Data &d, Params &p, Likelihood &l, Process &pr, bool shuffle, Rng rng = Rng())
+      : Sampler(d, p, l, pr, rng), shuffle_bool(shuffle) {};
 
   // ========== MCMC Interface ==========
 
@@ -226,6 +249,37 @@ public:
    */
   void step() override;
 
+  /** @brief Writes the random stream and the move counters (see Sampler::write_checkpoint()) */
+  void write_checkpoint(CheckpointWriter &out) const override;
+
+  /** @brief Restores the state written by write_checkpoint() */
+  void read_checkpoint(CheckpointReader &in) override;
+
+  /**
+   * @brief Heap bytes of the launch state and the moved set, plus the Sampler buffers
+   * @see MemoryReport
+   */
+  std::size_t memory_bytes() const override {
+    return Sampler::memory_bytes() + MemoryReport::bytes(launch_state) + MemoryReport::bytes(S);
+  }
+
+  /**
+   * @brief Sets the number of intermediate scans of the split and shuffle proposals
+   * @param settings Bounds and tolerance
+   * @throws std::invalid_argument if min_scans is negative, max_scans < min_scans or tolerance
+   * is not in [0, 1]
+   *
+   * The launch state is scanned min_scans times, then until at most a fraction tolerance of its
+   * points changed cluster in the last scan or max_scans scans were run: a launch state settled
+   * after one or two scans stops early, a large one still moving gets up to max_scans. The
+   * default (1, 10, 0.02) replaces the fixed four intermediate scans; min_scans = max_scans = 4
+   * restores them. The realized scans are counted by the launch_scan profiling counter.
+   */
+  void set_launch_scans(LaunchScans settings);
+
+  /** @brief Intermediate scans of the split and shuffle proposals */
+  const LaunchScans &get_launch_scans() const { return launch_scans; }
+
   // ========== Accessor Methods ==========
   /**
    * @brief Get number of accepted split moves for diagnostics
@@ -50,11 +50,6 @@
  */
 class SplitMerge_LSS : public Sampler {
 private:
-  // ========== Random Number Generation ==========
-
-  /** @brief Mersenne Twister random number generator for sampling operations */
-  mutable std::mt19937 gen;
-
   // ========== Move Selection Variables ==========
 
   /** @brief Index of first randomly chosen observation */
@@ -82,8 +77,11 @@ private:
   /** @brief Indices of observations in clusters ci and cj */
   Eigen::VectorXi S;
 
-  /** @brief Original cluster assignments before move proposal */
-  Eigen::VectorXi original_allocations;
+  /** @brief Size of cluster ci before the move proposal */
+  int size_old_ci = 0;
+
+  /** @brief Size of cluster cj before the move proposal */
+  int size_old_cj = 0;
 
   // ========== Proposal Probabilities ==========
 
@@ -152,10 +150,9 @@ private:
   /**
    * @brief Compute acceptance ratio for LSS split move
    *
-   * @param likelihood_old_cluster Likelihood of the original single cluster
    * @return Log acceptance ratio for the split proposal
    */
-  double compute_acceptance_ratio_split(double likelihood_old_cluster);
+  double compute_acceptance_ratio_split();
 
   // ========== Merge Move Implementation ==========
 
@@ -170,12 +167,11 @@ private:
   /**
    * @brief Compute acceptance ratio for LSS merge move
    *
-   * @param likelihood_old_ci Likelihood of first original cluster
-   * @param likelihood_old_cj Likelihood of second original cluster
+   * @param pair Likelihoods of the two original clusters and of their union
    * @return Log acceptance ratio for the merge proposal
    */
-  double compute_acceptance_ratio_merge(double likelihood_old_ci,
-                                        double likelihood_old_cj);
+  double
+  compute_acceptance_ratio_merge(const Likelihood::PairLoglikelihood &pair);
 
   // ========== Shuffle Move Implementation ==========
 
@@ -212,14 +208,15 @@ public:
    * @param l Reference to Likelihood object for probability computations
    * @param pr Reference to Process object defining the prior
    * @param shuffle Flag to enable shuffle moves in addition to split-merge
+   * @param rng Random number generator stream (default: non-deterministically seeded)
    *
    * @details Initializes the LSS Split-Merge sampler, which uses locality
    * sensitive sampling for anchor point selection and sequential allocation for
    * generating proposals. This can provide computational advantages for large
    * datasets.
    */
-  SplitMerge_LSS(Data &d, Params &p, Likelihood &l, Process &pr, bool shuffle)
-      : Sampler(d, p, l, pr), shuffle_bool(shuffle), gen(rd()) {};
+  SplitMerge_LSS(Data &d, Params &p, Likelihood &l, Process &pr, bool shuffle, Rng rng = Rng())
+      : Sampler(d, p, l, pr, rng), shuffle_bool(shuffle) {};
 
   // ========== MCMC Interface ==========
 
@@ -239,6 +236,20 @@ public:
    */
   void step() override;
 
+  /** @brief Writes the random stream and the move counters (see Sampler::write_checkpoint()) */
+  void write_checkpoint(CheckpointWriter &out) const override;
+
+  /** @brief Restores the state written by write_checkpoint() */
+  void read_checkpoint(CheckpointReader &in) override;
+
+  /**
+   * @brief Heap bytes of the launch state and the moved set, plus the Sampler buffers
+   * @see MemoryReport
+   */
+  std::size_t memory_bytes() const override {
+    return Sampler::memory_bytes() + MemoryReport::bytes(launch_state) + MemoryReport::bytes(S);
+  }
+
   // ========== Accessor Methods ==========
   /**
    * @brief Get number of accepted split moves for diagnostics
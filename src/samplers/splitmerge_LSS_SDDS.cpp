@@ -17,39 +17,11 @@
  */
 
 #include "splitmerge_LSS_SDDS.hpp"
-#include <random>
-
-void SplitMerge_LSS_SDDS::choose_indeces(bool similarity) {
-
-    // Select first index idx_i uniformly at random
-    std::uniform_int_distribution<> dis(0, data.get_n() - 1);
-    idx_i = dis(gen);
-
-    const auto distances = params.D.row(idx_i);
-    const double log_max_distance = log(distances.maxCoeff());
-    double prob_sum = 0.0;
-    std::vector<double> probs(data.get_n());
-
-    // Compute probabilities for selecting idx_j based on distances from idx_i
-    // If similarity is true, prefer closer points; otherwise, prefer distant points
-    for (auto idx = 0; idx < data.get_n(); ++idx) {
-        if (idx == idx_i)
-            probs[idx] = 0.0;
-        else
-            probs[idx] = similarity ? log_max_distance - log(distances(idx)) : log(distances(idx));
-        prob_sum += probs[idx];
-    }
-
-    // // Normalize probabilities
-    // for (auto &p : probs) {
-    //     p /= distance_sum;
-    // }
+#include "../utils/Profiling.hpp"
+#include <algorithm>
+#include <stdexcept>
 
-    // Select second index idx_j based on computed probabilities
-    std::discrete_distribution<> dis1(probs.begin(), probs.end());
-    do {
-        idx_j = dis1(gen);
-    } while (idx_j == idx_i); // Ensure i and j are distinct
+void SplitMerge_LSS_SDDS::collect_launch_state() {
 
     // Get the clusters of the chosen indices
     ci = data.get_cluster_assignment(idx_i);
@@ -59,6 +31,10 @@ void SplitMerge_LSS_SDDS::choose_indeces(bool similarity) {
     int size_ci = data.get_cluster_size(ci);
     int size_cj = data.get_cluster_size(cj);
 
+    // Cluster sizes before the proposal, for the merge prior ratio
+    size_old_ci = size_ci;
+    size_old_cj = size_cj;
+
     // Initialize launch_state with current allocations of points in clusters ci
     // and cj while S with their indices
     launch_state_size = ci == cj ? size_ci - 2 : size_ci + size_cj - 2; // Exclude points i and j from the launch state
@@ -66,25 +42,26 @@ void SplitMerge_LSS_SDDS::choose_indeces(bool similarity) {
     launch_state.resize(launch_state_size);
     S.resize(launch_state_size);
 
-    // Properly collect all points from clusters ci and cj
+    // Collect the points of clusters ci and cj from their member lists
     int s_idx = 0;
-    for (int idx = 0; idx < data.get_n(); ++idx) {
-        if (idx == idx_i || idx == idx_j)
-            continue; // Skip points i and j
-
-        int temp_cluster = data.get_cluster_assignment(idx);
-        if (temp_cluster == ci || temp_cluster == cj) {
+    for (int c : {ci, cj}) {
+        const auto members = data.get_cluster_assignments_ref(c);
+        for (int m = 0; m < members.size(); ++m) {
+            const int idx = members(m);
+            if (idx == idx_i || idx == idx_j)
+                continue; // Skip points i and j
             S(s_idx) = idx;
-            launch_state(s_idx) = temp_cluster;
+            launch_state(s_idx) = c;
             s_idx++;
         }
+        if (ci == cj)
+            break;
     }
 
     // Shuffle launch_state and S in unison using Fisher-Yates algorithm
     // This maintains alignment between the two vectors while shuffling in-place
     for (int i = launch_state_size - 1; i > 0; --i) {
-        std::uniform_int_distribution<> dis_shuffle(0, i);
-        int j = dis_shuffle(gen);
+        int j = gen.uniform_int(i + 1);
         if (i != j) {
             std::swap(launch_state(i), launch_state(j));
             std::swap(S(i), S(j));
@@ -122,11 +99,8 @@ void SplitMerge_LSS_SDDS::sequential_allocation(int iterations, bool only_probab
             }
 
             // Compute probabilities for each cluster (ci and cj)
-            log_probs(0) = likelihood.point_loglikelihood_cond(point_idx, ci);
-            log_probs(1) = likelihood.point_loglikelihood_cond(point_idx, cj);
-
-            log_probs(0) += process.gibbs_prior_existing_cluster(ci, point_idx);
-            log_probs(1) += process.gibbs_prior_existing_cluster(cj, point_idx);
+            log_probs(0) = restricted_gibbs_log_odds(point_idx, ci, cj);
+            log_probs(1) = 0;
 
             // Normalize log probabilities using log-sum-exp trick
             double max_log_prob = log_probs.maxCoeff();
@@ -137,8 +111,7 @@ void SplitMerge_LSS_SDDS::sequential_allocation(int iterations, bool only_probab
                 probs = (log_probs.array() - max_log_prob).exp();
 
                 // Sample new cluster based on computed probabilities
-                std::discrete_distribution<int> dist(probs.data(), probs.data() + probs.size());
-                int new_cluster_idx = dist(gen);
+                int new_cluster_idx = gen.categorical(probs.data(), 2);
                 int new_cluster = (new_cluster_idx == 0) ? ci : cj;
 
                 // Assign point to the new cluster
@@ -159,17 +132,14 @@ void SplitMerge_LSS_SDDS::sequential_allocation(int iterations, bool only_probab
     }
 }
 
-double SplitMerge_LSS_SDDS::compute_acceptance_ratio_merge(double likelihood_old_ci, double likelihood_old_cj) {
+double SplitMerge_LSS_SDDS::compute_acceptance_ratio_merge(const Likelihood::PairLoglikelihood &pair) {
 
     // Prior ratio
-    int size_old_ci = (original_allocations.array() == ci).count();
-    int size_old_cj = (original_allocations.array() == cj).count();
     double log_acceptance_ratio = process.prior_ratio_merge(size_old_ci, size_old_cj);
 
     // Likelihood ratio
-    log_acceptance_ratio += likelihood.cluster_loglikelihood(ci);
-    log_acceptance_ratio -= likelihood_old_ci;
-    log_acceptance_ratio -= likelihood_old_cj;
+    log_likelihood_ratio = pair.merged - pair.ci - pair.cj;
+    log_acceptance_ratio += log_likelihood_ratio;
 
     // Proposal ratio of the reverse move (smart or dumb split)
     log_acceptance_ratio += log_merge_gibbs_prob;
@@ -177,64 +147,58 @@ double SplitMerge_LSS_SDDS::compute_acceptance_ratio_merge(double likelihood_old
     return log_acceptance_ratio;
 }
 
-void SplitMerge_LSS_SDDS::smart_merge_move() {
-
-    // Reverse dumb split proposal probability
-    log_merge_gibbs_prob = S.size() * rand_split_prob;
-
-    // Get old likelihoods
-    double likelihood_old_ci = likelihood.cluster_loglikelihood(ci);
-    double likelihood_old_cj = likelihood.cluster_loglikelihood(cj);
-
-    // Assign both anchor points to ci
-    data.set_allocation(idx_j, ci);
-
-    // Initially assign all points from both clusters to ci
-    for (const auto &idx : S) {
-        data.set_allocation(idx, ci);
-    }
-
-    // Compute acceptance ratio
-    double acceptance_ratio = compute_acceptance_ratio_merge(likelihood_old_ci, likelihood_old_cj);
-
-    // Accept or reject the move
-    if (log(dis_real(gen)) > acceptance_ratio) // move not accepted
+bool SplitMerge_LSS_SDDS::accept_or_restore(double log_acceptance_ratio) {
+    if (log(gen.uniform_pos()) > log_acceptance_ratio) { // move not accepted
         process.restore_state();
-    else
-        accepted_merge++;
+        return false;
+    }
+    process.commit_state();
+    if (tracks_log_likelihood())
+        track_log_likelihood(log_likelihood_ratio);
+    return true;
 }
 
-void SplitMerge_LSS_SDDS::dumb_merge_move() {
+double SplitMerge_LSS_SDDS::merge_proposal(bool smart) {
 
-    // Reverse smart split proposal probability
-    sequential_allocation(1, true);
+    if (smart) {
+        // Reverse dumb split proposal probability
+        log_merge_gibbs_prob = S.size() * rand_split_prob;
+    } else {
+        // Reverse smart split proposal probability
+        sequential_allocation(1, true);
+    }
 
-    // Get old likelihoods
-    double likelihood_old_ci = likelihood.cluster_loglikelihood(ci);
-    double likelihood_old_cj = likelihood.cluster_loglikelihood(cj);
+    // Both clusters and their union in one evaluation, so the merged state
+    // needs no likelihood pass of its own
+    const Likelihood::PairLoglikelihood pair = likelihood.pair_loglikelihood(ci, cj);
+
+    if (smart) {
+        // Assign both anchor points to ci
+        data.set_allocation(idx_j, ci);
 
-    // Direct merge: assign all points to ci
-    data.set_allocation(idx_j, ci);
-    for (int idx = 0; idx < launch_state_size; ++idx) {
-        if (launch_state(idx) == cj) {
-            data.set_allocation(S(idx), ci); // Merge cj into ci
+        // Initially assign all points from both clusters to ci
+        for (const auto &idx : S) {
+            data.set_allocation(idx, ci);
         }
+    } else {
+        // Direct merge: all points of cj (j included) to ci, in one batch
+        data.merge_clusters(cj, ci);
     }
 
-    // Compute acceptance ratio
-    double acceptance_ratio = compute_acceptance_ratio_merge(likelihood_old_ci, likelihood_old_cj);
+    return compute_acceptance_ratio_merge(pair);
+}
 
-    // Accept or reject the move
-    if (log(dis_real(gen)) > acceptance_ratio) // move not accepted
-        process.restore_state();
-    else
+void SplitMerge_LSS_SDDS::smart_merge_move() {
+    if (accept_or_restore(merge_proposal(true)))
         accepted_merge++;
 }
 
-void SplitMerge_LSS_SDDS::smart_split_move() {
+void SplitMerge_LSS_SDDS::dumb_merge_move() {
+    if (accept_or_restore(merge_proposal(false)))
+        accepted_merge++;
+}
 
-    // old cluster likelihood
-    double likelihood_old_cluster = likelihood.cluster_loglikelihood(ci);
+double SplitMerge_LSS_SDDS::split_proposal(bool smart) {
 
     // Create new cluster for point j
     data.set_allocation(idx_j, data.get_K()); // Create a new cluster for point j
@@ -242,60 +206,42 @@ void SplitMerge_LSS_SDDS::smart_split_move() {
 
     // Allocate randomly points in S to either ci or cj
     for (const auto &idx : S) {
-        int new_cluster = (dis_int(gen) == 0) ? ci : cj;
+        int new_cluster = (gen.uniform_int(2) == 0) ? ci : cj;
         data.set_allocation(idx, new_cluster);
     }
 
-    // Perform sequential allocation to refine the allocations
-    sequential_allocation(1);
+    if (smart) {
+        // Perform sequential allocation to refine the allocations
+        PROFILE_SCOPE(SplitMergeProposal);
+        sequential_allocation(1);
+    } else {
+        // Random split proposal probability
+        log_split_gibbs_prob = S.size() * rand_split_prob; // Probability of the dumb split move
+    }
 
-    // Compute acceptance ratio
-    double acceptance_ratio = compute_acceptance_ratio_split(likelihood_old_cluster);
+    return compute_acceptance_ratio_split();
+}
 
-    // Accept or reject the move
-    if (log(dis_real(gen)) > acceptance_ratio) // move not accepted
-        process.restore_state();
-    else
+void SplitMerge_LSS_SDDS::smart_split_move() {
+    if (accept_or_restore(split_proposal(true)))
         accepted_split++;
 }
 
 void SplitMerge_LSS_SDDS::dumb_split_move() {
-
-    // old cluster likelihood
-    double likelihood_old_cluster = likelihood.cluster_loglikelihood(ci);
-
-    // Create new cluster for point j
-    data.set_allocation(idx_j, data.get_K()); // Create a new cluster for point j
-    cj = data.get_cluster_assignment(idx_j);  // Update cj to the new cluster index
-
-    // Randomly allocate points in S to either ci or cj
-    for (const auto &idx : S) {
-        int new_cluster = (dis_int(gen) == 0) ? ci : cj;
-        data.set_allocation(idx, new_cluster);
-    }
-
-    // Random split proposal probability
-    log_split_gibbs_prob = S.size() * rand_split_prob; // Probability of the dumb split move
-
-    // Compute acceptance ratio
-    double acceptance_ratio = compute_acceptance_ratio_split(likelihood_old_cluster);
-
-    // Accept or reject the move
-    if (log(dis_real(gen)) > acceptance_ratio) // move not accepted
-        process.restore_state();
-    else
+    if (accept_or_restore(split_proposal(false)))
         accepted_split++;
 }
 
-double SplitMerge_LSS_SDDS::compute_acceptance_ratio_split(double likelihood_old_cluster) {
+double SplitMerge_LSS_SDDS::compute_acceptance_ratio_split() {
 
     // Prior ratio
     double log_acceptance_ratio = process.prior_ratio_split(ci, cj);
 
     // Likelihood ratio
-    log_acceptance_ratio += likelihood.cluster_loglikelihood(ci);
-    log_acceptance_ratio += likelihood.cluster_loglikelihood(cj);
-    log_acceptance_ratio -= likelihood_old_cluster;
+    // The union of ci and cj is the original cluster
+    const Likelihood::PairLoglikelihood pair = likelihood.pair_loglikelihood(ci, cj);
+    log_likelihood_ratio = pair.ci + pair.cj - pair.merged;
+    log_acceptance_ratio += log_likelihood_ratio;
 
     // Proposal ratio (dumb or smart split as forwad move)
     log_acceptance_ratio -= log_split_gibbs_prob;
@@ -305,8 +251,10 @@ double SplitMerge_LSS_SDDS::compute_acceptance_ratio_split(double likelihood_old
 
 void SplitMerge_LSS_SDDS::shuffle() {
 
-    if (data.get_K() < 2)
-        return; // No point in shuffling if there's only one cluster
+    if (data.get_K() < 2) {
+        process.commit_state(); // Nothing moved: close the transaction
+        return;                 // No point in shuffling if there's only one cluster
+    }
 
     // Get number of points in clusters ci and cj and likelihoods
     double likelihood_old_ci = likelihood.cluster_loglikelihood(ci);
@@ -317,17 +265,18 @@ void SplitMerge_LSS_SDDS::shuffle() {
     // Compute probabilities
     sequential_allocation(1, true, true);
 
-    // Use restricted gibbs to refine the allocations
-    sequential_allocation(1, false, true);
+    // Use restricted gibbs to refine the allocations (one sequential pass, no launch scans)
+    {
+        PROFILE_SCOPE(SplitMergeProposal);
+        sequential_allocation(1, false, true);
+    }
 
     // Compute acceptance ratio
     double log_acceptance_ratio =
         compute_acceptance_ratio_shuffle(likelihood_old_ci, likelihood_old_cj, old_ci_size, old_cj_size);
 
     // Accept or reject the move
-    if (log(dis_real(gen)) > log_acceptance_ratio) // move not accepted
-        process.restore_state();
-    else
+    if (accept_or_restore(log_acceptance_ratio))
         accepted_shuffle++;
 }
 
@@ -338,10 +287,9 @@ double SplitMerge_LSS_SDDS::compute_acceptance_ratio_shuffle(double likelihood_o
     double log_acceptance_ratio = process.prior_ratio_shuffle(old_ci_size, old_cj_size, ci, cj);
 
     // Likelihood ratio
-    log_acceptance_ratio += likelihood.cluster_loglikelihood(ci);
-    log_acceptance_ratio += likelihood.cluster_loglikelihood(cj);
-    log_acceptance_ratio -= likelihood_old_ci;
-    log_acceptance_ratio -= likelihood_old_cj;
+    log_likelihood_ratio = likelihood.cluster_loglikelihood(ci) + likelihood.cluster_loglikelihood(cj) -
+                           likelihood_old_ci - likelihood_old_cj;
+    log_acceptance_ratio += log_likelihood_ratio;
 
     // Proposal ratio
     log_acceptance_ratio -= log_split_gibbs_prob;
@@ -358,18 +306,14 @@ void SplitMerge_LSS_SDDS::choose_clusters_shuffle() {
     }
 
     // Choose two distinct clusters ci and cj uniformly at random
-    std::uniform_int_distribution<> dis(0, data.get_K() - 1);
-    ci = dis(gen);
+    ci = gen.uniform_int(data.get_K());
     do {
-        cj = dis(gen);
+        cj = gen.uniform_int(data.get_K());
     } while (cj == ci); // Ensure ci and cj are distinct
 
     // Choose random points from clusters ci and cj
-    std::uniform_int_distribution<> dis_idx_i(0, data.get_cluster_size(ci) - 1);
-    idx_i = data.get_cluster_assignments(ci)[dis_idx_i(gen)];
-
-    std::uniform_int_distribution<> dis_idx_j(0, data.get_cluster_size(cj) - 1);
-    idx_j = data.get_cluster_assignments(cj)[dis_idx_j(gen)];
+    idx_i = data.get_cluster_assignments_ref(ci)(gen.uniform_int(data.get_cluster_size(ci)));
+    idx_j = data.get_cluster_assignments_ref(cj)(gen.uniform_int(data.get_cluster_size(cj)));
 
     // Pre-allocate launch_state and S
     const int size_ci = data.get_cluster_size(ci);
@@ -378,38 +322,36 @@ void SplitMerge_LSS_SDDS::choose_clusters_shuffle() {
     launch_state.resize(launch_state_size);
     S.resize(launch_state_size);
 
-    // Create S and launch_state
+    // Create S and launch_state from the member lists of ci and cj
     int s_idx = 0;
-    for (int idx = 0; idx < data.get_n(); ++idx) {
-        if (idx == idx_i || idx == idx_j)
-            continue; // Skip points i and j
-
-        int temp_cluster = data.get_cluster_assignment(idx);
-        if (temp_cluster == ci || temp_cluster == cj) {
+    for (int c : {ci, cj}) {
+        const auto members = data.get_cluster_assignments_ref(c);
+        for (int m = 0; m < members.size(); ++m) {
+            const int idx = members(m);
+            if (idx == idx_i || idx == idx_j)
+                continue; // Skip points i and j
             S(s_idx) = idx;
-            launch_state(s_idx) = temp_cluster;
+            launch_state(s_idx) = c;
             s_idx++;
         }
     }
 }
 
-void SplitMerge_LSS_SDDS::step() {
+bool SplitMerge_LSS_SDDS::propose(bool similarity, int i, int j) {
 
-    std::discrete_distribution<> dist({0.5, 0.5});
-    const int similarity_dist = dist(gen);                   // 0 for dissimilarity (split), 1 for similarity (merge)
-    process.set_old_cluster_members(data.get_cluster_map()); // Update old cluster members in the process
-    process.set_old_allocations(data.get_allocations());     // Update old allocations in the process
-    process.set_old_K(data.get_K());                         // Cache number of clusters for rollback
-    choose_indeces(similarity_dist);
-    process.set_idx_i(idx_i);
-    process.set_idx_j(idx_j);
+    idx_i = i;
+    idx_j = j;
+    process.save_state(idx_i, idx_j); // Open the proposal transaction
+    collect_launch_state();
 
     // Reset log proposal probabilities
     log_split_gibbs_prob = 0;
     log_merge_gibbs_prob = 0;
 
+    const int accepted_before = accepted_split + accepted_merge;
+
     // Determine which move to perform based on strategy
-    if (similarity_dist) {
+    if (similarity) {
         // smart merge - dumb split
         if (ci != cj) {
             merge_moves++;
@@ -433,14 +375,82 @@ void SplitMerge_LSS_SDDS::step() {
     log_split_gibbs_prob = 0;
     log_merge_gibbs_prob = 0;
 
+    return accepted_split + accepted_merge > accepted_before;
+}
+
+double SplitMerge_LSS_SDDS::draw_split(bool similarity, int i, int j) {
+
+    idx_i = i;
+    idx_j = j;
+    process.save_state(idx_i, idx_j); // Open the proposal transaction
+    collect_launch_state();
+    if (ci != cj) {
+        process.restore_state();
+        throw std::invalid_argument("SplitMerge_LSS_SDDS: draw_split() needs two anchors of one cluster");
+    }
+
+    log_split_gibbs_prob = 0;
+    log_merge_gibbs_prob = 0;
+    const double log_acceptance_ratio = split_proposal(!similarity);
+    log_split_gibbs_prob = 0;
+    return log_acceptance_ratio;
+}
+
+double SplitMerge_LSS_SDDS::merge_log_ratio(bool similarity, int i, int j) {
+
+    idx_i = i;
+    idx_j = j;
+    process.save_state(idx_i, idx_j); // Open the proposal transaction
+    collect_launch_state();
+    if (ci == cj) {
+        process.restore_state();
+        throw std::invalid_argument("SplitMerge_LSS_SDDS: merge_log_ratio() needs anchors of two clusters");
+    }
+
+    log_split_gibbs_prob = 0;
+    log_merge_gibbs_prob = 0;
+    const double log_acceptance_ratio = merge_proposal(similarity);
+    process.restore_state();
+    log_merge_gibbs_prob = 0;
+    return log_acceptance_ratio;
+}
+
+void SplitMerge_LSS_SDDS::step() {
+
+    const int similarity_dist = gen.uniform_int(2);                   // 0 for dissimilarity (split), 1 for similarity (merge)
+
+    // Select first index uniformly at random, the second based on distance weights from it:
+    // if similarity is true, prefer closer points; otherwise, prefer distant points
+    const int i = gen.uniform_int(data.get_n());
+    const int j = anchors->sample(i, similarity_dist, gen);
+    propose(similarity_dist, i, j);
+
     if (shuffle_bool) {
         shuffle_moves++;
-        process.set_old_allocations(data.get_allocations());     // Update old allocations in the process
-        process.set_old_cluster_members(data.get_cluster_map()); // Update old cluster members in the process
-        process.set_old_K(data.get_K());                         // Cache number of clusters for rollback
         choose_clusters_shuffle();
-        process.set_idx_i(idx_i);
-        process.set_idx_j(idx_j);
+        process.save_state(idx_i, idx_j); // Open the proposal transaction
         shuffle();
     }
-}
\ No newline at end of file
+}
+
+void SplitMerge_LSS_SDDS::write_checkpoint(CheckpointWriter &out) const {
+    Sampler::write_checkpoint(out);
+    out.begin("SplitMerge_LSS_SDDS");
+    out.write(accepted_split);
+    out.write(accepted_merge);
+    out.write(accepted_shuffle);
+    out.write(split_moves);
+    out.write(merge_moves);
+    out.write(shuffle_moves);
+}
+
+void SplitMerge_LSS_SDDS::read_checkpoint(CheckpointReader &in) {
+    Sampler::read_checkpoint(in);
+    in.expect("SplitMerge_LSS_SDDS");
+    in.read(accepted_split);
+    in.read(accepted_merge);
+    in.read(accepted_shuffle);
+    in.read(split_moves);
+    in.read(merge_moves);
+    in.read(shuffle_moves);
+}
@@ -20,6 +20,8 @@
 #pragma once
 
 #include "../utils/Sampler.hpp"
+#include "anchor_tables.hpp"
+#include <memory>
 
 /**
  * @brief Locality Sensitive Sampling (LSS) with SDDS Split-Merge sampler
@@ -63,11 +65,6 @@
  */
 class SplitMerge_LSS_SDDS : public Sampler {
 private:
-    // ========== Random Number Generation ==========
-
-    /** @brief Mersenne Twister random number generator for sampling operations */
-    mutable std::mt19937 gen;
-
     // ========== Move Selection Variables ==========
 
     /** @brief Index of first randomly chosen observation */
@@ -87,6 +84,9 @@ private:
     /** @brief Flag to enable shuffle moves (Mena and Martinez, 2014) */
     bool shuffle_bool = false;
 
+    /** @brief Precomputed tables for drawing the second anchor (shareable between samplers on the same D) */
+    std::shared_ptr<const AnchorTables> anchors;
+
     // ========== State Management ==========
 
     /** @brief Launch state for sequential allocation */
@@ -98,17 +98,13 @@ private:
     /** @brief Size of the launch state and S vectors */
     int launch_state_size;
 
-    /** @brief Cached reference to original allocations stored in the process */
-    const Eigen::VectorXi &original_allocations;
+    /** @brief Size of cluster ci before the move proposal */
+    int size_old_ci = 0;
 
-    // ========== Proposal Probabilities ==========
-
-    /** @brief uniform distribution between 0 and 1
-     */
-    std::uniform_real_distribution<> dis_real;
+    /** @brief Size of cluster cj before the move proposal */
+    int size_old_cj = 0;
 
-    /** @brief uniform integer distribution for general use */
-    std::uniform_int_distribution<> dis_int;
+    // ========== Proposal Probabilities ==========
 
     /**
      * @brief Log probabilities of allocating a point to clusters ci and cj
@@ -131,6 +127,9 @@ private:
      */
     const double rand_split_prob = log(0.5);
 
+    /** @brief Log-likelihood ratio of the last proposal, reported to the running log-likelihood on acceptance */
+    double log_likelihood_ratio = 0;
+
     // ========== Debug variables ==========
     int accepted_split = 0;
     int accepted_merge = 0;
@@ -142,18 +141,17 @@ private:
     // ========== Move Selection Methods ==========
 
     /**
-     * @brief Randomly select two observations for split-merge proposal
-     *
-     * @details Samples two distinct observation indices using locality sensitive
-     * sampling. When similarity=false, selects dissimilar points (for split
-     * moves). When similarity=true, selects similar points (for merge moves). The
-     * first point is selected uniformly, and the second is selected based on
-     * distance weights from the first point.
+     * @brief Collects the launch state of the anchors idx_i and idx_j
      *
-     * @param similarity If true, select similar points; if false, select
-     * dissimilar points
+     * @details The anchors are drawn by step() with locality sensitive sampling:
+     * the first uniformly, the second based on distance weights from the first
+     * through the precomputed AnchorTables (dissimilar points for smart splits,
+     * similar points for smart merges). Sets ci, cj and their sizes, and fills S
+     * and launch_state with the other points of ci and cj, shuffled. The launch
+     * state is collected from the member lists of ci and cj, so the setup costs
+     * O(n_ci + n_cj).
      */
-    void choose_indeces(bool similarity = false);
+    void collect_launch_state();
 
     /**
      * @brief Select clusters for shuffle move
@@ -184,8 +182,22 @@ private:
      */
     void sequential_allocation(int iterations, bool only_probabilities = false, bool sequential = true);
 
+    /**
+     * @brief Accepts or rejects the open proposal
+     * @param log_acceptance_ratio Log Metropolis-Hastings ratio of the proposal
+     * @return true if the proposal was accepted (and committed), false if it was restored
+     */
+    bool accept_or_restore(double log_acceptance_ratio);
+
     // ========== Split Move Implementation ==========
 
+    /**
+     * @brief Splits the cluster of the anchors, leaving the decision to the caller
+     * @param smart Sequential allocation of the launch state (smart split) or a uniform one (dumb split)
+     * @return Log acceptance ratio of the split (compute_acceptance_ratio_split())
+     */
+    double split_proposal(bool smart);
+
     /**
      * @brief Execute a smart split move using sequential allocation
      *
@@ -213,21 +225,27 @@ private:
     /**
      * @brief Compute acceptance ratio for LSS split move
      *
-     * @param likelihood_old_cluster Log-likelihood of the original single cluster
-     * before split
      * @return Log acceptance ratio for the split proposal
      *
      * @details Computes log acceptance ratio as:
      * log(α) = log(prior_ratio) + log(likelihood_ratio) - log(proposal_ratio)
      * where:
      * - prior_ratio accounts for cluster size changes
-     * - likelihood_ratio = L(ci_new) + L(cj_new) - L(ci_old)
+     * - likelihood_ratio = L(ci_new) + L(cj_new) - L(ci_old), the three terms from one
+     *   Likelihood::pair_loglikelihood() of the split state
      * - proposal_ratio is log_split_gibbs_prob (0 for dumb split)
      */
-    double compute_acceptance_ratio_split(double likelihood_old_cluster);
+    double compute_acceptance_ratio_split();
 
     // ========== Merge Move Implementation ==========
 
+    /**
+     * @brief Merges the clusters of the anchors, leaving the decision to the caller
+     * @param smart Reverse probability of a dumb split (smart merge) or of a smart split (dumb merge)
+     * @return Log acceptance ratio of the merge (compute_acceptance_ratio_merge())
+     */
+    double merge_proposal(bool smart);
+
     /**
      * @brief Execute a smart merge move using sequential allocation
      *
@@ -253,10 +271,7 @@ private:
     /**
      * @brief Compute acceptance ratio for LSS merge move
      *
-     * @param likelihood_old_ci Log-likelihood of first original cluster ci before
-     * merge
-     * @param likelihood_old_cj Log-likelihood of second original cluster cj
-     * before merge
+     * @param pair Log-likelihoods of ci, cj and of their union, evaluated before the merge
      * @return Log acceptance ratio for the merge proposal
      *
      * @details Computes log acceptance ratio as:
@@ -266,7 +281,7 @@ private:
      * - likelihood_ratio = L(ci_merged) - L(ci_old) - L(cj_old)
      * - proposal_ratio is log_merge_gibbs_prob (0 for dumb merge)
      */
-    double compute_acceptance_ratio_merge(double likelihood_old_ci, double likelihood_old_cj);
+    double compute_acceptance_ratio_merge(const Likelihood::PairLoglikelihood &pair);
 
     // ========== Shuffle Move Implementation ==========
 
@@ -313,6 +328,7 @@ public:
      * @param l Reference to Likelihood object for probability computations
      * @param pr Reference to Process object defining the prior
      * @param shuffle Flag to enable shuffle moves in addition to split-merge
+     * @param rng Random number generator stream (default: non-deterministically seeded)
      *
      * @details Initializes the LSS-SDDS Split-Merge sampler, which uses:
      * - Locality sensitive sampling for anchor point selection
@@ -322,10 +338,20 @@ public:
      * - Simple random allocation for "dumb" proposals
      * This sampler provides computational advantages for large datasets by
      * intelligently balancing computational cost with proposal quality.
+     * The anchor sampling tables are built here, in O(n^2) once.
      */
-    SplitMerge_LSS_SDDS(Data &d, Params &p, Likelihood &l, Process &pr, bool shuffle)
-        : Sampler(d, p, l, pr), shuffle_bool(shuffle), original_allocations(pr.old_allocations_view()), gen(rd()),
-          dis_real(0.0, 1.0), dis_int(0, 1) {};
+    SplitMerge_LSS_SDDS(Data &d, Params &p, Likelihood &l, Process &pr, bool shuffle, Rng rng = Rng())
+        : Sampler(d, p, l, pr, rng), shuffle_bool(shuffle), anchors(std::make_shared<const AnchorTables>(p)) {};
+
+    /**
+     * @brief Constructor reusing anchor tables built on the same distances
+     *
+     * @param anchor_tables Tables shared with other samplers (e.g. the workers of
+     * ParallelSplitMerge), so that each sampler costs no O(n^2) construction
+     */
+    SplitMerge_LSS_SDDS(Data &d, const Params &p, const Likelihood &l, Process &pr, bool shuffle,
+                        std::shared_ptr<const AnchorTables> anchor_tables, Rng rng = Rng())
+        : Sampler(d, p, l, pr, rng), shuffle_bool(shuffle), anchors(std::move(anchor_tables)) {};
 
     // ========== MCMC Interface ==========
 
@@ -357,6 +383,77 @@ public:
      */
     void step() override final;
 
+    /**
+     * @brief Accepted proposals report their likelihood ratio (see Sampler::track_log_likelihood()),
+     * if the likelihood is cluster-local: the ratio then is the change of the sum of the cluster terms
+     */
+    bool tracks_log_likelihood() const override { return likelihood.cluster_local(); }
+
+    /** @brief Writes the random stream and the move counters (see Sampler::write_checkpoint()) */
+    void write_checkpoint(CheckpointWriter &out) const override;
+
+    /** @brief Restores the state written by write_checkpoint() */
+    void read_checkpoint(CheckpointReader &in) override;
+
+    /**
+     * @brief Heap bytes of the launch state and the moved set, plus the Sampler buffers, without the anchor tables (shared by the samplers built on them)
+     * @see MemoryReport
+     */
+    std::size_t buffer_bytes() const {
+        return Sampler::memory_bytes() + MemoryReport::bytes(launch_state) + MemoryReport::bytes(S);
+    }
+
+    /**
+     * @brief Heap bytes of the buffers and of the anchor tables
+     * @see MemoryReport
+     */
+    std::size_t memory_bytes() const override { return buffer_bytes() + (anchors ? anchors->memory_bytes() : 0); }
+
+    /**
+     * @brief Split or merge proposal on given anchors (steps 3, 4 and 6 of step())
+     *
+     * @param similarity Move mode: true for dumb split / smart merge, false for
+     * smart split / dumb merge
+     * @param i First anchor
+     * @param j Second anchor, j != i
+     * @return true if the proposal was accepted
+     *
+     * @details The anchors must be drawn as in step(): i uniformly and j from
+     * get_anchor_tables() with the same mode. Only the points of the clusters of i
+     * and j are read and moved.
+     */
+    bool propose(bool similarity, int i, int j);
+
+    /**
+     * @brief Draws a split proposal on two anchors of one cluster, without deciding on it
+     *
+     * @param similarity Move mode, as in propose(): true for a dumb split, false for a smart split
+     * @param i First anchor
+     * @param j Second anchor, in the cluster of i
+     * @return Log acceptance ratio of the split, as computed by propose()
+     * @throws std::invalid_argument if i and j are in different clusters
+     *
+     * @details The split is left open in the proposal transaction: the caller reads the proposed
+     * allocations and ends it with Process::restore_state() or Process::commit_state(). The move
+     * counters are not updated. Used for the candidates of MultipleTrySplitMerge.
+     */
+    double draw_split(bool similarity, int i, int j);
+
+    /**
+     * @brief Log acceptance ratio of merging the clusters of two anchors, leaving the data unchanged
+     *
+     * @param similarity Move mode, as in propose(): true for a smart merge, false for a dumb merge
+     * @param i First anchor
+     * @param j Second anchor, in another cluster than i
+     * @return Log acceptance ratio of the merge, as computed by propose() (for a dumb merge, with
+     * the reverse smart split probability of a launch order drawn here)
+     * @throws std::invalid_argument if i and j are in the same cluster
+     */
+    double merge_log_ratio(bool similarity, int i, int j);
+
+    /** @brief Anchor tables, to share with other samplers on the same distances */
+    const std::shared_ptr<const AnchorTables> &get_anchor_tables() const { return anchors; }
+
     // ========== Accessor Methods ==========
     /**
      * @brief Get number of accepted split moves for diagnostics
@@ -12,6 +12,7 @@
  */
 
 #include "splitmerge_SAMS.hpp"
+#include "../utils/Profiling.hpp"
 
 void SplitMerge_SAMS::choose_indeces() {
   /**
@@ -21,11 +22,9 @@ void SplitMerge_SAMS::choose_indeces() {
    * operation.
    */
 
-  std::uniform_int_distribution<> dis(0, data.get_n() - 1);
-
-  idx_i = dis(gen);
+  idx_i = gen.uniform_int(data.get_n());
   do {
-    idx_j = dis(gen);
+    idx_j = gen.uniform_int(data.get_n());
   } while (idx_j == idx_i); // Ensure i and j are distinct
 
   // Get the clusters of the chosen indices
@@ -45,8 +44,9 @@ void SplitMerge_SAMS::choose_indeces() {
 
   launch_state.resize(launch_state_size);
   S.resize(launch_state_size);
-  original_allocations =
-      data.get_allocations(); // Store original allocations in case of rejection
+  // Cluster sizes before the proposal, for the merge prior ratio
+  size_old_ci = size_ci;
+  size_old_cj = size_cj;
 
   // Properly collect all points from clusters ci and cj
   int s_idx = 0;
@@ -63,21 +63,24 @@ void SplitMerge_SAMS::choose_indeces() {
   }
 
   // Shuffle the launch_state and S in unison to ensure randomness
-  std::vector<int> indices(launch_state_size);
+  // (permutation and shuffled copies in the workspace)
+  Workspace::Frame frame(workspace);
+  int *indices = workspace.take<int>(launch_state_size);
   for (size_t i = 0; i < launch_state_size; ++i) {
     indices[i] = i;
   }
-  std::shuffle(indices.begin(), indices.end(), gen);
+  std::shuffle(indices, indices + launch_state_size, gen);
 
-  Eigen::VectorXi shuffled_launch_state(launch_state_size);
-  Eigen::VectorXi shuffled_S(launch_state_size);
+  Eigen::Map<Eigen::VectorXi> shuffled_launch_state =
+      workspace.int_vector(launch_state_size);
+  Eigen::Map<Eigen::VectorXi> shuffled_S = workspace.int_vector(launch_state_size);
   for (size_t i = 0; i < launch_state_size; ++i)
   {
     shuffled_launch_state(i) = launch_state(indices[i]);
     shuffled_S(i) = S(indices[i]);
   }
   launch_state = shuffled_launch_state;
-  S = shuffled_S;  
+  S = shuffled_S;
 
   // Ensure we collected the expected number of points
   #if VERBOSITY_LEVEL >= 1
@@ -120,11 +123,8 @@ void SplitMerge_SAMS::sequential_allocation(int iterations, bool only_probabilit
       // Compute probabilities for each cluster (ci and cj)
       Eigen::Vector2d log_probs;
 
-      log_probs(0) = likelihood.point_loglikelihood_cond(point_idx, ci);
-      log_probs(1) = likelihood.point_loglikelihood_cond(point_idx, cj);
-
-      log_probs(0) += process.gibbs_prior_existing_cluster(ci, point_idx);
-      log_probs(1) += process.gibbs_prior_existing_cluster(cj, point_idx);
+      log_probs(0) = restricted_gibbs_log_odds(point_idx, ci, cj);
+      log_probs(1) = 0;
 
       // Normalize to get probabilities
       double max_log_prob = log_probs.maxCoeff();
@@ -133,9 +133,7 @@ void SplitMerge_SAMS::sequential_allocation(int iterations, bool only_probabilit
 
       if (!only_probabilities) {
         // Sample new cluster based on computed probabilities
-        std::discrete_distribution<int> dist(probs.data(),
-                                             probs.data() + probs.size());
-        int new_cluster_idx = dist(gen);
+        int new_cluster_idx = gen.categorical(probs.data(), 2, 1.0);
         int new_cluster = (new_cluster_idx == 0) ? ci : cj;
 
         // Assign point to the new cluster
@@ -156,24 +154,20 @@ void SplitMerge_SAMS::sequential_allocation(int iterations, bool only_probabilit
 }
 
 double
-SplitMerge_SAMS::compute_acceptance_ratio_merge(double likelihood_old_ci,
-                                                double likelihood_old_cj) {
+SplitMerge_SAMS::compute_acceptance_ratio_merge(const Likelihood::PairLoglikelihood &pair) {
   /**
    * @brief Compute the log acceptance ratio for a merge move.
-   * @param likelihood_old_ci The log likelihood of cluster ci before the merge.
-   * @param likelihood_old_cj The log likelihood of cluster cj before the merge.
+   * @param pair Log likelihoods of ci, cj and their union before the merge.
    * @return The log acceptance ratio for the merge move.
    */
 
   // Prior ratio
-  int size_old_ci = (original_allocations.array() == ci).count();
-  int size_old_cj = (original_allocations.array() == cj).count();
   double log_acceptance_ratio = process.prior_ratio_merge(size_old_ci, size_old_cj);
 
   // Likelihood ratio
-  log_acceptance_ratio += likelihood.cluster_loglikelihood(ci);
-  log_acceptance_ratio -= likelihood_old_ci;
-  log_acceptance_ratio -= likelihood_old_cj;
+  log_acceptance_ratio += pair.merged;
+  log_acceptance_ratio -= pair.ci;
+  log_acceptance_ratio -= pair.cj;
 
   // Proposal ratio
   log_acceptance_ratio += log_merge_gibbs_prob;
@@ -191,29 +185,27 @@ void SplitMerge_SAMS::merge_move() {
   // Reset log probabilities
   log_merge_gibbs_prob = 0;
 
-  double likelihood_old_ci = likelihood.cluster_loglikelihood(ci);
-  double likelihood_old_cj = likelihood.cluster_loglikelihood(cj);
+  // Both clusters and their union in one evaluation, so the merged state
+  // needs no likelihood pass of its own
+  const Likelihood::PairLoglikelihood pair = likelihood.pair_loglikelihood(ci, cj);
 
   sequential_allocation(1, true); // only compute probabilities
 
-  data.set_allocation(idx_j, ci); // Temporarily assign j to ci for likelihood computation
-
-  // Propose new allocations by merging clusters ci and cj
-  for (int idx = 0; idx < launch_state.size(); ++idx) {
-    if (launch_state(idx) == cj) {
-      data.set_allocation(S(idx), ci); // Merge cj into ci
-    }
-  }
+  // Propose new allocations by merging clusters ci and cj (j included) in one
+  // batch, so that the caches combine the two clusters at once
+  data.merge_clusters(cj, ci);
 
   // Compute acceptance ratio
-  double acceptance_ratio = compute_acceptance_ratio_merge(likelihood_old_ci, likelihood_old_cj);
+  double acceptance_ratio = compute_acceptance_ratio_merge(pair);
 
   // Accept or reject the move
   std::uniform_real_distribution<> dis(0.0, 1.0);
   if (log(dis(gen)) > acceptance_ratio) // move not accepted
-    data.set_allocations(original_allocations);
-  else
+    process.restore_state();
+  else {
+    process.commit_state();
     accepted_merge++;
+  }
 }
 
 void SplitMerge_SAMS::split_move() {
@@ -223,9 +215,6 @@ void SplitMerge_SAMS::split_move() {
    * the move.
    */
 
-  double likelihood_old_cluster = likelihood.cluster_loglikelihood(
-      ci); // likelihood of the merged cluster old configuration
-
   log_split_gibbs_prob = 0; // reset the log probability of the split move
 
   data.set_allocation(idx_j, data.get_K()); // Create a new cluster for point j
@@ -239,26 +228,30 @@ void SplitMerge_SAMS::split_move() {
     data.set_allocation(S(idx), new_cluster);
   }
 
-  // Perform restricted Gibbs sampling to refine the allocations
-  sequential_allocation(1);
+  // Perform restricted Gibbs sampling to refine the allocations (one
+  // sequential pass from the empty state: there are no launch scans)
+  {
+    PROFILE_SCOPE(SplitMergeProposal);
+    sequential_allocation(1);
+  }
 
   // Compute acceptance ratio
-  double acceptance_ratio = compute_acceptance_ratio_split(likelihood_old_cluster);
+  double acceptance_ratio = compute_acceptance_ratio_split();
 
   // Accept or reject the move
   std::uniform_real_distribution<> dis2(0.0, 1.0);
   if (log(dis2(gen)) > acceptance_ratio) // move not accepted
-    data.set_allocations(original_allocations);
-  else
+    process.restore_state();
+  else {
+    process.commit_state();
     accepted_split++;
+  }
 }
 
 double
-SplitMerge_SAMS::compute_acceptance_ratio_split(double likelihood_old_cluster) {
+SplitMerge_SAMS::compute_acceptance_ratio_split() {
   /**
    * @brief Compute the log acceptance ratio for a split move.
-   * @param likelihood_old_cluster The log likelihood of the original cluster
-   * before the split.
    * @return The log acceptance ratio for the split move.
    */
 
@@ -266,9 +259,11 @@ SplitMerge_SAMS::compute_acceptance_ratio_split(double likelihood_old_cluster) {
   double log_acceptance_ratio = process.prior_ratio_split(ci, cj);
 
   // Likelihood ratio
-  log_acceptance_ratio += likelihood.cluster_loglikelihood(ci);
-  log_acceptance_ratio += likelihood.cluster_loglikelihood(cj);
-  log_acceptance_ratio -= likelihood_old_cluster;
+  // The union of ci and cj is the original cluster
+  const Likelihood::PairLoglikelihood pair = likelihood.pair_loglikelihood(ci, cj);
+  log_acceptance_ratio += pair.ci;
+  log_acceptance_ratio += pair.cj;
+  log_acceptance_ratio -= pair.merged;
 
   // Proposal ratio
   log_acceptance_ratio -= log_split_gibbs_prob;
@@ -287,8 +282,10 @@ void SplitMerge_SAMS::shuffle() {
                             // it to store the proposal prob
   log_merge_gibbs_prob = 0;
 
-  if (data.get_K() < 2)
+  if (data.get_K() < 2) {
+    process.commit_state(); // Nothing moved: close the transaction
     return; // No point in shuffling if there's only one cluster
+  }
 
   // Get number of points in clusters ci and cj and likelihoods
   double likelihood_old_ci = likelihood.cluster_loglikelihood(ci);
@@ -300,7 +297,10 @@ void SplitMerge_SAMS::shuffle() {
   sequential_allocation(1, true, true); // only compute probabilities
 
   // Use restricted gibbs to refine the allocations
-  sequential_allocation(1, false, true);
+  {
+    PROFILE_SCOPE(SplitMergeProposal);
+    sequential_allocation(1, false, true);
+  }
 
   // Compute acceptance ratio
   double log_acceptance_ratio = compute_acceptance_ratio_shuffle(likelihood_old_ci, likelihood_old_cj, old_ci_size, old_cj_size);
@@ -308,9 +308,11 @@ void SplitMerge_SAMS::shuffle() {
   // Accept or reject the move
   std::uniform_real_distribution<> acceptance_ratio_dis(0.0, 1.0);
   if (log(acceptance_ratio_dis(gen)) > log_acceptance_ratio) // move not accepted
-    data.set_allocations(original_allocations);
-  else
+    process.restore_state();
+  else {
+    process.commit_state();
     accepted_shuffle++;
+  }
 }
 
 double SplitMerge_SAMS::compute_acceptance_ratio_shuffle(
@@ -363,9 +365,6 @@ void SplitMerge_SAMS::choose_clusters_shuffle() {
   std::uniform_int_distribution<> dis_idx_j(0, data.get_cluster_size(cj) - 1);
   idx_j = data.get_cluster_assignments(cj)[dis_idx_j(gen)];
 
-  // Store original allocations in case of rejection
-  original_allocations = data.get_allocations();
-
   // Pre-allocate launch_state and S
   const int size_ci = data.get_cluster_size(ci);
   const int size_cj = data.get_cluster_size(cj);
@@ -397,10 +396,7 @@ void SplitMerge_SAMS::step() {
    */
 
   choose_indeces();
-  process.set_old_allocations(
-      data.get_allocations()); // Update old allocations in the process
-  process.set_idx_i(idx_i);
-  process.set_idx_j(idx_j);
+  process.save_state(idx_i, idx_j); // Open the proposal transaction
 
   if (ci == cj) {
     split_move();
@@ -410,10 +406,23 @@ void SplitMerge_SAMS::step() {
 
   if (shuffle_bool) {
     choose_clusters_shuffle();
-    process.set_old_allocations(
-        data.get_allocations()); // Update old allocations in the process
-    process.set_idx_i(idx_i);
-    process.set_idx_j(idx_j);
+    process.save_state(idx_i, idx_j); // Open the proposal transaction
     shuffle();
   }
-}
\ No newline at end of file
+}
+
+void SplitMerge_SAMS::write_checkpoint(CheckpointWriter &out) const {
+  Sampler::write_checkpoint(out);
+  out.begin("SplitMerge_SAMS");
+  out.write(accepted_split);
+  out.write(accepted_merge);
+  out.write(accepted_shuffle);
+}
+
+void SplitMerge_SAMS::read_checkpoint(CheckpointReader &in) {
+  Sampler::read_checkpoint(in);
+  in.expect("SplitMerge_SAMS");
+  in.read(accepted_split);
+  in.read(accepted_merge);
+  in.read(accepted_shuffle);
+}
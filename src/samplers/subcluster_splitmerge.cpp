@@ -0,0 +1,259 @@
+/**
+ * @file subcluster_splitmerge.cpp
+ * @brief Implementation of SubClusterSplitMerge
+ *
+ * @author Filippo Galli
+ * @date 2025
+ */
+
+#include "subcluster_splitmerge.hpp"
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <numeric>
+#include <stdexcept>
+
+SubClusterSplitMerge::SubClusterSplitMerge(Data &d, Params &p, Likelihood &l, Process &pr, int n_threads,
+                                           int sub_sweeps, int proposals, Rng rng)
+    : Sampler(d, p, l, pr, rng), n_threads(n_threads), sub_sweeps(sub_sweeps), proposals(proposals),
+      half_a(0.5 * p.a) {
+    if (n_threads < 1 || sub_sweeps < 1 || proposals < 1) {
+        throw std::invalid_argument("SubClusterSplitMerge: n_threads, sub_sweeps and proposals must be positive");
+    }
+    if (!l.cluster_local()) {
+        throw std::invalid_argument("SubClusterSplitMerge: the likelihood must be cluster-local");
+    }
+    side.resize(d.get_n());
+    for (uint8_t &s : side)
+        s = static_cast<uint8_t>(gen.uniform_int(2));
+    position.resize(d.get_n());
+    order.resize(d.get_n());
+}
+
+// ========== Sub-clusters ==========
+
+void SubClusterSplitMerge::collect_subclusters() {
+    const int K = data.get_K();
+    for (auto &lists : members) {
+        lists.resize(K);
+        for (auto &list : lists)
+            list.clear();
+    }
+
+    for (int k = 0; k < K; ++k) {
+        const auto cluster = data.get_cluster_assignments_ref(k);
+        for (int m = 0; m < cluster.size(); ++m) {
+            const int i = cluster(m);
+            std::vector<int> &list = members[side[i]][k];
+            position[i] = static_cast<int>(list.size());
+            list.push_back(i);
+        }
+    }
+}
+
+void SubClusterSplitMerge::sweep_cluster(int k, Rng &rng) {
+    // Each cluster owns its range of order, so the clusters swept in parallel write disjoint entries
+    const auto cluster = data.get_cluster_assignments_ref(k);
+    const auto begin = order.begin() + offset[k];
+    const auto end = std::copy(cluster.data(), cluster.data() + cluster.size(), begin);
+    std::shuffle(begin, end, rng);
+
+    for (auto it = begin; it != end; ++it) {
+        const int i = *it;
+        // Remove the point from its sub-cluster (swap with the last member)
+        std::vector<int> &from = members[side[i]][k];
+        const int last = from.back();
+        from[position[i]] = last;
+        position[last] = position[i];
+        from.pop_back();
+
+        double log_w[2];
+        for (int l = 0; l < 2; ++l) {
+            const std::vector<int> &sub = members[l][k];
+            const Eigen::Map<const Eigen::VectorXi> sub_members(sub.data(), static_cast<Eigen::Index>(sub.size()));
+            log_w[l] = std::log(sub.size() + half_a) + likelihood.point_loglikelihood_members(i, sub_members);
+        }
+
+        // p(right) = 1 / (1 + exp(log_w[0] - log_w[1]))
+        const int l = rng.uniform() * (1.0 + std::exp(log_w[0] - log_w[1])) < 1.0;
+        std::vector<int> &to = members[l][k];
+        side[i] = static_cast<uint8_t>(l);
+        position[i] = static_cast<int>(to.size());
+        to.push_back(i);
+    }
+}
+
+void SubClusterSplitMerge::sweep_subclusters() {
+    const int K = data.get_K();
+    cluster_rngs.clear();
+    offset.resize(K + 1);
+    offset[0] = 0;
+    for (int k = 0; k < K; ++k) {
+        cluster_rngs.push_back(gen.split());
+        offset[k + 1] = offset[k] + data.get_cluster_size(k);
+    }
+
+    // The packed storage reads rows through a buffer shared by the likelihood
+    const int threads = params.get_D_packed() ? 1 : n_threads;
+    std::vector<std::exception_ptr> errors(K);
+
+#pragma omp parallel for schedule(dynamic, 1) num_threads(threads) if (threads > 1)
+    for (int k = 0; k < K; ++k) {
+        try {
+            sweep_cluster(k, cluster_rngs[k]);
+        } catch (...) {
+            errors[k] = std::current_exception();
+        }
+    }
+
+    for (const std::exception_ptr &error : errors) {
+        if (error)
+            std::rethrow_exception(error);
+    }
+}
+
+double SubClusterSplitMerge::log_subcluster_prob(int n_l, int n_r) const {
+    return std::lgamma(2 * half_a) - std::lgamma(2 * half_a + n_l + n_r) + std::lgamma(half_a + n_l) +
+           std::lgamma(half_a + n_r) - 2 * std::lgamma(half_a);
+}
+
+// ========== Split and merge moves ==========
+
+void SubClusterSplitMerge::draw_subclusters(const std::vector<int> &points) {
+    // Polya urn of the Dirichlet(a / 2, a / 2)-multinomial
+    int sizes[2] = {0, 0};
+    for (const int i : points) {
+        const int l = gen.uniform() * (sizes[0] + sizes[1] + 2 * half_a) < sizes[1] + half_a;
+        side[i] = static_cast<uint8_t>(l);
+        sizes[l]++;
+    }
+}
+
+bool SubClusterSplitMerge::split_move(int k) {
+    const auto cluster = data.get_cluster_assignments_ref(k);
+    std::vector<int> sub[2];
+    for (int m = 0; m < cluster.size(); ++m)
+        sub[side[cluster(m)]].push_back(cluster(m));
+    if (sub[0].empty() || sub[1].empty())
+        return false; // Not reachable by a merge
+
+    const int K = data.get_K();
+    process.save_state(sub[0].front(), sub[1].front()); // Open the proposal transaction
+
+    const double likelihood_old_cluster = likelihood.cluster_loglikelihood(k);
+
+    // The right sub-cluster becomes a new cluster
+    const int cj = data.get_K();
+    for (const int i : sub[1])
+        data.set_allocation(i, cj);
+
+    double log_acceptance_ratio = process.prior_ratio_split(k, cj);
+    log_acceptance_ratio += likelihood.cluster_loglikelihood(k);
+    log_acceptance_ratio += likelihood.cluster_loglikelihood(cj);
+    log_acceptance_ratio -= likelihood_old_cluster;
+
+    // Sub-cluster weights of the old cluster, and cluster choice: 1 / K forward, one ordered pair
+    // out of (K + 1) K in reverse (the sub-clusters drawn for the new clusters cancel out)
+    log_acceptance_ratio -= log_subcluster_prob(static_cast<int>(sub[0].size()), static_cast<int>(sub[1].size()));
+    log_acceptance_ratio -= std::log(K + 1.0);
+
+    if (log(gen.uniform_pos()) > log_acceptance_ratio) { // move not accepted
+        process.restore_state();
+        return false;
+    }
+    process.commit_state();
+
+    draw_subclusters(sub[0]);
+    draw_subclusters(sub[1]);
+    return true;
+}
+
+bool SubClusterSplitMerge::merge_move(int ci, int cj) {
+    const auto cluster_i = data.get_cluster_assignments_ref(ci);
+    const auto cluster_j = data.get_cluster_assignments_ref(cj);
+    const std::vector<int> members_i(cluster_i.data(), cluster_i.data() + cluster_i.size());
+    const std::vector<int> members_j(cluster_j.data(), cluster_j.data() + cluster_j.size());
+    const int size_i = static_cast<int>(members_i.size());
+    const int size_j = static_cast<int>(members_j.size());
+    const int K = data.get_K();
+
+    process.save_state(members_i.front(), members_j.front()); // Open the proposal transaction
+
+    const double likelihood_old_ci = likelihood.cluster_loglikelihood(ci);
+    const double likelihood_old_cj = likelihood.cluster_loglikelihood(cj);
+
+    data.merge_clusters(cj, ci);
+
+    double log_acceptance_ratio = process.prior_ratio_merge(size_i, size_j);
+    log_acceptance_ratio += likelihood.cluster_loglikelihood(ci);
+    log_acceptance_ratio -= likelihood_old_ci;
+    log_acceptance_ratio -= likelihood_old_cj;
+
+    // Inverse of the split terms: the two clusters become the sub-clusters of the merged one
+    log_acceptance_ratio += log_subcluster_prob(size_i, size_j);
+    log_acceptance_ratio += std::log(static_cast<double>(K));
+
+    if (log(gen.uniform_pos()) > log_acceptance_ratio) { // move not accepted
+        process.restore_state();
+        return false;
+    }
+    process.commit_state();
+
+    for (const int i : members_i)
+        side[i] = 0;
+    for (const int i : members_j)
+        side[i] = 1;
+    return true;
+}
+
+void SubClusterSplitMerge::step() {
+    for (int sweep = 0; sweep < sub_sweeps; ++sweep) {
+        collect_subclusters();
+        sweep_subclusters();
+    }
+
+    for (int m = 0; m < proposals; ++m) {
+        const int K = data.get_K();
+        if (gen.uniform_int(2)) { // Split of a uniform cluster
+            split_moves++;
+            accepted_split += split_move(gen.uniform_int(K));
+        } else if (K > 1) { // Merge of a uniform ordered pair
+            const int ci = gen.uniform_int(K);
+            int cj = gen.uniform_int(K - 1);
+            cj += cj >= ci;
+            merge_moves++;
+            accepted_merge += merge_move(ci, cj);
+        }
+    }
+}
+
+void SubClusterSplitMerge::write_checkpoint(CheckpointWriter &out) const {
+    Sampler::write_checkpoint(out);
+    out.begin("SubClusterSplitMerge");
+    out.write(side);
+    out.write(accepted_split);
+    out.write(accepted_merge);
+    out.write(split_moves);
+    out.write(merge_moves);
+}
+
+void SubClusterSplitMerge::read_checkpoint(CheckpointReader &in) {
+    Sampler::read_checkpoint(in);
+    in.expect("SubClusterSplitMerge");
+    in.read(side);
+    if (static_cast<int>(side.size()) != data.get_n()) {
+        in.fail("sub-cluster labels do not match the data");
+    }
+    for (uint8_t &s : side)
+        s = s != 0;
+    in.read(accepted_split);
+    in.read(accepted_merge);
+    in.read(split_moves);
+    in.read(merge_moves);
+}
+
+std::size_t SubClusterSplitMerge::memory_bytes() const {
+    return Sampler::memory_bytes() + MemoryReport::bytes(side) + MemoryReport::bytes(members[0]) +
+           MemoryReport::bytes(members[1]) + MemoryReport::bytes(position) + MemoryReport::bytes(cluster_rngs) +
+           MemoryReport::bytes(order) + MemoryReport::bytes(offset);
+}
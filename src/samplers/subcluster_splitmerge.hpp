@@ -0,0 +1,159 @@
+/**
+ * @file subcluster_splitmerge.hpp
+ * @brief Split-merge sampler with persistent sub-clusters (Chang and Fisher, 2013)
+ *
+ * @author Filippo Galli
+ * @date 2025
+ */
+
+#pragma once
+
+#include "../utils/Sampler.hpp"
+#include <cstdint>
+#include <vector>
+
+/**
+ * @class SubClusterSplitMerge
+ * @brief Split-merge moves proposed from two persistent sub-clusters per cluster
+ *
+ * Every allocated point carries a sub-cluster label, left (0) or right (1), kept across steps:
+ * the chain runs on (z, s), with target p(z | x) times, for each cluster, the
+ * Dirichlet(a / 2, a / 2)-multinomial probability of its sub-cluster labels. A step runs:
+ * 1. Gibbs sweeps of the sub-cluster labels of every cluster,
+ *    p(s_i = l) ∝ (n_kl^{-i} + a / 2) f(x_i | x_kl^{-i}), where f is
+ *    Likelihood::point_loglikelihood_members(). The clusters are independent given the
+ *    allocations, so they are swept in parallel, one OpenMP task per cluster, each with its own
+ *    random stream (the result does not depend on the number of threads);
+ * 2. split-merge proposals, each with probability 1/2 the split of a uniform cluster along its
+ *    sub-clusters, otherwise the merge of a uniform ordered pair of clusters, whose two former
+ *    clusters become its left and right sub-clusters. An accepted split draws the sub-cluster
+ *    labels of the two new clusters from the Dirichlet-multinomial. No launch state and no
+ *    restricted Gibbs scan: a split costs two cluster log-likelihoods.
+ *
+ * The Hastings ratios are those of Chang and Fisher (2013), prior ratio of the Process (so any of
+ * DP, NGGP, NGGPx) times the likelihood ratio, with the Dirichlet-multinomial probability of the
+ * sub-clusters and the cluster choice terms. They hold for the product-partition models of Chang
+ * and Fisher, where the likelihood of a cluster, and the sweep's conditional of a point within a
+ * sub-cluster, read only the members involved. A likelihood with terms between clusters (the
+ * repulsion of Natarajan_likelihood) also tilts the sweep by points outside the cluster, which
+ * the ratios do not account for, so the sampler requires Likelihood::cluster_local().
+ *
+ * The allocations are otherwise left to a point Gibbs sampler (Neal3, ParallelGibbs), run in
+ * alternation: the sub-cluster labels follow the points, so they survive moves made by other
+ * samplers and the relabeling when empty clusters are removed. A point moved by such a sampler
+ * keeps its label until the next sweep.
+ *
+ * @note Reference: Chang, J. and Fisher III, J. W. (2013). "Parallel Sampling of DP Mixture
+ * Models using Sub-Clusters Splits"
+ * @see SplitMerge_LSS_SDDS
+ */
+class SubClusterSplitMerge : public Sampler {
+private:
+    int n_threads;           ///< OpenMP threads of the sub-cluster sweep
+    int sub_sweeps;          ///< Sub-cluster sweeps per step
+    int proposals;           ///< Split-merge proposals per step
+    double half_a;           ///< Dirichlet concentration of each sub-cluster (a / 2)
+
+    std::vector<uint8_t> side; ///< Sub-cluster of each point (0: left, 1: right)
+    std::vector<std::vector<int>> members[2]; ///< Members of the sub-clusters of each cluster
+    std::vector<int> position; ///< Position of each point in its sub-cluster member list
+    std::vector<Rng> cluster_rngs; ///< Random stream of each cluster in the current sweep
+    std::vector<int> order;        ///< Visiting order of the sweep, cluster k at [offset[k], offset[k + 1])
+    std::vector<int> offset;       ///< Start of each cluster in order
+
+    // ========== Debug variables ==========
+    int accepted_split = 0;
+    int accepted_merge = 0;
+    int split_moves = 0;
+    int merge_moves = 0;
+
+    /** @brief Rebuilds the sub-cluster member lists from the allocations and side */
+    void collect_subclusters();
+
+    /**
+     * @brief One Gibbs sweep of the sub-cluster labels of a cluster
+     * @param k Cluster
+     * @param rng Random stream of the cluster
+     */
+    void sweep_cluster(int k, Rng &rng);
+
+    /** @brief Sweeps every cluster, in parallel over the clusters */
+    void sweep_subclusters();
+
+    /** @brief Draws the sub-cluster labels of a set of points from the Dirichlet-multinomial */
+    void draw_subclusters(const std::vector<int> &points);
+
+    /**
+     * @brief Proposes the split of a cluster along its sub-clusters
+     * @param k Cluster (rejected if a sub-cluster is empty)
+     * @return Whether the split was accepted
+     */
+    bool split_move(int k);
+
+    /**
+     * @brief Proposes the merge of two clusters
+     * @param ci Cluster kept, the left sub-cluster of the merged cluster
+     * @param cj Cluster merged into ci, the right sub-cluster
+     * @return Whether the merge was accepted
+     */
+    bool merge_move(int ci, int cj);
+
+    /**
+     * @brief Log probability of a sub-cluster assignment under the Dirichlet(a/2, a/2) weights
+     * @param n_l Size of the left sub-cluster
+     * @param n_r Size of the right sub-cluster
+     */
+    double log_subcluster_prob(int n_l, int n_r) const;
+
+public:
+    /**
+     * @brief Constructor
+     *
+     * @param d Reference to Data object containing observations
+     * @param p Reference to Params object with hyperparameters (a sets the sub-cluster weights)
+     * @param l Reference to Likelihood object; must be cluster_local() and implement
+     * point_loglikelihood_members()
+     * @param pr Reference to Process object defining the prior
+     * @param n_threads OpenMP threads of the sub-cluster sweep (1: serial; forced to 1 with
+     * packed distance storage, whose row buffer is shared)
+     * @param sub_sweeps Sub-cluster sweeps per step
+     * @param proposals Split-merge proposals per step
+     * @param rng Random number generator stream (default: non-deterministically seeded)
+     * @throws std::invalid_argument if n_threads < 1, sub_sweeps < 1 or proposals < 1, or if the
+     * likelihood is not cluster_local()
+     *
+     * @details The sub-cluster labels start at random.
+     */
+    SubClusterSplitMerge(Data &d, Params &p, Likelihood &l, Process &pr, int n_threads = 1, int sub_sweeps = 1,
+                         int proposals = 1, Rng rng = Rng());
+
+    /** @brief One step: sub-cluster sweeps, then split and merge proposals */
+    void step() override;
+
+    /** @brief Writes the random stream, the sub-cluster labels and the move counters */
+    void write_checkpoint(CheckpointWriter &out) const override;
+
+    /** @brief Restores the state written by write_checkpoint() */
+    void read_checkpoint(CheckpointReader &in) override;
+
+    /**
+     * @brief Heap bytes of the sub-cluster labels, member lists and streams
+     * @see MemoryReport
+     */
+    std::size_t memory_bytes() const override;
+
+    /** @brief Sub-cluster of a point (0: left, 1: right) */
+    int get_subcluster(int index) const { return side[index]; }
+
+    /**
+     * @brief Get number of accepted split moves for diagnostics
+     * @return Ratio of accepted split moves
+     */
+    double get_accepted_split() const { return static_cast<double>(accepted_split) / split_moves; }
+
+    /**
+     * @brief Get number of accepted merge moves for diagnostics
+     * @return Ratio of accepted merge moves
+     */
+    double get_accepted_merge() const { return static_cast<double>(accepted_merge) / merge_moves; }
+};
@@ -0,0 +1,136 @@
+/**
+ * @file AsyncTraceWriter.cpp
+ * @brief Implementation of the AsyncTraceWriter class
+ */
+
+#include "AsyncTraceWriter.hpp"
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <stdexcept>
+#include <unordered_set>
+
+AsyncTraceWriter::Channel::Channel(AsyncTraceWriter &owner, TraceWriter &target, int capacity)
+    : owner(owner), target(target), n(target.size()), slots(capacity) {
+    for (Slot &slot : slots)
+        slot.allocations.resize(n);
+}
+
+void AsyncTraceWriter::Channel::write(const int *allocations, int K, double U, double log_likelihood) {
+    if (owner.failed.load(std::memory_order_acquire) || owner.stopping.load(std::memory_order_acquire)) {
+        throw std::runtime_error("AsyncTraceWriter: the writer is closed or failed");
+    }
+    const std::uint64_t position = head.load(std::memory_order_relaxed);
+    const std::uint64_t capacity = slots.size();
+    if (position - tail.load(std::memory_order_acquire) >= capacity) {
+        if (owner.backpressure == Backpressure::Drop) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        stalls.fetch_add(1, std::memory_order_relaxed);
+        for (int spin = 0; position - tail.load(std::memory_order_acquire) >= capacity; ++spin) {
+            if (owner.failed.load(std::memory_order_acquire)) {
+                throw std::runtime_error("AsyncTraceWriter: the writer failed");
+            }
+            if (spin < 64)
+                std::this_thread::yield();
+            else
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    }
+
+    Slot &slot = slots[position % capacity];
+    std::copy(allocations, allocations + n, slot.allocations.begin());
+    slot.K = K;
+    slot.U = U;
+    slot.log_likelihood = log_likelihood;
+    head.store(position + 1, std::memory_order_release);
+}
+
+std::size_t AsyncTraceWriter::Channel::drain() {
+    const std::uint64_t end = head.load(std::memory_order_acquire);
+    std::uint64_t position = tail.load(std::memory_order_relaxed);
+    const std::size_t count = end - position;
+    for (; position < end; ++position) {
+        const Slot &slot = slots[position % slots.size()];
+        // After a failure the samples are discarded, so that no chain waits for a slot
+        if (!owner.failed.load(std::memory_order_relaxed))
+            target.write(slot.allocations.data(), slot.K, slot.U, slot.log_likelihood);
+        tail.store(position + 1, std::memory_order_release);
+    }
+    return count;
+}
+
+AsyncTraceWriter::AsyncTraceWriter(std::vector<TraceWriter *> targets, int capacity, Backpressure backpressure)
+    : backpressure(backpressure) {
+    if (targets.empty()) {
+        throw std::invalid_argument("AsyncTraceWriter: need at least one trace file");
+    }
+    if (capacity < 1) {
+        throw std::invalid_argument("AsyncTraceWriter: capacity must be positive");
+    }
+    std::unordered_set<const TraceWriter *> seen;
+    for (TraceWriter *target : targets) {
+        if (!target || !seen.insert(target).second) {
+            throw std::invalid_argument("AsyncTraceWriter: every channel needs its own trace file");
+        }
+        channels.emplace_back(new Channel(*this, *target, capacity));
+    }
+    worker = std::thread(&AsyncTraceWriter::run, this);
+}
+
+AsyncTraceWriter::~AsyncTraceWriter() {
+    try {
+        close();
+    } catch (const std::exception &) {
+        // Destructors must not throw: the error was reported to the chains
+    }
+}
+
+void AsyncTraceWriter::run() {
+    auto pause = std::chrono::microseconds(1);
+    for (;;) {
+        // Read before draining: once set, the drain below sees every sample published before close()
+        const bool last = stopping.load(std::memory_order_acquire);
+        std::size_t written = 0;
+        for (const std::unique_ptr<Channel> &channel : channels) {
+            try {
+                written += channel->drain();
+            } catch (const std::exception &e) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (error.empty())
+                    error = e.what();
+                failed.store(true, std::memory_order_release);
+            }
+        }
+        if (last)
+            return;
+        if (written > 0) {
+            pause = std::chrono::microseconds(1);
+        } else {
+            std::this_thread::sleep_for(pause);
+            pause = std::min(pause * 2, std::chrono::microseconds(1000));
+        }
+    }
+}
+
+void AsyncTraceWriter::close() {
+    if (closed)
+        return;
+    closed = true;
+    stopping.store(true, std::memory_order_release);
+    if (worker.joinable())
+        worker.join();
+
+    for (const std::unique_ptr<Channel> &channel : channels) {
+        try {
+            channel->target.close();
+        } catch (const std::exception &e) {
+            if (error.empty())
+                error = e.what();
+        }
+    }
+    if (!error.empty()) {
+        throw std::runtime_error("AsyncTraceWriter: " + error);
+    }
+}
@@ -0,0 +1,151 @@
+/**
+ * @file AsyncTraceWriter.hpp
+ * @brief Trace output on a background thread, fed by the chains through bounded lock-free queues
+ *
+ * @author Filippo Galli
+ * @date 2025
+ */
+
+#pragma once
+
+#include "TraceFile.hpp"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @class AsyncTraceWriter
+ * @brief Moves the encoding and writing of the trace samples off the sampling threads
+ *
+ * A chain streams its samples to a Channel (a TraceSink, see ChainRunner::set_trace()), which
+ * copies each one (n labels, K, U and log-likelihood) into the next slot of a ring of capacity
+ * preallocated slots and returns. One background thread drains the rings of all the channels and
+ * hands the samples to their TraceWriter, which delta-encodes, compresses and writes them, so the
+ * chains sample while their previous samples are written and one thread serves every chain of
+ * run_chains().
+ *
+ * Each ring has a single producer (its chain) and a single consumer (the background thread): the
+ * producer publishes a slot by advancing its head and the consumer frees it by advancing its
+ * tail, two atomic counters with acquire / release ordering and no lock. When a ring is full the
+ * backpressure policy applies: Block waits for a free slot (the trace is complete, the chain runs
+ * at the speed of the output when that is slower), Drop discards the sample and counts it (the
+ * chain never waits, the trace misses samples). The background thread polls with an increasing
+ * pause, up to a millisecond, while all rings are empty.
+ *
+ * An error of a TraceWriter stops the output: the chains get it from their next write() (so a
+ * blocked chain does not wait forever) and close() rethrows it.
+ */
+class AsyncTraceWriter {
+public:
+    /** @brief What a write to a full ring does */
+    enum class Backpressure {
+        Block, ///< Wait for a free slot
+        Drop   ///< Discard the sample and count it
+    };
+
+    /**
+     * @class Channel
+     * @brief Queue of the samples of one chain, written to its TraceWriter in the background
+     *
+     * Must be written by one thread at a time (one chain).
+     */
+    class Channel : public TraceSink {
+    public:
+        /**
+         * @brief Queues a sample (copied, so the caller may overwrite allocations at once)
+         * @throws std::runtime_error if the writer is closed or the output failed
+         */
+        void write(const int *allocations, int K, double U, double log_likelihood) override;
+
+        /** @brief Number of points */
+        int size() const override { return n; }
+
+        /** @brief Samples queued so far (written or waiting) */
+        std::uint64_t get_queued() const { return head.load(std::memory_order_acquire); }
+
+        /** @brief Samples written to the TraceWriter so far */
+        std::uint64_t get_written() const { return tail.load(std::memory_order_acquire); }
+
+        /** @brief Samples discarded on a full ring (Backpressure::Drop) */
+        std::uint64_t get_dropped() const { return dropped.load(std::memory_order_relaxed); }
+
+        /** @brief Times the chain waited for a free slot (Backpressure::Block) */
+        std::uint64_t get_stalls() const { return stalls.load(std::memory_order_relaxed); }
+
+    private:
+        friend class AsyncTraceWriter;
+
+        /** @brief One queued sample */
+        struct Slot {
+            std::vector<int> allocations; ///< n labels
+            int K = 0;                    ///< Number of clusters
+            double U = 0.0;               ///< U
+            double log_likelihood = 0.0;  ///< Log-likelihood
+        };
+
+        Channel(AsyncTraceWriter &owner, TraceWriter &target, int capacity);
+
+        /** @brief Writes the queued samples to the target; returns how many (consumer side) */
+        std::size_t drain();
+
+        AsyncTraceWriter &owner;              ///< Writer of the background thread
+        TraceWriter &target;                  ///< Trace file of the chain
+        int n;                                ///< Number of points
+        std::vector<Slot> slots;              ///< Ring of samples
+        alignas(64) std::atomic<std::uint64_t> head{0}; ///< Samples published by the chain
+        alignas(64) std::atomic<std::uint64_t> tail{0}; ///< Samples written by the background thread
+        std::atomic<std::uint64_t> dropped{0}; ///< Samples discarded
+        std::atomic<std::uint64_t> stalls{0};  ///< Writes that waited for a slot
+    };
+
+    /**
+     * @brief Starts the background thread
+     * @param targets Trace file of each channel (not owned, closed by close()); several channels
+     *        must not share one
+     * @param capacity Slots of each ring (n ints each)
+     * @param backpressure Policy of a write to a full ring
+     * @throws std::invalid_argument if targets is empty or has a null or repeated entry, or capacity < 1
+     */
+    AsyncTraceWriter(std::vector<TraceWriter *> targets, int capacity = 64,
+                     Backpressure backpressure = Backpressure::Block);
+
+    AsyncTraceWriter(const AsyncTraceWriter &) = delete;
+    AsyncTraceWriter &operator=(const AsyncTraceWriter &) = delete;
+
+    /** @brief Closes the writer if close() was not called, ignoring output errors */
+    ~AsyncTraceWriter();
+
+    /**
+     * @brief Channel of a chain
+     * @param c Index of the channel, that of its TraceWriter in targets
+     * @throws std::out_of_range if c is out of range
+     */
+    Channel &channel(int c) { return *channels.at(c); }
+
+    /** @brief Number of channels */
+    int size() const { return static_cast<int>(channels.size()); }
+
+    /**
+     * @brief Writes every queued sample, stops the background thread and closes the trace files;
+     * later calls do nothing. The chains must have stopped writing
+     * @throws std::runtime_error if the output failed
+     */
+    void close();
+
+private:
+    std::vector<std::unique_ptr<Channel>> channels; ///< One per chain
+    Backpressure backpressure;                      ///< Policy on a full ring
+    std::atomic<bool> stopping{false};              ///< Set by close(): drain and exit
+    std::atomic<bool> failed{false};                ///< Set when a TraceWriter threw
+    std::mutex error_mutex;                         ///< Guards error
+    std::string error;                              ///< Message of the first output error
+    std::thread worker;                             ///< Background thread
+    bool closed = false;                            ///< Whether close() ran
+
+    /** @brief Loop of the background thread */
+    void run();
+};
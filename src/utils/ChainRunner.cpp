@@ -0,0 +1,211 @@
+/**
+ * @file ChainRunner.cpp
+ * @brief Implementation of the ChainRunner class
+ */
+
+#include "ChainRunner.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+ChainRunner::ChainRunner(Data &data_, Process &process_, std::vector<Sampler *> samplers_, std::vector<int> periods_,
+                         U_sampler *u_sampler_)
+    : data(data_), process(process_), samplers(std::move(samplers_)), periods(std::move(periods_)),
+      u_sampler(u_sampler_) {
+
+    if (samplers.size() != periods.size()) {
+        throw std::invalid_argument("samplers and schedule must have the same length");
+    }
+    for (int period : periods) {
+        if (period < 1) {
+            throw std::invalid_argument("schedule entries must be positive integers");
+        }
+    }
+}
+
+void ChainRunner::set_trace(TraceSink *trace_, const Likelihood *likelihood_) {
+    if (trace_ && trace_->size() != data.get_n()) {
+        throw std::invalid_argument("trace file is for " + std::to_string(trace_->size()) + " points, data has " +
+                                    std::to_string(data.get_n()));
+    }
+    trace = trace_;
+    likelihood = likelihood_;
+}
+
+void ChainRunner::set_co_clustering(CoClustering *co_clustering_) {
+    if (co_clustering_ && co_clustering_->size() != data.get_n()) {
+        throw std::invalid_argument("co-clustering accumulator is for " + std::to_string(co_clustering_->size()) +
+                                    " points, data has " + std::to_string(data.get_n()));
+    }
+    co_clustering = co_clustering_;
+}
+
+void ChainRunner::set_checkpoint(std::string path, int every) {
+    if (every < 0) {
+        throw std::invalid_argument("checkpoint_every must be non-negative");
+    }
+    checkpoint_path = std::move(path);
+    checkpoint_every = every;
+}
+
+void ChainRunner::save_checkpoint(const std::string &path, int iteration, int BI, int thin) {
+    CheckpointWriter out(path);
+    out.begin("ChainRunner");
+    out.write(static_cast<int32_t>(iteration));
+    out.write(static_cast<int32_t>(BI));
+    out.write(static_cast<int32_t>(thin));
+    out.write(static_cast<int32_t>(samplers.size()));
+    out.write(static_cast<int8_t>(u_sampler != nullptr));
+
+    data.write_checkpoint(out);
+    data.rebuild_derived_state(); // Continue from the caches a resumed chain rebuilds
+    if (u_sampler)
+        u_sampler->write_checkpoint(out);
+    for (const Sampler *sampler : samplers)
+        sampler->write_checkpoint(out);
+    out.close();
+}
+
+int ChainRunner::load_checkpoint(const std::string &path, int BI, int thin) {
+    CheckpointReader in(path);
+    in.expect("ChainRunner");
+    int32_t iteration, saved_BI, saved_thin, n_samplers;
+    int8_t has_u_sampler;
+    in.read(iteration);
+    in.read(saved_BI);
+    in.read(saved_thin);
+    in.read(n_samplers);
+    in.read(has_u_sampler);
+    if (saved_BI != BI || saved_thin != thin) {
+        in.fail("written with BI = " + std::to_string(saved_BI) + " and thin = " + std::to_string(saved_thin) +
+                ", resumed with BI = " + std::to_string(BI) + " and thin = " + std::to_string(thin));
+    }
+    if (n_samplers != static_cast<int>(samplers.size()) || (has_u_sampler != 0) != (u_sampler != nullptr)) {
+        in.fail("written by a chain with " + std::to_string(n_samplers) + " samplers" +
+                (has_u_sampler ? " and" : " and no") + " U sampler");
+    }
+    if (iteration < 0) {
+        in.fail("corrupt iteration");
+    }
+
+    // The Data first: the parallel samplers reset their replicas to it
+    data.read_checkpoint(in);
+    if (u_sampler)
+        u_sampler->read_checkpoint(in);
+    for (Sampler *sampler : samplers)
+        sampler->read_checkpoint(in);
+    in.finish();
+    return iteration;
+}
+
+void ChainRunner::track_log_likelihood(const Likelihood *untempered, int check_every) {
+    if (check_every < 0) {
+        throw std::invalid_argument("drift check interval must be non-negative");
+    }
+    tracked = untempered;
+    drift_check_every = check_every;
+    max_drift = 0;
+    if (tracked)
+        data.set_running_log_likelihood(full_log_likelihood());
+    else
+        data.stop_log_likelihood_tracking();
+}
+
+double ChainRunner::full_log_likelihood() const {
+    double total = 0.0;
+    for (int k = 0; k < data.get_K(); ++k) {
+        if (data.get_cluster_size(k) > 0)
+            total += tracked->cluster_loglikelihood(k);
+    }
+    return total;
+}
+
+double ChainRunner::log_likelihood() {
+    if (!tracked) {
+        throw std::logic_error("ChainRunner: the log-likelihood is not tracked");
+    }
+    if (!data.tracks_log_likelihood())
+        data.set_running_log_likelihood(full_log_likelihood());
+    return data.get_running_log_likelihood();
+}
+
+double ChainRunner::log_posterior() { return log_likelihood() + process.log_prior(); }
+
+void ChainRunner::iterate(int i) {
+    // Update process parameters (U)
+    process.update_params();
+
+    // MCMC steps
+    for (size_t s = 0; s < samplers.size(); ++s) {
+        if (i % periods[s] == 0) {
+            samplers[s]->step();
+            if (!samplers[s]->tracks_log_likelihood())
+                data.stop_log_likelihood_tracking();
+        }
+    }
+
+    // Drift of the running log-likelihood, re-synchronized on the full sum
+    if (tracked && drift_check_every > 0 && i % drift_check_every == 0 && data.tracks_log_likelihood()) {
+        const double full = full_log_likelihood();
+        max_drift = std::max(max_drift, std::abs(data.get_running_log_likelihood() - full));
+        data.set_running_log_likelihood(full);
+    }
+}
+
+double ChainRunner::run(int BI, int NI, int thin, int *allocations_out, int *K_out, double *U_out,
+                        const std::function<void(int, int)> &on_progress, int first_iteration,
+                        double *log_posterior_out) {
+
+    const int n = data.get_n();
+    const int total_iters = BI + NI;
+    const int progress_every = std::max(1, total_iters / 20);
+
+    const auto start_time = std::chrono::steady_clock::now();
+
+    int saved = 0;
+    for (int i = first_iteration + 1; i <= total_iters; ++i) {
+        iterate(i);
+        if (u_sampler && i == BI)
+            u_sampler->reset_diagnostics(); // Efficiency of U after the burn-in only
+
+        // Store results
+        if (i % thin == 0) {
+            const Eigen::VectorXi &allocations = data.get_allocations();
+            if (allocations_out)
+                std::copy(allocations.data(), allocations.data() + n, allocations_out + static_cast<size_t>(saved) * n);
+            K_out[saved] = data.get_K();
+            if (u_sampler)
+                U_out[saved] = u_sampler->get_U();
+            if (log_posterior_out)
+                log_posterior_out[saved] = tracked ? log_posterior() : std::numeric_limits<double>::quiet_NaN();
+            ++saved;
+
+            if (trace && i > BI) {
+                double log_likelihood = std::numeric_limits<double>::quiet_NaN();
+                if (likelihood && likelihood == tracked) {
+                    log_likelihood = this->log_likelihood();
+                } else if (likelihood) {
+                    log_likelihood = 0.0;
+                    for (int k = 0; k < data.get_K(); ++k)
+                        log_likelihood += likelihood->cluster_loglikelihood(k);
+                }
+                trace->write(allocations.data(), data.get_K(),
+                             u_sampler ? u_sampler->get_U() : std::numeric_limits<double>::quiet_NaN(), log_likelihood);
+            }
+            if (co_clustering && i > BI)
+                co_clustering->add(data);
+        }
+
+        if (checkpoint_every > 0 && !checkpoint_path.empty() && i % checkpoint_every == 0)
+            save_checkpoint(checkpoint_path, i, BI, thin);
+
+        if (on_progress && i % progress_every == 0)
+            on_progress(i, total_iters);
+    }
+
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+}
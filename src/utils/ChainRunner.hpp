@@ -0,0 +1,216 @@
+/**
+ * @file ChainRunner.hpp
+ * @brief Native MCMC chain driver shared by the single- and multi-chain R entry points
+ *
+ * @author Filippo Galli
+ * @date 2025
+ */
+
+#pragma once
+
+#include "../samplers/U_sampler/U_sampler.hpp"
+#include "CoClustering.hpp"
+#include "Data.hpp"
+#include "Likelihood.hpp"
+#include "Process.hpp"
+#include "Sampler.hpp"
+#include "TraceFile.hpp"
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * @class ChainRunner
+ * @brief Runs a full MCMC chain on an already built Data/Process/Sampler stack
+ *
+ * At every iteration the process parameters are updated first, then each sampler is stepped
+ * if the 1-based iteration index is a multiple of its period. Every `thin`-th iteration the
+ * allocations, K and (optionally) U are written into caller-provided buffers, so the runner
+ * never allocates per iteration and never touches the R API. This makes it safe to run several
+ * independent chains concurrently, one per thread.
+ *
+ * With a TraceWriter attached (set_trace()) the thinned post-burn-in samples are also streamed to
+ * a trace file, and the in-memory allocation buffer may be omitted; an AsyncTraceWriter channel
+ * moves the encoding and writing to a background thread. With a CoClustering attached
+ * (set_co_clustering()) the same samples are accumulated into the posterior similarity matrix.
+ *
+ * With a checkpoint file set (set_checkpoint()) the full state of the chain is written to it every
+ * few iterations: the Data, the U sampler and every sampler (random streams, counters, adapted
+ * quantities). A stack built the same way can load it (load_checkpoint()) and run() from the
+ * iteration it was written at, continuing exactly as the chain that wrote it. The process needs
+ * nothing: its tables are rebuilt by the update_params() that starts each iteration.
+ */
+class ChainRunner {
+private:
+    Data &data;                     ///< Data object of this chain
+    Process &process;               ///< Process of this chain
+    std::vector<Sampler *> samplers; ///< Samplers stepped in order at each iteration
+    std::vector<int> periods;       ///< Period of each sampler (1 = every iteration)
+    U_sampler *u_sampler;           ///< Optional U sampler whose U is traced and checkpointed
+    TraceSink *trace = nullptr;     ///< Optional trace of the post-burn-in samples
+    const Likelihood *likelihood = nullptr; ///< Optional likelihood whose value is written to the trace
+    CoClustering *co_clustering = nullptr;  ///< Optional accumulator of the post-burn-in co-clustering
+    std::string checkpoint_path;    ///< Checkpoint file written during run() (empty: none)
+    int checkpoint_every = 0;       ///< Iterations between checkpoints (0: none)
+    const Likelihood *tracked = nullptr;    ///< Untempered likelihood of the running log-likelihood (nullptr: none)
+    int drift_check_every = 0;      ///< Iterations between full recomputations of it (0: none)
+    double max_drift = 0;           ///< Largest gap found by those recomputations
+
+    /** @brief Sum of the cluster log-likelihoods of tracked over the non-empty clusters */
+    double full_log_likelihood() const;
+
+public:
+    /**
+     * @brief Constructs a runner for one chain
+     * @param data_ Data object shared by the process and the samplers
+     * @param process_ Process updated at the start of each iteration
+     * @param samplers_ Samplers stepped in order
+     * @param periods_ Period of each sampler, same length as samplers_
+     * @param u_sampler_ Optional U sampler (nullptr if U is not traced); it is checkpointed with the chain
+     * @throws std::invalid_argument if the sizes differ or a period is not positive
+     */
+    ChainRunner(Data &data_, Process &process_, std::vector<Sampler *> samplers_, std::vector<int> periods_,
+                U_sampler *u_sampler_ = nullptr);
+
+    /**
+     * @brief Number of iterations stored for a run
+     * @param BI Number of burn-in iterations
+     * @param NI Number of iterations after burn-in
+     * @param thin Thinning interval
+     * @param first_iteration Iterations already run, for a resumed chain (see run())
+     * @return Number of saved iterations, (BI + NI) / thin - first_iteration / thin
+     */
+    static int n_saved(int BI, int NI, int thin, int first_iteration = 0) {
+        return (BI + NI) / thin - first_iteration / thin;
+    }
+
+    /**
+     * @brief Streams the post-burn-in samples to a trace file
+     * @param trace_ Trace writer, or channel of an AsyncTraceWriter, for n points, or nullptr to stop
+     *        streaming; not owned
+     * @param likelihood_ Optional likelihood; if set, the sum of its cluster log-likelihoods is written
+     *        with each sample (O(n^2) per sample for the distance likelihoods), otherwise NaN
+     * @throws std::invalid_argument if the trace is not for the n points of the data
+     */
+    void set_trace(TraceSink *trace_, const Likelihood *likelihood_ = nullptr);
+
+    /**
+     * @brief Accumulates the post-burn-in samples into a co-clustering matrix
+     * @param co_clustering_ Accumulator for n points, or nullptr to stop; not owned. If several
+     *        runners share it concurrently it must have been created with shared = true
+     * @throws std::invalid_argument if the accumulator is not for the n points of the data
+     */
+    void set_co_clustering(CoClustering *co_clustering_);
+
+    /**
+     * @brief Keeps the log-likelihood of the partition up to date from the moves of the samplers
+     * @param untempered Likelihood whose value is tracked, untempered (Tempered_likelihood::get_base()),
+     *        or nullptr to stop; not owned
+     * @param check_every Iterations between full recomputations checking the drift of the running
+     *        value (0: none); each replaces the running value
+     * @throws std::invalid_argument if check_every < 0
+     *
+     * @details The value is seeded with a full sum, then updated by the samplers that report the
+     * likelihood change of their moves (Sampler::tracks_log_likelihood(): SplitMerge_LSS_SDDS on a
+     * cluster-local likelihood, Neal3 on one with exact conditionals, a MoveScheduler of them).
+     * After a step of any other sampler it is recomputed in full when next read, at the cost of the
+     * sum it replaces. The samplers must all share one likelihood over untempered, tempered or not.
+     */
+    void track_log_likelihood(const Likelihood *untempered, int check_every = 0);
+
+    /**
+     * @brief Untempered log-likelihood of the current partition
+     * @return The running value, recomputed in full (and re-seeded) if a sampler stopped the tracking
+     * @throws std::logic_error if track_log_likelihood() was not called
+     */
+    double log_likelihood();
+
+    /**
+     * @brief Untempered log-posterior of the current partition, up to a constant
+     * @return log_likelihood() + Process::log_prior(), NaN if the process has no closed-form prior
+     *         (Process::has_log_prior())
+     * @throws std::logic_error if track_log_likelihood() was not called
+     */
+    double log_posterior();
+
+    /** @brief Largest gap between the running and the fully recomputed log-likelihood at the drift checks */
+    double get_max_drift() const { return max_drift; }
+
+    /**
+     * @brief Writes a checkpoint periodically during run()
+     * @param path Checkpoint file, replaced at each write (empty to stop)
+     * @param every Iterations between checkpoints (0 to stop); the last iteration is always included
+     *        if it is a multiple of every
+     * @throws std::invalid_argument if every < 0
+     */
+    void set_checkpoint(std::string path, int every);
+
+    /**
+     * @brief Writes the state of the chain to a checkpoint file
+     * @param path Checkpoint file (replaced atomically)
+     * @param iteration Iterations run so far
+     * @param BI Number of burn-in iterations of the run
+     * @param thin Thinning interval of the run
+     * @throws std::runtime_error if the file cannot be written
+     *
+     * @details Sections in order: the runner (iteration, BI, thin, number of samplers), the Data,
+     * the U sampler if any, then the samplers in schedule order.
+     */
+    void save_checkpoint(const std::string &path, int iteration, int BI, int thin);
+
+    /**
+     * @brief Restores the state written by save_checkpoint()
+     * @param path Checkpoint file
+     * @param BI Number of burn-in iterations of the run to resume, which must match the checkpoint
+     * @param thin Thinning interval of the run to resume, which must match the checkpoint
+     * @return Iterations already run, to pass to run() as first_iteration
+     * @throws std::runtime_error if the file is not a checkpoint of a chain built like this one
+     * (same Data size, U sampler type and samplers in the same order) or BI and thin differ; the
+     * stack may then be partially restored and should be rebuilt
+     */
+    int load_checkpoint(const std::string &path, int BI, int thin);
+
+    /**
+     * @brief Runs one iteration: the process update, then the samplers due at this iteration
+     * @param i 1-based iteration index, matched against the periods (and the drift checks)
+     * @note Nothing is stored; used by run() and by drivers interleaving several chains (ReplicaExchange)
+     */
+    void iterate(int i);
+
+    /** @brief Data object of this chain */
+    const Data &get_data() const { return data; }
+
+    /** @brief Process of this chain */
+    const Process &get_process() const { return process; }
+
+    /** @brief U sampler whose U is traced, or nullptr */
+    const U_sampler *get_u_sampler() const { return u_sampler; }
+
+    /** @brief U sampler whose U is traced, or nullptr */
+    U_sampler *get_u_sampler() { return u_sampler; }
+
+    /**
+     * @brief Runs BI + NI iterations writing thinned traces into the given buffers
+     * @param BI Number of burn-in iterations
+     * @param NI Number of iterations after burn-in
+     * @param thin Thinning interval of the stored traces
+     * @param allocations_out Buffer of n * n_saved ints, filled one column (n values) per saved iteration,
+     *        or nullptr to keep the allocations only in the trace
+     * @param K_out Buffer of n_saved ints for the number of clusters
+     * @param U_out Buffer of n_saved doubles for U (left untouched if no U sampler is set)
+     * @param on_progress Optional callback invoked 20 times during the run with (iteration, total)
+     * @param first_iteration Iterations already run (from load_checkpoint()); the run continues at
+     *        first_iteration + 1 and the buffers hold n_saved(BI, NI, thin, first_iteration) samples
+     * @param log_posterior_out Optional buffer of n_saved doubles for log_posterior() (NaN if the
+     *        log-likelihood is not tracked)
+     * @return Elapsed wall time in seconds
+     *
+     * The trace and the co-clustering accumulator, if any, receive every thin-th iteration after
+     * the burn-in. A resumed run writes only the samples of the iterations it runs. The diagnostics
+     * of the U sampler (U_sampler::get_ess()) are reset at the end of the burn-in. If the trace
+     * likelihood is the tracked one, the trace takes the running log-likelihood.
+     */
+    double run(int BI, int NI, int thin, int *allocations_out, int *K_out, double *U_out,
+               const std::function<void(int, int)> &on_progress = {}, int first_iteration = 0,
+               double *log_posterior_out = nullptr);
+};
@@ -0,0 +1,149 @@
+/**
+ * @file Checkpoint.cpp
+ * @brief Implementation of CheckpointWriter and CheckpointReader
+ *
+ * @author Filippo Galli
+ * @date 2025
+ */
+
+#include "Checkpoint.hpp"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+
+// ========== CheckpointWriter ==========
+
+CheckpointWriter::CheckpointWriter(std::string path_) : path(std::move(path_)) {
+    const int32_t fields[2] = {checkpoint_file::version, 0};
+    char header[sizeof(checkpoint_file::magic) + sizeof(fields)];
+    std::memcpy(header, checkpoint_file::magic, sizeof(checkpoint_file::magic));
+    std::memcpy(header + sizeof(checkpoint_file::magic), fields, sizeof(fields));
+    buffer.assign(header, header + sizeof(header));
+}
+
+void CheckpointWriter::begin(const std::string &tag) {
+    write(static_cast<int32_t>(tag.size()));
+    write_bytes(tag.data(), tag.size());
+}
+
+void CheckpointWriter::write(const Eigen::VectorXi &values) {
+    write(static_cast<int64_t>(values.size()));
+    write_bytes(values.data(), static_cast<std::size_t>(values.size()) * sizeof(int));
+}
+
+void CheckpointWriter::write(const Rng &rng) {
+    std::uint64_t state[4];
+    rng.get_state(state);
+    write_bytes(state, sizeof(state));
+}
+
+void CheckpointWriter::close() {
+    write_bytes(checkpoint_file::end_magic, sizeof(checkpoint_file::end_magic));
+
+    const std::string tmp_path = path + ".tmp";
+    {
+        std::unique_ptr<std::FILE, int (*)(std::FILE *)> file(std::fopen(tmp_path.c_str(), "wb"), &std::fclose);
+        if (!file) {
+            throw std::runtime_error("Cannot create checkpoint file " + tmp_path + ": " + std::strerror(errno));
+        }
+        if (std::fwrite(buffer.data(), 1, buffer.size(), file.get()) != buffer.size() ||
+            std::fflush(file.get()) != 0) {
+            throw std::runtime_error("Error while writing checkpoint file " + tmp_path);
+        }
+        if (std::fclose(file.release()) != 0) {
+            throw std::runtime_error("Error while closing checkpoint file " + tmp_path);
+        }
+    }
+    if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        throw std::runtime_error("Cannot move checkpoint file into " + path + ": " + std::strerror(errno));
+    }
+}
+
+// ========== CheckpointReader ==========
+
+CheckpointReader::CheckpointReader(std::string path_) : path(std::move(path_)) {
+    std::unique_ptr<std::FILE, int (*)(std::FILE *)> file(std::fopen(path.c_str(), "rb"), &std::fclose);
+    if (!file) {
+        throw std::runtime_error("Cannot open checkpoint file " + path + ": " + std::strerror(errno));
+    }
+    char chunk[1 << 16];
+    std::size_t got;
+    while ((got = std::fread(chunk, 1, sizeof(chunk), file.get())) > 0)
+        buffer.insert(buffer.end(), chunk, chunk + got);
+    if (std::ferror(file.get())) {
+        fail("read error");
+    }
+
+    char file_magic[8];
+    int32_t header[2];
+    if (buffer.size() < sizeof(file_magic) + sizeof(header) + sizeof(checkpoint_file::end_magic)) {
+        fail("not a checkpoint file");
+    }
+    read_bytes(file_magic, sizeof(file_magic));
+    read_bytes(header, sizeof(header));
+    if (std::memcmp(file_magic, checkpoint_file::magic, sizeof(file_magic)) != 0) {
+        fail("not a checkpoint file");
+    }
+    if (header[0] != checkpoint_file::version) {
+        fail("format version " + std::to_string(header[0]) + ", expected " +
+             std::to_string(checkpoint_file::version));
+    }
+}
+
+void CheckpointReader::fail(const std::string &message) const {
+    throw std::runtime_error("Checkpoint file " + path + ": " + message);
+}
+
+void CheckpointReader::read_bytes(void *data, std::size_t size) {
+    if (size > buffer.size() - offset) {
+        fail("unexpected end of file");
+    }
+    std::memcpy(data, buffer.data() + offset, size);
+    offset += size;
+}
+
+std::size_t CheckpointReader::read_size(std::size_t element_size) {
+    int64_t count;
+    read(count);
+    if (count < 0 || static_cast<uint64_t>(count) > (buffer.size() - offset) / element_size) {
+        fail("corrupt array size");
+    }
+    return static_cast<std::size_t>(count);
+}
+
+void CheckpointReader::expect(const std::string &tag) {
+    int32_t length;
+    read(length);
+    if (length < 0 || static_cast<std::size_t>(length) > buffer.size() - offset) {
+        fail("corrupt section tag, expected '" + tag + "'");
+    }
+    const std::string found(buffer.data() + offset, static_cast<std::size_t>(length));
+    offset += length;
+    if (found != tag) {
+        fail("found section '" + found + "' where '" + tag + "' was expected (was the chain built differently?)");
+    }
+}
+
+void CheckpointReader::read(Eigen::VectorXi &values) {
+    values.resize(static_cast<Eigen::Index>(read_size(sizeof(int))));
+    read_bytes(values.data(), static_cast<std::size_t>(values.size()) * sizeof(int));
+}
+
+void CheckpointReader::read(Rng &rng) {
+    std::uint64_t state[4];
+    read_bytes(state, sizeof(state));
+    rng.set_state(state);
+}
+
+void CheckpointReader::finish() {
+    char file_magic[8];
+    if (buffer.size() - offset != sizeof(file_magic)) {
+        fail("sections left over (was the chain built differently?)");
+    }
+    read_bytes(file_magic, sizeof(file_magic));
+    if (std::memcmp(file_magic, checkpoint_file::end_magic, sizeof(file_magic)) != 0) {
+        fail("missing end marker");
+    }
+}
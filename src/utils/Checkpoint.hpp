@@ -0,0 +1,151 @@
+/**
+ * @file Checkpoint.hpp
+ * @brief Binary checkpoint of the full state of a chain, to resume it after preemption
+ *
+ * @author Filippo Galli
+ * @date 2025
+ */
+
+#pragma once
+
+#include "Rng.hpp"
+#include <Eigen/Dense>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+/**
+ * @brief Layout shared by CheckpointWriter and CheckpointReader
+ *
+ * File layout (native endianness, like the trace files):
+ * - header, 16 bytes: magic "BNPCKPT1", format version (int32), reserved (int32, 0)
+ * - a sequence of sections, each a tag (int32 length, then the characters) followed by the
+ *   fields of the component that wrote it, as raw scalars and (int64 count, elements) arrays
+ * - the magic "BNPCEND1"
+ *
+ * Each component writes its own tag first (e.g. "Data", "Sampler", "SplitMerge_LSS_SDDS"), and
+ * the reader checks every tag, so a checkpoint restored into a stack built differently fails with
+ * the names of the two components instead of silently loading garbage.
+ */
+namespace checkpoint_file {
+constexpr char magic[8] = {'B', 'N', 'P', 'C', 'K', 'P', 'T', '1'};
+constexpr char end_magic[8] = {'B', 'N', 'P', 'C', 'E', 'N', 'D', '1'};
+constexpr int32_t version = 1;
+} // namespace checkpoint_file
+
+/**
+ * @class CheckpointWriter
+ * @brief Collects the sections of a checkpoint in memory and writes them at once
+ *
+ * The file is written to path + ".tmp" and then renamed over path by close(), so an interrupted
+ * write never replaces the previous checkpoint with a truncated one.
+ */
+class CheckpointWriter {
+private:
+    std::string path;          ///< Output path
+    std::vector<char> buffer;  ///< Contents written so far
+
+    /** @brief Appends raw bytes */
+    void write_bytes(const void *data, std::size_t size) {
+        const char *bytes = static_cast<const char *>(data);
+        buffer.insert(buffer.end(), bytes, bytes + size);
+    }
+
+public:
+    /**
+     * @brief Starts a checkpoint
+     * @param path_ Output path (replaced by close())
+     */
+    explicit CheckpointWriter(std::string path_);
+
+    /** @brief Starts the section of a component */
+    void begin(const std::string &tag);
+
+    /** @brief Writes a trivially copyable value */
+    template <typename T> void write(const T &value) {
+        static_assert(std::is_trivially_copyable<T>::value, "CheckpointWriter: value must be trivially copyable");
+        write_bytes(&value, sizeof(T));
+    }
+
+    /** @brief Writes a vector of trivially copyable values, with its size */
+    template <typename T> void write(const std::vector<T> &values) {
+        static_assert(std::is_trivially_copyable<T>::value, "CheckpointWriter: values must be trivially copyable");
+        write(static_cast<int64_t>(values.size()));
+        write_bytes(values.data(), values.size() * sizeof(T));
+    }
+
+    /** @brief Writes an integer vector, with its size */
+    void write(const Eigen::VectorXi &values);
+
+    /** @brief Writes the state of a generator */
+    void write(const Rng &rng);
+
+    /**
+     * @brief Writes the end marker and moves the file into place
+     * @throws std::runtime_error if the file cannot be written or renamed
+     */
+    void close();
+};
+
+/**
+ * @class CheckpointReader
+ * @brief Reads a checkpoint written by CheckpointWriter, checking the tag of every section
+ */
+class CheckpointReader {
+private:
+    std::string path;          ///< Input path, for error messages
+    std::vector<char> buffer;  ///< Whole file
+    std::size_t offset = 0;    ///< Read position
+
+    /** @brief Copies raw bytes, throwing at the end of the file */
+    void read_bytes(void *data, std::size_t size);
+
+public:
+    /**
+     * @brief Opens and loads a checkpoint
+     * @param path_ Input path
+     * @throws std::runtime_error if the file cannot be read, is not a checkpoint or has another version
+     */
+    explicit CheckpointReader(std::string path_);
+
+    /**
+     * @brief Reads the tag of the next section
+     * @throws std::runtime_error if it is not tag
+     */
+    void expect(const std::string &tag);
+
+    /** @brief Reads a trivially copyable value */
+    template <typename T> void read(T &value) {
+        static_assert(std::is_trivially_copyable<T>::value, "CheckpointReader: value must be trivially copyable");
+        read_bytes(&value, sizeof(T));
+    }
+
+    /** @brief Reads a vector of trivially copyable values */
+    template <typename T> void read(std::vector<T> &values) {
+        static_assert(std::is_trivially_copyable<T>::value, "CheckpointReader: values must be trivially copyable");
+        values.resize(read_size(sizeof(T)));
+        read_bytes(values.data(), values.size() * sizeof(T));
+    }
+
+    /** @brief Reads an integer vector */
+    void read(Eigen::VectorXi &values);
+
+    /** @brief Restores the state of a generator */
+    void read(Rng &rng);
+
+    /**
+     * @brief Reads an array size, checking that the elements fit in the rest of the file
+     * @param element_size Size of one element in bytes
+     */
+    std::size_t read_size(std::size_t element_size);
+
+    /**
+     * @brief Checks that the whole checkpoint was read
+     * @throws std::runtime_error if sections are left or the end marker is missing
+     */
+    void finish();
+
+    /** @brief Throws a std::runtime_error naming the file */
+    [[noreturn]] void fail(const std::string &message) const;
+};
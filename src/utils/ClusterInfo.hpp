@@ -11,7 +11,9 @@
 
 #pragma once
 
+#include "MemoryReport.hpp"
 #include <Eigen/Dense>
+#include <vector>
 
 /**
  * @class ClusterInfo
@@ -35,6 +37,21 @@ public:
      */
     virtual void set_allocation(int index, int cluster, int old_cluster) = 0;
 
+    /**
+     * @brief Moves every point of a cluster into another one
+     * @param from_cluster Cluster whose points move (left empty, not removed)
+     * @param to_cluster Cluster the points join
+     * @param moved Points that moved, the former members of from_cluster; the allocations
+     * already give them to_cluster
+     *
+     * The default replays the moves with set_allocation(), which is correct for caches that do
+     * not read the allocations; caches with additive statistics combine the two clusters at once.
+     */
+    virtual void merge_clusters(int from_cluster, int to_cluster, const std::vector<int> &moved) {
+        for (const int index : moved)
+            set_allocation(index, to_cluster, from_cluster);
+    }
+
     /**
      * @brief Recomputes all cluster information from current allocations
      * @param K Current number of clusters
@@ -49,11 +66,30 @@ public:
      */
     virtual void move_cluster_info(int from_cluster, int to_cluster) = 0;
 
+    /**
+     * @brief Moves cluster information from one cluster to another, given the moved points
+     * @param from_cluster Index of the source cluster
+     * @param to_cluster Index of the target cluster
+     * @param members Points of the moved cluster; the allocations already give them to_cluster
+     *
+     * Called by the compaction of Datax. The default is move_cluster_info(); caches that store
+     * per-point entries keyed by cluster relabel only the entries those points can affect.
+     */
+    virtual void relabel_cluster(int from_cluster, int to_cluster, [[maybe_unused]] const std::vector<int> &members) {
+        move_cluster_info(from_cluster, to_cluster);
+    }
+
     /**
      * @brief Removes information related to a specific cluster
      * @param cluster Index of the cluster to remove
      */
     virtual void remove_info(int cluster) = 0;
 
+    /**
+     * @brief Heap bytes of the cached statistics and of any copy of the data
+     * @see MemoryReport
+     */
+    virtual std::size_t memory_bytes() const = 0;
+
     virtual ~ClusterInfo() = default;
 };
\ No newline at end of file
@@ -0,0 +1,144 @@
+/**
+ * @file CoClustering.cpp
+ * @brief Implementation of the CoClustering accumulator
+ */
+
+#include "CoClustering.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+CoClustering::CoClustering(int n, Layout layout, bool shared) : n(n), layout(layout), shared(shared) {
+    if (n < 1) {
+        throw std::invalid_argument("CoClustering needs at least one point");
+    }
+
+    if (layout == Layout::Dense) {
+        counts.assign(static_cast<size_t>(n) * n, 0);
+    } else if (layout == Layout::Packed) {
+        counts.assign(static_cast<size_t>(n) * (n - 1) / 2, 0);
+        row_offset.resize(n);
+        size_t pos = 0;
+        for (int i = 0; i < n; ++i) {
+            // row_offset[i] + (i + 1) is the first entry of row i (unsigned wrap-around is intended for i = 0)
+            row_offset[i] = pos - static_cast<size_t>(i) - 1;
+            pos += n - i - 1;
+        }
+    }
+}
+
+void CoClustering::add_sorted_members(const int *sorted, int size) {
+    if (layout == Layout::Sparse) {
+        std::unique_lock<std::mutex> lock(map_mutex, std::defer_lock);
+        if (shared)
+            lock.lock();
+        for (int a = 0; a < size; ++a) {
+            const uint64_t base = static_cast<uint64_t>(sorted[a]) * n;
+            for (int b = a + 1; b < size; ++b)
+                ++map[base + sorted[b]];
+        }
+        return;
+    }
+
+    for (int a = 0; a < size; ++a) {
+        const int i = sorted[a];
+        if (layout == Layout::Dense) {
+            uint32_t *row_i = counts.data() + static_cast<size_t>(i) * n;
+            for (int b = a + 1; b < size; ++b) {
+                const int j = sorted[b];
+                increment(row_i[j]);
+                increment(counts[static_cast<size_t>(j) * n + i]);
+            }
+        } else {
+            // Row i of the upper triangle, read at ascending j
+            uint32_t *row_i = counts.data() + row_offset[i];
+            for (int b = a + 1; b < size; ++b)
+                increment(row_i[sorted[b]]);
+        }
+    }
+}
+
+void CoClustering::add(const Data &data) {
+    if (data.get_n() != n) {
+        throw std::invalid_argument("CoClustering is for " + std::to_string(n) + " points, data has " +
+                                    std::to_string(data.get_n()));
+    }
+
+    std::vector<int> sorted;
+    for (int k = 0; k < data.get_K(); ++k) {
+        const auto members = data.get_cluster_assignments_ref(k);
+        sorted.assign(members.data(), members.data() + members.size());
+        std::sort(sorted.begin(), sorted.end());
+        add_sorted_members(sorted.data(), static_cast<int>(sorted.size()));
+    }
+    ++samples;
+}
+
+void CoClustering::add(const ClusterMembers &clusters) {
+    std::vector<int> sorted;
+    for (const std::vector<int> &members : clusters) {
+        sorted = members;
+        std::sort(sorted.begin(), sorted.end());
+        if (!sorted.empty() && (sorted.front() < 0 || sorted.back() >= n)) {
+            throw std::out_of_range("CoClustering: member index outside [0, " + std::to_string(n) + ")");
+        }
+        add_sorted_members(sorted.data(), static_cast<int>(sorted.size()));
+    }
+    ++samples;
+}
+
+void CoClustering::merge(const CoClustering &other) {
+    if (other.n != n) {
+        throw std::invalid_argument("CoClustering: cannot merge accumulators on different points");
+    }
+
+    if (layout == other.layout && layout != Layout::Sparse) {
+        for (size_t e = 0; e < counts.size(); ++e)
+            counts[e] += other.counts[e];
+    } else {
+        const bool dense = layout == Layout::Dense;
+        other.for_each_pair([&](int i, int j, uint32_t c) {
+            if (layout == Layout::Sparse) {
+                map[static_cast<uint64_t>(i) * n + j] += c;
+            } else if (dense) {
+                counts[static_cast<size_t>(i) * n + j] += c;
+                counts[static_cast<size_t>(j) * n + i] += c;
+            } else {
+                counts[row_offset[i] + j] += c;
+            }
+        });
+    }
+    samples += other.samples.load();
+}
+
+uint32_t CoClustering::count(int i, int j) const {
+    if (i == j)
+        return static_cast<uint32_t>(samples.load());
+    if (i > j)
+        std::swap(i, j);
+
+    switch (layout) {
+    case Layout::Dense:
+        return counts[static_cast<size_t>(i) * n + j];
+    case Layout::Packed:
+        return counts[row_offset[i] + j];
+    default: {
+        const auto it = map.find(static_cast<uint64_t>(i) * n + j);
+        return it == map.end() ? 0 : it->second;
+    }
+    }
+}
+
+void CoClustering::to_dense(double *out) const {
+    const int64_t s = samples.load();
+    const double scale = s > 0 ? 1.0 / s : 0.0;
+    std::fill(out, out + static_cast<size_t>(n) * n, 0.0);
+    for (int i = 0; i < n; ++i)
+        out[static_cast<size_t>(i) * n + i] = 1.0;
+
+    for_each_pair([&](int i, int j, uint32_t c) {
+        const double value = c * scale;
+        out[static_cast<size_t>(j) * n + i] = value;
+        out[static_cast<size_t>(i) * n + j] = value;
+    });
+}
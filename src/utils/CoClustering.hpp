@@ -0,0 +1,165 @@
+/**
+ * @file CoClustering.hpp
+ * @brief Online accumulator of the posterior similarity (co-clustering) matrix
+ *
+ * @author Filippo Galli
+ * @date 2025
+ */
+
+#pragma once
+
+#include "Data.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @class CoClustering
+ * @brief Counts, for every pair of points, the kept samples in which they share a cluster
+ *
+ * add() is called once per kept sample and walks the member lists of the clusters, so an update
+ * costs O(sum_k n_k^2) (each within-cluster pair once) instead of an O(n^2) pass, and no sample
+ * needs to be stored. The posterior similarity of i and j is count(i, j) / samples, 1 on the
+ * diagonal.
+ *
+ * Three layouts are supported:
+ * - Dense:  n x n counts with both (i, j) and (j, i), 4 n^2 bytes, rows readable directly
+ * - Packed: strict upper triangle, 2 n (n - 1) bytes (the default)
+ * - Sparse: hash map of the pairs seen at least once, about 16 bytes per pair; for large n with
+ *   many small clusters, whose co-clustering matrix is mostly zero
+ *
+ * Counts are 32-bit integers, exact for up to 2^32 - 1 samples; probabilities are produced on
+ * output only.
+ *
+ * With shared = true one accumulator may be fed concurrently by several chains (e.g. the threads
+ * of the multi-chain runner) to pool their samples: the dense and packed counts are then updated
+ * atomically and the sparse map under a lock. Otherwise add() must not be called concurrently.
+ */
+class CoClustering {
+public:
+    /** @brief Storage layout of the counts */
+    enum class Layout { Dense, Packed, Sparse };
+
+private:
+    int n;                                      ///< Number of points
+    Layout layout;                              ///< Storage layout
+    bool shared;                                ///< Whether add() may be called concurrently
+    std::atomic<int64_t> samples{0};            ///< Number of accumulated samples
+    std::vector<uint32_t> counts;               ///< Dense or packed counts
+    std::vector<size_t> row_offset;             ///< Packed: row_offset[i] + j is the position of (i, j), j > i
+    std::unordered_map<uint64_t, uint32_t> map; ///< Sparse: counts keyed by i * n + j, i < j
+    std::mutex map_mutex;                       ///< Sparse: guards map when shared
+
+    /** @brief Adds one to a dense or packed count, atomically when shared */
+    inline void increment(uint32_t &count) {
+        if (shared) {
+#pragma omp atomic update
+            ++count;
+        } else {
+            ++count;
+        }
+    }
+
+    /**
+     * @brief Adds one to the counts of all pairs of a sorted member list
+     * @param sorted Member indices in ascending order
+     * @param size Number of members
+     */
+    void add_sorted_members(const int *sorted, int size);
+
+public:
+    /**
+     * @brief Creates an empty accumulator
+     * @param n Number of points
+     * @param layout Storage layout (default: packed)
+     * @param shared If true, add() may be called concurrently from several threads (default: false)
+     * @throws std::invalid_argument if n is not positive
+     */
+    explicit CoClustering(int n, Layout layout = Layout::Packed, bool shared = false);
+
+    /**
+     * @brief Accumulates the current partition
+     * @param data Data object of a chain on the same n points
+     * @throws std::invalid_argument if the data has a different number of points
+     */
+    void add(const Data &data);
+
+    /**
+     * @brief Accumulates a partition given as member lists
+     * @param clusters Member indices of each cluster
+     */
+    void add(const ClusterMembers &clusters);
+
+    /**
+     * @brief Adds the counts and samples of another accumulator on the same points
+     * @param other Accumulator to merge (not modified)
+     * @throws std::invalid_argument if the number of points differs
+     */
+    void merge(const CoClustering &other);
+
+    /**
+     * @brief Number of samples in which i and j share a cluster
+     * @param i First point
+     * @param j Second point
+     */
+    uint32_t count(int i, int j) const;
+
+    /**
+     * @brief Posterior similarity of i and j (1 on the diagonal, 0 before the first sample)
+     * @param i First point
+     * @param j Second point
+     */
+    double similarity(int i, int j) const {
+        const int64_t s = samples.load();
+        return i == j ? 1.0 : (s > 0 ? static_cast<double>(count(i, j)) / s : 0.0);
+    }
+
+    /**
+     * @brief Writes the whole similarity matrix
+     * @param out Output buffer of n * n doubles (column-major, symmetric)
+     */
+    void to_dense(double *out) const;
+
+    /**
+     * @brief Calls f(i, j, count) for every pair i < j with a non-zero count
+     * @param f Callback
+     */
+    template <class F> void for_each_pair(F &&f) const {
+        if (layout == Layout::Sparse) {
+            for (const auto &entry : map)
+                f(static_cast<int>(entry.first / n), static_cast<int>(entry.first % n), entry.second);
+            return;
+        }
+        for (int i = 0; i < n; ++i)
+            for (int j = i + 1; j < n; ++j)
+                if (const uint32_t c = count(i, j))
+                    f(i, j, c);
+    }
+
+    /** @brief Number of accumulated samples */
+    int64_t get_samples() const { return samples.load(); }
+
+    /** @brief Number of points */
+    int size() const { return n; }
+
+    /** @brief Storage layout */
+    Layout get_layout() const { return layout; }
+
+    /** @brief Whether add() may be called concurrently */
+    bool is_shared() const { return shared; }
+
+    /** @brief Number of pairs with a stored count (sparse), or of allocated counts (dense, packed) */
+    size_t stored_entries() const { return layout == Layout::Sparse ? map.size() : counts.size(); }
+
+    /**
+     * @brief Heap bytes of the counts (sparse: hash nodes, about 32 bytes each, and buckets)
+     * @see MemoryReport
+     */
+    size_t memory_bytes() const {
+        return MemoryReport::bytes(counts) + MemoryReport::bytes(row_offset) + map.size() * 32 +
+               map.bucket_count() * sizeof(void *);
+    }
+};
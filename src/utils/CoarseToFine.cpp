@@ -0,0 +1,260 @@
+/**
+ * @file CoarseToFine.cpp
+ * @brief Implementation of the CoarseToFine class
+ */
+
+#include "CoarseToFine.hpp"
+#include "../likelihoods/Gamma_likelihood.hpp"
+#include "../likelihoods/Natarajan_likelihood.hpp"
+#include "../processes/DP.hpp"
+#include "../processes/NGGP.hpp"
+#include "../samplers/U_sampler/RWMH.hpp"
+#include "../samplers/neal.hpp"
+#include "../samplers/splitmerge_LSS_SDDS.hpp"
+#include "ChainRunner.hpp"
+#include "InitialPartition.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+
+CoarseToFine::Coreset CoarseToFine::coreset(const Params &params, int representatives, int spread_pairs, Rng &rng) {
+    const int n = params.n;
+    if (n < 1) {
+        throw std::invalid_argument("CoarseToFine: no points");
+    }
+    if (representatives < 1 || spread_pairs < 1) {
+        throw std::invalid_argument("CoarseToFine: need at least one representative and one spread pair");
+    }
+    const int m = std::min(representatives, n);
+
+    // D^2 seeding; nearest[i] is the distance of point i to its closest representative so far
+    Coreset coreset;
+    coreset.assignment.assign(n, 0);
+    std::vector<double> nearest(n, std::numeric_limits<double>::infinity());
+    int seed = rng.uniform_int(n);
+    for (int r = 0; r < m; ++r) {
+        coreset.representatives.push_back(seed);
+        double total = 0.0;
+#pragma omp parallel for schedule(static) reduction(+ : total)
+        for (int i = 0; i < n; ++i) {
+            const double d = params.distance(i, seed);
+            if (d < nearest[i]) {
+                nearest[i] = d;
+                coreset.assignment[i] = r;
+            }
+            total += nearest[i] * nearest[i];
+        }
+        // Every point coincides with a representative: the others would be duplicates
+        if (r + 1 == m || !(total > 0.0))
+            break;
+        double target = rng.uniform() * total;
+        seed = -1;
+        for (int i = 0; i < n && seed < 0; ++i) {
+            target -= nearest[i] * nearest[i];
+            if (target < 0.0)
+                seed = i;
+        }
+        // Rounding left the target at the end of the scan: the last point still away from all
+        if (seed < 0) {
+            for (int i = n - 1; i >= 0 && seed < 0; --i) {
+                if (nearest[i] > 0.0)
+                    seed = i;
+            }
+        }
+    }
+
+    // Weights and spreads, from the members of each representative
+    const int size = static_cast<int>(coreset.representatives.size());
+    std::vector<std::vector<int>> members(size);
+    for (int i = 0; i < n; ++i)
+        members[coreset.assignment[i]].push_back(i);
+    coreset.weights.resize(size);
+    coreset.spread.assign(size, 0.0);
+    for (int r = 0; r < size; ++r) {
+        const int w = static_cast<int>(members[r].size());
+        coreset.weights[r] = w;
+        if (w < 2)
+            continue;
+        double sum = 0.0;
+        for (int p = 0; p < spread_pairs; ++p) {
+            const int i = rng.uniform_int(w);
+            int j = rng.uniform_int(w - 1);
+            if (j >= i)
+                ++j;
+            sum += params.distance(members[r][i], members[r][j]);
+        }
+        coreset.spread[r] = sum / spread_pairs;
+    }
+    return coreset;
+}
+
+Params CoarseToFine::coarse_params(const Params &params, Coreset &coreset, int budget) {
+    if (budget < 1) {
+        throw std::invalid_argument("CoarseToFine: the budget must be positive");
+    }
+    const int m = static_cast<int>(coreset.representatives.size());
+    const int n = params.n;
+
+    // Multiplicities, and the first copy of each representative
+    coreset.copies.resize(m);
+    std::vector<int> first(m + 1, 0);
+    for (int r = 0; r < m; ++r) {
+        const double scaled = budget >= n ? coreset.weights[r]
+                                          : std::round(static_cast<double>(coreset.weights[r]) * budget / n);
+        coreset.copies[r] = std::max(1, static_cast<int>(scaled));
+        first[r + 1] = first[r] + coreset.copies[r];
+    }
+    const int M = first[m];
+
+    Eigen::MatrixXd between(m, m);
+#pragma omp parallel for schedule(static)
+    for (int s = 0; s < m; ++s) {
+        for (int r = 0; r < m; ++r)
+            between(r, s) = params.distance(coreset.representatives[r], coreset.representatives[s]);
+    }
+
+    // Copies of duplicate points get half the smallest positive distance, not 0, whose log is -inf
+    double floor = 0.0;
+    bool found = false; // Whether any positive distance was seen
+    for (int s = 0; s < m; ++s) {
+        if (coreset.spread[s] > 0.0) {
+            floor = found ? std::min(floor, coreset.spread[s]) : coreset.spread[s];
+            found = true;
+        }
+        for (int r = 0; r < s; ++r) {
+            if (between(r, s) > 0.0) {
+                floor = found ? std::min(floor, between(r, s)) : between(r, s);
+                found = true;
+            }
+        }
+    }
+    floor = found ? floor / 2 : 1.0;
+
+    Eigen::MatrixXd D(M, M);
+#pragma omp parallel for schedule(static)
+    for (int s = 0; s < m; ++s) {
+        for (int r = 0; r < m; ++r) {
+            const double d = r == s ? std::max(coreset.spread[r], floor) : between(r, s);
+            D.block(first[r], first[s], coreset.copies[r], coreset.copies[s]).setConstant(d);
+        }
+        D.block(first[s], first[s], coreset.copies[s], coreset.copies[s]).diagonal().setZero();
+    }
+
+    Params coarse(params.delta1, params.alpha, params.beta, params.delta2, params.gamma, params.zeta, params.BI,
+                  params.NI, params.a, params.sigma, params.tau, std::move(D));
+    return coarse;
+}
+
+Eigen::VectorXi CoarseToFine::lift(const Coreset &coreset, const Eigen::VectorXi &coarse,
+                                   Eigen::VectorXi &representative_labels) {
+    const int m = static_cast<int>(coreset.representatives.size());
+    int M = 0;
+    for (const int c : coreset.copies)
+        M += c;
+    if (static_cast<int>(coreset.copies.size()) != m || coarse.size() != M) {
+        throw std::invalid_argument("CoarseToFine: the coarse partition must have one label per copy");
+    }
+    if (M > 0 && coarse.minCoeff() < 0) {
+        throw std::invalid_argument("CoarseToFine: the coarse partition has a negative label");
+    }
+
+    // Majority label of the copies of each representative; ties go to the label seen first
+    std::vector<int> counts(M > 0 ? coarse.maxCoeff() + 1 : 0, 0);
+    representative_labels.resize(m);
+    for (int r = 0, q = 0; r < m; ++r) {
+        int best = coarse(q), best_count = 0;
+        for (int c = 0; c < coreset.copies[r]; ++c) {
+            const int label = coarse(q + c);
+            if (++counts[label] > best_count) {
+                best = label;
+                best_count = counts[label];
+            }
+        }
+        for (int c = 0; c < coreset.copies[r]; ++c)
+            counts[coarse(q + c)] = 0;
+        representative_labels(r) = best;
+        q += coreset.copies[r];
+    }
+
+    // Labels of the points, compacted in order of first appearance
+    const int n = static_cast<int>(coreset.assignment.size());
+    std::vector<int> compact(counts.size(), -1);
+    int K = 0;
+    Eigen::VectorXi allocations(n);
+    for (int i = 0; i < n; ++i) {
+        int &label = compact[representative_labels(coreset.assignment[i])];
+        if (label < 0)
+            label = K++;
+        allocations(i) = label;
+    }
+    for (int r = 0; r < m; ++r) {
+        const int label = compact[representative_labels(r)];
+        representative_labels(r) = label;
+    }
+    return allocations;
+}
+
+CoarseToFine::Result CoarseToFine::run(const Params &params, const Options &options, Rng &rng) {
+    if (options.process != "DP" && options.process != "NGGP") {
+        throw std::invalid_argument("CoarseToFine: process must be \"DP\" or \"NGGP\"");
+    }
+    if (options.likelihood != "Natarajan" && options.likelihood != "Gamma") {
+        throw std::invalid_argument("CoarseToFine: likelihood must be \"Natarajan\" or \"Gamma\"");
+    }
+    if (options.periods.size() != 2 || options.periods[0] < 1 || options.periods[1] < 1) {
+        throw std::invalid_argument("CoarseToFine: need two positive periods (split-merge, Gibbs)");
+    }
+    if (options.representatives < 0 || options.budget < 0 || options.iterations < 1 || options.start_clusters < 0) {
+        throw std::invalid_argument("CoarseToFine: sizes must be non-negative and iterations positive");
+    }
+    const int n = params.n;
+    const int m = options.representatives > 0 ? options.representatives : std::min(n, 500);
+    const int budget = options.budget > 0 ? options.budget : std::min(n, 4 * m);
+
+    Result result;
+    const auto start_time = std::chrono::steady_clock::now();
+    Rng coreset_rng = rng.split();
+    result.coreset = coreset(params, m, options.spread_pairs, coreset_rng);
+    Params coarse = coarse_params(params, result.coreset, budget);
+    result.coreset_time =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+
+    // The stack of HyperparameterGrid, on the copies
+    coarse.BI = options.iterations;
+    coarse.NI = 0;
+    Rng gen = rng.split();
+    // The coarse chain starts from the k-medoids partition of the copies, as build_chain() suggests
+    InitialPartition::Options start_options;
+    start_options.K = options.start_clusters;
+    Rng start_rng = rng.split();
+    const std::vector<int> labels = InitialPartition::k_medoids(coarse, start_options, start_rng).labels;
+    const Eigen::VectorXi start = Eigen::Map<const Eigen::VectorXi>(labels.data(), coarse.n);
+    Data data(coarse, start);
+    std::unique_ptr<Likelihood> likelihood;
+    if (options.likelihood == "Gamma")
+        likelihood = std::make_unique<Gamma_likelihood>(data, coarse);
+    else
+        likelihood = std::make_unique<Natarajan_likelihood>(data, coarse);
+    RWMH u_sampler(coarse, data, true, 2.0, true, gen.split());
+    std::unique_ptr<Process> process;
+    if (options.process == "DP")
+        process = std::make_unique<DP>(data, coarse);
+    else
+        process = std::make_unique<NGGP>(data, coarse, u_sampler);
+    SplitMerge_LSS_SDDS split_merge(data, coarse, *likelihood, *process, true, gen.split());
+    Neal3 gibbs(data, coarse, *likelihood, *process, gen.split());
+
+    const bool has_u = options.process == "NGGP";
+    ChainRunner runner(data, *process, {&split_merge, &gibbs}, options.periods, has_u ? &u_sampler : nullptr);
+    int K = 0;
+    double U = 0.0;
+    // Thinning by the run length keeps the last partition alone
+    result.chain_time = runner.run(options.iterations, 0, options.iterations, nullptr, &K, &U);
+
+    result.allocations = lift(result.coreset, data.get_allocations(), result.coarse_allocations);
+    result.K = result.allocations.size() > 0 ? result.allocations.maxCoeff() + 1 : 0;
+    return result;
+}
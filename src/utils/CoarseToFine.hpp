@@ -0,0 +1,121 @@
+/**
+ * @file CoarseToFine.hpp
+ * @brief Starting partition for large n from a short chain on a weighted coreset of the points
+ *
+ * @author Filippo Galli
+ * @date 2025
+ */
+
+#pragma once
+
+#include "Params.hpp"
+#include "Rng.hpp"
+#include <Eigen/Dense>
+#include <string>
+#include <vector>
+
+/**
+ * @class CoarseToFine
+ * @brief Runs the model on a few representatives standing for all the points, then lifts the result
+ *
+ * On large n most of the burn-in of the full chain is spent finding the coarse structure, at O(n)
+ * distance reads per point and move. Here that structure is found on m << n points first:
+ * - coreset(): m representatives are seeded by D^2 sampling (each new one drawn with probability
+ *   proportional to the squared distance to the closest representative so far) and every point
+ *   joins its closest one. The weight w_r of a representative is the number of points it stands
+ *   for, its spread the mean distance between two of them (estimated on a few random pairs);
+ * - coarse_params(): the weights enter the model as multiplicities. Representative r becomes c_r
+ *   copies, c_r proportional to w_r for a budget of M points (c_r = w_r when M >= n), at distance
+ *   spread_r from each other and d(r, s) from the copies of s. The likelihood and the process of
+ *   the M points then see a cluster of representatives as a cluster of the points it stands for,
+ *   scaled to M: its size is the sum of the multiplicities, its pairs those between and within
+ *   the groups of copies. Nothing of the model changes, so any process and sampler run on it;
+ * - run(): a short chain of the chosen likelihood and process (SplitMerge_LSS_SDDS and Neal3, as
+ *   build_chain() without modules) on the M points, started from their k-medoids partition
+ *   (InitialPartition), whose last partition is lifted: each representative takes the label of
+ *   most of its copies, each point that of its representative.
+ *
+ * The lifted partition is a starting point for the full chain (initial_allocations), not a
+ * posterior sample: with M < n the coarse posterior is that of a smaller data set, flatter than the
+ * full one, and the copies of a representative split only as a block of similar points does. The
+ * full chain corrects both; it starts close to the posterior mode rather than from one cluster, so
+ * it needs a fraction of the burn-in. The coreset reads O(n m) distances through Params::distance(),
+ * on any storage, and the coarse chain costs what a chain on M points does.
+ *
+ * Reference: Arthur, D., Vassilvitskii, S. (2007) "k-means++: the advantages of careful seeding";
+ * Bachem, O., Lucic, M., Krause, A. (2017) "Practical coreset constructions for machine learning"
+ */
+class CoarseToFine {
+public:
+    /** @brief Options of the coarse stage */
+    struct Options {
+        std::string process = "NGGP";         ///< "DP" or "NGGP"
+        std::string likelihood = "Natarajan"; ///< "Natarajan" or "Gamma"
+        int representatives = 0;              ///< Coreset size m (0: min(n, 500))
+        int budget = 0;                       ///< Points M of the coarse chain (0: min(n, 4 m))
+        int iterations = 200;                 ///< Iterations of the coarse chain
+        int start_clusters = 0;               ///< K of its k-medoids start (0: InitialPartition default)
+        std::vector<int> periods = {1, 25};   ///< Periods of SplitMerge_LSS_SDDS and Neal3
+        int spread_pairs = 16;                ///< Pairs of members sampled for each spread
+    };
+
+    /** @brief Representatives of the points */
+    struct Coreset {
+        std::vector<int> representatives; ///< Point of each representative
+        std::vector<int> weights;         ///< Points each representative stands for
+        std::vector<double> spread;       ///< Mean distance between two of those points (0: one point)
+        std::vector<int> assignment;      ///< Representative of each point
+        std::vector<int> copies;          ///< Multiplicity in the coarse chain (set by coarse_params())
+    };
+
+    /** @brief Outcome of run() */
+    struct Result {
+        Eigen::VectorXi allocations;        ///< Lifted partition of the n points, 0-based labels
+        Eigen::VectorXi coarse_allocations; ///< Label of each representative
+        int K = 0;                          ///< Number of clusters
+        Coreset coreset;                    ///< Representatives and their multiplicities
+        double coreset_time = 0.0;          ///< Wall time of the coreset, in seconds
+        double chain_time = 0.0;            ///< Wall time of the coarse chain, in seconds
+    };
+
+    /**
+     * @brief Seeds the representatives and assigns every point to its closest one
+     * @param params Parameters holding the n x n distances
+     * @param representatives Number m of representatives (at most n)
+     * @param spread_pairs Pairs of members sampled for each spread
+     * @param rng Generator of the seeding and of the pairs
+     * @return Coreset of min(m, n) representatives, fewer if the distances tie (duplicate points)
+     * @throws std::invalid_argument if there are no points, m < 1 or spread_pairs < 1
+     */
+    static Coreset coreset(const Params &params, int representatives, int spread_pairs, Rng &rng);
+
+    /**
+     * @brief Distances of the copies of the representatives
+     * @param params Parameters of the full chain; the scalars are copied
+     * @param coreset Representatives; their copies are set
+     * @param budget Total number of copies M to aim at (at least one per representative)
+     * @return Params of sum_r c_r points, the copies of each representative contiguous
+     * @throws std::invalid_argument if budget < 1
+     */
+    static Params coarse_params(const Params &params, Coreset &coreset, int budget);
+
+    /**
+     * @brief Partition of the points from one of the copies
+     * @param coreset Representatives, with their copies
+     * @param coarse Label of each copy, in the order of coarse_params()
+     * @param representative_labels Set to the label of each representative
+     * @return Label of each point, relabelled 0..K-1 in order of first appearance
+     * @throws std::invalid_argument if coarse has a wrong size or a negative label
+     */
+    static Eigen::VectorXi lift(const Coreset &coreset, const Eigen::VectorXi &coarse,
+                                Eigen::VectorXi &representative_labels);
+
+    /**
+     * @brief Coreset, coarse chain and lift
+     * @param params Parameters of the full chain (distances and hyperparameters)
+     * @param options Options of the coarse stage
+     * @param rng Master generator; the coreset and the chain streams are split off it
+     * @throws std::invalid_argument if the process, likelihood, periods or sizes are not as documented
+     */
+    static Result run(const Params &params, const Options &options, Rng &rng);
+};
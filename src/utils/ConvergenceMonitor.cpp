@@ -0,0 +1,267 @@
+/**
+ * @file ConvergenceMonitor.cpp
+ * @brief Implementation of the ConvergenceMonitor class
+ */
+
+#include "ConvergenceMonitor.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <exception>
+#include <limits>
+#include <stdexcept>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+ConvergenceMonitor::ConvergenceMonitor(std::vector<Chain> chains_, const Options &options_)
+    : chains(std::move(chains_)), options(options_) {
+    if (chains.empty()) {
+        throw std::invalid_argument("ConvergenceMonitor: need at least one chain");
+    }
+    for (const Chain &chain : chains) {
+        if (chain.runner.get_data().get_n() != chains[0].runner.get_data().get_n()) {
+            throw std::invalid_argument("ConvergenceMonitor: every chain must have the same number of points");
+        }
+    }
+    if (options.check_every < 1 || options.min_burn_in < 0) {
+        throw std::invalid_argument("ConvergenceMonitor: check_every must be positive and min_burn_in non-negative");
+    }
+    if (!(options.rhat_max >= 1.0) || !(options.min_ess >= 0.0) || !(options.target_ess >= 0.0)) {
+        throw std::invalid_argument("ConvergenceMonitor: rhat_max must be at least 1 and the sample sizes non-negative");
+    }
+    for (Chain &chain : chains) {
+        if (chain.likelihood)
+            chain.runner.track_log_likelihood(chain.likelihood);
+    }
+}
+
+double ConvergenceMonitor::split_rhat(const std::vector<const double *> &traces, size_t length) {
+    const size_t m = length / 2;
+    const int J = 2 * static_cast<int>(traces.size());
+
+    // Mean and variance of each half
+    std::vector<double> means(J), variances(J);
+    for (int h = 0; h < J; ++h) {
+        const double *half = traces[h / 2] + (h % 2 == 0 ? 0 : length - m);
+        double mean = 0.0;
+        for (size_t t = 0; t < m; ++t)
+            mean += half[t];
+        mean /= static_cast<double>(m);
+        double var = 0.0;
+        for (size_t t = 0; t < m; ++t)
+            var += (half[t] - mean) * (half[t] - mean);
+        means[h] = mean;
+        variances[h] = var / static_cast<double>(m - 1);
+    }
+
+    double W = 0.0, grand_mean = 0.0;
+    for (int h = 0; h < J; ++h) {
+        W += variances[h];
+        grand_mean += means[h];
+    }
+    W /= J;
+    grand_mean /= J;
+    double B = 0.0;
+    for (int h = 0; h < J; ++h)
+        B += (means[h] - grand_mean) * (means[h] - grand_mean);
+    B *= static_cast<double>(m) / (J - 1);
+
+    if (W <= 0.0)
+        return B <= 0.0 ? 1.0 : std::numeric_limits<double>::infinity();
+    const double var_plus = (static_cast<double>(m) - 1.0) / static_cast<double>(m) * W + B / static_cast<double>(m);
+    return std::sqrt(var_plus / W);
+}
+
+double ConvergenceMonitor::trace_ess(const double *trace, size_t length) {
+    const size_t b = static_cast<size_t>(std::sqrt(static_cast<double>(length)));
+    const size_t B = b > 0 ? length / b : 0;
+    if (B < 2)
+        return 0.0;
+
+    // Complete batches only: the first B b values
+    const size_t N = B * b;
+    double mean = 0.0;
+    for (size_t t = 0; t < N; ++t)
+        mean += trace[t];
+    mean /= static_cast<double>(N);
+    double var = 0.0;
+    for (size_t t = 0; t < N; ++t)
+        var += (trace[t] - mean) * (trace[t] - mean);
+    var /= static_cast<double>(N - 1);
+
+    double batch_var = 0.0;
+    for (size_t k = 0; k < B; ++k) {
+        double batch_mean = 0.0;
+        for (size_t t = k * b; t < (k + 1) * b; ++t)
+            batch_mean += trace[t];
+        batch_mean /= static_cast<double>(b);
+        batch_var += (batch_mean - mean) * (batch_mean - mean);
+    }
+    batch_var /= static_cast<double>(B - 1);
+
+    if (batch_var <= 0.0 || var <= 0.0)
+        return 0.0;
+    return static_cast<double>(N) * var / (static_cast<double>(b) * batch_var);
+}
+
+bool ConvergenceMonitor::statistics(int q, size_t first, double &rhat, double &ess) const {
+    rhat = ess = std::numeric_limits<double>::quiet_NaN();
+    if (samples[q][0].size() < first + 4)
+        return false;
+    const size_t length = samples[q][0].size() - first;
+
+    std::vector<const double *> traces(size());
+    bool constant = true;
+    const double value = samples[q][0][first];
+    for (int c = 0; c < size(); ++c) {
+        traces[c] = samples[q][c].data() + first;
+        for (size_t t = 0; t < length && constant; ++t)
+            constant = traces[c][t] == value;
+    }
+
+    if (constant) {
+        rhat = 1.0;
+        ess = static_cast<double>(length) * size();
+        return true;
+    }
+    rhat = split_rhat(traces, length);
+    ess = 0.0;
+    for (int c = 0; c < size(); ++c)
+        ess += trace_ess(traces[c], length);
+    return true;
+}
+
+double ConvergenceMonitor::run(int BI, int NI, int thin, const std::vector<int *> &allocations_out,
+                               const std::vector<int *> &K_out, const std::vector<double *> &U_out,
+                               const std::vector<double *> &log_posterior_out, int n_threads,
+                               const std::function<void(int, int)> &on_progress) {
+    const int M = size();
+    const int n = chains[0].runner.get_data().get_n();
+    const int n_saved = ChainRunner::n_saved(BI, NI, thin);
+
+#ifdef _OPENMP
+    if (n_threads <= 0)
+        n_threads = omp_get_max_threads();
+#else
+    n_threads = 1;
+#endif
+
+    report = Report();
+    report.burn_in_rhat.fill(std::numeric_limits<double>::quiet_NaN());
+    report.burn_in_ess.fill(std::numeric_limits<double>::quiet_NaN());
+    report.monitored[CLUSTERS] = true;
+    report.monitored[U_VALUE] = report.monitored[LOG_POSTERIOR] = true;
+    for (Chain &chain : chains) {
+        report.monitored[U_VALUE] = report.monitored[U_VALUE] && chain.runner.get_u_sampler();
+        report.monitored[LOG_POSTERIOR] =
+            report.monitored[LOG_POSTERIOR] && chain.likelihood && chain.runner.get_process().has_log_prior();
+    }
+    for (int q = 0; q < n_quantities; ++q) {
+        samples[q].assign(M, std::vector<double>());
+        for (std::vector<double> &trace : samples[q])
+            trace.reserve(report.monitored[q] ? n_saved : 0);
+    }
+
+    const auto start_time = std::chrono::steady_clock::now();
+    std::vector<std::exception_ptr> errors(M);
+
+    bool in_burn_in = BI > 0;
+    size_t first_after = 0; // Samples recorded before the end of the burn-in
+    int end = BI + NI;      // Last iteration, moved once the burn-in ends
+    for (int start = 1; start <= end;) {
+        int block_end = std::min(start + options.check_every - 1, end);
+        if (in_burn_in)
+            block_end = std::min(block_end, BI);
+
+#pragma omp parallel for schedule(dynamic, 1) num_threads(n_threads)
+        for (int c = 0; c < M; ++c) {
+            // Exceptions must not escape the parallel region
+            try {
+                ChainRunner &runner = chains[c].runner;
+                const NodeAffinity pin(runner.get_data().get_params().distance_node());
+                for (int i = start; i <= block_end; ++i) {
+                    runner.iterate(i);
+                    if (i % thin != 0)
+                        continue;
+
+                    const int saved = i / thin - 1;
+                    const Data &data = runner.get_data();
+                    const Eigen::VectorXi &allocations = data.get_allocations();
+                    if (allocations_out[c])
+                        std::copy(allocations.data(), allocations.data() + n,
+                                  allocations_out[c] + static_cast<size_t>(saved) * n);
+                    K_out[c][saved] = data.get_K();
+                    if (runner.get_u_sampler())
+                        U_out[c][saved] = runner.get_u_sampler()->get_U();
+                    const double log_posterior =
+                        chains[c].likelihood ? runner.log_posterior() : std::numeric_limits<double>::quiet_NaN();
+                    log_posterior_out[c][saved] = log_posterior;
+
+                    samples[CLUSTERS][c].push_back(data.get_K());
+                    if (report.monitored[U_VALUE])
+                        samples[U_VALUE][c].push_back(U_out[c][saved]);
+                    if (report.monitored[LOG_POSTERIOR])
+                        samples[LOG_POSTERIOR][c].push_back(log_posterior);
+                }
+            } catch (...) {
+                errors[c] = std::current_exception();
+            }
+        }
+        for (const std::exception_ptr &error : errors) {
+            if (error)
+                std::rethrow_exception(error);
+        }
+        const size_t recorded = samples[CLUSTERS][0].size();
+
+        if (in_burn_in) {
+            // Second half of the burn-in so far
+            bool converged = block_end >= options.min_burn_in;
+            for (int q = 0; q < n_quantities; ++q) {
+                if (!report.monitored[q])
+                    continue;
+                const bool enough = statistics(q, recorded / 2, report.burn_in_rhat[q], report.burn_in_ess[q]);
+                converged = converged && enough && report.burn_in_rhat[q] <= options.rhat_max &&
+                            report.burn_in_ess[q] >= options.min_ess;
+            }
+
+            if (converged || block_end == BI) {
+                in_burn_in = false;
+                report.burn_in = block_end;
+                report.burn_in_converged = converged;
+                end = block_end + NI;
+                first_after = recorded;
+                for (Chain &chain : chains) {
+                    if (chain.runner.get_u_sampler())
+                        chain.runner.get_u_sampler()->reset_diagnostics(); // Efficiency of U after the burn-in only
+                }
+            }
+        } else if (options.target_ess > 0 && block_end < end) {
+            bool reached = true;
+            for (int q = 0; q < n_quantities && reached; ++q) {
+                double rhat, ess;
+                if (report.monitored[q])
+                    reached = statistics(q, first_after, rhat, ess) && ess >= options.target_ess;
+            }
+            if (reached) {
+                report.target_reached = true;
+                end = block_end;
+            }
+        }
+
+        if (on_progress)
+            on_progress(block_end, end);
+        start = block_end + 1;
+    }
+
+    report.iterations = end - report.burn_in;
+    for (int q = 0; q < n_quantities; ++q) {
+        if (report.monitored[q])
+            statistics(q, first_after, report.rhat[q], report.ess[q]);
+        else
+            report.rhat[q] = report.ess[q] = std::numeric_limits<double>::quiet_NaN();
+    }
+
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+}
@@ -0,0 +1,152 @@
+/**
+ * @file ConvergenceMonitor.hpp
+ * @brief Multi-chain driver checking split-R-hat and effective sample sizes while it runs
+ *
+ * @author Filippo Galli
+ * @date 2025
+ */
+
+#pragma once
+
+#include "ChainRunner.hpp"
+#include "Likelihood.hpp"
+#include <array>
+#include <functional>
+#include <vector>
+
+/**
+ * @class ConvergenceMonitor
+ * @brief Runs independent chains in blocks on OpenMP threads, ending the burn-in and the run on convergence
+ *
+ * The chains run check_every iterations at a time, one per thread (pinned to the cores of the NUMA
+ * node of their distances, see Params::distance_node()), and every thin-th iteration
+ * each chain records K, U and the log-posterior (ChainRunner::log_posterior(), from the running
+ * log-likelihood the samplers keep up to date) next to its samples. Between blocks, on the calling thread:
+ * - during the burn-in, the second half of the samples recorded so far is checked: the burn-in ends
+ *   once every monitored quantity has a split-R-hat of at most rhat_max across the chains and a
+ *   batch-means effective sample size (summed over the chains) of at least min_ess;
+ * - after the burn-in, the run stops once every monitored quantity reaches target_ess effective
+ *   samples after the burn-in (if target_ess > 0).
+ * The burn-in ends at BI otherwise, and the run after BI + NI iterations. All the chains share the
+ * end of their burn-in and their number of iterations.
+ *
+ * The split-R-hat is that of Gelman et al. (2013): each chain is cut in two halves and the
+ * potential scale reduction of the 2 M halves is sqrt(((m - 1) / m W + B / m) / W), for halves of m
+ * samples with within-half variance W and between-half variance B (of the means, times m). The
+ * effective sample sizes are batch-means estimates with batches of sqrt(N) of the N samples of
+ * each chain (Flegal and Jones, 2010), summed over the chains: unlike OnlineESS, whose batches
+ * start at one value, they are not inflated on the short windows of the first checks. A chain
+ * stuck at one value counts for none, unless every chain holds that same value (the quantity is
+ * then taken as converged, with one effective sample per sample). A quantity is only monitored if
+ * every chain has it: U needs a U sampler, the log-posterior a likelihood and a process with a
+ * closed-form prior of the partition (Process::log_prior()).
+ *
+ * Reference: Gelman, A. et al. (2013) "Bayesian Data Analysis", 3rd ed., section 11.4;
+ * Flegal, J. M., Jones, G. L. (2010) "Batch means and spectral variance estimators in Markov chain Monte Carlo"
+ */
+class ConvergenceMonitor {
+public:
+    /** @brief Quantities monitored */
+    enum Quantity { CLUSTERS = 0, U_VALUE = 1, LOG_POSTERIOR = 2 };
+    static constexpr int n_quantities = 3;
+
+    /** @brief One chain */
+    struct Chain {
+        ChainRunner runner;                     ///< Stack of the chain (Data, Process, samplers)
+        const Likelihood *likelihood = nullptr; ///< Untempered likelihood of the log-posterior; may be nullptr
+    };
+
+    /** @brief Stopping rules */
+    struct Options {
+        int check_every = 100;  ///< Iterations between checks
+        double rhat_max = 1.05; ///< Largest split-R-hat ending the burn-in
+        double min_ess = 100;   ///< Smallest effective sample size ending the burn-in (second half of it)
+        double target_ess = 0;  ///< Effective sample size after the burn-in ending the run (0: never)
+        int min_burn_in = 0;    ///< Iterations before the burn-in can end
+    };
+
+    /** @brief Outcome of a run */
+    struct Report {
+        int burn_in = 0;                ///< Burn-in iterations run
+        int iterations = 0;             ///< Iterations run after the burn-in
+        bool burn_in_converged = false; ///< Whether the burn-in ended on the thresholds, not at BI
+        bool target_reached = false;    ///< Whether the run ended on target_ess, not at BI + NI
+        std::array<bool, n_quantities> monitored{};    ///< Quantities every chain has
+        std::array<double, n_quantities> rhat{};       ///< Split-R-hat after the burn-in
+        std::array<double, n_quantities> ess{};        ///< Effective sample size after the burn-in
+        std::array<double, n_quantities> burn_in_rhat{}; ///< Split-R-hat at the last burn-in check
+        std::array<double, n_quantities> burn_in_ess{};  ///< Effective sample size at the last burn-in check
+    };
+
+private:
+    std::vector<Chain> chains;
+    Options options;
+    Report report;
+
+    /** @brief samples[q][c]: values of quantity q recorded by chain c, one per saved iteration */
+    std::array<std::vector<std::vector<double>>, n_quantities> samples;
+
+    /**
+     * @brief Split-R-hat and effective sample size of quantity q on the samples [first, end) of every chain
+     * @return false if there are too few samples for the statistics (4 per chain)
+     */
+    bool statistics(int q, size_t first, double &rhat, double &ess) const;
+
+public:
+    /**
+     * @brief Constructor
+     * @param chains_ Chains, at least one, all with the same number of points
+     * @param options_ Stopping rules
+     * @throws std::invalid_argument if there are no chains, their sizes differ or the options are invalid
+     *
+     * @details The runners of the chains with a likelihood track its log-likelihood.
+     */
+    ConvergenceMonitor(std::vector<Chain> chains_, const Options &options_);
+
+    /**
+     * @brief Runs the chains, writing their thinned traces
+     * @param BI Largest number of burn-in iterations
+     * @param NI Largest number of iterations after the burn-in
+     * @param thin Thinning interval of the stored traces
+     * @param allocations_out Per chain, a buffer of n * n_saved ints or nullptr
+     *        (n_saved = ChainRunner::n_saved(BI, NI, thin), of which the first get_report().burn_in
+     *        + get_report().iterations iterations are filled)
+     * @param K_out Per chain, a buffer of n_saved ints for the number of clusters
+     * @param U_out Per chain, a buffer of n_saved doubles for U (left untouched without a U sampler)
+     * @param log_posterior_out Per chain, a buffer of n_saved doubles for the log-posterior (NaN without a likelihood)
+     * @param n_threads Number of threads (0 = OpenMP default)
+     * @param on_progress Optional callback invoked after each check, on the calling thread, with the
+     *        iteration and the last iteration of the run (BI + NI until the burn-in ends); get_report()
+     *        then holds the burn-in once it has ended
+     * @return Elapsed wall time in seconds
+     *
+     * @details The iterations are numbered from 1 over the whole run, as in ChainRunner::run(), so a
+     * sample is stored every thin-th iteration before and after the end of the burn-in.
+     */
+    double run(int BI, int NI, int thin, const std::vector<int *> &allocations_out, const std::vector<int *> &K_out,
+               const std::vector<double *> &U_out, const std::vector<double *> &log_posterior_out,
+               int n_threads = 0, const std::function<void(int, int)> &on_progress = {});
+
+    /** @brief Number of chains */
+    int size() const { return static_cast<int>(chains.size()); }
+
+    /** @brief Outcome of the last run() */
+    const Report &get_report() const { return report; }
+
+    /**
+     * @brief Split-R-hat of several chains
+     * @param traces One trace per chain
+     * @param length Values of each trace, at least 4 (an odd middle value is dropped)
+     * @return The estimate; 1 if every value is the same, infinity if only the halves are constant
+     */
+    static double split_rhat(const std::vector<const double *> &traces, size_t length);
+
+    /**
+     * @brief Batch-means effective sample size of one trace
+     * @param trace Values of the trace
+     * @param length Number of values
+     * @return N var(x) / (b var(batch means)) on B batches of b = floor(sqrt(length)) values, N = B b;
+     * 0 if it cannot be estimated (constant trace, fewer than 2 batches)
+     */
+    static double trace_ess(const double *trace, size_t length);
+};
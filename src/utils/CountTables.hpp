@@ -0,0 +1,162 @@
+/**
+ * @file CountTables.hpp
+ * @brief Shared tables of log and lgamma at integer counts
+ *
+ * The priors, modules and likelihoods all evaluate log(offset + step m) or
+ * lgamma(offset + step m) at cluster sizes and counts m. This file defines CountTable, an
+ * immutable table of those values for m = 0, ..., size - 1, and CountTables, the registry that
+ * builds each table once per (function, offset, step) and hands out shared views of it.
+ *
+ * @author Filippo Galli
+ * @date 2025
+ */
+
+#pragma once
+
+#include <cmath>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <tuple>
+#include <vector>
+
+/**
+ * @class CountTable
+ * @brief View of f(offset + step m) for integer m, f = log or lgamma
+ *
+ * Copies share the underlying values. Counts past the end of the table (or a default-constructed,
+ * empty view) are evaluated directly, so indexing is always valid for m >= 0.
+ */
+class CountTable {
+public:
+    /** @brief Tabulated function */
+    enum class Function { Log, Lgamma };
+
+private:
+    Function function = Function::Log;                 ///< Tabulated function
+    double offset = 0.0;                               ///< Value of the argument at m = 0
+    double step = 1.0;                                 ///< Increment of the argument per count
+    std::shared_ptr<const std::vector<double>> values; ///< Shared values (nullptr: empty view)
+    const double *data = nullptr;                      ///< values->data()
+    int size = 0;                                      ///< Number of tabulated counts
+
+public:
+    CountTable() = default;
+
+    /**
+     * @brief Tabulates f(offset + step m) for m = 0, ..., size - 1
+     * @param function Tabulated function
+     * @param offset Value of the argument at m = 0
+     * @param step Increment of the argument per count
+     * @param size Number of tabulated counts
+     */
+    CountTable(Function function, double offset, double step, int size)
+        : function(function), offset(offset), step(step), size(size) {
+        auto table = std::make_shared<std::vector<double>>(size);
+        for (int m = 0; m < size; ++m)
+            (*table)[m] = evaluate(m);
+        values = std::move(table);
+        data = values->data();
+    }
+
+    /**
+     * @brief View of values tabulated elsewhere
+     * @param function Tabulated function
+     * @param offset Value of the argument at m = 0
+     * @param step Increment of the argument per count
+     * @param values Values of f(offset + step m) for m = 0, ..., values->size() - 1
+     */
+    CountTable(Function function, double offset, double step, std::shared_ptr<const std::vector<double>> values)
+        : function(function), offset(offset), step(step), values(std::move(values)), data(this->values->data()),
+          size(static_cast<int>(this->values->size())) {}
+
+    /** @brief Shared values of the table */
+    const std::shared_ptr<const std::vector<double>> &get_values() const { return values; }
+
+    /**
+     * @brief f(offset + step m), computed without the table
+     * @param m Count
+     */
+    double evaluate(int m) const {
+        const double x = offset + step * m;
+        return function == Function::Log ? std::log(x) : std::lgamma(x);
+    }
+
+    /**
+     * @brief f(offset + step m)
+     * @param m Count, m >= 0
+     */
+    double operator[](int m) const { return m < size ? data[m] : evaluate(m); }
+
+    /** @brief Number of tabulated counts */
+    int get_size() const { return size; }
+
+    /** @brief Value of the argument at m = 0 */
+    double get_offset() const { return offset; }
+
+    /** @brief Increment of the argument per count */
+    double get_step() const { return step; }
+};
+
+/**
+ * @class CountTables
+ * @brief Registry of CountTable, one per (function, offset, step)
+ *
+ * Everything built with the same hyperparameters gets the same values: the first request builds
+ * the table, the following ones share it. Entries are held weakly, so the tables of a parameter
+ * set that is no longer used (e.g. after the discount of a process changed) are freed with their
+ * last holder. A request for more counts than an existing table holds rebuilds it larger.
+ *
+ * Thread safe; lookups are meant for construction and parameter updates, not for the hot loops,
+ * which index the CountTable they hold.
+ */
+class CountTables {
+private:
+    using Key = std::tuple<int, double, double>;
+
+    std::map<Key, std::weak_ptr<const std::vector<double>>> tables; ///< Values of the registered tables
+
+    CountTables() = default;
+
+public:
+    /** @brief The process-wide registry */
+    static CountTables &shared() {
+        static CountTables registry;
+        return registry;
+    }
+
+    /**
+     * @brief Returns the table of f(offset + step m), building it if needed
+     * @param function Tabulated function
+     * @param offset Value of the argument at m = 0
+     * @param step Increment of the argument per count
+     * @param size Minimum number of tabulated counts (usually n + 1)
+     */
+    CountTable get(CountTable::Function function, double offset, double step, int size) {
+        const Key key(static_cast<int>(function), offset, step);
+        CountTable result;
+#pragma omp critical(count_tables)
+        {
+            std::shared_ptr<const std::vector<double>> values = tables[key].lock();
+            if (values && static_cast<int>(values->size()) >= size) {
+                result = CountTable(function, offset, step, values);
+            } else {
+                result = CountTable(function, offset, step, size);
+                tables[key] = result.get_values();
+            }
+
+            // Drop the entries whose tables are no longer held
+            for (auto it = tables.begin(); it != tables.end();)
+                it = it->second.expired() ? tables.erase(it) : std::next(it);
+        }
+        return result;
+    }
+
+    /** @brief Shorthand for get(CountTable::Function::Log, ...) */
+    CountTable log(double offset, double step, int size) { return get(CountTable::Function::Log, offset, step, size); }
+
+    /** @brief Shorthand for get(CountTable::Function::Lgamma, ...) */
+    CountTable lgamma(double offset, double step, int size) {
+        return get(CountTable::Function::Lgamma, offset, step, size);
+    }
+};
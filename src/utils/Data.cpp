@@ -5,7 +5,10 @@
 
 #include "Data.hpp"
 #include "Eigen/src/Core/Matrix.h"
+#include <algorithm>
 #include <iostream>
+#include <stdexcept>
+#include <string>
 
 Data::Data(const Params &p, const Eigen::VectorXi &initial_allocations) : params(p), allocations(initial_allocations) {
 
@@ -21,13 +24,24 @@ Data::Data(const Params &p, const Eigen::VectorXi &initial_allocations) : params
     // Find the maximum cluster index to determine K
     K = allocations.maxCoeff() + 1;
 
-    // Allocate cluster mapping
+    // Allocate cluster members
+    cluster_members.resize(K > 0 ? K : 0);
     for (int i = 0; i < params.n; ++i) {
         int cluster_id = allocations(i);
         if (cluster_id >= 0) {
             cluster_members[cluster_id].push_back(i);
         }
     }
+    index_members();
+}
+
+void Data::index_members() {
+    member_position.assign(params.n, -1);
+    for (const auto &members : cluster_members) {
+        for (size_t j = 0; j < members.size(); ++j) {
+            member_position[members[j]] = static_cast<int>(j);
+        }
+    }
 }
 
 double Data::get_distance(int i, int j) const {
@@ -37,23 +51,18 @@ double Data::get_distance(int i, int j) const {
     }
 #endif
 
-    return params.D(i, j);
+    return params.distance(i, j);
 }
 
-Eigen::VectorXi Data::get_cluster_assignments(int cluster) const {
+Eigen::Map<const Eigen::VectorXi> Data::get_cluster_assignments(int cluster) const {
 #if VERBOSITY_LEVEL >= 1
     if (cluster > K || cluster < 0) {
         throw std::out_of_range("Index out of bounds in get_cluster_assignments");
     }
 #endif
 
-    // Check if the cluster exists in the map before accessing it
-    if (cluster >= K || cluster < 0) {
-        return Eigen::VectorXi::Zero(0); // Return empty vector for non-existent clusters
-    }
-
-    const auto &it = cluster_members.at(cluster);
-    return Eigen::Map<const Eigen::VectorXi>(it.data(), static_cast<Eigen::Index>(it.size()));
+    // Non-existent clusters give an empty view
+    return cluster_members_view(cluster_members, cluster < K ? cluster : -1);
 }
 
 Eigen::Map<const Eigen::VectorXi> Data::get_cluster_assignments_ref(int cluster) const {
@@ -63,14 +72,7 @@ Eigen::Map<const Eigen::VectorXi> Data::get_cluster_assignments_ref(int cluster)
     }
 #endif
 
-    // Check if the cluster exists in the map before accessing it
-    if (cluster >= K || cluster < 0) {
-        static const int dummy_value = 0;
-        return Eigen::Map<const Eigen::VectorXi>(&dummy_value, 0);
-    }
-    const auto &it = cluster_members.at(cluster);
-
-    return Eigen::Map<const Eigen::VectorXi>(it.data(), static_cast<Eigen::Index>(it.size()));
+    return cluster_members_view(cluster_members, cluster < K ? cluster : -1);
 }
 
 void Data::compact_cluster(int old_cluster) {
@@ -82,31 +84,18 @@ void Data::compact_cluster(int old_cluster) {
 
     const int last_cluster = K - 1;
 
-    // If compacting the last cluster (or the only cluster), this is a pure deletion.
-    if (K <= 1 || old_cluster == last_cluster) {
-        cluster_members.erase(old_cluster);
-        K--;
-        return;
-    }
-
-    auto last_cluster_it = cluster_members.find(last_cluster);
-    bool last_cluster_exists = (last_cluster_it != cluster_members.end());
-
-    // Shift allocations of the last cluster to the old cluster
-    if (last_cluster_exists && !last_cluster_it->second.empty()) {
-        for (int point_index : last_cluster_it->second) {
+    // The last cluster takes the place of the removed one; compacting the last
+    // cluster (or the only one) is a pure deletion
+    if (K > 1 && old_cluster != last_cluster) {
+        for (int point_index : cluster_members[last_cluster]) {
             allocations(point_index) = old_cluster;
         }
-
-        // Move members of the last cluster to the old cluster using move semantics
-        cluster_members[old_cluster] = std::move(last_cluster_it->second);
-    } else {
-        // Last cluster is empty or doesn't exist, just clear the old cluster
-        cluster_members[old_cluster].clear();
+        // Positions inside the member list are unchanged by the swap
+        cluster_members[old_cluster].swap(cluster_members[last_cluster]);
     }
 
-    // Remove the last cluster
-    cluster_members.erase(last_cluster);
+    // Keep the emptied list, so that the next new cluster does not allocate
+    retire_last_members();
     K--; // Decrease the number of clusters
 }
 
@@ -132,29 +121,14 @@ void Data::set_allocation_wo_compaction(int index, int cluster) {
         return;
     }
 
-    auto old_cluster_it = cluster_members.end();
-    bool old_cluster_exists = false;
-
-    // Check if old_cluster exists in the map
+    // Remove from old cluster first (if applicable): swap with the last member, O(1)
     if (old_cluster != -1) {
-        old_cluster_it = cluster_members.find(old_cluster);
-        old_cluster_exists = (old_cluster_it != cluster_members.end());
-
-#if VERBOSITY_LEVEL >= 1
-        if (!old_cluster_exists) {
-            throw std::runtime_error("Inconsistent state: old_cluster not found in cluster_members");
-        }
-#endif
-    }
-
-    // Remove from old cluster first (if applicable)
-    if (old_cluster_exists) {
-        auto &old_members = old_cluster_it->second;
-        // Use find + erase instead of remove + erase for single element (more efficient)
-        auto it = std::find(old_members.begin(), old_members.end(), index);
-        if (it != old_members.end()) {
-            old_members.erase(it);
-        }
+        auto &old_members = cluster_members[old_cluster];
+        const int pos = member_position[index];
+        const int moved = old_members.back();
+        old_members[pos] = moved;
+        member_position[moved] = pos;
+        old_members.pop_back();
     }
 
     // Update allocation
@@ -162,34 +136,126 @@ void Data::set_allocation_wo_compaction(int index, int cluster) {
 
     // Handle new cluster assignment
     if (cluster == -1) {
-        // Point becomes unallocated - nothing more to do after removal above
-    } else if (cluster == K) {
-        // New cluster creation
-        cluster_members[K].push_back(index);
-        K++;
-    } else {
-        // Existing cluster assignment - cache the target cluster iterator
-        auto target_cluster_it = cluster_members.find(cluster);
-        if (target_cluster_it != cluster_members.end()) {
-            target_cluster_it->second.push_back(index);
+        // Point becomes unallocated
+        member_position[index] = -1;
+        return;
+    }
+    if (cluster == K) {
+        // New cluster creation, on a spare member list if there is one
+        if (spare_members.empty()) {
+            cluster_members.emplace_back();
         } else {
-            // Create the cluster if it doesn't exist
-            cluster_members[cluster].push_back(index);
+            cluster_members.push_back(std::move(spare_members.back()));
+            spare_members.pop_back();
+        }
+        K++;
+    }
+    auto &members = cluster_members[cluster];
+    if (members.size() == members.capacity()) {
+        grow_from_spare(members);
+    }
+    member_position[index] = static_cast<int>(members.size());
+    members.push_back(index);
+}
+
+void Data::grow_from_spare(std::vector<int> &members) {
+    std::vector<int> *best = nullptr;
+    for (auto &spare : spare_members) {
+        if (spare.capacity() > members.size() && (!best || spare.capacity() > best->capacity())) {
+            best = &spare;
         }
     }
+    if (!best) {
+        return;
+    }
+    best->assign(members.begin(), members.end());
+    members.swap(*best);
+    best->clear();
 }
 
 void Data::set_allocation(int index, int cluster) {
+    PROFILE_SCOPE(DataSetAllocation);
 
     int old_cluster = allocations(index);
-    auto old_cluster_it = cluster_members.find(old_cluster);
 
+    if (old_cluster == cluster) {
+        return;
+    }
+
+    cluster = claim_cluster(cluster);
     set_allocation_wo_compaction(index, cluster);
 
+    // Inside a transaction empty clusters are compacted on commit
+    if (transaction_open) {
+        journal.push_back({index, old_cluster});
+        return;
+    }
+
     // Check if old cluster became empty and needs compaction
-    if (old_cluster_it != cluster_members.end() && old_cluster_it->second.empty()) {
-        compact_cluster(old_cluster);
+    if (old_cluster != -1 && cluster_members[old_cluster].empty()) {
+        if (lazy_compaction)
+            free_clusters.push_back(old_cluster);
+        else
+            compact_cluster(old_cluster);
+    }
+}
+
+int Data::claim_cluster(int cluster) {
+    if (free_clusters.empty() || cluster < 0) {
+        return cluster;
+    }
+    if (cluster == K) {
+        cluster = free_clusters.back();
+        free_clusters.pop_back();
+    } else if (cluster_members[cluster].empty()) {
+        // Clusters emptied inside a transaction are not free until the commit
+        const auto slot = std::find(free_clusters.begin(), free_clusters.end(), cluster);
+        if (slot != free_clusters.end())
+            free_clusters.erase(slot);
+    }
+    return cluster;
+}
+
+void Data::collect_free_clusters() {
+    free_clusters.clear();
+    if (!lazy_compaction)
+        return;
+    for (int k = K - 1; k >= 0; --k) {
+        if (cluster_members[k].empty())
+            free_clusters.push_back(k);
+    }
+}
+
+void Data::merge_clusters_wo_compaction(int from_cluster, int to_cluster) {
+#if VERBOSITY_LEVEL >= 1
+    if (from_cluster < 0 || from_cluster >= K || to_cluster < 0 || to_cluster >= K || from_cluster == to_cluster) {
+        throw std::out_of_range("Invalid cluster index in merge_clusters");
+    }
+#endif
+
+    std::vector<int> &from_members = cluster_members[from_cluster];
+    std::vector<int> &to_members = cluster_members[to_cluster];
+    to_members.reserve(to_members.size() + from_members.size());
+    for (const int index : from_members) {
+        allocations(index) = to_cluster;
+        member_position[index] = static_cast<int>(to_members.size());
+        to_members.push_back(index);
+        if (transaction_open)
+            journal.push_back({index, from_cluster});
     }
+    from_members.clear();
+}
+
+void Data::merge_clusters(int from_cluster, int to_cluster) {
+    PROFILE_SCOPE(DataSetAllocation);
+
+    merge_clusters_wo_compaction(from_cluster, to_cluster);
+    if (transaction_open)
+        return;
+    if (lazy_compaction)
+        free_clusters.push_back(from_cluster);
+    else
+        compact_cluster(from_cluster);
 }
 
 void Data::set_allocations(const Eigen::VectorXi &new_allocations) {
@@ -200,18 +266,27 @@ void Data::set_allocations(const Eigen::VectorXi &new_allocations) {
 #endif
 
     allocations = new_allocations;
-
-    // Update cluster members mapping
-    cluster_members.clear();
-    for (int i = 0; i < params.n; ++i)
-        cluster_members[allocations(i)].push_back(i);
+    journal.clear();
+    transaction_open = false;
+    stop_log_likelihood_tracking();
 
     // Update K based on the new allocations
     K = allocations.maxCoeff() + 1;
+
+    // Update cluster members
+    for (auto &members : cluster_members)
+        members.clear();
+    cluster_members.resize(K > 0 ? K : 0);
+    for (int i = 0; i < params.n; ++i) {
+        if (allocations(i) >= 0)
+            cluster_members[allocations(i)].push_back(i);
+    }
+    index_members();
+    collect_free_clusters();
 }
 
-void Data::restore_state(Eigen::VectorXi &old_allocations,
-                         std::unordered_map<int, std::vector<int>> &old_cluster_members, int old_K) {
+void Data::restore_state(Eigen::VectorXi &old_allocations, ClusterMembers &old_cluster_members, int old_K) {
+    PROFILE_SCOPE(RestoreState);
 #if VERBOSITY_LEVEL >= 1
     if (old_allocations.size() != allocations.size()) {
         throw std::invalid_argument("Saved allocations size mismatch in restore_state");
@@ -221,4 +296,128 @@ void Data::restore_state(Eigen::VectorXi &old_allocations,
     allocations.swap(old_allocations);
     cluster_members.swap(old_cluster_members);
     K = old_K;
-}
\ No newline at end of file
+    index_members();
+    journal.clear();
+    transaction_open = false;
+    collect_free_clusters();
+}
+
+void Data::begin_transaction() {
+    journal.clear();
+    transaction_open = true;
+    transaction_K = K;
+    transaction_free = free_clusters;
+}
+
+void Data::commit() {
+    journal.clear();
+    transaction_open = false;
+
+    if (lazy_compaction)
+        collect_free_clusters();
+    else
+        compact();
+}
+
+void Data::compact() {
+    if (transaction_open) {
+        throw std::logic_error("Data: cannot compact inside a transaction");
+    }
+    free_clusters.clear();
+
+    // From the back, so that the last cluster moved into a hole is never empty
+    for (int k = K - 1; k >= 0; --k) {
+        if (cluster_members[k].empty())
+            compact_cluster(k);
+    }
+}
+
+void Data::set_lazy_compaction(bool lazy) {
+    if (transaction_open) {
+        throw std::logic_error("Data: cannot change the compaction mode inside a transaction");
+    }
+    lazy_compaction = lazy;
+    if (!lazy)
+        compact();
+}
+
+void Data::drop_transaction_clusters() {
+    // Clusters opened during the transaction are empty again and at the end
+    cluster_members.resize(transaction_K);
+    K = transaction_K;
+    journal.clear();
+    transaction_open = false;
+    free_clusters.swap(transaction_free);
+}
+
+void Data::rollback() {
+    for (auto it = journal.rbegin(); it != journal.rend(); ++it) {
+        set_allocation_wo_compaction(it->index, it->from);
+    }
+    drop_transaction_clusters();
+}
+
+void Data::write_checkpoint(CheckpointWriter &out) const {
+    if (transaction_open) {
+        throw std::logic_error("Data: cannot checkpoint inside a transaction");
+    }
+    out.begin("Data");
+    out.write(static_cast<int32_t>(params.n));
+    out.write(static_cast<int32_t>(K));
+    out.write(allocations);
+    for (const std::vector<int> &members : cluster_members)
+        out.write(members);
+}
+
+void Data::rebuild_derived_state() {
+    if (transaction_open) {
+        throw std::logic_error("Data: cannot rebuild the derived state inside a transaction");
+    }
+    Eigen::VectorXi same_allocations = allocations;
+    ClusterMembers same_members = cluster_members;
+    restore_state(same_allocations, same_members, K);
+}
+
+void Data::read_checkpoint(CheckpointReader &in) {
+    in.expect("Data");
+    int32_t n, saved_K;
+    in.read(n);
+    in.read(saved_K);
+    if (n != params.n) {
+        in.fail("written for " + std::to_string(n) + " points, data has " + std::to_string(params.n));
+    }
+    if (saved_K < 0 || saved_K > n) {
+        in.fail("corrupt number of clusters");
+    }
+
+    Eigen::VectorXi saved_allocations;
+    in.read(saved_allocations);
+    if (saved_allocations.size() != n) {
+        in.fail("corrupt allocations");
+    }
+    ClusterMembers saved_members(saved_K);
+    std::vector<char> listed(n, 0);
+    for (int k = 0; k < saved_K; ++k) {
+        in.read(saved_members[k]);
+        for (const int i : saved_members[k]) {
+            if (i < 0 || i >= n || saved_allocations(i) != k || listed[i]) {
+                in.fail("member lists do not match the allocations");
+            }
+            listed[i] = 1;
+        }
+    }
+    for (int i = 0; i < n; ++i) {
+        if (!listed[i] && saved_allocations(i) != -1) {
+            in.fail("member lists do not match the allocations");
+        }
+    }
+
+    restore_state(saved_allocations, saved_members, saved_K);
+    stop_log_likelihood_tracking();
+}
+
+std::size_t Data::memory_bytes() const {
+    return MemoryReport::bytes(allocations) + MemoryReport::bytes(cluster_members) +
+           MemoryReport::bytes(spare_members) + MemoryReport::bytes(member_position) + MemoryReport::bytes(journal) +
+           MemoryReport::bytes(free_clusters) + MemoryReport::bytes(transaction_free);
+}
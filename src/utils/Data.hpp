@@ -6,16 +6,37 @@
 #pragma once
 
 #include <Eigen/Dense>
-#include <Rcpp.h>
-#include <RcppEigen.h>
-#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "Checkpoint.hpp"
+#include "MemoryReport.hpp"
 #include "Params.hpp"
+#include "Profiling.hpp"
 
 // compilation time verbosity level
 #ifndef VERBOSITY_LEVEL
 #define VERBOSITY_LEVEL 0
 #endif
 
+/// Point indices of each cluster, indexed by cluster (members in no particular order)
+using ClusterMembers = std::vector<std::vector<int>>;
+
+/**
+ * @brief Read-only view of the members of one cluster
+ * @param members Cluster members storage
+ * @param cluster Index of the cluster
+ * @return Map over the member indices (empty if the cluster does not exist)
+ *
+ * The view aliases the storage: it is invalidated by the next change to that cluster.
+ */
+inline Eigen::Map<const Eigen::VectorXi> cluster_members_view(const ClusterMembers &members, int cluster) {
+    if (cluster < 0 || cluster >= static_cast<int>(members.size())) {
+        return Eigen::Map<const Eigen::VectorXi>(nullptr, 0);
+    }
+    const std::vector<int> &m = members[cluster];
+    return Eigen::Map<const Eigen::VectorXi>(m.data(), static_cast<Eigen::Index>(m.size()));
+}
+
 /**
  * @class Data
  * @brief Manages distance matrices and cluster allocations for points
@@ -31,14 +52,85 @@ protected:
     Eigen::VectorXi allocations; ///< Cluster allocation for each point
     int K;                       ///< Current number of clusters
 
-    /// Maps cluster indices to vectors of point indices in that cluster
-    std::unordered_map<int, std::vector<int>> cluster_members;
+    /// Point indices of each cluster, indexed by cluster
+    ClusterMembers cluster_members;
+
+    /// Emptied member lists of removed clusters, reused (with their capacity) by new clusters
+    ClusterMembers spare_members;
+
+    /// Position of each point in its cluster's member list (-1 if unallocated), for O(1) removal
+    std::vector<int> member_position;
+
+    /**
+     * @brief Rebuilds member_position from cluster_members
+     */
+    void index_members();
+
+    /**
+     * @brief Moves a full member list into the largest spare list with room for one more member
+     *
+     * The members keep their order (member_position is unchanged) and the old storage becomes a
+     * spare; without a larger spare the list is left as it is and the next push_back grows it.
+     * @param members Member list about to receive a point (size() == capacity())
+     */
+    void grow_from_spare(std::vector<int> &members);
+
+    /**
+     * @brief Removes the (empty) member list of the last cluster, keeping it as a spare
+     */
+    void retire_last_members() {
+        spare_members.push_back(std::move(cluster_members.back()));
+        cluster_members.pop_back();
+    }
+
+    // ========== Transaction journal ==========
+
+    /// A point move recorded during a transaction
+    struct JournalEntry {
+        int index; ///< Point that moved
+        int from;  ///< Cluster it left (-1 if unallocated)
+    };
+
+    std::vector<JournalEntry> journal; ///< Moves made since begin_transaction()
+    bool transaction_open = false;     ///< True between begin_transaction() and commit()/rollback()
+    int transaction_K = 0;             ///< Number of clusters when the transaction began
+
+    /**
+     * @brief Removes the trailing clusters created during a rolled-back transaction
+     */
+    void drop_transaction_clusters();
+
+    // ========== Running log-likelihood ==========
+
+    /// Untempered log-likelihood of the partition, kept up to date by the samplers while tracked
+    double running_log_likelihood = 0.0;
+    bool log_likelihood_tracked = false; ///< True while running_log_likelihood is up to date
+
+    // ========== Lazy compaction ==========
+
+    bool lazy_compaction = false;        ///< True if emptied clusters are kept as free slots
+    std::vector<int> free_clusters;      ///< Empty cluster slots, reused by new clusters (lazy mode only)
+    std::vector<int> transaction_free;   ///< free_clusters when the transaction began
+
+    /**
+     * @brief Target slot of a move, taking a free slot for a new cluster
+     * @param cluster Requested cluster (K for a new cluster)
+     * @return cluster, or the free slot that becomes the new cluster
+     *
+     * Also drops cluster from free_clusters when a point moves explicitly into a free slot.
+     */
+    int claim_cluster(int cluster);
+
+    /**
+     * @brief Rebuilds free_clusters from the empty clusters (lazy mode), or clears it
+     */
+    void collect_free_clusters();
 
     /**
      * @brief Removes an empty cluster and compacts cluster indices
      * @param old_cluster Index of the cluster to remove
      */
-    void compact_cluster(int old_cluster);
+    virtual void compact_cluster(int old_cluster);
 
     /**
      * @brief Assigns a point to a cluster without compaction
@@ -48,6 +140,13 @@ protected:
      */
     void set_allocation_wo_compaction(int index, int cluster);
 
+    /**
+     * @brief Moves every point of a cluster into another one without compaction
+     * @param from_cluster Cluster emptied
+     * @param to_cluster Cluster the points join
+     */
+    void merge_clusters_wo_compaction(int from_cluster, int to_cluster);
+
 public:
     /**
      * @brief Constructs a Data object with a distance matrix
@@ -77,12 +176,24 @@ public:
      */
     int get_n() const { return params.n; }
 
+    /**
+     * @brief Gets the model parameters
+     * @return Params this object was built on
+     */
+    const Params &get_params() const { return params; }
+
     /**
      * @brief Gets the current number of clusters
-     * @return Number of clusters
+     * @return Number of clusters (cluster slots, free ones included, in lazy compaction mode)
      */
     int get_K() const { return K; }
 
+    /**
+     * @brief Gets the empty cluster slots kept by lazy compaction
+     * @return Indices of the free slots (always empty outside lazy compaction mode)
+     */
+    const std::vector<int> &get_free_clusters() const { return free_clusters; }
+
     /**
      * @brief Gets the cluster allocations vector
      * @return Reference to the allocations vector
@@ -95,7 +206,7 @@ public:
      * @return Number of points in the cluster (0 if cluster doesn't exist)
      */
     int get_cluster_size(unsigned cluster_index) const {
-        return (cluster_index < K) ? cluster_members.at(cluster_index).size() : 0;
+        return (cluster_index < K) ? cluster_members[cluster_index].size() : 0;
     }
 
     /**
@@ -114,24 +225,25 @@ public:
     /**
      * @brief Gets all point indices assigned to a specific cluster
      * @param cluster Index of the cluster
-     * @return Vector of point indices in the cluster
+     * @return View of the point indices in the cluster (empty if the cluster does not exist),
+     * valid until the next allocation change
      * @throws std::out_of_range if cluster index is invalid
      */
-    Eigen::VectorXi get_cluster_assignments(int cluster) const;
+    Eigen::Map<const Eigen::VectorXi> get_cluster_assignments(int cluster) const;
 
     /**
      * @brief Gets all point indices assigned to a specific cluster (map form)
      * @param cluster Index of the cluster
-     * @return Map to vector of point indices in the cluster
+     * @return View of the point indices in the cluster, same as get_cluster_assignments()
      * @throws std::out_of_range if cluster index is invalid
      */
     Eigen::Map<const Eigen::VectorXi> get_cluster_assignments_ref(int cluster) const;
 
     /**
-     * @brief Gets the full mapping of clusters to their member points
-     * @return Unordered map of cluster indices to vectors of point indices
+     * @brief Gets a copy of the members of every cluster
+     * @return Cluster-indexed vectors of point indices
      */
-    std::unordered_map<int, std::vector<int>> get_cluster_map_copy() const { return cluster_members; }
+    ClusterMembers get_cluster_map_copy() const { return cluster_members; }
 
     /** @} */
 
@@ -145,6 +257,9 @@ public:
      * @param index Index of the point to reassign
      * @param cluster Target cluster index (K for new cluster, -1 for unallocated)
      * @throws std::out_of_range if index or cluster is invalid
+     *
+     * In lazy compaction mode a new cluster takes a free slot if there is one, so the point may
+     * end up in a cluster other than K: read it back with get_cluster_assignment().
      */
     virtual void set_allocation(int index, int cluster);
 
@@ -155,23 +270,193 @@ public:
      */
     virtual void set_allocations(const Eigen::VectorXi &new_allocations);
 
+    /**
+     * @brief Moves every point of a cluster into another one, as one batch
+     * @param from_cluster Cluster whose points move
+     * @param to_cluster Cluster the points join (from_cluster != to_cluster)
+     * @throws std::out_of_range if a cluster index is invalid
+     *
+     * Same partition as calling set_allocation(point, to_cluster) on each member of from_cluster,
+     * but the caches of a Datax see one merge and combine the statistics of the two clusters at
+     * once. Inside a transaction each move is journaled and from_cluster stays empty until
+     * commit(); outside, from_cluster is compacted at once, as by set_allocation() (the last
+     * cluster takes its index), or becomes a free slot in lazy compaction mode.
+     */
+    virtual void merge_clusters(int from_cluster, int to_cluster);
+
     /**
      * @brief Restores allocations, cluster memberships, and cluster count from a saved state
      *
      * @param old_allocations Vector holding the saved allocations (swapped into place)
-     * @param old_cluster_members Map of saved cluster memberships (swapped into place)
+     * @param old_cluster_members Saved cluster memberships (swapped into place)
      * @param old_K Number of clusters in the saved state
      */
-    virtual void restore_state(Eigen::VectorXi &old_allocations,
-                               std::unordered_map<int, std::vector<int>> &old_cluster_members, int old_K);
+    virtual void restore_state(Eigen::VectorXi &old_allocations, ClusterMembers &old_cluster_members, int old_K);
 
     /**
-     * @brief Gets the full mapping of clusters to their member points
-     * @return Reference to the vector of cluster members
+     * @brief Gets the members of every cluster
+     * @return Reference to the cluster-indexed vectors of point indices
      */
-    const std::unordered_map<int, std::vector<int>> &get_cluster_map() const { return cluster_members; }
+    const ClusterMembers &get_cluster_map() const { return cluster_members; }
 
     /** @} */
 
+    /**
+     * @brief Transactions
+     * @details Between begin_transaction() and commit() or rollback(), set_allocation()
+     * records each move and defers the compaction of clusters that become empty, so
+     * cluster indices stay stable for the whole proposal. rollback() undoes the moves
+     * in reverse order in O(moved points); commit() compacts the empty clusters (or, in lazy
+     * compaction mode, keeps them as free slots).
+     * set_allocations() and restore_state() discard an open transaction.
+     * @{
+     */
+
+    /**
+     * @brief Starts recording moves
+     */
+    void begin_transaction();
+
+    /**
+     * @brief Keeps the moves made since begin_transaction() and compacts empty clusters
+     */
+    virtual void commit();
+
+    /**
+     * @brief Undoes the moves made since begin_transaction()
+     */
+    virtual void rollback();
+
+    /**
+     * @brief Whether a transaction is open
+     * @return True between begin_transaction() and commit()/rollback()
+     */
+    bool in_transaction() const { return transaction_open; }
+
+    /** @} */
+
+    /**
+     * @brief Lazy compaction
+     * @details Removing an empty cluster moves the last cluster into its index: the members of
+     * the last cluster are relabelled and every ClusterInfo moves its statistics. In lazy mode an
+     * emptied cluster is instead kept as a free slot, so the other clusters keep their indices,
+     * and a new cluster (set_allocation() to K) fills a free slot before K grows. The slots are
+     * compacted on demand by compact(), or when the mode is switched off.
+     *
+     * Free slots are empty clusters among 0, ..., K - 1: the priors give them zero weight and
+     * Sampler::compute_gibbs_log_weights() rules them out, but anything reading K as the number
+     * of clusters (the U update of NGGP, traces, checkpoints) needs compact() first. A sampler
+     * turns the mode on for the span of its step, as Neal3 does with set_lazy_compaction().
+     * @{
+     */
+
+    /**
+     * @brief Switches lazy compaction on or off
+     * @param lazy True to keep emptied clusters as free slots; false compacts them at once
+     * @throws std::logic_error inside a transaction
+     */
+    void set_lazy_compaction(bool lazy);
+
+    /**
+     * @brief Whether emptied clusters are kept as free slots
+     */
+    bool get_lazy_compaction() const { return lazy_compaction; }
+
+    /**
+     * @brief Removes every empty cluster, compacting the cluster indices
+     * @throws std::logic_error inside a transaction
+     */
+    void compact();
+
+    /** @} */
+
+    /**
+     * @brief Running log-likelihood
+     * @details The sum of the cluster log-likelihoods of the untempered likelihood, kept up to
+     * date from the likelihood changes that the samplers compute for their moves anyway (Gibbs
+     * log-weights, split-merge acceptance ratios), so that it costs nothing per iteration while a
+     * full recomputation costs a likelihood pass over every cluster. While nobody tracks it the
+     * samplers skip the bookkeeping. ChainRunner seeds it with a full sum and stops the tracking
+     * after a sampler that does not report its changes; set_allocations() and read_checkpoint()
+     * stop it too (restore_state() rolls back a move, keeping it). The tracking state is an
+     * explicit flag rather than a NaN value, so that it survives -ffinite-math-only.
+     * @{
+     */
+
+    /** @brief Whether the running log-likelihood is tracked */
+    bool tracks_log_likelihood() const { return log_likelihood_tracked; }
+
+    /** @brief Running log-likelihood, meaningful only while tracked */
+    double get_running_log_likelihood() const { return running_log_likelihood; }
+
+    /**
+     * @brief Sets the running log-likelihood and starts tracking it
+     * @param value Sum of the cluster log-likelihoods of the current partition
+     */
+    void set_running_log_likelihood(double value) {
+        running_log_likelihood = value;
+        log_likelihood_tracked = true;
+    }
+
+    /** @brief Stops tracking the running log-likelihood */
+    void stop_log_likelihood_tracking() {
+        running_log_likelihood = 0.0;
+        log_likelihood_tracked = false;
+    }
+
+    /**
+     * @brief Adds the likelihood change of a move to the running log-likelihood
+     * @param delta Change of the untempered log-likelihood (no effect while untracked)
+     */
+    void add_running_log_likelihood(double delta) {
+        if (log_likelihood_tracked)
+            running_log_likelihood += delta;
+    }
+
+    /** @} */
+
+    /**
+     * @brief Checkpointing
+     * @{
+     */
+
+    /**
+     * @brief Writes the allocations and the member lists to a checkpoint
+     * @param out Checkpoint being written
+     * @throws std::logic_error inside a transaction
+     *
+     * @details The member lists are written in their current order, which the likelihood sums
+     * follow. The state is only read; see rebuild_derived_state() for the writing chain.
+     */
+    void write_checkpoint(CheckpointWriter &out) const;
+
+    /**
+     * @brief Restores a copy of the current state onto itself
+     * @throws std::logic_error inside a transaction
+     *
+     * @details Rebuilds the derived caches (the ClusterInfo of Datax) from scratch, as
+     * read_checkpoint() does: called after write_checkpoint() (ChainRunner::save_checkpoint()), the
+     * chain that wrote the checkpoint and a chain resumed from it continue from caches equal to
+     * the last bit.
+     */
+    void rebuild_derived_state();
+
+    /**
+     * @brief Restores the state written by write_checkpoint()
+     * @param in Checkpoint being read
+     * @throws std::runtime_error if the checkpoint is for a different number of points or is inconsistent
+     *
+     * @details Goes through restore_state(), so the ClusterInfo caches are recomputed.
+     */
+    void read_checkpoint(CheckpointReader &in);
+
+    /** @} */
+
+    /**
+     * @brief Heap bytes of the allocations, member lists, position index and journal
+     * @see MemoryReport
+     */
+    virtual std::size_t memory_bytes() const;
+
     virtual ~Data() = default;
 };
\ No newline at end of file
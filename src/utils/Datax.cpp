@@ -17,7 +17,7 @@ void Datax::compact_cluster(int old_cluster) {
 
     // If compacting the last cluster (or the only cluster), this is a pure deletion.
     if (K <= 1 || old_cluster == last_cluster) {
-        cluster_members.erase(old_cluster);
+        retire_last_members();
         // Update cluster info to remove the old cluster
         for (auto && ci : cluster_info) {
             ci->remove_info(old_cluster);
@@ -26,28 +26,21 @@ void Datax::compact_cluster(int old_cluster) {
         return;
     }
 
-    auto last_cluster_it = cluster_members.find(last_cluster);
-    bool last_cluster_exists = (last_cluster_it != cluster_members.end());
-
     // Shift allocations of the last cluster to the old cluster
-    if (last_cluster_exists && !last_cluster_it->second.empty()) {
-        for (int point_index : last_cluster_it->second) {
+    if (!cluster_members[last_cluster].empty()) {
+        for (int point_index : cluster_members[last_cluster]) {
             allocations(point_index) = old_cluster;
         }
 
-        // Move members of the last cluster to the old cluster using move semantics
-        cluster_members[old_cluster] = std::move(last_cluster_it->second);
+        // Positions inside the member list are unchanged by the swap
+        cluster_members[old_cluster].swap(cluster_members[last_cluster]);
         // Update cluster info accordingly
-        for (auto && ci : cluster_info) 
-            ci->move_cluster_info(last_cluster, old_cluster);
-
-    } else {
-        // Last cluster is empty or doesn't exist, just clear the old cluster
-        cluster_members[old_cluster].clear();
+        for (auto && ci : cluster_info)
+            ci->relabel_cluster(last_cluster, old_cluster, cluster_members[old_cluster]);
     }
 
     // Remove the last cluster
-    cluster_members.erase(last_cluster);
+    retire_last_members();
     // Update cluster info to remove the last cluster
     for (auto && ci : cluster_info)
         ci->remove_info(last_cluster);
@@ -56,6 +49,7 @@ void Datax::compact_cluster(int old_cluster) {
 }
 
 void Datax::set_allocation(int index, int cluster) {
+    PROFILE_SCOPE(DataSetAllocation);
 
     int old_cluster = allocations(index);
 
@@ -63,29 +57,77 @@ void Datax::set_allocation(int index, int cluster) {
         return;
     }
 
-    auto old_cluster_it = cluster_members.find(old_cluster);
-
+    cluster = claim_cluster(cluster);
     Data::set_allocation_wo_compaction(index, cluster);
-    for(auto && ci : cluster_info)
-        ci->set_allocation(index, cluster, old_cluster);
+    {
+        PROFILE_SCOPE(ClusterInfoSetAllocation);
+        for(auto && ci : cluster_info)
+            ci->set_allocation(index, cluster, old_cluster);
+    }
+
+    // Inside a transaction empty clusters are compacted on commit
+    if (transaction_open) {
+        journal.push_back({index, old_cluster});
+        return;
+    }
 
     // Check if old cluster became empty and needs compaction
-    if (old_cluster_it != cluster_members.end() && old_cluster_it->second.empty()) {
-        Datax::compact_cluster(old_cluster);
+    if (old_cluster != -1 && cluster_members[old_cluster].empty()) {
+        if (lazy_compaction)
+            free_clusters.push_back(old_cluster);
+        else
+            Datax::compact_cluster(old_cluster);
+    }
+}
+
+void Datax::merge_clusters(int from_cluster, int to_cluster) {
+    PROFILE_SCOPE(DataSetAllocation);
+
+    merged_points.assign(cluster_members[from_cluster].begin(), cluster_members[from_cluster].end());
+    Data::merge_clusters_wo_compaction(from_cluster, to_cluster);
+    {
+        PROFILE_SCOPE(ClusterInfoSetAllocation);
+        for (auto &&ci : cluster_info)
+            ci->merge_clusters(from_cluster, to_cluster, merged_points);
     }
+
+    if (transaction_open)
+        return;
+    if (lazy_compaction)
+        free_clusters.push_back(from_cluster);
+    else
+        Datax::compact_cluster(from_cluster);
 }
 
 void Datax::set_allocations(const Eigen::VectorXi &new_allocations) {
 
     Data::set_allocations(new_allocations);
+    PROFILE_SCOPE(ClusterInfoRecompute);
     for(auto && ci : cluster_info)
         ci->recompute(K, allocations);
 }
 
-void Datax::restore_state(Eigen::VectorXi &old_allocations,
-                                      std::unordered_map<int, std::vector<int>> &old_cluster_members, int old_K) {
+void Datax::restore_state(Eigen::VectorXi &old_allocations, ClusterMembers &old_cluster_members, int old_K) {
+    PROFILE_SCOPE(RestoreState);
 
     Data::restore_state(old_allocations, old_cluster_members, old_K);
+    PROFILE_SCOPE(ClusterInfoRecompute);
     for(auto && ci : cluster_info)
         ci->recompute(K, allocations);
-}
\ No newline at end of file
+}
+
+void Datax::rollback() {
+    // Undo the moves in reverse order; the caches see the same moves backwards
+    for (auto it = journal.rbegin(); it != journal.rend(); ++it) {
+        const int current = allocations(it->index);
+        Data::set_allocation_wo_compaction(it->index, it->from);
+        for (auto && ci : cluster_info)
+            ci->set_allocation(it->index, it->from, current);
+    }
+
+    for (int k = K - 1; k >= transaction_K; --k) {
+        for (auto && ci : cluster_info)
+            ci->remove_info(k);
+    }
+    drop_transaction_clusters();
+}
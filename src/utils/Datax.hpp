@@ -30,7 +30,10 @@ class Datax : public Data {
 protected:
     std::vector<std::shared_ptr<ClusterInfo>> cluster_info;
 
-    void compact_cluster(int old_cluster);
+    /// Members moved by the last merge_clusters(), kept to reuse the storage
+    std::vector<int> merged_points;
+
+    void compact_cluster(int old_cluster) override;
 
 public:
     Datax(const Params &p, std::vector<std::shared_ptr<ClusterInfo>> ci,
@@ -52,15 +55,40 @@ public:
      */
     void set_allocations(const Eigen::VectorXi &new_allocations) override;
 
+    /**
+     * @brief Moves every point of a cluster into another one, with one
+     * ClusterInfo::merge_clusters() call per cache
+     * @param from_cluster Cluster whose points move
+     * @param to_cluster Cluster the points join (from_cluster != to_cluster)
+     */
+    void merge_clusters(int from_cluster, int to_cluster) override;
+
     /**
      * @brief Restores allocations, cluster memberships, and cluster count from a saved state
      *
      * @param old_allocations Vector holding the saved allocations (swapped into place)
-     * @param old_cluster_members Map of saved cluster memberships (swapped into place)
+     * @param old_cluster_members Saved cluster memberships (swapped into place)
      * @param old_K Number of clusters in the saved state
      */
-    void restore_state(Eigen::VectorXi &old_allocations, std::unordered_map<int, std::vector<int>> &old_cluster_members,
-                       int old_K) override;
+    void restore_state(Eigen::VectorXi &old_allocations, ClusterMembers &old_cluster_members, int old_K) override;
+
+    /**
+     * @brief Undoes the moves of the open transaction, replaying them backwards on every ClusterInfo
+     */
+    void rollback() override;
+
+    /**
+     * @brief Gets the registered caches
+     * @return The ClusterInfo objects kept in sync with the allocations
+     */
+    const std::vector<std::shared_ptr<ClusterInfo>> &get_cluster_info() const { return cluster_info; }
+
+    /**
+     * @brief Heap bytes of Data and of the list of caches (the caches report their own)
+     */
+    std::size_t memory_bytes() const override {
+        return Data::memory_bytes() + MemoryReport::bytes(merged_points) + MemoryReport::bytes(cluster_info);
+    }
 
     virtual ~Datax() = default;
 };
\ No newline at end of file
@@ -0,0 +1,366 @@
+/**
+ * @file DistanceBuilder.cpp
+ * @brief Implementation of the DistanceBuilder class
+ */
+
+#include "DistanceBuilder.hpp"
+#include "MappedDistances.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace {
+
+// Linear interpolation of (x, y) at increasing points xout, with R's approx(rule = 2): constant
+// outside the range, and the same interval and ties as R's binary search
+void interpolate(const double *x, const double *y, int G, const double *xout, int m, double *out) {
+    int i = 0;
+    for (int k = 0; k < m; ++k) {
+        const double v = xout[k];
+        if (v < x[0]) {
+            out[k] = y[0];
+            continue;
+        }
+        if (v > x[G - 1]) {
+            out[k] = y[G - 1];
+            continue;
+        }
+        while (i + 1 < G - 1 && x[i + 1] <= v)
+            ++i;
+        const int j = i + 1;
+        if (v == x[j])
+            out[k] = y[j];
+        else if (v == x[i])
+            out[k] = y[i];
+        else
+            out[k] = y[i] + (y[j] - y[i]) * ((v - x[i]) / (x[j] - x[i]));
+    }
+}
+
+} // namespace
+
+DistanceBuilder::Divergence DistanceBuilder::parse_divergence(const std::string &type) {
+    if (type == "Wasserstein")
+        return Divergence::Wasserstein;
+    if (type == "CM")
+        return Divergence::CramerVonMises;
+    if (type == "Jeff")
+        return Divergence::Jeffreys;
+    if (type == "chi2")
+        return Divergence::ChiSquared;
+    if (type == "euclidean")
+        return Divergence::Euclidean;
+    if (type == "Histogram-Divergence")
+        return Divergence::HistogramDivergence;
+    throw std::invalid_argument("DistanceBuilder: unsupported distance type " + type);
+}
+
+DistanceBuilder DistanceBuilder::from_histograms(const Eigen::MatrixXd &counts, const Eigen::VectorXd &breaks,
+                                                 Divergence divergence) {
+    if (breaks.size() != counts.cols() + 1 || counts.cols() == 0) {
+        throw std::invalid_argument("DistanceBuilder: histograms must have one more break than bins");
+    }
+
+    DistanceBuilder builder(divergence, false);
+    builder.n = static_cast<int>(counts.rows());
+    builder.bins = static_cast<int>(counts.cols());
+    const int B = builder.bins;
+
+    // Open end bins (a break at -Inf or Inf) take the width of the last bounded bin
+    const double inf = std::numeric_limits<double>::infinity();
+    std::vector<char> open(B);
+    builder.width.resize(B);
+    int last_bounded = -1;
+    for (int b = 0; b < B; ++b) {
+        open[b] = breaks(b) == -inf || breaks(b + 1) == inf;
+        builder.width[b] = breaks(b + 1) - breaks(b);
+        if (!open[b])
+            last_bounded = b;
+    }
+    if (last_bounded < 0) {
+        throw std::invalid_argument("DistanceBuilder: histograms have no finite bin");
+    }
+    for (int b = 0; b < B; ++b) {
+        if (open[b])
+            builder.width[b] = builder.width[last_bounded];
+    }
+
+    builder.prob.resize(static_cast<size_t>(builder.n) * B);
+    builder.cum.resize(static_cast<size_t>(builder.n) * B);
+    for (int i = 0; i < builder.n; ++i) {
+        const double total = counts.row(i).sum();
+        if (!(total > 0)) {
+            throw std::invalid_argument("DistanceBuilder: histogram " + std::to_string(i + 1) + " is empty");
+        }
+        double *p = builder.prob.data() + static_cast<size_t>(i) * B;
+        double *c = builder.cum.data() + static_cast<size_t>(i) * B;
+        double running = 0.0;
+        for (int b = 0; b < B; ++b) {
+            p[b] = counts(i, b) / total;
+            running += p[b];
+            c[b] = running;
+        }
+    }
+    return builder;
+}
+
+DistanceBuilder DistanceBuilder::from_densities(const Eigen::MatrixXd &x, const Eigen::MatrixXd &y,
+                                                Divergence divergence) {
+    if (x.rows() != y.rows() || x.cols() != y.cols() || x.cols() < 2) {
+        throw std::invalid_argument("DistanceBuilder: densities need x and y of the same size, with at least 2 points");
+    }
+
+    DistanceBuilder builder(divergence, true);
+    builder.n = static_cast<int>(x.rows());
+    builder.bins = static_cast<int>(x.cols());
+    const int G = builder.bins;
+
+    builder.grid_x.resize(static_cast<size_t>(builder.n) * G);
+    builder.grid_y.resize(static_cast<size_t>(builder.n) * G);
+    builder.x_lo.resize(builder.n);
+    builder.x_hi.resize(builder.n);
+    for (int i = 0; i < builder.n; ++i) {
+        for (int g = 0; g < G; ++g) {
+            builder.grid_x[static_cast<size_t>(i) * G + g] = x(i, g);
+            builder.grid_y[static_cast<size_t>(i) * G + g] = y(i, g);
+        }
+        builder.x_lo[i] = x.row(i).minCoeff();
+        builder.x_hi[i] = x.row(i).maxCoeff();
+    }
+    return builder;
+}
+
+double DistanceBuilder::histogram_distance(int i, int j) const {
+    const int B = bins;
+    const double *p1 = prob.data() + static_cast<size_t>(i) * B;
+    const double *p2 = prob.data() + static_cast<size_t>(j) * B;
+    const double *c1 = cum.data() + static_cast<size_t>(i) * B;
+    const double *c2 = cum.data() + static_cast<size_t>(j) * B;
+
+    double total = 0.0;
+    switch (divergence) {
+    case Divergence::Wasserstein:
+        for (int b = 0; b < B; ++b)
+            total += std::abs(c1[b] - c2[b]) * width[b];
+        return total;
+    case Divergence::CramerVonMises:
+        for (int b = 0; b < B; ++b)
+            total += (c1[b] - c2[b]) * (c1[b] - c2[b]) * width[b];
+        return total;
+    case Divergence::Jeffreys: {
+        bool overlap = false;
+        double kl1 = 0.0, kl2 = 0.0;
+        for (int b = 0; b < B; ++b) {
+            if (p1[b] > 0 && p2[b] > 0) {
+                overlap = true;
+                kl1 += p1[b] * std::log(p1[b] / p2[b]);
+                kl2 += p2[b] * std::log(p2[b] / p1[b]);
+            }
+        }
+        return overlap ? kl1 + kl2 : std::numeric_limits<double>::infinity();
+    }
+    case Divergence::ChiSquared:
+        for (int b = 0; b < B; ++b) {
+            if (p2[b] > 0)
+                total += (p1[b] - p2[b]) * (p1[b] - p2[b]) / p2[b];
+        }
+        return total;
+    case Divergence::Euclidean:
+        for (int b = 0; b < B; ++b)
+            total += (p1[b] - p2[b]) * (p1[b] - p2[b]);
+        return std::sqrt(total);
+    case Divergence::HistogramDivergence:
+        for (int b = 0; b < B; ++b)
+            total += std::min(p1[b], p2[b]);
+        return 1.0 - total;
+    }
+    return total;
+}
+
+double DistanceBuilder::density_distance(int i, int j, Scratch &scratch) const {
+    const int G = bins;
+
+    // Common grid on the intersection of the ranges, as R's seq(x_min, x_max, length.out = G)
+    const double x_min = std::max(x_lo[i], x_lo[j]);
+    const double x_max = std::min(x_hi[i], x_hi[j]);
+    const double by = (x_max - x_min) / (G - 1);
+    std::vector<double> &grid = scratch.x;
+    std::vector<double> &y1 = scratch.y1;
+    std::vector<double> &y2 = scratch.y2;
+    grid.resize(G);
+    y1.resize(G);
+    y2.resize(G);
+    grid[0] = x_min;
+    for (int g = 1; g < G - 1; ++g)
+        grid[g] = x_min + g * by;
+    grid[G - 1] = x_max;
+    const double dx = grid[1] - grid[0];
+
+    interpolate(grid_x.data() + static_cast<size_t>(i) * G, grid_y.data() + static_cast<size_t>(i) * G, G,
+                grid.data(), G, y1.data());
+    interpolate(grid_x.data() + static_cast<size_t>(j) * G, grid_y.data() + static_cast<size_t>(j) * G, G,
+                grid.data(), G, y2.data());
+
+    double mass1 = 0.0, mass2 = 0.0;
+    for (int g = 0; g < G; ++g) {
+        y1[g] = std::max(y1[g], 0.0);
+        y2[g] = std::max(y2[g], 0.0);
+        mass1 += y1[g] * dx;
+        mass2 += y2[g] * dx;
+    }
+    for (int g = 0; g < G; ++g) {
+        y1[g] /= mass1;
+        y2[g] /= mass2;
+    }
+
+    double total = 0.0;
+    switch (divergence) {
+    case Divergence::HistogramDivergence:
+        for (int g = 0; g < G; ++g)
+            total += std::min(y1[g], y2[g]);
+        return dx * total;
+    case Divergence::Jeffreys: {
+        double kl1 = 0.0, kl2 = 0.0;
+        for (int g = 0; g < G; ++g) {
+            if (y1[g] > 0 && y2[g] > 0) {
+                kl1 += y1[g] * std::log(y1[g] / y2[g]) * dx;
+                kl2 += y2[g] * std::log(y2[g] / y1[g]) * dx;
+            }
+        }
+        return kl1 + kl2;
+    }
+    case Divergence::ChiSquared:
+        for (int g = 0; g < G; ++g) {
+            if (y2[g] > 0)
+                total += (y1[g] - y2[g]) * (y1[g] - y2[g]) / y2[g];
+        }
+        return dx * total;
+    case Divergence::Euclidean:
+        for (int g = 0; g < G; ++g)
+            total += (y1[g] - y2[g]) * (y1[g] - y2[g]);
+        return std::sqrt(dx * total);
+    case Divergence::CramerVonMises:
+    case Divergence::Wasserstein: {
+        double cum1 = 0.0, cum2 = 0.0;
+        for (int g = 0; g < G; ++g) {
+            cum1 += y1[g] * dx;
+            cum2 += y2[g] * dx;
+            total += divergence == Divergence::Wasserstein ? std::abs(cum1 - cum2) : (cum1 - cum2) * (cum1 - cum2);
+        }
+        return dx * total;
+    }
+    }
+    return total;
+}
+
+double DistanceBuilder::distance(int i, int j) const {
+    if (!densities)
+        return histogram_distance(i, j);
+    Scratch scratch;
+    return density_distance(i, j, scratch);
+}
+
+template <typename Store> void DistanceBuilder::for_each_pair(Store store, bool diagonal, int n_threads) const {
+#ifdef _OPENMP
+    if (n_threads <= 0)
+        n_threads = omp_get_max_threads();
+#else
+    n_threads = 1;
+#endif
+
+    const int blocks = (n + tile_size - 1) / tile_size;
+    std::vector<std::pair<int, int>> tiles;
+    tiles.reserve(static_cast<size_t>(blocks) * (blocks + 1) / 2);
+    for (int bi = 0; bi < blocks; ++bi) {
+        for (int bj = bi; bj < blocks; ++bj)
+            tiles.emplace_back(bi, bj);
+    }
+    const long n_tiles = static_cast<long>(tiles.size());
+
+#pragma omp parallel num_threads(n_threads)
+    {
+        Scratch scratch;
+#pragma omp for schedule(dynamic, 1)
+        for (long t = 0; t < n_tiles; ++t) {
+            const int i0 = tiles[t].first * tile_size, i1 = std::min(n, i0 + tile_size);
+            const int j0 = tiles[t].second * tile_size, j1 = std::min(n, j0 + tile_size);
+            for (int i = i0; i < i1; ++i) {
+                for (int j = std::max(j0, diagonal ? i : i + 1); j < j1; ++j)
+                    store(i, j, densities ? density_distance(i, j, scratch) : histogram_distance(i, j));
+            }
+        }
+    }
+    (void)n_threads;
+}
+
+Eigen::MatrixXd DistanceBuilder::dense(int n_threads) const {
+    Eigen::MatrixXd D = Eigen::MatrixXd::Zero(n, n);
+    for_each_pair(
+        [&D](int i, int j, double d) {
+            D(i, j) = d;
+            D(j, i) = d;
+        },
+        true, n_threads);
+    return D;
+}
+
+Eigen::MatrixXd DistanceBuilder::block(const std::vector<int> &points, int n_threads) const {
+    for (const int i : points) {
+        if (i < 0 || i >= n) {
+            throw std::invalid_argument("DistanceBuilder: block index out of range");
+        }
+    }
+#ifdef _OPENMP
+    if (n_threads <= 0)
+        n_threads = omp_get_max_threads();
+#else
+    n_threads = 1;
+#endif
+
+    const int m = static_cast<int>(points.size());
+    Eigen::MatrixXd D = Eigen::MatrixXd::Zero(m, m);
+#pragma omp parallel num_threads(n_threads)
+    {
+        Scratch scratch;
+#pragma omp for schedule(dynamic, 1)
+        for (int a = 0; a < m; ++a) {
+            for (int b = a; b < m; ++b) {
+                const int i = points[a], j = points[b];
+                const double d = densities ? density_distance(i, j, scratch) : histogram_distance(i, j);
+                D(a, b) = d;
+                D(b, a) = d;
+            }
+        }
+    }
+    (void)n_threads;
+    return D;
+}
+
+std::shared_ptr<const PackedDistances> DistanceBuilder::packed(int n_threads) const {
+    auto store = std::make_shared<PackedDistances>(n);
+    PackedDistances &packed_store = *store;
+    for_each_pair([&packed_store](int i, int j, double d) { packed_store.set(i, j, d); }, false, n_threads);
+    return store;
+}
+
+void DistanceBuilder::write_file(const std::string &path, int n_threads) const {
+    const size_t stride = static_cast<size_t>(n);
+    MappedDistances::create(path, n, [&](double *D, double *log_D) {
+        for_each_pair(
+            [&](int i, int j, double d) {
+                const double log_d = std::log(d);
+                D[static_cast<size_t>(j) * stride + i] = d;
+                D[static_cast<size_t>(i) * stride + j] = d;
+                log_D[static_cast<size_t>(j) * stride + i] = log_d;
+                log_D[static_cast<size_t>(i) * stride + j] = log_d;
+            },
+            true, n_threads);
+    });
+}
@@ -0,0 +1,153 @@
+/**
+ * @file DistanceBuilder.hpp
+ * @brief Pairwise divergences between histograms or densities, computed in parallel
+ *
+ * @author Filippo Galli
+ * @date 2025
+ */
+
+#pragma once
+
+#include "PackedDistances.hpp"
+#include <Eigen/Dense>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @class DistanceBuilder
+ * @brief Builds the distance matrix of n distributions, straight into the chosen storage
+ *
+ * The distributions are either histograms on shared breaks or densities evaluated on a grid each
+ * (e.g. the x and y of R's density()), one per row. The divergences are those of
+ * compute_hist_distances() and compute_kde_distances() in R/utils.R, with the same definitions, so
+ * the matrices agree with the R loops up to rounding (R accumulates its sums in long double):
+ * - "Wasserstein": integral of |F1 - F2|;
+ * - "CM": integral of (F1 - F2)^2 (Cramer-von Mises);
+ * - "Jeff": KL(p1 || p2) + KL(p2 || p1) on the common support (Jeffreys), Inf for histograms with
+ *   no common support;
+ * - "chi2": sum of (p1 - p2)^2 / p2 where p2 > 0 (not symmetric: entry (i, j), i < j, has p1 the
+ *   i-th distribution, and is mirrored to (j, i));
+ * - "euclidean": L2 distance of the probabilities (densities);
+ * - "Histogram-Divergence": 1 - sum of min(p1, p2) for histograms, and, as in R, the overlap
+ *   integral of min(p1, p2) itself for densities.
+ *
+ * Densities are compared on a grid per pair, as in compute_kde_distances(): both are linearly
+ * interpolated on G points spanning the intersection of their ranges (R's approx(rule = 2)),
+ * clipped at 0 and normalized to integrate to 1.
+ *
+ * The upper triangle is cut into square tiles of tile_size points, scheduled dynamically over
+ * OpenMP threads; every pair is computed once and written to its entries of the output directly,
+ * so D is materialized once, in its final storage: dense(), packed() or write_file().
+ */
+class DistanceBuilder {
+public:
+    /** @brief Supported divergences, see the class description */
+    enum class Divergence { Wasserstein, CramerVonMises, Jeffreys, ChiSquared, Euclidean, HistogramDivergence };
+
+    /** @brief Side of the square tiles of the upper triangle */
+    static constexpr int tile_size = 64;
+
+    /**
+     * @brief Parses a divergence name, as accepted by the R functions
+     * @param type "Wasserstein", "CM", "Jeff", "chi2", "euclidean" or "Histogram-Divergence"
+     * @throws std::invalid_argument for any other name
+     */
+    static Divergence parse_divergence(const std::string &type);
+
+    /**
+     * @brief Histograms on shared breaks
+     * @param counts Counts, n x B (one histogram per row)
+     * @param breaks Breaks, B + 1 increasing values (infinite bin widths take the width of the
+     * last finite bin, as in compute_hist_distances())
+     * @param divergence Divergence to compute
+     * @throws std::invalid_argument if the sizes do not match, a histogram is empty or no bin is finite
+     */
+    static DistanceBuilder from_histograms(const Eigen::MatrixXd &counts, const Eigen::VectorXd &breaks,
+                                           Divergence divergence);
+
+    /**
+     * @brief Densities evaluated on a grid each
+     * @param x Grid points, n x G (one increasing grid per row, G >= 2)
+     * @param y Density values at the grid points, n x G
+     * @param divergence Divergence to compute
+     * @throws std::invalid_argument if the sizes do not match or G < 2
+     */
+    static DistanceBuilder from_densities(const Eigen::MatrixXd &x, const Eigen::MatrixXd &y, Divergence divergence);
+
+    /** @brief Number of distributions */
+    int size() const { return n; }
+
+    /**
+     * @brief Divergence between two distributions
+     * @param i Index of the first distribution (p1)
+     * @param j Index of the second distribution (p2)
+     */
+    double distance(int i, int j) const;
+
+    /**
+     * @brief Dense distance matrix, diagonal included (as the R loops over j >= i)
+     * @param n_threads OpenMP threads (<= 0: all available)
+     */
+    Eigen::MatrixXd dense(int n_threads = 0) const;
+
+    /**
+     * @brief Dense distance matrix among some of the distributions, diagonal included
+     * @param points Indices of the distributions (0-based), in the order of the rows
+     * @param n_threads OpenMP threads (<= 0: all available)
+     * @return m x m matrix, m = points.size(); only these m^2 / 2 divergences are computed
+     * @throws std::invalid_argument if an index is out of range
+     */
+    Eigen::MatrixXd block(const std::vector<int> &points, int n_threads = 0) const;
+
+    /**
+     * @brief Packed upper triangle, for Params::use_packed_storage()
+     * @param n_threads OpenMP threads (<= 0: all available)
+     */
+    std::shared_ptr<const PackedDistances> packed(int n_threads = 0) const;
+
+    /**
+     * @brief Writes a distance file for Params::map_distances(), filled in place
+     * @param path Output path (overwritten)
+     * @param n_threads OpenMP threads (<= 0: all available)
+     * @throws std::runtime_error if the file cannot be written
+     * @see MappedDistances::create()
+     */
+    void write_file(const std::string &path, int n_threads = 0) const;
+
+private:
+    /** @brief Per-thread buffers of the density grids */
+    struct Scratch {
+        std::vector<double> x;  ///< Common grid of the pair
+        std::vector<double> y1; ///< First density on the common grid
+        std::vector<double> y2; ///< Second density on the common grid
+    };
+
+    Divergence divergence; ///< Divergence computed
+    bool densities;        ///< Densities (x, y) rather than histograms
+    int n = 0;             ///< Number of distributions
+    int bins = 0;          ///< Bins per histogram or points per grid
+
+    // Histograms: probabilities and cumulative probabilities, one row per histogram (row-major)
+    std::vector<double> prob;  ///< p, n x bins
+    std::vector<double> cum;   ///< Cumulative sums of p, n x bins
+    std::vector<double> width; ///< Bin widths
+
+    // Densities: grids and values, one row per density (row-major)
+    std::vector<double> grid_x; ///< x, n x bins
+    std::vector<double> grid_y; ///< y, n x bins
+    std::vector<double> x_lo;   ///< Smallest grid point of each density
+    std::vector<double> x_hi;   ///< Largest grid point of each density
+
+    DistanceBuilder(Divergence divergence, bool densities) : divergence(divergence), densities(densities) {}
+
+    double histogram_distance(int i, int j) const;
+    double density_distance(int i, int j, Scratch &scratch) const;
+
+    /**
+     * @brief Calls store(i, j, distance(i, j)) on every pair i < j (and i == j if diagonal), in parallel
+     *
+     * Each pair is visited once, by one thread; store must be safe to call concurrently on distinct pairs.
+     */
+    template <typename Store> void for_each_pair(Store store, bool diagonal, int n_threads) const;
+};
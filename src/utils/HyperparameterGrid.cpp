@@ -0,0 +1,142 @@
+/**
+ * @file HyperparameterGrid.cpp
+ * @brief Implementation of the HyperparameterGrid class
+ */
+
+#include "HyperparameterGrid.hpp"
+#include "../likelihoods/Gamma_likelihood.hpp"
+#include "../likelihoods/Natarajan_likelihood.hpp"
+#include "../processes/DP.hpp"
+#include "../processes/NGGP.hpp"
+#include "../samplers/U_sampler/RWMH.hpp"
+#include "../samplers/neal.hpp"
+#include "../samplers/splitmerge_LSS_SDDS.hpp"
+#include "ChainRunner.hpp"
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <limits>
+#include <stdexcept>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+HyperparameterGrid::HyperparameterGrid(Params &base, Options options) : base(base), options(std::move(options)) {
+    if (this->options.process != "DP" && this->options.process != "NGGP") {
+        throw std::invalid_argument("HyperparameterGrid: process must be \"DP\" or \"NGGP\"");
+    }
+    if (this->options.likelihood != "Natarajan" && this->options.likelihood != "Gamma") {
+        throw std::invalid_argument("HyperparameterGrid: likelihood must be \"Natarajan\" or \"Gamma\"");
+    }
+    if (this->options.periods.size() != 2 || this->options.periods[0] < 1 || this->options.periods[1] < 1) {
+        throw std::invalid_argument("HyperparameterGrid: need two positive periods (split-merge, Gibbs)");
+    }
+    if (this->options.initial_allocations.size() != 0 && this->options.initial_allocations.size() != base.n) {
+        throw std::invalid_argument("HyperparameterGrid: the starting partition must have one entry per point");
+    }
+
+    base.share_distances();
+    anchors = std::make_shared<const AnchorTables>(base);
+}
+
+std::vector<HyperparameterGrid::Summary> HyperparameterGrid::run(const std::vector<Job> &jobs, int n_threads) const {
+    bool log_distances = false;
+    for (const Job &job : jobs) {
+        if (job.BI < 0 || job.NI < 0 || job.thin < 1) {
+            throw std::invalid_argument("HyperparameterGrid: BI and NI must be non-negative and thin positive");
+        }
+        log_distances = log_distances || job.delta1 != 1.0 || job.delta2 != 1.0;
+    }
+    // Computed once here, so the copies of the jobs share it instead of each computing its own
+    if (log_distances && base.dense_storage())
+        base.get_log_D_data();
+
+    const int n_jobs = static_cast<int>(jobs.size());
+    std::vector<Summary> summaries(n_jobs);
+#ifdef _OPENMP
+    if (n_threads <= 0)
+        n_threads = omp_get_max_threads();
+#pragma omp parallel for schedule(dynamic, 1) num_threads(n_threads)
+#endif
+    for (int j = 0; j < n_jobs; ++j) {
+        // Exceptions must not escape the parallel region
+        try {
+            const NodeAffinity pin(base.distance_node());
+            summaries[j] = run_job(jobs[j]);
+        } catch (const std::exception &e) {
+            summaries[j].error = e.what();
+        }
+    }
+    return summaries;
+}
+
+HyperparameterGrid::Summary HyperparameterGrid::run_job(const Job &job) const {
+    // Copy of the scalars; the distance stores are shared with base
+    Params params = base;
+    params.delta1 = job.delta1;
+    params.alpha = job.alpha;
+    params.beta = job.beta;
+    params.delta2 = job.delta2;
+    params.gamma = job.gamma;
+    params.zeta = job.zeta;
+    params.a = job.a;
+    params.sigma = job.sigma;
+    params.tau = job.tau;
+    params.BI = job.BI;
+    params.NI = job.NI;
+
+    Rng gen(job.seed);
+    Data data(params, options.initial_allocations);
+    std::unique_ptr<Likelihood> likelihood;
+    if (options.likelihood == "Gamma")
+        likelihood = std::make_unique<Gamma_likelihood>(data, params);
+    else
+        likelihood = std::make_unique<Natarajan_likelihood>(data, params);
+    RWMH u_sampler(params, data, true, 2.0, true, gen.split());
+    std::unique_ptr<Process> process;
+    if (options.process == "DP")
+        process = std::make_unique<DP>(data, params);
+    else
+        process = std::make_unique<NGGP>(data, params, u_sampler);
+    SplitMerge_LSS_SDDS split_merge(data, params, *likelihood, *process, true, anchors, gen.split());
+    Neal3 gibbs(data, params, *likelihood, *process, gen.split());
+
+    const bool has_u = options.process == "NGGP";
+    ChainRunner runner(data, *process, {&split_merge, &gibbs}, options.periods, has_u ? &u_sampler : nullptr);
+    runner.track_log_likelihood(likelihood.get());
+
+    const int n_saved = ChainRunner::n_saved(job.BI, job.NI, job.thin);
+    std::vector<int> K(n_saved);
+    std::vector<double> U(n_saved, std::numeric_limits<double>::quiet_NaN()), log_posterior(n_saved);
+    Summary summary;
+    summary.elapsed_time = runner.run(job.BI, job.NI, job.thin, nullptr, K.data(), U.data(), {}, 0,
+                                      log_posterior.data());
+
+    // Post burn-in samples only
+    const int first = job.BI / job.thin;
+    summary.samples = n_saved - first;
+    summary.allocations = data.get_allocations();
+    if (summary.samples == 0) {
+        summary.mean_K = summary.sd_K = summary.mean_U = summary.mean_log_posterior = summary.max_log_posterior =
+            std::numeric_limits<double>::quiet_NaN();
+        return summary;
+    }
+    double sum_K = 0.0, sum_K2 = 0.0, sum_U = 0.0, sum_log_posterior = 0.0;
+    summary.max_log_posterior = -std::numeric_limits<double>::infinity();
+    for (int s = first; s < n_saved; ++s) {
+        if (K[s] >= static_cast<int>(summary.K_counts.size()))
+            summary.K_counts.resize(K[s] + 1, 0);
+        ++summary.K_counts[K[s]];
+        sum_K += K[s];
+        sum_K2 += static_cast<double>(K[s]) * K[s];
+        sum_U += U[s];
+        sum_log_posterior += log_posterior[s];
+        summary.max_log_posterior = std::max(summary.max_log_posterior, log_posterior[s]);
+    }
+    summary.mean_K = sum_K / summary.samples;
+    summary.sd_K = std::sqrt(std::max(0.0, sum_K2 / summary.samples - summary.mean_K * summary.mean_K));
+    summary.mean_U = sum_U / summary.samples;
+    summary.mean_log_posterior = sum_log_posterior / summary.samples;
+    return summary;
+}
@@ -0,0 +1,107 @@
+/**
+ * @file HyperparameterGrid.hpp
+ * @brief Batch of chains differing only in their hyperparameters, run as jobs on one distance store
+ *
+ * @author Filippo Galli
+ * @date 2025
+ */
+
+#pragma once
+
+#include "../samplers/anchor_tables.hpp"
+#include "Params.hpp"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @class HyperparameterGrid
+ * @brief Runs one chain per configuration of the Params scalars, all reading the same distances
+ *
+ * A sensitivity study runs the same model for many values of delta1, alpha, beta, delta2, gamma,
+ * zeta, a, sigma and tau. As separate R sessions, each copies D and computes its log D; here the
+ * distances are put once in a read-only store shared by every job (Params::share_distances(), or
+ * the mapped, placed, single-precision or packed store already in use), and so are the anchor
+ * tables of the split-merge sampler, which depend on D alone.
+ *
+ * Each job copies the base Params with its own scalars, builds its stack in the thread that runs
+ * it (Data, Natarajan or Gamma likelihood, DP or NGGP with a RWMH for U, SplitMerge_LSS_SDDS and
+ * Neal3, as build_chain() without modules), so whatever the likelihood and process precompute
+ * from the hyperparameters (lgamma tables, log gamma(alpha + ...) constants) is built per job, and
+ * frees it when done. The jobs are taken one at a time by the threads (OpenMP dynamic schedule):
+ * a thread that finishes a short job takes the next, so jobs of different lengths keep every
+ * thread busy, and at most n_threads stacks are alive at once. What is kept of a job is a summary
+ * in O(n + K), not its trace.
+ */
+class HyperparameterGrid {
+public:
+    /** @brief Hyperparameters and run length of one job */
+    struct Job {
+        double delta1, alpha, beta, delta2, gamma, zeta; ///< Likelihood hyperparameters
+        double a, sigma, tau;                            ///< NGGP parameters (a alone for the DP)
+        int BI, NI;                                      ///< Burn-in and post burn-in iterations
+        int thin = 1;                                    ///< Thinning of the summarized samples
+        std::uint64_t seed = 0;                          ///< Seed of the stack streams
+
+        /**
+         * @brief Job with the values of a Params
+         * @param params Params whose scalars are copied
+         * @param seed Seed of the stack streams
+         */
+        static Job from(const Params &params, std::uint64_t seed) {
+            return {params.delta1, params.alpha, params.beta, params.delta2, params.gamma, params.zeta,
+                    params.a,      params.sigma, params.tau,  params.BI,     params.NI,    1, seed};
+        }
+    };
+
+    /** @brief Model shared by the jobs */
+    struct Options {
+        std::string process = "NGGP";          ///< "DP" or "NGGP"
+        std::string likelihood = "Natarajan";  ///< "Natarajan" or "Gamma"
+        std::vector<int> periods = {1, 25};    ///< Periods of SplitMerge_LSS_SDDS and Neal3
+        Eigen::VectorXi initial_allocations;   ///< Starting partition (empty: the Data default)
+    };
+
+    /** @brief Compact result of one job, over its post burn-in samples */
+    struct Summary {
+        int samples = 0;                 ///< Post burn-in samples summarized
+        double mean_K = 0.0;             ///< Mean number of clusters
+        double sd_K = 0.0;               ///< Standard deviation of the number of clusters
+        std::vector<int> K_counts;       ///< K_counts[k]: samples with k clusters
+        double mean_U = 0.0;             ///< Mean of U (NaN for the DP)
+        double mean_log_posterior = 0.0; ///< Mean log-posterior, up to a constant (NaN without a prior)
+        double max_log_posterior = 0.0;  ///< Largest log-posterior of the samples
+        double elapsed_time = 0.0;       ///< Wall time of the run, in seconds
+        Eigen::VectorXi allocations;     ///< Last partition
+        std::string error;               ///< Message of the exception that stopped the job (empty: none)
+    };
+
+    /**
+     * @brief Prepares the shared stores
+     * @param base Params of the distances; its in-memory D is moved to a shared store
+     * (Params::share_distances()). Must outlive the grid
+     * @param options Model of the jobs
+     * @throws std::invalid_argument if the process, likelihood or periods are not as documented, or
+     * the starting partition has a wrong size
+     */
+    HyperparameterGrid(Params &base, Options options);
+
+    /**
+     * @brief Runs the jobs
+     * @param jobs Configurations, one chain each
+     * @param n_threads Threads (0: OpenMP default)
+     * @return One summary per job, in the order of jobs; a job that throws reports its message
+     * in Summary::error and the others still run
+     * @throws std::invalid_argument if a job has a negative length or a thinning below 1
+     */
+    std::vector<Summary> run(const std::vector<Job> &jobs, int n_threads = 0) const;
+
+private:
+    Params &base;                                ///< Params of the shared distances
+    Options options;                             ///< Model of the jobs
+    std::shared_ptr<const AnchorTables> anchors; ///< Anchor tables of the split-merge, shared
+
+    /** @brief Runs one job on the calling thread */
+    Summary run_job(const Job &job) const;
+};
@@ -0,0 +1,167 @@
+/**
+ * @file InitialPartition.cpp
+ * @brief Implementation of the CLARA-style k-medoids starting partition
+ */
+
+#include "InitialPartition.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <utility>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace {
+
+/**
+ * @brief Assigns each point to its closest medoid (lowest medoid index on ties)
+ * @return Sum of the distances of the points to their medoid
+ */
+double assign(const Params &params, const std::vector<int> &points, const std::vector<int> &medoids,
+              std::vector<int> &labels) {
+    double cost = 0.0;
+    labels.resize(points.size());
+    for (size_t q = 0; q < points.size(); ++q) {
+        double best = std::numeric_limits<double>::infinity();
+        int best_k = 0;
+        for (size_t k = 0; k < medoids.size(); ++k) {
+            const double d = params.distance(points[q], medoids[k]);
+            if (d < best) {
+                best = d;
+                best_k = static_cast<int>(k);
+            }
+        }
+        labels[q] = best_k;
+        cost += best;
+    }
+    return cost;
+}
+
+} // namespace
+
+double InitialPartition::expected_clusters(double a, int n) {
+    double expected = 0.0;
+    for (int i = 0; i < n; ++i)
+        expected += a / (a + i);
+    return expected;
+}
+
+void InitialPartition::search(const Params &params, int K, int s, int max_iterations, Rng &rng, Result &result) {
+    const int n = params.n;
+
+    // Sample of s points, by a partial Fisher-Yates shuffle
+    std::vector<int> sample(n);
+    std::iota(sample.begin(), sample.end(), 0);
+    for (int q = 0; q < s; ++q)
+        std::swap(sample[q], sample[q + rng.uniform_int(n - q)]);
+    sample.resize(s);
+
+    // k-medoids++ seeding on the sample, by position in it
+    std::vector<int> seeds{rng.uniform_int(s)};
+    std::vector<double> closest(s);
+    for (int q = 0; q < s; ++q)
+        closest[q] = params.distance(sample[q], sample[seeds[0]]);
+    while (static_cast<int>(seeds.size()) < K) {
+        double total = 0.0;
+        for (const double d : closest)
+            total += d;
+        if (!(total > 0.0))
+            break; // Every sample point coincides with a medoid
+        const int next = rng.categorical(closest.data(), s, total);
+        seeds.push_back(next);
+        for (int q = 0; q < s; ++q)
+            closest[q] = std::min(closest[q], params.distance(sample[q], sample[next]));
+    }
+
+    std::vector<int> medoids(seeds.size());
+    for (size_t k = 0; k < seeds.size(); ++k)
+        medoids[k] = sample[seeds[k]];
+
+    // Alternating k-medoids iteration on the sample
+    std::vector<int> labels;
+    std::vector<std::vector<int>> members(medoids.size());
+    for (int it = 0; it < max_iterations; ++it) {
+        assign(params, sample, medoids, labels);
+        for (auto &cluster : members)
+            cluster.clear();
+        for (int q = 0; q < s; ++q)
+            members[labels[q]].push_back(sample[q]);
+
+        bool moved = false;
+        for (size_t k = 0; k < medoids.size(); ++k) {
+            double best = std::numeric_limits<double>::infinity();
+            int best_point = medoids[k];
+            for (const int c : members[k]) {
+                double sum = 0.0;
+                for (const int p : members[k])
+                    sum += params.distance(c, p);
+                if (sum < best || (sum == best && c == medoids[k])) {
+                    best = sum;
+                    best_point = c;
+                }
+            }
+            moved |= best_point != medoids[k];
+            medoids[k] = best_point;
+        }
+        if (!moved)
+            break;
+    }
+
+    // All the points to the medoids of the sample
+    std::vector<int> all(n);
+    std::iota(all.begin(), all.end(), 0);
+    result.cost = assign(params, all, medoids, result.labels);
+    result.medoids = std::move(medoids);
+}
+
+InitialPartition::Result InitialPartition::k_medoids(const Params &params, const Options &options, Rng &rng) {
+    const int n = params.n;
+    if (n < 1) {
+        throw std::invalid_argument("InitialPartition: no points");
+    }
+    if (options.K < 0 || options.restarts < 1 || options.sample_size < 0 || options.max_iterations < 0) {
+        throw std::invalid_argument("InitialPartition: invalid search options");
+    }
+
+    int K = options.K > 0 ? options.K : static_cast<int>(std::lround(expected_clusters(params.a, n)));
+    K = std::min(std::max(K, 1), n);
+    const int s = std::min(options.sample_size > 0 ? std::max(options.sample_size, K) : 40 + 20 * K, n);
+
+    std::vector<Rng> streams;
+    streams.reserve(options.restarts);
+    for (int r = 0; r < options.restarts; ++r)
+        streams.push_back(rng.split());
+
+    std::vector<Result> results(options.restarts);
+#ifdef _OPENMP
+    const int n_threads = options.n_threads > 0 ? options.n_threads : omp_get_max_threads();
+#pragma omp parallel for schedule(dynamic, 1) num_threads(n_threads)
+#endif
+    for (int r = 0; r < options.restarts; ++r) {
+        search(params, K, s, options.max_iterations, streams[r], results[r]);
+        results[r].restart = r;
+    }
+
+    int best = 0;
+    for (int r = 1; r < options.restarts; ++r)
+        if (results[r].cost < results[best].cost)
+            best = r;
+    Result result = std::move(results[best]);
+
+    // Clusters by first appearance; medoids without points (duplicate points) are dropped
+    std::vector<int> label_of(result.medoids.size(), -1);
+    std::vector<int> medoids;
+    for (int &label : result.labels) {
+        if (label_of[label] < 0) {
+            label_of[label] = static_cast<int>(medoids.size());
+            medoids.push_back(result.medoids[label]);
+        }
+        label = label_of[label];
+    }
+    result.medoids = std::move(medoids);
+    return result;
+}
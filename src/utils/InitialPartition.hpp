@@ -0,0 +1,86 @@
+/**
+ * @file InitialPartition.hpp
+ * @brief Starting partition for the chains, by k-medoids on the distances
+ *
+ * @author Filippo Galli
+ * @date 2025
+ */
+
+#pragma once
+
+#include "Params.hpp"
+#include "Rng.hpp"
+#include <vector>
+
+/**
+ * @class InitialPartition
+ * @brief CLARA-style k-medoids partition of the points, from the distances of a Params
+ *
+ * Each restart draws a sample of the points, seeds K medoids among them by k-medoids++ (each new
+ * medoid drawn with probability proportional to its distance to the closest medoid so far), and
+ * runs the alternating k-medoids iteration on the sample: every sample point joins its closest
+ * medoid, every medoid moves to the member minimizing the sum of distances to its cluster. All n
+ * points are then assigned to their closest medoid, and the restart with the smallest sum of
+ * distances to the medoids is kept (Kaufman and Rousseeuw's CLARA). A restart reads
+ * O(s^2 + n K) distances for a sample of s points, through Params::distance(), so it works on
+ * every storage (dense, mapped, single precision, packed); restarts run on OpenMP threads.
+ *
+ * The partition is a start for the chains far closer to the posterior than the single cluster
+ * Data falls back to, so it shortens the burn-in of the split-merge samplers.
+ *
+ * Reference: Kaufman, L., Rousseeuw, P. J. (1990) "Finding Groups in Data", chapter 3 (CLARA);
+ * Arthur, D., Vassilvitskii, S. (2007) "k-means++: the advantages of careful seeding"
+ */
+class InitialPartition {
+public:
+    /** @brief Options of the search */
+    struct Options {
+        int K = 0;               ///< Number of clusters (0: expected number under the DP prior, see expected_clusters())
+        int restarts = 5;        ///< Independent samples
+        int sample_size = 0;     ///< Points per sample (0: 40 + 20 K), at most n
+        int max_iterations = 20; ///< Maximum k-medoids iterations per sample
+        int n_threads = 0;       ///< OpenMP threads (0: default)
+    };
+
+    /** @brief Best partition found */
+    struct Result {
+        std::vector<int> labels;  ///< Cluster of each point, 0-based and ordered by first appearance
+        std::vector<int> medoids; ///< Medoid of each cluster
+        double cost = 0.0;        ///< Sum of the distances of the points to their medoid
+        int restart = 0;          ///< Index of the winning restart
+    };
+
+    /**
+     * @brief Expected number of clusters of n points under a DP prior
+     * @param a Total mass
+     * @param n Number of points
+     * @return sum_{i < n} a / (a + i)
+     *
+     * @details Also the sigma -> 0 limit of the NGGP with the same total mass; with sigma > 0 the
+     * NGGP expects more clusters, so pass Options::K explicitly for it.
+     */
+    static double expected_clusters(double a, int n);
+
+    /**
+     * @brief Searches the k-medoids partition of the points of params
+     * @param params Parameters holding the n x n distances (and a, for the default K)
+     * @param options Search options
+     * @param rng Master generator; one stream is split off per restart
+     * @return Best partition over the restarts (ties go to the lowest restart); it has fewer than
+     * K clusters only if the distances tie (duplicate points)
+     * @throws std::invalid_argument if there are no points or the options are invalid
+     */
+    static Result k_medoids(const Params &params, const Options &options, Rng &rng);
+
+private:
+    /**
+     * @brief Runs one restart
+     * @param params Parameters holding the distances
+     * @param K Resolved number of clusters
+     * @param s Resolved sample size
+     * @param max_iterations Maximum k-medoids iterations on the sample
+     * @param rng Generator of the restart
+     * @param result Output partition (labels not yet relabelled) with its cost
+     */
+    static void search(const Params &params, int K, int s, int max_iterations, Rng &rng, Result &result);
+};
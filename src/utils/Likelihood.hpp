@@ -12,8 +12,17 @@
 
 #pragma once
 
+#include "CountTables.hpp"
 #include "Data.hpp"
 #include "Params.hpp"
+#include "gather_kernels.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 /**
  * @class Likelihood
@@ -23,14 +32,237 @@
  * Derived classes must implement methods for computing both cluster-level and
  * point-level conditional log-likelihoods, which are essential for Gibbs and
  * split-merge MCMC algorithms.
+ *
+ * @note The const methods are not reentrant: they share the mutable row and per-cluster scratch
+ * buffers below, so one likelihood must not be called from two threads at once. Parallelism
+ * goes inside the calls instead (point_loglikelihood_cond_all_parallel()), where the threads
+ * read the shared state and write disjoint slices of the buffers. Reentrant const methods are
+ * deferred: they would need caller-owned scratch passed through every derived likelihood, and
+ * no caller needs them, since each chain owns its likelihood.
  */
 class Likelihood {
 protected:
     const Data &data;     ///< Reference to Data object with distances and allocations
     const Params &params; ///< Reference to model parameters
 
+    const double *D_data;        ///< Dense D, in memory or mapped (nullptr: other storage), see Params::get_D_data()
+    const DistancePair *D_pairs; ///< Single-precision D / log D (nullptr: double storage), see Params::use_single_precision()
+
+    const PackedDistances *D_packed; ///< Packed D / log D (nullptr: dense storage), see Params::use_packed_storage()
+
+    mutable std::vector<double> packed_row_buf;     ///< Dense row of D materialized from D_packed
+    mutable std::vector<double> packed_log_row_buf; ///< Dense row of log D materialized from D_packed
+    mutable int packed_row_point = -1;              ///< Point whose row is in the buffers (-1: none)
+
+    /**
+     * @brief Materializes the row of a point from the packed storage, unless already there
+     * @param point_index Index of the point
+     *
+     * D never changes, so the buffers stay valid until another row is requested: the scalar
+     * conditionals of one point (one call per candidate cluster) pay a single O(n) copy.
+     */
+    void load_packed_row(int point_index) const {
+        if (packed_row_point == point_index)
+            return;
+        packed_row_buf.resize(params.n);
+        packed_log_row_buf.resize(params.n);
+        D_packed->materialize_row(point_index, packed_row_buf.data(), packed_log_row_buf.data());
+        packed_row_point = point_index;
+    }
+
+    mutable std::vector<double> point_sum_buf;     ///< Per-cluster sums of D(point, .), see accumulate_point_sums()
+    mutable std::vector<double> point_log_sum_buf; ///< Per-cluster sums of log D(point, .)
+
+    mutable std::vector<double> partial_sum_buf;     ///< Per-thread partial sums of D(point, .), see accumulate_point_sums()
+    mutable std::vector<double> partial_log_sum_buf; ///< Per-thread partial sums of log D(point, .)
+
+    /**
+     * @brief Dispatch loop of accumulate_point_sums_range() over one row
+     * @tparam WithLog false to read the D row only, log_sum being left untouched
+     */
+    template <bool WithLog>
+    static void accumulate_row(const int *__restrict__ alloc, const double *__restrict__ D_row,
+                               const double *__restrict__ logD_row, int begin, int end, double *__restrict__ sum,
+                               double *__restrict__ log_sum) {
+        for (int j = begin; j < end; ++j) {
+            const int c = alloc[j];
+            if (c < 0)
+                continue;
+            sum[c] += D_row[j];
+            if constexpr (WithLog)
+                log_sum[c] += logD_row[j];
+        }
+    }
+
+    /**
+     * @brief Adds D(point, j) and log D(point, j) to the cluster of j, for j in [begin, end)
+     * @param point_index Index of the point
+     * @param log_D_data Flattened log distance matrix (unused unless Params::dense_storage();
+     *        nullptr there if the likelihood has no log-distance term, the log sums then stay 0)
+     * @param begin First column
+     * @param end One past the last column
+     * @param sum Per-cluster sums of D, updated
+     * @param log_sum Per-cluster sums of log D, updated
+     *
+     * Reads only shared state: with packed storage the row must already be loaded
+     * (load_packed_row()), so that threads can run it on disjoint column ranges.
+     */
+    void accumulate_point_sums_range(int point_index, const double *log_D_data, int begin, int end,
+                                     double *__restrict__ sum, double *__restrict__ log_sum) const {
+        const int *__restrict__ alloc = data.get_allocations().data();
+        const size_t row = static_cast<size_t>(point_index) * params.n;
+
+        if (D_pairs) {
+            const DistancePair *__restrict__ pair_row = D_pairs + row;
+            for (int j = begin; j < end; ++j) {
+                const int c = alloc[j];
+                if (c < 0)
+                    continue;
+                sum[c] += pair_row[j].d;
+                log_sum[c] += pair_row[j].log_d;
+            }
+            return;
+        }
+
+        const double *D_row = D_packed ? packed_row_buf.data() : D_data + row;
+        if (D_packed)
+            accumulate_row<true>(alloc, D_row, packed_log_row_buf.data(), begin, end, sum, log_sum);
+        else if (log_D_data)
+            accumulate_row<true>(alloc, D_row, log_D_data + row, begin, end, sum, log_sum);
+        else
+            accumulate_row<false>(alloc, D_row, nullptr, begin, end, sum, log_sum);
+    }
+
+    /**
+     * @brief Sums the distances and log-distances of a point to the members of every cluster
+     * @param point_index Index of the point
+     * @param log_D_data Flattened log distance matrix (unused unless Params::dense_storage())
+     * @param n_threads OpenMP threads (1: serial)
+     *
+     * A single pass over row point_index of D and log D, dispatched on the current allocations,
+     * fills point_sum_buf and point_log_sum_buf with one entry per cluster. Unallocated points
+     * (allocation -1) are skipped.
+     *
+     * With several threads, thread t sums the t-th contiguous block of the row into its own slice
+     * of partial_sum_buf (padded to a cache line), and entry k is then the sum of the slices in
+     * thread order: for a given number of threads the result does not depend on the scheduling,
+     * while it differs from the serial pass in the last bits (different summation order).
+     */
+    void accumulate_point_sums(int point_index, const double *log_D_data, int n_threads = 1) const {
+        const int n = data.get_n();
+        const int K = data.get_K();
+
+        point_sum_buf.assign(K, 0.0);
+        point_log_sum_buf.assign(K, 0.0);
+        if (D_packed)
+            load_packed_row(point_index);
+
+#ifdef _OPENMP
+        if (n_threads > 1) {
+            const int stride = (K + 7) / 8 * 8;
+            partial_sum_buf.resize(static_cast<size_t>(n_threads) * stride);
+            partial_log_sum_buf.resize(static_cast<size_t>(n_threads) * stride);
+
+#pragma omp parallel num_threads(n_threads)
+            {
+                const int threads = omp_get_num_threads();
+                const int t = omp_get_thread_num();
+                double *partial_sum = partial_sum_buf.data() + static_cast<size_t>(t) * stride;
+                double *partial_log_sum = partial_log_sum_buf.data() + static_cast<size_t>(t) * stride;
+                std::fill(partial_sum, partial_sum + K, 0.0);
+                std::fill(partial_log_sum, partial_log_sum + K, 0.0);
+
+                const int begin = static_cast<int>(static_cast<long>(n) * t / threads);
+                const int end = static_cast<int>(static_cast<long>(n) * (t + 1) / threads);
+                accumulate_point_sums_range(point_index, log_D_data, begin, end, partial_sum, partial_log_sum);
+
+#pragma omp barrier
+#pragma omp for schedule(static)
+                for (int k = 0; k < K; ++k) {
+                    double s = 0.0, log_s = 0.0;
+                    for (int u = 0; u < threads; ++u) {
+                        s += partial_sum_buf[static_cast<size_t>(u) * stride + k];
+                        log_s += partial_log_sum_buf[static_cast<size_t>(u) * stride + k];
+                    }
+                    point_sum_buf[k] = s;
+                    point_log_sum_buf[k] = log_s;
+                }
+            }
+            return;
+        }
+#endif
+        (void)n_threads;
+        accumulate_point_sums_range(point_index, log_D_data, 0, n, point_sum_buf.data(), point_log_sum_buf.data());
+    }
+
+    // ========== Storage-independent reductions ==========
+    // Forward to the gather_kernels overload matching the storage mode of params. On the dense
+    // storage a null log_D_data selects the D-only kernels and returns log sums of 0.
+
+    /**
+     * @brief Sums D(point, .) and log D(point, .) over a member set
+     * @param point_index Index of the point (row)
+     * @param log_D_data Flattened log distance matrix (unused unless Params::dense_storage())
+     * @param idx Member indices
+     * @param m Number of members
+     * @param sum Output: sum of D
+     * @param log_sum Output: sum of log D
+     */
+    void row_sum2(int point_index, const double *log_D_data, const int *idx, int m, double &sum,
+                  double &log_sum) const {
+        const size_t row = static_cast<size_t>(point_index) * params.n;
+        if (D_pairs) {
+            gather_kernels::gather_sum2(D_pairs + row, idx, m, sum, log_sum);
+        } else if (D_packed) {
+            load_packed_row(point_index);
+            gather_kernels::gather_sum2(packed_row_buf.data(), packed_log_row_buf.data(), idx, m, sum, log_sum);
+        } else if (log_D_data) {
+            gather_kernels::gather_sum2(D_data + row, log_D_data + row, idx, m, sum, log_sum);
+        } else {
+            sum = gather_kernels::gather_sum(D_data + row, idx, m);
+            log_sum = 0.0;
+        }
+    }
+
+    /**
+     * @brief Sums D and log D over the unordered pairs of a member set
+     * @see gather_kernels::pair_sum2()
+     */
+    void pair_sum2(const double *log_D_data, const int *idx, int m, double &sum, double &log_sum) const {
+        if (D_pairs) {
+            gather_kernels::pair_sum2(D_pairs, params.n, idx, m, sum, log_sum);
+        } else if (D_packed) {
+            D_packed->pair_sum2(idx, m, sum, log_sum);
+        } else if (log_D_data) {
+            gather_kernels::pair_sum2(D_data, log_D_data, params.n, idx, m, sum, log_sum);
+        } else {
+            sum = gather_kernels::pair_sum(D_data, params.n, idx, m);
+            log_sum = 0.0;
+        }
+    }
+
+    /**
+     * @brief Sums D and log D over the cross pairs of two disjoint member sets
+     * @see gather_kernels::cross_sum2()
+     */
+    void cross_sum2(const double *log_D_data, const int *idx_k, int m_k, const int *idx_t, int m_t, double &sum,
+                    double &log_sum) const {
+        if (D_pairs) {
+            gather_kernels::cross_sum2(D_pairs, params.n, idx_k, m_k, idx_t, m_t, sum, log_sum);
+        } else if (D_packed) {
+            D_packed->cross_sum2(idx_k, m_k, idx_t, m_t, sum, log_sum);
+        } else if (log_D_data) {
+            gather_kernels::cross_sum2(D_data, log_D_data, params.n, idx_k, m_k, idx_t, m_t, sum, log_sum);
+        } else {
+            sum = gather_kernels::cross_sum(D_data, params.n, idx_k, m_k, idx_t, m_t);
+            log_sum = 0.0;
+        }
+    }
+
 public:
-    Likelihood(const Data &data, const Params &param) : data(data), params(param) {}
+    Likelihood(const Data &data, const Params &param)
+        : data(data), params(param), D_data(param.dense_storage() ? param.get_D_data() : nullptr),
+          D_pairs(param.get_D_pairs()), D_packed(param.get_D_packed()) {}
 
     /**
      * @brief Computes the log-likelihood for a cluster
@@ -52,6 +284,40 @@ public:
     virtual double cluster_loglikelihood(int cluster_index,
                                          const Eigen::Ref<const Eigen::VectorXi> &cls_ass_k) const = 0;
 
+    /**
+     * @struct PairLoglikelihood
+     * @brief Log-likelihoods entering a split-merge acceptance ratio, see pair_loglikelihood()
+     */
+    struct PairLoglikelihood {
+        double ci;     ///< cluster_loglikelihood(ci)
+        double cj;     ///< cluster_loglikelihood(cj)
+        double merged; ///< cluster_loglikelihood() of ci and cj merged into one cluster
+    };
+
+    /**
+     * @brief Log-likelihoods of two clusters and of their union, from the current state
+     * @param ci First cluster
+     * @param cj Second cluster (cj != ci)
+     * @return The three terms, merged being the value cluster_loglikelihood(ci) would take after
+     * moving every point of cj to ci, the other clusters unchanged
+     * @throws std::logic_error (default) unless the likelihood is cluster_local()
+     * @note A split or merge proposal only changes ci and cj within their union, so one call on
+     * the split side of the move (after the launch state of a split, before a merge) gives both
+     * sides of the likelihood ratio, and the proposal never evaluates a cluster a second time.
+     * Likelihoods with sufficient statistics override it so that the union reuses the sums of
+     * the two parts. The default evaluates the union on the concatenated members, which is
+     * exact only when a cluster reads no other cluster.
+     */
+    virtual PairLoglikelihood pair_loglikelihood(int ci, int cj) const {
+        if (!cluster_local())
+            throw std::logic_error("Likelihood: the union of two clusters needs an override of pair_loglikelihood");
+        auto members_i = data.get_cluster_assignments_ref(ci);
+        auto members_j = data.get_cluster_assignments_ref(cj);
+        Eigen::VectorXi merged(members_i.size() + members_j.size());
+        merged << members_i, members_j;
+        return {cluster_loglikelihood(ci), cluster_loglikelihood(cj), cluster_loglikelihood(ci, merged)};
+    }
+
     /**
      * @brief Conditional log-likelihood of a point in a particular cluster
      * @param point_index Index of the point to evaluate
@@ -62,5 +328,103 @@ public:
 
     virtual double point_loglikelihood_cond(int point_index, int cluster_index) const = 0;
 
+    /**
+     * @brief Log-odds of a point joining cluster ci rather than cluster cj
+     * @param point_index Index of the point (must be unallocated)
+     * @param ci First cluster
+     * @param cj Second cluster
+     * @return point_loglikelihood_cond(point_index, ci) - point_loglikelihood_cond(point_index, cj)
+     * @note Used by the restricted Gibbs scans of the split-merge samplers, which choose between
+     * two clusters only. The default takes the difference of the two conditionals; likelihoods
+     * whose conditionals share terms from the other clusters (repulsion) override it so that only
+     * the members of ci and cj are read, O(n_ci + n_cj) instead of O(n).
+     */
+    virtual double point_loglikelihood_odds(int point_index, int ci, int cj) const {
+        return point_loglikelihood_cond(point_index, ci) - point_loglikelihood_cond(point_index, cj);
+    }
+
+    /**
+     * @brief Conditional log-likelihood of a point for every candidate cluster at once
+     * @param point_index Index of the point to evaluate
+     * @param out Output vector of size K + 1: entry k equals point_loglikelihood_cond(point_index, k),
+     * entry K is the value for a new cluster
+     * @note Useful for Gibbs sampling. The default implementation calls point_loglikelihood_cond()
+     * K + 1 times; distance likelihoods override it with a single O(n) pass.
+     */
+
+    virtual void point_loglikelihood_cond_all(int point_index, Eigen::Ref<Eigen::VectorXd> out) const {
+        const int K = data.get_K();
+        for (int k = 0; k <= K; ++k)
+            out(k) = point_loglikelihood_cond(point_index, k);
+    }
+
+    /**
+     * @brief point_loglikelihood_cond_all() with the work split over OpenMP threads
+     * @param point_index Index of the point to evaluate
+     * @param out Output vector of size K + 1, as point_loglikelihood_cond_all()
+     * @param n_threads Number of threads
+     * @note Called by the Sampler Gibbs kernel on large updates (see Sampler::set_gibbs_threads()).
+     * The default runs the serial version; likelihoods built on accumulate_point_sums() split the
+     * pass over the row and the scoring of the candidates, with results reproducible for a given
+     * number of threads.
+     */
+    virtual void point_loglikelihood_cond_all_parallel(int point_index, Eigen::Ref<Eigen::VectorXd> out,
+                                                       int n_threads) const {
+        (void)n_threads;
+        point_loglikelihood_cond_all(point_index, out);
+    }
+
+    /**
+     * @brief Conditional log-likelihood of a point joining an arbitrary set of points
+     * @param point_index Index of the point (not among the members)
+     * @param members Indices of the points of the set, which need not be a cluster of the data
+     * @return Within-set (cohesion) term of adding the point to the set; 0 for an empty set
+     * @note Used by SubClusterSplitMerge for its sub-clusters. Called from several threads at once,
+     * so implementations must not write shared buffers (the packed storage row buffer is one:
+     * the sampler stays serial with it). The default throws std::logic_error.
+     */
+    virtual double point_loglikelihood_members(int point_index,
+                                               const Eigen::Ref<const Eigen::VectorXi> &members) const {
+        (void)point_index;
+        (void)members;
+        throw std::logic_error("Likelihood: conditionals on arbitrary point sets are not supported");
+    }
+
+    /**
+     * @brief Whether the log-likelihood of a cluster depends only on its own members
+     * @return true if cluster_loglikelihood(k) and point_loglikelihood_cond(i, k) read no other
+     * cluster (cohesion-only likelihoods), false otherwise (default, e.g. repulsion terms)
+     * @note Moves on disjoint clusters then commute, which ParallelSplitMerge relies on
+     */
+    [[nodiscard]] virtual bool cluster_local() const { return false; }
+
+    /**
+     * @brief Whether the point conditionals are increments of the cluster log-likelihoods
+     * @return true if point_loglikelihood_cond(i, k) is cluster_loglikelihood() of k with i minus
+     * that of k without it, for every cluster and the new one; false (default) if the conditional
+     * is a model of its own, as the per-point rates of the distance likelihoods
+     * @note The Gibbs log-weights then give the likelihood change of a move for free
+     * (Sampler::sample_gibbs_move())
+     */
+    [[nodiscard]] virtual bool exact_conditionals() const { return false; }
+
+    /**
+     * @brief Power the log-likelihoods of the model are raised to
+     * @return 1 (default); the inverse temperature beta for Tempered_likelihood
+     * @note The samplers divide the likelihood changes of their moves by it, so the running
+     * log-likelihood of the Data (Data::get_running_log_likelihood()) is always untempered
+     */
+    [[nodiscard]] virtual double inverse_temperature() const { return 1.0; }
+
+    /**
+     * @brief Heap bytes of the scratch rows and per-cluster sums (the distances belong to Params)
+     * @see MemoryReport
+     */
+    virtual std::size_t memory_bytes() const {
+        return MemoryReport::bytes(packed_row_buf) + MemoryReport::bytes(packed_log_row_buf) +
+               MemoryReport::bytes(point_sum_buf) + MemoryReport::bytes(point_log_sum_buf) +
+               MemoryReport::bytes(partial_sum_buf) + MemoryReport::bytes(partial_log_sum_buf);
+    }
+
     virtual ~Likelihood() = default;
 };
\ No newline at end of file
@@ -0,0 +1,140 @@
+/**
+ * @file MappedDistances.cpp
+ * @brief Implementation of the MappedDistances class
+ */
+
+#include "MappedDistances.hpp"
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+constexpr char magic[8] = {'B', 'N', 'P', 'D', 'I', 'S', 'T', '1'};
+
+} // namespace
+
+MappedDistances::MappedDistances(const std::string &path) {
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open distance file " + path + ": " + std::strerror(errno));
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < header_size) {
+        ::close(fd);
+        throw std::runtime_error("Distance file " + path + " is too short");
+    }
+    length = static_cast<std::size_t>(st.st_size);
+
+    base = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping keeps the file alive
+    ::close(fd);
+    if (base == MAP_FAILED) {
+        base = nullptr;
+        throw std::runtime_error("Cannot map distance file " + path + ": " + std::strerror(errno));
+    }
+
+    const char *bytes = static_cast<const char *>(base);
+    std::int64_t n64;
+    std::memcpy(&n64, bytes + 8, sizeof(n64));
+    const std::size_t cells = n64 > 0 ? static_cast<std::size_t>(n64) * static_cast<std::size_t>(n64) : 0;
+    if (std::memcmp(bytes, magic, sizeof(magic)) != 0 || n64 < 0 || n64 > INT32_MAX ||
+        length != header_size + 2 * cells * sizeof(double)) {
+        ::munmap(base, length);
+        base = nullptr;
+        throw std::runtime_error("Distance file " + path + " is not a valid distance file");
+    }
+
+    n = static_cast<int>(n64);
+    D = reinterpret_cast<const double *>(bytes + header_size);
+    log_D = D + cells;
+}
+
+MappedDistances::~MappedDistances() {
+    if (base) {
+        ::munmap(base, length);
+    }
+}
+
+void MappedDistances::write(const std::string &path, const Eigen::MatrixXd &D_full) {
+    if (D_full.rows() != D_full.cols()) {
+        throw std::invalid_argument("Distance matrix must be square");
+    }
+
+    std::unique_ptr<std::FILE, int (*)(std::FILE *)> file(std::fopen(path.c_str(), "wb"), &std::fclose);
+    if (!file) {
+        throw std::runtime_error("Cannot create distance file " + path + ": " + std::strerror(errno));
+    }
+
+    const std::int64_t n64 = D_full.rows();
+    const std::int64_t reserved = 0;
+    const std::size_t cells = static_cast<std::size_t>(D_full.size());
+    bool ok = std::fwrite(magic, 1, sizeof(magic), file.get()) == sizeof(magic);
+    ok = ok && std::fwrite(&n64, sizeof(n64), 1, file.get()) == 1;
+    ok = ok && std::fwrite(&reserved, sizeof(reserved), 1, file.get()) == 1;
+    ok = ok && std::fwrite(D_full.data(), sizeof(double), cells, file.get()) == cells;
+
+    // log D column by column, so the whole matrix is never held twice
+    std::vector<double> log_col(D_full.rows());
+    for (Eigen::Index j = 0; ok && j < D_full.cols(); ++j) {
+        for (Eigen::Index i = 0; i < D_full.rows(); ++i) {
+            log_col[i] = std::log(D_full(i, j));
+        }
+        ok = std::fwrite(log_col.data(), sizeof(double), log_col.size(), file.get()) == log_col.size();
+    }
+
+    if (!ok || std::fflush(file.get()) != 0) {
+        throw std::runtime_error("Error while writing distance file " + path);
+    }
+}
+
+void MappedDistances::create(const std::string &path, int n,
+                             const std::function<void(double *D, double *log_D)> &fill) {
+    if (n < 0) {
+        throw std::invalid_argument("Number of points must be non-negative");
+    }
+
+    const int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot create distance file " + path + ": " + std::strerror(errno));
+    }
+
+    const std::size_t cells = static_cast<std::size_t>(n) * static_cast<std::size_t>(n);
+    const std::size_t file_length = header_size + 2 * cells * sizeof(double);
+    if (::ftruncate(fd, static_cast<off_t>(file_length)) != 0) {
+        const std::string reason = std::strerror(errno);
+        ::close(fd);
+        throw std::runtime_error("Cannot size distance file " + path + ": " + reason);
+    }
+
+    void *mapping = ::mmap(nullptr, file_length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        throw std::runtime_error("Cannot map distance file " + path + ": " + std::strerror(errno));
+    }
+    std::unique_ptr<void, std::function<void(void *)>> guard(mapping,
+                                                             [file_length](void *p) { ::munmap(p, file_length); });
+
+    char *bytes = static_cast<char *>(mapping);
+    const std::int64_t n64 = n;
+    const std::int64_t reserved = 0;
+    std::memcpy(bytes, magic, sizeof(magic));
+    std::memcpy(bytes + 8, &n64, sizeof(n64));
+    std::memcpy(bytes + 16, &reserved, sizeof(reserved));
+
+    double *D_file = reinterpret_cast<double *>(bytes + header_size);
+    fill(D_file, D_file + cells);
+
+    if (::msync(mapping, file_length, MS_SYNC) != 0) {
+        throw std::runtime_error("Error while writing distance file " + path + ": " + std::strerror(errno));
+    }
+}
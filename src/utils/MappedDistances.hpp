@@ -0,0 +1,90 @@
+/**
+ * @file MappedDistances.hpp
+ * @brief Read-only memory-mapped file holding a distance matrix and its logarithm
+ *
+ * @author Filippo Galli
+ * @date 2025
+ */
+
+#pragma once
+
+#include <Eigen/Dense>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+/**
+ * @class MappedDistances
+ * @brief Dense D and log D read straight from a file mapped with mmap
+ *
+ * File layout (native endianness, all little-endian on the hosts we run on):
+ * - 8 bytes: magic "BNPDIST1"
+ * - 8 bytes: n as a signed 64-bit integer
+ * - 8 bytes: reserved, 0 (keeps the matrices 8-byte aligned at offset 24 and room for flags)
+ * - n * n doubles: D, column-major
+ * - n * n doubles: log D, column-major
+ *
+ * The mapping is read-only and shared, so opening a file costs no copy and no logarithm, pages
+ * are loaded on first touch, and concurrent jobs on the same host share one copy in the page
+ * cache. Write the file once with write().
+ */
+class MappedDistances {
+private:
+    int n = 0;                     ///< Number of points
+    void *base = nullptr;          ///< Start of the mapping
+    std::size_t length = 0;        ///< Length of the mapping in bytes
+    const double *D = nullptr;     ///< D inside the mapping
+    const double *log_D = nullptr; ///< log D inside the mapping
+
+public:
+    /** @brief Size of the file header in bytes */
+    static constexpr std::size_t header_size = 24;
+
+    /**
+     * @brief Maps a distance file
+     * @param path Path of a file written by write()
+     * @throws std::runtime_error if the file cannot be opened or mapped, or is not a valid distance file
+     */
+    explicit MappedDistances(const std::string &path);
+
+    MappedDistances(const MappedDistances &) = delete;
+    MappedDistances &operator=(const MappedDistances &) = delete;
+
+    ~MappedDistances();
+
+    /**
+     * @brief Writes a distance file
+     * @param path Output path (overwritten)
+     * @param D_full Dense distance matrix
+     * @throws std::invalid_argument if D_full is not square
+     * @throws std::runtime_error if the file cannot be written
+     */
+    static void write(const std::string &path, const Eigen::MatrixXd &D_full);
+
+    /**
+     * @brief Writes a distance file filled in place, without a dense D in memory
+     * @param path Output path (overwritten)
+     * @param n Number of points
+     * @param fill Called once with the writable D and log D of the file (n x n each, column-major,
+     * every entry 0); it must set both
+     * @throws std::invalid_argument if n is negative
+     * @throws std::runtime_error if the file cannot be created, mapped or synced
+     *
+     * The file is sized and mapped read-write, so fill writes the pages of the file directly
+     * (and may do so from several threads): the matrices are materialized once, on disk.
+     */
+    static void create(const std::string &path, int n, const std::function<void(double *D, double *log_D)> &fill);
+
+    /** @brief Number of points */
+    int size() const { return n; }
+
+    /** @brief Length of the mapping in bytes (file-backed pages, shared by every process mapping the file) */
+    std::size_t memory_bytes() const { return length; }
+
+    /** @brief Mapped D (n x n, column-major) */
+    const double *get_D() const { return D; }
+
+    /** @brief Mapped log D (n x n, column-major) */
+    const double *get_log_D() const { return log_D; }
+};
@@ -0,0 +1,122 @@
+/**
+ * @file MemoryReport.cpp
+ * @brief Implementation of the up-front memory estimate
+ */
+
+#include "MemoryReport.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+
+MemoryReport MemoryReport::estimate(const Config &config) {
+    if (config.n <= 0) {
+        throw std::invalid_argument("MemoryReport: n must be positive");
+    }
+    const double n = config.n;
+    const double K = config.K > 0 ? config.K : std::max(1.0, std::ceil(std::sqrt(n)));
+    const double chains = std::max(config.chains, 1);
+    const double square = n * n * sizeof(double);
+    const bool log_distances = config.log_distances;
+
+    MemoryReport report;
+    const auto add = [&](const std::string &component, const std::string &type, double bytes) {
+        if (bytes > 0.0)
+            report.add(nullptr, component, type, static_cast<std::size_t>(std::llround(bytes)));
+    };
+
+    // ========== Distances (shared by the chains) ==========
+
+    if (config.storage == "dense") {
+        add("params", "D", square);
+        if (log_distances)
+            add("params", "log_D", square);
+    } else if (config.storage == "single") {
+        add("params", "single", square); // n^2 pairs of two floats
+        add("startup", "single", square);
+    } else if (config.storage == "packed") {
+        add("params", "packed", n * (n - 1) / 2 * 2 * sizeof(double) + n * sizeof(double));
+        add("startup", "packed", square);
+    } else if (config.storage == "mapped") {
+        add("params", "mapped", 2 * square + 24);
+    } else if (config.storage == "placed") {
+        const double huge_page = 2.0 * 1024 * 1024;
+        add("params", "placed",
+            std::max(config.replicas, 1) * std::ceil(2 * square / huge_page) * huge_page);
+        add("startup", "placed", square);
+    } else {
+        throw std::invalid_argument("MemoryReport: unknown storage \"" + config.storage + "\"");
+    }
+    if (config.from_r)
+        add("R", "matrix", square);
+
+    // ========== Per chain ==========
+
+    add("data", "Data", chains * (5 * n * sizeof(int) + K * sizeof(std::vector<int>)));
+
+    if (config.distance_cache)
+        add("cache", "DistanceCache",
+            chains * (n * sizeof(int) + 16 * K + 2 * (2 * K) * (2 * K) * sizeof(double) + 2 * n * sizeof(double)));
+    if (config.cluster_layout)
+        add("cache", "ClusterLayout", chains * (square * (log_distances ? 2 : 1) + 24 * n + 8 * K));
+
+    if (config.knn > 0)
+        add("likelihood", "Knn_Natarajan_likelihood", chains * (n * config.knn * 20.0 + 16 * n));
+    else
+        add("likelihood", "Natarajan_likelihood",
+            chains * (2 * K * sizeof(double) + (config.storage == "packed" ? 2 * n * sizeof(double) : 0.0)));
+
+    if (config.spatial_edges >= 0) {
+        const double E = static_cast<double>(config.spatial_edges);
+        add("cache", "SpatialCache", chains * (2 * ((n + 1) * sizeof(int) + 2 * E * sizeof(int)) + 8 * n + 16 * E +
+                                               4 * K));
+    }
+
+    if (config.multi_covariates) {
+        const double d = config.continuos_covariates, b = config.binary_covariates;
+        if (d > 0)
+            add("cache", "MultiContinuosCache", chains * (K * sizeof(int) + 2 * K * d * sizeof(double) +
+                                                          n * d * sizeof(double)));
+        if (b > 0) {
+            const double words = std::ceil(b / 64);
+            add("cache", "MultiBinaryCache", chains * (K * sizeof(int) + K * b * sizeof(int) +
+                                                       n * words * sizeof(std::uint64_t)));
+            add("module", "MultiBinaryCovariatesModuleCache", chains * 4 * (n + 1) * b * sizeof(double));
+        }
+    } else {
+        add("cache", "ContinuosCache",
+            chains * config.continuos_covariates * (n * sizeof(double) + 3 * K * sizeof(double)));
+        add("cache", "BinaryCache", chains * config.binary_covariates * (n * sizeof(int) + 2 * K * sizeof(int)));
+        add("module", "BinaryCovariatesModuleCache",
+            chains * config.binary_covariates * 2 * K * sizeof(int));
+    }
+    const double levels = std::max(config.categories, 1);
+    add("cache", "CategoricalCache", chains * config.categorical_covariates *
+                                         (n * sizeof(int) + K * (sizeof(std::vector<int>) + 8 + levels * sizeof(int))));
+    add("module", "CategoricalCovariatesModuleCache",
+        chains * config.categorical_covariates * (levels + 2 * (n + 1) * levels) * sizeof(double));
+
+    // Allocations and members before a move, kept by every process
+    add("process", "snapshot", chains * (2 * n * sizeof(int) + K * sizeof(std::vector<int>)));
+
+    // Neal3 and the SDDS split-merge, the default stack; the anchor tables keep 32 candidates per
+    // point for each of the two weightings (index, alias slot and threshold)
+    add("sampler", "Neal3 + SplitMerge_LSS_SDDS", chains * (2 * (n + 1) * sizeof(double) + 16 * n));
+    add("sampler", "AnchorTables", chains * (2 * n * (32 * 16 + 3 * sizeof(double)) + n * sizeof(double)));
+
+    // ========== Output ==========
+
+    if (config.saved_samples > 0)
+        add("trace", "samples", chains * config.saved_samples * (2 * n * sizeof(int) + 4 * sizeof(double)));
+
+    if (config.co_clustering == "dense")
+        add("co_clustering", "dense", chains * n * n * sizeof(std::uint32_t));
+    else if (config.co_clustering == "packed")
+        add("co_clustering", "packed", chains * (2 * n * (n - 1) + n * sizeof(std::size_t)));
+    else if (config.co_clustering == "sparse")
+        add("co_clustering", "sparse", chains * n * n / (2 * K) * 32);
+    else if (config.co_clustering != "none")
+        throw std::invalid_argument("MemoryReport: unknown co-clustering layout \"" + config.co_clustering + "\"");
+
+    return report;
+}
@@ -0,0 +1,122 @@
+/**
+ * @file MemoryReport.hpp
+ * @brief Resident bytes of the components of a chain, measured or estimated before building them
+ *
+ * @author Filippo Galli
+ * @date 2025
+ */
+
+#pragma once
+
+#include <Eigen/Dense>
+#include <cstddef>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * @class MemoryReport
+ * @brief Table of the heap bytes held by each component of one or more chains
+ *
+ * Every Data, ClusterInfo, Module, Likelihood, Process and Sampler reports the bytes of the
+ * containers it owns through its memory_bytes() (capacity, not size: what the allocator holds),
+ * and Params those of its distance stores. Shared objects — a Params under several chains, a
+ * module referenced by a process and listed again — are entered once: add() keys them by address.
+ * Scalars, the object itself (sizeof) and the O(n) tables shared through CountTables are not
+ * counted; a mapped distance file is reported as its mapped length, though its pages are shared
+ * by every process mapping it.
+ *
+ * estimate() predicts the same table from n, K and the configuration alone, with the formulas of
+ * the containers the components allocate, so the peak of a run can be checked before anything
+ * is allocated.
+ */
+class MemoryReport {
+public:
+    /** @brief One component */
+    struct Entry {
+        std::string component; ///< Role in the chain ("params", "data", "cache", "likelihood", ...)
+        std::string type;      ///< Concrete class, or store for the distances
+        std::size_t bytes;     ///< Heap bytes
+    };
+
+    /** @brief Configuration of estimate() */
+    struct Config {
+        int n = 0;                      ///< Number of points
+        int K = 0;                      ///< Number of clusters (0: sqrt(n))
+        int chains = 1;                 ///< Chains sharing the Params
+        std::string storage = "dense";  ///< "dense", "single", "packed", "mapped" or "placed"
+        int replicas = 1;               ///< Copies of the placed distances (placement "replicate")
+        bool log_distances = true;      ///< Whether the likelihood reads log D (Params::uses_log_distances())
+        bool from_r = true;             ///< D passed as an R matrix (held by R during the run)
+        bool distance_cache = false;    ///< DistanceCache registered
+        bool cluster_layout = false;    ///< ClusterLayout registered
+        int knn = 0;                    ///< Neighbours of Knn_Natarajan_likelihood (0: exact likelihood)
+        long spatial_edges = -1;        ///< Undirected edges of W (-1: no spatial cache and module)
+        int continuos_covariates = 0;   ///< Continuous covariates (one cache and module each, or one multi)
+        int binary_covariates = 0;      ///< Binary covariates (one cache and module each, or one multi)
+        int categorical_covariates = 0; ///< Categorical covariates (one cache and module each)
+        int categories = 2;             ///< Levels of each categorical covariate
+        bool multi_covariates = false;  ///< Continuous and binary covariates in the multi caches
+        int saved_samples = 0;          ///< Saved draws per chain returned to R (NI / thin)
+        std::string co_clustering = "none"; ///< "none", "dense", "packed" or "sparse" accumulator
+    };
+
+    /**
+     * @brief Adds a component, unless the object was already added
+     * @param object Address of the object (nullptr: always added)
+     * @param component Role in the chain
+     * @param type Concrete class or store
+     * @param bytes Heap bytes
+     * @return True if the entry was added
+     */
+    bool add(const void *object, const std::string &component, const std::string &type, std::size_t bytes) {
+        if (object && !seen.insert(object).second)
+            return false;
+        items.push_back({component, type, bytes});
+        return true;
+    }
+
+    /** @brief Entries, in the order they were added */
+    const std::vector<Entry> &entries() const { return items; }
+
+    /** @brief Sum of the entries */
+    std::size_t total() const {
+        std::size_t sum = 0;
+        for (const Entry &entry : items)
+            sum += entry.bytes;
+        return sum;
+    }
+
+    /**
+     * @brief Predicted table of a configuration, without allocating any component
+     * @param config Sizes and components (see Config)
+     * @return One entry per component, with per-chain components multiplied by config.chains; the
+     * entry "startup" is the transient peak while the distances are converted
+     * @throws std::invalid_argument if n is not positive, or the storage or co-clustering layout is unknown
+     */
+    static MemoryReport estimate(const Config &config);
+
+    // ========== Container sizes ==========
+
+    /** @brief Heap bytes of a vector (its capacity) */
+    template <typename T> static std::size_t bytes(const std::vector<T> &values) {
+        return values.capacity() * sizeof(T);
+    }
+
+    /** @brief Heap bytes of a vector of vectors, the inner ones included */
+    template <typename T> static std::size_t bytes(const std::vector<std::vector<T>> &values) {
+        std::size_t sum = values.capacity() * sizeof(std::vector<T>);
+        for (const std::vector<T> &inner : values)
+            sum += bytes(inner);
+        return sum;
+    }
+
+    /** @brief Heap bytes of a dense Eigen matrix or vector */
+    template <typename Derived> static std::size_t bytes(const Eigen::PlainObjectBase<Derived> &values) {
+        return static_cast<std::size_t>(values.size()) * sizeof(typename Derived::Scalar);
+    }
+
+private:
+    std::vector<Entry> items;             ///< Entries
+    std::unordered_set<const void *> seen; ///< Objects already added
+};
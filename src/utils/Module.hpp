@@ -5,7 +5,12 @@
  * @brief Base class for modules used in processes.
  */
 
+#include "Data.hpp"
 #include <Eigen/Dense>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
 
 /**
  * @class Module
@@ -24,17 +29,17 @@ protected:
      */
     const Eigen::VectorXi *old_allocations_provider;
 
-    /** @brief Provider function for accessing old cluster members map */
-    const std::unordered_map<int, std::vector<int>> *old_cluster_members_provider;
+    /** @brief Provider function for accessing old cluster members */
+    const ClusterMembers *old_cluster_members_provider;
 
 public:
     Module(const Eigen::VectorXi *old_allocations_provider_ = nullptr, 
-           const std::unordered_map<int, std::vector<int>> *old_cluster_members_provider_ = nullptr)
+           const ClusterMembers *old_cluster_members_provider_ = nullptr)
         : old_allocations_provider(old_allocations_provider_), old_cluster_members_provider(old_cluster_members_provider_) {}
 
     void set_old_allocations_provider(const Eigen::VectorXi *provider) { old_allocations_provider = provider; }
 
-    void set_old_cluster_members_provider(const std::unordered_map<int, std::vector<int>> *provider) {
+    void set_old_cluster_members_provider(const ClusterMembers *provider) {
         old_cluster_members_provider = provider;
     }
 
@@ -81,5 +86,84 @@ public:
      */
     virtual Eigen::VectorXd compute_similarity_obs(int obs_idx) const = 0;
 
+    /**
+     * @brief Add the similarity contributions for all existing clusters to a buffer
+     *
+     * Adds compute_similarity_obs(obs_idx, k) to out(k) for every cluster k, without
+     * allocating the vector of contributions. Used by the processes to accumulate the
+     * module terms into the Gibbs prior in place; each contribution is computed as in
+     * compute_similarity_obs(obs_idx) and added once, so the sums are bit-identical.
+     *
+     * @param obs_idx Index of the observation
+     * @param out Buffer of K log priors, incremented in place
+     * @note The modules of the package keep their per-cluster scratch in mutable
+     * members: like the likelihood, a module is not reentrant.
+     */
+    virtual void add_similarity_obs(int obs_idx, Eigen::Ref<Eigen::VectorXd> out) const {
+        out += compute_similarity_obs(obs_idx);
+    }
+
+    /**
+     * @brief Heap bytes of the tables, copies of the data and scratch of the module
+     * @see MemoryReport
+     */
+    virtual std::size_t memory_bytes() const = 0;
+
     virtual ~Module() = default;
 };
+
+/**
+ * @class SimilaritySnapshot
+ * @brief Similarities of the two clusters of a split-merge proposal, taken before its first move
+ *
+ * At the start of a proposal the current allocations are the old ones, so compute_similarity_cls(c,
+ * false), read from the caches of the modules, is the similarity of c under the old allocations.
+ * DPx and NGGPx take it for the clusters of the pair and the prior ratios look it up, instead of
+ * recomputing compute_similarity_cls(c, true) from copies of the allocations and cluster members.
+ */
+class SimilaritySnapshot {
+private:
+    int ci = -1;                ///< Cluster of the first observation of the pair
+    int cj = -1;                ///< Cluster of the second observation of the pair
+    std::vector<double> sim_ci; ///< Similarity of ci, one entry per module
+    std::vector<double> sim_cj; ///< Similarity of cj, one entry per module
+
+public:
+    /**
+     * @brief Stores the similarities of ci and cj under the current allocations
+     * @param modules Modules of the process
+     * @param ci_ Cluster of the first observation of the pair
+     * @param cj_ Cluster of the second observation of the pair
+     */
+    void take(const std::vector<std::shared_ptr<Module>> &modules, int ci_, int cj_) {
+        ci = ci_;
+        cj = cj_;
+        sim_ci.resize(modules.size());
+        sim_cj.resize(modules.size());
+        for (std::size_t m = 0; m < modules.size(); ++m) {
+            sim_ci[m] = modules[m]->compute_similarity_cls(ci, false);
+            sim_cj[m] = ci == cj ? sim_ci[m] : modules[m]->compute_similarity_cls(cj, false);
+        }
+    }
+
+    /** @brief Cluster of the first observation before the proposal */
+    [[nodiscard]] int old_ci() const { return ci; }
+
+    /** @brief Cluster of the second observation before the proposal */
+    [[nodiscard]] int old_cj() const { return cj; }
+
+    /**
+     * @brief Similarity of a cluster of the pair before the proposal
+     * @param m Index of the module
+     * @param c Cluster index, ci or cj
+     * @return The value of compute_similarity_cls(c, true) for module m
+     * @throws std::logic_error if c is neither ci nor cj
+     */
+    [[nodiscard]] double old_similarity(std::size_t m, int c) const {
+        if (c == ci)
+            return sim_ci[m];
+        if (c == cj)
+            return sim_cj[m];
+        throw std::logic_error("SimilaritySnapshot: cluster " + std::to_string(c) + " is not in the proposal");
+    }
+};
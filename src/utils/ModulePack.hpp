@@ -0,0 +1,94 @@
+/**
+ * @file ModulePack.hpp
+ * @brief Fixed list of module types, called without virtual dispatch
+ *
+ * @author Filippo Galli
+ * @date 2025
+ */
+
+#pragma once
+
+#include "Module.hpp"
+#include <memory>
+#include <stdexcept>
+#include <tuple>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief One module of a ModulePack, with its similarity calls bound to the concrete type
+ *
+ * The calls are qualified (module.M::compute_similarity_cls), so the compiler emits a direct
+ * call to M's implementation instead of a lookup in the vtable of Module, and can inline it when
+ * the definition is visible (same translation unit or LTO).
+ */
+template <typename M> struct StaticModule {
+    const M &module; ///< The module
+
+    /** @brief Similarity of a cluster, see Module::compute_similarity_cls() */
+    double cls(int cls_idx, bool old_allo) const { return module.M::compute_similarity_cls(cls_idx, old_allo); }
+
+    /** @brief Similarity of an observation with a cluster, see Module::compute_similarity_obs(int, int) */
+    double obs(int obs_idx, int cls_idx) const { return module.M::compute_similarity_obs(obs_idx, cls_idx); }
+
+    /** @brief Similarities of an observation with every cluster, see Module::compute_similarity_obs(int) */
+    Eigen::VectorXd obs(int obs_idx) const { return module.M::compute_similarity_obs(obs_idx); }
+
+    /** @brief Adds the similarities of an observation to out, see Module::add_similarity_obs() */
+    void add_obs(int obs_idx, Eigen::Ref<Eigen::VectorXd> out) const { module.M::add_similarity_obs(obs_idx, out); }
+};
+
+/**
+ * @class ModulePack
+ * @brief The modules of a process as a tuple of concrete types, in a fixed order
+ *
+ * for_each() visits the modules in order with a fold expression, so a loop written against it
+ * performs the same operations in the same order as the loop over std::vector<shared_ptr<Module>>
+ * in DPx and NGGPx, and gives bit-identical results, without any virtual call.
+ *
+ * @tparam Mods Concrete module types, in the order of the modules
+ */
+template <typename... Mods> class ModulePack {
+private:
+    std::tuple<std::shared_ptr<Mods>...> modules; ///< The modules
+
+    template <std::size_t... I>
+    static std::tuple<std::shared_ptr<Mods>...> cast(const std::vector<std::shared_ptr<Module>> &mods,
+                                                     std::index_sequence<I...>) {
+        return std::tuple<std::shared_ptr<Mods>...>(std::static_pointer_cast<Mods>(mods[I])...);
+    }
+
+    template <std::size_t... I>
+    static bool matches(const std::vector<std::shared_ptr<Module>> &mods, std::index_sequence<I...>) {
+        return ((mods[I] && typeid(*mods[I]) == typeid(Mods)) && ...);
+    }
+
+public:
+    /**
+     * @brief Checks that a list of modules has exactly the types Mods, in order
+     *
+     * Derived types do not match: a qualified call would skip their overrides.
+     */
+    static bool matches(const std::vector<std::shared_ptr<Module>> &mods) {
+        return mods.size() == sizeof...(Mods) && matches(mods, std::index_sequence_for<Mods...>{});
+    }
+
+    /**
+     * @brief Constructor
+     * @param mods Modules, of exactly the types Mods in order
+     * @throws std::invalid_argument if matches(mods) is false
+     */
+    explicit ModulePack(const std::vector<std::shared_ptr<Module>> &mods)
+        : modules(matches(mods) ? cast(mods, std::index_sequence_for<Mods...>{})
+                                : throw std::invalid_argument("ModulePack: modules do not match the compiled types")) {}
+
+    /** @brief Calls f(StaticModule<M>) on each module, in order */
+    template <typename F> void for_each(F &&f) const {
+        std::apply(
+            [&f](const auto &...mod) {
+                (f(StaticModule<typename std::decay_t<decltype(mod)>::element_type>{*mod}), ...);
+            },
+            modules);
+    }
+};
@@ -0,0 +1,136 @@
+/**
+ * @file OnlineESS.hpp
+ * @brief Constant-memory effective sample size of a scalar trace
+ *
+ * @author Filippo Galli
+ * @date 2025
+ */
+
+#pragma once
+
+#include "Checkpoint.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+/**
+ * @class OnlineESS
+ * @brief Batch-means estimate of the effective sample size of a trace, updated one value at a time
+ *
+ * The values are summed into consecutive batches of equal size. When the number of complete
+ * batches reaches max_batches, adjacent batches are merged pairwise and the batch size doubles,
+ * so between max_batches / 2 and max_batches batches are kept whatever the length of the trace
+ * and adding a value is O(1) amortized. The estimate is
+ *   ESS = N var(x) / (b var(batch means)),
+ * with N the values in complete batches, b the batch size and var(x) the sample variance of the
+ * trace (Welford's update): b var(batch means) estimates the asymptotic variance of the mean.
+ * Like any batch-means estimate it is biased upwards while the batches are shorter than the
+ * autocorrelation time, i.e. early in the trace.
+ */
+class OnlineESS {
+private:
+    int max_batches;                ///< Batches kept before merging (even)
+    int64_t count = 0;              ///< Values added
+    double mean = 0.0;              ///< Running mean of the values
+    double m2 = 0.0;                ///< Running sum of squared deviations from the mean
+    int64_t batch_size = 1;         ///< Values per batch
+    int64_t in_batch = 0;           ///< Values in the open batch
+    double batch_sum = 0.0;         ///< Sum of the open batch
+    std::vector<double> batch_sums; ///< Sums of the complete batches
+
+public:
+    /**
+     * @brief Constructor
+     * @param max_batches_ Batches kept before merging, rounded up to an even number of at least 4
+     */
+    explicit OnlineESS(int max_batches_ = 128) : max_batches(std::max(4, max_batches_ + (max_batches_ & 1))) {
+        batch_sums.reserve(max_batches);
+    }
+
+    /** @brief Adds the next value of the trace */
+    void add(double x) {
+        ++count;
+        const double delta = x - mean;
+        mean += delta / static_cast<double>(count);
+        m2 += delta * (x - mean);
+
+        batch_sum += x;
+        if (++in_batch < batch_size)
+            return;
+        batch_sums.push_back(batch_sum);
+        batch_sum = 0.0;
+        in_batch = 0;
+
+        if (static_cast<int>(batch_sums.size()) == max_batches) {
+            for (int b = 0; b < max_batches / 2; ++b)
+                batch_sums[b] = batch_sums[2 * b] + batch_sums[2 * b + 1];
+            batch_sums.resize(max_batches / 2);
+            batch_size *= 2;
+        }
+    }
+
+    /** @brief Forgets every value (e.g. at the end of the burn-in) */
+    void reset() { *this = OnlineESS(max_batches); }
+
+    /** @brief Number of values added */
+    int64_t size() const { return count; }
+
+    /**
+     * @brief Effective sample size of the values added
+     * @return The estimate; NaN for a constant trace (e.g. a stuck sampler) or with fewer than 2 complete batches
+     */
+    double ess() const {
+        const int B = static_cast<int>(batch_sums.size());
+        if (B < 2)
+            return std::numeric_limits<double>::quiet_NaN();
+
+        const double b = static_cast<double>(batch_size);
+        double batch_mean = 0.0;
+        for (const double sum : batch_sums)
+            batch_mean += sum / b;
+        batch_mean /= B;
+        double batch_var = 0.0;
+        for (const double sum : batch_sums)
+            batch_var += (sum / b - batch_mean) * (sum / b - batch_mean);
+        batch_var /= B - 1;
+
+        const double var = m2 / static_cast<double>(count - 1);
+        if (batch_var <= 0.0 || var <= 0.0)
+            return std::numeric_limits<double>::quiet_NaN();
+        return b * B * var / (b * batch_var);
+    }
+
+    /** @brief Writes the estimator state to a checkpoint */
+    void write_checkpoint(CheckpointWriter &out) const {
+        out.begin("OnlineESS");
+        out.write(static_cast<int32_t>(max_batches));
+        out.write(count);
+        out.write(mean);
+        out.write(m2);
+        out.write(batch_size);
+        out.write(in_batch);
+        out.write(batch_sum);
+        out.write(batch_sums);
+    }
+
+    /** @brief Restores the state written by write_checkpoint() */
+    void read_checkpoint(CheckpointReader &in) {
+        in.expect("OnlineESS");
+        int32_t saved_max_batches;
+        in.read(saved_max_batches);
+        in.read(count);
+        in.read(mean);
+        in.read(m2);
+        in.read(batch_size);
+        in.read(in_batch);
+        in.read(batch_sum);
+        in.read(batch_sums);
+        if (saved_max_batches < 4 || saved_max_batches % 2 != 0 ||
+            static_cast<int>(batch_sums.size()) >= saved_max_batches || batch_size < 1) {
+            in.fail("corrupt effective sample size estimator");
+        }
+        max_batches = saved_max_batches;
+    }
+};
@@ -0,0 +1,193 @@
+/**
+ * @file PackedDistances.hpp
+ * @brief Packed upper-triangular storage of a symmetric distance matrix and its logarithm
+ *
+ * @author Filippo Galli
+ * @date 2025
+ */
+
+#pragma once
+
+#include <Eigen/Dense>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+/**
+ * @class PackedDistances
+ * @brief Strict upper triangle of D and log D, n (n - 1) / 2 entries each
+ *
+ * D is symmetric and its diagonal is never used by the likelihoods, so only the entries (i, j)
+ * with i < j are kept, row by row: row i holds (i, i + 1), ..., (i, n - 1) contiguously. Together
+ * with log D this takes 8 n (n - 1) bytes, about half of the dense D plus the dense log D.
+ *
+ * Reading a full row is no longer a contiguous read (entries j < i sit one per earlier row), so
+ * the hot loops that scan a row use materialize_row() into a scratch buffer and then work on it
+ * as on a dense row. Reductions over pairs of members read the entries directly.
+ *
+ * The diagonal reads as D = 0 and log D = -inf, as in the dense log of a zero diagonal.
+ */
+class PackedDistances {
+private:
+    int n;                      ///< Number of points
+    std::vector<double> D;      ///< Packed strict upper triangle of D
+    std::vector<double> log_D;  ///< Packed strict upper triangle of log D
+    std::vector<size_t> offset; ///< offset[i] + j is the position of (i, j), j > i
+
+public:
+    /**
+     * @brief Packs a dense distance matrix
+     * @param D_full Dense symmetric distance matrix (only the upper triangle is read)
+     */
+    explicit PackedDistances(const Eigen::Ref<const Eigen::MatrixXd> &D_full) : n(D_full.rows()) {
+        const size_t size = static_cast<size_t>(n) * (n > 0 ? n - 1 : 0) / 2;
+        D.resize(size);
+        log_D.resize(size);
+        offset.resize(n);
+
+        size_t pos = 0;
+        for (int i = 0; i < n; ++i) {
+            // offset[i] + (i + 1) is the first entry of row i (unsigned wrap-around is intended for i = 0)
+            offset[i] = pos - static_cast<size_t>(i) - 1;
+            for (int j = i + 1; j < n; ++j, ++pos) {
+                D[pos] = D_full(i, j);
+                log_D[pos] = std::log(D_full(i, j));
+            }
+        }
+    }
+
+    /**
+     * @brief Allocates the store of n points, every entry 0, to be filled with set()
+     * @param n Number of points
+     */
+    explicit PackedDistances(int n) : n(n) {
+        const size_t size = static_cast<size_t>(n) * (n > 0 ? n - 1 : 0) / 2;
+        D.assign(size, 0.0);
+        log_D.assign(size, -std::numeric_limits<double>::infinity());
+        offset.resize(n);
+        size_t pos = 0;
+        for (int i = 0; i < n; ++i) {
+            offset[i] = pos - static_cast<size_t>(i) - 1;
+            pos += static_cast<size_t>(n - i - 1);
+        }
+    }
+
+    /**
+     * @brief Stores D(i, j) = D(j, i) and its logarithm
+     * @param i Row index
+     * @param j Column index, j != i
+     * @param d Distance
+     *
+     * Calls on distinct pairs write distinct entries, so threads can fill disjoint pairs at once.
+     */
+    void set(int i, int j, double d) {
+        const size_t pos = index(i, j);
+        D[pos] = d;
+        log_D[pos] = std::log(d);
+    }
+
+    /** @brief Number of points */
+    int size() const { return n; }
+
+    /** @brief Heap bytes of the packed D, log D and row offsets */
+    size_t memory_bytes() const {
+        return (D.capacity() + log_D.capacity()) * sizeof(double) + offset.capacity() * sizeof(size_t);
+    }
+
+    /**
+     * @brief Position of entry (i, j) in the packed arrays
+     * @param i Row index
+     * @param j Column index, j != i
+     */
+    size_t index(int i, int j) const { return i < j ? offset[i] + j : offset[j] + i; }
+
+    /** @brief D(i, j), 0 on the diagonal */
+    double distance(int i, int j) const { return i == j ? 0.0 : D[index(i, j)]; }
+
+    /** @brief log D(i, j), -inf on the diagonal */
+    double log_distance(int i, int j) const {
+        return i == j ? -std::numeric_limits<double>::infinity() : log_D[index(i, j)];
+    }
+
+    /**
+     * @brief Writes row i of D and log D in dense form
+     * @param i Row index
+     * @param D_row Output buffer of n entries
+     * @param log_D_row Output buffer of n entries
+     *
+     * O(n): the entries j > i are copied contiguously, the entries j < i are read with a stride
+     * that shrinks by one per row.
+     */
+    void materialize_row(int i, double *__restrict__ D_row, double *__restrict__ log_D_row) const {
+        for (int j = 0; j < i; ++j) {
+            const size_t pos = offset[j] + i;
+            D_row[j] = D[pos];
+            log_D_row[j] = log_D[pos];
+        }
+        D_row[i] = 0.0;
+        log_D_row[i] = -std::numeric_limits<double>::infinity();
+        if (i + 1 < n) {
+            const size_t pos = offset[i] + i + 1;
+            std::copy(D.begin() + pos, D.begin() + pos + (n - i - 1), D_row + i + 1);
+            std::copy(log_D.begin() + pos, log_D.begin() + pos + (n - i - 1), log_D_row + i + 1);
+        }
+    }
+
+    /**
+     * @brief Entries (i, i + 1), ..., (i, n - 1) of D
+     * @param i Row index, i < n - 1
+     */
+    const double *upper_row_D(int i) const { return D.data() + offset[i] + i + 1; }
+
+    /**
+     * @brief Entries (i, i + 1), ..., (i, n - 1) of log D
+     * @param i Row index, i < n - 1
+     */
+    const double *upper_row_log_D(int i) const { return log_D.data() + offset[i] + i + 1; }
+
+    // ========== Member reductions ==========
+
+    /**
+     * @brief Sums D and log D over the unordered pairs of a member set
+     * @param idx Member indices
+     * @param m Number of members
+     * @param sum Output: sum of D(idx[a], idx[b]) for a < b
+     * @param log_sum Output: sum of log D(idx[a], idx[b]) for a < b
+     */
+    void pair_sum2(const int *idx, int m, double &sum, double &log_sum) const {
+        double s = 0, l = 0;
+        for (int a = 0; a + 1 < m; ++a) {
+            for (int b = a + 1; b < m; ++b) {
+                const size_t pos = index(idx[a], idx[b]);
+                s += D[pos];
+                l += log_D[pos];
+            }
+        }
+        sum = s;
+        log_sum = l;
+    }
+
+    /**
+     * @brief Sums D and log D over the cross pairs of two disjoint member sets
+     * @param idx_k Members of the first set
+     * @param m_k Size of the first set
+     * @param idx_t Members of the second set
+     * @param m_t Size of the second set
+     * @param sum Output: sum of D(idx_k[a], idx_t[b]) over all a, b
+     * @param log_sum Output: sum of log D(idx_k[a], idx_t[b]) over all a, b
+     */
+    void cross_sum2(const int *idx_k, int m_k, const int *idx_t, int m_t, double &sum, double &log_sum) const {
+        double s = 0, l = 0;
+        for (int a = 0; a < m_k; ++a) {
+            for (int b = 0; b < m_t; ++b) {
+                const size_t pos = index(idx_k[a], idx_t[b]);
+                s += D[pos];
+                l += log_D[pos];
+            }
+        }
+        sum = s;
+        log_sum = l;
+    }
+};
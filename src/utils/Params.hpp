@@ -13,9 +13,17 @@
 
 #pragma once
 
+#include "DistancePair.hpp"
+#include "MappedDistances.hpp"
+#include "MemoryReport.hpp"
+#include "PackedDistances.hpp"
+#include "PlacedDistances.hpp"
 #include <Eigen/Dense>
-#include <Rcpp.h>
-#include <RcppEigen.h>
+#include <cmath>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
 
 /**
  * @brief Structure containing all parameters needed for the NGGP (Normalized
@@ -72,12 +80,422 @@ struct Params {
     /** @brief Third parameter of the NGGP (controls tail behavior) */
     double tau;
 
-    /** @brief Distance matrix */
+    /**
+     * @brief Distance matrix
+     *
+     * Empty after use_single_precision(), use_packed_storage(), map_distances(),
+     * place_distances() or share_distances(): read the
+     * distances through distance() or get_D_data() rather than directly.
+     */
     Eigen::MatrixXd D;
 
     /** @brief Number of points */
     int n;
 
+    /**
+     * @brief Gets the dense distance matrix, in memory, mapped or placed
+     * @return Pointer to n x n doubles (column-major); with place_distances(), those of the copy
+     * of this Params (see replica())
+     * @throws std::logic_error unless dense_storage()
+     */
+    const double *get_D_data() const {
+        if (!dense_storage()) {
+            throw std::logic_error("get_D_data: the distances are not stored as dense double matrices");
+        }
+        if (D_placed)
+            return D_placed->get_D(placed_replica);
+        if (D_shared)
+            return D_shared->data();
+        return D_mapped ? D_mapped->get_D() : D.data();
+    }
+
+    /**
+     * @brief Whether the distance likelihoods have a log-distance term
+     * @return false if delta1 = delta2 = 1: the (delta - 1) log D terms of the cohesion and of the
+     * repulsion vanish, so Natarajan_likelihood and the caches read D alone and get_log_D_data()
+     * is never called (Gamma_likelihood, cohesion only, checks delta1 alone)
+     * @note Read by the likelihoods and caches at construction: change delta1 and delta2 before
+     */
+    bool uses_log_distances() const { return delta1 != 1.0 || delta2 != 1.0; }
+
+    /**
+     * @brief Gets the element-wise log of the distance matrix
+     *
+     * The matrix is computed on first use and then shared by every likelihood built on this
+     * Params object, so several chains running on the same Params hold a single n x n copy of it.
+     * With map_distances() it is read from the file instead and never computed, and with
+     * place_distances() it is the one placed next to D.
+     *
+     * @return Pointer to n x n doubles (column-major)
+     * @throws std::logic_error unless dense_storage()
+     */
+    const double *get_log_D_data() const {
+        if (!dense_storage()) {
+            throw std::logic_error("get_log_D_data: the distances are not stored as dense double matrices");
+        }
+        if (D_placed) {
+            return D_placed->get_log_D(placed_replica);
+        }
+        if (D_mapped) {
+            return D_mapped->get_log_D();
+        }
+#pragma omp critical(params_log_D)
+        {
+            if (!log_D) {
+                const Eigen::Map<const Eigen::MatrixXd> dense(D_shared ? D_shared->data() : D.data(), n, n);
+                log_D = std::make_shared<const Eigen::MatrixXd>(dense.array().log().matrix());
+            }
+        }
+        return log_D->data();
+    }
+
+    /**
+     * @brief Reads D and log D from a distance file mapped in memory
+     * @param path File written by MappedDistances::write()
+     *
+     * Replaces the in-memory D (n is taken from the file). The file is mapped read-only and
+     * shared, so nothing is copied or computed at startup and every process mapping the same
+     * file on a host shares its pages. Must be called before any Data, cache or likelihood is
+     * built on this Params.
+     *
+     * @throws std::runtime_error if the file cannot be mapped
+     * @throws std::logic_error if the storage was already switched to single precision or packed
+     */
+    void map_distances(const std::string &path) {
+        if (D_pairs || D_packed) {
+            throw std::logic_error("map_distances: the distances are already in single precision or packed");
+        }
+        auto mapped = std::make_shared<const MappedDistances>(path);
+#pragma omp critical(params_log_D)
+        {
+            D_mapped = std::move(mapped);
+            n = D_mapped->size();
+            D = Eigen::MatrixXd();
+            D_shared.reset();
+            log_D.reset();
+            D_placed.reset();
+        }
+    }
+
+    /**
+     * @brief Copies D and log D into huge-page mappings placed on the NUMA nodes
+     * @param options Page backing and placement (see PlacedDistances)
+     *
+     * Replaces the in-memory or mapped D (log D is computed during the copy). With
+     * PlacedDistances::Placement::REPLICATE there is one copy per node: this Params reads the
+     * first, and replica() gives a Params reading each of the others, on which to build the
+     * stacks of the chains running on that node. Must be called before any Data, cache or
+     * likelihood is built on this Params. get_D_placed()->report() tells what was obtained.
+     *
+     * @throws std::runtime_error if the copies cannot be mapped
+     * @throws std::logic_error if the distances are in single precision or packed
+     */
+    void place_distances(const PlacedDistances::Options &options) {
+        if (!dense_storage()) {
+            throw std::logic_error("place_distances: the distances are in single precision or packed");
+        }
+        auto placed = std::make_shared<const PlacedDistances>(n, get_D_data(), options);
+#pragma omp critical(params_log_D)
+        {
+            D_placed = std::move(placed);
+            placed_replica = 0;
+            D = Eigen::MatrixXd();
+            D_shared.reset();
+            D_mapped.reset();
+            log_D.reset();
+        }
+    }
+
+    /**
+     * @brief Same parameters, reading one copy of the placed distances
+     * @param r Copy, taken modulo the number of copies (so chain c can pass c)
+     * @return Params sharing the placed store, whose get_D_data() and get_log_D_data() read copy r
+     * @throws std::logic_error unless place_distances() was called
+     */
+    Params replica(int r) const {
+        if (!D_placed) {
+            throw std::logic_error("replica: the distances are not placed");
+        }
+        Params copy = *this;
+        const int copies = D_placed->replicas();
+        copy.placed_replica = ((r % copies) + copies) % copies;
+        return copy;
+    }
+
+    /**
+     * @brief Same parameters, on the distances among some of the points
+     * @param points Indices of the points (0-based), in the order of the new points
+     * @return Params of points.size() points with a dense copy of the block of D, whatever the
+     * storage of this one, for a local chain of ShardedClustering
+     * @throws std::invalid_argument if an index is out of range
+     */
+    Params subset(const std::vector<int> &points) const {
+        for (const int i : points) {
+            if (i < 0 || i >= n) {
+                throw std::invalid_argument("subset: point index out of range");
+            }
+        }
+        const int m = static_cast<int>(points.size());
+        Eigen::MatrixXd block(m, m);
+#pragma omp parallel for schedule(static)
+        for (int b = 0; b < m; ++b) {
+            for (int a = 0; a < m; ++a)
+                block(a, b) = distance(points[a], points[b]);
+        }
+        return Params(delta1, alpha, beta, delta2, gamma, zeta, BI, NI, a, sigma, tau, std::move(block));
+    }
+
+    /**
+     * @brief Moves the in-memory D into a read-only store shared by the copies of this Params
+     *
+     * Copying a Params afterwards (to change its hyperparameters, as HyperparameterGrid does for
+     * each job) copies a pointer instead of the n x n matrix; log D is computed here if
+     * uses_log_distances(), so the copies share it too. The other storages are shared by copies
+     * already and are left as they are. Must be called before any Data, cache or likelihood is
+     * built on this Params. Calling it again has no effect.
+     */
+    void share_distances() {
+#pragma omp critical(params_log_D)
+        {
+            if (D.size() > 0) {
+                D_shared = std::make_shared<const Eigen::MatrixXd>(std::move(D));
+                D = Eigen::MatrixXd();
+            }
+        }
+        if (uses_log_distances() && dense_storage())
+            get_log_D_data();
+    }
+
+    /**
+     * @brief Whether D is in the shared in-memory store
+     * @return True after share_distances() on a dense D in memory
+     */
+    bool shared_distances() const { return static_cast<bool>(D_shared); }
+
+    /**
+     * @brief Gets the placed distances
+     * @return Pointer to the placed store, nullptr unless place_distances() was called
+     */
+    const PlacedDistances *get_D_placed() const { return D_placed.get(); }
+
+    /**
+     * @brief NUMA node holding the distances read through this Params
+     * @return Node of its placed copy, -1 unless the copies are bound to nodes (REPLICATE)
+     */
+    int distance_node() const { return D_placed ? D_placed->node(placed_replica) : -1; }
+
+    /**
+     * @brief Switches the distance storage to single precision
+     *
+     * D and log D are packed into one interleaved float pair per cell (8 bytes per cell instead
+     * of the 16 of D plus the shared log D) and the double matrices are released. The logarithm
+     * is taken in double before rounding, and the likelihood kernels keep accumulating in double,
+     * so only the stored entries lose precision (relative error below 6e-8 each).
+     *
+     * Must be called before any Data, cache or likelihood is built on this Params. Calling it
+     * again has no effect.
+     *
+     * @throws std::logic_error if the distances are already packed (use_packed_storage())
+     */
+    void use_single_precision() {
+        if (D_packed) {
+            throw std::logic_error("use_single_precision: the distances are already packed");
+        }
+#pragma omp critical(params_log_D)
+        {
+            if (!D_pairs) {
+                const double *D_dense = get_D_data();
+                auto pairs = std::make_shared<std::vector<DistancePair>>(static_cast<size_t>(n) * n);
+                DistancePair *cell = pairs->data();
+                for (int i = 0; i < n; ++i) {
+                    for (int j = 0; j < n; ++j, ++cell) {
+                        const double d = D_dense[static_cast<size_t>(i) * n + j];
+                        cell->d = static_cast<float>(d);
+                        cell->log_d = static_cast<float>(std::log(d));
+                    }
+                }
+                D_pairs = std::move(pairs);
+                D = Eigen::MatrixXd();
+                D_shared.reset();
+                D_mapped.reset();
+                log_D.reset();
+                D_placed.reset();
+            }
+        }
+    }
+
+    /**
+     * @brief Switches the distance storage to the packed upper triangle
+     *
+     * D and log D are kept as their strict upper triangles, n (n - 1) / 2 doubles each (see
+     * PackedDistances), and the dense matrices are released: about half of the dense D plus
+     * log D, with the same values. Reading a full row costs an O(n) materialization, which the
+     * likelihoods do once per point.
+     *
+     * Must be called before any Data, cache or likelihood is built on this Params. Calling it
+     * again has no effect.
+     *
+     * @throws std::logic_error if the distances are already in single precision
+     */
+    void use_packed_storage() {
+        if (D_pairs) {
+            throw std::logic_error("use_packed_storage: the distances are already in single precision");
+        }
+#pragma omp critical(params_log_D)
+        {
+            if (!D_packed) {
+                D_packed =
+                    std::make_shared<const PackedDistances>(Eigen::Map<const Eigen::MatrixXd>(get_D_data(), n, n));
+                D = Eigen::MatrixXd();
+                D_shared.reset();
+                D_mapped.reset();
+                log_D.reset();
+                D_placed.reset();
+            }
+        }
+    }
+
+    /**
+     * @brief Switches the distance storage to a packed upper triangle built elsewhere
+     * @param packed Packed D and log D (e.g. from DistanceBuilder::packed()), shared
+     *
+     * Same storage as use_packed_storage(), without going through a dense D: n is taken from
+     * the store. Must be called before any Data, cache or likelihood is built on this Params.
+     *
+     * @throws std::invalid_argument if packed is null
+     * @throws std::logic_error if the distances are already in single precision or packed
+     */
+    void use_packed_storage(std::shared_ptr<const PackedDistances> packed) {
+        if (!packed) {
+            throw std::invalid_argument("use_packed_storage: no packed distances");
+        }
+        if (D_pairs || D_packed) {
+            throw std::logic_error("use_packed_storage: the distances are already in single precision or packed");
+        }
+#pragma omp critical(params_log_D)
+        {
+            D_packed = std::move(packed);
+            n = D_packed->size();
+            D = Eigen::MatrixXd();
+            D_shared.reset();
+            D_mapped.reset();
+            log_D.reset();
+            D_placed.reset();
+        }
+    }
+
+    /**
+     * @brief Appends points to the distance matrix
+     * @param D_new m x (n + m) distances of the new points: row r holds the distances of point
+     * n + r to the n current points, then to the m new ones (of the block between new points,
+     * the upper triangle is read)
+     *
+     * D becomes (n + m) x (n + m) and n is updated; the current distances are copied, not
+     * recomputed, and so is log D when it was already computed (the log of the new entries is
+     * taken here). Every Data, cache, likelihood, process and sampler built on this Params reads
+     * n-sized buffers and must be rebuilt afterwards (see Sampler::allocate_unallocated_points()
+     * to warm-start the new stack from the current partition).
+     *
+     * @throws std::invalid_argument if D_new has the wrong number of columns
+     * @throws std::logic_error unless the distances are a dense matrix in memory (not mapped,
+     * placed, single precision or packed)
+     */
+    void append_points(const Eigen::MatrixXd &D_new) {
+        const int m = D_new.rows();
+        if (D_new.cols() != n + m) {
+            throw std::invalid_argument("append_points: D_new must have n + m columns");
+        }
+        if (D_mapped || D_placed || D_shared || !dense_storage()) {
+            throw std::logic_error(
+                "append_points: the distances are mapped, placed, shared, in single precision or packed");
+        }
+#pragma omp critical(params_log_D)
+        {
+            const int n_old = n;
+            D.conservativeResize(n_old + m, n_old + m);
+            D.bottomRows(m) = D_new;
+            D.rightCols(m) = D_new.transpose();
+            D.bottomRightCorner(m, m) = D_new.rightCols(m).selfadjointView<Eigen::Upper>();
+
+            if (log_D) {
+                auto extended = std::make_shared<Eigen::MatrixXd>(n_old + m, n_old + m);
+                extended->topLeftCorner(n_old, n_old) = *log_D;
+                const Eigen::MatrixXd log_new = D_new.array().log().matrix();
+                extended->bottomRows(m) = log_new;
+                extended->rightCols(m) = log_new.transpose();
+                extended->bottomRightCorner(m, m) = log_new.rightCols(m).selfadjointView<Eigen::Upper>();
+                log_D = std::move(extended);
+            }
+            n = n_old + m;
+        }
+    }
+
+    /**
+     * @brief Whether D and log D are dense double matrices, in memory (the default), mapped or placed
+     * @return False after use_single_precision() or use_packed_storage()
+     */
+    bool dense_storage() const { return !D_pairs && !D_packed; }
+
+    /**
+     * @brief Gets the packed distances
+     * @return Pointer to the packed store, nullptr unless use_packed_storage() was called
+     */
+    const PackedDistances *get_D_packed() const { return D_packed.get(); }
+
+    /**
+     * @brief Whether the distances are stored in single precision
+     * @return True after use_single_precision()
+     */
+    bool single_precision() const { return static_cast<bool>(D_pairs); }
+
+    /**
+     * @brief Gets the interleaved single-precision distances
+     * @return Pointer to n x n pairs (row i starts at i * n), nullptr in double precision mode
+     */
+    const DistancePair *get_D_pairs() const { return D_pairs ? D_pairs->data() : nullptr; }
+
+    /**
+     * @brief Distance between two points, whatever the storage mode
+     * @param i Index of the first point
+     * @param j Index of the second point
+     * @return D(i, j)
+     */
+    double distance(int i, int j) const {
+        if (D_pairs)
+            return (*D_pairs)[static_cast<size_t>(i) * n + j].d;
+        if (D_packed)
+            return D_packed->distance(i, j);
+        if (D_placed)
+            return D_placed->get_D(placed_replica)[static_cast<size_t>(j) * n + i];
+        if (D_mapped)
+            return D_mapped->get_D()[static_cast<size_t>(j) * n + i];
+        if (D_shared)
+            return (*D_shared)(i, j);
+        return D(i, j);
+    }
+
+    /**
+     * @brief Adds the distance stores to a memory report
+     * @param report Report receiving one entry per store in use ("D", "log_D", "single", "packed",
+     * "mapped", "placed"); stores shared with other Params (replicas, copies) are entered once
+     */
+    void report_memory(MemoryReport &report) const {
+        if (D.size() > 0)
+            report.add(D.data(), "params", "D", MemoryReport::bytes(D));
+        if (D_shared)
+            report.add(D_shared.get(), "params", "D", MemoryReport::bytes(*D_shared));
+        if (log_D)
+            report.add(log_D.get(), "params", "log_D", MemoryReport::bytes(*log_D));
+        if (D_pairs)
+            report.add(D_pairs.get(), "params", "single", MemoryReport::bytes(*D_pairs));
+        if (D_packed)
+            report.add(D_packed.get(), "params", "packed", D_packed->memory_bytes());
+        if (D_mapped)
+            report.add(D_mapped.get(), "params", "mapped", D_mapped->memory_bytes());
+        if (D_placed)
+            report.add(D_placed.get(), "params", "placed", D_placed->memory_bytes());
+    }
+
     /**
      * @brief Constructor with default parameter values
      *
@@ -101,4 +519,26 @@ struct Params {
           sigma(sigma), tau(tau), D(D) {
         n = D.rows();
     }
+
+private:
+    /** @brief Lazily computed log distance matrix, see get_log_D_data() */
+    mutable std::shared_ptr<const Eigen::MatrixXd> log_D;
+
+    /** @brief Interleaved single-precision D and log D, see use_single_precision() */
+    std::shared_ptr<const std::vector<DistancePair>> D_pairs;
+
+    /** @brief In-memory D shared by the copies of this Params, see share_distances() */
+    std::shared_ptr<const Eigen::MatrixXd> D_shared;
+
+    /** @brief Packed upper triangle of D and log D, see use_packed_storage() */
+    std::shared_ptr<const PackedDistances> D_packed;
+
+    /** @brief Memory-mapped D and log D, see map_distances() */
+    std::shared_ptr<const MappedDistances> D_mapped;
+
+    /** @brief D and log D on huge pages, see place_distances() */
+    std::shared_ptr<const PlacedDistances> D_placed;
+
+    /** @brief Copy of D_placed read through this Params, see replica() */
+    int placed_replica = 0;
 };
@@ -0,0 +1,342 @@
+/**
+ * @file PartitionEstimator.cpp
+ * @brief Implementation of the SALSO-style point estimate search
+ */
+
+#include "PartitionEstimator.hpp"
+#include "CoClustering.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace {
+
+/** @brief Relabels in place to 0, ..., L - 1 in order of first appearance; returns L */
+int relabel(int *labels, int n) {
+    std::unordered_map<int, int> map;
+    for (int i = 0; i < n; ++i) {
+        const auto it = map.emplace(labels[i], static_cast<int>(map.size())).first;
+        labels[i] = it->second;
+    }
+    return static_cast<int>(map.size());
+}
+
+} // namespace
+
+// ========== Search State ==========
+
+/**
+ * @brief Partition under construction with the counts needed to score single-point moves
+ *
+ * Clusters are kept contiguous in 0, ..., K - 1: a cluster emptied by a move is filled with the
+ * last one. For VI the contingency counts of draw m are stored as table[offset[m] + l cap + k],
+ * so the counts of one label against all clusters are contiguous.
+ */
+struct PartitionEstimator::Search {
+    const PartitionEstimator &estimator;
+    const Loss loss;
+    const int cap;       ///< Maximum number of clusters
+    const double a;      ///< Binder cost of clustering a pair together
+    std::vector<int> labels;
+    std::vector<int> sizes;
+    int K = 0;
+    std::vector<int32_t> table;
+    std::vector<size_t> offset;
+    std::vector<double> score; ///< Change of the loss when adding the current point to each cluster
+
+    Search(const PartitionEstimator &estimator, Loss loss, int cap, double a)
+        : estimator(estimator), loss(loss), cap(cap), a(a), labels(estimator.n, -1), sizes(cap, 0), score(cap) {
+        if (loss == Loss::VI) {
+            offset.resize(estimator.M);
+            size_t total = 0;
+            for (int m = 0; m < estimator.M; ++m) {
+                offset[m] = total;
+                total += static_cast<size_t>(estimator.num_labels[m]) * cap;
+            }
+            table.assign(total, 0);
+        }
+    }
+
+    void place(int i, int k) {
+        if (k == K)
+            ++K;
+        ++sizes[k];
+        labels[i] = k;
+        if (loss == Loss::VI) {
+            const int32_t *draw = estimator.draws.data() + static_cast<size_t>(i) * estimator.M;
+            for (int m = 0; m < estimator.M; ++m)
+                ++table[offset[m] + static_cast<size_t>(draw[m]) * cap + k];
+        }
+    }
+
+    void remove(int i) {
+        const int k = labels[i];
+        --sizes[k];
+        labels[i] = -1;
+        if (loss == Loss::VI) {
+            const int32_t *draw = estimator.draws.data() + static_cast<size_t>(i) * estimator.M;
+            for (int m = 0; m < estimator.M; ++m)
+                --table[offset[m] + static_cast<size_t>(draw[m]) * cap + k];
+        }
+    }
+
+    /** @brief Moves the last cluster into the empty cluster k */
+    void compact(int k) {
+        const int last = --K;
+        if (k == last)
+            return;
+        sizes[k] = sizes[last];
+        sizes[last] = 0;
+        for (int &label : labels)
+            if (label == last)
+                label = k;
+        if (loss == Loss::VI) {
+            for (int m = 0; m < estimator.M; ++m) {
+                int32_t *counts = table.data() + offset[m];
+                for (int l = 0; l < estimator.num_labels[m]; ++l) {
+                    counts[static_cast<size_t>(l) * cap + k] = counts[static_cast<size_t>(l) * cap + last];
+                    counts[static_cast<size_t>(l) * cap + last] = 0;
+                }
+            }
+        }
+    }
+
+    /** @brief Fills score[0, K) for the unallocated point i */
+    void score_clusters(int i) {
+        std::fill(score.begin(), score.begin() + K, 0.0);
+        const double *dF = estimator.dxlogx.data();
+
+        if (loss == Loss::VI) {
+            const int32_t *draw = estimator.draws.data() + static_cast<size_t>(i) * estimator.M;
+            for (int m = 0; m < estimator.M; ++m) {
+                const int32_t *counts = table.data() + offset[m] + static_cast<size_t>(draw[m]) * cap;
+                for (int k = 0; k < K; ++k)
+                    score[k] += dF[counts[k]];
+            }
+            const double weight = 2.0 / estimator.M;
+            for (int k = 0; k < K; ++k)
+                score[k] = dF[sizes[k]] - weight * score[k];
+        } else {
+            // score[k] collects the similarities to the members of k, then a n_k - (a + 1) sum p_ij
+            const double *row = estimator.psm.data() + static_cast<size_t>(i) * estimator.n;
+            for (int j = 0; j < estimator.n; ++j)
+                if (labels[j] >= 0)
+                    score[labels[j]] += row[j];
+            for (int k = 0; k < K; ++k)
+                score[k] = a * sizes[k] - (a + 1.0) * score[k];
+        }
+    }
+
+    /**
+     * @brief Best cluster for the unallocated point i
+     * @param current Cluster the point was removed from (kept on ties), or -1
+     * @return Cluster index in [0, K], K meaning a new cluster
+     */
+    int best_cluster(int i, int current) {
+        score_clusters(i);
+        int best = current;
+        double best_score = current >= 0 ? score[current] : std::numeric_limits<double>::infinity();
+        for (int k = 0; k < K; ++k) {
+            if (score[k] < best_score) {
+                best = k;
+                best_score = score[k];
+            }
+        }
+        // A new cluster leaves the loss unchanged; an emptied current cluster is already one
+        const bool current_empty = current >= 0 && sizes[current] == 0;
+        if (K < cap && !current_empty && best_score > 0.0)
+            best = K;
+        return best;
+    }
+};
+
+// ========== PartitionEstimator ==========
+
+PartitionEstimator::PartitionEstimator(int n, const int *allocations, int M) : n(n), M(M) {
+    if (n < 1 || M < 1) {
+        throw std::invalid_argument("PartitionEstimator needs at least one point and one draw");
+    }
+
+    // Relabel each draw and store the labels point-major, as read by the search
+    draws.resize(static_cast<size_t>(n) * M);
+    num_labels.resize(M);
+    std::vector<int> draw(n);
+    for (int m = 0; m < M; ++m) {
+        std::copy(allocations + static_cast<size_t>(m) * n, allocations + static_cast<size_t>(m + 1) * n, draw.begin());
+        num_labels[m] = relabel(draw.data(), n);
+        for (int i = 0; i < n; ++i)
+            draws[static_cast<size_t>(i) * M + m] = draw[i];
+    }
+    max_labels = *std::max_element(num_labels.begin(), num_labels.end());
+
+    xlogx.resize(n + 1);
+    dxlogx.resize(n);
+    for (int x = 0; x <= n; ++x)
+        xlogx[x] = x > 0 ? x * std::log2(static_cast<double>(x)) : 0.0;
+    for (int x = 0; x < n; ++x)
+        dxlogx[x] = xlogx[x + 1] - xlogx[x];
+
+    std::vector<int> counts(max_labels);
+    for (int m = 0; m < M; ++m) {
+        std::fill(counts.begin(), counts.end(), 0);
+        for (int i = 0; i < n; ++i)
+            ++counts[draws[static_cast<size_t>(i) * M + m]];
+        for (int l = 0; l < num_labels[m]; ++l)
+            vi_constant += xlogx[counts[l]];
+    }
+    vi_constant /= M;
+}
+
+PartitionEstimator::PartitionEstimator(int n, std::vector<double> similarity) : n(n), psm(std::move(similarity)) {
+    if (n < 1) {
+        throw std::invalid_argument("PartitionEstimator needs at least one point");
+    }
+    if (psm.size() != static_cast<size_t>(n) * n) {
+        throw std::invalid_argument("PartitionEstimator: similarity matrix must be " + std::to_string(n) + " x " +
+                                    std::to_string(n));
+    }
+}
+
+void PartitionEstimator::build_psm() {
+    if (!psm.empty())
+        return;
+
+    CoClustering co_clustering(n, CoClustering::Layout::Packed);
+    ClusterMembers clusters;
+    for (int m = 0; m < M; ++m) {
+        clusters.assign(num_labels[m], {});
+        for (int i = 0; i < n; ++i)
+            clusters[draws[static_cast<size_t>(i) * M + m]].push_back(i);
+        co_clustering.add(clusters);
+    }
+    psm.resize(static_cast<size_t>(n) * n);
+    co_clustering.to_dense(psm.data());
+}
+
+double PartitionEstimator::loss_of(Loss loss, const int *labels, double binder_a) const {
+    std::vector<int> cls(labels, labels + n);
+    const int K = relabel(cls.data(), n);
+
+    if (loss == Loss::Binder) {
+        double total = 0.0;
+        for (int i = 0; i < n; ++i) {
+            const double *row = psm.data() + static_cast<size_t>(i) * n;
+            for (int j = i + 1; j < n; ++j)
+                total += cls[i] == cls[j] ? binder_a * (1.0 - row[j]) : row[j];
+        }
+        return total;
+    }
+
+    // VI: (1/n) [sum_k F(n_k) + 1/M sum_m sum_l F(n_{m,l}) - 2/M sum_m sum_{l,k} F(n_{m,l,k})]
+    std::vector<int> sizes(K, 0);
+    for (int i = 0; i < n; ++i)
+        ++sizes[cls[i]];
+    double own = 0.0;
+    for (int k = 0; k < K; ++k)
+        own += xlogx[sizes[k]];
+
+    double joint = 0.0;
+    std::vector<int> counts(static_cast<size_t>(max_labels) * K);
+    for (int m = 0; m < M; ++m) {
+        std::fill(counts.begin(), counts.end(), 0);
+        for (int i = 0; i < n; ++i)
+            ++counts[static_cast<size_t>(draws[static_cast<size_t>(i) * M + m]) * K + cls[i]];
+        for (const int c : counts)
+            joint += xlogx[c];
+    }
+    return (own + vi_constant - 2.0 * joint / M) / n;
+}
+
+double PartitionEstimator::expected_loss(Loss loss, const int *labels, double binder_a) {
+    if (loss == Loss::VI && M == 0) {
+        throw std::invalid_argument("VI loss needs the MCMC draws, not only the similarity matrix");
+    }
+    for (int i = 0; i < n; ++i) {
+        if (labels[i] < 0)
+            throw std::invalid_argument("PartitionEstimator: labels must be non-negative");
+    }
+    if (loss == Loss::Binder)
+        build_psm();
+    return loss_of(loss, labels, binder_a);
+}
+
+void PartitionEstimator::search(Loss loss, const Options &options, int max_clusters, Rng &rng, Result &result) const {
+    Search state(*this, loss, max_clusters, options.binder_a);
+    std::vector<int> order(n);
+    std::iota(order.begin(), order.end(), 0);
+
+    // Sequential allocation in random order
+    std::shuffle(order.begin(), order.end(), rng);
+    for (const int i : order)
+        state.place(i, state.best_cluster(i, -1));
+
+    // Sweeps of single-point moves until none improves the loss
+    int sweeps = 0;
+    while (sweeps < options.max_sweeps) {
+        ++sweeps;
+        std::shuffle(order.begin(), order.end(), rng);
+        int moves = 0;
+        for (const int i : order) {
+            const int current = state.labels[i];
+            state.remove(i);
+            const int best = state.best_cluster(i, current);
+            state.place(i, best);
+            if (best != current) {
+                ++moves;
+                if (state.sizes[current] == 0)
+                    state.compact(current);
+            }
+        }
+        if (moves == 0)
+            break;
+    }
+
+    result.labels = state.labels;
+    relabel(result.labels.data(), n);
+    result.loss = loss_of(loss, result.labels.data(), options.binder_a);
+    result.sweeps = sweeps;
+}
+
+PartitionEstimator::Result PartitionEstimator::minimize(Loss loss, const Options &options, Rng &rng) {
+    if (loss == Loss::VI && M == 0) {
+        throw std::invalid_argument("VI loss needs the MCMC draws, not only the similarity matrix");
+    }
+    if (options.restarts < 1 || options.max_sweeps < 0 || options.max_clusters < 0 || !(options.binder_a > 0.0)) {
+        throw std::invalid_argument("PartitionEstimator: invalid search options");
+    }
+    if (loss == Loss::Binder)
+        build_psm();
+
+    // VI keeps M x L x K counts, so its default limit follows the draws; Binder only needs n sizes
+    int max_clusters = options.max_clusters > 0 ? options.max_clusters : (loss == Loss::VI ? 2 * max_labels : n);
+    max_clusters = std::min(max_clusters, n);
+
+    std::vector<Rng> streams;
+    streams.reserve(options.restarts);
+    for (int r = 0; r < options.restarts; ++r)
+        streams.push_back(rng.split());
+
+    std::vector<Result> results(options.restarts);
+#ifdef _OPENMP
+    const int n_threads = options.n_threads > 0 ? options.n_threads : omp_get_max_threads();
+#pragma omp parallel for schedule(dynamic, 1) num_threads(n_threads)
+#endif
+    for (int r = 0; r < options.restarts; ++r) {
+        search(loss, options, max_clusters, streams[r], results[r]);
+        results[r].restart = r;
+    }
+
+    int best = 0;
+    for (int r = 1; r < options.restarts; ++r)
+        if (results[r].loss < results[best].loss)
+            best = r;
+    return std::move(results[best]);
+}
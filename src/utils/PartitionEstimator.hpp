@@ -0,0 +1,131 @@
+/**
+ * @file PartitionEstimator.hpp
+ * @brief Point estimate of the clustering by minimization of the posterior expected loss
+ *
+ * @author Filippo Galli
+ * @date 2025
+ */
+
+#pragma once
+
+#include "Rng.hpp"
+#include <cstdint>
+#include <vector>
+
+/**
+ * @class PartitionEstimator
+ * @brief Searches the partition minimizing the posterior expected VI or Binder loss
+ *
+ * The search follows SALSO (Dahl, Johnson, Müller 2022): every restart builds a partition by
+ * allocating the points one at a time, in random order, to the cluster (or new cluster) that
+ * minimizes the loss of the points allocated so far, then sweeps over the points, moving each to
+ * its best cluster, until a sweep moves none. Restarts run in parallel on OpenMP threads, each on
+ * its own stream of the generator, and the best partition is returned.
+ *
+ * Every single-point move is scored incrementally:
+ * - VI (Variation of Information, log base 2, averaged over the M draws) keeps, for every draw m,
+ *   the contingency counts n_{m,l,k} between its labels l and the current clusters k. Moving
+ *   point i to cluster k changes the loss by dF(n_k) - 2/M sum_m dF(n_{m, l_m(i), k}), with
+ *   dF(x) = F(x + 1) - F(x) tabulated for F(x) = x log2 x: O(M K) per point.
+ * - Binder, with cost a for clustering a pair together and 1 for separating it, needs the
+ *   posterior similarity matrix p only: moving i to k changes the loss by
+ *   sum_{j in k} (a - (a + 1) p_ij), O(n) per point with one pass over row i of p.
+ *
+ * Reference: Dahl, D. B., Johnson, D. J., Müller, P. (2022) "Search Algorithms and Loss Functions
+ * for Bayesian Clustering", Journal of Computational and Graphical Statistics 31(4)
+ */
+class PartitionEstimator {
+public:
+    /** @brief Loss function */
+    enum class Loss { VI, Binder };
+
+    /** @brief Options of the search */
+    struct Options {
+        int restarts = 16;     ///< Number of independent restarts
+        int max_sweeps = 100;  ///< Maximum number of sweeps per restart
+        int max_clusters = 0;  ///< Maximum number of clusters (0: VI twice the largest K of the draws, Binder n)
+        double binder_a = 1.0; ///< Binder cost of clustering together a pair that should be apart
+        int n_threads = 0;     ///< OpenMP threads (0: default)
+    };
+
+    /** @brief Best partition found */
+    struct Result {
+        std::vector<int> labels; ///< Cluster of each point, 0-based and ordered by first appearance
+        double loss = 0.0;       ///< Posterior expected loss of the partition
+        int sweeps = 0;          ///< Sweeps of the winning restart
+        int restart = 0;         ///< Index of the winning restart
+    };
+
+private:
+    int n;                       ///< Number of points
+    int M = 0;                   ///< Number of draws (0: similarity matrix only)
+    std::vector<int32_t> draws;  ///< Label of point i in draw m at i M + m, relabeled 0, ..., L_m - 1
+    std::vector<int> num_labels; ///< L_m, number of clusters of each draw
+    int max_labels = 0;          ///< Largest L_m
+    std::vector<double> psm;     ///< Posterior similarity matrix, n x n (empty until needed)
+    std::vector<double> xlogx;   ///< F(x) = x log2 x for x = 0, ..., n
+    std::vector<double> dxlogx;  ///< dF(x) = F(x + 1) - F(x) for x = 0, ..., n - 1
+    double vi_constant = 0.0;    ///< 1/M sum_m sum_l F(n_{m,l}), the part of the VI loss fixed by the draws
+
+    /** @brief Search state of one restart (defined in the .cpp) */
+    struct Search;
+
+    /** @brief Builds the similarity matrix from the draws */
+    void build_psm();
+
+    /** @brief Expected loss of a partition; the similarity matrix must be built for Binder */
+    double loss_of(Loss loss, const int *labels, double binder_a) const;
+
+    /**
+     * @brief Runs one restart
+     * @param loss Loss function
+     * @param options Search options
+     * @param max_clusters Resolved cluster limit
+     * @param rng Generator of the restart
+     * @param result Output partition with its loss and sweeps
+     */
+    void search(Loss loss, const Options &options, int max_clusters, Rng &rng, Result &result) const;
+
+public:
+    /**
+     * @brief Estimator over MCMC draws (VI and Binder loss)
+     * @param n Number of points
+     * @param allocations Labels of M draws, draw m at [m n, (m + 1) n) (any integer labels)
+     * @param M Number of draws
+     * @throws std::invalid_argument if n or M are not positive
+     */
+    PartitionEstimator(int n, const int *allocations, int M);
+
+    /**
+     * @brief Estimator over a posterior similarity matrix (Binder loss only)
+     * @param n Number of points
+     * @param similarity n x n posterior similarity matrix (symmetric, 1 on the diagonal)
+     * @throws std::invalid_argument if n is not positive
+     */
+    PartitionEstimator(int n, std::vector<double> similarity);
+
+    /**
+     * @brief Searches the partition minimizing the expected loss
+     * @param loss Loss function
+     * @param options Search options
+     * @param rng Master generator; one stream is split off per restart
+     * @return Best partition over the restarts (ties go to the lowest restart)
+     * @throws std::invalid_argument if VI is requested without draws, or the options are invalid
+     */
+    Result minimize(Loss loss, const Options &options, Rng &rng);
+
+    /**
+     * @brief Posterior expected loss of a partition
+     * @param loss Loss function
+     * @param labels Cluster of each point (n non-negative labels)
+     * @param binder_a Binder cost of clustering together a pair that should be apart
+     * @throws std::invalid_argument if VI is requested without draws
+     */
+    double expected_loss(Loss loss, const int *labels, double binder_a = 1.0);
+
+    /** @brief Number of points */
+    int size() const { return n; }
+
+    /** @brief Number of draws (0 if built from a similarity matrix) */
+    int get_num_draws() const { return M; }
+};
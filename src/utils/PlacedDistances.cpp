@@ -0,0 +1,255 @@
+/**
+ * @file PlacedDistances.cpp
+ * @brief Implementation of the PlacedDistances and NodeAffinity classes
+ */
+
+#include "PlacedDistances.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
+
+namespace {
+
+/** @brief Size of a huge page, and alignment of the copies */
+constexpr std::size_t huge_page_size = std::size_t(2) << 20;
+
+// Policies of the mbind() system call (linux/mempolicy.h), called directly to avoid a libnuma dependency
+constexpr int mpol_bind = 2;
+constexpr int mpol_interleave = 3;
+
+/** @brief Parses a sysfs list such as "0-3,8,10-11" */
+std::vector<int> parse_list(const std::string &path) {
+    std::ifstream file(path);
+    std::string text;
+    std::vector<int> values;
+    if (!std::getline(file, text))
+        return values;
+    std::stringstream ranges(text);
+    std::string range;
+    while (std::getline(ranges, range, ',')) {
+        int first, last;
+        const int read = std::sscanf(range.c_str(), "%d-%d", &first, &last);
+        if (read < 1)
+            continue;
+        if (read == 1)
+            last = first;
+        for (int v = first; v <= last; ++v)
+            values.push_back(v);
+    }
+    return values;
+}
+
+/** @brief Sets the NUMA policy of [addr, addr + length) to mode over nodes; false if refused */
+bool bind_memory(void *addr, std::size_t length, int mode, const std::vector<int> &nodes) {
+#if defined(__linux__) && defined(SYS_mbind)
+    int max_node = 0;
+    for (const int node : nodes)
+        max_node = std::max(max_node, node);
+    const std::size_t bits = 8 * sizeof(unsigned long);
+    std::vector<unsigned long> mask(max_node / bits + 1, 0UL);
+    for (const int node : nodes)
+        mask[node / bits] |= 1UL << (node % bits);
+    // The kernel reads maxnode - 1 bits of the mask
+    return ::syscall(SYS_mbind, addr, length, mode, mask.data(), mask.size() * bits + 1, 0) == 0;
+#else
+    (void)addr;
+    (void)length;
+    (void)mode;
+    (void)nodes;
+    return false;
+#endif
+}
+
+} // namespace
+
+std::vector<int> PlacedDistances::online_nodes() {
+    std::vector<int> nodes = parse_list("/sys/devices/system/node/online");
+    if (nodes.empty())
+        nodes.push_back(0);
+    return nodes;
+}
+
+std::vector<int> PlacedDistances::node_cpus(int node) {
+    return parse_list("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+}
+
+PlacedDistances::PlacedDistances(int n_, const double *D, const Options &options) : n(n_) {
+    if (n < 0) {
+        throw std::invalid_argument("PlacedDistances: number of points must be non-negative");
+    }
+    if (!D && n > 0) {
+        throw std::invalid_argument("PlacedDistances: no distances to place");
+    }
+
+    const std::size_t cells = static_cast<std::size_t>(n) * static_cast<std::size_t>(n);
+    const std::size_t bytes = 2 * cells * sizeof(double);
+    const std::size_t rounded = (bytes + huge_page_size - 1) / huge_page_size * huge_page_size;
+
+    const std::vector<int> nodes = online_nodes();
+    placement = options.placement;
+    if (nodes.size() < 2)
+        placement = Placement::FIRST_TOUCH;
+    copies.resize(placement == Placement::REPLICATE ? nodes.size() : 1);
+
+    huge_pages = options.huge_pages;
+    for (size_t r = 0; r < copies.size(); ++r) {
+        Copy &copy = copies[r];
+        void *base = MAP_FAILED;
+        bool from_pool = false;
+#ifdef MAP_HUGETLB
+        if (options.huge_pages == HugePages::EXPLICIT) {
+            copy.length = std::max(rounded, huge_page_size);
+            base = ::mmap(nullptr, copy.length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+                          -1, 0);
+            from_pool = base != MAP_FAILED;
+        }
+#endif
+        if (!from_pool) {
+            // Extra huge page to align the start of the copy
+            copy.length = rounded + huge_page_size;
+            base = ::mmap(nullptr, copy.length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (base == MAP_FAILED) {
+                const int error = errno;
+                for (size_t other = 0; other < r; ++other)
+                    ::munmap(copies[other].base, copies[other].length);
+                throw std::runtime_error(std::string("PlacedDistances: cannot map the distances: ") +
+                                         std::strerror(error));
+            }
+        }
+        copy.base = base;
+        const std::uintptr_t start = reinterpret_cast<std::uintptr_t>(base);
+        copy.D = reinterpret_cast<double *>((start + huge_page_size - 1) / huge_page_size * huge_page_size);
+
+        if (!from_pool) {
+            bool advised = false;
+#ifdef MADV_HUGEPAGE
+            if (options.huge_pages != HugePages::NONE && rounded > 0)
+                advised = ::madvise(copy.D, rounded, MADV_HUGEPAGE) == 0;
+#endif
+            if (!advised)
+                huge_pages = HugePages::NONE;
+            else if (huge_pages == HugePages::EXPLICIT)
+                huge_pages = HugePages::TRANSPARENT; // Pool too small
+        }
+
+        // Policies apply to the pages not yet touched, so bind before filling
+        if (placement == Placement::INTERLEAVE && !bind_memory(copy.D, rounded, mpol_interleave, nodes))
+            placement = Placement::FIRST_TOUCH;
+        if (placement == Placement::REPLICATE) {
+            if (bind_memory(copy.D, rounded, mpol_bind, {nodes[r]})) {
+                copy.node = nodes[r];
+            } else {
+                // Refused: keep the first copy only
+                for (size_t other = 1; other <= r; ++other)
+                    ::munmap(copies[other].base, copies[other].length);
+                copies.resize(1);
+                placement = Placement::FIRST_TOUCH;
+            }
+        }
+    }
+
+    for (Copy &copy : copies) {
+        double *D_copy = copy.D;
+        double *log_D_copy = copy.D + cells;
+#pragma omp parallel for schedule(static)
+        for (int j = 0; j < n; ++j) {
+            const std::size_t offset = static_cast<std::size_t>(j) * n;
+            for (int i = 0; i < n; ++i) {
+                D_copy[offset + i] = D[offset + i];
+                log_D_copy[offset + i] = std::log(D[offset + i]);
+            }
+        }
+    }
+}
+
+PlacedDistances::~PlacedDistances() {
+    for (const Copy &copy : copies) {
+        if (copy.base)
+            ::munmap(copy.base, copy.length);
+    }
+}
+
+PlacedDistances::Report PlacedDistances::report() const {
+    Report result;
+    result.huge_pages = huge_pages;
+    result.placement = placement;
+    result.bytes = 2 * static_cast<std::size_t>(n) * n * sizeof(double);
+    for (const Copy &copy : copies)
+        result.nodes.push_back(copy.node);
+
+    // Huge pages of the mappings of the copies, which the kernel may have split after mbind()
+    std::ifstream smaps("/proc/self/smaps");
+    std::string line;
+    bool inside = false;
+    while (std::getline(smaps, line)) {
+        unsigned long long first, last;
+        char dash;
+        std::istringstream header(line);
+        if (header >> std::hex >> first >> dash >> last && dash == '-') {
+            inside = false;
+            for (const Copy &copy : copies) {
+                const std::uintptr_t base = reinterpret_cast<std::uintptr_t>(copy.base);
+                inside = inside || (first < base + copy.length && last > base);
+            }
+            continue;
+        }
+        if (!inside)
+            continue;
+        std::istringstream field(line);
+        std::string key;
+        std::size_t kb = 0;
+        if (field >> key >> kb &&
+            (key == "AnonHugePages:" || key == "Shared_Hugetlb:" || key == "Private_Hugetlb:"))
+            result.huge_page_bytes += kb * 1024;
+    }
+    return result;
+}
+
+NodeAffinity::NodeAffinity(int node) {
+#ifdef __linux__
+    if (node < 0)
+        return;
+    const std::vector<int> cpus = PlacedDistances::node_cpus(node);
+    if (cpus.empty())
+        return;
+
+    cpu_set_t previous, pinned;
+    if (::sched_getaffinity(0, sizeof(previous), &previous) != 0)
+        return;
+    CPU_ZERO(&pinned);
+    for (const int cpu : cpus) {
+        if (cpu < CPU_SETSIZE)
+            CPU_SET(cpu, &pinned);
+    }
+    if (::sched_setaffinity(0, sizeof(pinned), &pinned) != 0)
+        return;
+    saved.resize(sizeof(previous));
+    std::memcpy(saved.data(), &previous, sizeof(previous));
+#else
+    (void)node;
+#endif
+}
+
+NodeAffinity::~NodeAffinity() {
+#ifdef __linux__
+    if (!saved.empty()) {
+        cpu_set_t previous;
+        std::memcpy(&previous, saved.data(), sizeof(previous));
+        ::sched_setaffinity(0, sizeof(previous), &previous);
+    }
+#endif
+}
@@ -0,0 +1,145 @@
+/**
+ * @file PlacedDistances.hpp
+ * @brief Distance matrix and its logarithm in anonymous memory backed by huge pages and placed on NUMA nodes
+ *
+ * @author Filippo Galli
+ * @date 2025
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * @class PlacedDistances
+ * @brief Dense D and log D copied into huge-page mappings, interleaved over or replicated on the NUMA nodes
+ *
+ * Each copy is one anonymous mapping holding D then log D (n x n doubles each, column-major, the
+ * layout of MappedDistances), aligned to 2 MB. Huge pages cut the TLB misses of the scattered
+ * reads of the likelihoods, which touch a 4 KB page per entry once n is large:
+ * - TRANSPARENT asks for transparent huge pages with madvise(MADV_HUGEPAGE); the kernel may
+ *   still back part of the mapping with 4 KB pages;
+ * - EXPLICIT maps pages of the hugetlbfs pool (MAP_HUGETLB), and falls back to TRANSPARENT if
+ *   the pool is too small.
+ *
+ * The placement applies to the pages before they are first written, with mbind():
+ * - FIRST_TOUCH leaves the kernel default (node of the thread filling each page);
+ * - INTERLEAVE spreads the pages of the single copy round-robin over all the nodes, so every
+ *   chain sees the average latency instead of some chains reading everything remotely;
+ * - REPLICATE keeps one copy bound to each node. Params::replica() selects the copy read by a
+ *   chain, and the multi-chain runners pin it to the cores of that node (NodeAffinity).
+ * On a single node, or where the system refuses the policy, the placement falls back to
+ * FIRST_TOUCH; report() tells what was obtained.
+ */
+class PlacedDistances {
+public:
+    /** @brief Page backing of the copies */
+    enum class HugePages { NONE = 0, TRANSPARENT = 1, EXPLICIT = 2 };
+
+    /** @brief Placement of the copies on the NUMA nodes */
+    enum class Placement { FIRST_TOUCH = 0, INTERLEAVE = 1, REPLICATE = 2 };
+
+    /** @brief Requested backing and placement */
+    struct Options {
+        HugePages huge_pages = HugePages::TRANSPARENT; ///< Page backing
+        Placement placement = Placement::INTERLEAVE;   ///< NUMA placement
+    };
+
+    /** @brief Backing and placement obtained */
+    struct Report {
+        HugePages huge_pages = HugePages::NONE;       ///< Backing obtained (EXPLICIT only if the pool served every copy)
+        Placement placement = Placement::FIRST_TOUCH; ///< Placement obtained
+        std::vector<int> nodes;                       ///< Node each copy is bound to (-1: unbound)
+        std::size_t bytes = 0;                        ///< Bytes of one copy (D and log D)
+        std::size_t huge_page_bytes = 0;              ///< Bytes of all copies currently on huge pages
+    };
+
+private:
+    /** @brief One mapping holding a copy */
+    struct Copy {
+        void *base = nullptr;      ///< Start of the mapping
+        std::size_t length = 0;    ///< Length of the mapping in bytes
+        double *D = nullptr;       ///< D inside the mapping (2 MB aligned)
+        int node = -1;             ///< Node the copy is bound to (-1: unbound)
+    };
+
+    int n = 0;                ///< Number of points
+    std::vector<Copy> copies; ///< One copy, or one per node with REPLICATE
+    HugePages huge_pages = HugePages::NONE;
+    Placement placement = Placement::FIRST_TOUCH;
+
+public:
+    /**
+     * @brief Copies a distance matrix into placed mappings, computing log D
+     * @param n Number of points
+     * @param D Dense D (n x n, column-major)
+     * @param options Requested backing and placement
+     * @throws std::invalid_argument if n is negative or D is null with n > 0
+     * @throws std::runtime_error if a mapping cannot be created
+     */
+    PlacedDistances(int n, const double *D, const Options &options);
+
+    PlacedDistances(const PlacedDistances &) = delete;
+    PlacedDistances &operator=(const PlacedDistances &) = delete;
+
+    ~PlacedDistances();
+
+    /** @brief Number of points */
+    int size() const { return n; }
+
+    /** @brief Number of copies (1 unless the placement is REPLICATE) */
+    int replicas() const { return static_cast<int>(copies.size()); }
+
+    /** @brief D of copy r (n x n, column-major) */
+    const double *get_D(int r = 0) const { return copies[r].D; }
+
+    /** @brief log D of copy r (n x n, column-major) */
+    const double *get_log_D(int r = 0) const { return copies[r].D + static_cast<std::size_t>(n) * n; }
+
+    /** @brief NUMA node copy r is bound to (-1: unbound) */
+    int node(int r = 0) const { return copies[r].node; }
+
+    /** @brief Bytes mapped by all the copies (2 MB aligned) */
+    std::size_t memory_bytes() const {
+        std::size_t total = 0;
+        for (const Copy &copy : copies)
+            total += copy.length;
+        return total;
+    }
+
+    /**
+     * @brief Backing and placement obtained
+     * @details huge_page_bytes is read from /proc/self/smaps at the call, so it follows the
+     * kernel collapsing or splitting transparent huge pages after the copy.
+     */
+    Report report() const;
+
+    /** @brief Online NUMA nodes of the host ({0} where they cannot be read) */
+    static std::vector<int> online_nodes();
+
+    /** @brief CPUs of a NUMA node (empty where they cannot be read) */
+    static std::vector<int> node_cpus(int node);
+};
+
+/**
+ * @class NodeAffinity
+ * @brief Pins the calling thread to the CPUs of a NUMA node until the end of the scope
+ *
+ * The previous affinity of the thread is restored on destruction, so OpenMP threads are not
+ * left pinned after a chain. A negative node, a node without readable CPUs or a refused
+ * sched_setaffinity() leave the thread as it was.
+ */
+class NodeAffinity {
+private:
+    std::vector<unsigned char> saved; ///< Saved cpu_set_t of the thread (empty: not pinned)
+
+public:
+    /** @param node NUMA node (-1: no pinning) */
+    explicit NodeAffinity(int node);
+
+    NodeAffinity(const NodeAffinity &) = delete;
+    NodeAffinity &operator=(const NodeAffinity &) = delete;
+
+    ~NodeAffinity();
+};
@@ -0,0 +1,289 @@
+/**
+ * @file PredictiveAllocator.cpp
+ * @brief Implementation of the PredictiveAllocator class
+ */
+
+#include "PredictiveAllocator.hpp"
+#include "../processes/module/binary_covariate_module_cache.hpp"
+#include "../processes/module/continuos_covariate_module_cache.hpp"
+#include "../processes/module/spatial_module_cache.hpp"
+#include "MemoryReport.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+PredictiveAllocator::PredictiveAllocator(const Params &params, Options options, Eigen::VectorXi reference, Rng rng)
+    : delta1(params.delta1), alpha(params.alpha), beta(params.beta), delta2(params.delta2), gamma(params.gamma),
+      zeta(params.zeta), a(params.a), sigma(params.sigma), tau(params.tau), options(std::move(options)),
+      reference(std::move(reference)), gen(rng) {
+    if (this->options.process != "DP" && this->options.process != "NGGP") {
+        throw std::invalid_argument("PredictiveAllocator: process must be \"DP\" or \"NGGP\"");
+    }
+    if (this->options.likelihood != "Natarajan" && this->options.likelihood != "Gamma") {
+        throw std::invalid_argument("PredictiveAllocator: likelihood must be \"Natarajan\" or \"Gamma\"");
+    }
+    if (this->options.representatives < 0) {
+        throw std::invalid_argument("PredictiveAllocator: representatives must be non-negative");
+    }
+    if (this->reference.size() > 0) {
+        if (this->reference.minCoeff() < 0) {
+            throw std::invalid_argument("PredictiveAllocator: the reference partition has an unallocated point");
+        }
+        K_reference = this->reference.maxCoeff() + 1;
+    }
+    nggp = this->options.process == "NGGP";
+    repulsion = this->options.likelihood == "Natarajan";
+    log_distances = delta1 != 1.0 || (repulsion && delta2 != 1.0);
+}
+
+void PredictiveAllocator::add_module(std::shared_ptr<const Module> module) {
+    if (!frozen.empty()) {
+        throw std::logic_error("PredictiveAllocator: modules must be added before the samples");
+    }
+    if (auto continuos = std::dynamic_pointer_cast<const ContinuosCovariatesModuleCache>(module)) {
+        continuos_modules.push_back(std::move(continuos));
+    } else if (auto binary = std::dynamic_pointer_cast<const BinaryCovariatesModuleCache>(module)) {
+        binary_modules.push_back(std::move(binary));
+    } else if (auto spatial = std::dynamic_pointer_cast<const SpatialModuleCache>(module)) {
+        spatial_weight += spatial->get_spatial_weight();
+        spatial_modules.push_back(std::move(spatial));
+    } else {
+        throw std::invalid_argument("PredictiveAllocator: only ContinuosCovariatesModuleCache, "
+                                    "BinaryCovariatesModuleCache and SpatialModuleCache modules are supported");
+    }
+}
+
+void PredictiveAllocator::add_sample(const Data &data, double U) {
+    const Eigen::VectorXi &allocations = data.get_allocations();
+    const int n = data.get_n();
+    if (n > 0 && allocations.minCoeff() < 0) {
+        throw std::invalid_argument("PredictiveAllocator: the sample has an unallocated point");
+    }
+    if (nggp && !(U > 0.0)) {
+        throw std::invalid_argument("PredictiveAllocator: the NGGP needs a positive U for each sample");
+    }
+    if (reference.size() == 0) {
+        reference = allocations;
+        K_reference = data.get_K();
+    } else if (reference.size() != n) {
+        throw std::invalid_argument("PredictiveAllocator: the sample and the reference differ in size");
+    }
+    if (landmark_column.empty())
+        landmark_column.assign(n, -1);
+
+    Sample sample;
+    sample.first_cluster = static_cast<int>(clusters.size());
+    sample.K = data.get_K();
+    sample.log_new = std::log(a) + (nggp ? sigma * std::log(tau + U) : 0.0);
+    if (!spatial_modules.empty())
+        sample.allocations.assign(allocations.data(), allocations.data() + n);
+
+    const double discount = nggp ? sigma : 0.0;
+    const double log_beta_alpha = alpha * std::log(beta) - std::lgamma(alpha);
+    const double log_gamma_zeta = zeta * std::log(gamma) - std::lgamma(zeta);
+    std::vector<int> members, shared(K_reference, 0), touched;
+    for (int k = 0; k < sample.K; ++k) {
+        const Eigen::Map<const Eigen::VectorXi> cluster_members = data.get_cluster_assignments(k);
+        const int n_k = static_cast<int>(cluster_members.size());
+        Cluster cluster;
+        cluster.log_prior = n_k - discount > 0 ? std::log(n_k - discount) : std::numeric_limits<double>::lowest();
+        cluster.cohesion = -n_k * std::lgamma(delta1) + std::lgamma(alpha + delta1 * n_k) + log_beta_alpha;
+        cluster.cohesion_rate = alpha + delta1 * n_k;
+        cluster.repulsion = -n_k * std::lgamma(delta2) + std::lgamma(zeta + delta2 * n_k) + log_gamma_zeta;
+        cluster.repulsion_rate = zeta + delta2 * n_k;
+
+        // Landmarks: the members already in the list first, so that samples share them
+        members.assign(cluster_members.data(), cluster_members.data() + n_k);
+        const int R = options.representatives;
+        if (R > 0 && n_k > R) {
+            std::shuffle(members.begin(), members.end(), gen);
+            std::stable_partition(members.begin(), members.end(), [&](int j) { return landmark_column[j] >= 0; });
+            members.resize(R);
+        }
+        cluster.first_landmark = static_cast<int>(cluster_landmarks.size());
+        cluster.landmarks = static_cast<int>(members.size());
+        cluster.scale = cluster.landmarks > 0 ? static_cast<double>(n_k) / cluster.landmarks : 0.0;
+        for (const int j : members) {
+            if (landmark_column[j] < 0) {
+                landmark_column[j] = static_cast<int>(landmark_points.size());
+                landmark_points.push_back(j);
+            }
+            cluster_landmarks.push_back(landmark_column[j]);
+        }
+
+        // Members shared with each reference cluster
+        for (int i = 0; i < n_k; ++i) {
+            const int r = reference(cluster_members(i));
+            if (shared[r]++ == 0)
+                touched.push_back(r);
+        }
+        cluster.first_overlap = static_cast<int>(overlaps.size());
+        cluster.overlaps = static_cast<int>(touched.size());
+        for (const int r : touched) {
+            overlaps.push_back({r, static_cast<double>(shared[r]) / n_k});
+            shared[r] = 0;
+        }
+        touched.clear();
+
+        for (const auto &module : continuos_modules)
+            continuos_stats.push_back(module->get_cache().get_cluster_stats(k));
+        for (const auto &module : binary_modules)
+            binary_stats.push_back(module->get_cache().get_cluster_stats(k));
+        clusters.push_back(cluster);
+    }
+    frozen.push_back(std::move(sample));
+}
+
+PredictiveAllocator::Result PredictiveAllocator::allocate(const Points &points, int n_threads) const {
+    if (frozen.empty()) {
+        throw std::logic_error("PredictiveAllocator: no sample was added");
+    }
+    const int m = static_cast<int>(points.distances.rows());
+    const int L = static_cast<int>(landmark_points.size());
+    const int n_continuos = static_cast<int>(continuos_modules.size());
+    const int n_binary = static_cast<int>(binary_modules.size());
+    if (points.distances.cols() != L) {
+        throw std::invalid_argument("PredictiveAllocator: need one distance column per landmark (" +
+                                    std::to_string(L) + ")");
+    }
+    if (n_continuos > 0 && (points.continuos.rows() != m || points.continuos.cols() != n_continuos)) {
+        throw std::invalid_argument("PredictiveAllocator: need one continuous column per continuous module");
+    }
+    if (n_binary > 0) {
+        if (points.binary.rows() != m || points.binary.cols() != n_binary) {
+            throw std::invalid_argument("PredictiveAllocator: need one binary column per binary module");
+        }
+        if (m > 0 && (points.binary.minCoeff() < 0 || points.binary.maxCoeff() > 1)) {
+            throw std::invalid_argument("PredictiveAllocator: binary covariates must be 0 or 1");
+        }
+    }
+    if (!spatial_modules.empty()) {
+        if (static_cast<int>(points.neighbors.size()) != m) {
+            throw std::invalid_argument("PredictiveAllocator: need the neighbours of every point");
+        }
+        const int n = static_cast<int>(reference.size());
+        for (const std::vector<int> &row : points.neighbors) {
+            for (const int j : row) {
+                if (j < 0 || j >= n) {
+                    throw std::invalid_argument("PredictiveAllocator: neighbour out of range");
+                }
+            }
+        }
+    }
+
+    int max_K = 0;
+    for (const Sample &sample : frozen)
+        max_K = std::max(max_K, sample.K);
+    const double inv_samples = 1.0 / static_cast<double>(frozen.size());
+
+    Result result;
+    result.probabilities = Eigen::MatrixXd::Zero(m, K_reference + 1);
+    result.labels.resize(m);
+#ifdef _OPENMP
+    if (n_threads <= 0)
+        n_threads = omp_get_max_threads();
+#pragma omp parallel num_threads(n_threads)
+#endif
+    {
+        std::vector<double> d(L), log_d(L), w(max_K + 1);
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+        for (int i = 0; i < m; ++i) {
+            for (int l = 0; l < L; ++l) {
+                d[l] = points.distances(i, l);
+                if (log_distances)
+                    log_d[l] = std::log(d[l]);
+            }
+            auto row = result.probabilities.row(i);
+
+            for (const Sample &sample : frozen) {
+                const int K = sample.K;
+                const bool with_repulsion = repulsion && K > 1;
+                double total_repulsion = 0.0;
+                for (int k = 0; k < K; ++k) {
+                    const Cluster &c = clusters[sample.first_cluster + k];
+                    double sum = 0.0, log_sum = 0.0;
+                    for (int l = c.first_landmark; l < c.first_landmark + c.landmarks; ++l) {
+                        sum += d[cluster_landmarks[l]];
+                        if (log_distances)
+                            log_sum += log_d[cluster_landmarks[l]];
+                    }
+                    sum *= c.scale;
+                    log_sum *= c.scale;
+
+                    double log_likelihood =
+                        c.cohesion + (delta1 - 1.0) * log_sum - c.cohesion_rate * std::log(beta + sum);
+                    if (with_repulsion) {
+                        const double rep =
+                            c.repulsion + (delta2 - 1.0) * log_sum - c.repulsion_rate * std::log(gamma + sum);
+                        log_likelihood -= rep;
+                        total_repulsion += rep;
+                    }
+                    w[k] = c.log_prior + log_likelihood;
+                }
+                w[K] = sample.log_new;
+
+                for (int j = 0; j < n_continuos; ++j) {
+                    const double x = points.continuos(i, j);
+                    const ContinuosCovariatesModuleCache &module = *continuos_modules[j];
+                    for (int k = 0; k < K; ++k)
+                        w[k] += module.log_predictive(continuos_stats[(sample.first_cluster + k) * n_continuos + j], x);
+                    w[K] += module.log_predictive(ContinuosCache::ClusterStats(), x);
+                }
+                for (int j = 0; j < n_binary; ++j) {
+                    const int x = points.binary(i, j);
+                    const BinaryCovariatesModuleCache &module = *binary_modules[j];
+                    for (int k = 0; k < K; ++k)
+                        w[k] += module.log_predictive(binary_stats[(sample.first_cluster + k) * n_binary + j], x);
+                    w[K] += module.log_predictive(BinaryCache::ClusterStats(), x);
+                }
+                if (!spatial_modules.empty()) {
+                    for (const int j : points.neighbors[i])
+                        w[sample.allocations[j]] += spatial_weight;
+                }
+
+                // Every candidate is repelled by the other clusters, a new cluster by all of them
+                if (with_repulsion) {
+                    for (int k = 0; k <= K; ++k)
+                        w[k] += total_repulsion;
+                }
+
+                const double max_log = *std::max_element(w.begin(), w.begin() + K + 1);
+                double total = 0.0;
+                for (int k = 0; k <= K; ++k) {
+                    w[k] = std::exp(w[k] - max_log);
+                    total += w[k];
+                }
+                const double weight = inv_samples / total;
+                for (int k = 0; k < K; ++k) {
+                    const Cluster &c = clusters[sample.first_cluster + k];
+                    for (int o = c.first_overlap; o < c.first_overlap + c.overlaps; ++o)
+                        row(overlaps[o].cluster) += weight * w[k] * overlaps[o].fraction;
+                }
+                row(K_reference) += weight * w[K];
+            }
+            Eigen::Index label;
+            row.maxCoeff(&label);
+            result.labels(i) = static_cast<int>(label);
+        }
+    }
+    (void)n_threads;
+    return result;
+}
+
+std::size_t PredictiveAllocator::memory_bytes() const {
+    std::size_t bytes = MemoryReport::bytes(frozen) + MemoryReport::bytes(clusters) +
+                        MemoryReport::bytes(cluster_landmarks) + MemoryReport::bytes(overlaps) +
+                        MemoryReport::bytes(continuos_stats) + MemoryReport::bytes(binary_stats) +
+                        MemoryReport::bytes(landmark_points) + MemoryReport::bytes(landmark_column) +
+                        MemoryReport::bytes(reference);
+    for (const Sample &sample : frozen)
+        bytes += MemoryReport::bytes(sample.allocations);
+    return bytes;
+}
@@ -0,0 +1,190 @@
+/**
+ * @file PredictiveAllocator.hpp
+ * @brief Allocation of new observations to the clusters of a fitted posterior, without MCMC
+ *
+ * @author Filippo Galli
+ * @date 2025
+ */
+
+#pragma once
+
+#include "../processes/caches/binary_cache.hpp"
+#include "../processes/caches/continuos_cache.hpp"
+#include "Data.hpp"
+#include "Module.hpp"
+#include "Params.hpp"
+#include "Rng.hpp"
+#include <Eigen/Dense>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+class BinaryCovariatesModuleCache;
+class ContinuosCovariatesModuleCache;
+class SpatialModuleCache;
+
+/**
+ * @class PredictiveAllocator
+ * @brief Scores new points against frozen posterior samples, close to one Gibbs step each
+ *
+ * A new point x joins cluster k of a sample with the probability a Gibbs update of Neal3 would give
+ * it if it were one more point of the data: the prior weight of the process (log(n_k - sigma), and
+ * log a + sigma log(tau + U) for a new cluster), the Natarajan or Gamma conditional of its
+ * distances to the members, and the predictive terms of the modules. add_sample() freezes a
+ * partition (a posterior sample, or the point estimate) into what these need, per cluster:
+ * - its size and the constants of the likelihood and prior that depend on it alone;
+ * - up to R members, its landmarks: the sums of d(x, j) and log d(x, j) over the members, which the
+ *   likelihood reads, are estimated as n_k / r_k times the sums over the r_k landmarks, exact for
+ *   clusters of at most R points (R = 0: every member, the exact conditional);
+ * - the module statistics: those of each ContinuosCache and BinaryCache, read from the caches of
+ *   the modules, and the sample allocations for the neighbours of a SpatialModuleCache.
+ * The landmarks of all the samples form one list (landmarks()), reused across samples whenever a
+ * cluster has members already in it, so the caller computes the distances of a new point to a few
+ * training points (one row of L distances) rather than to all n.
+ *
+ * Labels differ between samples, so each sample is mapped to a reference partition: the new point
+ * goes to reference cluster r with probability sum_k p_k |C_k and R_r| / |C_k|, the chance that a
+ * random member of the cluster it joins is in r, plus a column for a cluster of its own; the
+ * probabilities are averaged over the samples. With the reference itself as the only sample this is
+ * the Gibbs conditional on the point estimate.
+ *
+ * allocate() scores a batch of points on OpenMP threads (static schedule over the points). A point
+ * costs O(L) logs plus O(sum_k r_k + K modules + degree) per sample, microseconds for tens of
+ * samples of tens of clusters. The new points are scored independently: they are not added to the
+ * clusters, nor to each other's neighbours.
+ */
+class PredictiveAllocator {
+public:
+    /** @brief Model of the fitted chain */
+    struct Options {
+        std::string process = "NGGP";         ///< "DP" or "NGGP"
+        std::string likelihood = "Natarajan"; ///< "Natarajan" (cohesion and repulsion) or "Gamma" (cohesion)
+        int representatives = 8;              ///< Landmarks per cluster (R; 0: all the members)
+    };
+
+    /** @brief Batch of new points; every matrix has one row per point */
+    struct Points {
+        Eigen::MatrixXd distances;               ///< Distances to the landmarks(), in their order
+        Eigen::MatrixXd continuos;               ///< Value of each continuous module, in add_module() order
+        Eigen::MatrixXi binary;                  ///< Value (0 or 1) of each binary module, in add_module() order
+        std::vector<std::vector<int>> neighbors; ///< Training points adjacent to each point (spatial modules)
+    };
+
+    /** @brief Allocation of a batch of points */
+    struct Result {
+        Eigen::MatrixXd probabilities; ///< Points x (K reference clusters + 1): last column, a new cluster
+        Eigen::VectorXi labels;        ///< Most probable column of each point (K: a new cluster)
+    };
+
+    /**
+     * @brief Empty allocator
+     * @param params Hyperparameters of the likelihood and the process (copied)
+     * @param options Model of the chain
+     * @param reference Partition the samples are mapped to, 0-based (empty: the first sample)
+     * @param rng Generator drawing the landmarks
+     * @throws std::invalid_argument if the process, likelihood or number of representatives is not
+     * as documented, or reference has a negative label
+     */
+    PredictiveAllocator(const Params &params, Options options, Eigen::VectorXi reference = {}, Rng rng = Rng());
+
+    /**
+     * @brief Adds the predictive term of a module of the process
+     * @param module A ContinuosCovariatesModuleCache, BinaryCovariatesModuleCache or
+     * SpatialModuleCache on the Data later passed to add_sample(); kept alive by the allocator
+     * @throws std::invalid_argument for any other module
+     * @throws std::logic_error if samples were already added
+     */
+    void add_module(std::shared_ptr<const Module> module);
+
+    /**
+     * @brief Freezes the current partition of data
+     * @param data Data with the caches of the modules; its partition is read, not changed
+     * @param U Latent variable of the NGGP in this sample (ignored for the DP)
+     * @throws std::invalid_argument if data has another number of points than the reference or
+     * an unallocated point, or U is not positive for the NGGP
+     */
+    void add_sample(const Data &data, double U = std::numeric_limits<double>::quiet_NaN());
+
+    /**
+     * @brief Allocation probabilities of new points
+     * @param points New points, with as many columns as landmarks and modules
+     * @param n_threads OpenMP threads (0: default)
+     * @throws std::invalid_argument if the sizes do not match, a neighbour is out of range or a
+     * binary value is not 0 or 1
+     * @throws std::logic_error if no sample was added
+     */
+    Result allocate(const Points &points, int n_threads = 0) const;
+
+    /** @brief Training points whose distances allocate() needs, in column order */
+    const std::vector<int> &landmarks() const { return landmark_points; }
+
+    /** @brief Number of frozen samples */
+    int samples() const { return static_cast<int>(frozen.size()); }
+
+    /** @brief Number of clusters of the reference partition */
+    int reference_clusters() const { return K_reference; }
+
+    /**
+     * @brief Heap bytes of the frozen samples
+     * @see MemoryReport
+     */
+    std::size_t memory_bytes() const;
+
+private:
+    /** @brief What the likelihood and the prior need of a cluster of a sample */
+    struct Cluster {
+        double log_prior;      ///< log(n_k - sigma)
+        double cohesion;       ///< Terms of the cohesion that depend on n_k alone
+        double cohesion_rate;  ///< alpha + delta1 n_k
+        double repulsion;      ///< Terms of the repulsion that depend on n_k alone
+        double repulsion_rate; ///< zeta + delta2 n_k
+        double scale;          ///< n_k / r_k
+        int first_landmark;    ///< First entry of the cluster in cluster_landmarks
+        int landmarks;         ///< r_k
+        int first_overlap;     ///< First entry of the cluster in overlaps
+        int overlaps;          ///< Reference clusters sharing members with it
+    };
+
+    /** @brief Share of the members of a cluster in one reference cluster */
+    struct Overlap {
+        int cluster;     ///< Reference cluster
+        double fraction; ///< |C_k and R_r| / |C_k|
+    };
+
+    /** @brief One frozen partition */
+    struct Sample {
+        int first_cluster; ///< First entry in clusters, and in the module statistics
+        int K;             ///< Number of clusters
+        double log_new;    ///< Log prior weight of a new cluster
+        std::vector<int> allocations; ///< Partition (spatial modules only, empty otherwise)
+    };
+
+    // Hyperparameters
+    double delta1, alpha, beta, delta2, gamma, zeta; ///< Likelihood
+    double a, sigma, tau;                            ///< Process
+    Options options;
+    bool repulsion;     ///< Natarajan: cohesion and repulsion
+    bool nggp;          ///< NGGP rather than DP
+    bool log_distances; ///< Whether the likelihood reads log d (delta1 or delta2 not 1)
+
+    Eigen::VectorXi reference; ///< Reference partition (empty until the first sample)
+    int K_reference = 0;       ///< Clusters of the reference
+    Rng gen;                   ///< Landmark draws
+
+    // Modules
+    std::vector<std::shared_ptr<const ContinuosCovariatesModuleCache>> continuos_modules;
+    std::vector<std::shared_ptr<const BinaryCovariatesModuleCache>> binary_modules;
+    std::vector<std::shared_ptr<const SpatialModuleCache>> spatial_modules;
+    double spatial_weight = 0.0; ///< Sum of the weights of the spatial modules
+
+    // Frozen samples
+    std::vector<Sample> frozen;
+    std::vector<Cluster> clusters;                              ///< Clusters of all the samples
+    std::vector<int> cluster_landmarks;                         ///< Landmark columns of each cluster
+    std::vector<Overlap> overlaps;                              ///< Reference overlaps of each cluster
+    std::vector<ContinuosCache::ClusterStats> continuos_stats;  ///< Cluster x continuous module
+    std::vector<BinaryCache::ClusterStats> binary_stats;        ///< Cluster x binary module
+    std::vector<int> landmark_points;                           ///< Training point of each column
+    std::vector<int> landmark_column;                           ///< Column of each training point (-1: none)
+};
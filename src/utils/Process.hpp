@@ -13,10 +13,11 @@
 
 #pragma once
 
+#include "CountTables.hpp"
 #include "Data.hpp"
 #include "Params.hpp"
 #include <Eigen/Dense>
-#include <unordered_map>
+#include <limits>
 
 /**
  * @brief Abstract base class for Bayesian nonparametric processes
@@ -36,6 +37,11 @@
  * Derived classes must implement the pure virtual methods to define their
  * specific process characteristics (DP, NGGP, NGGPW, DPW).
  *
+ * @note The const prior methods (gibbs_prior_*, prior_ratio_*) keep no scratch state, here or in
+ * the modules and caches they read, so concurrent const calls are safe as long as no thread
+ * changes the allocations. The Gibbs kernel still calls them from one thread (see
+ * Sampler::set_gibbs_threads()); implementations adding mutable buffers must keep this property.
+ *
  * @see DP, NGGP, NGGPW, DPW
  */
 class Process {
@@ -54,7 +60,7 @@ protected:
 
     /** @brief Storage for previous cluster members to enable rollback in case of
      * rejection or for computation requiring it*/
-    std::unordered_map<int, std::vector<int>> old_cluster_members;
+    ClusterMembers old_cluster_members;
 
     /** @brief Number of clusters associated with the stored previous state */
     int old_K = 0;
@@ -62,9 +68,9 @@ protected:
     /**
      * @brief Provides read-only access to the stored previous cluster members.
      *
-     * @return Const reference to the unordered map of previous cluster members.
+     * @return Const reference to the previous cluster members.
      */
-    [[nodiscard]] const std::unordered_map<int, std::vector<int>> &old_cluster_members_view() const {
+    [[nodiscard]] const ClusterMembers &old_cluster_members_view() const {
         return old_cluster_members;
     }
 
@@ -74,8 +80,46 @@ protected:
     /** @brief Index of second observation involved in split-merge move */
     int idx_j;
 
-    /** @brief Precomputed logarithm of total mass parameter for efficiency */
-    const double log_a = log(params.a);
+    /** @brief Whether the open proposal was started with a snapshot, see snapshot_old_state() */
+    bool old_state_snapshot = false;
+
+    /**
+     * @brief Takes what the prior ratios read from the state before a proposal
+     *
+     * @return True if the snapshot replaces the copies of the allocations and cluster members
+     *
+     * @details Called by save_state(int, int) with idx_i and idx_j set, before the proposal moves
+     * any observation.
+     */
+    virtual bool snapshot_old_state() { return false; }
+
+    /** @brief Precomputed logarithm of total mass parameter, see refresh_tables() */
+    double log_a = log(params.a);
+
+    /** @brief Discount the size tables are built for */
+    double table_discount = 0.0;
+
+    /** @brief log(m - discount) at cluster size m, shared through CountTables */
+    CountTable log_size;
+
+    /** @brief lgamma(m - discount) at cluster size m, shared through CountTables */
+    CountTable lgamma_size;
+
+    /**
+     * @brief Refreshes log_a and, if the discount changed, the size tables
+     * @param discount Discount of the process (0 for the DP, sigma for the NGGP)
+     *
+     * Called by the constructors of the derived processes and by update_params(), so the tables
+     * follow the parameters without any lookup in the sampling loops.
+     */
+    void refresh_tables(double discount) {
+        log_a = log(params.a);
+        if (log_size.get_size() == 0 || discount != table_discount) {
+            table_discount = discount;
+            log_size = CountTables::shared().log(-discount, 1.0, data.get_n() + 1);
+            lgamma_size = CountTables::shared().lgamma(-discount, 1.0, data.get_n() + 1);
+        }
+    }
 
 public:
     /**
@@ -123,6 +167,21 @@ public:
 
     virtual Eigen::VectorXd gibbs_prior_existing_clusters(int obs_idx) const = 0;
 
+    /**
+     * @brief Compute prior probabilities for assigning observation to all
+     * existing clusters, into a caller-provided buffer
+     * @param obs_idx Index of the observation to be assigned
+     * @param out Output, K entries: the log prior of each existing cluster
+     * (overwritten), as gibbs_prior_existing_clusters(obs_idx)
+     * @details Used by the Gibbs kernel with a buffer from the sampler
+     * workspace. The default copies the vector returned by the allocating
+     * overload; the processes of the package override it to fill out in
+     * place, with bit-identical values.
+     */
+    virtual void gibbs_prior_existing_clusters(int obs_idx, Eigen::Ref<Eigen::VectorXd> out) const {
+        out = gibbs_prior_existing_clusters(obs_idx);
+    }
+
     /**
      * @brief Compute prior probability for creating a new cluster
      *
@@ -193,6 +252,23 @@ public:
      */
     virtual double prior_ratio_shuffle(int size_old_ci, int size_old_cj, int ci, int cj) const = 0;
 
+    // ========== Joint Prior ==========
+
+    /**
+     * @brief Log prior of the current partition (and of the process latent variables)
+     *
+     * @return Log prior, consistent with the Gibbs priors and the prior ratios: moving a point or
+     * splitting a cluster changes it by the corresponding log ratio. NaN (default) if the process
+     * has no closed form (see has_log_prior())
+     *
+     * @details Added to the log-likelihood it gives the joint log-posterior of the chain (see
+     * ChainRunner::log_posterior()). An O(K) pass over the cluster sizes, plus the module terms.
+     */
+    [[nodiscard]] virtual double log_prior() const { return std::numeric_limits<double>::quiet_NaN(); }
+
+    /** @brief Whether log_prior() is implemented in closed form (false by default) */
+    [[nodiscard]] virtual bool has_log_prior() const { return false; }
+
     // ========== State Management Methods ==========
 
     /**
@@ -208,12 +284,12 @@ public:
     /**
      * @brief Store current cluster members for potential rollback
      *
-     * @param new_cluster_members Current cluster members map to store
+     * @param new_cluster_members Current cluster members to store
      *
      * @details Saves the current state of cluster members before attempting
      * a split-merge move, enabling rollback if the move is rejected.
      */
-    void set_old_cluster_members(const std::unordered_map<int, std::vector<int>> &new_cluster_members) {
+    void set_old_cluster_members(const ClusterMembers &new_cluster_members) {
         old_cluster_members = new_cluster_members;
     };
 
@@ -224,10 +300,72 @@ public:
      */
     void set_old_K(int new_K) { old_K = new_K; }
 
+    /**
+     * @brief Whether the process reads the state before a proposal
+     *
+     * @return True if prior ratios need old_allocations_view() / old_cluster_members_view()
+     *
+     * @details When false, save_state() skips the O(n) copies of the allocations and
+     * cluster members.
+     */
+    [[nodiscard]] virtual bool uses_old_state() const { return false; }
+
+    /**
+     * @brief Marks the start of a split-merge proposal
+     *
+     * @details Opens a transaction on the data, so that restore_state() undoes only the
+     * moves of the proposal. The allocations and cluster members are copied only when
+     * uses_old_state() is true.
+     */
+    void save_state() {
+        old_state_snapshot = false;
+        if (uses_old_state()) {
+            old_allocations = data.get_allocations();
+            old_cluster_members = data.get_cluster_map();
+        }
+        old_K = data.get_K();
+        data.begin_transaction();
+    }
+
+    /**
+     * @brief Marks the start of a split-merge proposal on the pair (i, j)
+     *
+     * @param i Index of the first observation of the pair
+     * @param j Index of the second observation of the pair
+     *
+     * @details Same as save_state() followed by set_idx_i(i) and set_idx_j(j), but the process
+     * may first snapshot what its prior ratios need (snapshot_old_state()), in which case the O(n)
+     * copies of the allocations and cluster members are skipped.
+     */
+    void save_state(int i, int j) {
+        idx_i = i;
+        idx_j = j;
+        old_state_snapshot = snapshot_old_state();
+        if (!old_state_snapshot && uses_old_state()) {
+            old_allocations = data.get_allocations();
+            old_cluster_members = data.get_cluster_map();
+        }
+        old_K = data.get_K();
+        data.begin_transaction();
+    }
+
+    /**
+     * @brief Accepts the proposal started by save_state()
+     */
+    void commit_state() { data.commit(); }
+
     /**
      * @brief Restores the cached state into the data object
+     *
+     * @details Rolls back the open transaction if any, otherwise swaps the saved
+     * allocations and cluster members back into place.
      */
-    void restore_state() { data.restore_state(old_allocations, old_cluster_members, old_K); }
+    void restore_state() {
+        if (data.in_transaction())
+            data.rollback();
+        else
+            data.restore_state(old_allocations, old_cluster_members, old_K);
+    }
 
     /**
      * @brief Provides read-only access to the stored previous allocations.
@@ -262,6 +400,14 @@ public:
      */
     virtual void update_params() = 0;
 
+    /**
+     * @brief Heap bytes of the copies of the previous state (the shared count tables are not counted)
+     * @see MemoryReport
+     */
+    virtual std::size_t memory_bytes() const {
+        return MemoryReport::bytes(old_allocations) + MemoryReport::bytes(old_cluster_members);
+    }
+
     /**
      * @brief Virtual destructor for proper cleanup of derived classes
      */
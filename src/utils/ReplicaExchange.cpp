@@ -0,0 +1,156 @@
+/**
+ * @file ReplicaExchange.cpp
+ * @brief Implementation of the ReplicaExchange class
+ *
+ * @author Filippo Galli
+ * @date 2025
+ */
+
+#include "ReplicaExchange.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <exception>
+#include <stdexcept>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+ReplicaExchange::ReplicaExchange(std::vector<Chain> chains_, std::vector<double> betas_, int swap_every_, Rng rng)
+    : chains(std::move(chains_)), betas(std::move(betas_)), swap_every(swap_every_), gen(rng) {
+    const int M = static_cast<int>(chains.size());
+    if (M == 0 || betas.size() != chains.size()) {
+        throw std::invalid_argument("ReplicaExchange: need one beta per chain, and at least one chain");
+    }
+    if (swap_every < 1) {
+        throw std::invalid_argument("ReplicaExchange: swap_every must be positive");
+    }
+    if (betas[0] != 1.0) {
+        throw std::invalid_argument("ReplicaExchange: the first beta must be 1");
+    }
+    for (int t = 1; t < M; ++t) {
+        if (!(betas[t] > 0 && betas[t] < betas[t - 1])) {
+            throw std::invalid_argument("ReplicaExchange: betas must be positive and decreasing");
+        }
+    }
+    for (const Chain &chain : chains) {
+        if (!chain.likelihood) {
+            throw std::invalid_argument("ReplicaExchange: every chain needs its tempered likelihood");
+        }
+        if (chain.runner.get_data().get_n() != chains[0].runner.get_data().get_n()) {
+            throw std::invalid_argument("ReplicaExchange: every chain must have the same number of points");
+        }
+    }
+
+    chain_at.resize(M);
+    for (int t = 0; t < M; ++t) {
+        chain_at[t] = t;
+        chains[t].likelihood->set_beta(betas[t]);
+        chains[t].runner.track_log_likelihood(&chains[t].likelihood->get_base());
+    }
+    pair_stats.resize(std::max(0, M - 1));
+    log_likelihood.resize(M);
+}
+
+void ReplicaExchange::attempt_swaps(int n_threads) {
+    const int M = size();
+    const int first = static_cast<int>(rounds % 2);
+    rounds++;
+    if (first + 1 >= M)
+        return;
+
+    // Untempered log-likelihood of every chain: the running value, or a full sum (O(n^2) for the
+    // distance likelihoods) after a sampler that does not track it
+    std::vector<std::exception_ptr> errors(M);
+#pragma omp parallel for schedule(dynamic, 1) num_threads(n_threads)
+    for (int c = 0; c < M; ++c) {
+        try {
+            log_likelihood[c] = chains[c].runner.log_likelihood();
+        } catch (...) {
+            errors[c] = std::current_exception();
+        }
+    }
+    for (const std::exception_ptr &error : errors) {
+        if (error)
+            std::rethrow_exception(error);
+    }
+
+    for (int t = first; t + 1 < M; t += 2) {
+        const int a = chain_at[t];
+        const int b = chain_at[t + 1];
+        const double log_ratio = (betas[t] - betas[t + 1]) * (log_likelihood[b] - log_likelihood[a]);
+
+        pair_stats[t].attempted++;
+        if (std::log(gen.uniform_pos()) > log_ratio)
+            continue;
+
+        pair_stats[t].accepted++;
+        std::swap(chain_at[t], chain_at[t + 1]);
+        chains[b].likelihood->set_beta(betas[t]);
+        chains[a].likelihood->set_beta(betas[t + 1]);
+    }
+}
+
+double ReplicaExchange::run(int BI, int NI, int thin, int *allocations_out, int *K_out, double *U_out,
+                            int *cold_chain_out, int n_threads, const std::function<void(int, int)> &on_progress) {
+    const int M = size();
+    const int n = chains[0].runner.get_data().get_n();
+    const int total_iters = BI + NI;
+    const int progress_every = std::max(1, total_iters / 20);
+
+#ifdef _OPENMP
+    if (n_threads <= 0)
+        n_threads = omp_get_max_threads();
+#else
+    n_threads = 1;
+#endif
+
+    const auto start_time = std::chrono::steady_clock::now();
+    std::vector<std::exception_ptr> errors(M);
+
+    for (int start = 1; start <= total_iters; start += swap_every) {
+        const int end = std::min(start + swap_every - 1, total_iters);
+        const int cold = chain_at[0]; // Fixed during the round
+
+#pragma omp parallel for schedule(dynamic, 1) num_threads(n_threads)
+        for (int c = 0; c < M; ++c) {
+            // Exceptions must not escape the parallel region
+            try {
+                ChainRunner &runner = chains[c].runner;
+                for (int i = start; i <= end; ++i) {
+                    runner.iterate(i);
+                    if (c != cold || i % thin != 0)
+                        continue;
+
+                    // Store the posterior sample
+                    const int saved = i / thin - 1;
+                    const Data &data = runner.get_data();
+                    const Eigen::VectorXi &allocations = data.get_allocations();
+                    if (allocations_out)
+                        std::copy(allocations.data(), allocations.data() + n,
+                                  allocations_out + static_cast<size_t>(saved) * n);
+                    K_out[saved] = data.get_K();
+                    if (runner.get_u_sampler())
+                        U_out[saved] = runner.get_u_sampler()->get_U();
+                    if (cold_chain_out)
+                        cold_chain_out[saved] = c;
+                }
+            } catch (...) {
+                errors[c] = std::current_exception();
+            }
+        }
+        for (const std::exception_ptr &error : errors) {
+            if (error)
+                std::rethrow_exception(error);
+        }
+
+        if (end < total_iters)
+            attempt_swaps(n_threads);
+
+        if (on_progress && end / progress_every != (start - 1) / progress_every)
+            on_progress(end, total_iters);
+    }
+
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+}
@@ -0,0 +1,105 @@
+/**
+ * @file ReplicaExchange.hpp
+ * @brief Parallel tempering over chains run on separate threads
+ *
+ * @author Filippo Galli
+ * @date 2025
+ */
+
+#pragma once
+
+#include "../likelihoods/Tempered_likelihood.hpp"
+#include "ChainRunner.hpp"
+#include "Rng.hpp"
+#include <functional>
+#include <vector>
+
+/**
+ * @class ReplicaExchange
+ * @brief Runs M tempered chains in rounds on OpenMP threads and swaps their temperatures in between
+ *
+ * Chain c runs its ChainRunner stack with a Tempered_likelihood, so it targets p(z) L(z)^beta for
+ * the inverse temperature its likelihood holds. The chains run swap_every iterations at a time,
+ * one per thread; after each round, swaps are attempted between adjacent temperatures, on the even
+ * pairs (0-1, 2-3, ...) after one round and on the odd pairs after the next. A swap between
+ * temperatures t and t + 1, held by chains a and b, is accepted with probability
+ * min(1, exp((beta_t - beta_{t+1}) (log L_b - log L_a))), with log L the untempered log-likelihood
+ * (the sum of the cluster log-likelihoods of the base likelihood), which each runner keeps up to
+ * date from the moves of its samplers (ChainRunner::track_log_likelihood()).
+ *
+ * A swap exchanges the temperatures of the two chains, not their states: the two betas are set on
+ * the likelihoods and two entries of the temperature permutation are exchanged, so no allocation,
+ * cache or process state is copied. The samples of the posterior (beta = 1) are taken from
+ * whichever chain holds temperature 0 at the time.
+ */
+class ReplicaExchange {
+public:
+    /** @brief One tempered chain */
+    struct Chain {
+        ChainRunner runner;                 ///< Stack of the chain (Data, Process, samplers)
+        Tempered_likelihood *likelihood;    ///< Likelihood of its samplers; not owned
+    };
+
+    /** @brief Swap statistics of a pair of adjacent temperatures */
+    struct PairStats {
+        long attempted = 0; ///< Swaps attempted
+        long accepted = 0;  ///< Swaps accepted
+    };
+
+private:
+    std::vector<Chain> chains;            ///< Chains, in construction order
+    std::vector<double> betas;            ///< Inverse temperatures, decreasing, betas[0] = 1
+    std::vector<int> chain_at;            ///< chain_at[t]: chain holding temperature t
+    std::vector<PairStats> pair_stats;    ///< Statistics of the pairs (t, t + 1)
+    int swap_every;                       ///< Iterations per round
+    Rng gen;                              ///< Stream of the swap decisions
+    long rounds = 0;                      ///< Rounds run, selects the even or odd pairs
+
+    std::vector<double> log_likelihood;   ///< Untempered log-likelihood of each chain (scratch)
+
+    /** @brief Attempts the swaps of the even or odd pairs, depending on the round */
+    void attempt_swaps(int n_threads);
+
+public:
+    /**
+     * @brief Constructor
+     * @param chains_ Chains, one per temperature; chain t starts at temperature t
+     * @param betas_ Inverse temperatures, betas_[0] = 1 and decreasing, in (0, 1]
+     * @param swap_every_ Iterations between swap attempts
+     * @param rng Random number generator stream of the swaps
+     * @throws std::invalid_argument if the sizes differ, a likelihood is missing, a chain has a different
+     * number of points, betas_ is not as required or swap_every_ < 1
+     *
+     * @details The betas are set on the likelihoods here, and every runner tracks the log-likelihood
+     * of its base likelihood.
+     */
+    ReplicaExchange(std::vector<Chain> chains_, std::vector<double> betas_, int swap_every_, Rng rng = Rng());
+
+    /**
+     * @brief Runs BI + NI iterations of every chain, writing thinned traces of the posterior chain
+     * @param BI Number of burn-in iterations
+     * @param NI Number of iterations after burn-in
+     * @param thin Thinning interval of the stored traces
+     * @param allocations_out Buffer of n * n_saved ints (see ChainRunner::run())
+     * @param K_out Buffer of n_saved ints for the number of clusters
+     * @param U_out Buffer of n_saved doubles for U (left untouched without a U sampler)
+     * @param cold_chain_out Optional buffer of n_saved ints for the chain the sample was taken from
+     * @param n_threads Number of threads (0 = OpenMP default)
+     * @param on_progress Optional callback invoked about 20 times, on the calling thread
+     * @return Elapsed wall time in seconds
+     */
+    double run(int BI, int NI, int thin, int *allocations_out, int *K_out, double *U_out, int *cold_chain_out,
+               int n_threads = 0, const std::function<void(int, int)> &on_progress = {});
+
+    /** @brief Number of chains */
+    int size() const { return static_cast<int>(chains.size()); }
+
+    /** @brief Inverse temperatures */
+    const std::vector<double> &get_betas() const { return betas; }
+
+    /** @brief Chain holding each temperature */
+    const std::vector<int> &get_chain_at() const { return chain_at; }
+
+    /** @brief Swap statistics of the pairs (t, t + 1), t = 0, ..., M - 2 */
+    const std::vector<PairStats> &get_pair_stats() const { return pair_stats; }
+};
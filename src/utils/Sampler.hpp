@@ -13,14 +13,19 @@
 
 #pragma once
 
+#include "Checkpoint.hpp"
 #include "Data.hpp"
 #include "Likelihood.hpp"
 #include "Params.hpp"
 #include "Process.hpp"
+#include "Rng.hpp"
+#include "Workspace.hpp"
+#include "cpu_dispatch.hpp"
 
-#include <random>
-#include <Rcpp.h>
 #include <Eigen/Dense>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
 
 /**
  * @brief Abstract base class for MCMC sampler implementations
@@ -68,11 +73,185 @@ protected:
 
     // ========== Random Number Generation ==========
 
-    /** @brief Random device for generating random numbers across sampling
-     * algorithms */
-    std::random_device rd;
+    /** @brief Random number generator owned by this sampler (an independent
+     * stream, see Rng::split()) */
+    mutable Rng gen;
+
+    // ========== Gibbs Kernel ==========
+
+    /** @brief Log-weight buffer of the Gibbs kernel, sized n + 1 once so that
+     * sweeps never reallocate (only the first K + 1 entries are used) */
+    Eigen::VectorXd gibbs_log_weights;
+
+    /** @brief Scratch arena of the point updates and moves, so that a steady-state sweep does
+     * not allocate (see Workspace) */
+    Workspace workspace;
+
+    /** @brief OpenMP threads of the Gibbs kernel likelihood (1: serial), see set_gibbs_threads() */
+    int gibbs_threads = 1;
+
+    /** @brief Minimum work of a point update for the threaded kernel, see gibbs_work() */
+    long gibbs_min_work = default_gibbs_min_work;
+
+    /**
+     * @brief Work estimate of scoring every candidate of a point update
+     *
+     * K clusters of mean size n / K cost one gathered distance per member plus about
+     * gibbs_candidate_cost for the log terms of each candidate: K (n / K + c) = n + c K.
+     */
+    long gibbs_work(int K) const { return data.get_n() + static_cast<long>(gibbs_candidate_cost) * K; }
+
+    /**
+     * @brief Fills gibbs_log_weights with the full conditional of an unallocated point
+     *
+     * @param index Index of the point (must be unallocated)
+     * @param with_new_cluster If true, entry K is filled with the new-cluster weight
+     * @return Number of entries filled (K + 1, or K without the new cluster)
+     *
+     * @details Entry k < K is point_loglikelihood_cond(index, k) +
+     * gibbs_prior_existing_cluster(k, index), computed with one batch likelihood
+     * call and one batch prior call (which includes every module), instead of
+     * K scalar virtual calls per component. Above the gibbs_min_work threshold
+     * the likelihood call is split over gibbs_threads threads; the prior stays
+     * on the calling thread. The prior is written to a workspace buffer, so the
+     * kernel does not allocate.
+     */
+    int compute_gibbs_log_weights(int index, bool with_new_cluster = true) {
+        const int K = data.get_K();
+        const int m = K + 1;
+
+        // The batch likelihood always writes the new-cluster entry too
+        if (gibbs_threads > 1 && gibbs_work(K) >= gibbs_min_work)
+            likelihood.point_loglikelihood_cond_all_parallel(index, gibbs_log_weights.head(m), gibbs_threads);
+        else
+            likelihood.point_loglikelihood_cond_all(index, gibbs_log_weights.head(m));
+
+        Workspace::Frame frame(workspace);
+        Eigen::Map<Eigen::VectorXd> log_prior = workspace.vector(K);
+        process.gibbs_prior_existing_clusters(index, log_prior);
+        gibbs_log_weights.head(K) += log_prior;
+        mask_free_clusters();
+
+        if (!with_new_cluster)
+            return K;
+
+        gibbs_log_weights(K) += process.gibbs_prior_new_cluster_obs(index);
+        return m;
+    }
+
+    /**
+     * @brief Gives zero weight to the free cluster slots (see Data::set_lazy_compaction())
+     *
+     * The priors already make an empty cluster unreachable, but a module or likelihood term of
+     * an empty cluster is not guaranteed to be finite.
+     */
+    void mask_free_clusters() {
+        for (const int k : data.get_free_clusters())
+            gibbs_log_weights(k) = -std::numeric_limits<double>::infinity();
+    }
+
+    /**
+     * @brief Log-odds of an unallocated point joining cluster ci rather than cj
+     *
+     * @param index Index of the point (must be unallocated)
+     * @param ci First cluster
+     * @param cj Second cluster
+     * @return Full conditional log-weight of ci minus that of cj
+     *
+     * @details The two-candidate kernel of the restricted Gibbs scans of the split-merge
+     * samplers. Only the log-odds of ci against cj matter there, since the terms of the other
+     * clusters cancel: Likelihood::point_loglikelihood_odds() plus the difference of the two scalar
+     * priors, so a launch-state update reads the members of ci and cj only instead of scoring
+     * all K clusters. Equal to the difference of entries ci and cj of
+     * compute_gibbs_log_weights() up to rounding.
+     */
+    double restricted_gibbs_log_odds(int index, int ci, int cj) const {
+        return likelihood.point_loglikelihood_odds(index, ci, cj) + process.gibbs_prior_existing_cluster(ci, index) -
+               process.gibbs_prior_existing_cluster(cj, index);
+    }
+
+    /**
+     * @brief Turns unnormalized log-weights into probabilities in place
+     *
+     * @param log_weights Log-weights, overwritten with the normalized probabilities
+     * @return Log normalizing constant (log-sum-exp of the input)
+     * @details Through the table of cpu_dispatch, vectorized for the instruction set of the CPU.
+     */
+    static double normalize_log_weights(Eigen::Ref<Eigen::VectorXd> log_weights) {
+        return cpu_dispatch::kernels().normalize_log_weights(log_weights.data(), static_cast<int>(log_weights.size()));
+    }
+
+    /**
+     * @brief Samples an index from the first m entries of gibbs_log_weights
+     *
+     * @param m Number of candidates
+     * @return Sampled index in [0, m); the buffer is left holding the probabilities
+     */
+    int sample_gibbs_log_weights(int m) {
+        normalize_log_weights(gibbs_log_weights.head(m));
+        return gen.categorical(gibbs_log_weights.data(), m, 1.0);
+    }
+
+    // ========== Running Log-Likelihood ==========
+
+    /**
+     * @brief Adds the likelihood change of an accepted move to the running log-likelihood
+     *
+     * @param delta Change of the log-likelihood of the sampler's likelihood (tempered, if it is)
+     *
+     * @details Divided by Likelihood::inverse_temperature(), so the running value stays
+     * untempered. No effect while the Data does not track it.
+     */
+    void track_log_likelihood(double delta) {
+        if (data.tracks_log_likelihood())
+            data.add_running_log_likelihood(delta / likelihood.inverse_temperature());
+    }
+
+    /**
+     * @brief sample_gibbs_log_weights() for the Gibbs move of a point, tracking its likelihood change
+     *
+     * @param index Point being updated (unallocated)
+     * @param m Number of candidates filled by compute_gibbs_log_weights()
+     * @param old_candidate Candidate of the cluster the point left (K, the new cluster, if it was
+     * a singleton)
+     * @return Sampled candidate, drawn exactly as by sample_gibbs_log_weights()
+     *
+     * @details The log-weights are the full conditional log(likelihood x prior) of each candidate
+     * given the other points, so the sampled entry minus that of old_candidate is the change of
+     * the log joint; the change of the log prior, two scalar Gibbs priors, is subtracted to leave
+     * the likelihood change. Nothing is computed while the Data does not track it, or if the
+     * conditionals of the likelihood are not increments of its cluster terms
+     * (Likelihood::exact_conditionals()).
+     */
+    int sample_gibbs_move(int index, int m, int old_candidate) {
+        if (!data.tracks_log_likelihood() || !likelihood.exact_conditionals())
+            return sample_gibbs_log_weights(m);
+
+        const int K = m - 1;
+        const double old_weight = gibbs_log_weights(old_candidate);
+        const double log_norm = normalize_log_weights(gibbs_log_weights.head(m));
+        const int sampled = gen.categorical(gibbs_log_weights.data(), m, 1.0);
+        if (sampled == old_candidate)
+            return sampled;
+
+        auto log_prior = [&](int k) {
+            return k == K ? process.gibbs_prior_new_cluster_obs(index) : process.gibbs_prior_existing_cluster(k, index);
+        };
+        const double log_joint = std::log(gibbs_log_weights(sampled)) + log_norm - old_weight;
+        track_log_likelihood(log_joint - (log_prior(sampled) - log_prior(old_candidate)));
+        return sampled;
+    }
 
 public:
+    /** @brief Cost of scoring one candidate, in gathered distances (see gibbs_work()) */
+    static constexpr int gibbs_candidate_cost = 32;
+
+    /**
+     * @brief Default gibbs_min_work: below it an OpenMP fork-join costs more than it saves
+     * (a hot team forks in a few microseconds, the serial pass reads ~1 distance per ns)
+     */
+    static constexpr long default_gibbs_min_work = 1L << 16;
+
     // ========== Constructor ==========
 
     /**
@@ -86,6 +265,8 @@ public:
      * probabilities
      * @param pr Reference to Process object (DP, NGGP, DPW, or NGGPW) defining
      * the prior
+     * @param rng Random number generator stream used by this sampler (default:
+     * non-deterministically seeded)
      *
      * @details The constructor establishes references to all components needed
      * for MCMC sampling. The specific behavior depends on the concrete
@@ -94,8 +275,8 @@ public:
      * - Different Likelihood models handle various data types and distributions
      * - Parameter settings control burn-in, iterations, and hyperparameter values
      */
-    Sampler(Data &d, const Params &p, const Likelihood &l, Process &pr)
-        : data(d), params(p), likelihood(l), process(pr) {};
+    Sampler(Data &d, const Params &p, const Likelihood &l, Process &pr, Rng rng = Rng())
+        : data(d), params(p), likelihood(l), process(pr), gen(rng), gibbs_log_weights(d.get_n() + 1) {};
 
     // ========== Pure Virtual Interface ==========
 
@@ -124,6 +305,104 @@ public:
      */
     virtual void step() = 0;
 
+    // ========== Warm Start ==========
+
+    /**
+     * @brief Allocates the unallocated points by one Gibbs draw each
+     *
+     * @return Number of points allocated
+     *
+     * @details Visits the points with allocation -1 in index order and draws each from its full
+     * conditional (compute_gibbs_log_weights(), existing clusters and a new one) given the points
+     * allocated so far. After Params::append_points(), a stack rebuilt with the previous partition
+     * for the old points and -1 for the new ones thus starts next to the posterior of the old
+     * chain, and needs a short burn-in instead of a cold start.
+     */
+    int allocate_unallocated_points() {
+        int allocated = 0;
+        for (int i = 0; i < data.get_n(); ++i) {
+            if (data.get_cluster_assignment(i) >= 0)
+                continue;
+            const int k = sample_gibbs_log_weights(compute_gibbs_log_weights(i));
+            data.set_allocation(i, k);
+            ++allocated;
+        }
+        return allocated;
+    }
+
+    /**
+     * @brief Whether step() reports the likelihood change of every move it makes
+     *
+     * @return false (default); true for the samplers that keep the running log-likelihood of the
+     * Data up to date (see track_log_likelihood()). ChainRunner stops the tracking after stepping
+     * a sampler that does not
+     */
+    virtual bool tracks_log_likelihood() const { return false; }
+
+    // ========== Threading ==========
+
+    /**
+     * @brief Splits the candidate scoring of the Gibbs kernel over OpenMP threads
+     *
+     * @param n_threads Threads per point update (1: serial, the default)
+     * @param min_work Updates with gibbs_work(K) = n + gibbs_candidate_cost K below this stay serial
+     * @throws std::invalid_argument if n_threads < 1 or min_work < 0
+     *
+     * @details Opt-in, for chains with large n or hundreds of clusters (early burn-in, NGGP on big
+     * data). The OpenMP team persists across point updates, so each update pays one fork-join.
+     * Likelihoods built on per-cluster row sums (Natarajan, Gamma) split the row pass into
+     * per-thread partial buffers reduced in thread order, and the candidates in static chunks:
+     * chains are reproducible for a given n_threads, and differ from the serial chain only through
+     * the rounding of the sums. Other likelihoods run serially. Within run_chains() the chains
+     * already occupy the threads and the nested regions run on one thread each. The threads share
+     * one non-reentrant Likelihood (see its class note) and only run inside its parallel kernel;
+     * two samplers must not step over the same likelihood concurrently.
+     */
+    void set_gibbs_threads(int n_threads, long min_work = default_gibbs_min_work) {
+        if (n_threads < 1 || min_work < 0) {
+            throw std::invalid_argument("Sampler: n_threads must be positive and min_work non-negative");
+        }
+        gibbs_threads = n_threads;
+        gibbs_min_work = min_work;
+    }
+
+    /** @brief Threads of the Gibbs kernel, see set_gibbs_threads() */
+    int get_gibbs_threads() const { return gibbs_threads; }
+
+    // ========== Checkpointing ==========
+
+    /**
+     * @brief Writes the state of the sampler to a checkpoint
+     *
+     * @param out Checkpoint being written
+     *
+     * @details The base writes the random stream. Samplers with state that outlives a step
+     * (acceptance counters, adapted quantities, inner samplers) override both methods, call the
+     * base first and then write their own section; per-step scratch buffers are not written.
+     * The Data, Process and Likelihood are checkpointed by ChainRunner, not by the samplers.
+     */
+    virtual void write_checkpoint(CheckpointWriter &out) const {
+        out.begin("Sampler");
+        out.write(gen);
+    }
+
+    /**
+     * @brief Restores the state written by write_checkpoint()
+     *
+     * @param in Checkpoint being read
+     * @throws std::runtime_error if the checkpoint was written by a different sampler
+     */
+    virtual void read_checkpoint(CheckpointReader &in) {
+        in.expect("Sampler");
+        in.read(gen);
+    }
+
+    /**
+     * @brief Heap bytes of the Gibbs weights, the scratch arena and any buffer of the sampler
+     * @see MemoryReport
+     */
+    virtual std::size_t memory_bytes() const { return MemoryReport::bytes(gibbs_log_weights) + workspace.capacity(); }
+
     /**
      * @brief Virtual destructor for proper cleanup of derived classes
      */
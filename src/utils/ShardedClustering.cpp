@@ -0,0 +1,263 @@
+/**
+ * @file ShardedClustering.cpp
+ * @brief Implementation of the divide-and-conquer shards, summaries and merge
+ */
+
+#include "ShardedClustering.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <numeric>
+#include <stdexcept>
+#include <utility>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace {
+
+/** @brief Shuffles values in place (Fisher-Yates) */
+void shuffle(std::vector<int> &values, Rng &rng) {
+    for (int q = static_cast<int>(values.size()) - 1; q > 0; --q)
+        std::swap(values[q], values[rng.uniform_int(q + 1)]);
+}
+
+} // namespace
+
+std::vector<std::vector<int>> ShardedClustering::assign_shards(int n, int shards, const std::vector<int> &labels,
+                                                               Rng &rng) {
+    if (shards < 1 || shards > std::max(n, 1)) {
+        throw std::invalid_argument("ShardedClustering: the number of shards must be between 1 and n");
+    }
+    if (!labels.empty() && static_cast<int>(labels.size()) != n) {
+        throw std::invalid_argument("ShardedClustering: labels must have one entry per point");
+    }
+
+    std::vector<std::vector<int>> result(shards);
+    if (labels.empty()) {
+        std::vector<int> order(n);
+        std::iota(order.begin(), order.end(), 0);
+        shuffle(order, rng);
+        for (int q = 0; q < n; ++q)
+            result[q % shards].push_back(order[q]);
+    } else {
+        // Clusters, with every unallocated point (negative label) on its own
+        const int K = n > 0 ? std::max(*std::max_element(labels.begin(), labels.end()) + 1, 0) : 0;
+        std::vector<std::vector<int>> clusters(K);
+        for (int i = 0; i < n; ++i) {
+            if (labels[i] >= 0)
+                clusters[labels[i]].push_back(i);
+            else
+                clusters.push_back({i});
+        }
+        std::vector<int> order(clusters.size());
+        std::iota(order.begin(), order.end(), 0);
+        shuffle(order, rng);
+        std::stable_sort(order.begin(), order.end(),
+                         [&](int a, int b) { return clusters[a].size() > clusters[b].size(); });
+
+        // Largest cluster first, to the lightest shard; cut where the shard is full
+        const size_t capacity = (static_cast<size_t>(n) + shards - 1) / shards;
+        for (const int c : order) {
+            size_t taken = 0;
+            while (taken < clusters[c].size()) {
+                auto lightest = std::min_element(result.begin(), result.end(), [](const auto &a, const auto &b) {
+                    return a.size() < b.size();
+                });
+                const size_t room = std::min(capacity - lightest->size(), clusters[c].size() - taken);
+                lightest->insert(lightest->end(), clusters[c].begin() + taken, clusters[c].begin() + taken + room);
+                taken += room;
+            }
+        }
+    }
+
+    for (std::vector<int> &points : result)
+        std::sort(points.begin(), points.end());
+    return result;
+}
+
+std::vector<ShardedClustering::Summary> ShardedClustering::summarize(int shard, const std::vector<int> &points,
+                                                                     const std::vector<int> &local_labels,
+                                                                     const DistanceFn &distance, int representatives,
+                                                                     Rng &rng) {
+    if (points.size() != local_labels.size()) {
+        throw std::invalid_argument("ShardedClustering: local labels must have one entry per point of the shard");
+    }
+    if (representatives < 1) {
+        throw std::invalid_argument("ShardedClustering: need at least one representative per cluster");
+    }
+
+    int K = 0;
+    for (const int label : local_labels) {
+        if (label < 0) {
+            throw std::invalid_argument("ShardedClustering: every point of a shard must be allocated");
+        }
+        K = std::max(K, label + 1);
+    }
+    std::vector<std::vector<int>> members(K);
+    for (size_t q = 0; q < points.size(); ++q)
+        members[local_labels[q]].push_back(points[q]);
+
+    std::vector<Summary> summaries;
+    for (int k = 0; k < K; ++k) {
+        if (members[k].empty())
+            continue;
+        Summary summary;
+        summary.shard = shard;
+        summary.label = k;
+        summary.size = static_cast<int>(members[k].size());
+
+        // Representatives by a partial Fisher-Yates shuffle of the members
+        std::vector<int> &pool = members[k];
+        const int R = std::min(representatives, summary.size);
+        for (int q = 0; q < R; ++q)
+            std::swap(pool[q], pool[q + rng.uniform_int(summary.size - q)]);
+        summary.representatives.assign(pool.begin(), pool.begin() + R);
+        std::sort(summary.representatives.begin(), summary.representatives.end());
+
+        double sum = 0.0;
+        for (int a = 0; a < R; ++a)
+            for (int b = a + 1; b < R; ++b)
+                sum += distance(summary.representatives[a], summary.representatives[b]);
+        summary.has_spread = R > 1;
+        summary.spread = summary.has_spread ? sum / (0.5 * R * (R - 1)) : 0.0;
+        summaries.push_back(std::move(summary));
+    }
+    return summaries;
+}
+
+std::vector<int> ShardedClustering::merge(const std::vector<Summary> &summaries, const DistanceFn &distance,
+                                          double threshold, int n_threads) {
+    if (!(threshold > 0.0)) {
+        throw std::invalid_argument("ShardedClustering: the merge threshold must be positive");
+    }
+    const int M = static_cast<int>(summaries.size());
+    std::vector<int> groups(M);
+    std::iota(groups.begin(), groups.end(), 0);
+    if (M < 2)
+        return groups;
+
+    // Spread of the clusters with a single representative: pooled over the others
+    double pooled = 0.0, pooled_size = 0.0;
+    for (const Summary &summary : summaries) {
+        if (summary.has_spread) {
+            pooled += summary.size * summary.spread;
+            pooled_size += summary.size;
+        }
+    }
+    if (pooled_size == 0.0)
+        return groups;
+    pooled /= pooled_size;
+
+    // Sums and counts of the representative distances of every pair of clusters, then of groups
+    const size_t stride = M;
+    std::vector<double> link_sum(stride * M, 0.0), link_count(stride * M, 0.0);
+#ifdef _OPENMP
+    if (n_threads <= 0)
+        n_threads = omp_get_max_threads();
+#pragma omp parallel for schedule(dynamic, 1) num_threads(n_threads)
+#endif
+    for (int a = 0; a < M; ++a) {
+        for (int b = a + 1; b < M; ++b) {
+            double sum = 0.0;
+            for (const int i : summaries[a].representatives)
+                for (const int j : summaries[b].representatives)
+                    sum += distance(i, j);
+            const double count =
+                static_cast<double>(summaries[a].representatives.size() * summaries[b].representatives.size());
+            link_sum[a * stride + b] = link_sum[b * stride + a] = sum;
+            link_count[a * stride + b] = link_count[b * stride + a] = count;
+        }
+    }
+
+    int n_shards = 0;
+    for (const Summary &summary : summaries)
+        n_shards = std::max(n_shards, summary.shard + 1);
+    const int words = (n_shards + 63) / 64;
+    std::vector<std::uint64_t> shards_of(static_cast<size_t>(M) * words, 0);
+    std::vector<double> size(M), weighted_spread(M);
+    std::vector<char> alive(M, 1);
+    for (int a = 0; a < M; ++a) {
+        shards_of[static_cast<size_t>(a) * words + summaries[a].shard / 64] |= std::uint64_t(1) << (summaries[a].shard % 64);
+        size[a] = summaries[a].size;
+        weighted_spread[a] = size[a] * (summaries[a].has_spread ? summaries[a].spread : pooled);
+    }
+    const auto disjoint = [&](int g, int h) {
+        for (int w = 0; w < words; ++w)
+            if (shards_of[static_cast<size_t>(g) * words + w] & shards_of[static_cast<size_t>(h) * words + w])
+                return false;
+        return true;
+    };
+
+    // Agglomerate the pair of groups with the smallest linkage / spread ratio while it is within threshold
+    for (;;) {
+        double best = threshold;
+        int best_g = -1, best_h = -1;
+        for (int g = 0; g < M; ++g) {
+            if (!alive[g])
+                continue;
+            for (int h = g + 1; h < M; ++h) {
+                if (!alive[h] || !disjoint(g, h))
+                    continue;
+                const double linkage = link_sum[g * stride + h] / link_count[g * stride + h];
+                const double scale = 0.5 * (weighted_spread[g] / size[g] + weighted_spread[h] / size[h]);
+                const double ratio = scale > 0.0 ? linkage / scale : (linkage == 0.0 ? 0.0 : HUGE_VAL);
+                if (ratio <= best) {
+                    best = ratio;
+                    best_g = g;
+                    best_h = h;
+                }
+            }
+        }
+        if (best_g < 0)
+            break;
+
+        // Group h joins group g
+        alive[best_h] = 0;
+        for (int x = 0; x < M; ++x) {
+            link_sum[best_g * stride + x] += link_sum[best_h * stride + x];
+            link_count[best_g * stride + x] += link_count[best_h * stride + x];
+            link_sum[x * stride + best_g] = link_sum[best_g * stride + x];
+            link_count[x * stride + best_g] = link_count[best_g * stride + x];
+        }
+        for (int w = 0; w < words; ++w)
+            shards_of[static_cast<size_t>(best_g) * words + w] |= shards_of[static_cast<size_t>(best_h) * words + w];
+        size[best_g] += size[best_h];
+        weighted_spread[best_g] += weighted_spread[best_h];
+        for (int &group : groups)
+            if (group == best_h)
+                group = best_g;
+    }
+
+    // Number the groups by first appearance
+    std::vector<int> relabel(M, -1);
+    int next = 0;
+    for (int &group : groups) {
+        if (relabel[group] < 0)
+            relabel[group] = next++;
+        group = relabel[group];
+    }
+    return groups;
+}
+
+std::vector<int> ShardedClustering::global_labels(int n, const std::vector<std::vector<int>> &shards,
+                                                  const std::vector<std::vector<int>> &local_labels,
+                                                  const std::vector<Summary> &summaries,
+                                                  const std::vector<int> &groups) {
+    std::map<std::pair<int, int>, int> group_of;
+    for (size_t m = 0; m < summaries.size(); ++m)
+        group_of[{summaries[m].shard, summaries[m].label}] = groups[m];
+
+    std::vector<int> labels(n, -1);
+    for (size_t s = 0; s < shards.size(); ++s) {
+        for (size_t q = 0; q < shards[s].size(); ++q) {
+            const auto found = group_of.find({static_cast<int>(s), local_labels[s][q]});
+            if (found == group_of.end()) {
+                throw std::invalid_argument("ShardedClustering: a local cluster has no summary");
+            }
+            labels[shards[s][q]] = found->second;
+        }
+    }
+    return labels;
+}
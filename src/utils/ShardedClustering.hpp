@@ -0,0 +1,128 @@
+/**
+ * @file ShardedClustering.hpp
+ * @brief Divide-and-conquer clustering: shards of the points, summaries of their local clusters and a global merge
+ *
+ * @author Filippo Galli
+ * @date 2025
+ */
+
+#pragma once
+
+#include "Rng.hpp"
+#include <functional>
+#include <vector>
+
+/**
+ * @class ShardedClustering
+ * @brief Splits the points into shards clustered independently, then merges the local clusters across shards
+ *
+ * A round of the divide-and-conquer scheme of Zuanetti et al. (2018) and Ni et al. (2020):
+ * 1. assign_shards() cuts the n points into S shards of about n / S points. In the first round
+ *    they are random; afterwards every global cluster is kept in one shard as far as the sizes
+ *    allow, so the next local chains can refine it rather than rediscover it.
+ * 2. Each shard runs its own chain (any Process and sampler stack) on the distances among its
+ *    points only: a Params of n / S points (Params::subset(), DistanceBuilder::block()), so the
+ *    shards together hold n^2 / S distances instead of n^2, and need no data from each other.
+ * 3. summarize() reduces every local cluster of a shard to its size, up to R representatives
+ *    drawn among its members and their mean pairwise distance (its spread).
+ * 4. merge() builds the global partition from the summaries of all the shards alone: local
+ *    clusters of different shards are merged agglomeratively by average linkage on their
+ *    representatives, the closest pair first, while the linkage is at most threshold times the
+ *    mean spread of the two groups. Two clusters of the same shard are never merged: the local
+ *    chain already kept them apart. global_labels() maps every point through the clusters of its
+ *    shard.
+ *
+ * Communication and fidelity: a shard only exports O(K_s R) integers and K_s doubles, and the
+ * merge reads the (sum_s K_s R)^2 distances among representatives, wherever the shards run.
+ * Larger R estimates the linkages and spreads better (R = the cluster sizes gives exact average
+ * linkage) at a quadratic cost; with few representatives, sparse or elongated clusters are merged
+ * less reliably. Whatever R, the global partition is a point estimate assembled from the local
+ * posteriors, not a draw from the full posterior: each local chain sees the prior of n / S points,
+ * so with a DP or NGGP the local clusters are coarser than the global ones would be for the same
+ * mass, and the cross-shard repulsion of the likelihood only enters through the merge. More
+ * rounds, with shards formed from the previous global clusters, move the partition toward the
+ * posterior mode, and a final full-data chain started from it recovers the posterior when the
+ * data fit in memory.
+ *
+ * Reference: Zuanetti, D. A., Müller, P., Zhu, Y., Yang, S., Ji, Y. (2018) "Bayesian nonparametric
+ * clustering for large data sets"; Ni, Y., Müller, P., Diesendruck, M., Williamson, S., Zhu, Y.,
+ * Ji, Y. (2020) "Scalable Bayesian nonparametric clustering and classification"
+ */
+class ShardedClustering {
+public:
+    /** @brief Distance between two points of the full data set */
+    using DistanceFn = std::function<double(int, int)>;
+
+    /** @brief Summary of one local cluster, all the merge needs of it */
+    struct Summary {
+        int shard = 0;                    ///< Shard of the cluster
+        int label = 0;                    ///< Label of the cluster in its shard
+        int size = 0;                     ///< Number of members
+        double spread = 0.0;              ///< Mean distance between distinct representatives (0 with one)
+        bool has_spread = false;          ///< Whether spread is defined (at least two representatives)
+        std::vector<int> representatives; ///< Up to R members, indices in the full data set
+    };
+
+    /**
+     * @brief Assigns the points to shards
+     * @param n Number of points
+     * @param shards Number of shards, at least 1 and at most n
+     * @param labels Global cluster of each point (empty: random shards)
+     * @param rng Generator of the shuffles
+     * @return Points of each shard, in increasing order; sizes differ by at most one without labels,
+     * and are at most ceil(n / shards) with them (clusters larger than that are cut)
+     * @throws std::invalid_argument if shards is out of range or labels has a wrong size
+     *
+     * @details With labels, the clusters are taken from the largest (ties in random order) and each
+     * goes to the shard with the fewest points, which keeps it whole while that shard has room.
+     */
+    static std::vector<std::vector<int>> assign_shards(int n, int shards, const std::vector<int> &labels, Rng &rng);
+
+    /**
+     * @brief Summarizes the local clusters of a shard
+     * @param shard Index of the shard
+     * @param points Points of the shard, indices in the full data set
+     * @param local_labels Label of each point of the shard (0-based, any labelling)
+     * @param distance Distances of the full data set
+     * @param representatives Largest number of representatives per cluster (R, at least 1)
+     * @param rng Generator drawing the representatives
+     * @return One summary per non-empty local cluster, by increasing label
+     * @throws std::invalid_argument if the sizes do not match or representatives < 1
+     */
+    static std::vector<Summary> summarize(int shard, const std::vector<int> &points,
+                                          const std::vector<int> &local_labels, const DistanceFn &distance,
+                                          int representatives, Rng &rng);
+
+    /**
+     * @brief Merges local clusters across shards
+     * @param summaries Summaries of all the shards
+     * @param distance Distances of the full data set
+     * @param threshold Largest ratio of linkage to mean spread of a merge (> 0). Two random parts of
+     * one cluster have a linkage about equal to its spread, so values somewhat above 1 (e.g. 1.5)
+     * merge them while keeping apart clusters separated by more than their spread.
+     * @param n_threads OpenMP threads of the linkages (0: default)
+     * @return Global cluster of each summary, 0-based and numbered by first appearance
+     * @throws std::invalid_argument if threshold is not positive
+     *
+     * @details The spread of a cluster with one representative is the size-weighted mean spread of
+     * the others (no merge at all if no cluster has two representatives). The linkage of two
+     * groups is the mean distance over all the pairs of their representatives, and the spread of a
+     * group the size-weighted mean spread of its clusters.
+     */
+    static std::vector<int> merge(const std::vector<Summary> &summaries, const DistanceFn &distance, double threshold,
+                                  int n_threads = 0);
+
+    /**
+     * @brief Global labels of the points
+     * @param n Number of points
+     * @param shards Points of each shard, as from assign_shards()
+     * @param local_labels Local labels of the points of each shard
+     * @param summaries Summaries of all the shards
+     * @param groups Global cluster of each summary, as from merge()
+     * @return Global cluster of each point (0-based)
+     * @throws std::invalid_argument if a local cluster has no summary
+     */
+    static std::vector<int> global_labels(int n, const std::vector<std::vector<int>> &shards,
+                                          const std::vector<std::vector<int>> &local_labels,
+                                          const std::vector<Summary> &summaries, const std::vector<int> &groups);
+};
@@ -0,0 +1,213 @@
+/**
+ * @file SparseAdjacency.hpp
+ * @brief Compressed sparse row storage of a spatial adjacency graph
+ *
+ * @author Filippo Galli
+ * @date 2025
+ */
+
+#pragma once
+
+#include <Eigen/Dense>
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/**
+ * @class SparseAdjacency
+ * @brief Neighbour lists of n points as offsets into one flat array
+ *
+ * The neighbours of point i are neighbors[offsets[i]], ..., neighbors[offsets[i + 1] - 1], in
+ * ascending order and without duplicates. Memory is 4 (n + 1 + E) bytes for E stored entries
+ * (twice the number of undirected edges), and building from sparse input is O(n + E) up to the
+ * sort of each neighbour list.
+ *
+ * The spatial terms assume a symmetric graph (each edge counted from both ends); the builders
+ * keep exactly the entries they are given, except from_edges() which can symmetrize.
+ */
+class SparseAdjacency {
+private:
+    int n = 0;                        ///< Number of points
+    std::vector<int> offsets = {0};   ///< Start of the neighbours of each point, n + 1 entries
+    std::vector<int> neighbors;       ///< Neighbour indices of all points, concatenated
+
+    /**
+     * @brief Builds from row indices and column indices of the entries, in any order
+     * @param n Number of points
+     * @param rows Row index of each entry
+     * @param cols Column index of each entry
+     * @throws std::invalid_argument if an index is outside [0, n)
+     */
+    static SparseAdjacency from_pairs(int n, const std::vector<int> &rows, const std::vector<int> &cols) {
+        SparseAdjacency graph;
+        graph.n = n;
+        graph.offsets.assign(n + 1, 0);
+        for (size_t e = 0; e < rows.size(); ++e) {
+            if (rows[e] < 0 || rows[e] >= n || cols[e] < 0 || cols[e] >= n) {
+                throw std::invalid_argument("SparseAdjacency: entry (" + std::to_string(rows[e]) + ", " +
+                                            std::to_string(cols[e]) + ") outside a graph of " +
+                                            std::to_string(n) + " points");
+            }
+            ++graph.offsets[rows[e] + 1];
+        }
+        for (int i = 0; i < n; ++i)
+            graph.offsets[i + 1] += graph.offsets[i];
+
+        // Counting sort by row, then sort and deduplicate each row in place
+        graph.neighbors.resize(rows.size());
+        std::vector<int> fill(graph.offsets.begin(), graph.offsets.end() - 1);
+        for (size_t e = 0; e < rows.size(); ++e)
+            graph.neighbors[fill[rows[e]]++] = cols[e];
+
+        int out = 0;
+        for (int i = 0; i < n; ++i) {
+            const auto first = graph.neighbors.begin() + graph.offsets[i];
+            const auto last = graph.neighbors.begin() + graph.offsets[i + 1];
+            std::sort(first, last);
+            const auto unique_last = std::unique(first, last);
+            graph.offsets[i] = out;
+            out = static_cast<int>(std::move(first, unique_last, graph.neighbors.begin() + out) -
+                                   graph.neighbors.begin());
+        }
+        graph.offsets[n] = out;
+        graph.neighbors.resize(out);
+        graph.neighbors.shrink_to_fit();
+        return graph;
+    }
+
+public:
+    /**
+     * @struct Row
+     * @brief Read-only view of the neighbours of one point
+     */
+    struct Row {
+        const int *first; ///< First neighbour
+        const int *last;  ///< One past the last neighbour
+
+        const int *begin() const { return first; }
+        const int *end() const { return last; }
+        size_t size() const { return static_cast<size_t>(last - first); }
+        int operator[](size_t j) const { return first[j]; }
+    };
+
+    SparseAdjacency() = default;
+
+    /**
+     * @brief Builds from a dense 0/1 adjacency matrix (entries equal to 1 are edges)
+     * @param W Square adjacency matrix
+     * @throws std::invalid_argument if W is not square
+     */
+    static SparseAdjacency from_dense(const Eigen::Ref<const Eigen::MatrixXi> &W) {
+        if (W.rows() != W.cols()) {
+            throw std::invalid_argument("SparseAdjacency: adjacency matrix must be square");
+        }
+        SparseAdjacency graph;
+        graph.n = static_cast<int>(W.rows());
+        graph.offsets.assign(graph.n + 1, 0);
+        for (int i = 0; i < graph.n; ++i) {
+            for (int j = 0; j < graph.n; ++j) {
+                if (W(i, j) == 1) {
+                    graph.neighbors.push_back(j);
+                }
+            }
+            graph.offsets[i + 1] = static_cast<int>(graph.neighbors.size());
+        }
+        return graph;
+    }
+
+    /**
+     * @brief Builds from compressed sparse column arrays (the p, i and x slots of a dgCMatrix)
+     * @param n Number of points (the matrix is n x n)
+     * @param col_ptr Column pointers, n + 1 entries
+     * @param row_idx Row index of each stored entry, col_ptr[n] entries
+     * @param values Value of each stored entry, or nullptr for a pattern matrix; zeros are skipped
+     *
+     * Row i of the result lists the columns j with a non-zero W(i, j), so W need not be symmetric
+     * for the transposition to be right.
+     */
+    static SparseAdjacency from_csc(int n, const int *col_ptr, const int *row_idx, const double *values = nullptr) {
+        if (col_ptr[0] != 0 || col_ptr[n] < 0) {
+            throw std::invalid_argument("SparseAdjacency: malformed column pointers");
+        }
+        std::vector<int> rows, cols;
+        rows.reserve(col_ptr[n]);
+        cols.reserve(col_ptr[n]);
+        for (int j = 0; j < n; ++j) {
+            for (int e = col_ptr[j]; e < col_ptr[j + 1]; ++e) {
+                if (values && values[e] == 0.0)
+                    continue;
+                rows.push_back(row_idx[e]);
+                cols.push_back(j);
+            }
+        }
+        return from_pairs(n, rows, cols);
+    }
+
+    /**
+     * @brief Builds from an edge list (0-based indices)
+     * @param n Number of points
+     * @param from First end of each edge
+     * @param to Second end of each edge
+     * @param symmetric If true each edge is stored in both directions (default: true)
+     * @throws std::invalid_argument if from and to differ in length or an index is outside [0, n)
+     */
+    static SparseAdjacency from_edges(int n, const std::vector<int> &from, const std::vector<int> &to,
+                                      bool symmetric = true) {
+        if (from.size() != to.size()) {
+            throw std::invalid_argument("SparseAdjacency: edge endpoints differ in length");
+        }
+        if (!symmetric) {
+            return from_pairs(n, from, to);
+        }
+        std::vector<int> rows(from), cols(to);
+        rows.insert(rows.end(), to.begin(), to.end());
+        cols.insert(cols.end(), from.begin(), from.end());
+        return from_pairs(n, rows, cols);
+    }
+
+    /** @brief Neighbours of point i */
+    Row operator[](int i) const {
+        const int *base = neighbors.data();
+        return Row{base + offsets[i], base + offsets[i + 1]};
+    }
+
+    /** @brief Number of neighbours of point i */
+    int degree(int i) const { return offsets[i + 1] - offsets[i]; }
+
+    /** @brief Number of points */
+    int size() const { return n; }
+
+    /** @brief Number of stored entries (each undirected edge counts twice) */
+    size_t num_entries() const { return neighbors.size(); }
+
+    /** @brief Heap bytes of the offsets and neighbour indices */
+    size_t memory_bytes() const { return (offsets.capacity() + neighbors.capacity()) * sizeof(int); }
+
+    /** @brief Whether every entry (i, j) has its reverse (j, i) */
+    bool is_symmetric() const {
+        for (int i = 0; i < n; ++i) {
+            for (const int j : (*this)[i]) {
+                const Row back = (*this)[j];
+                if (!std::binary_search(back.begin(), back.end(), i))
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    /** @brief The graph with every entry reversed: row i lists the points that have i as a neighbour */
+    SparseAdjacency transposed() const {
+        std::vector<int> rows, cols;
+        rows.reserve(neighbors.size());
+        cols.reserve(neighbors.size());
+        for (int i = 0; i < n; ++i) {
+            for (const int j : (*this)[i]) {
+                rows.push_back(j);
+                cols.push_back(i);
+            }
+        }
+        return from_pairs(n, rows, cols);
+    }
+};
@@ -0,0 +1,166 @@
+/**
+ * @file SweepOrder.cpp
+ * @brief Implementation of the sweep orders
+ */
+
+#include "SweepOrder.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+/** @brief Cells per side of the Hilbert grid */
+constexpr std::uint32_t hilbert_side = 1u << 16;
+
+/** @brief Position of cell (x, y) along the Hilbert curve of the grid */
+std::uint64_t hilbert_index(std::uint32_t x, std::uint32_t y) {
+    std::uint64_t d = 0;
+    for (std::uint32_t s = hilbert_side / 2; s > 0; s /= 2) {
+        const std::uint32_t rx = (x & s) ? 1 : 0;
+        const std::uint32_t ry = (y & s) ? 1 : 0;
+        d += static_cast<std::uint64_t>(s) * s * ((3 * rx) ^ ry);
+        if (ry == 0) {
+            if (rx == 1) {
+                x = hilbert_side - 1 - x;
+                y = hilbert_side - 1 - y;
+            }
+            std::swap(x, y);
+        }
+    }
+    return d;
+}
+
+/** @brief Squared distance of i and j left after the first dims coordinates of X, clipped at 0 */
+double residual_sq(const Params &params, const Eigen::MatrixXd &X, int dims, int i, int j) {
+    const double d = params.distance(i, j);
+    double r = d * d;
+    for (int c = 0; c < dims; ++c) {
+        const double diff = X(i, c) - X(j, c);
+        r -= diff * diff;
+    }
+    return std::max(r, 0.0);
+}
+
+/** @brief Point farthest from pivot in the residual distance (smallest index on ties) */
+int farthest(const Params &params, const Eigen::MatrixXd &X, int dims, int pivot) {
+    int best = pivot;
+    double best_sq = -1.0;
+    for (int i = 0; i < params.n; ++i) {
+        const double r = residual_sq(params, X, dims, pivot, i);
+        if (r > best_sq) {
+            best_sq = r;
+            best = i;
+        }
+    }
+    return best;
+}
+
+} // namespace
+
+namespace sweep_order {
+
+std::vector<int> reverse_cuthill_mckee(const SparseAdjacency &graph) {
+    const int n = graph.size();
+    std::vector<int> degree(n);
+    for (int i = 0; i < n; ++i)
+        degree[i] = static_cast<int>(graph[i].size());
+    const auto by_degree = [&degree](int a, int b) {
+        return degree[a] != degree[b] ? degree[a] < degree[b] : a < b;
+    };
+
+    // Roots are taken in increasing degree, the first unvisited one starting each component
+    std::vector<int> roots(n);
+    std::iota(roots.begin(), roots.end(), 0);
+    std::sort(roots.begin(), roots.end(), by_degree);
+
+    std::vector<int> order;
+    order.reserve(n);
+    std::vector<char> visited(n, 0);
+    for (const int root : roots) {
+        if (visited[root])
+            continue;
+        visited[root] = 1;
+        order.push_back(root);
+        for (size_t head = order.size() - 1; head < order.size(); ++head) {
+            const size_t first = order.size();
+            for (const int j : graph[order[head]]) {
+                if (!visited[j]) {
+                    visited[j] = 1;
+                    order.push_back(j);
+                }
+            }
+            std::sort(order.begin() + first, order.end(), by_degree);
+        }
+    }
+    std::reverse(order.begin(), order.end());
+    return order;
+}
+
+Eigen::MatrixXd fastmap_embedding(const Params &params, int dims) {
+    if (dims < 1) {
+        throw std::invalid_argument("sweep_order: the embedding needs at least one coordinate");
+    }
+    const int n = params.n;
+    Eigen::MatrixXd X = Eigen::MatrixXd::Zero(n, dims);
+    if (n == 0)
+        return X;
+
+    for (int c = 0; c < dims; ++c) {
+        const int a0 = farthest(params, X, c, 0);
+        const int b = farthest(params, X, c, a0);
+        const int a = farthest(params, X, c, b);
+        const double ab_sq = residual_sq(params, X, c, a, b);
+        if (ab_sq <= 0.0)
+            break; // the previous coordinates explain all the distances
+        const double ab = std::sqrt(ab_sq);
+        for (int i = 0; i < n; ++i)
+            X(i, c) = (residual_sq(params, X, c, a, i) + ab_sq - residual_sq(params, X, c, b, i)) / (2.0 * ab);
+    }
+    return X;
+}
+
+std::vector<int> hilbert_order(const Eigen::MatrixXd &coords) {
+    if (coords.cols() != 2) {
+        throw std::invalid_argument("sweep_order: the Hilbert order needs two coordinates");
+    }
+    const int n = static_cast<int>(coords.rows());
+    std::vector<int> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    if (n == 0)
+        return order;
+
+    const Eigen::RowVector2d lo = coords.colwise().minCoeff();
+    const Eigen::RowVector2d span = coords.colwise().maxCoeff() - lo;
+    const double cells = static_cast<double>(hilbert_side - 1);
+    const auto cell = [&](int i, int c) {
+        return span(c) > 0 ? static_cast<std::uint32_t>((coords(i, c) - lo(c)) / span(c) * cells) : 0u;
+    };
+
+    std::vector<std::uint64_t> key(n);
+    for (int i = 0; i < n; ++i)
+        key[i] = hilbert_index(cell(i, 0), cell(i, 1));
+    std::stable_sort(order.begin(), order.end(), [&key](int a, int b) { return key[a] < key[b]; });
+    return order;
+}
+
+std::vector<int> distance_order(const Params &params) { return hilbert_order(fastmap_embedding(params, 2)); }
+
+void check_permutation(const std::vector<int> &order, int n, const std::string &owner) {
+    if (static_cast<int>(order.size()) != n) {
+        throw std::invalid_argument(owner + ": visiting order has " + std::to_string(order.size()) +
+                                    " entries for " + std::to_string(n) + " points");
+    }
+    std::vector<char> seen(n, 0);
+    for (const int i : order) {
+        if (i < 0 || i >= n || seen[i]) {
+            throw std::invalid_argument(owner + ": visiting order is not a permutation of the points");
+        }
+        seen[i] = 1;
+    }
+}
+
+} // namespace sweep_order
@@ -0,0 +1,84 @@
+/**
+ * @file SweepOrder.hpp
+ * @brief Locality-preserving visiting orders for the point updates of a Gibbs sweep
+ *
+ * @author Filippo Galli
+ * @date 2025
+ */
+
+#pragma once
+
+#include "Params.hpp"
+#include "SparseAdjacency.hpp"
+#include <Eigen/Dense>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Permutations of the points for Neal3::set_visit_order()
+ *
+ * A sweep visiting consecutive points that are close (neighbours on the spatial graph, or near
+ * in D) reads overlapping data in consecutive updates: the neighbour lists and the allocations of
+ * the neighbours of a spatial term, the rows of D of a ClusterLayout. Any fixed order leaves the
+ * posterior invariant, so these orders change the speed of a sweep, not the chain's target.
+ */
+namespace sweep_order {
+
+/**
+ * @brief Reverse Cuthill-McKee order of a graph
+ *
+ * Breadth-first search started from a vertex of smallest degree of each connected component,
+ * neighbours visited by increasing degree (ties by index), then reversed; the bandwidth of the
+ * reordered adjacency is small, so the neighbours of a point are visited close to it. O(n + E)
+ * up to the sort of each neighbour list by degree.
+ *
+ * @param graph Symmetric adjacency of the points
+ * @return Permutation of 0, ..., n - 1: the point visited at each position
+ */
+std::vector<int> reverse_cuthill_mckee(const SparseAdjacency &graph);
+
+/**
+ * @brief FastMap embedding of the points in dims coordinates, from the distances only
+ *
+ * Each coordinate projects the points on the line through two pivots far apart (found by two
+ * farthest-point passes, started from point 0), using the distances left unexplained by the
+ * previous coordinates. O(dims n) distance reads, so it works on every storage of Params
+ * (dense, packed, mapped) without forming D. Non-Euclidean distances are clipped where the
+ * residual would be negative.
+ *
+ * @param params Parameters holding the n x n distances
+ * @param dims Number of coordinates (>= 1)
+ * @return n x dims coordinates
+ * @throws std::invalid_argument if dims < 1
+ */
+Eigen::MatrixXd fastmap_embedding(const Params &params, int dims = 2);
+
+/**
+ * @brief Order of points along a Hilbert curve through their bounding box
+ *
+ * The coordinates are scaled to a 2^16 x 2^16 grid; points in the same cell keep their index
+ * order. Points close on the curve are close in the plane.
+ *
+ * @param coords n x 2 coordinates
+ * @return Permutation of 0, ..., n - 1
+ * @throws std::invalid_argument if coords does not have two columns
+ */
+std::vector<int> hilbert_order(const Eigen::MatrixXd &coords);
+
+/**
+ * @brief Hilbert order of the two-dimensional FastMap embedding of the distances
+ * @param params Parameters holding the n x n distances
+ * @return Permutation of 0, ..., n - 1
+ */
+std::vector<int> distance_order(const Params &params);
+
+/**
+ * @brief Checks that order is a permutation of 0, ..., n - 1
+ * @param order Visiting order
+ * @param n Number of points
+ * @param owner Class name prefixed to the message
+ * @throws std::invalid_argument otherwise
+ */
+void check_permutation(const std::vector<int> &order, int n, const std::string &owner);
+
+} // namespace sweep_order
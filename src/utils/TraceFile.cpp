@@ -0,0 +1,321 @@
+/**
+ * @file TraceFile.cpp
+ * @brief Implementation of TraceWriter and TraceReader
+ */
+
+#include "TraceFile.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#if TRACE_FILE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace {
+
+// ========== Varint Encoding ==========
+
+void put_varint(std::vector<uint8_t> &out, uint32_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+uint32_t get_varint(const uint8_t *&pos, const uint8_t *end) {
+    uint32_t value = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (pos == end)
+            throw std::runtime_error("Corrupt trace payload");
+        const uint8_t byte = *pos++;
+        value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return value;
+    }
+    throw std::runtime_error("Corrupt trace payload");
+}
+
+int64_t file_size_of(std::FILE *file) {
+    if (std::fseek(file, 0, SEEK_END) != 0)
+        return -1;
+    const long size = std::ftell(file);
+    return size < 0 ? -1 : static_cast<int64_t>(size);
+}
+
+} // namespace
+
+// ========== TraceWriter ==========
+
+TraceWriter::TraceWriter(const std::string &path, int n, int keyframe_interval, int compression_level)
+    : file(nullptr, &std::fclose), path(path), n(n), keyframe_interval(keyframe_interval),
+      compression_level(compression_level) {
+
+    if (n < 1 || keyframe_interval < 1) {
+        throw std::invalid_argument("Trace needs positive n and keyframe interval");
+    }
+    if (compression_level < 0 || compression_level > 9) {
+        throw std::invalid_argument("Trace compression level must be between 0 and 9");
+    }
+#if !TRACE_FILE_ZLIB
+    if (compression_level > 0) {
+        throw std::invalid_argument("Trace compression requires a build with -DTRACE_FILE_ZLIB=1");
+    }
+#endif
+
+    file.reset(std::fopen(path.c_str(), "wb"));
+    if (!file) {
+        throw std::runtime_error("Cannot create trace file " + path + ": " + std::strerror(errno));
+    }
+
+    const int32_t header[4] = {n, keyframe_interval, compression_level, 0};
+    write_bytes(trace_file::magic, sizeof(trace_file::magic));
+    write_bytes(header, sizeof(header));
+    previous.assign(n, 0);
+}
+
+TraceWriter::~TraceWriter() {
+    try {
+        close();
+    } catch (...) {
+    }
+}
+
+void TraceWriter::write_bytes(const void *data, std::size_t size) {
+    if (size > 0 && std::fwrite(data, 1, size, file.get()) != size) {
+        throw std::runtime_error("Error while writing trace file " + path);
+    }
+}
+
+void TraceWriter::write(const int *allocations, int K, double U, double log_likelihood) {
+    if (!file) {
+        throw std::runtime_error("Trace file " + path + " is closed");
+    }
+
+    // Keyframe: all labels; delta: (gap, label) of the labels that changed
+    const bool is_keyframe = offsets.size() % keyframe_interval == 0;
+    payload.clear();
+    if (is_keyframe) {
+        for (int i = 0; i < n; ++i)
+            put_varint(payload, static_cast<uint32_t>(allocations[i] + 1));
+    } else {
+        int last = -1;
+        for (int i = 0; i < n; ++i) {
+            if (allocations[i] != previous[i]) {
+                put_varint(payload, static_cast<uint32_t>(i - last - 1));
+                put_varint(payload, static_cast<uint32_t>(allocations[i] + 1));
+                last = i;
+            }
+        }
+    }
+    std::copy(allocations, allocations + n, previous.begin());
+
+    const uint8_t *stored = payload.data();
+    std::size_t stored_size = payload.size();
+#if TRACE_FILE_ZLIB
+    if (compression_level > 0 && !payload.empty()) {
+        uLongf bound = compressBound(payload.size());
+        compressed.resize(bound);
+        if (compress2(compressed.data(), &bound, payload.data(), payload.size(), compression_level) != Z_OK) {
+            throw std::runtime_error("Cannot compress trace record for " + path);
+        }
+        stored = compressed.data();
+        stored_size = bound;
+    }
+#endif
+
+    const int32_t kind_K[2] = {is_keyframe ? trace_file::keyframe : trace_file::delta, K};
+    const double values[2] = {U, log_likelihood};
+    const int32_t sizes[2] = {static_cast<int32_t>(stored_size), static_cast<int32_t>(payload.size())};
+    write_bytes(kind_K, sizeof(kind_K));
+    write_bytes(values, sizeof(values));
+    write_bytes(sizes, sizeof(sizes));
+    write_bytes(stored, stored_size);
+
+    offsets.push_back(offset);
+    K_trace.push_back(K);
+    U_trace.push_back(U);
+    loglik_trace.push_back(log_likelihood);
+    offset += trace_file::record_header_size + stored_size;
+}
+
+void TraceWriter::close() {
+    if (!file) {
+        return;
+    }
+    const int64_t samples = get_samples();
+    write_bytes(offsets.data(), offsets.size() * sizeof(int64_t));
+    write_bytes(K_trace.data(), K_trace.size() * sizeof(int32_t));
+    write_bytes(U_trace.data(), U_trace.size() * sizeof(double));
+    write_bytes(loglik_trace.data(), loglik_trace.size() * sizeof(double));
+    write_bytes(&samples, sizeof(samples));
+    write_bytes(&offset, sizeof(offset));
+    write_bytes(trace_file::end_magic, sizeof(trace_file::end_magic));
+
+    std::FILE *raw = file.release();
+    if (std::fclose(raw) != 0) {
+        throw std::runtime_error("Error while closing trace file " + path);
+    }
+}
+
+// ========== TraceReader ==========
+
+TraceReader::TraceReader(const std::string &path) : file(std::fopen(path.c_str(), "rb"), &std::fclose), path(path) {
+    if (!file) {
+        throw std::runtime_error("Cannot open trace file " + path + ": " + std::strerror(errno));
+    }
+    const int64_t file_size = file_size_of(file.get());
+    if (file_size < static_cast<int64_t>(trace_file::header_size)) {
+        throw std::runtime_error("Trace file " + path + " is too short");
+    }
+
+    char file_magic[8];
+    int32_t header[4];
+    seek(0);
+    read_bytes(file_magic, sizeof(file_magic));
+    read_bytes(header, sizeof(header));
+    if (std::memcmp(file_magic, trace_file::magic, sizeof(file_magic)) != 0 || header[0] < 1 || header[1] < 1) {
+        throw std::runtime_error("Trace file " + path + " is not a valid trace file");
+    }
+    n = header[0];
+    keyframe_interval = header[1];
+    compression_level = header[2];
+
+    if (!read_footer(file_size)) {
+        scan_records(file_size);
+    }
+}
+
+void TraceReader::read_bytes(void *data, std::size_t size) {
+    if (size > 0 && std::fread(data, 1, size, file.get()) != size) {
+        throw std::runtime_error("Unexpected end of trace file " + path);
+    }
+}
+
+void TraceReader::seek(int64_t position) {
+    if (std::fseek(file.get(), static_cast<long>(position), SEEK_SET) != 0) {
+        throw std::runtime_error("Cannot seek in trace file " + path);
+    }
+}
+
+bool TraceReader::read_footer(int64_t file_size) {
+    const int64_t tail_size = 2 * sizeof(int64_t) + sizeof(trace_file::end_magic);
+    if (file_size < static_cast<int64_t>(trace_file::header_size) + tail_size) {
+        return false;
+    }
+
+    int64_t samples = 0, footer = 0;
+    char file_magic[8];
+    seek(file_size - tail_size);
+    read_bytes(&samples, sizeof(samples));
+    read_bytes(&footer, sizeof(footer));
+    read_bytes(file_magic, sizeof(file_magic));
+    const int64_t per_sample = sizeof(int64_t) + sizeof(int32_t) + 2 * sizeof(double);
+    if (std::memcmp(file_magic, trace_file::end_magic, sizeof(file_magic)) != 0 || samples < 0 ||
+        footer < static_cast<int64_t>(trace_file::header_size) || footer + samples * per_sample + tail_size != file_size) {
+        return false;
+    }
+
+    offsets.resize(samples);
+    K_trace.resize(samples);
+    U_trace.resize(samples);
+    loglik_trace.resize(samples);
+    seek(footer);
+    read_bytes(offsets.data(), samples * sizeof(int64_t));
+    read_bytes(K_trace.data(), samples * sizeof(int32_t));
+    read_bytes(U_trace.data(), samples * sizeof(double));
+    read_bytes(loglik_trace.data(), samples * sizeof(double));
+    return true;
+}
+
+void TraceReader::scan_records(int64_t file_size) {
+    // No footer: keep every complete record from the header on
+    int64_t position = trace_file::header_size;
+    while (position + static_cast<int64_t>(trace_file::record_header_size) <= file_size) {
+        int32_t kind_K[2], sizes[2];
+        double values[2];
+        seek(position);
+        read_bytes(kind_K, sizeof(kind_K));
+        read_bytes(values, sizeof(values));
+        read_bytes(sizes, sizeof(sizes));
+
+        const bool expected_kind = (kind_K[0] == trace_file::keyframe) == (offsets.size() % keyframe_interval == 0);
+        const int64_t next = position + trace_file::record_header_size + sizes[0];
+        if (!expected_kind || kind_K[0] < 0 || kind_K[0] > 1 || sizes[0] < 0 || next > file_size) {
+            break;
+        }
+
+        offsets.push_back(position);
+        K_trace.push_back(kind_K[1]);
+        U_trace.push_back(values[0]);
+        loglik_trace.push_back(values[1]);
+        position = next;
+    }
+}
+
+void TraceReader::apply_record(std::vector<int> &labels, std::vector<uint8_t> &buffer, std::vector<uint8_t> &raw) {
+    int32_t kind_K[2], sizes[2];
+    double values[2];
+    read_bytes(kind_K, sizeof(kind_K));
+    read_bytes(values, sizeof(values));
+    read_bytes(sizes, sizeof(sizes));
+    if (sizes[0] < 0 || sizes[1] < 0) {
+        throw std::runtime_error("Corrupt record in trace file " + path);
+    }
+    buffer.resize(sizes[0]);
+    read_bytes(buffer.data(), buffer.size());
+
+    const uint8_t *pos = buffer.data();
+    const uint8_t *end = pos + buffer.size();
+    if (compression_level > 0 && sizes[1] > 0) {
+#if TRACE_FILE_ZLIB
+        uLongf raw_size = sizes[1];
+        raw.resize(raw_size);
+        if (uncompress(raw.data(), &raw_size, buffer.data(), buffer.size()) != Z_OK ||
+            raw_size != static_cast<uLongf>(sizes[1])) {
+            throw std::runtime_error("Corrupt compressed record in trace file " + path);
+        }
+        pos = raw.data();
+        end = pos + raw.size();
+#else
+        (void)raw;
+        throw std::runtime_error("Trace file " + path + " is compressed: rebuild with -DTRACE_FILE_ZLIB=1");
+#endif
+    }
+
+    if (kind_K[0] == trace_file::keyframe) {
+        for (int i = 0; i < n; ++i)
+            labels[i] = static_cast<int>(get_varint(pos, end)) - 1;
+    } else {
+        int index = -1;
+        while (pos != end) {
+            index += static_cast<int>(get_varint(pos, end)) + 1;
+            const int label = static_cast<int>(get_varint(pos, end)) - 1;
+            if (index >= n)
+                throw std::runtime_error("Corrupt record in trace file " + path);
+            labels[index] = label;
+        }
+    }
+}
+
+void TraceReader::read_allocations(int64_t first, int64_t count, int *out) {
+    if (first < 0 || count < 0 || first + count > get_samples()) {
+        throw std::out_of_range("Trace slice outside the " + std::to_string(get_samples()) + " samples of " + path);
+    }
+    if (count == 0) {
+        return;
+    }
+
+    // Decode from the keyframe at or before first
+    std::vector<int> labels(n, 0);
+    std::vector<uint8_t> buffer, raw;
+    const int64_t start = first - first % keyframe_interval;
+    seek(offsets[start]);
+    for (int64_t s = start; s < first + count; ++s) {
+        apply_record(labels, buffer, raw); // records are contiguous
+        if (s >= first)
+            std::copy(labels.begin(), labels.end(), out + static_cast<size_t>(s - first) * n);
+    }
+}
@@ -0,0 +1,221 @@
+/**
+ * @file TraceFile.hpp
+ * @brief Compact binary trace of allocation samples, written while the chain runs
+ *
+ * @author Filippo Galli
+ * @date 2025
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifndef TRACE_FILE_ZLIB
+#define TRACE_FILE_ZLIB 0
+#endif
+
+/**
+ * @brief Layout shared by TraceWriter and TraceReader
+ *
+ * File layout (native endianness, all little-endian on the hosts we run on):
+ * - header, 24 bytes: magic "BNPTRAC1", n (int32), keyframe interval (int32), compression level
+ *   (int32, 0 = none), reserved (int32, 0)
+ * - one record per sample: kind (int32, 0 = keyframe, 1 = delta), K (int32), U (double),
+ *   log-likelihood (double), stored payload size (int32), raw payload size (int32), payload
+ * - footer: per sample the record offset (int64), K (int32), U (double) and log-likelihood
+ *   (double) as four arrays, then the number of samples (int64), the footer offset (int64)
+ *   and the magic "BNPTEND1"
+ *
+ * A keyframe payload holds the n labels; a delta payload the changed labels with respect to the
+ * previous sample, as (gap to the previous changed index, label) pairs. Both are LEB128 varints
+ * of label + 1 (labels are >= -1), so a typical delta takes a few bytes per changed label. Every
+ * keyframe_interval-th sample is a keyframe, which bounds the records decoded to read any slice.
+ * With a compression level > 0 each payload is deflated (requires -DTRACE_FILE_ZLIB=1 and -lz).
+ *
+ * A file without footer (a run that was interrupted) is still readable: the reader then scans the
+ * records from the header.
+ */
+namespace trace_file {
+constexpr char magic[8] = {'B', 'N', 'P', 'T', 'R', 'A', 'C', '1'};
+constexpr char end_magic[8] = {'B', 'N', 'P', 'T', 'E', 'N', 'D', '1'};
+constexpr std::size_t header_size = 24;
+constexpr std::size_t record_header_size = 32;
+constexpr int32_t keyframe = 0;
+constexpr int32_t delta = 1;
+} // namespace trace_file
+
+/**
+ * @class TraceSink
+ * @brief Destination of the samples streamed by a chain (ChainRunner::set_trace())
+ *
+ * A TraceWriter writes them on the calling thread; an AsyncTraceWriter channel queues them for a
+ * background thread.
+ */
+class TraceSink {
+public:
+    /**
+     * @brief Appends a sample
+     * @param allocations n labels (-1 for unallocated)
+     * @param K Number of clusters
+     * @param U Value of U (NaN if not traced)
+     * @param log_likelihood Log-likelihood of the sample (NaN if not traced)
+     */
+    virtual void write(const int *allocations, int K, double U, double log_likelihood) = 0;
+
+    /** @brief Number of points */
+    virtual int size() const = 0;
+
+    virtual ~TraceSink() = default;
+};
+
+/**
+ * @class TraceWriter
+ * @brief Streams allocation samples with K, U and log-likelihood to a trace file
+ *
+ * Memory is O(n) whatever the number of samples: only the previous sample, one payload buffer and
+ * the per-sample scalars kept for the footer (24 bytes per sample) are held.
+ */
+class TraceWriter : public TraceSink {
+private:
+    std::unique_ptr<std::FILE, int (*)(std::FILE *)> file; ///< Output file (nullptr once closed)
+    std::string path;                                      ///< Output path, for error messages
+    int n;                                                 ///< Number of points
+    int keyframe_interval;                                 ///< Samples between keyframes
+    int compression_level;                                 ///< Deflate level (0 = none)
+    int64_t offset = trace_file::header_size;              ///< Offset of the next record
+    std::vector<int> previous;                             ///< Last written sample
+    std::vector<uint8_t> payload;                          ///< Encoded payload of the current record
+    std::vector<uint8_t> compressed;                       ///< Deflated payload (compression only)
+    std::vector<int64_t> offsets;                          ///< Offset of each record
+    std::vector<int32_t> K_trace;                          ///< K of each sample
+    std::vector<double> U_trace;                           ///< U of each sample
+    std::vector<double> loglik_trace;                      ///< Log-likelihood of each sample
+
+    /** @brief Writes raw bytes, throwing on failure */
+    void write_bytes(const void *data, std::size_t size);
+
+public:
+    /**
+     * @brief Creates a trace file
+     * @param path Output path (overwritten)
+     * @param n Number of points
+     * @param keyframe_interval Samples between keyframes (default: 256)
+     * @param compression_level Deflate level 1-9, or 0 for no compression (default: 0)
+     * @throws std::invalid_argument if n or keyframe_interval are not positive, or compression is
+     *         requested in a build without zlib
+     * @throws std::runtime_error if the file cannot be created
+     */
+    TraceWriter(const std::string &path, int n, int keyframe_interval = 256, int compression_level = 0);
+
+    TraceWriter(const TraceWriter &) = delete;
+    TraceWriter &operator=(const TraceWriter &) = delete;
+
+    /** @brief Closes the file, writing the footer if close() was not called */
+    ~TraceWriter() override;
+
+    /**
+     * @brief Appends a sample
+     * @param allocations n labels (-1 for unallocated)
+     * @param K Number of clusters
+     * @param U Value of U (NaN if not traced)
+     * @param log_likelihood Log-likelihood of the sample (NaN if not traced)
+     * @throws std::runtime_error if the writer is closed or the write fails
+     */
+    void write(const int *allocations, int K, double U, double log_likelihood) override;
+
+    /**
+     * @brief Writes the footer and closes the file; later calls do nothing
+     * @throws std::runtime_error if the write fails
+     */
+    void close();
+
+    /** @brief Number of points */
+    int size() const override { return n; }
+
+    /** @brief Number of samples written so far */
+    int64_t get_samples() const { return static_cast<int64_t>(offsets.size()); }
+};
+
+/**
+ * @class TraceReader
+ * @brief Reads slices of a trace file without loading the whole of it
+ *
+ * Opening reads the header and the footer (or scans the record headers if there is no footer),
+ * O(samples) small reads. read_allocations() seeks to the keyframe at or before the first
+ * requested sample and decodes forward, so a slice costs O(count + keyframe_interval) records.
+ */
+class TraceReader {
+private:
+    std::unique_ptr<std::FILE, int (*)(std::FILE *)> file; ///< Input file
+    std::string path;                                      ///< Input path, for error messages
+    int n = 0;                                             ///< Number of points
+    int keyframe_interval = 1;                             ///< Samples between keyframes
+    int compression_level = 0;                             ///< Deflate level the file was written with
+    std::vector<int64_t> offsets;                          ///< Offset of each record
+    std::vector<int32_t> K_trace;                          ///< K of each sample
+    std::vector<double> U_trace;                           ///< U of each sample
+    std::vector<double> loglik_trace;                      ///< Log-likelihood of each sample
+
+    /** @brief Reads raw bytes at the current position, throwing on failure */
+    void read_bytes(void *data, std::size_t size);
+
+    /** @brief Seeks to an absolute offset, throwing on failure */
+    void seek(int64_t position);
+
+    /** @brief Reads the footer; returns false if the file has none */
+    bool read_footer(int64_t file_size);
+
+    /** @brief Rebuilds offsets and scalar traces by scanning the records */
+    void scan_records(int64_t file_size);
+
+    /**
+     * @brief Applies the record at the current position to a sample
+     * @param labels Sample to update in place (n labels)
+     * @param buffer Scratch buffer for the payload
+     * @param raw Scratch buffer for the inflated payload
+     */
+    void apply_record(std::vector<int> &labels, std::vector<uint8_t> &buffer, std::vector<uint8_t> &raw);
+
+public:
+    /**
+     * @brief Opens a trace file
+     * @param path Path of a file written by TraceWriter
+     * @throws std::runtime_error if the file cannot be opened or is not a valid trace file
+     */
+    explicit TraceReader(const std::string &path);
+
+    /** @brief Number of points */
+    int size() const { return n; }
+
+    /** @brief Number of samples */
+    int64_t get_samples() const { return static_cast<int64_t>(offsets.size()); }
+
+    /** @brief Samples between keyframes */
+    int get_keyframe_interval() const { return keyframe_interval; }
+
+    /** @brief Deflate level the file was written with (0 = none) */
+    int get_compression_level() const { return compression_level; }
+
+    /** @brief K of every sample */
+    const std::vector<int32_t> &get_K() const { return K_trace; }
+
+    /** @brief U of every sample */
+    const std::vector<double> &get_U() const { return U_trace; }
+
+    /** @brief Log-likelihood of every sample */
+    const std::vector<double> &get_log_likelihood() const { return loglik_trace; }
+
+    /**
+     * @brief Decodes consecutive samples
+     * @param first Index of the first sample (0-based)
+     * @param count Number of samples
+     * @param out Output buffer of n * count ints, filled one sample (n labels) after the other
+     * @throws std::out_of_range if the range exceeds the samples
+     * @throws std::runtime_error if the file is corrupt or compressed in a build without zlib
+     */
+    void read_allocations(int64_t first, int64_t count, int *out);
+};
@@ -0,0 +1,148 @@
+/**
+ * @file Workspace.hpp
+ * @brief Scratch arena of a sampler, reused across point updates and sweeps
+ *
+ * @author Filippo Galli
+ * @date 2025
+ */
+
+#pragma once
+
+#include <Eigen/Dense>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+/**
+ * @class Workspace
+ * @brief Bump allocator for the per-step scratch buffers of a sampler
+ *
+ * Buffers are carved out of a block in stack order: a Frame records the top of the arena and
+ * releases everything taken after it when it goes out of scope, so a point update opens a frame,
+ * takes its vectors and gives them back on return. When a request does not fit in the current
+ * block a new block is chained (the buffers already handed out never move); when the outermost
+ * frame closes with more than one block, the blocks are replaced by one block of their total
+ * size. After the first sweep at the largest K seen so far, the whole sweep therefore runs in a
+ * single block and no call reaches the heap.
+ *
+ * Buffers are aligned to Workspace::alignment bytes and are not initialized. Only trivially
+ * destructible types can be taken: nothing is destroyed when a frame closes.
+ *
+ * @note Not thread-safe: one workspace per sampler (as the Gibbs buffers).
+ */
+class Workspace {
+public:
+    /** @brief Alignment of every buffer, in bytes (a cache line) */
+    static constexpr std::size_t alignment = 64;
+
+    /** @brief Size of the first block, in bytes */
+    static constexpr std::size_t initial_block_size = 16 * 1024;
+
+    /**
+     * @class Frame
+     * @brief Scope of a group of buffers: everything taken after its construction is released by its destructor
+     */
+    class Frame {
+    public:
+        explicit Frame(Workspace &ws) : ws(ws), block(ws.current), offset(ws.offset) { ++ws.depth; }
+        ~Frame() { ws.release(block, offset); }
+        Frame(const Frame &) = delete;
+        Frame &operator=(const Frame &) = delete;
+
+    private:
+        Workspace &ws;
+        std::size_t block;
+        std::size_t offset;
+    };
+
+    Workspace() = default;
+    Workspace(const Workspace &) = delete;
+    Workspace &operator=(const Workspace &) = delete;
+
+    /**
+     * @brief Takes an uninitialized buffer of count values of type T
+     * @param count Number of values (may be 0)
+     * @return Pointer valid until the enclosing Frame closes
+     */
+    template <typename T> T *take(std::size_t count) {
+        static_assert(std::is_trivially_destructible<T>::value && alignof(T) <= alignment,
+                      "Workspace: T must be trivially destructible and at most cache-line aligned");
+        return static_cast<T *>(take_bytes(count * sizeof(T)));
+    }
+
+    /** @brief Uninitialized vector of size doubles, see take() */
+    Eigen::Map<Eigen::VectorXd> vector(int size) {
+        return Eigen::Map<Eigen::VectorXd>(take<double>(static_cast<std::size_t>(size)), size);
+    }
+
+    /** @brief Uninitialized vector of size ints, see take() */
+    Eigen::Map<Eigen::VectorXi> int_vector(int size) {
+        return Eigen::Map<Eigen::VectorXi>(take<int>(static_cast<std::size_t>(size)), size);
+    }
+
+    /** @brief Number of blocks obtained from the heap so far (constant in the steady state) */
+    std::uint64_t heap_allocations() const { return block_allocations; }
+
+    /** @brief Bytes held by the arena */
+    std::size_t capacity() const {
+        std::size_t total = 0;
+        for (const Block &b : blocks)
+            total += b.size;
+        return total;
+    }
+
+private:
+    struct Deleter {
+        void operator()(unsigned char *p) const { ::operator delete(p, std::align_val_t(alignment)); }
+    };
+
+    struct Block {
+        std::unique_ptr<unsigned char, Deleter> memory;
+        std::size_t size;
+    };
+
+    std::vector<Block> blocks;             ///< Chained blocks, the last one being added to
+    std::size_t current = 0;               ///< Block the next buffer is taken from
+    std::size_t offset = 0;                ///< First free byte of the current block
+    int depth = 0;                         ///< Open frames
+    std::uint64_t block_allocations = 0;   ///< Blocks obtained from the heap
+
+    static std::size_t round_up(std::size_t bytes) { return (bytes + alignment - 1) / alignment * alignment; }
+
+    void add_block(std::size_t size) {
+        auto *p = static_cast<unsigned char *>(::operator new(size, std::align_val_t(alignment)));
+        blocks.push_back(Block{std::unique_ptr<unsigned char, Deleter>(p), size});
+        ++block_allocations;
+    }
+
+    void *take_bytes(std::size_t bytes) {
+        bytes = round_up(std::max<std::size_t>(bytes, 1));
+        while (current < blocks.size() && offset + bytes > blocks[current].size) {
+            ++current;
+            offset = 0;
+        }
+        if (current == blocks.size()) {
+            const std::size_t last = blocks.empty() ? initial_block_size / 2 : blocks.back().size;
+            add_block(std::max(2 * last, bytes));
+        }
+        void *p = blocks[current].memory.get() + offset;
+        offset += bytes;
+        return p;
+    }
+
+    void release(std::size_t block, std::size_t block_offset) {
+        current = block;
+        offset = block_offset;
+        if (--depth == 0 && blocks.size() > 1) {
+            const std::size_t total = capacity();
+            blocks.clear();
+            add_block(total);
+            current = 0;
+            offset = 0;
+        }
+    }
+};
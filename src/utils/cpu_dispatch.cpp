@@ -0,0 +1,234 @@
+/**
+ * @file cpu_dispatch.cpp
+ * @brief Kernel tables of the ISA levels and the choice of the active one
+ */
+
+#include "cpu_dispatch.hpp"
+#include "gather_kernels.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#if CPU_DISPATCH
+#include <immintrin.h>
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+namespace cpu_dispatch {
+
+namespace {
+
+// ========== Generic ==========
+// The code of the build flags: plain loops over libm, as the callers computed before dispatching.
+
+namespace generic {
+
+void gather_sum2(const double *a, const double *b, const int *idx, int m, double &sum_a, double &sum_b) {
+    gather_kernels::gather_sum2_unrolled(a, b, idx, m, sum_a, sum_b);
+}
+
+double normalize_log_weights(double *x, int K) {
+    double max_log = x[0];
+    for (int k = 1; k < K; ++k)
+        max_log = std::max(max_log, x[k]);
+    double sum = 0.0;
+    for (int k = 0; k < K; ++k) {
+        x[k] = std::exp(x[k] - max_log);
+        sum += x[k];
+    }
+    for (int k = 0; k < K; ++k)
+        x[k] /= sum;
+    return max_log + std::log(sum);
+}
+
+void nn_log_predictive(const double *n, const double *sum, int K, double x, double m, double B, double v,
+                       double *out) {
+    for (int k = 0; k < K; ++k) {
+        const double one_plus_nB = 1.0 + n[k] * B;
+        const double mu_n = (m + B * sum[k]) / one_plus_nB;
+        const double sigma2_pred = v * (1.0 + (n[k] + 1.0) * B) / one_plus_nB;
+        const double diff = x - mu_n;
+        out[k] += -0.5 * std::log(2.0 * M_PI * sigma2_pred) - 0.5 * diff * diff / sigma2_pred;
+    }
+}
+
+void nnig_log_predictive(const double *n, const double *sum, const double *sumsq, int K, double x, double m,
+                         double B, double nu, double S0, double *out) {
+    for (int k = 0; k < K; ++k) {
+        const double one_plus_nB = 1.0 + n[k] * B;
+        const double mu_n = (m + B * sum[k]) / one_plus_nB;
+        double S_n = S0;
+        if (n[k] > 0.0) {
+            const double xbar = sum[k] / n[k];
+            const double ss = sumsq[k] - n[k] * xbar * xbar;
+            const double dev = xbar - m;
+            S_n += 0.5 * ss + 0.5 * (n[k] / one_plus_nB) * dev * dev;
+        }
+        const double one_plus_next_nB = 1.0 + (n[k] + 1.0) * B;
+        const double diff = x - mu_n;
+        const double delta_S = 0.5 * diff * diff * one_plus_nB / one_plus_next_nB;
+        const double nu_n = nu + 0.5 * n[k];
+        out[k] += -0.5 * std::log(2.0 * M_PI) - 0.5 * std::log(one_plus_next_nB / one_plus_nB) -
+                  0.5 * std::log(S_n) - (nu_n + 0.5) * std::log(1.0 + delta_S / S_n);
+    }
+}
+
+} // namespace generic
+
+// ========== SIMD levels ==========
+
+#if CPU_DISPATCH
+
+#pragma GCC push_options
+#pragma GCC target("sse4.2,popcnt")
+#define CPU_DISPATCH_LEVEL 1
+#define CPU_DISPATCH_NAMESPACE sse42
+#include "cpu_dispatch_simd.hpp"
+#undef CPU_DISPATCH_NAMESPACE
+#undef CPU_DISPATCH_LEVEL
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+#define CPU_DISPATCH_LEVEL 2
+#define CPU_DISPATCH_NAMESPACE avx2
+#include "cpu_dispatch_simd.hpp"
+#undef CPU_DISPATCH_NAMESPACE
+#undef CPU_DISPATCH_LEVEL
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx2,fma")
+#define CPU_DISPATCH_LEVEL 3
+#define CPU_DISPATCH_NAMESPACE avx512
+#include "cpu_dispatch_simd.hpp"
+#undef CPU_DISPATCH_NAMESPACE
+#undef CPU_DISPATCH_LEVEL
+#pragma GCC pop_options
+
+#endif
+
+// ========== Dispatch ==========
+
+#define CPU_DISPATCH_TABLE(isa, ns)                                                                         \
+    Kernels { isa, ns::gather_sum2, ns::normalize_log_weights, ns::nn_log_predictive, ns::nnig_log_predictive }
+
+const Kernels generic_table = CPU_DISPATCH_TABLE(Isa::Generic, generic);
+#if CPU_DISPATCH
+const Kernels sse42_table = CPU_DISPATCH_TABLE(Isa::SSE42, sse42);
+const Kernels avx2_table = CPU_DISPATCH_TABLE(Isa::AVX2, avx2);
+const Kernels avx512_table = CPU_DISPATCH_TABLE(Isa::AVX512, avx512);
+#endif
+
+#undef CPU_DISPATCH_TABLE
+
+const Kernels &table(Isa isa) {
+    switch (isa) {
+#if CPU_DISPATCH
+    case Isa::SSE42:
+        return sse42_table;
+    case Isa::AVX2:
+        return avx2_table;
+    case Isa::AVX512:
+        return avx512_table;
+#endif
+    default:
+        return generic_table;
+    }
+}
+
+/** @brief Active table; null until the first kernels() */
+std::atomic<const Kernels *> current{nullptr};
+
+/** @brief detected(), capped by BNPCLUST_ISA */
+Isa initial() {
+    Isa isa = detected();
+    if (const char *cap = std::getenv("BNPCLUST_ISA")) {
+        try {
+            isa = std::min(isa, parse(cap));
+        } catch (const std::invalid_argument &) {
+            // An unknown value leaves the detected level
+        }
+    }
+    return isa;
+}
+
+} // namespace
+
+Isa detected() {
+#if CPU_DISPATCH
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return Isa::AVX512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return Isa::AVX2;
+    if (__builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt"))
+        return Isa::SSE42;
+#endif
+    return Isa::Generic;
+}
+
+std::vector<Isa> available() {
+    std::vector<Isa> levels;
+    for (Isa isa : {Isa::Generic, Isa::SSE42, Isa::AVX2, Isa::AVX512}) {
+        if (isa <= detected())
+            levels.push_back(isa);
+    }
+    return levels;
+}
+
+const Kernels &kernels() {
+    const Kernels *active = current.load(std::memory_order_acquire);
+    if (!active) {
+        static const Kernels *const first = &table(initial());
+        const Kernels *expected = nullptr;
+        current.compare_exchange_strong(expected, first, std::memory_order_acq_rel);
+        active = current.load(std::memory_order_acquire);
+    }
+    return *active;
+}
+
+void select(Isa isa) {
+    if (isa > detected()) {
+        throw std::invalid_argument(std::string("cpu_dispatch: ") + name(isa) + " is not supported by this CPU or build");
+    }
+    current.store(&table(isa), std::memory_order_release);
+}
+
+const char *name(Isa isa) {
+    switch (isa) {
+    case Isa::SSE42:
+        return "sse4.2";
+    case Isa::AVX2:
+        return "avx2";
+    case Isa::AVX512:
+        return "avx512";
+    default:
+        return "generic";
+    }
+}
+
+Isa parse(const std::string &name) {
+    for (Isa isa : {Isa::Generic, Isa::SSE42, Isa::AVX2, Isa::AVX512}) {
+        if (name == cpu_dispatch::name(isa))
+            return isa;
+    }
+    throw std::invalid_argument("cpu_dispatch: unknown ISA level \"" + name +
+                                "\" (expected generic, sse4.2, avx2 or avx512)");
+}
+
+namespace {
+
+// The table is chosen when the library is loaded, not in the middle of the first sweep
+const bool chosen_at_load = (kernels(), true);
+
+} // namespace
+
+} // namespace cpu_dispatch
@@ -0,0 +1,141 @@
+/**
+ * @file cpu_dispatch.hpp
+ * @brief Hot kernels compiled for several x86 ISA levels, the best one supported picked at load time
+ *
+ * A library built with -march=native runs only on CPUs with the instruction set of the build host
+ * (an illegal instruction elsewhere), and one built for the baseline x86-64 leaves AVX2 and AVX-512
+ * unused. The kernels here are compiled once per level in the same translation unit, in GCC
+ * target regions (`#pragma GCC target`) rather than with build flags, so a portable build (e.g.
+ * -march=x86-64-v2) still runs the wide kernels on the nodes that have them:
+ * - Generic: the code of the build flags (scalar, or what -march enables);
+ * - SSE42: 2-wide doubles (SSE4.2 and POPCNT, x86-64-v2);
+ * - AVX2: 4-wide doubles, with FMA and gathers (x86-64-v3);
+ * - AVX512: 8-wide doubles, with AVX-512F gathers.
+ *
+ * The table of the best level reported by the CPU (CPUID through __builtin_cpu_supports) is chosen
+ * on the first call of kernels(). The environment variable BNPCLUST_ISA (generic, sse4.2, avx2 or
+ * avx512) caps it, as does select(), e.g. to compare levels on one machine; neither can raise it
+ * above what the CPU supports. With other compilers or architectures, or -DCPU_DISPATCH=0, only
+ * Generic exists.
+ *
+ * The wide levels evaluate exp and log with branch-free polynomials that the compiler vectorizes
+ * (within a few units in the last place of libm on the ranges used here) instead of the scalar
+ * libm calls; results may differ from Generic in the last bits.
+ *
+ * @author Filippo Galli
+ * @date 2025
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#ifndef CPU_DISPATCH
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__)
+#define CPU_DISPATCH 1
+#else
+#define CPU_DISPATCH 0
+#endif
+#endif
+
+namespace cpu_dispatch {
+
+/** @brief Instruction set level of a kernel table */
+enum class Isa {
+    Generic, ///< Build flags
+    SSE42,   ///< x86-64-v2
+    AVX2,    ///< x86-64-v3 (AVX2 and FMA)
+    AVX512   ///< AVX-512F
+};
+
+/** @brief Kernels of one level; every entry is set */
+struct Kernels {
+    Isa isa; ///< Level of the table
+
+    /**
+     * @brief Sums two rows at the given indices, as gather_kernels::gather_sum2()
+     * @param a First row (e.g. a row of D)
+     * @param b Second row (e.g. the same row of log D)
+     * @param idx Member indices
+     * @param m Number of indices
+     * @param sum_a Output: sum of a[idx[i]]
+     * @param sum_b Output: sum of b[idx[i]]
+     */
+    void (*gather_sum2)(const double *a, const double *b, const int *idx, int m, double &sum_a, double &sum_b);
+
+    /**
+     * @brief Turns log-weights into probabilities, as Sampler::normalize_log_weights()
+     * @param x K log-weights, overwritten with exp(x - log_sum_exp(x)); -infinity gives 0
+     * @param K Number of weights (at least 1)
+     * @return log_sum_exp(x)
+     */
+    double (*normalize_log_weights)(double *x, int K);
+
+    /**
+     * @brief Adds the Normal (known variance) log predictive of one value to K clusters
+     * @param n Sizes of the clusters (as doubles)
+     * @param sum Sums of the values of each cluster
+     * @param K Number of clusters
+     * @param x Value
+     * @param m Prior mean
+     * @param B Prior variance of the mean, in units of v
+     * @param v Observation variance
+     * @param out out[k] += log N(x | mu_k, v (1 + (n_k + 1) B) / (1 + n_k B))
+     * @see ContinuosCovariatesModuleCache::compute_predictive_NN()
+     */
+    void (*nn_log_predictive)(const double *n, const double *sum, int K, double x, double m, double B, double v,
+                              double *out);
+
+    /**
+     * @brief Adds the Normal-Inverse-Gamma log predictive of one value to K clusters, but for the
+     * lgamma(nu_n + 1/2) - lgamma(nu_n) term, which the caller reads from its table
+     * @param n Sizes of the clusters (as doubles)
+     * @param sum Sums of the values of each cluster
+     * @param sumsq Sums of the squared values of each cluster
+     * @param K Number of clusters
+     * @param x Value
+     * @param m Prior mean
+     * @param B Prior variance of the mean, in units of v
+     * @param nu Prior shape of v
+     * @param S0 Prior scale of v
+     * @param out Accumulated log predictives
+     * @see ContinuosCovariatesModuleCache::compute_predictive_NNIG()
+     */
+    void (*nnig_log_predictive)(const double *n, const double *sum, const double *sumsq, int K, double x, double m,
+                                double B, double nu, double S0, double *out);
+};
+
+/**
+ * @brief Table of the active level
+ * @details Thread safe; the first call picks the level (see the file description)
+ */
+const Kernels &kernels();
+
+/** @brief Level of the active table */
+inline Isa active() { return kernels().isa; }
+
+/** @brief Best level supported by this CPU and build */
+Isa detected();
+
+/** @brief Levels supported by this CPU and build, lowest first */
+std::vector<Isa> available();
+
+/**
+ * @brief Makes the table of a level active for the kernels called from now on
+ * @param isa Level, at most detected()
+ * @throws std::invalid_argument if the CPU or the build does not support it
+ * @details Call it while no chain is running.
+ */
+void select(Isa isa);
+
+/** @brief Name of a level: "generic", "sse4.2", "avx2" or "avx512" */
+const char *name(Isa isa);
+
+/**
+ * @brief Level of a name, as written by name()
+ * @throws std::invalid_argument for an unknown name
+ */
+Isa parse(const std::string &name);
+
+} // namespace cpu_dispatch
@@ -0,0 +1,238 @@
+/**
+ * @file cpu_dispatch_simd.hpp
+ * @brief Bodies of the SIMD kernel tables of cpu_dispatch, compiled once per ISA level
+ *
+ * Not a regular header: cpu_dispatch.cpp includes it once per level, inside a
+ * `#pragma GCC target` region and with CPU_DISPATCH_LEVEL (1: SSE4.2, 2: AVX2, 3: AVX-512) and
+ * CPU_DISPATCH_NAMESPACE defined, so every function here, the exp and log helpers included, is
+ * compiled for that level and inlined into the kernels of the same level. Hence no include guard.
+ *
+ * @author Filippo Galli
+ * @date 2025
+ */
+
+namespace CPU_DISPATCH_NAMESPACE {
+
+// Selections go through the bits: with the default -ftrapping-math GCC does not vectorize a
+// floating-point comparison in a loop, and the integer ones vectorize at every level.
+
+/** @brief Bits of a double */
+inline std::uint64_t bits_of(double x) {
+    std::uint64_t bits;
+    std::memcpy(&bits, &x, sizeof bits);
+    return bits;
+}
+
+/** @brief Double of some bits */
+inline double from_bits(std::uint64_t bits) {
+    double x;
+    std::memcpy(&x, &bits, sizeof x);
+    return x;
+}
+
+/** @brief n, or 1 if n is +0 */
+inline double one_if_zero(double n) {
+    const std::uint64_t zero = 0 - static_cast<std::uint64_t>(bits_of(n) == 0);
+    return from_bits(bits_of(n) | (zero & bits_of(1.0)));
+}
+
+/**
+ * @brief exp(x) for x <= 0, 0 below -708 (where exp is denormal)
+ *
+ * Cody-Waite reduction x = k log 2 + r, |r| <= log(2) / 2, a degree 13 Taylor polynomial
+ * of exp(r) (truncation below 5e-18) and 2^k built in the exponent bits; no branch, so the
+ * loops calling it vectorize.
+ */
+inline double exp_nonpositive(double x) {
+    // For x <= 0 (and -infinity), x < -708 exactly when its bits are above those of -708
+    constexpr std::uint64_t limit = 0xC086200000000000ULL; // -708
+    const std::uint64_t below = 0 - static_cast<std::uint64_t>(bits_of(x) > limit);
+    const double clamped = from_bits((bits_of(x) & ~below) | (limit & below));
+    // Rounding by the 1.5 2^52 shift, which leaves k in the low mantissa bits of shifted; std::rint
+    // would be a libm call below AVX-512. k is read back through the bits: the OR does not change
+    // them, but keeps -ffast-math from folding (y + c) - c into y
+    const double shifted = clamped * 1.4426950408889634 + 0x1.8p52;
+    const std::uint64_t k_bits = bits_of(shifted);
+    const double k = from_bits(k_bits | 0x4330000000000000ULL) - 0x1.8p52;
+    const double r = (clamped - k * 6.93147180369123816490e-01) - k * 1.90821492927058770002e-10;
+    double p = 1.0 / 6227020800.0;
+    p = p * r + 1.0 / 479001600.0;
+    p = p * r + 1.0 / 39916800.0;
+    p = p * r + 1.0 / 3628800.0;
+    p = p * r + 1.0 / 362880.0;
+    p = p * r + 1.0 / 40320.0;
+    p = p * r + 1.0 / 5040.0;
+    p = p * r + 1.0 / 720.0;
+    p = p * r + 1.0 / 120.0;
+    p = p * r + 1.0 / 24.0;
+    p = p * r + 1.0 / 6.0;
+    p = p * r + 0.5;
+    p = p * r + 1.0;
+    p = p * r + 1.0;
+    // Adding the bias to k and shifting it into the exponent field gives 2^k for -1022 <= k <= 0
+    const double scale = from_bits((k_bits + 1023) << 52);
+    return from_bits(bits_of(p * scale) & ~below);
+}
+
+/**
+ * @brief log(x) for a positive normal x
+ *
+ * x = 2^e z with z in [sqrt(2) / 2, sqrt(2)) from the bits (as musl's log), then
+ * log z = 2 atanh(s), s = (z - 1) / (z + 1), |s| <= 0.172, by its series up to s^21. The exponent
+ * is converted to double through the bits as well, since AVX2 has no vector int64 conversion.
+ */
+inline double log_positive(double x) {
+    constexpr std::uint64_t offset = 0x3FE6A09E667F3BCDULL; // sqrt(2) / 2
+    const std::uint64_t ix = bits_of(x);
+    const std::uint64_t tmp = ix - offset;
+    const std::uint64_t biased = (tmp + (1ULL << 63)) >> 52; // e + 2048, with a logical shift
+    const double z = from_bits(ix - (tmp & (0xFFFULL << 52)));
+    const double e = from_bits(0x4330000000000000ULL | biased) - 4503599627372544.0; // - 2^52 - 2048
+
+    const double f = z - 1.0;
+    const double s = f / (2.0 + f);
+    const double w = s * s;
+    double p = 1.0 / 21.0;
+    p = p * w + 1.0 / 19.0;
+    p = p * w + 1.0 / 17.0;
+    p = p * w + 1.0 / 15.0;
+    p = p * w + 1.0 / 13.0;
+    p = p * w + 1.0 / 11.0;
+    p = p * w + 1.0 / 9.0;
+    p = p * w + 1.0 / 7.0;
+    p = p * w + 1.0 / 5.0;
+    p = p * w + 1.0 / 3.0;
+    p = p * w + 1.0;
+    return e * 6.93147180369123816490e-01 + (2.0 * s * p + e * 1.90821492927058770002e-10);
+}
+
+void gather_sum2(const double *__restrict__ a, const double *__restrict__ b, const int *__restrict__ idx, int m,
+                 double &sum_a, double &sum_b) {
+    // The gathers and the half extracts go through their masked forms with a zero source: the
+    // unmasked intrinsics of GCC 12 pass an undefined vector as source, which -Wall flags
+#if CPU_DISPATCH_LEVEL == 3
+    const __m512d zero = _mm512_setzero_pd();
+    int i = 0;
+    __m512d acc_a0 = zero, acc_a1 = zero;
+    __m512d acc_b0 = zero, acc_b1 = zero;
+    for (; i + 16 <= m; i += 16) {
+        const __m256i v0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(idx + i));
+        const __m256i v1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(idx + i + 8));
+        acc_a0 = _mm512_add_pd(acc_a0, _mm512_mask_i32gather_pd(zero, 0xFF, v0, a, 8));
+        acc_b0 = _mm512_add_pd(acc_b0, _mm512_mask_i32gather_pd(zero, 0xFF, v0, b, 8));
+        acc_a1 = _mm512_add_pd(acc_a1, _mm512_mask_i32gather_pd(zero, 0xFF, v1, a, 8));
+        acc_b1 = _mm512_add_pd(acc_b1, _mm512_mask_i32gather_pd(zero, 0xFF, v1, b, 8));
+    }
+    for (; i + 8 <= m; i += 8) {
+        const __m256i v0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(idx + i));
+        acc_a0 = _mm512_add_pd(acc_a0, _mm512_mask_i32gather_pd(zero, 0xFF, v0, a, 8));
+        acc_b0 = _mm512_add_pd(acc_b0, _mm512_mask_i32gather_pd(zero, 0xFF, v0, b, 8));
+    }
+    // Halves, then quarters, then the last pair, as _mm512_reduce_add_pd
+    const __m512d acc_a = _mm512_add_pd(acc_a0, acc_a1);
+    const __m512d acc_b = _mm512_add_pd(acc_b0, acc_b1);
+    const __m256d half_zero = _mm256_setzero_pd();
+    const __m256d h_a = _mm256_add_pd(_mm512_mask_extractf64x4_pd(half_zero, 0xF, acc_a, 0),
+                                      _mm512_mask_extractf64x4_pd(half_zero, 0xF, acc_a, 1));
+    const __m256d h_b = _mm256_add_pd(_mm512_mask_extractf64x4_pd(half_zero, 0xF, acc_b, 0),
+                                      _mm512_mask_extractf64x4_pd(half_zero, 0xF, acc_b, 1));
+    const __m128d r_a = _mm_add_pd(_mm256_castpd256_pd128(h_a), _mm256_extractf128_pd(h_a, 1));
+    const __m128d r_b = _mm_add_pd(_mm256_castpd256_pd128(h_b), _mm256_extractf128_pd(h_b, 1));
+    double s_a = _mm_cvtsd_f64(_mm_add_sd(r_a, _mm_unpackhi_pd(r_a, r_a)));
+    double s_b = _mm_cvtsd_f64(_mm_add_sd(r_b, _mm_unpackhi_pd(r_b, r_b)));
+    for (; i < m; ++i) {
+        s_a += a[idx[i]];
+        s_b += b[idx[i]];
+    }
+    sum_a = s_a;
+    sum_b = s_b;
+#elif CPU_DISPATCH_LEVEL == 2
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d all = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+    int i = 0;
+    __m256d acc_a0 = zero, acc_a1 = zero;
+    __m256d acc_b0 = zero, acc_b1 = zero;
+    for (; i + 8 <= m; i += 8) {
+        const __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(idx + i));
+        const __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(idx + i + 4));
+        acc_a0 = _mm256_add_pd(acc_a0, _mm256_mask_i32gather_pd(zero, a, v0, all, 8));
+        acc_b0 = _mm256_add_pd(acc_b0, _mm256_mask_i32gather_pd(zero, b, v0, all, 8));
+        acc_a1 = _mm256_add_pd(acc_a1, _mm256_mask_i32gather_pd(zero, a, v1, all, 8));
+        acc_b1 = _mm256_add_pd(acc_b1, _mm256_mask_i32gather_pd(zero, b, v1, all, 8));
+    }
+    for (; i + 4 <= m; i += 4) {
+        const __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(idx + i));
+        acc_a0 = _mm256_add_pd(acc_a0, _mm256_mask_i32gather_pd(zero, a, v0, all, 8));
+        acc_b0 = _mm256_add_pd(acc_b0, _mm256_mask_i32gather_pd(zero, b, v0, all, 8));
+    }
+    const __m256d acc_a = _mm256_add_pd(acc_a0, acc_a1);
+    const __m256d acc_b = _mm256_add_pd(acc_b0, acc_b1);
+    const __m128d r_a = _mm_add_pd(_mm256_castpd256_pd128(acc_a), _mm256_extractf128_pd(acc_a, 1));
+    const __m128d r_b = _mm_add_pd(_mm256_castpd256_pd128(acc_b), _mm256_extractf128_pd(acc_b, 1));
+    double s_a = _mm_cvtsd_f64(_mm_add_sd(r_a, _mm_unpackhi_pd(r_a, r_a)));
+    double s_b = _mm_cvtsd_f64(_mm_add_sd(r_b, _mm_unpackhi_pd(r_b, r_b)));
+    for (; i < m; ++i) {
+        s_a += a[idx[i]];
+        s_b += b[idx[i]];
+    }
+    sum_a = s_a;
+    sum_b = s_b;
+#else
+    // No gather before AVX2
+    gather_kernels::gather_sum2_unrolled(a, b, idx, m, sum_a, sum_b);
+#endif
+}
+
+double normalize_log_weights(double *x, int K) {
+    double max_log = x[0];
+#pragma omp simd reduction(max : max_log)
+    for (int k = 1; k < K; ++k)
+        max_log = x[k] > max_log ? x[k] : max_log;
+    double sum = 0.0;
+#pragma omp simd reduction(+ : sum)
+    for (int k = 0; k < K; ++k) {
+        x[k] = exp_nonpositive(x[k] - max_log);
+        sum += x[k];
+    }
+    const double inverse = 1.0 / sum;
+#pragma omp simd
+    for (int k = 0; k < K; ++k)
+        x[k] *= inverse;
+    return max_log + std::log(sum);
+}
+
+void nn_log_predictive(const double *n, const double *sum, int K, double x, double m, double B, double v,
+                       double *out) {
+    const double log_2pi = std::log(2.0 * M_PI);
+#pragma omp simd
+    for (int k = 0; k < K; ++k) {
+        const double one_plus_nB = 1.0 + n[k] * B;
+        const double mu_n = (m + B * sum[k]) / one_plus_nB;
+        const double sigma2_pred = v * (1.0 + (n[k] + 1.0) * B) / one_plus_nB;
+        const double diff = x - mu_n;
+        out[k] += -0.5 * (log_2pi + log_positive(sigma2_pred)) - 0.5 * diff * diff / sigma2_pred;
+    }
+}
+
+void nnig_log_predictive(const double *n, const double *sum, const double *sumsq, int K, double x, double m,
+                         double B, double nu, double S0, double *out) {
+    const double half_log_2pi = 0.5 * std::log(2.0 * M_PI);
+#pragma omp simd
+    for (int k = 0; k < K; ++k) {
+        const double one_plus_nB = 1.0 + n[k] * B;
+        const double mu_n = (m + B * sum[k]) / one_plus_nB;
+        // An empty cluster (sums 0) has S_n = S0: its centred sum of squares and deviation term are 0
+        const double xbar = sum[k] / one_if_zero(n[k]);
+        const double ss = sumsq[k] - n[k] * xbar * xbar;
+        const double dev = xbar - m;
+        const double S_n = S0 + 0.5 * ss + 0.5 * (n[k] / one_plus_nB) * dev * dev;
+        const double one_plus_next_nB = one_plus_nB + B;
+        const double diff = x - mu_n;
+        const double delta_S = 0.5 * diff * diff * one_plus_nB / one_plus_next_nB;
+        const double nu_n = nu + 0.5 * n[k];
+        out[k] += -half_log_2pi - 0.5 * log_positive(one_plus_next_nB / one_plus_nB) - 0.5 * log_positive(S_n) -
+                  (nu_n + 0.5) * log_positive(1.0 + delta_S / S_n);
+    }
+}
+
+} // namespace CPU_DISPATCH_NAMESPACE
@@ -0,0 +1,279 @@
+/**
+ * @file gather_kernels.hpp
+ * @brief Member-indexed reductions over distance rows shared by the distance likelihoods
+ *
+ * The inner loops of the likelihoods all read two rows (D and log D) at the indices of a
+ * cluster's members and accumulate both sums. This file provides those reductions with an
+ * unrolled scalar implementation and AVX-512 / AVX2 gather implementations.
+ *
+ * The gather paths are opt-in (-DGATHER_KERNELS_SIMD=1): bench/gather_kernels_bench.cpp shows
+ * them 1.1-1.2x faster when the rows are cache resident but slower once the reads miss cache,
+ * which is the usual case during a sweep. They are compiled for each level in cpu_dispatch and
+ * the one of the CPU is chosen at load time, so no -march flag is needed.
+ *
+ * Each reduction also has an overload on the interleaved single-precision storage
+ * (DistancePair, see Params::use_single_precision()); those read one 8-byte cell per member
+ * and accumulate in double.
+ *
+ * @author Filippo Galli
+ * @date 2025
+ */
+
+#pragma once
+
+#include "DistancePair.hpp"
+#include <cstddef>
+
+#ifndef GATHER_KERNELS_SIMD
+#define GATHER_KERNELS_SIMD 0
+#endif
+
+#if GATHER_KERNELS_SIMD
+#include "cpu_dispatch.hpp"
+#endif
+
+namespace gather_kernels {
+
+/**
+ * @brief gather_sum2() without gathers: two scalar accumulators per row
+ *
+ * @param a First row
+ * @param b Second row
+ * @param idx Member indices
+ * @param m Number of indices
+ * @param sum_a Output: sum of a[idx[i]]
+ * @param sum_b Output: sum of b[idx[i]]
+ */
+inline void gather_sum2_unrolled(const double *__restrict__ a, const double *__restrict__ b,
+                                 const int *__restrict__ idx, int m, double &sum_a, double &sum_b) {
+    double s_a0 = 0, s_a1 = 0, s_b0 = 0, s_b1 = 0;
+    int i = 0;
+    for (; i + 2 <= m; i += 2) {
+        s_a0 += a[idx[i]];
+        s_b0 += b[idx[i]];
+        s_a1 += a[idx[i + 1]];
+        s_b1 += b[idx[i + 1]];
+    }
+    double s_a = s_a0 + s_a1;
+    double s_b = s_b0 + s_b1;
+
+    // Tail
+    for (; i < m; ++i) {
+        s_a += a[idx[i]];
+        s_b += b[idx[i]];
+    }
+
+    sum_a = s_a;
+    sum_b = s_b;
+}
+
+/**
+ * @brief Sums two rows at the given indices in one pass
+ *
+ * @param a First row (e.g. a row of D)
+ * @param b Second row (e.g. the same row of log D)
+ * @param idx Member indices
+ * @param m Number of indices
+ * @param sum_a Output: sum of a[idx[i]]
+ * @param sum_b Output: sum of b[idx[i]]
+ *
+ * @details Both rows are gathered with the same index vector, and two independent
+ * accumulators per row hide the gather latency. The summation order differs from a plain
+ * loop, so results may differ in the last bits.
+ */
+inline void gather_sum2(const double *__restrict__ a, const double *__restrict__ b, const int *__restrict__ idx,
+                        int m, double &sum_a, double &sum_b) {
+#if GATHER_KERNELS_SIMD
+    cpu_dispatch::kernels().gather_sum2(a, b, idx, m, sum_a, sum_b);
+#else
+    gather_sum2_unrolled(a, b, idx, m, sum_a, sum_b);
+#endif
+}
+
+/**
+ * @brief Sums two symmetric matrices over the unordered pairs of a member set
+ *
+ * @param A First matrix (flattened, leading dimension ld)
+ * @param B Second matrix (flattened, leading dimension ld)
+ * @param ld Leading dimension (number of columns)
+ * @param idx Member indices
+ * @param m Number of members
+ * @param sum_a Output: sum of A(idx[i], idx[j]) for i < j
+ * @param sum_b Output: sum of B(idx[i], idx[j]) for i < j
+ */
+inline void pair_sum2(const double *A, const double *B, int ld, const int *idx, int m, double &sum_a,
+                      double &sum_b) {
+    double s_a = 0, s_b = 0;
+    for (int i = 0; i + 1 < m; ++i) {
+        const std::size_t row = static_cast<std::size_t>(idx[i]) * ld;
+        double r_a, r_b;
+        gather_sum2(A + row, B + row, idx + i + 1, m - i - 1, r_a, r_b);
+        s_a += r_a;
+        s_b += r_b;
+    }
+    sum_a = s_a;
+    sum_b = s_b;
+}
+
+/**
+ * @brief Sums two matrices over the cross pairs of two disjoint member sets
+ *
+ * @param A First matrix (flattened, leading dimension ld)
+ * @param B Second matrix (flattened, leading dimension ld)
+ * @param ld Leading dimension (number of columns)
+ * @param idx_k Members of the first set
+ * @param m_k Size of the first set
+ * @param idx_t Members of the second set
+ * @param m_t Size of the second set
+ * @param sum_a Output: sum of A(idx_k[i], idx_t[j]) over all i, j
+ * @param sum_b Output: sum of B(idx_k[i], idx_t[j]) over all i, j
+ */
+inline void cross_sum2(const double *A, const double *B, int ld, const int *idx_k, int m_k, const int *idx_t,
+                       int m_t, double &sum_a, double &sum_b) {
+    double s_a = 0, s_b = 0;
+    for (int i = 0; i < m_k; ++i) {
+        const std::size_t row = static_cast<std::size_t>(idx_k[i]) * ld;
+        double r_a, r_b;
+        gather_sum2(A + row, B + row, idx_t, m_t, r_a, r_b);
+        s_a += r_a;
+        s_b += r_b;
+    }
+    sum_a = s_a;
+    sum_b = s_b;
+}
+
+// ========== Single row (log D unused) ==========
+// With delta1 = 1 (and delta2 = 1 for the repulsion) the log-distance terms of the likelihoods
+// vanish, and these reductions read the D row alone: half the memory traffic of the ones above.
+
+/**
+ * @brief Sums a row at the given indices
+ *
+ * @param a Row (e.g. a row of D)
+ * @param idx Member indices
+ * @param m Number of indices
+ * @return Sum of a[idx[i]]
+ *
+ * @details Two independent accumulators, as the scalar path of gather_sum2(); there is no
+ * gather path, the reads being the bound.
+ */
+inline double gather_sum(const double *__restrict__ a, const int *__restrict__ idx, int m) {
+    double s0 = 0, s1 = 0;
+    int i = 0;
+    for (; i + 2 <= m; i += 2) {
+        s0 += a[idx[i]];
+        s1 += a[idx[i + 1]];
+    }
+    double s = s0 + s1;
+    for (; i < m; ++i)
+        s += a[idx[i]];
+    return s;
+}
+
+/**
+ * @brief Sums a symmetric matrix over the unordered pairs of a member set
+ * @return Sum of A(idx[i], idx[j]) for i < j
+ * @see pair_sum2()
+ */
+inline double pair_sum(const double *A, int ld, const int *idx, int m) {
+    double s = 0;
+    for (int i = 0; i + 1 < m; ++i)
+        s += gather_sum(A + static_cast<std::size_t>(idx[i]) * ld, idx + i + 1, m - i - 1);
+    return s;
+}
+
+/**
+ * @brief Sums a matrix over the cross pairs of two disjoint member sets
+ * @return Sum of A(idx_k[i], idx_t[j]) over all i, j
+ * @see cross_sum2()
+ */
+inline double cross_sum(const double *A, int ld, const int *idx_k, int m_k, const int *idx_t, int m_t) {
+    double s = 0;
+    for (int i = 0; i < m_k; ++i)
+        s += gather_sum(A + static_cast<std::size_t>(idx_k[i]) * ld, idx_t, m_t);
+    return s;
+}
+
+// ========== Single-precision interleaved storage ==========
+
+/**
+ * @brief Sums the D and log D entries of an interleaved row at the given indices
+ *
+ * @param row Row of interleaved pairs
+ * @param idx Member indices
+ * @param m Number of indices
+ * @param sum Output: sum of row[idx[i]].d
+ * @param log_sum Output: sum of row[idx[i]].log_d
+ *
+ * @details Each member costs a single 8-byte read. The floats are widened before being added
+ * to two double accumulators per sum, so the rounding of the storage does not accumulate.
+ */
+inline void gather_sum2(const DistancePair *__restrict__ row, const int *__restrict__ idx, int m, double &sum,
+                        double &log_sum) {
+    double s0 = 0, s1 = 0, l0 = 0, l1 = 0;
+    int i = 0;
+    for (; i + 2 <= m; i += 2) {
+        const DistancePair p0 = row[idx[i]];
+        const DistancePair p1 = row[idx[i + 1]];
+        s0 += p0.d;
+        l0 += p0.log_d;
+        s1 += p1.d;
+        l1 += p1.log_d;
+    }
+    for (; i < m; ++i) {
+        const DistancePair p = row[idx[i]];
+        s0 += p.d;
+        l0 += p.log_d;
+    }
+    sum = s0 + s1;
+    log_sum = l0 + l1;
+}
+
+/**
+ * @brief Sums D and log D over the unordered pairs of a member set, interleaved storage
+ *
+ * @param A Interleaved matrix (flattened, leading dimension ld)
+ * @param ld Leading dimension (number of columns)
+ * @param idx Member indices
+ * @param m Number of members
+ * @param sum Output: sum of A(idx[i], idx[j]).d for i < j
+ * @param log_sum Output: sum of A(idx[i], idx[j]).log_d for i < j
+ */
+inline void pair_sum2(const DistancePair *A, int ld, const int *idx, int m, double &sum, double &log_sum) {
+    double s = 0, l = 0;
+    for (int i = 0; i + 1 < m; ++i) {
+        double r_s, r_l;
+        gather_sum2(A + static_cast<std::size_t>(idx[i]) * ld, idx + i + 1, m - i - 1, r_s, r_l);
+        s += r_s;
+        l += r_l;
+    }
+    sum = s;
+    log_sum = l;
+}
+
+/**
+ * @brief Sums D and log D over the cross pairs of two disjoint member sets, interleaved storage
+ *
+ * @param A Interleaved matrix (flattened, leading dimension ld)
+ * @param ld Leading dimension (number of columns)
+ * @param idx_k Members of the first set
+ * @param m_k Size of the first set
+ * @param idx_t Members of the second set
+ * @param m_t Size of the second set
+ * @param sum Output: sum of A(idx_k[i], idx_t[j]).d over all i, j
+ * @param log_sum Output: sum of A(idx_k[i], idx_t[j]).log_d over all i, j
+ */
+inline void cross_sum2(const DistancePair *A, int ld, const int *idx_k, int m_k, const int *idx_t, int m_t,
+                       double &sum, double &log_sum) {
+    double s = 0, l = 0;
+    for (int i = 0; i < m_k; ++i) {
+        double r_s, r_l;
+        gather_sum2(A + static_cast<std::size_t>(idx_k[i]) * ld, idx_t, m_t, r_s, r_l);
+        s += r_s;
+        l += r_l;
+    }
+    sum = s;
+    log_sum = l;
+}
+
+} // namespace gather_kernels